@@ -0,0 +1,548 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+/*
+ * Benchmark suite: sweeps of representative contractions over the problem
+ * size (no/nv), the number of blocks per orbital space, the number of
+ * threads and the tensor type. Each point is run warmup times untimed and
+ * repeats times timed; the report lists the statistics of the repeats and
+ * the GFLOP/s of the median next to a plain DGEMM of the same shape.
+ *
+ *  ambit_benchmark [--no=10,20] [--nv=40,80] [--blocks=1,2] [--threads=1]
+ *                  [--types=core,disk] [--warmup=1] [--repeats=5]
+ *                  [--filter=name] [--json=results.json]
+ *
+ * The JSON file is the input of compare_benchmarks.py.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+#include <ambit/blocked_tensor.h>
+#include <ambit/print.h>
+#include <ambit/tensor.h>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+using namespace ambit;
+
+namespace
+{
+
+// => Options <= //
+
+struct Options
+{
+    vector<size_t> no = {10, 20};
+    vector<size_t> nv = {40, 80};
+    vector<size_t> blocks = {1, 2};
+    vector<int> threads = {1};
+    vector<TensorType> types = {CoreTensor};
+    int warmup = 1;
+    int repeats = 5;
+    string filter;
+    string json;
+};
+
+vector<string> split_list(const string &list)
+{
+    vector<string> items;
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t end = list.find(',', start);
+        if (end == string::npos)
+            end = list.size();
+        if (end > start)
+            items.push_back(list.substr(start, end - start));
+        start = end + 1;
+    }
+    return items;
+}
+
+template <typename T> vector<T> parse_numbers(const string &list)
+{
+    vector<T> numbers;
+    for (const string &item : split_list(list))
+        numbers.push_back(static_cast<T>(std::stoul(item)));
+    if (numbers.empty())
+        throw std::runtime_error("Empty list of numbers");
+    return numbers;
+}
+
+const char *type_name(TensorType type)
+{
+    return type == DiskTensor ? "disk"
+                              : (type == DistributedTensor ? "distributed"
+                                                           : "core");
+}
+
+Options parse_options(int argc, char *argv[])
+{
+    Options options;
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        string option(argv[arg]);
+        size_t equal = option.find('=');
+        string key = option.substr(0, equal);
+        string value = equal == string::npos ? "" : option.substr(equal + 1);
+        if (key == "--no")
+            options.no = parse_numbers<size_t>(value);
+        else if (key == "--nv")
+            options.nv = parse_numbers<size_t>(value);
+        else if (key == "--blocks")
+            options.blocks = parse_numbers<size_t>(value);
+        else if (key == "--threads")
+            options.threads = parse_numbers<int>(value);
+        else if (key == "--warmup")
+            options.warmup = std::stoi(value);
+        else if (key == "--repeats")
+            options.repeats = std::max(1, std::stoi(value));
+        else if (key == "--filter")
+            options.filter = value;
+        else if (key == "--json")
+            options.json = value;
+        else if (key == "--types")
+        {
+            options.types.clear();
+            for (const string &name : split_list(value))
+            {
+                if (name == "core")
+                    options.types.push_back(CoreTensor);
+                else if (name == "disk")
+                    options.types.push_back(DiskTensor);
+                else if (name == "distributed")
+                    options.types.push_back(DistributedTensor);
+                else
+                    throw std::runtime_error("Unknown tensor type " + name);
+            }
+        }
+        else
+            throw std::runtime_error("Unknown option " + option);
+    }
+    return options;
+}
+
+// => Workloads <= //
+
+/// One point of a sweep
+struct Point
+{
+    size_t no;
+    size_t nv;
+    size_t blocks;
+    int threads;
+    TensorType type;
+};
+
+/// A benchmarked operation, with the DGEMM doing the same arithmetic
+struct Workload
+{
+    double flops = 0.0;
+    /// Shape of the DGEMM baseline, nrow == 0 for none
+    size_t nrow = 0;
+    size_t ncol = 0;
+    size_t nzip = 0;
+    std::function<void()> run;
+};
+
+struct Case
+{
+    string name;
+    /// Does the case sweep the number of blocks?
+    bool blocked;
+    std::function<Workload(const Point &)> build;
+};
+
+void initialize_random(Tensor &tensor)
+{
+    for (double &value : tensor.data())
+        value = std::rand() / static_cast<double>(RAND_MAX);
+}
+
+Tensor build_random(TensorType type, const string &name, const Dimension &dims)
+{
+    Tensor tensor = Tensor::build(CoreTensor, name, dims);
+    initialize_random(tensor);
+    return type == CoreTensor ? tensor : tensor.clone(type);
+}
+
+BlockedTensor build_random_blocked(TensorType type, const string &name,
+                                   const vector<string> &blocks)
+{
+    BlockedTensor tensor = BlockedTensor::build(type, name, blocks);
+    for (auto &block : tensor.blocks())
+    {
+        Tensor T = block.second;
+        T.copy(build_random(CoreTensor, T.name(), T.dims()));
+    }
+    return tensor;
+}
+
+/// Splits the occupied (o, indices i,j,k,l) and virtual (v, indices a,b,c,d)
+/// orbitals into point.blocks spaces each
+void set_blocked_spaces(const Point &point)
+{
+    static const char occupied[] = "ABCDEFGH";
+    static const char virtuals[] = "QRSTUWXY";
+    if (point.blocks > 8 || point.blocks > point.no)
+        throw std::runtime_error("Unsupported number of blocks");
+
+    BlockedTensor::reset_mo_spaces();
+    vector<string> ospaces;
+    vector<string> vspaces;
+    for (size_t block = 0; block < point.blocks; ++block)
+    {
+        vector<size_t> omos, vmos;
+        for (size_t mo = block; mo < point.no; mo += point.blocks)
+            omos.push_back(mo);
+        for (size_t mo = block; mo < point.nv; mo += point.blocks)
+            vmos.push_back(mo);
+        string oname(1, occupied[block]);
+        string vname(1, virtuals[block]);
+        BlockedTensor::add_mo_space(oname, oname + "1," + oname + "2", omos,
+                                    NoSpin);
+        BlockedTensor::add_mo_space(vname, vname + "1," + vname + "2", vmos,
+                                    NoSpin);
+        ospaces.push_back(oname);
+        vspaces.push_back(vname);
+    }
+    BlockedTensor::add_composite_mo_space("o", "i,j,k,l", ospaces);
+    BlockedTensor::add_composite_mo_space("v", "a,b,c,d", vspaces);
+}
+
+/// A GEMM-like workload of nrow x ncol x nzip
+Workload gemm_like(size_t nrow, size_t ncol, size_t nzip,
+                   const std::function<void()> &run)
+{
+    Workload work;
+    work.flops = 2.0 * nrow * ncol * nzip;
+    work.nrow = nrow;
+    work.ncol = ncol;
+    work.nzip = nzip;
+    work.run = run;
+    return work;
+}
+
+/// Particle-particle ladder, a plain GEMM after no permutation
+Workload ladder(const Point &p)
+{
+    Tensor C = build_random(p.type, "C", {p.no, p.no, p.nv, p.nv});
+    Tensor V = build_random(p.type, "V", {p.nv, p.nv, p.nv, p.nv});
+    Tensor T = build_random(p.type, "T", {p.no, p.no, p.nv, p.nv});
+    return gemm_like(p.no * p.no, p.nv * p.nv, p.nv * p.nv,
+                     [=]() mutable { C("ijab") = T("ijcd") * V("cdab"); });
+}
+
+/// Ring term, where all three operands are permuted
+Workload ring(const Point &p)
+{
+    Tensor C = build_random(p.type, "C", {p.no, p.no, p.nv, p.nv});
+    Tensor W = build_random(p.type, "W", {p.no, p.nv, p.no, p.nv});
+    Tensor T = build_random(p.type, "T", {p.no, p.no, p.nv, p.nv});
+    return gemm_like(p.no * p.nv, p.no * p.nv, p.no * p.nv,
+                     [=]() mutable { C("ijab") += W("kbjc") * T("ikac"); });
+}
+
+/// Matrix-vector shaped singles term
+Workload singles(const Point &p)
+{
+    Tensor C = build_random(p.type, "C", {p.no, p.nv});
+    Tensor V = build_random(p.type, "V", {p.no, p.nv, p.no, p.nv});
+    Tensor T = build_random(p.type, "T", {p.no, p.nv});
+    return gemm_like(p.no * p.nv, 1, p.no * p.nv,
+                     [=]() mutable { C("ia") = V("iajb") * T("jb"); });
+}
+
+/// Pure data movement, without a DGEMM baseline
+Workload permute(const Point &p)
+{
+    Tensor C = build_random(p.type, "C", {p.nv, p.no, p.nv, p.no});
+    Tensor A = build_random(p.type, "A", {p.no, p.no, p.nv, p.nv});
+    Workload work;
+    work.run = [=]() mutable { C("aibj") = A("ijab"); };
+    return work;
+}
+
+/// The ladder over blocks of the orbital spaces
+Workload blocked_ladder(const Point &p)
+{
+    set_blocked_spaces(p);
+    BlockedTensor C = build_random_blocked(p.type, "C", {"oovv"});
+    BlockedTensor V = build_random_blocked(p.type, "V", {"vvvv"});
+    BlockedTensor T = build_random_blocked(p.type, "T", {"oovv"});
+    return gemm_like(p.no * p.no, p.nv * p.nv, p.nv * p.nv,
+                     [=]() mutable { C["ijab"] = T["ijcd"] * V["cdab"]; });
+}
+
+/// The ring term over blocks of the orbital spaces
+Workload blocked_ring(const Point &p)
+{
+    set_blocked_spaces(p);
+    BlockedTensor C = build_random_blocked(p.type, "C", {"oovv"});
+    BlockedTensor W = build_random_blocked(p.type, "W", {"ovov"});
+    BlockedTensor T = build_random_blocked(p.type, "T", {"oovv"});
+    return gemm_like(p.no * p.nv, p.no * p.nv, p.no * p.nv,
+                     [=]() mutable { C["ijab"] += W["kbjc"] * T["ikac"]; });
+}
+
+const vector<Case> cases = {{"ladder", false, ladder},
+                            {"ring", false, ring},
+                            {"singles", false, singles},
+                            {"permute", false, permute},
+                            {"blocked ladder", true, blocked_ladder},
+                            {"blocked ring", true, blocked_ring}};
+
+// => Measurement <= //
+
+/// Wall times in seconds of repeats runs, after warmup untimed runs
+vector<double> measure(const std::function<void()> &run, int warmup,
+                       int repeats)
+{
+    for (int n = 0; n < warmup; ++n)
+        run();
+    vector<double> times;
+    for (int n = 0; n < repeats; ++n)
+    {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        std::chrono::duration<double> time =
+            std::chrono::steady_clock::now() - start;
+        times.push_back(time.count());
+    }
+    return times;
+}
+
+struct Statistics
+{
+    double min;
+    double median;
+    double mean;
+    double stddev;
+};
+
+Statistics statistics(vector<double> times)
+{
+    std::sort(times.begin(), times.end());
+    Statistics stats;
+    size_t n = times.size();
+    stats.min = times.front();
+    stats.median =
+        n % 2 ? times[n / 2] : 0.5 * (times[n / 2 - 1] + times[n / 2]);
+    stats.mean = 0.0;
+    for (double time : times)
+        stats.mean += time / n;
+    double variance = 0.0;
+    for (double time : times)
+        variance += (time - stats.mean) * (time - stats.mean);
+    stats.stddev = n > 1 ? std::sqrt(variance / (n - 1)) : 0.0;
+    return stats;
+}
+
+/// GFLOP/s of the median DGEMM of the shape, through Tensor::gemm
+double dgemm_gflops(size_t nrow, size_t ncol, size_t nzip,
+                    const Options &options)
+{
+    Tensor A = build_random(CoreTensor, "A", {nrow, nzip});
+    Tensor B = build_random(CoreTensor, "B", {nzip, ncol});
+    Tensor C = Tensor::build(CoreTensor, "C", {nrow, ncol});
+    Statistics stats = statistics(measure(
+        [&]() {
+            C.gemm(A, B, false, false, nrow, ncol, nzip, nzip, ncol, ncol, 0,
+                   0, 0, 1.0, 0.0);
+        },
+        options.warmup, options.repeats));
+    return stats.median > 0.0 ? 2.0 * nrow * ncol * nzip / stats.median / 1e9
+                              : 0.0;
+}
+
+void set_threads(int threads)
+{
+#if defined(_OPENMP)
+    omp_set_num_threads(threads);
+#else
+    (void)threads;
+#endif
+}
+
+struct Result
+{
+    string name;
+    Point point;
+    Statistics stats;
+    double flops;
+    double gflops;
+    double dgemm_gflops;
+};
+
+/// DGEMM baselines by shape and thread count
+map<vector<size_t>, double> baselines;
+
+Result run_point(const Case &c, const Point &point, const Options &options)
+{
+    Result r;
+    r.name = c.name;
+    r.point = point;
+    Workload work = c.build(point);
+    r.stats = statistics(measure(work.run, options.warmup, options.repeats));
+    r.flops = work.flops;
+    r.gflops =
+        r.stats.median > 0.0 ? work.flops / r.stats.median / 1e9 : 0.0;
+    r.dgemm_gflops = 0.0;
+    if (work.nrow)
+    {
+        vector<size_t> key = {work.nrow, work.ncol, work.nzip,
+                              static_cast<size_t>(point.threads)};
+        if (!baselines.count(key))
+            baselines[key] =
+                dgemm_gflops(work.nrow, work.ncol, work.nzip, options);
+        r.dgemm_gflops = baselines[key];
+    }
+    return r;
+}
+
+// => Reporting <= //
+
+void print_header()
+{
+    ambit::print("%-16s %-5s %4s %4s %3s %3s %10s %10s %9s %8s %8s %6s\n",
+                 "Case", "Type", "no", "nv", "blk", "thr", "median ms",
+                 "min ms", "stddev %", "GFLOP/s", "DGEMM", "ratio");
+}
+
+void print_result(const Result &r)
+{
+    ambit::print(
+        "%-16s %-5s %4zu %4zu %3zu %3d %10.3f %10.3f %9.1f %8.2f %8.2f %6.2f\n",
+        r.name.c_str(), type_name(r.point.type), r.point.no, r.point.nv,
+        r.point.blocks, r.point.threads, 1e3 * r.stats.median,
+        1e3 * r.stats.min,
+        r.stats.mean > 0.0 ? 100.0 * r.stats.stddev / r.stats.mean : 0.0,
+        r.gflops, r.dgemm_gflops,
+        r.dgemm_gflops > 0.0 ? r.gflops / r.dgemm_gflops : 0.0);
+}
+
+void write_json(const string &filename, const vector<Result> &results,
+                const Options &options)
+{
+    std::ofstream out(filename);
+    if (!out)
+        throw std::runtime_error("Unable to open " + filename);
+    out.precision(10);
+    out << "{\"warmup\": " << options.warmup
+        << ", \"repeats\": " << options.repeats << ", \"benchmarks\": [";
+    for (size_t n = 0; n < results.size(); ++n)
+    {
+        const Result &r = results[n];
+        out << (n ? ",\n" : "\n") << "  {\"name\": \"" << r.name
+            << "\", \"type\": \"" << type_name(r.point.type)
+            << "\", \"no\": " << r.point.no << ", \"nv\": " << r.point.nv
+            << ", \"blocks\": " << r.point.blocks
+            << ", \"threads\": " << r.point.threads
+            << ", \"min_s\": " << r.stats.min
+            << ", \"median_s\": " << r.stats.median
+            << ", \"mean_s\": " << r.stats.mean
+            << ", \"stddev_s\": " << r.stats.stddev
+            << ", \"flops\": " << r.flops << ", \"gflops\": " << r.gflops
+            << ", \"dgemm_gflops\": " << r.dgemm_gflops << "}";
+    }
+    out << "\n]}\n";
+}
+}
+
+int main(int argc, char *argv[])
+{
+    ambit::initialize(argc, argv);
+
+    int status = EXIT_SUCCESS;
+    try
+    {
+        Options options = parse_options(argc, argv);
+        vector<Result> results;
+
+        print_header();
+        for (int threads : options.threads)
+        {
+            set_threads(threads);
+            for (TensorType type : options.types)
+                for (size_t no : options.no)
+                    for (size_t nv : options.nv)
+                        for (const Case &c : cases)
+                        {
+                            if (!options.filter.empty() &&
+                                c.name.find(options.filter) == string::npos)
+                                continue;
+                            for (size_t nblock : options.blocks)
+                            {
+                                // Only the blocked cases sweep the blocks
+                                if (!c.blocked && nblock != options.blocks[0])
+                                    continue;
+                                Point point = {no, nv, c.blocked ? nblock : 1,
+                                               threads, type};
+                                try
+                                {
+                                    results.push_back(
+                                        run_point(c, point, options));
+                                    print_result(results.back());
+                                }
+                                catch (const std::exception &e)
+                                {
+                                    // e.g. a type without some operation
+                                    ambit::print("%-16s %-5s skipped: %s\n",
+                                                 c.name.c_str(),
+                                                 type_name(type), e.what());
+                                }
+                            }
+                        }
+        }
+        BlockedTensor::reset_mo_spaces();
+
+        if (!options.json.empty())
+            write_json(options.json, results, options);
+    }
+    catch (const std::exception &e)
+    {
+        ambit::print("ambit_benchmark: %s\n", e.what());
+        status = EXIT_FAILURE;
+    }
+
+    ambit::finalize();
+    return status;
+}
@@ -0,0 +1,98 @@
+#!/usr/bin/env python
+#
+# @BEGIN LICENSE
+#
+# ambit: ambit: C++ library for the implementation of tensor product calculations
+#        through a clean, concise user interface.
+#
+# Copyright (c) 2014-2017 Ambit developers.
+#
+# The copyrights for code used from other parties are included in
+# the corresponding files.
+#
+# This file is part of ambit.
+#
+# Ambit is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, version 3.
+#
+# Ambit is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License along
+# with ambit; if not, write to the Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+# @END LICENSE
+#
+"""Compares two result files of ambit_benchmark --json.
+
+    compare_benchmarks.py baseline.json current.json [--threshold 0.10]
+
+Benchmarks are matched by case, tensor type, no, nv, blocks and threads.
+The median times are compared; the exit status is 1 if any benchmark is
+slower than the baseline by more than the threshold (a fraction), so the
+script can gate upgrades.
+"""
+
+from __future__ import print_function
+
+import argparse
+import json
+import sys
+
+
+def load(filename):
+    with open(filename) as f:
+        results = json.load(f)
+    benchmarks = {}
+    for b in results["benchmarks"]:
+        key = (b["name"], b["type"], b["no"], b["nv"], b["blocks"],
+               b["threads"])
+        benchmarks[key] = b
+    return benchmarks
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="tolerated slowdown of the median (default 0.10)")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    print("%-16s %-5s %4s %4s %3s %3s %11s %11s %8s" %
+          ("Case", "Type", "no", "nv", "blk", "thr", "base ms", "new ms",
+           "change"))
+    regressions = 0
+    for key in sorted(set(baseline) & set(current)):
+        old = baseline[key]["median_s"]
+        new = current[key]["median_s"]
+        change = (new - old) / old if old > 0.0 else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        print("%-16s %-5s %4d %4d %3d %3d %11.3f %11.3f %+7.1f%%%s" %
+              (key + (1e3 * old, 1e3 * new, 100.0 * change, flag)))
+
+    for key in sorted(set(baseline) ^ set(current)):
+        side = "baseline" if key in baseline else "current"
+        print("%s (%s, no %d, nv %d, blocks %d, threads %d) only in %s" %
+              (key + (side,)))
+
+    if regressions:
+        print("\n%d benchmark(s) slower than the baseline by more than %.0f%%"
+              % (regressions, 100.0 * args.threshold))
+        return 1
+    print("\nNo regressions beyond %.0f%%" % (100.0 * args.threshold))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -31,9 +31,11 @@
 #define TENSOR_INCLUDE_BLOCKED_TENSOR_H
 
 #include <cstdio>
+#include <future>
 #include <utility>
 #include <vector>
 #include <map>
+#include <set>
 #include <string>
 
 #include <ambit/tensor.h>
@@ -47,6 +49,14 @@ class LabeledBlockedTensorBatchedProduct;
 class LabeledBlockedTensorAddition;
 class LabeledBlockedTensorDistributive;
 
+namespace io
+{
+namespace hdf5
+{
+struct Location;
+}
+}
+
 enum SpinType
 {
     AlphaSpin,
@@ -122,6 +132,37 @@ class MOSpace
     std::vector<SpinType> spin_;
 };
 
+/**
+ * The MO spaces and modes used by BlockedTensor.
+ *
+ * The spaces live in a context so that independent calculations can run
+ * side by side in one process: each thread works on the context it set with
+ * BlockedTensor::set_context, and the threads that set none share a process
+ * default. A context may be shared by several threads as long as the spaces
+ * are not modified while they run.
+ */
+struct MOSpaceContext
+{
+    /// A vector of MOSpace objects
+    std::vector<MOSpace> mo_spaces;
+    /// Maps the name of MOSpace (e.g. "o") to the position of the object in
+    /// the vector mo_spaces
+    std::map<std::string, size_t> name_to_mo_space;
+    /// Maps the name of a composite orbital space (e.g. "h") to the MOSpace
+    /// objects that it spans
+    std::map<std::string, std::vector<size_t>> composite_name_to_mo_spaces;
+    /// Maps an orbital index (e.g. "i","j") to the MOSpace objects that
+    /// contain it
+    std::map<std::string, std::vector<size_t>> index_to_mo_spaces;
+    /// Enables expert mode, which overides some default error checking
+    bool expert_mode = false;
+    /// Stores spin-flipped blocks once (see set_restricted_spin)
+    bool restricted_spin = false;
+    /// The block keys of the label lists resolved so far
+    std::map<std::vector<std::string>, std::vector<std::vector<size_t>>>
+        block_keys;
+};
+
 /**
  * Class BlockedTensor
  * Represent a tensor aware of spin and MO spaces.
@@ -175,6 +216,63 @@ class BlockedTensor
     static BlockedTensor build(TensorType type, const std::string &name,
                                const std::vector<std::string> &blocks);
 
+    /**
+     * Build a BlockedTensor whose blocks are placed across the MPI processes
+     *
+     * Every block is a CoreTensor stored by one process, its owner, chosen
+     * by balance_blocks so that the processes hold similar numbers of
+     * elements. This suits tensors of many small blocks, which a
+     * DistributedTensor would spread (and communicate) over every process.
+     *
+     * A block product runs on the owner of its result block, and only the
+     * operand blocks it needs are sent there from their owners (replicated
+     * tensors, built with build, are available everywhere). Additions and
+     * contractions, including scalar ones, and norm work across processes;
+     * zero, scale, set and iterate act on the blocks of each process, and
+     * block() can only return the local blocks. Batched contractions are
+     * not supported. Without MPI the single process owns every block.
+     *
+     * @param name            The name of the tensor for use in printing.
+     * @param blocks          The blocks contained in this object (as for
+     * build).
+     */
+    static BlockedTensor build_distributed(const std::string &name,
+                                           const std::vector<std::string> &blocks);
+
+    /**
+     * Build a BlockedTensor whose blocks, of the given type, are placed
+     * across the MPI processes as for build_distributed.
+     *
+     * With DiskTensor the blocks of a tensor are striped over the scratch
+     * paths of the processes (each process sets its own, e.g. a node-local
+     * disk, with TENSOR_SCRATCH), so the tensor may exceed the disk of one
+     * node and its blocks are read with the bandwidth of all of them. A
+     * block needed by a product on another process is read by its owner and
+     * sent as a CoreTensor.
+     *
+     * @param type            The type of the blocks (CoreTensor or
+     * DiskTensor).
+     * @param name            The name of the tensor for use in printing.
+     * @param blocks          The blocks contained in this object (as for
+     * build).
+     */
+    static BlockedTensor build_distributed(TensorType type,
+                                           const std::string &name,
+                                           const std::vector<std::string> &blocks);
+
+    /**
+     * Assigns blocks to processes, largest first to the least loaded
+     * process, so that the total cost of each process is balanced. The
+     * result is the same on every process.
+     *
+     * @param costs           The cost (e.g. the number of elements) of each
+     * block.
+     * @param nprocess        The number of processes.
+     * @return The process assigned to each block
+     */
+    static std::vector<int> balance_blocks(const std::vector<double> &costs,
+                                           int nprocess);
+
     static void add_mo_space(const std::string &name,
                              const std::string &mo_indices,
                              std::vector<size_t> mos, SpinType spin);
@@ -188,7 +286,52 @@ class BlockedTensor
     static void reset_mo_spaces();
     static void print_mo_spaces();
 
-    static void set_expert_mode(bool mode) { expert_mode_ = mode; }
+    /// @return The MO space context of the calling thread
+    static const std::shared_ptr<MOSpaceContext> &context();
+    /**
+     * Makes the calling thread use the MO spaces of context, e.g.
+     *  BlockedTensor::set_context(std::make_shared<MOSpaceContext>());
+     *  BlockedTensor::add_mo_space("o", "i,j", {0, 1}, NoSpin);
+     * A null context restores the process default.
+     * @return The context previously set on this thread (null if none)
+     */
+    static std::shared_ptr<MOSpaceContext>
+    set_context(const std::shared_ptr<MOSpaceContext> &context);
+    /// @return The n-th MOSpace, n being an entry of a block key
+    static MOSpace mo_space(size_t n) { return context()->mo_spaces[n]; }
+
+    /**
+     * Builds the denominator epilogue of a block (see Epilogue::denominator)
+     * from orbital energies. epsilon holds one energy per MO, and each index
+     * of the block takes the energies of the MOs of its space, e.g.
+     *  T.block("oovv").contract(A, B, ..., BlockedTensor::denominator(
+     *      "oovv", epsilon, {1.0, 1.0, -1.0, -1.0}));
+     */
+    static Epilogue denominator(const std::string &block,
+                                const std::vector<double> &epsilon,
+                                const std::vector<double> &signs,
+                                double shift = 0.0);
+
+    static void set_expert_mode(bool mode) { context()->expert_mode = mode; }
+
+    /**
+     * Enables restricted-spin mode for the tensors built from now on.
+     *
+     * For closed-shell references a block equals the block with every spin
+     * flipped (e.g. "OOVV" equals "oovv"). In this mode a tensor stores only
+     * the canonical block of such a pair, the one whose first spin index is
+     * alpha, and the other block is an alias of the same storage. Results
+     * are then computed for the canonical blocks alone, which roughly halves
+     * the memory and the FLOPs of spin-orbital expressions: writes to an
+     * aliased block are skipped, so a statement for the beta-beta blocks
+     * (e.g. R["IJAB"] += ...) is a no-op next to its alpha-alpha twin, which
+     * must be present.
+     *
+     * The partner of a space is the space of opposite spin whose name
+     * differs only in case (as made by spin_cases). All the tensors of an
+     * expression must be spin symmetric in this sense.
+     */
+    static void set_restricted_spin(bool mode) { context()->restricted_spin = mode; }
 
     // => Accessors <= //
 
@@ -241,6 +384,14 @@ class BlockedTensor
     bool is_block(const std::string &indices) const;
     /// Is this block present?
     bool is_block(const std::vector<size_t> &key) const;
+    /// Does this block share the storage of its spin-flipped block (see
+    /// set_restricted_spin)?
+    bool is_alias(const std::vector<size_t> &key) const;
+    /// Were the blocks placed across the processes (see build_distributed)?
+    bool block_distributed() const { return !owners_.empty(); }
+    /// @return The process that stores this block (see build_distributed),
+    /// or -1 if every process stores it
+    int block_owner(const std::vector<size_t> &key) const;
 
     /// Return a Tensor object that corresponds to a given orbital class
     Tensor block(const std::vector<size_t> &key);
@@ -263,6 +414,30 @@ class BlockedTensor
      **/
     double norm(int type = 2) const;
 
+    /// @return The two-norm of every block, as used to screen block products
+    /// (see settings::block_screening)
+    std::map<std::vector<size_t>, double> block_norms() const;
+
+    /**
+     * Drops the blocks whose elements are all below threshold, so that
+     * numerically zero blocks are not stored (an aliased block goes with
+     * its partner). Contractions read the dropped blocks as zero when
+     * settings::block_screening is set, or in expert mode; other operations
+     * on them fail.
+     *
+     * Block-distributed tensors (see build_distributed) are not supported.
+     *
+     * @return The number of blocks dropped
+     */
+    size_t drop_zero_blocks(double threshold);
+
+    /**
+     * Computes the statistics of the elements of all blocks, in one pass
+     * over each block (see Tensor::stats). The indices of the maximum and
+     * minimum are MO indices (MOSpace::mos) rather than block positions.
+     **/
+    TensorStats stats() const;
+
     /**
      * Sets the data of the tensor to zeros.
      * Note: this just drops down to scale(0.0);
@@ -297,6 +472,66 @@ class BlockedTensor
      **/
     //    void copy(const BlockedTensor& other);
 
+    // => Rank-2 LAPACK-Type Operations <= //
+
+    /**
+     * Diagonalizes every diagonal block (e.g. "oo", "vv", "OO") of a
+     * block-diagonal matrix, the blocks concurrently (see Tensor::syev).
+     * A block aliased in restricted-spin mode shares the results of its
+     * partner. Off-diagonal blocks are not allowed.
+     *
+     * @returns map with the keys "eigenvalues", with a rank-1 block per
+     * space (e.g. "o", "v"), and "eigenvectors", with the blocks of this.
+     */
+    std::map<std::string, BlockedTensor> syev(EigenvalueOrder order) const;
+    /// Raises every diagonal block to power, the blocks concurrently (see
+    /// syev and Tensor::power)
+    BlockedTensor power(double power, double condition = 1.0E-12) const;
+    /// Inverts every diagonal block, the blocks concurrently (see syev and
+    /// Tensor::inverse)
+    BlockedTensor inverse() const;
+
+    // => Checkpointing <= //
+
+    /**
+     * Saves the tensor to an HDF5 location (a file or a group): one dataset
+     * per block, named by its label (e.g. "oOvV"), plus the name of the
+     * tensor and the MO spaces of its blocks. A block aliased in
+     * restricted-spin mode is saved once. Saving again to the same location
+     * overwrites the datasets in place.
+     *
+     * Block-distributed tensors (see build_distributed) are not supported.
+     */
+    void save(const io::hdf5::Location &location) const;
+
+    /**
+     * Saves the tensor like save, in the background, to the group of an
+     * HDF5 file (created if needed; empty for the root of the file). The
+     * blocks are copied first, so the tensor may be changed as soon as this
+     * returns, e.g. by the next iteration. Only the first process writes.
+     * No other HDF5 calls on the file may be made until the returned future
+     * is ready; its get() rethrows an error of the write.
+     *
+     * The blocks must be CoreTensor's or DiskTensor's.
+     */
+    std::future<void> save_async(const std::string &filename,
+                                 const std::string &group = "") const;
+
+    /**
+     * Loads a tensor saved by save. Its MO spaces are defined if they are
+     * not already, and must match the current ones if they are.
+     *
+     * CoreTensor blocks are read on their first use (see
+     * Tensor::build_deferred), so the file must stay in place until then;
+     * DiskTensor blocks are read at once through their mapping, and
+     * DistributedTensor blocks a share of rows per process.
+     *
+     * @param location        The file or group the tensor was saved to.
+     * @param type            The tensor type of the blocks.
+     */
+    static BlockedTensor load(const io::hdf5::Location &location,
+                              TensorType type = CoreTensor);
+
     // => Iterators <= //
 
     /**
@@ -325,6 +560,37 @@ class BlockedTensor
     std::string name_;
     std::size_t rank_;
     std::map<std::vector<size_t>, Tensor> blocks_;
+    /// The keys of the blocks that alias their spin-flipped block
+    std::set<std::vector<size_t>> aliases_;
+    /// The owner of every block of a tensor built by build_distributed
+    std::map<std::vector<size_t>, int> owners_;
+
+    /** Moves blocks between processes.
+     *
+     * needs lists (process, key) pairs of the blocks each process reads and
+     * must be the same on every process. Each block is sent by its owner to
+     * every process in needs that does not store it.
+     *
+     * @return The blocks received by this process
+     */
+    std::map<std::vector<size_t>, Tensor> exchange_blocks(
+        const std::vector<std::pair<int, std::vector<size_t>>> &needs) const;
+
+    /** Builds a zeroed CoreTensor-backed BlockedTensor for an intermediate.
+     *
+     * The block storage is drawn from the library scratch pool, so the
+     * intermediates of repeated statements (e.g. across the iterations of
+     * an amplitude equation) reuse the storage of earlier ones of the same
+     * shape. The idle storage kept by the pool is capped by
+     * settings::memory_limit.
+     */
+    static BlockedTensor
+    build_intermediate(const std::string &name,
+                       const std::vector<std::string> &blocks);
+    static BlockedTensor build_blocks(TensorType type, const std::string &name,
+                                      const std::vector<std::string> &blocks,
+                                      bool intermediate,
+                                      bool distributed = false);
 
     /// A vector of MOSpace objects
     size_t add_mo_space(MOSpace mo_space);
@@ -335,6 +601,24 @@ class BlockedTensor
     bool map_index_to_mo_spaces(const std::string &index,
                                 const std::vector<size_t> &mo_spaces_idx);
     static std::vector<size_t> indices_to_key(const std::string &indices);
+    /// @return The key with the spin of every space flipped, or key itself
+    /// if a space has no partner of opposite spin
+    static std::vector<size_t> spin_flipped_key(const std::vector<size_t> &key);
+    /** Applies op to every diagonal block, the blocks concurrently.
+     *
+     * @return For each block key, the tensors returned by op
+     */
+    std::map<std::vector<size_t>, std::map<std::string, Tensor>>
+    map_diagonal_blocks(
+        const std::string &caller,
+        const std::function<std::map<std::string, Tensor>(const Tensor &)> &op)
+        const;
+    /// Builds a rank-2 (or rank-1, for one index per key) BlockedTensor
+    /// named name from the tensors of map_diagonal_blocks found under label
+    BlockedTensor diagonal_result(
+        const std::string &name, const std::string &label, size_t rank,
+        const std::map<std::vector<size_t>, std::map<std::string, Tensor>>
+            &results) const;
     static std::vector<std::string> indices_to_block_labels(
             const Indices &indices,
             const std::vector<std::vector<size_t>> &unique_indices_keys,
@@ -346,8 +630,6 @@ class BlockedTensor
             const std::map<std::vector<size_t>, Tensor> &blocks,
             bool full_contraction);
 
-    /// @return The n-th MOSpace
-    static MOSpace mo_space(size_t n) { return mo_spaces_[n]; }
     /// @return The MOSpace corresponding to the name of a space
     size_t name_to_mo_space(const std::string &index);
     /// @return The MOSpace objects corresponding to the name of a space
@@ -355,26 +637,11 @@ class BlockedTensor
     /// @return The MOSpace objects corresponding to an orbital index
     std::vector<size_t> &index_to_mo_spaces(const std::string &index);
 
-    // => Static Class Data <= //
-
-    /// A vector of MOSpace objects
-    static std::vector<MOSpace> mo_spaces_;
-    /// Maps the name of MOSpace (e.g. "o") to the position of the object in the
-    /// vector mo_spaces_
-    static std::map<std::string, size_t> name_to_mo_space_;
-    /// Maps the name of a composite orbital space (e.g. "h") to the MOSpace
-    /// objects that it spans
-    static std::map<std::string, std::vector<size_t>>
-        composite_name_to_mo_spaces_;
-    /// Maps an orbital index (e.g. "i","j") to the MOSpace objects that contain
-    /// it
-    static std::map<std::string, std::vector<size_t>> index_to_mo_spaces_;
-    /// Enables expert mode, which overides some default error checking
-    static bool expert_mode_;
-
   public:
     /// @return Is BlockedTensor using "expert mode"?
-    static bool expert_mode() { return expert_mode_; }
+    static bool expert_mode() { return context()->expert_mode; }
+    /// @return Is BlockedTensor in restricted-spin mode?
+    static bool restricted_spin() { return context()->restricted_spin; }
 
   protected:
   public:
@@ -453,12 +720,24 @@ class LabeledBlockedTensor
 
   private:
     void set(const LabeledBlockedTensor &to);
+    void set(LabeledBlockedTensor &&to);
 
     std::vector<std::vector<size_t>> label_to_block_keys() const
     {
         return BT_.label_to_block_keys(indices_);
     }
     void add(const LabeledBlockedTensor &rhs, double alpha, double beta);
+    /// Adds alpha times every term of rhs (to zero if zero_result), writing
+    /// each lhs block once through Tensor::permute_sum
+    void add_sum(const LabeledBlockedTensorAddition &rhs, double alpha,
+                 bool zero_result);
+    /// contract_pair for block-distributed tensors (see
+    /// BlockedTensor::build_distributed)
+    void contract_pair_distributed(
+        const LabeledBlockedTensorProduct &rhs, bool zero_result, bool add,
+        const std::vector<std::vector<size_t>> &unique_indices_keys,
+        const std::vector<size_t> &result_pos,
+        const std::vector<std::vector<size_t>> &term_pos);
 
     BlockedTensor BT_;
     std::vector<std::string> indices_;
@@ -509,6 +788,23 @@ class LabeledBlockedTensorProduct
             const std::map<std::string, size_t> &index_map,
             bool full_contraction) const;
 
+    /// Cost (cpu, memory) of contracting two operands with the given
+    /// (sorted) indices, summed over the blocks they touch
+    pair<double, double>
+    compute_pair_contraction_cost(
+            const Indices &first, const Indices &second,
+            const std::vector<std::vector<size_t>> &unique_indices_keys,
+            const std::map<std::string, size_t> &index_map,
+            bool full_contraction) const;
+
+    /// The cheapest left-to-right order of the terms
+    vector<size_t>
+    optimal_order(
+            const Indices &result,
+            const std::vector<std::vector<size_t>> &unique_indices_keys,
+            const std::map<std::string, size_t> &index_map,
+            bool full_contraction) const;
+
   private:
     std::vector<LabeledBlockedTensor> tensors_;
 };
@@ -530,8 +826,13 @@ class LabeledBlockedTensorBatchedProduct
     Indices batched_indices_;
 };
 
+/// Evaluates product in batches over batched_indices (see the batched()
+/// of labeled tensors in ambit/tensor.h)
 LabeledBlockedTensorBatchedProduct batched(const string &batched_indices, const LabeledBlockedTensorProduct &product);
 
+/// Same, with the batched index picked from the sizes of the intermediates
+LabeledBlockedTensorBatchedProduct batched(const LabeledBlockedTensorProduct &product);
+
 class LabeledBlockedTensorAddition
 {
   public:
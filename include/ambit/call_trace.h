@@ -0,0 +1,100 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#ifndef AMBIT_CALL_TRACE_H
+#define AMBIT_CALL_TRACE_H
+
+#include <ambit/common_types.h>
+#include <ambit/tensor.h>
+
+namespace ambit
+{
+
+/**
+ * A log of the Tensor::contract, Tensor::permute and Tensor::slice calls of
+ * a run, with shapes but no data, so that a workload can be replayed on
+ * random tensors (see test/replay_trace.cc).
+ *
+ * The log is a text file with one call per line, after a "#" header line:
+ *
+ *  contract alpha beta C A B
+ *  permute alpha beta C A
+ *  slice alpha beta C A
+ *
+ * where each operand is written as "type dims labels", the type being one of
+ * core, disk or distributed, the dims a comma-separated list and the labels
+ * either the comma-separated indices (contract and permute) or the
+ * comma-separated lo:hi ranges (slice). Empty lists are written as "-".
+ *
+ * Setting the environment variable AMBIT_CALL_TRACE to a file name logs
+ * the whole run, from ambit::initialize to ambit::finalize.
+ *
+ * Sample usage:
+ *  call_trace::start("run.trace");
+ *  ...
+ *  call_trace::stop();
+ **/
+namespace call_trace
+{
+
+/// One traced call
+struct Call
+{
+    /// "contract", "permute" or "slice"
+    string kind;
+    double alpha;
+    double beta;
+    /// The operands C, A and (for contract) B
+    vector<TensorType> types;
+    vector<Dimension> dims;
+    /// The indices of each operand, for contract and permute
+    vector<Indices> indices;
+    /// The ranges of C and A, for slice
+    vector<IndexRange> ranges;
+};
+
+/// Start logging calls to filename, which is overwritten
+void start(const string &filename);
+
+/// Stop logging and close the file. Does nothing if not logging.
+void stop();
+
+/// @return Is a log being written?
+bool active();
+
+/// Append call to the log (does nothing if not logging), thread safe
+void record(const Call &call);
+
+/// @return the calls logged in filename, throws if the file is malformed
+vector<Call> read(const string &filename);
+}
+}
+
+#endif // AMBIT_CALL_TRACE_H
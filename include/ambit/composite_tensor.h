@@ -41,6 +41,39 @@
 namespace ambit
 {
 
+/**
+ * Fused operations on collections of tensors of one shape, e.g. the
+ * history vectors of DIIS or the subspace of a Davidson solver.
+ *
+ * Each operation makes a single pass over the tensors: they are read in
+ * chunks along their first index, a chunk of every tensor at a time, small
+ * enough to stay in cache while all the pairs of the chunk are formed. A
+ * tensor is thus read once per call rather than once per pair. Tensors
+ * that are not CoreTensor's (e.g. DiskTensor's) are streamed chunk by chunk.
+ * BlockedTensor's are processed block by block.
+ **/
+namespace composite
+{
+
+/// @return The matrix of dot products S[i][j] = X[i] . Y[j]
+vector<vector<double>> dots(const vector<Tensor> &X, const vector<Tensor> &Y);
+/// @return The matrix of dot products S[i][j] = X[i] . Y[j]
+vector<vector<double>> dots(const vector<BlockedTensor> &X,
+                            const vector<BlockedTensor> &Y);
+
+/// @return The Gram matrix S[i][j] = X[i] . X[j], each pair formed once
+vector<vector<double>> gram(const vector<Tensor> &X);
+/// @return The Gram matrix S[i][j] = X[i] . X[j], each pair formed once
+vector<vector<double>> gram(const vector<BlockedTensor> &X);
+
+/// C = sum_i c[i] X[i] + beta C
+void linear_combination(Tensor &C, const vector<Tensor> &X,
+                        const vector<double> &c, double beta = 0.0);
+/// C = sum_i c[i] X[i] + beta C
+void linear_combination(BlockedTensor &C, const vector<BlockedTensor> &X,
+                        const vector<double> &c, double beta = 0.0);
+}
+
 template <typename TensorType>
 class CompositeTensor
 {
@@ -68,6 +101,34 @@ public:
         tensors_.push_back(newTensor);
         return *this;
     }
+
+    size_t size() const
+    {
+        return tensors_.size();
+    }
+
+    /// @return The Gram matrix of the tensors (see composite::gram)
+    vector<vector<double>> gram() const
+    {
+        return composite::gram(tensors_);
+    }
+
+    /// @return The dot product of x with each tensor, in one pass
+    vector<double> dots(const TensorType& x) const
+    {
+        vector<vector<double>> S = composite::dots(tensors_, {x});
+        vector<double> d;
+        for (const vector<double>& row : S)
+            d.push_back(row[0]);
+        return d;
+    }
+
+    /// C = sum_i c[i] (*this)(i) + beta C, in one pass
+    void linear_combination(TensorType& C, const vector<double>& c,
+                            double beta = 0.0) const
+    {
+        composite::linear_combination(C, tensors_, c, beta);
+    }
 };
 
 }
@@ -0,0 +1,155 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#ifndef AMBIT_FACTORIZED_TENSOR_H
+#define AMBIT_FACTORIZED_TENSOR_H
+
+#include <ambit/common_types.h>
+#include <ambit/tensor.h>
+
+namespace ambit
+{
+
+/**
+ * Class FactorizedTensor
+ *
+ * A low-rank tensor held as a sum of products of two factors,
+ *  T(p.., q..) = sum_Q L(Q, p..) R(Q, q..),
+ * where the first split() indices of T belong to L and the others to R.
+ * Cholesky-decomposed two-electron integrals, (pq|rs) = sum_Q L(Q,pq)
+ * L(Q,rs), share one factor for both sides.
+ *
+ * contract uses the factors directly: the operand is contracted with one
+ * factor first, the one that gives the smaller intermediate, and the
+ * result with the other. The full tensor is never formed.
+ *
+ * Sample usage:
+ *  FactorizedTensor V = FactorizedTensor::cholesky(ao, 1.0e-8);
+ *  // J(pq) = (pq|rs) D(rs)
+ *  V.contract(J, D, {"p", "q"}, {"p", "q", "r", "s"}, {"r", "s"});
+ **/
+class FactorizedTensor
+{
+  public:
+    // => Constructors <= //
+
+    /// Default constructor. Does nothing.
+    FactorizedTensor();
+
+    /**
+     * Build a FactorizedTensor from its factors
+     *
+     * @param name  the name of the tensor for use in printing
+     * @param left  the factor L(Q, p..)
+     * @param right the factor R(Q, q..), with as many vectors as left
+     **/
+    FactorizedTensor(const string &name, const Tensor &left,
+                     const Tensor &right);
+
+    /**
+     * Pivoted incomplete Cholesky decomposition of a symmetric positive
+     * semidefinite tensor viewed as a matrix, its first half of indices
+     * against the second (e.g. (pq|rs) as the pq x rs matrix).
+     *
+     * Vectors are added, for the largest remaining diagonal element, until
+     * every diagonal element of the error is below tolerance (which bounds
+     * every element of the error) or max_vectors are found. Only the
+     * diagonal and one row per vector of T are read; T must be a
+     * CoreTensor or a DiskTensor, whose rows are read through its mapping.
+     *
+     * @param T           the tensor to decompose
+     * @param tolerance   the largest diagonal error that is accepted
+     * @param max_vectors the largest number of vectors, 0 for no limit
+     * @param type        the tensor type of the factor
+     **/
+    static FactorizedTensor cholesky(const Tensor &T,
+                                     double tolerance = 1.0E-10,
+                                     size_t max_vectors = 0,
+                                     TensorType type = CoreTensor);
+
+    /**
+     * Truncated singular value decomposition of a tensor viewed as a
+     * matrix, its first split indices against the others. The singular
+     * values above tolerance are kept, each split as its square root
+     * between the two factors.
+     *
+     * The whole matrix is decomposed in core.
+     *
+     * @param T         the tensor to compress
+     * @param split     the number of indices of the left factor
+     * @param tolerance the smallest singular value kept
+     * @param type      the tensor type of the factors
+     **/
+    static FactorizedTensor svd(const Tensor &T, size_t split,
+                                double tolerance = 1.0E-10,
+                                TensorType type = CoreTensor);
+
+    // => Accessors <= //
+
+    /// @return The name of the tensor for use in printing
+    string name() const { return name_; }
+    /// @return The full dimensions of the tensor
+    const Dimension &dims() const { return dims_; }
+    /// @return The number of full indices
+    size_t rank() const { return dims_.size(); }
+    /// @return The number of indices of the left factor
+    size_t split() const { return left_.rank() - 1; }
+    /// @return The number of vectors (the rank of the factorization)
+    size_t size() const { return left_.dim(0); }
+    /// @return The factor L(Q, p..)
+    Tensor left() const { return left_; }
+    /// @return The factor R(Q, q..), the same tensor as left() for a
+    /// Cholesky decomposition
+    Tensor right() const { return right_; }
+
+    // => Conversions <= //
+
+    /// @return The full tensor
+    Tensor expand(TensorType type = CoreTensor) const;
+
+    // => Operations <= //
+
+    /**
+     * C(Cinds) = alpha * T(Tinds) * A(Ainds) + beta * C(Cinds), as
+     * Tensor::contract, where T is this tensor
+     **/
+    void contract(Tensor &C, const Tensor &A, const Indices &Cinds,
+                  const Indices &Tinds, const Indices &Ainds,
+                  double alpha = 1.0, double beta = 0.0) const;
+
+  private:
+    string name_;
+    Dimension dims_;
+    Tensor left_;
+    Tensor right_;
+};
+}
+
+#endif // AMBIT_FACTORIZED_TENSOR_H
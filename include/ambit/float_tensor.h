@@ -0,0 +1,134 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#ifndef AMBIT_FLOAT_TENSOR_H
+#define AMBIT_FLOAT_TENSOR_H
+
+#include <memory>
+
+#include <ambit/common_types.h>
+#include <ambit/tensor.h>
+
+namespace ambit
+{
+
+/**
+ * Class FloatTensor
+ *
+ * A tensor stored in single precision, for the parts of a calculation that
+ * tolerate it: half the memory and I/O of a Tensor, and single-precision
+ * GEMM throughput. A CoreTensor keeps its elements in memory, a DiskTensor
+ * in a scratch file (under Tensor::scratch_path()) that is mapped into
+ * memory.
+ *
+ * Contractions either stay in single precision (contract) or write a
+ * double-precision Tensor (contract_mixed), which accumulates sgemm
+ * products over short runs of the contracted indices in double precision,
+ * so the rounding error does not grow with the contraction length.
+ * Indices shared by A, B and C (Hadamard products) are not supported.
+ *
+ * Sample usage:
+ *  FloatTensor V = FloatTensor::build(DiskTensor, "V", {no, no, nv, nv});
+ *  V.assign(Vdouble);
+ *  FloatTensor::contract_mixed(R, V, T, {"i", "j", "a", "b"},
+ *                              {"i", "j", "c", "d"}, {"c", "d", "a", "b"});
+ **/
+class FloatTensor
+{
+  public:
+    // => Constructors <= //
+
+    /// Default constructor. Does nothing.
+    FloatTensor();
+
+    /**
+     * Build a zeroed FloatTensor object
+     *
+     * @param type  CoreTensor or DiskTensor
+     * @param name  the name of the tensor for use in printing
+     * @param dims  the dimensions of the tensor
+     **/
+    static FloatTensor build(TensorType type, const string &name,
+                             const Dimension &dims);
+
+    /// @return A FloatTensor holding A rounded to single precision
+    static FloatTensor build(TensorType type, const Tensor &A);
+
+    // => Accessors <= //
+
+    /// @return The tensor type (CoreTensor or DiskTensor)
+    TensorType type() const;
+    /// @return The name of the tensor for use in printing
+    string name() const;
+    /// @return The dimensions of the tensor
+    const Dimension &dims() const;
+    /// @return The number of indices
+    size_t rank() const { return dims().size(); }
+    /// @return The number of elements
+    size_t numel() const;
+
+    /// @return The elements, in row-major order
+    float *data();
+    const float *data() const;
+
+    // => Conversions <= //
+
+    /// Stores A, C = alpha * A + beta * C, rounded to single precision
+    void assign(const Tensor &A, double alpha = 1.0, double beta = 0.0);
+
+    /// @return The tensor in double precision
+    Tensor to_double(TensorType type = CoreTensor) const;
+
+    // => Operations <= //
+
+    /// C = 0
+    void zero();
+
+    /// C(Cinds) = alpha * A(Ainds) * B(Binds) + beta * C(Cinds) in single
+    /// precision, as Tensor::contract
+    void contract(const FloatTensor &A, const FloatTensor &B,
+                  const Indices &Cinds, const Indices &Ainds,
+                  const Indices &Binds, double alpha = 1.0, double beta = 0.0);
+
+    /// C(Cinds) = alpha * A(Ainds) * B(Binds) + beta * C(Cinds) for a
+    /// double-precision C, with single-precision products accumulated in
+    /// double precision
+    static void contract_mixed(Tensor &C, const FloatTensor &A,
+                               const FloatTensor &B, const Indices &Cinds,
+                               const Indices &Ainds, const Indices &Binds,
+                               double alpha = 1.0, double beta = 0.0);
+
+  private:
+    struct Storage;
+    std::shared_ptr<Storage> storage_;
+};
+}
+
+#endif // AMBIT_FLOAT_TENSOR_H
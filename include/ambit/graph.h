@@ -0,0 +1,144 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#ifndef AMBIT_GRAPH_H
+#define AMBIT_GRAPH_H
+
+#include <functional>
+#include <initializer_list>
+#include <ambit/common_types.h>
+#include <ambit/tensor.h>
+
+namespace ambit
+{
+
+/**
+ * Class Graph
+ *
+ * Deferred execution of a sequence of labeled tensor statements.
+ *
+ * Between begin() and execute() the assignments of labeled tensors
+ * (C("ij") = ..., +=, -=, *=, /=) made on the calling thread are recorded
+ * instead of being executed. execute() then evaluates all recorded
+ * statements in order, after choosing the pairwise order of each product:
+ *
+ *  - pairwise subproducts that appear in several statements (e.g.
+ *    V("mnef") * T2("ijef") and V("klcd") * T2("ijcd")) are computed once,
+ *    provided none of their operands is written in between;
+ *  - every intermediate is freed right after its last use.
+ *
+ * Statements that do not depend on each other (neither writes a tensor the
+ * other reads or writes) run concurrently on the OpenMP threads, as long as
+ * all their tensors are CoreTensor's. The statements admitted together are
+ * limited so that the intermediates they build fit in
+ * settings::memory_limit; a statement that does not fit with others runs
+ * alone.
+ *
+ * Statements reading a tensor written by an earlier recorded statement see
+ * the updated tensor, exactly as they would without a Graph. BlockedTensor
+ * statements are recorded as a whole and take part in the scheduling, but
+ * not in the reuse of subproducts. Calls that do not go through labeled
+ * tensors (Tensor::contract, Tensor::permute, Tensor::data(), ...) are not
+ * recorded and run immediately; if such a call reads a tensor a recorded
+ * statement writes, or writes a tensor one reads or writes, the statements
+ * recorded so far are executed first and recording goes on. (A view is told
+ * apart from its tensor.) Scalar products (double E = A("ij") * B("ij"))
+ * would need pending results and throw while recording.
+ *
+ * Sample usage:
+ *  Graph g;
+ *  g.begin();
+ *  R1("ia") = V("mnef") * T2("imef") * T1("na");
+ *  R2("ijab") = V("mnef") * T2("ijef") * T2("mnab");
+ *  g.execute();
+ **/
+class Graph
+{
+  public:
+    Graph();
+    ~Graph();
+
+    /// Starts recording statements made on the calling thread
+    void begin();
+    /// Stops recording without executing the recorded statements
+    void end();
+    /// Stops recording and executes (then drops) the recorded statements
+    void execute();
+
+    /// @return Is this Graph recording?
+    bool is_recording() const;
+    /// @return The number of recorded statements
+    size_t size() const { return statements_.size(); }
+    /// @return The number of pairwise products saved by the last execute()
+    size_t shared_products() const { return shared_products_; }
+
+    /// @return The Graph recording on the calling thread, or nullptr
+    static Graph *recording();
+
+    /// Records target = (or +=, -=) the product rhs (used by LabeledTensor)
+    void record(const LabeledTensor &target,
+                const LabeledTensorContraction &rhs, bool zero_result,
+                bool add, bool optimize_order);
+    /// Records an operation that reads the tensors reads and writes the
+    /// tensors writes (used by LabeledTensor and LabeledBlockedTensor)
+    void record(const vector<Tensor> &writes, const vector<Tensor> &reads,
+                const std::function<void()> &action);
+
+    /// Executes the statements recorded on the calling thread so far if a
+    /// direct call that writes writes and reads reads depends on any of
+    /// them, then goes on recording (used by Tensor)
+    static void flush(std::initializer_list<const Tensor *> writes,
+                      std::initializer_list<const Tensor *> reads);
+
+  private:
+    struct Statement
+    {
+        /// The tensors written and read by the statement
+        vector<Tensor> writes;
+        vector<Tensor> reads;
+        /// Products: the target, its labels and the terms of the product
+        Tensor target;
+        Indices indices;
+        vector<LabeledTensor> terms;
+        bool zero_result;
+        bool add;
+        bool optimize_order;
+        /// Everything else: the deferred operation
+        std::function<void()> action;
+    };
+
+    vector<Statement> statements_;
+    size_t shared_products_;
+
+    Graph(const Graph &) = delete;
+    Graph &operator=(const Graph &) = delete;
+};
+}
+
+#endif
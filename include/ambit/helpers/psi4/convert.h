@@ -40,6 +40,7 @@ namespace ambit
 {
 
 class Tensor;
+class SymBlockedTensor;
 
 namespace helpers
 {
@@ -47,10 +48,41 @@ namespace helpers
 namespace psi4
 {
 
+/**
+ * Copies a psi::Matrix without symmetry into a rank-2 tensor of the same
+ * dimensions.
+ *
+ * CoreTensor and DiskTensor targets are written in place (a DiskTensor
+ * through its memory map), rows in parallel, so the data is copied once;
+ * other tensor types receive it through a CoreTensor.
+ **/
 void convert(const psi::Matrix &matrix, ambit::Tensor *target);
 
+/// Copies a psi::Vector without symmetry into a rank-1 tensor (see above)
 void convert(const psi::Vector &vector, ambit::Tensor *target);
 
+/// Copies a rank-2 tensor into a psi::Matrix without symmetry, reading
+/// CoreTensor and DiskTensor sources in place
+void convert(const ambit::Tensor &tensor, psi::Matrix *target);
+
+/// Copies a rank-1 tensor into a psi::Vector without symmetry (see above)
+void convert(const ambit::Tensor &tensor, psi::Vector *target);
+
+/**
+ * Copies the irrep blocks of a psi::Matrix into the blocks of a rank-2
+ * SymBlockedTensor of the same symmetry, all blocks in parallel.
+ *
+ * Row p of irrep h of the matrix is the p-th lowest MO of irrep h among
+ * the MO spaces of SymBlockedTensor (for MOs numbered in Pitzer order,
+ * MO offset(h) + p). Only the elements of the blocks of target are read.
+ **/
+void convert(const psi::Matrix &matrix, ambit::SymBlockedTensor *target);
+
+/// Copies the blocks of a rank-2 SymBlockedTensor into the irrep blocks of
+/// a psi::Matrix of the same symmetry (see above). Elements outside of the
+/// blocks of tensor are left untouched.
+void convert(const ambit::SymBlockedTensor &tensor, psi::Matrix *target);
+
 } // namespace psi4
 
 } // namespace helpers
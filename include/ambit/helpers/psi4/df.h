@@ -0,0 +1,87 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#ifndef AMBIT_DF_H
+#define AMBIT_DF_H
+
+#include <string>
+#include <vector>
+
+#include <libmints/mints.h>
+
+#include <ambit/blocked_tensor.h>
+
+namespace ambit
+{
+
+namespace helpers
+{
+
+namespace psi4
+{
+
+/**
+ * Returns (P|Q)^-1/2 of an auxiliary basis, from an integral object for
+ * (P|Q) (auxiliary, zero, auxiliary, zero basis sets). Eigenvalues below
+ * condition are dropped (see Tensor::power).
+ */
+Tensor df_metric_inverse_sqrt(psi::TwoBodyAOInt &metric,
+                              double condition = 1.0E-10);
+
+/**
+ * Builds the density-fitted three-index tensor
+ *  B(Q,p,q) = sum_P (Q|P)^-1/2 sum_mn (P|mn) C(m,p) C(n,q)
+ * into the blocks of a BlockedTensor, without ever holding the n^4 (or
+ * even the full n^3 AO) integrals.
+ *
+ * engines compute (P|mn) (auxiliary, zero, primary, primary basis sets),
+ * one per OpenMP thread, and metric (P|Q) as for df_metric_inverse_sqrt.
+ * C holds the MO coefficients (AO x MO, a CoreTensor): the orbitals of an
+ * MO space are columns of C. The first space of each block (e.g. "L" in
+ * "Lov") is the auxiliary space, whose orbitals are auxiliary functions.
+ *
+ * The auxiliary shells are taken in batches whose (P|mn), half-transformed
+ * (P|pn) and fully-transformed (P|pq) pieces fit in memory bytes (by
+ * default what settings::memory_limit leaves). Each batch is added to
+ * every block as B += (Q|P)^-1/2 (P|pq), so with type = DiskTensor the
+ * blocks are the only O(N^3) storage and they stay on disk.
+ */
+BlockedTensor df_b_tensor(const std::vector<psi::TwoBodyAOInt *> &engines,
+                          psi::TwoBodyAOInt &metric, const Tensor &C,
+                          const std::string &name,
+                          const std::vector<std::string> &blocks,
+                          TensorType type = DiskTensor, size_t memory = 0);
+
+} // namespace psi4
+
+} // namespace helpers
+
+} // namespace ambit
+
+#endif // AMBIT_DF_H
@@ -34,6 +34,8 @@
 #ifndef AMBIT_INTEGRALS_H
 #define AMBIT_INTEGRALS_H
 
+#include <vector>
+
 #include <libmints/mints.h>
 
 namespace ambit
@@ -51,6 +53,23 @@ void integrals(psi::OneBodyAOInt &integral, ambit::Tensor *target);
 
 void integrals(psi::TwoBodyAOInt &integral, ambit::Tensor *target);
 
+/**
+ * Computes the two-electron integrals of engines into target, with one
+ * OpenMP thread per integral object (all for the same basis sets).
+ *
+ * Shell quartets whose Schwarz bound sqrt((PQ|PQ)) * sqrt((RS|RS)) is below
+ * screening are skipped and left zero (screening needs the bra and ket
+ * basis sets to be the same; 0.0 computes every quartet). When the four
+ * basis sets are one, only the canonical quartets are computed and each is
+ * written with its 8 permutations.
+ *
+ * CoreTensor and DiskTensor targets are written in place by the threads. A
+ * DistributedTensor target has its quartets shared out over the processes
+ * and each (P,Q) shell pair goes out as one batch (see Tensor::scatter).
+ */
+void integrals(const std::vector<psi::TwoBodyAOInt *> &engines,
+               ambit::Tensor *target, double screening = 1.0E-12);
+
 } // namespace psi4
 
 } // namespace helpers
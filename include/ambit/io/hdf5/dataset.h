@@ -39,6 +39,7 @@
 #include <ambit/io/hdf5/dataspace.h>
 #include <ambit/io/hdf5/type.h>
 #include <hdf5.h>
+#include <algorithm>
 
 namespace ambit
 {
@@ -49,6 +50,49 @@ namespace io
 namespace hdf5
 {
 
+/// Compression filter of the chunks of a dataset
+enum Compression
+{
+    kCompressionNone,
+    kCompressionGzip,
+    kCompressionSzip,
+    /// The Blosc filter plugin (filter 32001), found through HDF5_PLUGIN_PATH
+    kCompressionBlosc
+};
+
+/// Layout of the data of a new dataset
+struct Storage
+{
+    /// Dimensions of a chunk. Empty for a contiguous dataset, unless it is
+    /// compressed, when chunks of about 1 MB are chosen.
+    Dimension chunk;
+    /// Filter the chunks go through
+    Compression compression = kCompressionNone;
+    /// Level of gzip (1 to 9) or blosc (0 to 9)
+    unsigned level = 4;
+};
+
+namespace detail
+{
+
+/// Are the files opened by all processes together, through MPI-IO?
+bool parallel();
+
+/// Creation properties of a dataset of dims stored as storage says
+hid_t creation_properties(const Dimension &dims, const Storage &storage);
+
+/// Transfer properties: collective MPI-IO when the file is parallel
+hid_t transfer_properties();
+
+/// Selects range of space, or nothing if select is false
+void select(hid_t space, const IndexRange &range, bool select = true);
+
+/// The ranges of the rows (values of the first index) of range taken by
+/// each process, about evenly
+vector<IndexRange> row_shares(const IndexRange &range, int nprocess);
+
+} // namespace detail
+
 template <typename T> struct Dataset
 {
     Dataset() : id_(-1) {}
@@ -61,10 +105,10 @@ template <typename T> struct Dataset
     }
 
     Dataset(const Location &location, const string &name,
-            const Dataspace &space)
+            const Dataspace &space, const Storage &storage = Storage())
         : id_(-1)
     {
-        create(location, name, space);
+        create(location, name, space, storage);
     }
 
     virtual ~Dataset() { close(); }
@@ -79,12 +123,19 @@ template <typename T> struct Dataset
     }
 
     void create(const Location &location, const string &name,
-                const Dataspace &space)
+                const Dataspace &space, const Storage &storage = Storage())
     {
         close();
 
+        int rank = H5Sget_simple_extent_ndims(space.id());
+        vector<hsize_t> cdims(static_cast<size_t>(std::max(rank, 0)));
+        H5Sget_simple_extent_dims(space.id(), cdims.data(), nullptr);
+
+        hid_t dcpl = detail::creation_properties(
+            Dimension(cdims.begin(), cdims.end()), storage);
         id_ = H5Dcreate2(location.id(), name.c_str(), detail::ctype<T>::hid(),
-                        space.id(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                         space.id(), H5P_DEFAULT, dcpl, H5P_DEFAULT);
+        H5Pclose(dcpl);
 
         if (id_ == -1)
             throw std::runtime_error("Unable to create dataset");
@@ -99,44 +150,227 @@ template <typename T> struct Dataset
         }
     }
 
+    /// @return The dimensions of the dataset
+    Dimension dims() const
+    {
+        hid_t space = H5Dget_space(id_);
+        int rank = H5Sget_simple_extent_ndims(space);
+        vector<hsize_t> cdims(static_cast<size_t>(std::max(rank, 0)));
+        H5Sget_simple_extent_dims(space, cdims.data(), nullptr);
+        H5Sclose(space);
+        return Dimension(cdims.begin(), cdims.end());
+    }
+
     void write(const vector<T> &data)
     {
         H5Dwrite(id_, detail::ctype<T>::hid(), H5S_ALL, H5S_ALL, H5P_DEFAULT,
                  data.data());
     }
 
+    /**
+     * Writes the whole of data, which has the dimensions of the dataset.
+     *
+     * CoreTensor's and DiskTensor's are written straight from their memory
+     * (DiskTensor's from their mapping, without a core copy). A
+     * DistributedTensor is written a share of rows per process: with
+     * parallel HDF5 every process gathers and writes its own share in one
+     * collective call, otherwise the first process writes the shares one
+     * after another. Either way no process holds more than its share.
+     */
     void write(const Tensor &data)
     {
-        if (data.type() != CoreTensor)
+        IndexRange range;
+        for (size_t dim : data.dims())
+            range.push_back({0L, dim});
+        write(data, range);
+    }
+
+    /// Writes data into range of the dataset, the sizes of range being the
+    /// dimensions of data
+    void write(const Tensor &data, const IndexRange &range)
+    {
+        if (data.type() == DistributedTensor)
+        {
+            write_distributed(data, range);
+            return;
+        }
+        if (data.type() != CoreTensor && data.type() != DiskTensor)
         {
             throw std::runtime_error(
-                "Only able to write CoreTensor's to disk.");
+                "Only able to write CoreTensor's and DiskTensor's to disk.");
         }
 
-        write(data.data());
+        // A parallel file is written by the first process alone
+        bool writer = !detail::parallel() || settings::rank == 0;
+        transfer(data.map_data(), data.dims(), full(data.dims()), range,
+                 writer, true);
     }
 
-    void read(const vector<T> &data)
+    /// Reads the whole dataset into data, resizing it
+    void read(vector<T> &data)
     {
-        //        H5Dread(id_, detail::ctype<T>::hid(), )
+        Dimension sizes = dims();
+        size_t numel = 1L;
+        for (size_t size : sizes)
+            numel *= size;
+        data.resize(numel);
+        H5Dread(id_, detail::ctype<T>::hid(), H5S_ALL, H5S_ALL, H5P_DEFAULT,
+                data.data());
+    }
+
+    /// Reads the whole dataset into data, which has its dimensions
+    void read(Tensor &data)
+    {
+        IndexRange range;
+        for (size_t dim : data.dims())
+            range.push_back({0L, dim});
+        read(data, range, range);
+    }
+
+    /**
+     * Reads a hyperslab into a slice:
+     *  data(Cinds) = dataset(range)
+     *
+     * CoreTensor's and DiskTensor's are read in place, only the elements of
+     * range leaving the file. A DistributedTensor is read a share of rows
+     * per process and scattered with one collective call.
+     */
+    void read(Tensor &data, const IndexRange &Cinds, const IndexRange &range)
+    {
+        if (data.type() == DistributedTensor)
+        {
+            read_distributed(data, Cinds, range);
+            return;
+        }
+        if (data.type() != CoreTensor && data.type() != DiskTensor)
+        {
+            throw std::runtime_error(
+                "Only able to read into CoreTensor's and DiskTensor's.");
+        }
+
+        transfer(data.map_data(), data.dims(), Cinds, range, true, false);
     }
 
     const hid_t &id() const { return id_; }
 
-    static void write(const Location& location, const Tensor& data)
+    static void write(const Location &location, const Tensor &data,
+                      const Storage &storage = Storage())
     {
         Dataspace space(data);
-        Dataset<T> set(location, data.name(), space);
+        Dataset<T> set(location, data.name(), space, storage);
         set.write(data);
     }
 
   private:
+    static IndexRange full(const Dimension &dims)
+    {
+        IndexRange range;
+        for (size_t dim : dims)
+            range.push_back({0L, dim});
+        return range;
+    }
+
+    // Moves range of the dataset to or from Cinds of the memory p of dims;
+    // a process that is not active takes part in the call with nothing
+    void transfer(const T *p, const Dimension &dims, const IndexRange &Cinds,
+                  const IndexRange &range, bool active, bool writing)
+    {
+        vector<hsize_t> mdims(dims.begin(), dims.end());
+        hid_t mspace = H5Screate_simple(static_cast<int>(mdims.size()),
+                                        mdims.data(), nullptr);
+        hid_t fspace = H5Dget_space(id_);
+        detail::select(mspace, Cinds, active);
+        detail::select(fspace, range, active);
+        hid_t dxpl = detail::transfer_properties();
+
+        herr_t status;
+        if (writing)
+            status = H5Dwrite(id_, detail::ctype<T>::hid(), mspace, fspace,
+                              dxpl, p);
+        else
+            status = H5Dread(id_, detail::ctype<T>::hid(), mspace, fspace,
+                             dxpl, const_cast<T *>(p));
+
+        if (dxpl != H5P_DEFAULT)
+            H5Pclose(dxpl);
+        H5Sclose(fspace);
+        H5Sclose(mspace);
+        if (status < 0)
+            throw std::runtime_error(writing ? "Unable to write dataset"
+                                             : "Unable to read dataset");
+    }
+
+    static Tensor slab(const IndexRange &range)
+    {
+        Dimension sizes;
+        for (const vector<size_t> &r : range)
+            sizes.push_back(r[1] - r[0]);
+        return Tensor::build(CoreTensor, "HDF5 Slab", sizes);
+    }
+
+    void write_distributed(const Tensor &data, const IndexRange &range)
+    {
+        vector<IndexRange> shares =
+            detail::row_shares(full(data.dims()), settings::nprocess);
+        IndexRange mine = shares[settings::rank];
+
+        if (detail::parallel())
+        {
+            Tensor local = slab(mine);
+            data.gather({local}, {full(local.dims())}, {mine});
+            transfer(local.data().data(), local.dims(), full(local.dims()),
+                     shifted(mine, range), true, true);
+            return;
+        }
+
+        // Every share passes through the first process in turn
+        for (const IndexRange &share : shares)
+        {
+            Tensor local = slab(share);
+            if (settings::rank == 0)
+                data.gather({local}, {full(local.dims())}, {share});
+            else
+                data.gather({}, {}, {});
+            if (settings::rank == 0)
+                transfer(local.data().data(), local.dims(),
+                         full(local.dims()), shifted(share, range), true,
+                         true);
+        }
+    }
+
+    void read_distributed(Tensor &data, const IndexRange &Cinds,
+                          const IndexRange &range)
+    {
+        IndexRange mine =
+            detail::row_shares(range, settings::nprocess)[settings::rank];
+        Tensor local = slab(mine);
+        transfer(local.data().data(), local.dims(), full(local.dims()), mine,
+                 true, false);
+
+        IndexRange Cmine(Cinds);
+        if (!Cmine.empty())
+            Cmine[0] = {Cinds[0][0] + mine[0][0] - range[0][0],
+                        Cinds[0][0] + mine[0][1] - range[0][0]};
+        data.scatter({local}, {Cmine}, {full(local.dims())});
+    }
+
+    // share of the whole tensor, moved to the place of range in the dataset
+    static IndexRange shifted(const IndexRange &share, const IndexRange &range)
+    {
+        IndexRange result(share);
+        for (size_t dim = 0; dim < share.size(); ++dim)
+            result[dim] = {share[dim][0] + range[dim][0],
+                           share[dim][1] + range[dim][0]};
+        return result;
+    }
+
     hid_t id_;
 };
 
-inline void write(const Location& location, const Tensor& data)
+inline void write(const Location &location, const Tensor &data,
+                  const Storage &storage = Storage())
 {
-    Dataset<double>::write(location, data);
+    Dataset<double>::write(location, data, storage);
 }
 
 } // namespace hdf5
@@ -33,6 +33,8 @@
 #include <cstdint>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 #include <functional>
 
@@ -178,7 +180,8 @@ struct Manager
     Entry& entry(const std::string& key);
 
     Manager(const Manager&& other)
-            : owner_(other.owner_), contents_(std::move(other.contents_))
+            : owner_(other.owner_), contents_(std::move(other.contents_)),
+              index_(std::move(other.index_))
     {
     }
 
@@ -188,6 +191,8 @@ private:
 
     File& owner_;
     std::vector<Entry> contents_;
+    /// position of each key in contents_, so lookups do not walk the TOC
+    std::unordered_map<std::string, size_t> index_;
 };
 
 } // namespace toc
@@ -442,6 +447,37 @@ struct File
                     "read_stream: read beyond the extend of the entry.");
     }
 
+    /** Returns the data of an entry in place, without copying.
+    * The file is memory mapped on the first call (and remapped when it has
+    * grown past the mapping); the pointer stays valid until the file is
+    * closed. Writes made through this object are seen through it.
+    * \param label Entry to view.
+    * \param count Number of T's that will be accessed.
+    * \return Pointer to the data, or nullptr if the data is not aligned for
+    * T or the file cannot be mapped (use read then).
+    */
+    template<typename T>
+    const T *view(const std::string& label, uint64_t count)
+    {
+        // ensure the entry exists
+        if (toc_.exists(label) == false)
+            throw std::runtime_error("entry does not exist in the file: " +
+                                     label);
+        const toc::Entry& entry = toc_.entry(label);
+        Address start =
+                util::get_address(entry.start_address, sizeof(toc::Entry));
+        Address end = util::get_address(start, sizeof(T) * count);
+        if (end > entry.end_address)
+            throw std::runtime_error(
+                    "view past the end address of this entry: " + label);
+
+        const char *data = mapped(start, sizeof(T) * count);
+        if (data == nullptr ||
+            reinterpret_cast<uintptr_t>(data) % alignof(T) != 0)
+            return nullptr;
+        return reinterpret_cast<const T *>(data);
+    }
+
     /** Performs a streaming read of the data for the entry.
     * \param label Entry to read.
     * \param next Address to read from.
@@ -488,22 +524,36 @@ struct File
             : handle_(other.handle_), name_(other.name_),
               read_stat_(other.read_stat_), write_stat_(other.write_stat_),
               toc_(std::move(other.toc_)), open_mode_(std::move(other.open_mode_)),
-              delete_mode_(std::move(other.delete_mode_))
+              delete_mode_(std::move(other.delete_mode_)), map_(other.map_),
+              map_size_(other.map_size_),
+              retired_maps_(std::move(other.retired_maps_))
     {
         other.handle_ = -1;
+        other.map_ = nullptr;
+        other.map_size_ = 0;
     }
 
 protected:
-    /** Performs the ultimate reading from the file. Will seek to add and read
-     * size number of bytes into buffer.
+    /** Performs the ultimate reading from the file. Copies size bytes at add
+     * into buffer, from the mapping of the file when it covers them and with
+     * a positioned read otherwise.
     */
     void read_raw(void *buffer, const Address& add, uint64_t size);
 
-    /** Performs the ultimate writing to the file. Will seek to add and write
-     * size number of bytes from buffer.
+    /** Performs the ultimate writing to the file. Writes size number of bytes
+     * from buffer at add with a positioned write.
     */
     void write_raw(const void *buffer, const Address& add, uint64_t size);
 
+    /** Returns the mapping of the size bytes at add, mapping (or remapping)
+     * the file if needed; nullptr if the file cannot be mapped or is too
+     * short.
+    */
+    const char *mapped(const Address& add, uint64_t size);
+
+    /// Releases every mapping of the file.
+    void unmap();
+
     /** Used internally to report an error to the user.
     */
     void error(Error code);
@@ -522,6 +572,13 @@ protected:
     const OpenMode open_mode_;
     DeleteMode delete_mode_;
 
+    /// read-only mapping of the first map_size_ bytes of the file
+    char *map_ = nullptr;
+    uint64_t map_size_ = 0;
+    /// mappings replaced by a larger one, kept until close for the views
+    /// handed out into them
+    std::vector<std::pair<char *, uint64_t>> retired_maps_;
+
     friend struct toc::Manager;
 };
 }
@@ -34,8 +34,12 @@
 
 #include <ambit/tensor.h>
 
+#include <functional>
+
 namespace ambit
 {
+class BlockedTensor;
+
 namespace io
 {
 namespace psi4 {
@@ -47,6 +51,16 @@ static constexpr int integrals_per_buffer__ = 2980;
 /// The label in the integral file to use. Should probably be abstracted away
 /// but this is what PSI3/4 uses.
 static constexpr const char *buffer_key__ = "IWL Buffers";
+/// The number of buffers read ahead, and scattered, at a time.
+static constexpr int buffers_per_batch__ = 64;
+
+/// The integrals of consecutive buffers, labels stored as p, q, r, s.
+struct Batch
+{
+    std::vector<short int> labels;
+    std::vector<double> values;
+    bool last = false;
+};
 }
 
 struct IWL : public File
@@ -99,9 +113,53 @@ struct IWL : public File
 
     static void read_one(File& io, const std::string& label, Tensor& tensor);
 
+    /**
+    * Reads the two-electron integrals (pq|rs) into a dense rank-4 tensor,
+    * all 8 permutations of each stored integral included. Works on any
+    * tensor with map_data() (CoreTensor, DiskTensor).
+    *
+    * The next buffers are read in the background while the current ones are
+    * scattered, and the scatter is split over the threads by the leading
+    * index, so each thread writes its own slab. The stream of io is
+    * consumed.
+    */
     static void read_two(IWL& io, Tensor& tensor);
 
+    /**
+    * Reads the two-electron integrals into the blocks of a BlockedTensor:
+    * block(key)[i][j][k][l] = (pq|rs), where p, q, r, s are the i-th, j-th,
+    * k-th and l-th orbitals of the MO spaces of key. Only the integrals that
+    * fall in a block of tensor are stored, so a tensor built with the
+    * needed blocks alone (e.g. the active ones) never holds the full n^4.
+    *
+    * Spin plays no role: each block receives the spatial integrals of its
+    * orbitals, and aliased blocks (see set_restricted_spin) are written
+    * once. The threads split the blocks between them.
+    */
+    static void read_two(IWL& io, BlockedTensor& tensor);
+
+    /**
+    * Reads the two-electron integrals packed with their 8-fold symmetry:
+    * tensor is rank 1 with npair * (npair + 1) / 2 elements, where
+    * npair = n * (n + 1) / 2, and (pq|rs) is stored at pqrs = pq * (pq + 1)
+    * / 2 + rs with pq = p * (p + 1) / 2 + q for p >= q (and likewise rs,
+    * pq >= rs). Works on any tensor with map_data().
+    */
+    static void read_two_packed(IWL& io, Tensor& tensor, size_t n);
+
 private:
+    /// Appends up to buffers_per_batch__ buffers to batch.
+    void fetch(details::Batch& batch);
+
+    /**
+    * Hands the integrals of io, from the current buffer to the last one, to
+    * scatter one batch at a time, while the next batch is read in the
+    * background.
+    */
+    static void
+    read_batches(IWL& io,
+                 const std::function<void(const details::Batch&)>& scatter);
+
     /// psi3/4 compatible label structure.
     std::vector<short int> labels_;
 
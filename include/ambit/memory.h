@@ -0,0 +1,80 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#ifndef AMBIT_MEMORY_H
+#define AMBIT_MEMORY_H
+
+#include <ambit/common_types.h>
+
+namespace ambit
+{
+
+/**
+ * Accounting of the memory held by CoreTensor's, including the
+ * intermediates of contractions and the buffers of the scratch pool.
+ *
+ * Every allocation is charged to the name of its tensor. With
+ * settings::enforce_memory_limit set, an allocation that would take the
+ * live tensors past settings::memory_limit first drops the idle scratch
+ * buffers and, if that is not enough, throws an exception naming the
+ * tensor and the largest live tensors.
+ **/
+namespace memory
+{
+
+/// Usage of the tensors of one name
+struct Usage
+{
+    /// Bytes currently held
+    size_t live;
+    /// Largest number of bytes held at once
+    size_t peak;
+    /// Number of allocations so far
+    size_t allocations;
+};
+
+/// @return Bytes held by all live CoreTensor's
+size_t live_bytes();
+
+/// @return Largest number of bytes held at once since the last reset_peak
+size_t peak_bytes();
+
+/// Restarts the high-water marks (overall and per name) at the live usage
+void reset_peak();
+
+/// @return The usage per tensor name, for the names allocated so far
+map<string, Usage> usage();
+
+/// Prints the live and peak usage, overall and for the largest tensors
+void report();
+}
+}
+
+#endif // AMBIT_MEMORY_H
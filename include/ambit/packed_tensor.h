@@ -0,0 +1,137 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#ifndef AMBIT_PACKED_TENSOR_H
+#define AMBIT_PACKED_TENSOR_H
+
+#include <ambit/common_types.h>
+#include <ambit/tensor.h>
+
+namespace ambit
+{
+
+/**
+ * Permutational symmetry of the adjacent index pair (first, first + 1).
+ *
+ * A sign of -1 declares T(..p,q..) = -T(..q,p..) (e.g. the i,j and a,b
+ * pairs of antisymmetrized integrals and amplitudes), a sign of +1 declares
+ * T(..p,q..) = T(..q,p..).
+ **/
+struct PairSymmetry
+{
+    size_t first;
+    int sign;
+};
+
+/**
+ * Class PackedTensor
+ *
+ * A tensor with declared pair symmetries that stores only the unique
+ * triangle of each pair: p < q for antisymmetric pairs and p <= q for
+ * symmetric ones. A pair of dimension n is held as a single packed index of
+ * dimension n(n-1)/2 or n(n+1)/2, element (p,q) at q(q-1)/2 + p or
+ * q(q+1)/2 + p.
+ *
+ * permute and contract act on the packed storage directly whenever every
+ * index pair of an operand is matched by the same pair, with the same
+ * symmetry, in the other operands. Anything else (e.g. a packed pair of C
+ * that is split between A and B) expands the operands, uses the full
+ * tensors, and packs the unique triangle of the result.
+ *
+ * Sample usage:
+ *  PackedTensor V = PackedTensor::build(CoreTensor, "V", {o, o, v, v},
+ *                                       {{0, -1}, {2, -1}});
+ *  C.contract(V, T, {"i", "j", "a", "b"}, {"i", "j", "c", "d"},
+ *             {"c", "d", "a", "b"}, 0.5);
+ **/
+class PackedTensor
+{
+  public:
+    // => Constructors <= //
+
+    /// Default constructor. Does nothing.
+    PackedTensor();
+
+    /**
+     * Build a PackedTensor object
+     *
+     * @param type  the tensor type of the packed storage
+     * @param name  the name of the tensor for use in printing
+     * @param dims  the full (unpacked) dimensions of the tensor
+     * @param pairs the symmetric or antisymmetric index pairs, which must
+     *              not overlap and must join indices of equal dimension
+     **/
+    static PackedTensor build(TensorType type, const string &name,
+                              const Dimension &dims,
+                              const vector<PairSymmetry> &pairs);
+
+    // => Accessors <= //
+
+    /// @return The name of the tensor for use in printing
+    string name() const;
+    /// @return The full (unpacked) dimensions of the tensor
+    const Dimension &dims() const { return dims_; }
+    /// @return The number of full indices
+    size_t rank() const { return dims_.size(); }
+    /// @return The declared index pairs, ordered by position
+    const vector<PairSymmetry> &pairs() const { return pairs_; }
+    /// @return The packed storage, with one index per pair
+    Tensor packed() const { return packed_; }
+
+    // => Conversions <= //
+
+    /// @return The full tensor, with every symmetry-related element filled
+    Tensor expand(TensorType type = CoreTensor) const;
+
+    /// Stores the unique triangle of the full tensor A, C = alpha * A +
+    /// beta * C. A is assumed to have the declared symmetry.
+    void pack(const Tensor &A, double alpha = 1.0, double beta = 0.0);
+
+    // => Operations <= //
+
+    /// C(Cinds) = alpha * A(Ainds) + beta * C(Cinds), as Tensor::permute
+    void permute(const PackedTensor &A, const Indices &Cinds,
+                 const Indices &Ainds, double alpha = 1.0, double beta = 0.0);
+
+    /// C(Cinds) = alpha * A(Ainds) * B(Binds) + beta * C(Cinds), as
+    /// Tensor::contract
+    void contract(const PackedTensor &A, const PackedTensor &B,
+                  const Indices &Cinds, const Indices &Ainds,
+                  const Indices &Binds, double alpha = 1.0,
+                  double beta = 0.0);
+
+  private:
+    Dimension dims_;
+    vector<PairSymmetry> pairs_;
+    Tensor packed_;
+};
+}
+
+#endif // AMBIT_PACKED_TENSOR_H
@@ -56,11 +56,115 @@ extern bool debug;
 /// Memory usage limit. Default is 1GB.
 extern size_t memory_limit;
 
+/// Refuse CoreTensor allocations that would take the live tensors past
+/// memory_limit (see ambit/memory.h)? Default is false.
+extern bool enforce_memory_limit;
+
+/// Spill the least recently used CoreTensor's to Tensor::scratch_path()
+/// rather than go past memory_limit, reading them back on their next use?
+/// References returned by Tensor::data() then only stay valid until the next
+/// tensor allocation. Default is false.
+extern bool spill_to_disk;
+
+/// Keep the data of DiskTensor's built from now on, and of tensors spilled
+/// to disk, compressed (see src/tensor/disk/codec.h), trading CPU time for
+/// scratch bandwidth? Data is stored uncompressed if ambit was built without
+/// zlib. Default is false.
+extern bool disk_compression;
+
+/// Bytes of the in-memory cache of the tiles of DiskTensor's (see
+/// src/tensor/disk/tile_cache.h), at most a quarter of memory_limit; 0
+/// disables it. Default is 64 MB.
+extern size_t disk_cache_size;
+
 /// Distributed capable?
 extern const bool distributed_capable;
 
+/// Tensors built as AgnosticTensor with at least this many bytes are
+/// distributed when running on several processes (see Tensor::choose_type).
+/// Default is 1 MB.
+extern size_t distributed_threshold;
+
+/// Threads ambit may use (see ambit/threads.h); 0 means the OpenMP
+/// default. Default is 0.
+extern int num_threads;
+
 /// Enable timers
 extern bool timers;
+
+/// Record every timed call for timer::write_trace (needs timers). Default
+/// is false.
+extern bool timer_trace;
+
+/// Count the cycles, instructions and last-level cache misses of each timer
+/// with the hardware counters (Linux perf_event; needs timers). report()
+/// shows them as instructions per cycle, misses per thousand instructions
+/// and an estimate of the memory bandwidth. Without counters (no PMU, or
+/// kernel.perf_event_paranoid above 2) nothing is counted. Default is false.
+extern bool timer_counters;
+
+/// Kernels for contractions between CoreTensors
+enum ContractionKernel
+{
+    /// The strided kernel when the permuted copies would be large, else GEMM
+    AutoKernel,
+    /// Permute misordered operands into GEMM layout, then call GEMM
+    PermuteKernel,
+    /// Pack GEMM tiles straight from the operand strides (GETT), never
+    /// forming permuted copies
+    StridedKernel
+};
+
+/// Contraction kernel. Default is AutoKernel.
+extern ContractionKernel contraction_kernel;
+
+/// How contractions between CoreTensors pick among their equivalent GEMM
+/// layouts (which operands to permute, and whether to compute C or C^T)
+enum ContractionLayout
+{
+    /// Fixed rules: a mismatched index group is reordered on an operand
+    /// that is permuted anyway, else on the smaller one
+    FixedLayout,
+    /// The layout whose permutations move the fewest elements
+    EstimatedLayout,
+    /// Every layout is timed on the first contraction of a shape and the
+    /// fastest is kept for that shape
+    MeasuredLayout
+};
+
+/// Layout choice of contractions. Default is EstimatedLayout.
+extern ContractionLayout contraction_layout;
+
+/// When non-negative, contractions between CoreTensors take candidate
+/// number contraction_layout_candidate (modulo the number of candidates)
+/// of the layouts tuned by EstimatedLayout and MeasuredLayout instead of
+/// the best one, to check each of them. Default is -1.
+extern int contraction_layout_candidate;
+
+/// Placement of the pages of large CoreTensor's across NUMA nodes
+enum PagePlacement
+{
+    /// Pages go to the node of the allocating thread
+    SerialPlacement,
+    /// Pages are first touched by the OpenMP threads in static chunks, so
+    /// static parallel loops over the tensor find them on their own node
+    ParallelFirstTouch,
+    /// Pages are interleaved over all nodes (Linux only, else serial)
+    InterleavePlacement
+};
+
+/// Page placement of CoreTensor's of at least 1 MB. Default is
+/// ParallelFirstTouch.
+extern PagePlacement page_placement;
+
+/// Skip the block products of BlockedTensor contractions whose operand
+/// blocks have a product of norms (times the factors) below this; operand
+/// blocks that are not stored count as zero. Default is 0.0 (no screening).
+extern double block_screening;
+
+/// Ask for transparent huge pages for CoreTensor's of at least this many
+/// bytes (Linux only); 0 disables. Default is 4 MB.
+extern size_t huge_page_threshold;
 }
 }
 
@@ -0,0 +1,380 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#ifndef AMBIT_STATIC_EXPRESSION_H
+#define AMBIT_STATIC_EXPRESSION_H
+
+#include <ambit/tensor.h>
+#include <stdexcept>
+#include <type_traits>
+
+namespace ambit
+{
+
+/**
+ * Tensor expressions with labels fixed at compile time, e.g.
+ *  using namespace ambit::labels;
+ *  C(_i, _j) = A(_i, _k) * B(_k, _j);
+ *  D(_i, _j) += 0.5 * A(_j, _i) - C(_i, _j);
+ *
+ * The labels are part of the types of the expression, so its topology is
+ * checked by the compiler (a label of the result missing on the right, or
+ * summed over in a single tensor, does not compile) and the Indices handed
+ * to the kernels are built once per expression, not on every evaluation.
+ * An expression holds its tensors and factors only and is evaluated
+ * directly with Tensor::permute and Tensor::contract, without the operand
+ * vectors of the runtime LabeledTensor expressions.
+ *
+ * A term is a tensor or the product of two tensors, scaled by a factor;
+ * terms may be added and subtracted. Longer products, whose order has to be
+ * planned, and BlockedTensor's use the runtime expressions. The result may
+ * not appear on the right-hand side. Expressions are evaluated at once;
+ * while a Graph is recording, the statements it holds on their tensors are
+ * executed first (see Graph).
+ **/
+namespace static_expression
+{
+
+/// A compile-time index label, see ambit::labels
+template <char L> struct Label
+{
+};
+
+/// The labels of a tensor, with the set operations used by the checks
+template <char... L> struct LabelList;
+
+template <> struct LabelList<>
+{
+    static constexpr bool contains(char) { return false; }
+    static constexpr bool distinct() { return true; }
+};
+
+template <char H, char... T> struct LabelList<H, T...>
+{
+    static constexpr bool contains(char c)
+    {
+        return c == H || LabelList<T...>::contains(c);
+    }
+    static constexpr bool distinct()
+    {
+        return !LabelList<T...>::contains(H) && LabelList<T...>::distinct();
+    }
+};
+
+/// Are all the labels of X in Y?
+template <typename X, typename Y> struct Subset;
+
+template <char... Y>
+struct Subset<LabelList<>, LabelList<Y...>> : std::true_type
+{
+};
+
+template <char H, char... T, char... Y>
+struct Subset<LabelList<H, T...>, LabelList<Y...>>
+    : std::integral_constant<bool,
+                             LabelList<Y...>::contains(H) &&
+                                 Subset<LabelList<T...>,
+                                        LabelList<Y...>>::value>
+{
+};
+
+template <typename X, typename Y> struct Join;
+
+template <char... X, char... Y> struct Join<LabelList<X...>, LabelList<Y...>>
+{
+    typedef LabelList<X..., Y...> type;
+};
+
+template <char... L> class Labeled;
+template <typename X, typename Y> class Product;
+template <typename X, typename Y> class Sum;
+
+template <typename T> struct is_term : std::false_type
+{
+};
+template <char... L> struct is_term<Labeled<L...>> : std::true_type
+{
+};
+template <typename X, typename Y>
+struct is_term<Product<X, Y>> : std::true_type
+{
+};
+template <typename X, typename Y> struct is_term<Sum<X, Y>> : std::true_type
+{
+};
+
+/// Can Term be stored in a tensor labeled by Result?
+template <typename Result, typename Term> struct Fits;
+
+/// A permutation has the labels of the result, in any order
+template <typename Result, char... R>
+struct Fits<Result, Labeled<R...>>
+    : std::integral_constant<bool,
+                             Subset<Result, LabelList<R...>>::value &&
+                                 Subset<LabelList<R...>, Result>::value>
+{
+};
+
+/// Every label of a product is either in the result or summed over, in
+/// both tensors
+template <typename Result, typename X, typename Y>
+struct Fits<Result, Product<X, Y>>
+    : std::integral_constant<
+          bool,
+          Subset<Result,
+                 typename Join<typename X::labels,
+                               typename Y::labels>::type>::value &&
+              Subset<typename X::labels,
+                     typename Join<Result, typename Y::labels>::type>::value &&
+              Subset<typename Y::labels,
+                     typename Join<Result, typename X::labels>::type>::value>
+{
+};
+
+template <typename Result, typename X, typename Y>
+struct Fits<Result, Sum<X, Y>>
+    : std::integral_constant<bool, Fits<Result, X>::value &&
+                                       Fits<Result, Y>::value>
+{
+};
+
+/// A tensor with compile-time labels, times a factor
+template <char... L> class Labeled
+{
+  public:
+    typedef LabelList<L...> labels;
+    static_assert(labels::distinct(),
+                  "A label appears more than once on a tensor.");
+
+    explicit Labeled(const Tensor &T, double factor = 1.0)
+        : T_(T), factor_(factor)
+    {
+        if (T_.rank() != sizeof...(L))
+            throw std::runtime_error(
+                "Labeled tensor does not have correct number of indices for "
+                "underlying tensor's rank");
+    }
+    Labeled(const Labeled &) = default;
+
+    /// The Indices of the labels, built on first use
+    static const Indices &indices()
+    {
+        static const Indices value{std::string(1, L)...};
+        return value;
+    }
+
+    const Tensor &T() const { return T_; }
+    double factor() const { return factor_; }
+
+    void operator=(const Labeled &rhs) { assign(rhs, 1.0, 0.0); }
+    template <typename Term> void operator=(const Term &rhs)
+    {
+        assign(rhs, 1.0, 0.0);
+    }
+    template <typename Term> void operator+=(const Term &rhs)
+    {
+        assign(rhs, 1.0, 1.0);
+    }
+    template <typename Term> void operator-=(const Term &rhs)
+    {
+        assign(rhs, -1.0, 1.0);
+    }
+
+    Labeled operator-() const { return Labeled(T_, -factor_); }
+
+    /// C(Cinds) = alpha * this + beta * C(Cinds)
+    void add_to(Tensor &C, const Indices &Cinds, double alpha,
+                double beta) const
+    {
+        C.permute(T_, Cinds, indices(), alpha * factor_, beta);
+    }
+    bool reads(const Tensor &C) const { return T_ == C; }
+
+  private:
+    template <typename Term> void assign(const Term &rhs, double alpha,
+                                         double beta)
+    {
+        static_assert(is_term<Term>::value,
+                      "Only tensor expressions can be assigned to a labeled "
+                      "tensor.");
+        static_assert(Fits<labels, Term>::value,
+                      "The labels of the expression do not match those of "
+                      "the result.");
+        if (rhs.reads(T_))
+            throw std::runtime_error("Self assignment is not allowed.");
+        // Every term after the first adds to the result
+        rhs.add_to(T_, indices(), alpha, beta);
+    }
+
+    Tensor T_;
+    double factor_;
+};
+
+/// The product of two labeled tensors, times a factor
+template <typename X, typename Y> class Product
+{
+  public:
+    Product(const X &x, const Y &y, double factor = 1.0)
+        : x_(x), y_(y), factor_(factor)
+    {
+    }
+
+    Product operator-() const { return Product(x_, y_, -factor_); }
+    Product scaled(double factor) const
+    {
+        return Product(x_, y_, factor * factor_);
+    }
+
+    void add_to(Tensor &C, const Indices &Cinds, double alpha,
+                double beta) const
+    {
+        C.contract(x_.T(), y_.T(), Cinds, X::indices(), Y::indices(),
+                   alpha * factor_ * x_.factor() * y_.factor(), beta);
+    }
+    bool reads(const Tensor &C) const { return x_.reads(C) || y_.reads(C); }
+
+  private:
+    X x_;
+    Y y_;
+    double factor_;
+};
+
+/// The sum of two terms
+template <typename X, typename Y> class Sum
+{
+  public:
+    Sum(const X &x, const Y &y) : x_(x), y_(y) {}
+
+    Sum operator-() const { return Sum(-x_, -y_); }
+
+    void add_to(Tensor &C, const Indices &Cinds, double alpha,
+                double beta) const
+    {
+        x_.add_to(C, Cinds, alpha, beta);
+        y_.add_to(C, Cinds, alpha, 1.0);
+    }
+    bool reads(const Tensor &C) const { return x_.reads(C) || y_.reads(C); }
+
+  private:
+    X x_;
+    Y y_;
+};
+
+template <char... L> Labeled<L...> operator*(double factor, const Labeled<L...> &x)
+{
+    return Labeled<L...>(x.T(), factor * x.factor());
+}
+template <char... L> Labeled<L...> operator*(const Labeled<L...> &x, double factor)
+{
+    return factor * x;
+}
+
+template <char... A, char... B>
+Product<Labeled<A...>, Labeled<B...>> operator*(const Labeled<A...> &x,
+                                                const Labeled<B...> &y)
+{
+    return Product<Labeled<A...>, Labeled<B...>>(x, y);
+}
+
+template <typename X, typename Y>
+Product<X, Y> operator*(double factor, const Product<X, Y> &xy)
+{
+    return xy.scaled(factor);
+}
+template <typename X, typename Y>
+Product<X, Y> operator*(const Product<X, Y> &xy, double factor)
+{
+    return xy.scaled(factor);
+}
+
+template <typename X, typename Y, char... L>
+void operator*(const Product<X, Y> &, const Labeled<L...> &)
+{
+    static_assert(sizeof...(L) != sizeof...(L),
+                  "Static expressions contract two tensors at a time; use the "
+                  "runtime expressions (A(\"ij\") * ...) for longer products.");
+}
+
+template <typename X, typename Y>
+typename std::enable_if<is_term<X>::value && is_term<Y>::value,
+                        Sum<X, Y>>::type
+operator+(const X &x, const Y &y)
+{
+    return Sum<X, Y>(x, y);
+}
+
+template <typename X, typename Y>
+typename std::enable_if<is_term<X>::value && is_term<Y>::value,
+                        Sum<X, Y>>::type
+operator-(const X &x, const Y &y)
+{
+    return Sum<X, Y>(x, -y);
+}
+}
+
+template <char... L>
+static_expression::Labeled<L...>
+Tensor::operator()(static_expression::Label<L>...) const
+{
+    return static_expression::Labeled<L...>(*this);
+}
+
+/// The labels _a to _z, for static expressions
+namespace labels
+{
+constexpr static_expression::Label<'a'> _a{};
+constexpr static_expression::Label<'b'> _b{};
+constexpr static_expression::Label<'c'> _c{};
+constexpr static_expression::Label<'d'> _d{};
+constexpr static_expression::Label<'e'> _e{};
+constexpr static_expression::Label<'f'> _f{};
+constexpr static_expression::Label<'g'> _g{};
+constexpr static_expression::Label<'h'> _h{};
+constexpr static_expression::Label<'i'> _i{};
+constexpr static_expression::Label<'j'> _j{};
+constexpr static_expression::Label<'k'> _k{};
+constexpr static_expression::Label<'l'> _l{};
+constexpr static_expression::Label<'m'> _m{};
+constexpr static_expression::Label<'n'> _n{};
+constexpr static_expression::Label<'o'> _o{};
+constexpr static_expression::Label<'p'> _p{};
+constexpr static_expression::Label<'q'> _q{};
+constexpr static_expression::Label<'r'> _r{};
+constexpr static_expression::Label<'s'> _s{};
+constexpr static_expression::Label<'t'> _t{};
+constexpr static_expression::Label<'u'> _u{};
+constexpr static_expression::Label<'v'> _v{};
+constexpr static_expression::Label<'w'> _w{};
+constexpr static_expression::Label<'x'> _x{};
+constexpr static_expression::Label<'y'> _y{};
+constexpr static_expression::Label<'z'> _z{};
+}
+}
+
+#endif // AMBIT_STATIC_EXPRESSION_H
@@ -36,25 +36,17 @@
 #include <map>
 #include <string>
 
+#include <ambit/blocked_tensor.h>
 #include <ambit/tensor.h>
 
 namespace ambit
 {
 
-class LabeledBlockedTensor;
-class LabeledBlockedTensorProduct;
-class LabeledBlockedTensorAddition;
-class LabeledBlockedTensorDistributive;
-
-enum SpinType
-{
-    AlphaSpin,
-    BetaSpin,
-    NoSpin
-};
+class LabeledSymBlockedTensor;
+class LabeledSymBlockedTensorProduct;
 
 /**
- * Class MOSpace
+ * Class SymMOSpace
  **/
 class SymMOSpace
 {
@@ -92,6 +84,15 @@ class SymMOSpace
     /// @return The spin of this set of molecular orbitals
     std::vector<SpinType> spin() const { return spin_; }
 
+    /// @return The number of irreducible representations
+    int nirrep() const { return nirrep_; }
+
+    /// @return The molecular orbitals of irrep h
+    const std::vector<size_t> &mos(int h) const { return mos_sym_[h]; }
+
+    /// @return The number of molecular orbitals of irrep h
+    size_t dim(int h) const { return mos_sym_[h].size(); }
+
     /// Print information about this molecular orbital space
     void print();
 
@@ -113,28 +114,54 @@ class SymMOSpace
     std::vector<std::pair<int,size_t>> mos_map_;
 };
 
+/// The MO spaces used by SymBlockedTensor (see MOSpaceContext)
+struct SymMOSpaceContext
+{
+    /// A vector of SymMOSpace objects
+    std::vector<SymMOSpace> mo_spaces;
+    /// Maps the name of MOSpace (e.g. "o") to the position of the object in
+    /// the vector mo_spaces
+    std::map<std::string, size_t> name_to_mo_space;
+    /// Maps the name of a composite orbital space (e.g. "h") to the MOSpace
+    /// objects that it spans
+    std::map<std::string, std::vector<size_t>> composite_name_to_mo_spaces;
+    /// Maps an orbital index (e.g. "i","j") to the MOSpace objects that
+    /// contain it
+    std::map<std::string, std::vector<size_t>> index_to_mo_spaces;
+    /// Enables expert mode, which overides some default error checking
+    bool expert_mode = false;
+};
+
+/// Block key of a SymBlockedTensor: the (MO space, irrep) of each index
+using SymBlockKey = std::vector<std::pair<size_t, int>>;
+
 /**
  * Class SymBlockedTensor
- * Represent a tensor aware of spin and MO spaces.
- * This class holds several tensors, blocked according to spin and MO spaces.
+ * Represent a tensor aware of MO spaces and of point-group symmetry.
+ * Each index of a block is restricted to one MO space and one irrep, and
+ * only the blocks whose direct product of irreps equals the symmetry of the
+ * tensor are stored. For abelian point groups (D2h and its subgroups),
+ * with irreps in Cotton order, the direct product of irreps h and g is
+ * h ^ g.
+ *
+ * Labeled contractions only visit the pairs of stored blocks that agree on
+ * their shared indices, so the symmetry-forbidden block combinations are
+ * never formed.
  *
  * Sample usage:
- *  BlockedTensor::add_mo_space("O" ,"i,j,k,l"    ,{0,1,2,3,4},AlphaSpin);
- *  BlockedTensor::add_mo_space("V" ,"a,b,c,d"    ,{7,8,9},AlphaSpin);
- *  BlockedTensor::add_mo_space("I" ,"p,q,r,s,t"  ,{"O","A","V"}); // create a
- *composite space
- *  BlockedTensor::add_mo_space("A" ,"u,v,w,x,y,z",{5,6},AlphaSpin);
- *  BlockedTensor::add_composite_mo_space("H","m,n",{"O","A"}); // BlockedTensor
- *can deal with redundant spaces
- *  BlockedTensor::add_composite_mo_space("P","e,f",{"A","V"});
+ *  SymBlockedTensor::add_mo_space("o", "i,j,k,l", 4,
+ *                                 {{0,0}, {1,0}, {2,1}, {3,3}}, AlphaSpin);
+ *  SymBlockedTensor::add_mo_space("v", "a,b,c,d", 4,
+ *                                 {{4,0}, {5,1}, {6,2}, {7,3}}, AlphaSpin);
  *
- *  BlockedTensor T("T","O,O,V,V");
- *  BlockedTensor V("V","O,O,V,V");
- *  E = 0.25 * T("ijab") * V("ijab")
+ *  SymBlockedTensor T = SymBlockedTensor::build(CoreTensor, "T", {"oovv"});
+ *  SymBlockedTensor V = SymBlockedTensor::build(CoreTensor, "V", {"oovv"});
+ *  double E = 0.25 * T("ijab") * V("ijab");
  **/
 class SymBlockedTensor
 {
-    friend class LabeledBlockedTensor;
+    friend class LabeledSymBlockedTensor;
+    friend class LabeledSymBlockedTensorProduct;
 
   public:
     // => Constructors <= //
@@ -151,18 +178,18 @@ class SymBlockedTensor
      * @param name            The name of the tensor for use in printing.
      * @param blocks          A vector of strings that specify which blocks are
      * contained in this object.
+     * @param symmetry        The irrep of the tensor (0 is totally symmetric).
      *
      * Example of use.
-     * Here "o","O","v","V" are names of orbital spaces.
-     * build(CoreTensor,"T2",{"o,O,v,V"});    // <- creates the alpha-alpha
-     * block of
-     * the tensor T2 in core
-     * build(DiskTensor,"T1",{"o,v","O,V"}); // <- creates the alpha and beta
-     * blocks
-     * of the tensor T1 on disk
+     * Here "o","v" are names of orbital spaces.
+     * build(CoreTensor,"T2",{"oovv"}); // <- creates every totally symmetric
+     * irrep block of the tensor T2 in core
+     * build(CoreTensor,"X",{"ov"},1); // <- creates the blocks of a tensor of
+     * irrep 1
      */
     static SymBlockedTensor build(TensorType type, const std::string &name,
-                               const std::vector<std::string> &blocks);
+                                  const std::vector<std::string> &blocks,
+                                  int symmetry = 0);
 
     static void add_mo_space(const std::string &name,
                              const std::string &mo_indices,
@@ -174,9 +201,16 @@ class SymBlockedTensor
                            const std::string &mo_indices,
                            const std::vector<std::string> &subspaces);
     static void reset_mo_spaces();
-//    static void print_mo_spaces();
+    /// @return The MO space context of the calling thread
+    static const std::shared_ptr<SymMOSpaceContext> &context();
+    /// Makes the calling thread use context (null restores the default)
+    /// @return The context previously set on this thread (null if none)
+    static std::shared_ptr<SymMOSpaceContext>
+    set_context(const std::shared_ptr<SymMOSpaceContext> &context);
+    /// @return The MO spaces, in the order of the space entries of block keys
+    static const std::vector<SymMOSpace> &mo_spaces() { return context()->mo_spaces; }
 
-//    static void set_expert_mode(bool mode) { expert_mode_ = mode; }
+    static void set_expert_mode(bool mode) { context()->expert_mode = mode; }
 
     // => Accessors <= //
 
@@ -186,374 +220,254 @@ class SymBlockedTensor
     size_t rank() const;
     /// @return The number of blocks
     size_t numblocks() const;
+    /// @return The irrep of the tensor
+    int symmetry() const { return symmetry_; }
+
+    /// Set the name of the tensor to name
+    void set_name(const std::string &name);
+
+    /// @return Does this Tensor point to the same underlying tensor as Tensor
+    /// other?
+    bool operator==(const SymBlockedTensor &other) const;
+    /// @return !Does this Tensor point to the same underlying tensor as Tensor
+    /// other?
+    bool operator!=(const SymBlockedTensor &other) const;
+
+    // => Data Access <= //
+
+    /// @return a list of labels of the blocks contained in this object (e.g.
+    /// {"o0o0v1v1",...}, space names each followed by the irrep)
+    const std::vector<std::string> &block_labels() const
+    {
+        return block_labels_;
+    }
+
+    /// @return a map with the block key and the corresponding tensor
+    const std::map<SymBlockKey, Tensor> &blocks() const { return blocks_; }
+
+    /// Is this block present?
+    bool is_block(const SymBlockKey &key) const;
+    /// Is the block of the given spaces (e.g. "oovv") and irreps present?
+    bool is_block(const std::string &spaces,
+                  const std::vector<int> &irreps) const;
+
+    /// Return a Tensor object that corresponds to a given block key
+    Tensor block(const SymBlockKey &key);
+    /// Return a constant Tensor object that corresponds to a given block key
+    const Tensor block(const SymBlockKey &key) const;
+    /// Return the block of the given spaces (e.g. "oovv") and irreps
+    Tensor block(const std::string &spaces, const std::vector<int> &irreps);
+
+    // => BLAS-Type Tensor Operations <= //
 
-//    /// Set the name of the tensor to name
-//    void set_name(const std::string &name);
-
-//    /// @return Does this Tensor point to the same underlying tensor as Tensor
-//    /// other?
-//    bool operator==(const BlockedTensor &other) const;
-//    /// @return !Does this Tensor point to the same underlying tensor as Tensor
-//    /// other?
-//    bool operator!=(const BlockedTensor &other) const;
-
-//    /**
-//    * Print some tensor information to fh
-//    * \param level If level = false, just print name and dimensions.  If level =
-//    *true, print the entire tensor.
-//    **/
-//    void print(FILE *fh = stdout, bool level = true,
-//               const std::string &format = std::string("%11.6f"),
-//               int maxcols = 5) const;
-
-//    // => Data Access <= //
-
-//    /// @return a list of labels of the blocks contained in this object (e.g.
-//    /// {"ccaa","cCaA",...})
-//    std::vector<std::string> &block_labels() { return block_labels_; }
-//    const
-
-//        /**
-//         * Returns a map with the block key and the corresponding tensor.
-//         *
-//         * Results:
-//         *  @return a key/Tensor map
-//         **/
-//        std::map<std::vector<size_t>, Tensor> &
-//        blocks()
-//    {
-//        return blocks_;
-//    }
-
-//    /// Is this block present?
-//    bool is_block(const std::string &indices) const;
-//    /// Is this block present?
-//    bool is_block(const std::vector<size_t> &key) const;
-
-//    /// Return a Tensor object that corresponds to a given orbital class
-//    Tensor block(const std::vector<size_t> &key);
-//    /// Return a constant Tensor object that corresponds to a given orbital
-//    /// class
-//    const Tensor block(const std::vector<size_t> &key) const;
-//    /// Return a Tensor object that corresponds to a given block key
-//    Tensor block(const std::string &indices);
-
-//    // => BLAS-Type Tensor Operations <= //
-
-//    /**
-//     * Returns the norm of the tensor
-//     *
-//     * Parameters:
-//     * @param type the type of norm desired:
-//     *  0 - Infinity-norm, maximum absolute value of elements
-//     *  1 - One-norm, sum of absolute values of elements
-//     *  2 - Two-norm, square root of sum of squares
-//     **/
-//    double norm(int type = 2) const;
-
-//    /**
-//     * Sets the data of the tensor to zeros.
-//     * Note: this just drops down to scale(0.0);
-//     **/
-//    void zero();
-
-//    /**
-//     * Scales the tensor by scalar beta, e.g.:
-//     *  C = beta * C
-//     *
-//     * Note: If beta is 0.0, a memset is performed rather than a scale to clamp
-//     * NaNs and other garbage out.
-//     **/
-//    void scale(double beta = 0.0);
-
-//    /**
-//     * Set the tensor elemets to gamma, e.g.:
-//     *  C = gamma
-//     **/
-//    void set(double gamma);
-
-//    /**
-//     * Copy the data of other into this blocked tensor:
-//     *  C() = other()
-//     * Note: this just drops into slice
-//     *
-//     * Parameters:
-//     *  @param other the blocked tensor to copy data from
-//     *
-//     * Results
-//     *  C is the current bocked tensor, whose data is overwritten
-//     **/
-//    //    void copy(const BlockedTensor& other);
-
-//    // => Iterators <= //
-
-//    /**
-//     * Iterate overall all elements of all blocks.  The iterator provides access
-//     *to the
-//     * value of the tensor elements, the MO indices, and spin values.
-//     **/
-//    void iterate(const std::function<void(const std::vector<size_t> &,
-//                                          const std::vector<SpinType> &,
-//                                          double &)> &func);
-//    /**
-//     * Iterate overall all elements of all blocks.  The iterator provides
-//     *constant access to the
-//     * value of the tensor elements, the MO indices, and spin values.
-//     **/
-//    void citerate(const std::function<void(const std::vector<size_t> &,
-//                                           const std::vector<SpinType> &,
-//                                           const double &)> &func) const;
-
-//    /// Maps tensor labels ({"i","j","k","p"}) to keys to the block map
-//    /// ({{0,0,0,0},{0,0,0,1}})
-//    static std::vector<std::vector<size_t>>
-//    label_to_block_keys(const std::vector<std::string> &indices);
+    /**
+     * Returns the norm of the tensor
+     *
+     * Parameters:
+     * @param type the type of norm desired:
+     *  0 - Infinity-norm, maximum absolute value of elements
+     *  1 - One-norm, sum of absolute values of elements
+     *  2 - Two-norm, square root of sum of squares
+     **/
+    double norm(int type = 2) const;
+
+    /**
+     * Sets the data of the tensor to zeros.
+     * Note: this just drops down to scale(0.0);
+     **/
+    void zero();
+
+    /**
+     * Scales the tensor by scalar beta, e.g.:
+     *  C = beta * C
+     **/
+    void scale(double beta = 0.0);
+
+    /**
+     * Set the tensor elemets to gamma, e.g.:
+     *  C = gamma
+     *
+     * Note: only the symmetry-allowed blocks are stored and set.
+     **/
+    void set(double gamma);
+
+    // => Rank-2 LAPACK-Type Operations <= //
+
+    /**
+     * Diagonalizes every irrep block of a totally symmetric matrix whose
+     * blocks are all diagonal in the MO spaces (e.g. "oo" and "vv"), the
+     * blocks concurrently (see Tensor::syev).
+     *
+     * @returns map with the keys "eigenvalues" and "eigenvectors", both with
+     * the blocks of this; the eigenvalues are on the diagonal of their
+     * blocks, as the irrep of a rank-1 block would break the symmetry of the
+     * tensor.
+     */
+    std::map<std::string, SymBlockedTensor> syev(EigenvalueOrder order) const;
+    /// Raises every irrep block to power, the blocks concurrently (see syev
+    /// and Tensor::power)
+    SymBlockedTensor power(double power, double condition = 1.0E-12) const;
+    /// Inverts every irrep block, the blocks concurrently (see syev and
+    /// Tensor::inverse)
+    SymBlockedTensor inverse() const;
+
+    // => Checkpointing <= //
+
+    /**
+     * Saves the tensor to an HDF5 location (a file or a group) as
+     * BlockedTensor::save does: one dataset per block, named by its label
+     * (e.g. "o0o0v1v1"), plus the name and symmetry of the tensor and its
+     * MO spaces.
+     */
+    void save(const io::hdf5::Location &location) const;
+
+    /// Saves the tensor in the background (see BlockedTensor::save_async)
+    std::future<void> save_async(const std::string &filename,
+                                 const std::string &group = "") const;
+
+    /**
+     * Loads a tensor saved by save, defining its MO spaces if needed (see
+     * BlockedTensor::load)
+     */
+    static SymBlockedTensor load(const io::hdf5::Location &location,
+                                 TensorType type = CoreTensor);
+
+    // => Iterators <= //
+
+    /**
+     * Iterate overall all elements of all blocks.  The iterator provides access
+     * to the value of the tensor elements, the MO indices, and their irreps.
+     **/
+    void iterate(const std::function<void(const std::vector<size_t> &,
+                                          const std::vector<int> &,
+                                          double &)> &func);
+    /**
+     * Iterate overall all elements of all blocks.  The iterator provides
+     * constant access to the value of the tensor elements, the MO indices,
+     * and their irreps.
+     **/
+    void citerate(const std::function<void(const std::vector<size_t> &,
+                                           const std::vector<int> &,
+                                           const double &)> &func) const;
 
   private:
     std::string name_;
     std::size_t rank_;
+    int symmetry_;
     std::vector<std::string> block_labels_;
-    std::map<std::vector<std::pair<size_t,int>>, Tensor> blocks_;
-
-//    /// A vector of MOSpace objects
-//    size_t add_mo_space(MOSpace mo_space);
-//    bool map_name_to_mo_space(const std::string &index, size_t mo_space_idx);
-//    bool
-//    map_composite_name_to_mo_spaces(const std::string &index,
-//                                    const std::vector<size_t> &mo_spaces_idx);
-//    bool map_index_to_mo_spaces(const std::string &index,
-//                                const std::vector<size_t> &mo_spaces_idx);
-//    static std::vector<size_t> indices_to_key(const std::string &indices);
-
-//    /// @return The n-th MOSpace
-//    static MOSpace mo_space(size_t n) { return mo_spaces_[n]; }
-//    /// @return The MOSpace corresponding to the name of a space
-//    size_t name_to_mo_space(const std::string &index);
-//    /// @return The MOSpace objects corresponding to the name of a space
-//    std::vector<size_t> &composite_name_to_mo_spaces(const std::string &index);
-//    /// @return The MOSpace objects corresponding to an orbital index
-//    std::vector<size_t> &index_to_mo_spaces(const std::string &index);
-
-    // => Static Class Data <= //
+    std::map<SymBlockKey, Tensor> blocks_;
 
-    /// A vector of SymMOSpace objects
-    static std::vector<SymMOSpace> mo_spaces_;
-    /// Maps the name of MOSpace (e.g. "o") to the position of the object in the
-    /// vector mo_spaces_
-    static std::map<std::string, size_t> name_to_mo_space_;
-    /// Maps the name of a composite orbital space (e.g. "h") to the MOSpace
-    /// objects that it spans
-    static std::map<std::string, std::vector<size_t>>
-        composite_name_to_mo_spaces_;
-    /// Maps an orbital index (e.g. "i","j") to the MOSpace objects that contain
-    /// it
-    static std::map<std::string, std::vector<size_t>> index_to_mo_spaces_;
-    /// Enables expert mode, which overides some default error checking
-    static bool expert_mode_;
+    /// @return The keys of the blocks whose spaces match the labels
+    std::vector<SymBlockKey>
+    label_to_block_keys(const std::vector<std::string> &indices) const;
+
+    /// @return The label of a block (e.g. "o0o0v1v1")
+    static std::string block_label(const SymBlockKey &key);
+
+    /// Applies op to every diagonal irrep block, the blocks concurrently.
+    /// @return For each label of the results of op, a tensor with the
+    /// blocks of this holding those results
+    std::map<std::string, SymBlockedTensor> map_diagonal_blocks(
+        const std::string &caller,
+        const std::function<std::map<std::string, Tensor>(const Tensor &)> &op)
+        const;
+
+  public:
+    /// @return Is SymBlockedTensor using "expert mode"?
+    static bool expert_mode() { return context()->expert_mode; }
+
+    // => Operator Overloading API <= //
+
+    LabeledSymBlockedTensor operator()(const std::string &indices);
+    LabeledSymBlockedTensor operator[](const std::string &indices);
+};
+
+class LabeledSymBlockedTensor
+{
+  public:
+    LabeledSymBlockedTensor(SymBlockedTensor T,
+                            const std::vector<std::string> &indices,
+                            double factor = 1.0);
+
+    double factor() const { return factor_; }
+    const Indices &indices() const { return indices_; }
+    const SymBlockedTensor &BT() const { return BT_; }
+
+    LabeledSymBlockedTensorProduct
+    operator*(const LabeledSymBlockedTensor &rhs) const;
+
+    /** Copies data from rhs to this sorting the data if needed. */
+    void operator=(const LabeledSymBlockedTensor &rhs);
+    void operator+=(const LabeledSymBlockedTensor &rhs);
+    void operator-=(const LabeledSymBlockedTensor &rhs);
 
+    void operator=(const LabeledSymBlockedTensorProduct &rhs);
+    void operator+=(const LabeledSymBlockedTensorProduct &rhs);
+    void operator-=(const LabeledSymBlockedTensorProduct &rhs);
+
+    void operator*=(double scale);
+    void operator/=(double scale);
+
+    size_t numdim() const { return indices_.size(); }
+
+    // negation
+    LabeledSymBlockedTensor operator-() const
+    {
+        return LabeledSymBlockedTensor(BT_, indices_, -factor_);
+    }
+
+  private:
+    void add(const LabeledSymBlockedTensor &rhs, double alpha, double beta);
+    void contract(const LabeledSymBlockedTensorProduct &rhs, double alpha,
+                  double beta);
+
+    SymBlockedTensor BT_;
+    std::vector<std::string> indices_;
+    double factor_;
+};
+
+inline LabeledSymBlockedTensor operator*(double factor,
+                                         const LabeledSymBlockedTensor &ti)
+{
+    return LabeledSymBlockedTensor(ti.BT(), ti.indices(), factor * ti.factor());
+}
+
+class LabeledSymBlockedTensorProduct
+{
   public:
-    /// @return Is BlockedTensor using "expert mode"?
-    static bool expert_mode() { return expert_mode_; }
+    LabeledSymBlockedTensorProduct(const LabeledSymBlockedTensor &A,
+                                   const LabeledSymBlockedTensor &B)
+        : A_(A), B_(B)
+    {
+    }
+
+    const LabeledSymBlockedTensor &A() const { return A_; }
+    const LabeledSymBlockedTensor &B() const { return B_; }
 
-//  protected:
-//  public:
-//    // => Operator Overloading API <= //
+    /**
+     * Calls func(A block, B block, irreps) for every pair of stored blocks
+     * that agree on the space and irrep of each shared index; irreps maps
+     * each label to its (space, irrep).
+     */
+    void for_each_block_pair(
+        const std::function<void(const Tensor &, const Tensor &,
+                                 const std::map<std::string,
+                                                std::pair<size_t, int>> &)>
+            &func) const;
 
-//    LabeledBlockedTensor operator()(const std::string &indices);
-//    LabeledBlockedTensor operator[](const std::string &indices);
+    // conversion operator
+    operator double() const;
+
+  private:
+    LabeledSymBlockedTensor A_;
+    LabeledSymBlockedTensor B_;
 };
 
-//class LabeledBlockedTensor
-//{
-
-//  public:
-//    LabeledBlockedTensor(BlockedTensor T,
-//                         const std::vector<std::string> &indices,
-//                         double factor = 1.0);
-
-//    double factor() const { return factor_; }
-//    const Indices &indices() const { return indices_; }
-//    const BlockedTensor &BT() const { return BT_; }
-//    std::string str() const;
-
-//    LabeledBlockedTensorProduct operator*(const LabeledBlockedTensor &rhs);
-//    LabeledBlockedTensorAddition operator+(const LabeledBlockedTensor &rhs);
-//    LabeledBlockedTensorAddition operator-(const LabeledBlockedTensor &rhs);
-
-//    LabeledBlockedTensorDistributive
-//    operator*(const LabeledBlockedTensorAddition &rhs);
-
-//    /** Copies data from rhs to this sorting the data if needed. */
-//    void operator=(const LabeledBlockedTensor &rhs);
-//    void operator+=(const LabeledBlockedTensor &rhs);
-//    void operator-=(const LabeledBlockedTensor &rhs);
-
-//    void operator=(const LabeledBlockedTensorDistributive &rhs);
-//    void operator+=(const LabeledBlockedTensorDistributive &rhs);
-//    void operator-=(const LabeledBlockedTensorDistributive &rhs);
-
-//    void operator=(const LabeledBlockedTensorProduct &rhs);
-//    void operator+=(const LabeledBlockedTensorProduct &rhs);
-//    void operator-=(const LabeledBlockedTensorProduct &rhs);
-
-//    void operator=(const LabeledBlockedTensorAddition &rhs);
-//    void operator+=(const LabeledBlockedTensorAddition &rhs);
-//    void operator-=(const LabeledBlockedTensorAddition &rhs);
-
-//    void operator*=(double scale);
-//    void operator/=(double scale);
-
-//    size_t numdim() const { return indices_.size(); }
-
-//    // negation
-//    LabeledBlockedTensor operator-() const
-//    {
-//        return LabeledBlockedTensor(BT_, indices_, -factor_);
-//    }
-
-//  private:
-//    void set(const LabeledBlockedTensor &to);
-
-//    std::vector<std::vector<size_t>> label_to_block_keys() const
-//    {
-//        return BT_.label_to_block_keys(indices_);
-//    }
-
-//    void contract(const LabeledBlockedTensorProduct &rhs, bool zero_result,
-//                  bool add);
-//    void add(const LabeledBlockedTensor &rhs, double alpha, double beta);
-
-//    BlockedTensor BT_;
-//    std::vector<std::string> indices_;
-//    double factor_;
-//};
-
-//inline LabeledBlockedTensor operator*(double factor,
-//                                      const LabeledBlockedTensor &ti)
-//{
-//    return LabeledBlockedTensor(ti.BT(), ti.indices(), factor * ti.factor());
-//};
-
-//class LabeledBlockedTensorProduct
-//{
-
-//  public:
-//    LabeledBlockedTensorProduct(const LabeledBlockedTensor &A,
-//                                const LabeledBlockedTensor &B)
-//    {
-//        tensors_.push_back(A);
-//        tensors_.push_back(B);
-//    }
-
-//    size_t size() const { return tensors_.size(); }
-
-//    std::string str() const;
-
-//    const LabeledBlockedTensor &operator[](size_t i) const
-//    {
-//        return tensors_[i];
-//    }
-
-//    LabeledBlockedTensorProduct &operator*(const LabeledBlockedTensor &other)
-//    {
-//        tensors_.push_back(other);
-//        return *this;
-//    }
-
-//    // conversion operator
-//    operator double() const;
-
-//  private:
-//    std::vector<LabeledBlockedTensor> tensors_;
-//};
-
-//class LabeledBlockedTensorAddition
-//{
-//  public:
-//    LabeledBlockedTensorAddition(const LabeledBlockedTensor &A,
-//                                 const LabeledBlockedTensor &B)
-//    {
-//        tensors_.push_back(A);
-//        tensors_.push_back(B);
-//    }
-
-//    size_t size() const { return tensors_.size(); }
-
-//    const LabeledBlockedTensor &operator[](size_t i) const
-//    {
-//        return tensors_[i];
-//    }
-
-//    std::vector<LabeledBlockedTensor>::iterator begin()
-//    {
-//        return tensors_.begin();
-//    }
-//    std::vector<LabeledBlockedTensor>::const_iterator begin() const
-//    {
-//        return tensors_.begin();
-//    }
-
-//    std::vector<LabeledBlockedTensor>::iterator end() { return tensors_.end(); }
-//    std::vector<LabeledBlockedTensor>::const_iterator end() const
-//    {
-//        return tensors_.end();
-//    }
-
-//    LabeledBlockedTensorAddition &operator+(const LabeledBlockedTensor &other)
-//    {
-//        tensors_.push_back(other);
-//        return *this;
-//    }
-
-//    LabeledBlockedTensorAddition &operator-(const LabeledBlockedTensor &other)
-//    {
-//        tensors_.push_back(-other);
-//        return *this;
-//    }
-
-//    LabeledBlockedTensorDistributive
-//    operator*(const LabeledBlockedTensor &other);
-
-//    LabeledBlockedTensorAddition &operator*(double scalar);
-
-//    // negation
-//    LabeledBlockedTensorAddition &operator-();
-
-//  private:
-//    // This handles cases like T("ijab")
-//    std::vector<LabeledBlockedTensor> tensors_;
-//};
-
-//inline LabeledBlockedTensorAddition
-//operator*(double factor, const LabeledBlockedTensorAddition &ti)
-//{
-//    LabeledBlockedTensorAddition ti2 = ti;
-//    return ti2 * factor;
-//}
-
-//// Is responsible for expressions like D * (J - K) --> D*J - D*K
-//class LabeledBlockedTensorDistributive
-//{
-//  public:
-//    LabeledBlockedTensorDistributive(const LabeledBlockedTensor &A,
-//                                     const LabeledBlockedTensorAddition &B)
-//        : A_(A), B_(B)
-//    {
-//    }
-
-//    const LabeledBlockedTensor &A() const { return A_; }
-//    const LabeledBlockedTensorAddition &B() const { return B_; }
-
-//    // conversion operator
-//    operator double() const;
-
-//  private:
-//    const LabeledBlockedTensor &A_;
-//    const LabeledBlockedTensorAddition &B_;
-//};
-
-///// Take a string like "oovv" and generates the strings "oovv","oOvV","OOVV"
-//std::vector<std::string> spin_cases(const std::vector<std::string> &str);
+inline LabeledSymBlockedTensorProduct
+operator*(double factor, const LabeledSymBlockedTensorProduct &ti)
+{
+    return LabeledSymBlockedTensorProduct(factor * ti.A(), ti.B());
+}
 }
 
 #endif
@@ -33,6 +33,10 @@
 #include "common_types.h"
 #include "settings.h"
 
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
 namespace ambit
 {
 
@@ -45,7 +49,13 @@ class LabeledTensorAddition;
 class LabeledTensorSubtraction;
 class LabeledTensorDistribution;
 class LabeledTensorSumOfProducts;
+class LabeledTensorPermutation;
 class SlicedTensor;
+namespace static_expression
+{
+template <char L> struct Label;
+template <char... L> class Labeled;
+}
 
 // => Tensor Types <=
 enum TensorType
@@ -54,7 +64,24 @@ enum TensorType
     CoreTensor,        // <= In-core only tensor
     DiskTensor,        // <= Disk cachable tensor
     DistributedTensor, // <= Tensor suitable for parallel distributed
-    AgnosticTensor     // <= Let the library decide for you.
+    AgnosticTensor,    // <= Let the library decide for you.
+    GpuTensor,         // <= Tensor resident in GPU memory
+    LazyTensor         // <= Read-only tensor computed on demand, box by box
+};
+
+/**
+ * Computes the elements of a box of a lazy tensor (see Tensor::build_lazy).
+ * box holds the [begin, end) range of each index, and buffer receives the
+ * elements of the box in row-major order.
+ */
+typedef function<void(const IndexRange &box, double *buffer)> TileGenerator;
+
+/// How a tensor is going to be used, which guides the type an
+/// AgnosticTensor is given (see Tensor::choose_type)
+enum TensorAccess
+{
+    RandomAccess,  // <= Contraction operands and element access
+    StreamedAccess // <= Written or read whole in a few passes
 };
 
 enum EigenvalueOrder
@@ -85,6 +112,73 @@ void finalize();
  */
 void barrier();
 
+/// Statistics of the elements of a tensor, computed in one pass by
+/// Tensor::stats() and BlockedTensor::stats()
+struct TensorStats
+{
+    /// Number of elements
+    size_t numel = 0L;
+    /// Sum of absolute values
+    double norm1 = 0.0;
+    /// Square root of the sum of squares
+    double norm2 = 0.0;
+    /// Largest absolute value
+    double norm_inf = 0.0;
+    /// Root mean square, norm2 / sqrt(numel)
+    double rms = 0.0;
+    /// Largest value and its indices (the first one if tied)
+    double max = 0.0;
+    vector<size_t> max_indices;
+    /// Smallest value and its indices (the first one if tied)
+    double min = 0.0;
+    vector<size_t> min_indices;
+};
+
+/**
+ * An operation applied to every element of the result of a contraction as
+ * it is written, while it is still in cache:
+ *  C(Cinds) = f(alpha * A(Ainds) * B(Binds) + beta * C(Cinds))
+ * e.g. the division by orbital-energy denominators that follows most
+ * amplitude updates, without a second pass over C (see Tensor::contract).
+ **/
+class Epilogue
+{
+  public:
+    typedef function<void(const vector<size_t> &, double &)> Function;
+
+    /// Calls func(indices, value) on every element of C, as Tensor::iterate
+    /// does, but from several threads at once
+    explicit Epilogue(const Function &func) : func_(func) {}
+
+    /**
+     * Divides every element of C by
+     *  shift + sum_k signs[k] * energies[k][i_k]
+     * with one vector of energies (and one sign) per index of C. E.g. the
+     * denominators of doubles amplitudes T("ijab") take {eo, eo, ev, ev}
+     * and signs {1, 1, -1, -1}. See BlockedTensor::denominator for the
+     * energies of a block.
+     **/
+    static Epilogue denominator(const vector<vector<double>> &energies,
+                                const vector<double> &signs,
+                                double shift = 0.0);
+
+    /// Throws unless the epilogue fits a C of dimensions dims
+    void check(const Dimension &dims) const;
+
+    /// Applies the epilogue to the n elements stored at data, which run
+    /// from indices along index dim of C (indices is restored on return)
+    void apply(vector<size_t> &indices, size_t dim, double *data,
+               size_t n) const;
+
+  private:
+    Epilogue() {}
+
+    Function func_;
+    vector<vector<double>> energies_;
+    vector<double> signs_;
+    double shift_ = 0.0;
+};
+
 class Tensor
 {
 
@@ -108,6 +202,50 @@ class Tensor
     static Tensor build(TensorType type, const string &name,
                         const Dimension &dims);
 
+    /**
+     * Factory constructor like build, for tensors that will be fully
+     * overwritten before they are read (e.g. by a contraction or permute
+     * with beta = 0). CoreTensor storage is drawn from the library's scratch
+     * pool, so it is not zero-filled when a recycled buffer fits. Other
+     * types are built by build.
+     *
+     * Results:
+     *  @return new Tensor of TensorType type with name and dims
+     *   The contents of the returned Tensor are undefined.
+     **/
+    static Tensor build_uninitialized(TensorType type, const string &name,
+                                      const Dimension &dims);
+
+    /**
+     * Factory constructor for a CoreTensor whose data is produced on first
+     * use, e.g. read from a checkpoint. No memory is held until then: the
+     * first access to the data allocates it and calls loader with a pointer
+     * to numel() doubles, in the order of data(), to fill. The tensor is
+     * then an ordinary CoreTensor. An exception thrown by loader reaches
+     * the operation that touched the tensor, and the next access retries.
+     *
+     * Results:
+     *  @return new CoreTensor with name and dims, filled by loader
+     **/
+    static Tensor build_deferred(const string &name, const Dimension &dims,
+                                 const function<void(double *)> &loader);
+
+    /**
+     * Factory constructor for a read-only LazyTensor, e.g. energy
+     * denominators or integrals computed on the fly. Its elements are never
+     * stored: whenever an operation reads a box of the tensor, generator is
+     * called to compute that box. Slices read the box they take; copies,
+     * norms, permutations and contractions read it in tiles that fit in a
+     * fraction of settings::memory_limit, and batched contractions
+     * (see batched()) read the batch they need. The generator may be
+     * called from a helper thread, but not by two threads at once.
+     *
+     * Results:
+     *  @return new LazyTensor with name and dims, computed by generator
+     **/
+    static Tensor build_lazy(const string &name, const Dimension &dims,
+                             const TileGenerator &generator);
+
     /**
      * Return a new Tensor of TensorType type which copies the name,
      * dimensions, and data of this tensor.
@@ -126,6 +264,40 @@ class Tensor
      **/
     Tensor clone(TensorType type = CurrentTensor) const;
 
+    /**
+     * The type given to an AgnosticTensor of dims used as access says.
+     *
+     * With several processes and Cyclops, tensors of at least
+     * settings::distributed_threshold bytes are distributed. Otherwise a
+     * tensor stays in core while it fits in what settings::memory_limit
+     * leaves beside the live CoreTensor's, and goes to disk when it does
+     * not. A streamed tensor gains little from memory, so it only stays in
+     * core while it takes at most half of what is left.
+     *
+     * Parameters:
+     *  @param dims the dimensions of the tensor
+     *  @param access how the tensor is going to be used
+     *
+     * Results:
+     *  @return CoreTensor, DiskTensor or DistributedTensor
+     **/
+    static TensorType choose_type(const Dimension &dims,
+                                  TensorAccess access = RandomAccess);
+
+    /**
+     * Moves this tensor to the type choose_type gives it for access, when
+     * that is not its current type, keeping its name and contents; e.g. an
+     * integral tensor that is only streamed from now on can leave memory:
+     *  I.migrate(StreamedAccess);
+     * The memory of a CoreTensor counts as free for its own choice. Other
+     * Tensor objects sharing this tensor keep the old storage, as they
+     * would with clone.
+     *
+     * Results:
+     *  @return The type of the tensor afterwards
+     **/
+    TensorType migrate(TensorAccess access = RandomAccess);
+
     /**
      * Default constructor, builds a Tensor with a null underlying
      * implementation.
@@ -208,6 +380,68 @@ class Tensor
     vector<double> &data();
     const vector<double> &data() const;
 
+    /**
+     * Returns a pointer to the unrolled data of the tensor without copying,
+     * in the same order as data().
+     *
+     * For a CoreTensor this is data().data(). For a DiskTensor the backing
+     * file is memory mapped on the first call, so the pages are brought in
+     * by the OS as they are touched. The mapping is shared with the file and
+     * stays coherent with the other disk operations; it is valid until
+     * unmap_data() is called or the tensor is destroyed.
+     *
+     * Results:
+     *  @return pointer to numel() doubles, if tensor object supports it
+     **/
+    double *map_data();
+    const double *map_data() const;
+
+    /// Releases the mapping made by map_data(), a no-op for a CoreTensor
+    void unmap_data() const;
+
+    /**
+     * Returns a view of a sub-range of a CoreTensor, without copying.
+     *
+     * The view shares the storage of this tensor (and keeps it alive): it is
+     * a base pointer plus the strides of this tensor. Views can be used as
+     * any operand of a contraction, which then runs on them in place (a
+     * single GEMM when their strides allow it), can be copied or sliced to
+     * or from, and scaled or zeroed. Other operations, including data(),
+     * throw.
+     *
+     * E.g.:
+     *  C("ij") = A.view({{0, no}, {0, nv}})("ia") * B("aj");
+     *
+     * Parameters:
+     *  @param range the [begin, end) range of every index
+     *
+     * Results:
+     *  @return a Tensor of the dimensions of range looking into this one
+     **/
+    Tensor view(const IndexRange &range) const;
+
+    /**
+     * Returns a view of a CoreTensor with some indices fixed to one value,
+     * without copying. The view has the other indices, in order, and is used
+     * as those of view(). Slices of it are only taken to or from tensors of
+     * the rank of this one.
+     *
+     * E.g., the 2-index slab of a 3-index tensor at k = 4:
+     *  C("ij") = A.slab({2}, {4})("ia") * B("aj");
+     *
+     * Parameters:
+     *  @param axes the indices to fix
+     *  @param values the value of every one of axes
+     *
+     * Results:
+     *  @return a Tensor of rank rank() - axes.size() looking into this one
+     **/
+    Tensor slab(const std::vector<size_t> &axes,
+                const std::vector<size_t> &values) const;
+
+    /// Is this a view made by view() or slab()?
+    bool is_view() const;
+
     // => BLAS-Type Tensor Operations <= //
 
     /**
@@ -236,6 +470,13 @@ class Tensor
      */
     tuple<double, vector<size_t>> min() const;
 
+    /** Compute norm(0), norm(1), norm(2), max(), min() and the root mean
+     * square in a single pass over the data.
+     *
+     * @return the statistics of the elements
+     */
+    TensorStats stats() const;
+
     /**
      * Sets the data of the tensor to zeros
      *  C = 0.0
@@ -306,6 +547,36 @@ class Tensor
     void slice(const Tensor &A, const IndexRange &Cinds,
                const IndexRange &Ainds, double alpha = 1.0, double beta = 0.0);
 
+    /**
+     * Perform the slices:
+     *  C(Cinds[n]) = alpha * As[n](Ainds[n]) + beta * C(Cinds[n])
+     * as one batch, e.g. the shell quartets of an integral tensor. The
+     * Cinds must not overlap.
+     *
+     * When C is a DistributedTensor and the As are CoreTensor's, the whole
+     * batch is a single write, so it is one collective call on each process
+     * however many pieces that process holds; a process with nothing to
+     * contribute passes empty lists. Otherwise the pieces are sliced one
+     * after another.
+     **/
+    void scatter(const vector<Tensor> &As, const vector<IndexRange> &Cinds,
+                 const vector<IndexRange> &Ainds, double alpha = 1.0,
+                 double beta = 0.0);
+
+    /**
+     * Perform the slices:
+     *  Cs[n](Cinds[n]) = alpha * A(Ainds[n]) + beta * Cs[n](Cinds[n])
+     * as one batch, where A is the current tensor.
+     *
+     * When A is a DistributedTensor and the Cs are CoreTensor's, the whole
+     * batch is a single read, so each process fetches only the ranges it
+     * asks for, in one collective call. Otherwise the pieces are sliced one
+     * after another.
+     **/
+    void gather(const vector<Tensor> &Cs, const vector<IndexRange> &Cinds,
+                const vector<IndexRange> &Ainds, double alpha = 1.0,
+                double beta = 0.0) const;
+
     /**
      * Perform the permutation:
      *  C(Cinds) = alpha * A(Ainds) + beta * C(Cinds)
@@ -327,6 +598,23 @@ class Tensor
     void permute(const Tensor &A, const Indices &Cinds, const Indices &Ainds,
                  double alpha = 1.0, double beta = 0.0);
 
+    /**
+     * Perform the sum of permutations:
+     *  C(Cinds) = sum_n alphas[n] * As[n](Ainds[n]) + beta * C(Cinds)
+     *
+     * Note: Most users should instead use the operator overloading
+     * routines, e.g.,
+     *  C2("ij") = A2("ij") - A2("ji") + B2("ij");
+     *
+     * When C and all the As are CoreTensor's, C is traversed once: each
+     * tile of C accumulates every term in cache and is written back a
+     * single time, instead of once per term. Otherwise the terms are
+     * permuted one after another.
+     **/
+    void permute_sum(const vector<Tensor> &As, const Indices &Cinds,
+                     const vector<Indices> &Ainds, const vector<double> &alphas,
+                     double beta = 0.0);
+
     /**
      * Perform the contraction:
      *  C(Cinds) = alpha * A(Ainds) * B(Binds) + beta * C(Cinds)
@@ -357,6 +645,37 @@ class Tensor
                   std::shared_ptr<TensorImpl> &C2,
                   double alpha = 1.0, double beta = 0.0);
 
+    /**
+     * Perform the contraction followed by an epilogue:
+     *  C(Cinds) = f(alpha * A(Ainds) * B(Binds) + beta * C(Cinds))
+     *
+     * When all three are CoreTensor's, the GEMM runs in panels of rows of
+     * C that the epilogue finishes while they are in cache, so C is not
+     * read again. Otherwise the epilogue is a pass over C after the
+     * contraction.
+     **/
+    void contract(const Tensor &A, const Tensor &B, const Indices &Cinds,
+                  const Indices &Ainds, const Indices &Binds,
+                  const Epilogue &epilogue, double alpha = 1.0,
+                  double beta = 0.0);
+
+    /**
+     * Perform the independent contractions:
+     *  Cs[n](Cinds) = alpha * As[n](Ainds) * Bs[n](Binds) + beta * Cs[n](Cinds)
+     * as one batch, e.g. the many small block products of a BlockedTensor
+     * contraction. The Cs must be distinct tensors.
+     *
+     * When all the tensors are CoreTensor's, the products run concurrently
+     * and the layout of each shape is planned once, so products that need
+     * no permutation are bare GEMM calls. Otherwise they are contracted one
+     * after another.
+     **/
+    static void contract_batch(const vector<Tensor> &Cs,
+                               const vector<Tensor> &As,
+                               const vector<Tensor> &Bs, const Indices &Cinds,
+                               const Indices &Ainds, const Indices &Binds,
+                               double alpha = 1.0, double beta = 0.0);
+
     /**
      * Perform the GEMM call equivalent to:
      *  C_DGEMM(
@@ -432,6 +751,18 @@ class Tensor
      * @returns map of Tensor with the keys "eigenvalues" and "eigenvectors".
      */
     map<string, Tensor> syev(EigenvalueOrder order) const;
+
+    /**
+     * Computes only count eigenpairs of a square real symmetric matrix:
+     * the lowest ones for AscendingEigenvalue, the highest ones for
+     * DescendingEigenvalue. This is much cheaper than syev when count is
+     * small next to the dimension.
+     *
+     * @returns map of Tensor with the keys "eigenvalues" (count) and
+     * "eigenvectors" (count x n, one eigenvector per row, as for syev).
+     */
+    map<string, Tensor> syev(EigenvalueOrder order, size_t count) const;
+
     Tensor power(double power, double condition = 1.0E-12) const;
 
     /**
@@ -483,7 +814,22 @@ class Tensor
 
     // => Utility Operations <= //
 
-    static Tensor cat(const vector<Tensor>, int dim);
+    /**
+     * Concatenates tensors along index dim into a new tensor of the type of
+     * the first one. The tensors must have the same rank and the same
+     * dimensions but for dim. Each element of the result is written once.
+     *
+     * E.g., C = Tensor::cat({A, B}, 0) with A of dims {2, 5} and B of dims
+     * {3, 5} gives C of dims {5, 5}.
+     *
+     * Parameters:
+     *  @param tensors the tensors to concatenate, in order
+     *  @param dim the index along which they are concatenated
+     *
+     * Results:
+     *  @return the concatenated tensor
+     **/
+    static Tensor cat(const vector<Tensor> &tensors, int dim);
 
     // => Iterators <= //
 
@@ -491,12 +837,58 @@ class Tensor
     void citerate(const function<void(const vector<size_t> &, const double &)>
                       &func) const;
 
+    /**
+     * Like iterate, but func is called concurrently from the OpenMP threads
+     * of this process.
+     *
+     * For a distributed tensor each process visits the elements it owns,
+     * and only the elements that func changed are written back (no write
+     * at all when none changed on any process), so elementwise updates such
+     * as denominators keep their data on its owner.
+     **/
+    void parallel_iterate(
+        const function<void(const vector<size_t> &, double &)> &func);
+
+    /**
+     * Fast elementwise iterators for CoreTensor's.
+     *
+     * These take any callable (a lambda or functor is inlined rather than
+     * called through a std::function), visit elements in storage order, and
+     * advance the indices like an odometer instead of recomputing them from
+     * each element's address.
+     *
+     * for_each and cfor_each call func(indices, value) for every element, as
+     * iterate and citerate do.
+     *
+     * for_each_row and cfor_each_row call func(indices, row, n) once for every
+     * value of the leading indices, with row pointing to the n = dim(rank - 1)
+     * contiguous elements of the last index and indices holding the leading
+     * indices (the last index is 0). A rank-0 tensor is a single row of one.
+     *
+     * The parallel_ variants share the rows among OpenMP threads, and func is
+     * called concurrently from all of them. Without OpenMP they run serially.
+     *
+     * Example:
+     *  D.for_each_row([&](const vector<size_t> &ind, double *row, size_t n) {
+     *      for (size_t a = 0; a < n; ++a)
+     *          row[a] /= e[ind[0]] - e[a];
+     *  });
+     **/
+    template <typename Func> void for_each(Func func);
+    template <typename Func> void cfor_each(Func func) const;
+    template <typename Func> void for_each_row(Func func);
+    template <typename Func> void cfor_each_row(Func func) const;
+    template <typename Func> void parallel_for_each(Func func);
+    template <typename Func> void parallel_for_each_row(Func func);
+
   private:
   protected:
     shared_ptr<TensorImpl> tensor_;
 
     Tensor(shared_ptr<TensorImpl> tensor);
 
+    friend class BlockedTensor;
+
     static map<string, Tensor>
     map_to_tensor(const map<string, TensorImpl *> &x);
 
@@ -511,6 +903,12 @@ class Tensor
     SlicedTensor operator()(const IndexRange &range) const;
     SlicedTensor operator()() const;
 
+    /// Labels fixed at compile time, e.g. A(_i, _j); see
+    /// ambit/static_expression.h, which defines it
+    template <char... L>
+    static_expression::Labeled<L...>
+    operator()(static_expression::Label<L>... labels) const;
+
     // => Environment <= //
 
   private:
@@ -558,6 +956,10 @@ class LabeledTensor
     void operator+=(const LabeledTensorAddition &rhs);
     void operator-=(const LabeledTensorAddition &rhs);
 
+    void operator=(const LabeledTensorPermutation &rhs);
+    void operator+=(const LabeledTensorPermutation &rhs);
+    void operator-=(const LabeledTensorPermutation &rhs);
+
     void operator*=(double scale);
     void operator/=(double scale);
 
@@ -580,6 +982,11 @@ class LabeledTensor
 
   private:
     void set(const LabeledTensor &to);
+    /// T_ = sign * (sum of the terms) + beta * T_
+    void sum(const LabeledTensorAddition &rhs, double sign, double beta);
+    /// T_ = sign * (signed permutations of the term) + beta * T_
+    void permute_terms(const LabeledTensorPermutation &rhs, double sign,
+                       double beta);
 
     Tensor T_;
     Indices indices_;
@@ -641,8 +1048,25 @@ class LabeledTensorBatchedContraction
     Indices batched_indices_;
 };
 
+/**
+ * Evaluates contraction in batches over batched_indices (indices of the
+ * result), so that only the intermediates of one batch are alive at a time.
+ * The last batched index takes as many values per batch as fit in what the
+ * live tensors leave of settings::memory_limit.
+ *
+ * When every operand is a CoreTensor, the batches are contracted on all
+ * OpenMP threads at once. The batches of other operands are copied into
+ * memory, the next one being read while the current one is contracted.
+ *
+ * E.g.:
+ *  C("ijrs") = batched("r", A("abrs") * B("ijab"));
+ **/
 LabeledTensorBatchedContraction batched(const string &batched_indices, const LabeledTensorContraction &contraction);
 
+/// Same, with the batched index picked from the sizes of the intermediates
+/// (and no batching when they fit whole)
+LabeledTensorBatchedContraction batched(const LabeledTensorContraction &contraction);
+
 class LabeledTensorAddition
 {
   public:
@@ -696,6 +1120,70 @@ inline LabeledTensorAddition operator*(double factor,
     return ti2 * factor;
 }
 
+/**
+ * The antisymmetrizer over one or more groups of result indices: applied
+ * to a term, it sums every permutation of the indices of each group, with
+ * the sign of the permutation (no 1/n! normalization). Groups multiply,
+ * e.g. P("ij") * P("ab") gives the four terms of
+ *  X("ijab") - X("jiab") - X("ijba") + X("jiba")
+ **/
+class IndexPermutation
+{
+  public:
+    explicit IndexPermutation(const Indices &indices)
+        : groups_(1, indices)
+    {
+    }
+
+    const vector<Indices> &groups() const { return groups_; }
+
+    IndexPermutation operator*(const IndexPermutation &other) const;
+    LabeledTensorPermutation operator*(const LabeledTensor &rhs) const;
+    LabeledTensorPermutation
+    operator*(const LabeledTensorContraction &rhs) const;
+
+    /// The labels of each permutation applied to indices, with its sign
+    vector<pair<Indices, double>> apply(const Indices &indices) const;
+
+  private:
+    vector<Indices> groups_;
+};
+
+/**
+ * Builds the antisymmetrizer of the indices, used as, e.g.
+ *  R("ijab") += P("ij") * P("ab") * X("ijab");
+ *  R("ijab") += P("ij") * (A("ic") * B("cjab"));
+ *
+ * A product is contracted once into a temporary laid out like the result,
+ * and all the signed permutations are then added to the result in a single
+ * pass (see Tensor::permute_sum), without a copy per permutation.
+ **/
+IndexPermutation P(const string &indices);
+
+class LabeledTensorPermutation
+{
+  public:
+    LabeledTensorPermutation(const IndexPermutation &permutation,
+                             const LabeledTensorContraction &terms)
+        : permutation_(permutation), terms_(terms)
+    {
+    }
+
+    const IndexPermutation &permutation() const { return permutation_; }
+    /// The factors the permutations apply to; a single tensor or a product
+    const LabeledTensorContraction &terms() const { return terms_; }
+
+    LabeledTensorPermutation &operator*(const LabeledTensor &other)
+    {
+        terms_ *= other;
+        return *this;
+    }
+
+  private:
+    IndexPermutation permutation_;
+    LabeledTensorContraction terms_;
+};
+
 // Is responsible for expressions like D * (J - K) --> D*J - D*K
 class LabeledTensorDistribution
 {
@@ -730,6 +1218,11 @@ class SlicedTensor
     void operator+=(const SlicedTensor &rhs);
     void operator-=(const SlicedTensor &rhs);
 
+    /// Labels a view of the range (see Tensor::view), so that contractions
+    /// use it in place instead of a sliced copy, e.g. C("ij") = A(r)("ia") *
+    /// B("aj")
+    LabeledTensor operator()(const string &indices) const;
+
     // negation
     SlicedTensor operator-() const
     {
@@ -746,6 +1239,150 @@ inline SlicedTensor operator*(double factor, const SlicedTensor &ti)
 {
     return SlicedTensor(ti.T(), ti.range(), factor * ti.factor());
 };
+
+// => Elementwise Iterator Definitions <= //
+
+namespace elementwise
+{
+
+/// Calls func(indices, row, n) for rows [row_begin, row_end) of a tensor
+/// with dimensions dims stored at data
+template <typename Value, typename Func>
+void for_rows(const Dimension &dims, Value *data, size_t row_begin,
+              size_t row_end, Func &func)
+{
+    int rank = static_cast<int>(dims.size());
+    size_t n = (rank == 0 ? 1L : dims[rank - 1]);
+    vector<size_t> indices(rank, 0L);
+
+    // Only the first row is decoded, the rest follow by increments
+    size_t num = row_begin;
+    for (int k = rank - 2; k >= 0; --k)
+    {
+        indices[k] = num % dims[k];
+        num /= dims[k];
+    }
+    for (size_t row = row_begin; row < row_end; ++row)
+    {
+        func(indices, data + row * n, n);
+        for (int k = rank - 2; k >= 0; --k)
+        {
+            if (++indices[k] < dims[k])
+                break;
+            indices[k] = 0L;
+        }
+    }
+}
+
+/// Number of rows of the last index
+inline size_t row_count(const Dimension &dims)
+{
+    size_t nrow = (dims.empty() || dims.back() != 0L) ? 1L : 0L;
+    for (size_t k = 0; k + 1 < dims.size(); ++k)
+        nrow *= dims[k];
+    return nrow;
+}
+
+/// Runs for_rows over all rows, shared among OpenMP threads
+template <typename Value, typename Func>
+void parallel_for_rows(const Dimension &dims, Value *data, Func &func)
+{
+    size_t nrow = row_count(dims);
+#if defined(_OPENMP)
+#pragma omp parallel
+    {
+        size_t nthread = omp_get_num_threads();
+        size_t thread = omp_get_thread_num();
+        size_t row_begin = nrow * thread / nthread;
+        size_t row_end = nrow * (thread + 1) / nthread;
+        for_rows(dims, data, row_begin, row_end, func);
+    }
+#else
+    for_rows(dims, data, 0L, nrow, func);
+#endif
+}
+
+/// Turns an elementwise func(indices, value) into a row function
+template <typename Value, typename Func> class ElementRows
+{
+  public:
+    ElementRows(Func &func) : func_(func) {}
+
+    void operator()(vector<size_t> &indices, Value *row, size_t n)
+    {
+        if (indices.empty())
+        {
+            func_(indices, row[0]);
+            return;
+        }
+        size_t &last = indices.back();
+        for (size_t i = 0; i < n; ++i)
+        {
+            last = i;
+            func_(indices, row[i]);
+        }
+        last = 0L;
+    }
+
+  private:
+    Func &func_;
+};
+
+/// Passes the indices of a row on as const
+template <typename Value, typename Func> class ConstRows
+{
+  public:
+    ConstRows(Func &func) : func_(func) {}
+
+    void operator()(vector<size_t> &indices, Value *row, size_t n)
+    {
+        func_(indices, row, n);
+    }
+
+  private:
+    Func &func_;
+};
+}
+
+template <typename Func> void Tensor::for_each(Func func)
+{
+    elementwise::ElementRows<double, Func> rows(func);
+    elementwise::for_rows(dims(), data().data(), 0L, elementwise::row_count(dims()),
+                     rows);
+}
+
+template <typename Func> void Tensor::cfor_each(Func func) const
+{
+    elementwise::ElementRows<const double, Func> rows(func);
+    elementwise::for_rows(dims(), data().data(), 0L, elementwise::row_count(dims()),
+                     rows);
+}
+
+template <typename Func> void Tensor::for_each_row(Func func)
+{
+    elementwise::ConstRows<double, Func> rows(func);
+    elementwise::for_rows(dims(), data().data(), 0L, elementwise::row_count(dims()),
+                     rows);
+}
+
+template <typename Func> void Tensor::cfor_each_row(Func func) const
+{
+    elementwise::ConstRows<const double, Func> rows(func);
+    elementwise::for_rows(dims(), data().data(), 0L, elementwise::row_count(dims()),
+                     rows);
+}
+
+template <typename Func> void Tensor::parallel_for_each(Func func)
+{
+    elementwise::ElementRows<double, Func> rows(func);
+    elementwise::parallel_for_rows(dims(), data().data(), rows);
+}
+
+template <typename Func> void Tensor::parallel_for_each_row(Func func)
+{
+    elementwise::ConstRows<double, Func> rows(func);
+    elementwise::parallel_for_rows(dims(), data().data(), rows);
+}
 }
 
 #endif
@@ -0,0 +1,79 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#ifndef AMBIT_THREADS_H
+#define AMBIT_THREADS_H
+
+namespace ambit
+{
+
+/**
+ * The threads of ambit.
+ *
+ * ambit runs on the OpenMP thread team, which the runtime keeps alive
+ * between parallel regions. Where ambit runs independent tasks side by side
+ * (the block products of a BlockedTensor contraction, batched products,
+ * graph statements) it splits its threads between the tasks and the BLAS
+ * and OpenMP calls made within each task, rather than let every task start
+ * a full team of its own. With OMP_PROC_BIND set, the teams of the tasks are
+ * spread over the places (e.g. OMP_PLACES=sockets), so a task and its BLAS
+ * threads stay on one NUMA node.
+ **/
+namespace threads
+{
+
+/// @return The threads ambit may use from the calling thread: the OpenMP
+/// default, capped by settings::num_threads and by the Limit in scope
+int max_threads();
+
+/**
+ * Caps the threads of the ambit calls made by this thread while in scope,
+ * e.g. to leave cores to other work:
+ *  {
+ *      threads::Limit limit(4);
+ *      C["ij"] = A["ik"] * B["kj"];
+ *  }
+ **/
+class Limit
+{
+  public:
+    explicit Limit(int nthread);
+    ~Limit();
+
+    Limit(const Limit &) = delete;
+    Limit &operator=(const Limit &) = delete;
+
+  private:
+    int previous_;
+};
+}
+}
+
+#endif // AMBIT_THREADS_H
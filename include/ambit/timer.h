@@ -35,6 +35,7 @@
 #define AMBIT_TIMER_H
 
 #include "common_types.h"
+#include "settings.h"
 
 namespace ambit
 {
@@ -49,9 +50,94 @@ void finalize();
 
 void report();
 
+/// Writes the timer tree, with the counters and the per-thread times, as
+/// JSON to filename
+void report_json(const string &filename);
+
+/// Writes the calls recorded with settings::timer_trace in the Chrome trace
+/// event format (chrome://tracing, ui.perfetto.dev) to filename
+void write_trace(const string &filename);
+
+/**
+ * Timers may be pushed from any thread and from inside OpenMP regions. Each
+ * thread keeps its own timer tree, and report() merges the trees of the
+ * threads under the timer of the main thread they ran in, with the time of
+ * each thread and the load imbalance (longest over mean thread time).
+ */
+
+/// @return Do timer_push and timer_pop record anything right now?
+inline bool enabled() { return settings::timers; }
+
 void timer_push(const string &name);
+/// Same as timer_push(string), but the child timer is found by the address
+/// of name first, so string literals skip the lookup by contents
+void timer_push(const char *name);
 void timer_pop();
+
+/// Charges floating point operations to the current timer
+void add_flops(double flops);
+/// Charges bytes read and written to the current timer
+void add_bytes(double bytes);
+/// Charges bytes allocated to the current timer
+void add_allocated(double bytes);
+
+/// @return Can the hardware counters (settings::timer_counters) be read on
+/// the calling thread?
+bool counters_available();
 }
 }
 
+// => Probes <= //
+
+/**
+ * Instrumentation of the library's hot paths.
+ *
+ * AMBIT_TIMER_PUSH(label) evaluates label (e.g. a string assembled from
+ * tensor names and indices) only when the timers are enabled, so a disabled
+ * probe costs a single test of settings::timers. The counter probes
+ * (AMBIT_TIMER_FLOPS, AMBIT_TIMER_BYTES, AMBIT_TIMER_ALLOCATED) charge the
+ * current timer in the same way; report() turns them into GFLOP/s and GB/s
+ * over the time of each timer and its children. Building with
+ * AMBIT_DISABLE_TIMERS defined (the ENABLE_TIMERS=OFF CMake option) removes
+ * the probes altogether.
+ */
+#if defined(AMBIT_DISABLE_TIMERS)
+#define AMBIT_TIMER_PUSH(label) ((void)0)
+#define AMBIT_TIMER_POP() ((void)0)
+#define AMBIT_TIMER_FLOPS(flops) ((void)0)
+#define AMBIT_TIMER_BYTES(bytes) ((void)0)
+#define AMBIT_TIMER_ALLOCATED(bytes) ((void)0)
+#else
+#define AMBIT_TIMER_PUSH(label)                                                \
+    do                                                                         \
+    {                                                                          \
+        if (ambit::timer::enabled())                                           \
+            ambit::timer::timer_push(label);                                   \
+    } while (0)
+#define AMBIT_TIMER_POP()                                                      \
+    do                                                                         \
+    {                                                                          \
+        if (ambit::timer::enabled())                                           \
+            ambit::timer::timer_pop();                                         \
+    } while (0)
+#define AMBIT_TIMER_FLOPS(flops)                                               \
+    do                                                                         \
+    {                                                                          \
+        if (ambit::timer::enabled())                                           \
+            ambit::timer::add_flops(flops);                                    \
+    } while (0)
+#define AMBIT_TIMER_BYTES(bytes)                                               \
+    do                                                                         \
+    {                                                                          \
+        if (ambit::timer::enabled())                                           \
+            ambit::timer::add_bytes(bytes);                                    \
+    } while (0)
+#define AMBIT_TIMER_ALLOCATED(bytes)                                           \
+    do                                                                         \
+    {                                                                          \
+        if (ambit::timer::enabled())                                           \
+            ambit::timer::add_allocated(bytes);                                \
+    } while (0)
+#endif
+
 #endif // AMBIT_TIMER_H
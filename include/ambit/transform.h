@@ -0,0 +1,91 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#ifndef AMBIT_TRANSFORM_H
+#define AMBIT_TRANSFORM_H
+
+#include <functional>
+
+#include <ambit/blocked_tensor.h>
+
+namespace ambit
+{
+
+/**
+ * Fills slab, of dimensions {last - first, n, n, n}, with the AO integrals
+ * (mu nu|lambda sigma) for mu in [first, last). Used to transform integrals
+ * that are computed on the fly rather than stored.
+ **/
+using AOSlabFunction =
+    std::function<void(size_t first, size_t last, Tensor &slab)>;
+
+/**
+ * Transforms four-index AO integrals to the requested MO blocks.
+ *
+ * The integrals are taken in slabs of their first AO index. Each slab is
+ * transformed in its last, third and second index to the MO spaces of the
+ * blocks (sharing the quarter transformations between blocks that end in
+ * the same spaces) and its first-index transformation is accumulated into
+ * the blocks, so only the slabs and their partial transforms are held at
+ * once. The slab size is chosen so that these fit in memory bytes, which
+ * for blocks much smaller than the AO basis is about two slabs of
+ * n^4 / k elements for k slabs.
+ *
+ * The columns of the coefficients C (AO x MO) used for an MO space are the
+ * MOs of the space (MOSpace::mos); spins are ignored, so alpha and beta
+ * blocks receive the same spatial transformation.
+ *
+ * Sample usage:
+ *  BlockedTensor V = transform_ao_to_mo(ao, C, CoreTensor, "V",
+ *                                       {"oovv", "ovov"});
+ *
+ * @param ao     the AO integrals (CoreTensor or DiskTensor, n x n x n x n)
+ * @param C      the MO coefficients (n x number of MOs)
+ * @param type   the tensor type of the blocks
+ * @param name   the name of the result
+ * @param blocks the blocks to compute (as for BlockedTensor::build)
+ * @param memory the bytes available to the slabs, by default what is left
+ *               of settings::memory_limit once the blocks are built
+ * @return the BlockedTensor holding the MO integrals
+ **/
+BlockedTensor transform_ao_to_mo(const Tensor &ao, const Tensor &C,
+                                 TensorType type, const std::string &name,
+                                 const std::vector<std::string> &blocks,
+                                 size_t memory = 0);
+
+/// Transforms the AO integrals that ao computes slab by slab, for nbf basis
+/// functions (see above)
+BlockedTensor transform_ao_to_mo(const AOSlabFunction &ao, size_t nbf,
+                                 const Tensor &C, TensorType type,
+                                 const std::string &name,
+                                 const std::vector<std::string> &blocks,
+                                 size_t memory = 0);
+}
+
+#endif
@@ -27,27 +27,194 @@
  * @END LICENSE
  */
 
+#include <cctype>
 #include <cmath>
 #include <cstring>
+#include <exception>
 #include <stdexcept>
 #include <string>
 #include <algorithm>
 #include <numeric>
+#include <mutex>
 #include <set>
 #include <ambit/blocked_tensor.h>
+#include <ambit/graph.h>
+#include <ambit/memory.h>
+#include <ambit/settings.h>
+#include <ambit/timer.h>
+#include <tensor/contraction_path.h>
+#include <tensor/core/scratch.h>
+#include <tensor/globals.h>
 #include <tensor/indices.h>
+#include <tensor/threads.h>
 
 namespace ambit
 {
 
-// Static members of BlockedTensor
-std::vector<MOSpace> BlockedTensor::mo_spaces_;
-std::map<std::string, size_t> BlockedTensor::name_to_mo_space_;
-std::map<std::string, std::vector<size_t>>
-    BlockedTensor::composite_name_to_mo_spaces_;
-std::map<std::string, std::vector<size_t>> BlockedTensor::index_to_mo_spaces_;
+namespace
+{
+
+// => Label Resolution Cache <= //
+
+// Labels such as "ijab" are resolved to block keys once per distinct label
+// list; repeated evaluations of an expression then skip the string handling.
+// The block keys are cached in the MO space context that resolved them and
+// are emptied whenever its MO spaces change.
+std::mutex label_cache_mutex;
+std::map<std::string, Indices> split_cache;
+
+void clear_label_caches()
+{
+    std::lock_guard<std::mutex> lock(label_cache_mutex);
+    split_cache.clear();
+    BlockedTensor::context()->block_keys.clear();
+}
+
+/// indices::split, memoized
+Indices split_labels(const std::string &indices)
+{
+    std::lock_guard<std::mutex> lock(label_cache_mutex);
+    auto it = split_cache.find(indices);
+    if (it == split_cache.end())
+        it = split_cache.insert(std::make_pair(indices, indices::split(indices)))
+                 .first;
+    return it->second;
+}
+
+/// Positions of labels in the unique indices of an expression, so block keys
+/// of each term are gathered by integer position rather than by label
+std::vector<size_t> label_positions(const Indices &labels,
+                                    const std::map<std::string, size_t> &index_map)
+{
+    std::vector<size_t> positions;
+    for (const std::string &label : labels)
+        positions.push_back(index_map.at(label));
+    return positions;
+}
+
+std::vector<size_t> gather_key(const std::vector<size_t> &uik,
+                               const std::vector<size_t> &positions)
+{
+    std::vector<size_t> key(positions.size());
+    for (size_t n = 0; n < positions.size(); ++n)
+        key[n] = uik[positions[n]];
+    return key;
+}
+
+// => Deferred Statements <= //
+
+typedef std::pair<LabeledBlockedTensor, LabeledBlockedTensorAddition>
+    DistributiveTerms;
+typedef std::pair<LabeledBlockedTensorProduct, Indices> BatchedTerms;
+
+/// Appends the blocks of the blocked tensors of a right-hand side to reads
+/// Combines the partial results of all processes: their maximum if max,
+/// else their sum
+double reduce_over_processes(double value, bool max)
+{
+#if defined(HAVE_MPI)
+    double total = 0.0;
+    MPI_Allreduce(&value, &total, 1, MPI_DOUBLE, max ? MPI_MAX : MPI_SUM,
+                  globals::communicator);
+    return total;
+#else
+    (void)max;
+    return value;
+#endif
+}
+
+/// Is this block of a distributed tensor stored by another process?
+bool is_remote(const BlockedTensor &bt, const std::vector<size_t> &key)
+{
+    int owner = bt.block_owner(key);
+    return owner >= 0 && owner != settings::rank;
+}
+
+/// Is any of the tensors of a product block distributed?
+bool any_distributed(const LabeledBlockedTensor &lhs,
+                     const LabeledBlockedTensorProduct &rhs)
+{
+    bool distributed = lhs.BT().block_distributed();
+    for (size_t n = 0; n < rhs.size(); ++n)
+        distributed = distributed || rhs[n].BT().block_distributed();
+    return distributed;
+}
+
+void append_blocks(const LabeledBlockedTensor &rhs, std::vector<Tensor> &reads)
+{
+    BlockedTensor BT = rhs.BT();
+    for (const auto &block : BT.blocks())
+        reads.push_back(block.second);
+}
+void append_blocks(const LabeledBlockedTensorProduct &rhs,
+                   std::vector<Tensor> &reads)
+{
+    for (size_t n = 0; n < rhs.size(); ++n)
+        append_blocks(rhs[n], reads);
+}
+void append_blocks(const LabeledBlockedTensorAddition &rhs,
+                   std::vector<Tensor> &reads)
+{
+    for (const LabeledBlockedTensor &term : rhs)
+        append_blocks(term, reads);
+}
+void append_blocks(const DistributiveTerms &rhs, std::vector<Tensor> &reads)
+{
+    append_blocks(rhs.first, reads);
+    append_blocks(rhs.second, reads);
+}
+void append_blocks(const BatchedTerms &rhs, std::vector<Tensor> &reads)
+{
+    append_blocks(rhs.first, reads);
+}
+void append_blocks(double, std::vector<Tensor> &) {}
+
+/**
+ * Records lhs op rhs as a single statement of the Graph recording on this
+ * thread, if any, reading the blocks of every operand and writing the
+ * blocks of lhs. Returns false if nothing is recording.
+ */
+template <typename Rhs, typename Op>
+bool defer(const LabeledBlockedTensor &lhs, Op op, const Rhs &rhs)
+{
+    Graph *graph = Graph::recording();
+    if (graph == nullptr)
+        return false;
+    LabeledBlockedTensor target(lhs);
+    std::vector<Tensor> writes;
+    append_blocks(target, writes);
+    std::vector<Tensor> reads(writes);
+    append_blocks(rhs, reads);
+    graph->record(writes, reads, [=]() mutable { op(target, rhs); });
+    return true;
+}
+
+} // anonymous namespace
+
+namespace
+{
+
+/// The MO spaces of the threads that did not set a context of their own
+const std::shared_ptr<MOSpaceContext> default_context =
+    std::make_shared<MOSpaceContext>();
+
+/// The context set on this thread, if any
+thread_local std::shared_ptr<MOSpaceContext> thread_context;
+
+} // anonymous namespace
 
-bool BlockedTensor::expert_mode_ = false;
+const std::shared_ptr<MOSpaceContext> &BlockedTensor::context()
+{
+    return thread_context ? thread_context : default_context;
+}
+
+std::shared_ptr<MOSpaceContext>
+BlockedTensor::set_context(const std::shared_ptr<MOSpaceContext> &context)
+{
+    std::shared_ptr<MOSpaceContext> previous = thread_context;
+    thread_context = context;
+    return previous;
+}
 
 MOSpace::MOSpace(const std::string &name, const std::string &mo_indices,
                  std::vector<size_t> mos, SpinType spin)
@@ -83,6 +250,8 @@ void BlockedTensor::add_mo_space(const std::string &name,
                                  const std::string &mo_indices,
                                  std::vector<size_t> mos, SpinType spin)
 {
+    clear_label_caches();
+
     if (name.size() == 0)
     {
         throw std::runtime_error("Empty name given to orbital space.");
@@ -92,30 +261,30 @@ void BlockedTensor::add_mo_space(const std::string &name,
         throw std::runtime_error(
             "No MO indices were specified for the MO space \"" + name + "\"");
     }
-    if (name_to_mo_space_.count(name) != 0)
+    if (context()->name_to_mo_space.count(name) != 0)
     {
         throw std::runtime_error("The MO space \"" + name +
                                  "\" is already defined.");
     }
 
-    size_t mo_space_idx = mo_spaces_.size();
+    size_t mo_space_idx = context()->mo_spaces.size();
 
     MOSpace ms(name, mo_indices, mos, spin);
     // Add the MOSpace object
-    mo_spaces_.push_back(ms);
+    context()->mo_spaces.push_back(ms);
 
     // Link the name to the mo_space_ vector
-    name_to_mo_space_[name] = mo_space_idx;
+    context()->name_to_mo_space[name] = mo_space_idx;
 
     // Link the composite name to the mo_space_ vector
-    composite_name_to_mo_spaces_[name] = {mo_space_idx};
+    context()->composite_name_to_mo_spaces[name] = {mo_space_idx};
 
     // Link the indices to the mo_space_
     for (const std::string &mo_index : indices::split(mo_indices))
     {
-        if (index_to_mo_spaces_.count(mo_index) == 0)
+        if (context()->index_to_mo_spaces.count(mo_index) == 0)
         {
-            index_to_mo_spaces_[mo_index] = {mo_space_idx};
+            context()->index_to_mo_spaces[mo_index] = {mo_space_idx};
         }
         else
         {
@@ -129,6 +298,8 @@ void BlockedTensor::add_mo_space(
     const std::string &name, const std::string &mo_indices,
     std::vector<std::pair<size_t, SpinType>> mo_spin)
 {
+    clear_label_caches();
+
     if (name.size() == 0)
     {
         throw std::runtime_error("Empty name given to orbital space.");
@@ -138,30 +309,30 @@ void BlockedTensor::add_mo_space(
         throw std::runtime_error(
             "No MO indices were specified for the MO space \"" + name + "\"");
     }
-    if (name_to_mo_space_.count(name) != 0)
+    if (context()->name_to_mo_space.count(name) != 0)
     {
         throw std::runtime_error("The MO space \"" + name +
                                  "\" is already defined.");
     }
 
-    size_t mo_space_idx = mo_spaces_.size();
+    size_t mo_space_idx = context()->mo_spaces.size();
 
     MOSpace ms(name, mo_indices, mo_spin);
     // Add the MOSpace object
-    mo_spaces_.push_back(ms);
+    context()->mo_spaces.push_back(ms);
 
     // Link the name to the mo_space_ vector
-    name_to_mo_space_[name] = mo_space_idx;
+    context()->name_to_mo_space[name] = mo_space_idx;
 
     // Link the composite name to the mo_space_ vector
-    composite_name_to_mo_spaces_[name] = {mo_space_idx};
+    context()->composite_name_to_mo_spaces[name] = {mo_space_idx};
 
     // Link the indices to the mo_space_
     for (const std::string &mo_index : indices::split(mo_indices))
     {
-        if (index_to_mo_spaces_.count(mo_index) == 0)
+        if (context()->index_to_mo_spaces.count(mo_index) == 0)
         {
-            index_to_mo_spaces_[mo_index] = {mo_space_idx};
+            context()->index_to_mo_spaces[mo_index] = {mo_space_idx};
         }
         else
         {
@@ -175,6 +346,8 @@ void BlockedTensor::add_composite_mo_space(
     const std::string &name, const std::string &mo_indices,
     const std::vector<std::string> &subspaces)
 {
+    clear_label_caches();
+
     if (name.size() == 0)
     {
         throw std::runtime_error(
@@ -186,7 +359,7 @@ void BlockedTensor::add_composite_mo_space(
             "No MO indices were specified for the composite MO space \"" +
             name + "\"");
     }
-    if (name_to_mo_space_.count(name) != 0)
+    if (context()->name_to_mo_space.count(name) != 0)
     {
         throw std::runtime_error("The MO space \"" + name +
                                  "\" is already defined.");
@@ -196,24 +369,24 @@ void BlockedTensor::add_composite_mo_space(
     for (std::string subspace : subspaces)
     {
         // Is this simple MO space in our list of spaces?
-        if (name_to_mo_space_.count(subspace) == 0)
+        if (context()->name_to_mo_space.count(subspace) == 0)
         {
             throw std::runtime_error("The simple MO space \"" + subspace +
                                      "\" is not defined.");
         }
         else
         {
-            simple_spaces.push_back(name_to_mo_space_[subspace]);
+            simple_spaces.push_back(context()->name_to_mo_space[subspace]);
         }
     }
-    composite_name_to_mo_spaces_[name] = simple_spaces;
+    context()->composite_name_to_mo_spaces[name] = simple_spaces;
 
     // Link the indices to the mo_space_
     for (const std::string &mo_index : indices::split(mo_indices))
     {
-        if (index_to_mo_spaces_.count(mo_index) == 0)
+        if (context()->index_to_mo_spaces.count(mo_index) == 0)
         {
-            index_to_mo_spaces_[mo_index] = simple_spaces;
+            context()->index_to_mo_spaces[mo_index] = simple_spaces;
         }
         else
         {
@@ -226,18 +399,41 @@ void BlockedTensor::add_composite_mo_space(
 void BlockedTensor::print_mo_spaces()
 {
     printf("\n  List of Molecular Orbital Spaces:");
-    for (size_t ms = 0; ms < mo_spaces_.size(); ++ms)
+    for (size_t ms = 0; ms < context()->mo_spaces.size(); ++ms)
     {
-        mo_spaces_[ms].print();
+        context()->mo_spaces[ms].print();
+    }
+}
+
+Epilogue BlockedTensor::denominator(const std::string &block,
+                                    const std::vector<double> &epsilon,
+                                    const std::vector<double> &signs,
+                                    double shift)
+{
+    std::vector<std::vector<double>> energies;
+    for (size_t space : indices_to_key(block))
+    {
+        std::vector<double> energy;
+        for (size_t mo : context()->mo_spaces[space].mos())
+        {
+            if (mo >= epsilon.size())
+                throw std::runtime_error(
+                    "BlockedTensor::denominator: no energy for MO " +
+                    std::to_string(mo) + " of block " + block);
+            energy.push_back(epsilon[mo]);
+        }
+        energies.push_back(energy);
     }
+    return Epilogue::denominator(energies, signs, shift);
 }
 
 void BlockedTensor::reset_mo_spaces()
 {
-    mo_spaces_.clear();
-    name_to_mo_space_.clear();
-    composite_name_to_mo_spaces_.clear();
-    index_to_mo_spaces_.clear();
+    clear_label_caches();
+    context()->mo_spaces.clear();
+    context()->name_to_mo_space.clear();
+    context()->composite_name_to_mo_spaces.clear();
+    context()->index_to_mo_spaces.clear();
 }
 
 BlockedTensor::BlockedTensor() : rank_(0) {}
@@ -250,7 +446,7 @@ std::vector<std::string> BlockedTensor::block_labels() const {
         std::string block_label;
         for (size_t ms : this_block_tensor.first)
         {
-            block_label += mo_spaces_[ms].name();
+            block_label += context()->mo_spaces[ms].name();
         }
         labels.push_back(block_label);
     }
@@ -259,6 +455,59 @@ std::vector<std::string> BlockedTensor::block_labels() const {
 
 BlockedTensor BlockedTensor::build(TensorType type, const std::string &name,
                                    const std::vector<std::string> &blocks)
+{
+    return build_blocks(type, name, blocks, false);
+}
+
+BlockedTensor
+BlockedTensor::build_distributed(const std::string &name,
+                                 const std::vector<std::string> &blocks)
+{
+    return build_blocks(CoreTensor, name, blocks, false, true);
+}
+
+BlockedTensor
+BlockedTensor::build_distributed(TensorType type, const std::string &name,
+                                 const std::vector<std::string> &blocks)
+{
+    if (type != CoreTensor && type != DiskTensor)
+        throw std::runtime_error(
+            "BlockedTensor::build_distributed: the blocks of a "
+            "block-distributed tensor must be CoreTensor's or DiskTensor's.");
+    return build_blocks(type, name, blocks, false, true);
+}
+
+std::vector<int> BlockedTensor::balance_blocks(const std::vector<double> &costs,
+                                               int nprocess)
+{
+    std::vector<size_t> order(costs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return costs[a] > costs[b]; });
+
+    std::vector<int> placement(costs.size(), 0);
+    std::vector<double> load(std::max(nprocess, 1), 0.0);
+    for (size_t n : order)
+    {
+        int process = static_cast<int>(
+            std::min_element(load.begin(), load.end()) - load.begin());
+        placement[n] = process;
+        load[process] += costs[n];
+    }
+    return placement;
+}
+
+BlockedTensor
+BlockedTensor::build_intermediate(const std::string &name,
+                                  const std::vector<std::string> &blocks)
+{
+    return build_blocks(CoreTensor, name, blocks, true);
+}
+
+BlockedTensor BlockedTensor::build_blocks(TensorType type,
+                                          const std::string &name,
+                                          const std::vector<std::string> &blocks,
+                                          bool intermediate, bool distributed)
 {
     BlockedTensor newObject;
 
@@ -287,9 +536,9 @@ BlockedTensor BlockedTensor::build(TensorType type, const std::string &name,
         {
             std::vector<std::vector<size_t>> partial_blocks;
             // How does this MO space name map to the MOSpace objects contained
-            // in mo_spaces_? (e.g. "G" -> {0,1})
+            // in context()->mo_spaces? (e.g. "G" -> {0,1})
             for (size_t mo_space_idx :
-                 composite_name_to_mo_spaces_[mo_space_name])
+                 context()->composite_name_to_mo_spaces[mo_space_name])
             {
                 // Special case
                 if (final_blocks.size() == 0)
@@ -314,24 +563,82 @@ BlockedTensor BlockedTensor::build(TensorType type, const std::string &name,
             tensor_blocks.push_back(block);
     }
 
+    // In restricted-spin mode a block whose spin-flipped partner is also
+    // requested and comes first (its first spin index is alpha) aliases it
+    std::set<std::vector<size_t>> requested(tensor_blocks.begin(),
+                                            tensor_blocks.end());
+    std::vector<std::vector<size_t>> aliases;
+
+    // A distributed tensor only creates the blocks this process owns
+    if (distributed)
+    {
+        std::vector<double> costs;
+        for (const std::vector<size_t> &this_block : requested)
+        {
+            double cost = 1.0;
+            for (size_t ms : this_block)
+                cost *= static_cast<double>(context()->mo_spaces[ms].dim());
+            costs.push_back(cost);
+        }
+        std::vector<int> placement = balance_blocks(costs, settings::nprocess);
+        size_t n = 0;
+        for (const std::vector<size_t> &this_block : requested)
+            newObject.owners_[this_block] = placement[n++];
+    }
+
     // Create the blocks
     for (std::vector<size_t> &this_block : tensor_blocks)
     {
+        if (context()->restricted_spin)
+        {
+            std::vector<size_t> flipped = spin_flipped_key(this_block);
+            if (flipped != this_block && requested.count(flipped) != 0)
+            {
+                auto first = std::find_if(
+                    this_block.begin(), this_block.end(), [](size_t ms) {
+                        return context()->mo_spaces[ms].spin()[0] != NoSpin;
+                    });
+                if (context()->mo_spaces[*first].spin()[0] == BetaSpin)
+                {
+                    aliases.push_back(this_block);
+                    continue;
+                }
+            }
+        }
+
         // Grab the dims
         std::vector<size_t> dims;
         for (size_t ms : this_block)
         {
-            size_t dim = mo_spaces_[ms].dim();
+            size_t dim = context()->mo_spaces[ms].dim();
             dims.push_back(dim);
         }
         // Grab the orbital spaces names
         std::string block_label;
         for (size_t ms : this_block)
         {
-            block_label += mo_spaces_[ms].name();
+            block_label += context()->mo_spaces[ms].name();
+        }
+        if (intermediate)
+        {
+            // Recycle the storage of an idle intermediate of the same size
+            // instead of allocating (and page-faulting) a fresh block
+            Tensor block(
+                scratch::build(name + "[" + block_label + "]", dims));
+            block.zero();
+            newObject.blocks_[this_block] = block;
+        }
+        else if (distributed)
+        {
+            if (newObject.owners_[this_block] == settings::rank)
+                newObject.blocks_[this_block] = Tensor::build(
+                    type, name + "[" + block_label + "]", dims);
+        }
+        else
+        {
+            newObject.blocks_[this_block] =
+                Tensor::build(type, name + "[" + block_label + "]", dims);
         }
-        newObject.blocks_[this_block] =
-            Tensor::build(type, name + "[" + block_label + "]", dims);
 
         // Set or check the rank
         if (newObject.rank_ > 0)
@@ -348,6 +655,15 @@ BlockedTensor BlockedTensor::build(TensorType type, const std::string &name,
             newObject.rank_ = this_block.size();
         }
     }
+    for (const std::vector<size_t> &alias : aliases)
+    {
+        std::vector<size_t> canonical = spin_flipped_key(alias);
+        if (distributed)
+            newObject.owners_[alias] = newObject.owners_[canonical];
+        if (newObject.blocks_.count(canonical) != 0)
+            newObject.blocks_[alias] = newObject.blocks_[canonical];
+        newObject.aliases_.insert(alias);
+    }
 
     //    newObject.print(stdout);
     return newObject;
@@ -366,9 +682,9 @@ std::vector<size_t> BlockedTensor::indices_to_key(const std::string &indices)
     std::vector<size_t> key;
     for (const std::string &index : indices::split(indices))
     {
-        if (name_to_mo_space_.count(index) != 0)
+        if (context()->name_to_mo_space.count(index) != 0)
         {
-            key.push_back(name_to_mo_space_[index]);
+            key.push_back(context()->name_to_mo_space[index]);
         }
         else
         {
@@ -403,7 +719,7 @@ std::vector<std::string> BlockedTensor::indices_to_block_labels(
     } else {
         size_t max_path = 1;
         for (const std::string &index : indices) {
-            max_path *= BlockedTensor::index_to_mo_spaces_[index].size();
+            max_path *= BlockedTensor::context()->index_to_mo_spaces[index].size();
         }
         std::set<std::vector<size_t>> block_set;
         for (const std::vector<size_t> &uik : unique_indices_keys)
@@ -467,7 +783,119 @@ bool BlockedTensor::is_block(const std::string &indices) const
 
 bool BlockedTensor::is_block(const std::vector<size_t> &key) const
 {
-    return (blocks_.count(key) != 0);
+    return (blocks_.count(key) != 0) || (owners_.count(key) != 0);
+}
+
+int BlockedTensor::block_owner(const std::vector<size_t> &key) const
+{
+    auto it = owners_.find(key);
+    return it == owners_.end() ? -1 : it->second;
+}
+
+std::map<std::vector<size_t>, Tensor> BlockedTensor::exchange_blocks(
+    const std::vector<std::pair<int, std::vector<size_t>>> &needs) const
+{
+    std::map<std::vector<size_t>, Tensor> received;
+#if defined(HAVE_MPI)
+    if (owners_.empty())
+        return received;
+
+    // Every process walks the same ordered moves, so the messages between
+    // two processes are matched in order
+    std::set<std::pair<int, std::vector<size_t>>> moves;
+    for (const std::pair<int, std::vector<size_t>> &need : needs)
+        if (owners_.at(need.second) != need.first)
+            moves.insert(need);
+
+    std::vector<MPI_Request> requests;
+    // Blocks on disk are read into core once by their owners and sent from
+    // there
+    std::map<std::vector<size_t>, Tensor> outgoing;
+    for (const std::pair<int, std::vector<size_t>> &move : moves)
+    {
+        const std::vector<size_t> &key = move.second;
+        int owner = owners_.at(key);
+        if (move.first == settings::rank)
+        {
+            Dimension dims;
+            std::string block_label;
+            for (size_t ms : key)
+            {
+                dims.push_back(context()->mo_spaces[ms].dim());
+                block_label += context()->mo_spaces[ms].name();
+            }
+            Tensor block = Tensor::build(
+                CoreTensor, name_ + "[" + block_label + "]", dims);
+            requests.push_back(MPI_REQUEST_NULL);
+            MPI_Irecv(block.data().data(), static_cast<int>(block.numel()),
+                      MPI_DOUBLE, owner, 0, globals::communicator,
+                      &requests.back());
+            received[key] = block;
+        }
+        else if (owner == settings::rank)
+        {
+            Tensor block = blocks_.at(key);
+            if (block.type() != CoreTensor)
+            {
+                if (outgoing.count(key) == 0)
+                {
+                    outgoing[key] = Tensor::build(CoreTensor, block.name(),
+                                                  block.dims());
+                    outgoing[key].copy(block);
+                }
+                block = outgoing[key];
+            }
+            requests.push_back(MPI_REQUEST_NULL);
+            MPI_Isend(const_cast<double *>(block.data().data()),
+                      static_cast<int>(block.numel()), MPI_DOUBLE, move.first,
+                      0, globals::communicator, &requests.back());
+        }
+    }
+    MPI_Waitall(static_cast<int>(requests.size()), requests.data(),
+                MPI_STATUSES_IGNORE);
+#else
+    (void)needs;
+#endif
+    return received;
+}
+
+bool BlockedTensor::is_alias(const std::vector<size_t> &key) const
+{
+    return (aliases_.count(key) != 0);
+}
+
+std::vector<size_t>
+BlockedTensor::spin_flipped_key(const std::vector<size_t> &key)
+{
+    std::vector<size_t> flipped;
+    for (size_t ms : key)
+    {
+        const MOSpace &space = context()->mo_spaces[ms];
+        const std::vector<SpinType> &spin = space.spin();
+        if (std::find(spin.begin(), spin.end(), NoSpin) != spin.end())
+        {
+            flipped.push_back(ms);
+            continue;
+        }
+        // The partner has the opposite spin and the name in the other case
+        SpinType partner_spin = spin[0] == AlphaSpin ? BetaSpin : AlphaSpin;
+        std::string partner_name = space.name();
+        for (char &c : partner_name)
+            c = std::islower(c) ? std::toupper(c) : std::tolower(c);
+        auto it = context()->name_to_mo_space.find(partner_name);
+        if (std::count(spin.begin(), spin.end(), spin[0]) !=
+                static_cast<std::ptrdiff_t>(spin.size()) ||
+            it == context()->name_to_mo_space.end() || it->second == ms)
+            return key;
+        const MOSpace &partner = context()->mo_spaces[it->second];
+        const std::vector<SpinType> &pspin = partner.spin();
+        if (partner.dim() != space.dim() ||
+            std::count(pspin.begin(), pspin.end(), partner_spin) !=
+                static_cast<std::ptrdiff_t>(pspin.size()))
+            return key;
+        flipped.push_back(it->second);
+    }
+    return flipped;
 }
 
 Tensor BlockedTensor::block(const std::string &indices)
@@ -475,9 +903,9 @@ Tensor BlockedTensor::block(const std::string &indices)
     std::vector<size_t> key;
     for (const std::string &index : indices::split(indices))
     {
-        if (name_to_mo_space_.count(index) != 0)
+        if (context()->name_to_mo_space.count(index) != 0)
         {
-            key.push_back(name_to_mo_space_[index]);
+            key.push_back(context()->name_to_mo_space[index]);
         }
         else
         {
@@ -501,6 +929,17 @@ Tensor BlockedTensor::block(const std::vector<size_t> &key)
         throw std::runtime_error("Tensor " + name() +
                                  " does not contain block \"" + labels + "\"");
     }
+    if (blocks_.count(key) == 0)
+    {
+        std::string labels;
+        for (size_t k : key)
+        {
+            labels += mo_space(k).name();
+        }
+        throw std::runtime_error("Block \"" + labels + "\" of tensor " +
+                                 name() + " is stored by process " +
+                                 std::to_string(block_owner(key)));
+    }
     return blocks_.at(key);
 }
 
@@ -516,6 +955,17 @@ const Tensor BlockedTensor::block(const std::vector<size_t> &key) const
         throw std::runtime_error("Tensor " + name() +
                                  " does not contain block \"" + labels + "\"");
     }
+    if (blocks_.count(key) == 0)
+    {
+        std::string labels;
+        for (size_t k : key)
+        {
+            labels += mo_space(k).name();
+        }
+        throw std::runtime_error("Block \"" + labels + "\" of tensor " +
+                                 name() + " is stored by process " +
+                                 std::to_string(block_owner(key)));
+    }
     return blocks_.at(key);
 }
 
@@ -528,7 +978,7 @@ double BlockedTensor::norm(int type) const
         {
             val = std::max(val, std::fabs(block_tensor.second.norm(type)));
         }
-        return val;
+        return block_distributed() ? reduce_over_processes(val, true) : val;
     }
     else if (type == 1)
     {
@@ -537,7 +987,7 @@ double BlockedTensor::norm(int type) const
         {
             val += std::fabs(block_tensor.second.norm(type));
         }
-        return val;
+        return block_distributed() ? reduce_over_processes(val, false) : val;
     }
     else if (type == 2)
     {
@@ -546,6 +996,8 @@ double BlockedTensor::norm(int type) const
         {
             val += std::pow(block_tensor.second.norm(type), 2.0);
         }
+        if (block_distributed())
+            val = reduce_over_processes(val, false);
         return std::sqrt(val);
     }
     else
@@ -556,10 +1008,52 @@ double BlockedTensor::norm(int type) const
     return 0.0;
 }
 
+TensorStats BlockedTensor::stats() const
+{
+    TensorStats result;
+    double sum2 = 0.0;
+    for (const auto &block_tensor : blocks_)
+    {
+        TensorStats block = block_tensor.second.stats();
+        if (block.numel == 0L)
+            continue;
+
+        // Positions in the block become MO indices
+        const vector<size_t> &key = block_tensor.first;
+        for (size_t d = 0; d < key.size(); ++d)
+        {
+            const vector<size_t> &mos = context()->mo_spaces[key[d]].mos();
+            block.max_indices[d] = mos[block.max_indices[d]];
+            block.min_indices[d] = mos[block.min_indices[d]];
+        }
+
+        if (result.numel == 0L || block.max > result.max)
+        {
+            result.max = block.max;
+            result.max_indices = block.max_indices;
+        }
+        if (result.numel == 0L || block.min < result.min)
+        {
+            result.min = block.min;
+            result.min_indices = block.min_indices;
+        }
+        result.numel += block.numel;
+        result.norm1 += block.norm1;
+        sum2 += block.norm2 * block.norm2;
+        result.norm_inf = std::max(result.norm_inf, block.norm_inf);
+    }
+    result.norm2 = std::sqrt(sum2);
+    if (result.numel != 0L)
+        result.rms = std::sqrt(sum2 / static_cast<double>(result.numel));
+    return result;
+}
+
 void BlockedTensor::zero()
 {
     for (auto block_tensor : blocks_)
     {
+        if (is_alias(block_tensor.first))
+            continue;
         block_tensor.second.zero();
     }
 }
@@ -568,18 +1062,179 @@ void BlockedTensor::scale(double beta)
 {
     for (auto block_tensor : blocks_)
     {
+        if (is_alias(block_tensor.first))
+            continue;
         block_tensor.second.scale(beta);
     }
 }
 
+std::map<std::vector<size_t>, double> BlockedTensor::block_norms() const
+{
+    std::map<std::vector<size_t>, double> norms;
+    for (const auto &block_tensor : blocks_)
+    {
+        if (!is_alias(block_tensor.first))
+            norms[block_tensor.first] = block_tensor.second.norm(2);
+    }
+    for (const std::vector<size_t> &alias : aliases_)
+    {
+        auto it = norms.find(spin_flipped_key(alias));
+        if (it != norms.end())
+            norms[alias] = it->second;
+    }
+    return norms;
+}
+
+size_t BlockedTensor::drop_zero_blocks(double threshold)
+{
+    if (block_distributed())
+        throw std::runtime_error("BlockedTensor::drop_zero_blocks is not "
+                                 "supported for block-distributed tensors.");
+
+    std::vector<std::vector<size_t>> dropped;
+    for (const auto &block_tensor : blocks_)
+    {
+        if (!is_alias(block_tensor.first) &&
+            block_tensor.second.norm(0) < threshold)
+            dropped.push_back(block_tensor.first);
+    }
+    for (const std::vector<size_t> &alias : aliases_)
+    {
+        std::vector<size_t> canonical = spin_flipped_key(alias);
+        if (std::find(dropped.begin(), dropped.end(), canonical) !=
+            dropped.end())
+            dropped.push_back(alias);
+    }
+    for (const std::vector<size_t> &key : dropped)
+    {
+        blocks_.erase(key);
+        aliases_.erase(key);
+    }
+    return dropped.size();
+}
+
 void BlockedTensor::set(double gamma)
 {
     for (auto block_tensor : blocks_)
     {
+        if (is_alias(block_tensor.first))
+            continue;
         block_tensor.second.set(gamma);
     }
 }
 
+std::map<std::vector<size_t>, std::map<std::string, Tensor>>
+BlockedTensor::map_diagonal_blocks(
+    const std::string &caller,
+    const std::function<std::map<std::string, Tensor>(const Tensor &)> &op)
+    const
+{
+    if (rank_ != 2)
+        throw std::runtime_error(caller + ": the BlockedTensor \"" + name_ +
+                                 "\" is not rank 2.");
+    if (block_distributed())
+        throw std::runtime_error(caller + " is not supported for "
+                                          "block-distributed tensors.");
+
+    std::vector<std::vector<size_t>> keys;
+    for (const auto &block_tensor : blocks_)
+    {
+        const std::vector<size_t> &key = block_tensor.first;
+        if (key[0] != key[1])
+            throw std::runtime_error(
+                caller + ": the BlockedTensor \"" + name_ +
+                "\" has the off-diagonal block " + context()->mo_spaces[key[0]].name() +
+                context()->mo_spaces[key[1]].name() + ".");
+        if (!is_alias(key))
+            keys.push_back(key);
+    }
+
+    // One LAPACK call per block, the blocks concurrently
+    std::vector<std::map<std::string, Tensor>> results(keys.size());
+    std::exception_ptr error;
+    threads::TaskThreads split(keys.size());
+#pragma omp parallel for schedule(dynamic, 1) num_threads(split.outer())     \
+    proc_bind(spread) if (keys.size() > 1)
+    for (size_t b = 0; b < keys.size(); ++b)
+    {
+        split.enter();
+        try
+        {
+            results[b] = op(blocks_.at(keys[b]));
+        }
+        catch (...)
+        {
+#pragma omp critical(ambit_diagonal_blocks_error)
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+
+    std::map<std::vector<size_t>, std::map<std::string, Tensor>> by_key;
+    for (size_t b = 0; b < keys.size(); ++b)
+        by_key[keys[b]] = results[b];
+    for (const std::vector<size_t> &alias : aliases_)
+        if (blocks_.count(alias) != 0)
+            by_key[alias] = by_key[spin_flipped_key(alias)];
+    return by_key;
+}
+
+BlockedTensor BlockedTensor::diagonal_result(
+    const std::string &name, const std::string &label, size_t rank,
+    const std::map<std::vector<size_t>, std::map<std::string, Tensor>>
+        &results) const
+{
+    BlockedTensor result;
+    result.name_ = name;
+    result.rank_ = rank;
+    for (const auto &key_result : results)
+    {
+        std::vector<size_t> key(key_result.first.begin(),
+                                key_result.first.begin() + rank);
+        result.blocks_[key] = key_result.second.at(label);
+        if (is_alias(key_result.first))
+            result.aliases_.insert(key);
+    }
+    return result;
+}
+
+std::map<std::string, BlockedTensor>
+BlockedTensor::syev(EigenvalueOrder order) const
+{
+    auto results = map_diagonal_blocks(
+        "BlockedTensor::syev",
+        [order](const Tensor &block) { return block.syev(order); });
+
+    std::map<std::string, BlockedTensor> result;
+    result["eigenvalues"] = diagonal_result("Eigenvalues of " + name_,
+                                            "eigenvalues", 1, results);
+    result["eigenvectors"] = diagonal_result("Eigenvectors of " + name_,
+                                             "eigenvectors", 2, results);
+    return result;
+}
+
+BlockedTensor BlockedTensor::power(double alpha, double condition) const
+{
+    auto results = map_diagonal_blocks(
+        "BlockedTensor::power", [alpha, condition](const Tensor &block) {
+            return std::map<std::string, Tensor>{
+                {"power", block.power(alpha, condition)}};
+        });
+    return diagonal_result(name_ + "^" + std::to_string(alpha), "power", 2,
+                           results);
+}
+
+BlockedTensor BlockedTensor::inverse() const
+{
+    auto results =
+        map_diagonal_blocks("BlockedTensor::inverse", [](const Tensor &block) {
+            return std::map<std::string, Tensor>{{"inverse", block.inverse()}};
+        });
+    return diagonal_result(name_ + "^-1", "inverse", 2, results);
+}
+
 bool BlockedTensor::operator==(const BlockedTensor &other) const
 {
     bool same = false;
@@ -619,6 +1274,9 @@ void BlockedTensor::iterate(
     for (auto key_tensor : blocks_)
     {
         const std::vector<size_t> &key = key_tensor.first;
+        // An alias is updated through its canonical block
+        if (is_alias(key))
+            continue;
 
         // Assemble the map from the block indices to the MO indices
 
@@ -630,8 +1288,8 @@ void BlockedTensor::iterate(
         std::vector<std::vector<SpinType>> index_to_spin;
         for (size_t k : key)
         {
-            index_to_mo.push_back(mo_spaces_[k].mos());
-            index_to_spin.push_back(mo_spaces_[k].spin());
+            index_to_mo.push_back(context()->mo_spaces[k].mos());
+            index_to_spin.push_back(context()->mo_spaces[k].spin());
         }
 
         // Call iterate on this tensor block
@@ -667,8 +1325,8 @@ void BlockedTensor::citerate(
         std::vector<std::vector<SpinType>> index_to_spin;
         for (size_t k : key)
         {
-            index_to_mo.push_back(mo_spaces_[k].mos());
-            index_to_spin.push_back(mo_spaces_[k].spin());
+            index_to_mo.push_back(context()->mo_spaces[k].mos());
+            index_to_spin.push_back(context()->mo_spaces[k].spin());
         }
 
         // Call iterate on this tensor block
@@ -699,12 +1357,12 @@ void BlockedTensor::print(FILE *fh, bool level, std::string const &format,
 
 LabeledBlockedTensor BlockedTensor::operator()(const std::string &indices)
 {
-    return LabeledBlockedTensor(*this, indices::split(indices));
+    return LabeledBlockedTensor(*this, split_labels(indices));
 }
 
 LabeledBlockedTensor BlockedTensor::operator[](const std::string &indices)
 {
-    return LabeledBlockedTensor(*this, indices::split(indices));
+    return LabeledBlockedTensor(*this, split_labels(indices));
 }
 
 std::vector<std::vector<size_t>>
@@ -725,6 +1383,14 @@ BlockedTensor::label_to_block_keys(const std::vector<std::string> &indices)
     // as we
     // process all the indices.
 
+    const std::shared_ptr<MOSpaceContext> &ctx = context();
+    {
+        std::lock_guard<std::mutex> lock(label_cache_mutex);
+        auto it = ctx->block_keys.find(indices);
+        if (it != ctx->block_keys.end())
+            return it->second;
+    }
+
     std::vector<std::vector<size_t>> final_blocks;
 
     // Loop over indices of this block
@@ -732,10 +1398,10 @@ BlockedTensor::label_to_block_keys(const std::vector<std::string> &indices)
     {
         std::vector<std::vector<size_t>> partial_blocks;
         // How does this MO space name map to the MOSpace objects contained in
-        // mo_spaces_? (e.g. "G" -> {0,1})
-        if (index_to_mo_spaces_.count(index) != 0)
+        // context()->mo_spaces? (e.g. "G" -> {0,1})
+        if (ctx->index_to_mo_spaces.count(index) != 0)
         {
-            for (size_t mo_space_idx : index_to_mo_spaces_[index])
+            for (size_t mo_space_idx : ctx->index_to_mo_spaces[index])
             {
                 // Special case
                 if (final_blocks.size() == 0)
@@ -761,12 +1427,15 @@ BlockedTensor::label_to_block_keys(const std::vector<std::string> &indices)
         }
         final_blocks = partial_blocks;
     }
+
+    std::lock_guard<std::mutex> lock(label_cache_mutex);
+    ctx->block_keys[indices] = final_blocks;
     return final_blocks;
 }
 
 LabeledBlockedTensor::LabeledBlockedTensor(
     BlockedTensor BT, const std::vector<std::string> &indices, double factor)
-    : BT_(BT), indices_(indices), factor_(factor)
+    : BT_(std::move(BT)), indices_(indices), factor_(factor)
 {
     if (BT_.rank() != indices.size())
         throw std::runtime_error("Labeled tensor does not have correct number "
@@ -782,6 +1451,10 @@ std::string LabeledBlockedTensor::str() const
 
 void LabeledBlockedTensor::operator=(const LabeledBlockedTensor &rhs)
 {
+    if (defer(*this, [](LabeledBlockedTensor &lhs, const LabeledBlockedTensor &x) {
+            lhs = x;
+        }, rhs))
+        return;
     try
     {
         add(rhs, 1.0, 0.0);
@@ -796,6 +1469,10 @@ void LabeledBlockedTensor::operator=(const LabeledBlockedTensor &rhs)
 
 void LabeledBlockedTensor::operator+=(const LabeledBlockedTensor &rhs)
 {
+    if (defer(*this, [](LabeledBlockedTensor &lhs, const LabeledBlockedTensor &x) {
+            lhs += x;
+        }, rhs))
+        return;
     try
     {
         add(rhs, 1.0, 1.0);
@@ -810,6 +1487,10 @@ void LabeledBlockedTensor::operator+=(const LabeledBlockedTensor &rhs)
 
 void LabeledBlockedTensor::operator-=(const LabeledBlockedTensor &rhs)
 {
+    if (defer(*this, [](LabeledBlockedTensor &lhs, const LabeledBlockedTensor &x) {
+            lhs -= x;
+        }, rhs))
+        return;
     try
     {
         add(rhs, -1.0, 1.0);
@@ -830,6 +1511,30 @@ void LabeledBlockedTensor::add(const LabeledBlockedTensor &rhs, double alpha,
     std::vector<size_t> perm =
         indices::permutation_order(indices_, rhs.indices_);
 
+    // With distributed blocks each lhs block is updated where it is stored,
+    // from a copy of the rhs block if that lives elsewhere
+    std::map<std::vector<size_t>, Tensor> received;
+    if (BT_.block_distributed() || rhs.BT().block_distributed())
+    {
+        std::vector<std::pair<int, std::vector<size_t>>> needs;
+        for (const std::vector<size_t> &rhs_key : rhs_keys)
+        {
+            std::vector<size_t> lhs_key;
+            for (size_t p : perm)
+                lhs_key.push_back(rhs_key[p]);
+            if (BlockedTensor::expert_mode() &&
+                (not BT().is_block(lhs_key) || not rhs.BT().is_block(rhs_key)))
+                continue;
+            int owner = BT().block_owner(lhs_key);
+            if (owner >= 0)
+                needs.push_back(std::make_pair(owner, rhs_key));
+            else
+                for (int process = 0; process < settings::nprocess; ++process)
+                    needs.push_back(std::make_pair(process, rhs_key));
+        }
+        received = rhs.BT().exchange_blocks(needs);
+    }
+
     // Loop over all keys of the rhs
     for (std::vector<size_t> &rhs_key : rhs_keys)
     {
@@ -840,7 +1545,9 @@ void LabeledBlockedTensor::add(const LabeledBlockedTensor &rhs, double alpha,
             lhs_key.push_back(rhs_key[p]);
         }
 
-        bool do_add = true;
+        // An aliased block is written through its canonical block, and a
+        // distributed one by its owner
+        bool do_add = not BT().is_alias(lhs_key) && not is_remote(BT(), lhs_key);
         // In expert mode if a contraction cannot be performed
         if (BlockedTensor::expert_mode())
         {
@@ -853,7 +1560,9 @@ void LabeledBlockedTensor::add(const LabeledBlockedTensor &rhs, double alpha,
         {
             // Call LabeledTensor's operation
             Tensor LHS = BT().block(lhs_key);
-            const Tensor RHS = rhs.BT().block(rhs_key);
+            auto it = received.find(rhs_key);
+            const Tensor RHS =
+                it != received.end() ? it->second : rhs.BT().block(rhs_key);
 
             if (LHS == RHS)
                 throw std::runtime_error("Self assignment is not allowed.");
@@ -866,6 +1575,81 @@ void LabeledBlockedTensor::add(const LabeledBlockedTensor &rhs, double alpha,
     }
 }
 
+void LabeledBlockedTensor::add_sum(const LabeledBlockedTensorAddition &rhs,
+                                   double alpha, bool zero_result)
+{
+    // Distributed blocks are exchanged term by term
+    bool distributed = BT_.block_distributed();
+    for (size_t ind = 0, end = rhs.size(); ind < end; ++ind)
+        distributed = distributed || rhs[ind].BT().block_distributed();
+    if (distributed)
+    {
+        if (zero_result)
+            BT_.zero();
+        for (size_t ind = 0, end = rhs.size(); ind < end; ++ind)
+            add(rhs[ind], alpha, 1.0);
+        return;
+    }
+
+    // Collect the terms that land on each lhs block
+    struct BlockSum
+    {
+        std::vector<Tensor> As;
+        std::vector<Indices> Ainds;
+        std::vector<double> alphas;
+    };
+    std::map<std::vector<size_t>, BlockSum> sums;
+    for (size_t ind = 0, end = rhs.size(); ind < end; ++ind)
+    {
+        const LabeledBlockedTensor &term = rhs[ind];
+        std::vector<size_t> perm =
+            indices::permutation_order(indices_, term.indices_);
+        for (const std::vector<size_t> &rhs_key : term.label_to_block_keys())
+        {
+            std::vector<size_t> lhs_key;
+            for (size_t p : perm)
+                lhs_key.push_back(rhs_key[p]);
+
+            // As in add()
+            if (BT().is_alias(lhs_key))
+                continue;
+            if (BlockedTensor::expert_mode() &&
+                (not BT().is_block(lhs_key) || not term.BT().is_block(rhs_key)))
+                continue;
+
+            Tensor LHS = BT().block(lhs_key);
+            const Tensor RHS = term.BT().block(rhs_key);
+            if (LHS == RHS)
+                throw std::runtime_error("Self assignment is not allowed.");
+            if (LHS.rank() != RHS.rank())
+                throw std::runtime_error(
+                    "Permuted tensors do not have same rank");
+            BlockSum &sum = sums[lhs_key];
+            sum.As.push_back(RHS);
+            sum.Ainds.push_back(term.indices_);
+            sum.alphas.push_back(alpha * term.factor());
+        }
+    }
+
+    // Each block is written once with all of its terms; blocks no term
+    // reaches are only zeroed
+    if (zero_result)
+    {
+        for (auto &key_block : BT_.blocks_)
+        {
+            if (BT_.is_alias(key_block.first) || sums.count(key_block.first))
+                continue;
+            key_block.second.zero();
+        }
+    }
+    for (auto &key_sum : sums)
+    {
+        Tensor LHS = BT().block(key_sum.first);
+        LHS.permute_sum(key_sum.second.As, indices_, key_sum.second.Ainds,
+                        key_sum.second.alphas, zero_result ? 0.0 : 1.0);
+    }
+}
+
 LabeledBlockedTensorProduct LabeledBlockedTensor::
 operator*(const LabeledBlockedTensor &rhs)
 {
@@ -886,6 +1670,10 @@ operator-(const LabeledBlockedTensor &rhs)
 
 void LabeledBlockedTensor::operator=(const LabeledBlockedTensorProduct &rhs)
 {
+    if (defer(*this, [](LabeledBlockedTensor &lhs, const LabeledBlockedTensorProduct &x) {
+            lhs = x;
+        }, rhs))
+        return;
     try
     {
         contract(rhs, true, true);
@@ -900,6 +1688,10 @@ void LabeledBlockedTensor::operator=(const LabeledBlockedTensorProduct &rhs)
 
 void LabeledBlockedTensor::operator+=(const LabeledBlockedTensorProduct &rhs)
 {
+    if (defer(*this, [](LabeledBlockedTensor &lhs, const LabeledBlockedTensorProduct &x) {
+            lhs += x;
+        }, rhs))
+        return;
     try
     {
         contract(rhs, false, true);
@@ -914,6 +1706,10 @@ void LabeledBlockedTensor::operator+=(const LabeledBlockedTensorProduct &rhs)
 
 void LabeledBlockedTensor::operator-=(const LabeledBlockedTensorProduct &rhs)
 {
+    if (defer(*this, [](LabeledBlockedTensor &lhs, const LabeledBlockedTensorProduct &x) {
+            lhs -= x;
+        }, rhs))
+        return;
     try
     {
         contract(rhs, false, false);
@@ -928,6 +1724,10 @@ void LabeledBlockedTensor::operator-=(const LabeledBlockedTensorProduct &rhs)
 
 void LabeledBlockedTensor::operator=(const LabeledBlockedTensorBatchedProduct &rhs)
 {
+    if (defer(*this, [](LabeledBlockedTensor &lhs, const BatchedTerms &x) {
+            lhs = LabeledBlockedTensorBatchedProduct(x.first, x.second);
+        }, BatchedTerms(rhs.get_contraction(), rhs.get_batched_indices())))
+        return;
     try
     {
         contract_batched(rhs, true, true);
@@ -942,6 +1742,10 @@ void LabeledBlockedTensor::operator=(const LabeledBlockedTensorBatchedProduct &r
 
 void LabeledBlockedTensor::operator+=(const LabeledBlockedTensorBatchedProduct &rhs)
 {
+    if (defer(*this, [](LabeledBlockedTensor &lhs, const BatchedTerms &x) {
+            lhs += LabeledBlockedTensorBatchedProduct(x.first, x.second);
+        }, BatchedTerms(rhs.get_contraction(), rhs.get_batched_indices())))
+        return;
     try
     {
         contract_batched(rhs, false, true);
@@ -956,6 +1760,10 @@ void LabeledBlockedTensor::operator+=(const LabeledBlockedTensorBatchedProduct &
 
 void LabeledBlockedTensor::operator-=(const LabeledBlockedTensorBatchedProduct &rhs)
 {
+    if (defer(*this, [](LabeledBlockedTensor &lhs, const BatchedTerms &x) {
+            lhs -= LabeledBlockedTensorBatchedProduct(x.first, x.second);
+        }, BatchedTerms(rhs.get_contraction(), rhs.get_batched_indices())))
+        return;
     try
     {
         contract_batched(rhs, false, false);
@@ -1007,17 +1815,29 @@ void LabeledBlockedTensor::contract_pair(const LabeledBlockedTensorProduct &rhs,
     std::vector<std::vector<size_t>> &unique_indices_keys = std::get<0>(*block_info_ptr);
     std::map<std::string, size_t> &index_map = std::get<1>(*block_info_ptr);
 
+    // Resolve the labels of the result and of each term to positions once
+    const std::vector<size_t> result_pos = label_positions(indices(), index_map);
+    std::vector<std::vector<size_t>> term_pos;
+    for (size_t n = 0; n < nterms; ++n)
+        term_pos.push_back(label_positions(rhs[n].indices(), index_map));
+
+    if (any_distributed(*this, rhs))
+    {
+        contract_pair_distributed(rhs, zero_result, add, unique_indices_keys,
+                                  result_pos, term_pos);
+        return;
+    }
+
     if (zero_result)
     {
-        // Zero the results blocks
+        // Zero the results blocks (an alias is zeroed with its canonical
+        // block, which may already hold this statement's twin)
         for (const std::vector<size_t> &uik : unique_indices_keys)
         {
-            std::vector<size_t> result_key;
-            for (const std::string &index : indices())
-            {
-                result_key.push_back(uik[index_map[index]]);
-            }
-            if (BlockedTensor::expert_mode_)
+            std::vector<size_t> result_key = gather_key(uik, result_pos);
+            if (BT_.is_alias(result_key))
+                continue;
+            if (BlockedTensor::context()->expert_mode)
             {
                 if (BT_.is_block(result_key))
                 {
@@ -1031,55 +1851,235 @@ void LabeledBlockedTensor::contract_pair(const LabeledBlockedTensorProduct &rhs,
         }
     }
 
-    // Setup and perform contractions
-    for (const std::vector<size_t> &uik : unique_indices_keys)
+    // Norm screening: the norms of the operand blocks bound the norm of
+    // their product
+    double screening = settings::block_screening;
+    std::vector<std::map<std::vector<size_t>, double>> term_norms(nterms);
+    double factors = std::fabs(factor());
+    if (screening > 0.0)
     {
-        std::vector<size_t> result_key;
-        for (const std::string &index : indices())
+        for (size_t n = 0; n < nterms; ++n)
         {
-            result_key.push_back(uik[index_map[index]]);
+            term_norms[n] = rhs[n].BT().block_norms();
+            factors *= std::fabs(rhs[n].factor());
         }
+    }
+
+    // Group the block products by result block. Products that write to
+    // different result blocks are independent and may run concurrently, while
+    // the products of a group accumulate into their block one after another.
+    std::map<std::vector<size_t>, size_t> result_to_group;
+    std::vector<std::vector<const std::vector<size_t> *>> groups;
+    bool threaded = true;
+    for (const std::vector<size_t> &uik : unique_indices_keys)
+    {
+        std::vector<size_t> result_key = gather_key(uik, result_pos);
 
         bool do_contract = true;
         // In expert mode if a contraction cannot be performed
-        if (BlockedTensor::expert_mode_)
+        if (BlockedTensor::context()->expert_mode)
         {
             if (not BT().is_block(result_key))
                 do_contract = false;
             for (size_t n = 0; n < nterms; ++n)
             {
                 const LabeledBlockedTensor &lbt = rhs[n];
-                std::vector<size_t> term_key;
-                for (const std::string &index : lbt.indices())
-                {
-                    term_key.push_back(uik[index_map[index]]);
-                }
+                std::vector<size_t> term_key = gather_key(uik, term_pos[n]);
                 if (not lbt.BT().is_block(term_key))
                     do_contract = false;
             }
         }
+        // An aliased result block is computed with its canonical block
+        if (not do_contract or BT().is_alias(result_key))
+            continue;
 
-        if (do_contract)
+        if (screening > 0.0)
         {
-            LabeledTensor result(BT().block(result_key), indices(), factor());
-
-            LabeledTensorContraction prod;
+            // A block that is not stored is zero
+            double bound = factors;
             for (size_t n = 0; n < nterms; ++n)
             {
-                const LabeledBlockedTensor &lbt = rhs[n];
-                std::vector<size_t> term_key;
-                for (const std::string &index : lbt.indices())
+                auto it = term_norms[n].find(gather_key(uik, term_pos[n]));
+                bound *= (it == term_norms[n].end() ? 0.0 : it->second);
+            }
+            if (bound < screening)
+                continue;
+        }
+
+        // Only core blocks are safe to contract from several threads
+        if (BT().block(result_key).type() != CoreTensor)
+            threaded = false;
+        for (size_t n = 0; n < nterms; ++n)
+        {
+            const LabeledBlockedTensor &lbt = rhs[n];
+            std::vector<size_t> term_key = gather_key(uik, term_pos[n]);
+            if (lbt.BT().block(term_key).type() != CoreTensor)
+                threaded = false;
+        }
+
+        auto it = result_to_group.find(result_key);
+        if (it == result_to_group.end())
+        {
+            it = result_to_group
+                     .insert(std::make_pair(result_key, groups.size()))
+                     .first;
+            groups.push_back(std::vector<const std::vector<size_t> *>());
+        }
+        groups[it->second].push_back(&uik);
+    }
+
+    // Setup and perform contractions
+    auto contract_group =
+        [&](const std::vector<const std::vector<size_t> *> &group) {
+            for (const std::vector<size_t> *uik : group)
+            {
+                std::vector<size_t> result_key = gather_key(*uik, result_pos);
+
+                LabeledTensor result(BT().block(result_key), indices(),
+                                     factor());
+
+                LabeledTensorContraction prod;
+                for (size_t n = 0; n < nterms; ++n)
                 {
-                    term_key.push_back(uik[index_map[index]]);
+                    const LabeledBlockedTensor &lbt = rhs[n];
+                    std::vector<size_t> term_key = gather_key(*uik, term_pos[n]);
+                    const LabeledTensor term(lbt.BT().block(term_key),
+                                             lbt.indices(), lbt.factor());
+                    prod *= term;
                 }
-                const LabeledTensor term(lbt.BT().block(term_key),
-                                         lbt.indices(), lbt.factor());
-                prod *= term;
+
+                result.contract(prod, false, add, false);
+            }
+        };
+
+    size_t ngroups = groups.size();
+
+    // Pairs of core blocks go in rounds: round r takes the r-th product of
+    // every group, so the products of a round write different result blocks
+    // and run as one batch
+    if (threaded && nterms == 2)
+    {
+        const LabeledBlockedTensor &A = rhs[0];
+        const LabeledBlockedTensor &B = rhs[1];
+        double alpha = (add ? 1.0 : -1.0) * A.factor() * B.factor();
+        for (size_t round = 0;; ++round)
+        {
+            std::vector<Tensor> Cs, As, Bs;
+            for (const std::vector<const std::vector<size_t> *> &group : groups)
+            {
+                if (round >= group.size())
+                    continue;
+                const std::vector<size_t> &uik = *group[round];
+                Cs.push_back(BT().block(gather_key(uik, result_pos)));
+                As.push_back(A.BT().block(gather_key(uik, term_pos[0])));
+                Bs.push_back(B.BT().block(gather_key(uik, term_pos[1])));
             }
+            if (Cs.empty())
+                break;
+            AMBIT_TIMER_PUSH("block products");
+            Tensor::contract_batch(Cs, As, Bs, indices(), A.indices(),
+                                   B.indices(), alpha, 1.0);
+            AMBIT_TIMER_POP();
+        }
+        return;
+    }
+
+    threaded = threaded && (ngroups > 1);
+    std::exception_ptr error;
+    threads::TaskThreads split(threaded ? ngroups : 1);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(split.outer())     \
+    proc_bind(spread) if (threaded)
+    for (size_t g = 0; g < ngroups; ++g)
+    {
+        split.enter();
+        AMBIT_TIMER_PUSH("block products");
+        try
+        {
+            contract_group(groups[g]);
+        }
+        catch (...)
+        {
+#pragma omp critical(ambit_contract_pair_error)
+            if (!error)
+                error = std::current_exception();
+        }
+        AMBIT_TIMER_POP();
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void LabeledBlockedTensor::contract_pair_distributed(
+    const LabeledBlockedTensorProduct &rhs, bool zero_result, bool add,
+    const std::vector<std::vector<size_t>> &unique_indices_keys,
+    const std::vector<size_t> &result_pos,
+    const std::vector<std::vector<size_t>> &term_pos)
+{
+    size_t nterms = rhs.size();
 
-            result.contract(prod, false, add, false);
+    // A result block is computed where it is stored: by its owner, or by
+    // every process for a replicated result. The operand blocks go there.
+    std::vector<const std::vector<size_t> *> products;
+    std::vector<std::vector<std::pair<int, std::vector<size_t>>>> needs(nterms);
+    for (const std::vector<size_t> &uik : unique_indices_keys)
+    {
+        std::vector<size_t> result_key = gather_key(uik, result_pos);
+        bool do_contract = not BT_.is_alias(result_key);
+        if (BlockedTensor::context()->expert_mode)
+        {
+            if (not BT_.is_block(result_key))
+                do_contract = false;
+            for (size_t n = 0; n < nterms; ++n)
+                if (not rhs[n].BT().is_block(gather_key(uik, term_pos[n])))
+                    do_contract = false;
         }
+        if (not do_contract)
+            continue;
+
+        int owner = BT_.block_owner(result_key);
+        for (size_t n = 0; n < nterms; ++n)
+        {
+            std::vector<size_t> term_key = gather_key(uik, term_pos[n]);
+            if (owner >= 0)
+                needs[n].push_back(std::make_pair(owner, term_key));
+            else
+                for (int process = 0; process < settings::nprocess; ++process)
+                    needs[n].push_back(std::make_pair(process, term_key));
+        }
+        if (owner < 0 || owner == settings::rank)
+            products.push_back(&uik);
     }
+
+    AMBIT_TIMER_PUSH("block exchange");
+    std::vector<std::map<std::vector<size_t>, Tensor>> received;
+    for (size_t n = 0; n < nterms; ++n)
+        received.push_back(rhs[n].BT().exchange_blocks(needs[n]));
+    AMBIT_TIMER_POP();
+
+    if (zero_result)
+        for (const std::vector<size_t> *uik : products)
+            BT_.block(gather_key(*uik, result_pos)).zero();
+
+    AMBIT_TIMER_PUSH("block products");
+    for (const std::vector<size_t> *uik : products)
+    {
+        LabeledTensor result(BT_.block(gather_key(*uik, result_pos)),
+                             indices(), factor());
+        LabeledTensorContraction prod;
+        for (size_t n = 0; n < nterms; ++n)
+        {
+            const LabeledBlockedTensor &lbt = rhs[n];
+            std::vector<size_t> term_key = gather_key(*uik, term_pos[n]);
+            auto it = received[n].find(term_key);
+            const LabeledTensor term(it != received[n].end()
+                                         ? it->second
+                                         : lbt.BT().block(term_key),
+                                     lbt.indices(), lbt.factor());
+            prod *= term;
+        }
+        result.contract(prod, false, add, false);
+    }
+    AMBIT_TIMER_POP();
 }
 
 void LabeledBlockedTensor::set(const LabeledBlockedTensor &to)
@@ -1089,6 +2089,13 @@ void LabeledBlockedTensor::set(const LabeledBlockedTensor &to)
     factor_ = to.factor_;
 }
 
+void LabeledBlockedTensor::set(LabeledBlockedTensor &&to)
+{
+    BT_ = std::move(to.BT_);
+    indices_ = std::move(to.indices_);
+    factor_ = to.factor_;
+}
+
 void LabeledBlockedTensor::contract(const LabeledBlockedTensorProduct &rhs,
                                     bool zero_result, bool add, bool optimize_order)
 {
@@ -1125,7 +2132,7 @@ void LabeledBlockedTensor::contract(const LabeledBlockedTensorProduct &rhs,
         std::vector<std::vector<size_t>> unique_indices_keys;
         std::map<std::string, size_t> index_map;
         bool full_contraction = true;
-        if (BlockedTensor::expert_mode_)
+        if (BlockedTensor::context()->expert_mode)
         {
             // Find the unique indices in the contraction
             std::vector<std::string> unique_indices;
@@ -1164,7 +2171,8 @@ void LabeledBlockedTensor::contract(const LabeledBlockedTensorProduct &rhs,
                 }
                 if (not BT().is_block(result_key))
                     continue;
-                else if (zero_result) {
+                else if (zero_result && !BT_.is_alias(result_key) &&
+                         !is_remote(BT_, result_key)) {
                     BT_.block(result_key).zero();
                 }
                 for (size_t n = 0; n < nterms; ++n)
@@ -1194,26 +2202,12 @@ void LabeledBlockedTensor::contract(const LabeledBlockedTensorProduct &rhs,
     std::vector<std::vector<size_t>> &unique_indices_keys = std::get<1>(*expert_info_ptr);
     std::map<std::string, size_t> &index_map = std::get<2>(*expert_info_ptr);
 
-    std::vector<size_t> perm(nterms);
     std::vector<size_t> best_perm(nterms);
-    std::iota(perm.begin(), perm.end(), 0);
-    std::pair<double, double> best_cpu_memory_cost(1.0e200, 1.0e200);
+    std::iota(best_perm.begin(), best_perm.end(), 0);
 
-    if (optimize_order) {
-        do
-        {
-            std::pair<double, double> cpu_memory_cost =
-                rhs.compute_contraction_cost(perm, unique_indices_keys, index_map, full_contraction);
-            if (cpu_memory_cost.first < best_cpu_memory_cost.first)
-            {
-                best_perm = perm;
-                best_cpu_memory_cost = cpu_memory_cost;
-            }
-        } while (std::next_permutation(perm.begin(), perm.end()));
-        // at this point 'best_perm' should be used to perform contraction in
-        // optimal order.
-    } else {
-        best_perm = perm;
+    if (optimize_order && nterms > 2) {
+        best_perm = rhs.optimal_order(indices(), unique_indices_keys, index_map,
+                                      full_contraction);
     }
 
     const LabeledBlockedTensor &Aref = rhs[best_perm[0]];
@@ -1257,13 +2251,14 @@ void LabeledBlockedTensor::contract(const LabeledBlockedTensorProduct &rhs,
 
         if (! inter_AB_tensors[n]) {
             inter_AB_tensors[n] = std::make_shared<BlockedTensor>(
-                        BlockedTensor::build(CoreTensor, A.BT().name() + " * " + B.BT().name(), AB_blocks));
+                        BlockedTensor::build_intermediate(A.BT().name() + " * " + B.BT().name(), AB_blocks));
         }
         LabeledBlockedTensor AB(*(inter_AB_tensors[n]), indices);
 
         AB.contract_pair(A * B, true, true, inter_block_info_ptrs[n]);
 
-        A.set(AB);
+        // The intermediate is handed over, not copied block map and all
+        A.set(std::move(AB));
     }
     const LabeledBlockedTensor &B = rhs[best_perm[nterms - 1]];
 
@@ -1274,8 +2269,10 @@ void LabeledBlockedTensor::contract_batched(const LabeledBlockedTensorBatchedPro
                                     bool zero_result, bool add, bool optimize_order)
 {
     const LabeledBlockedTensorProduct &rhs = rhs_batched.get_contraction();
-    const Indices &batched_indices = rhs_batched.get_batched_indices();
-    size_t batched_size = batched_indices.size();
+
+    if (any_distributed(*this, rhs))
+        throw std::runtime_error("Batched contractions of block-distributed "
+                                 "tensors are not supported.");
 
     size_t nterms = rhs.size();
     // Check for self assignment
@@ -1293,7 +2290,7 @@ void LabeledBlockedTensor::contract_batched(const LabeledBlockedTensorBatchedPro
     std::map<std::string, size_t> index_map;
     // In expert mode if a contraction cannot be performed
     bool full_contraction = true;
-    if (BlockedTensor::expert_mode_)
+    if (BlockedTensor::context()->expert_mode)
     {
         // Find the unique indices in the contraction
         std::vector<std::string> unique_indices;
@@ -1308,14 +2305,6 @@ void LabeledBlockedTensor::contract_batched(const LabeledBlockedTensorBatchedPro
         unique_indices.erase(
             std::unique(unique_indices.begin(), unique_indices.end()),
             unique_indices.end());
-        Indices sorted_batched_indices(batched_indices);
-        sort(sorted_batched_indices.begin(), sorted_batched_indices.end());
-        Indices unbatched_indices;
-        std::set_difference(unique_indices.begin(), unique_indices.end(),
-                            sorted_batched_indices.begin(), sorted_batched_indices.end(),
-                            std::back_inserter(unbatched_indices));
-        unique_indices = batched_indices;
-        unique_indices.insert(unique_indices.end(), unbatched_indices.begin(), unbatched_indices.end());
 
         unique_indices_keys = BlockedTensor::label_to_block_keys(unique_indices);
         size_t full_contraction_size = unique_indices_keys.size();
@@ -1340,7 +2329,7 @@ void LabeledBlockedTensor::contract_batched(const LabeledBlockedTensorBatchedPro
             }
             if (not BT().is_block(result_key))
                 continue;
-            else if (zero_result) {
+            else if (zero_result && !BT_.is_alias(result_key)) {
                 BT_.block(result_key).zero();
             }
             bool do_contraction = true;
@@ -1369,26 +2358,48 @@ void LabeledBlockedTensor::contract_batched(const LabeledBlockedTensorBatchedPro
         }
     }
 
-    std::vector<size_t> perm(nterms);
     std::vector<size_t> best_perm(nterms);
-    std::iota(perm.begin(), perm.end(), 0);
-    std::pair<double, double> best_cpu_memory_cost(1.0e200, 1.0e200);
+    std::iota(best_perm.begin(), best_perm.end(), 0);
 
-    if (optimize_order) {
-        do
-        {
-            std::pair<double, double> cpu_memory_cost =
-                rhs.compute_contraction_cost(perm, unique_indices_keys, index_map, full_contraction);
-            if (cpu_memory_cost.first < best_cpu_memory_cost.first)
-            {
-                best_perm = perm;
-                best_cpu_memory_cost = cpu_memory_cost;
-            }
-        } while (std::next_permutation(perm.begin(), perm.end()));
-        // at this point 'best_perm' should be used to perform contraction in
-        // optimal order.
-    } else {
-        best_perm = perm;
+    if (optimize_order && nterms > 2) {
+        best_perm = rhs.optimal_order(indices(), unique_indices_keys, index_map,
+                                      full_contraction);
+    }
+
+    // Size the batches so that their intermediates fit in what the live
+    // tensors leave of the memory limit, counting every index at the full
+    // dimension of its spaces.
+    LabeledBlockedTensorProduct rhsp;
+    std::vector<Indices> terms;
+    std::map<std::string, size_t> dims;
+    for (size_t i = 0; i < nterms; ++i) {
+        const LabeledBlockedTensor &A = rhs[best_perm[i]];
+        rhsp.operator*(A);
+        terms.push_back(A.indices());
+        for (const std::string &index : A.indices()) {
+            dims[index] = 0;
+        }
+    }
+    for (const std::string &index : indices_) {
+        dims[index] = 0;
+    }
+    for (auto &index_dim : dims) {
+        for (const std::vector<size_t> &key : BlockedTensor::label_to_block_keys({index_dim.first})) {
+            index_dim.second += BlockedTensor::mo_space(key[0]).dim();
+        }
+    }
+    std::vector<size_t> order(nterms);
+    std::iota(order.begin(), order.end(), 0);
+    size_t live = memory::live_bytes();
+    size_t room = live < settings::memory_limit ? settings::memory_limit - live : 0L;
+    contraction_path::Batching batching = contraction_path::plan_batching(
+        terms, indices_, contraction_path::chain(order), dims,
+        rhs_batched.get_batched_indices(), room);
+    const Indices &batched_indices = batching.indices;
+    size_t batched_size = batched_indices.size();
+    if (batched_size == 0) {
+        contract(rhsp, zero_result, add, false);
+        return;
     }
 
     // Find the indices to be batched in result labeled tensor.
@@ -1402,124 +2413,75 @@ void LabeledBlockedTensor::contract_batched(const LabeledBlockedTensorBatchedPro
         }
     }
 
-    // Determine if the result need permutation to permute the batched indices to the front
-    bool permute_flag = false;
-    for (size_t l = 0; l < batched_size; ++l) {
-        if (slicing_axis[l] != l) {
-            permute_flag = true;
-            break;
-        }
-    }
-
-    // Determine batched dimensions.
-    Indices permuted_indices;
-
-    // Permute result labeled tensor.
-    LabeledBlockedTensor Lt(BT(), indices());
-    if (permute_flag) {
-        permuted_indices = batched_indices;
-        for (size_t l = 0, l_max = numdim(); l < l_max; ++l) {
-            if (std::find(slicing_axis.begin(), slicing_axis.end(),l) == slicing_axis.end()) {
-                permuted_indices.push_back(indices_[l]);
-            }
-        }
-        // Determine blocks
-        std::vector<std::string> L_blocks = BlockedTensor::reduce_rank_block_labels(
-                    permuted_indices,
-                    indices(),
-                    BT().blocks_,
-                    full_contraction);
-
-        BlockedTensor Lbtp = BlockedTensor::build(CoreTensor, BT().name() + " permute", L_blocks);
-        LabeledBlockedTensor Ltemp(Lbtp, permuted_indices);
-        Ltemp = Lt;
-        Lt.set(Ltemp);
-    }
-
-    std::vector<std::vector<bool>> need_slicing(nterms, std::vector<bool>(batched_size + 1));
-
-    // Permute tensor indices if the corresponding tensor needs to be batched.
-    LabeledBlockedTensorProduct rhsp;
-    for (size_t i = 0; i < nterms; ++i) {
-        const LabeledBlockedTensor& A = rhs[best_perm[i]];
-        const Indices& A_indices = A.indices();
-        Indices gemm_indices;
-        for (const string& s : A_indices) {
-            auto it = std::find(batched_indices.begin(), batched_indices.end(), s);
-            if (it != batched_indices.end()) {
-                need_slicing[i][std::distance(batched_indices.begin(), it)] = true;
-            } else {
-                gemm_indices.push_back(s);
-            }
-        }
-        Indices permuted_indices;
-        for (size_t l = 0; l < batched_size; ++l) {
-            if (need_slicing[i][l]) {
-                permuted_indices.push_back(batched_indices[l]);
-                need_slicing[i][batched_size] = true;
+    // The result and every term of a batch are made of slabs of their blocks
+    // at the current values of the batched indices they carry (the last one
+    // spanning a chunk of values), so each batch is contracted straight into
+    // the result blocks and only the intermediates of one batch are alive at
+    // a time.
+    // The blocks of A whose batched indices are in the spaces batch_keys,
+    // as slabs at current (where the first nfixed batched indices are fixed
+    // and the next one spans chunk values, relabeled chunk_label), keyed by
+    // their other spaces
+    auto batch_of = [&](const LabeledBlockedTensor &A, const std::vector<size_t> &batch_keys,
+                        const std::vector<size_t> &current, size_t nfixed, size_t chunk,
+                        const std::string &chunk_label) {
+        std::vector<size_t> axes, values, spaces, ranged;
+        Indices sub_indices;
+        for (size_t d = 0; d < A.indices().size(); ++d) {
+            size_t l = std::find(batched_indices.begin(), batched_indices.end(), A.indices()[d]) -
+                       batched_indices.begin();
+            if (l < batched_size) {
+                spaces.push_back(d);
+                if (l < nfixed) {
+                    axes.push_back(d);
+                    values.push_back(current[l]);
+                    continue;
+                }
+                ranged.push_back(current[l]);
+                sub_indices.push_back(chunk_label);
+                continue;
             }
-        }
-        if (permuted_indices.size() == 0) {
-            rhsp.operator*(A);
-        } else {
-            permuted_indices.insert(permuted_indices.end(),gemm_indices.begin(),gemm_indices.end());
-            if (permuted_indices == A_indices) {
-                rhsp.operator*(A);
-            } else {
-                // Determine blocks
-                std::vector<std::string> A_blocks = BlockedTensor::reduce_rank_block_labels(
-                            permuted_indices,
-                            A_indices,
-                            A.BT().blocks_,
-                            full_contraction);
-                BlockedTensor Abtp = BlockedTensor::build(CoreTensor, A.BT().name() + " permute", A_blocks);
-                LabeledBlockedTensor At(Abtp, permuted_indices);
-                At = A;
-                rhsp.operator*(At);
+            sub_indices.push_back(A.indices()[d]);
+        }
+        if (spaces.empty())
+            return A;
+
+        BlockedTensor batch;
+        batch.set_name(A.BT().name() + " batch");
+        batch.rank_ = sub_indices.size();
+        for (const auto &block_key_tensor : A.BT().blocks_) {
+            const std::vector<size_t> &key = block_key_tensor.first;
+            bool in_batch = true;
+            for (size_t d : spaces) {
+                size_t l = std::find(batched_indices.begin(), batched_indices.end(), A.indices()[d]) -
+                           batched_indices.begin();
+                if (key[d] != batch_keys[l]) {
+                    in_batch = false;
+                    break;
+                }
             }
-        }
-    }
-
-    // Create intermediate batch tensor for result tensor.
-    const Indices& Lt_indices = Lt.indices();
-    Indices L_batch_indices;
-    L_batch_indices.insert(L_batch_indices.end(), Lt_indices.begin()+batched_size, Lt_indices.end());
-    std::vector<std::string> L_batch_blocks = BlockedTensor::reduce_rank_block_labels(
-                L_batch_indices,
-                Lt_indices,
-                Lt.BT().blocks_,
-                full_contraction);
-    BlockedTensor Ltp_batch = BlockedTensor::build(CoreTensor, Lt.BT().name() + " batch", L_batch_blocks);
-    LabeledBlockedTensor Lt_batch(Ltp_batch, L_batch_indices);
-
-    // Create intermediate batch tensors for tensors to be contracted.
-    LabeledBlockedTensorProduct rhs_batch;
-    std::map<size_t, BlockedTensor> batch_tensors;
-    for (size_t i = 0; i < nterms; ++i) {
-        const LabeledBlockedTensor& A = rhsp[i];
-        if (need_slicing[i][batched_size]) {
-            const Indices& A_indices = A.indices();
-            Indices A_batch_indices;
-            size_t count = 0;
-            for (size_t l = 0; l < batched_size; ++l) {
-                if (need_slicing[i][l]) {
-                    count++;
+            if (not in_batch)
+                continue;
+            const Tensor &block = block_key_tensor.second;
+            std::vector<size_t> sub_key;
+            IndexRange range;
+            for (size_t d = 0; d < key.size(); ++d) {
+                if (std::find(axes.begin(), axes.end(), d) != axes.end())
+                    continue;
+                sub_key.push_back(key[d]);
+                if (std::find(spaces.begin(), spaces.end(), d) != spaces.end()) {
+                    range.push_back({ranged[0], std::min(ranged[0] + chunk, block.dim(d))});
+                } else {
+                    range.push_back({0L, block.dim(d)});
                 }
             }
-            A_batch_indices.insert(A_batch_indices.end(), A_indices.begin()+count, A_indices.end());
-            std::vector<std::string> A_batch_blocks = BlockedTensor::reduce_rank_block_labels(
-                        A_batch_indices,
-                        A_indices,
-                        A.BT().blocks_,
-                        full_contraction);
-
-            batch_tensors[i] = BlockedTensor::build(CoreTensor, A.BT().name() + " batch", A_batch_blocks);
-            LabeledBlockedTensor At(batch_tensors[i], A_batch_indices, A.factor());
-            rhs_batch.operator*(At);
-        } else {
-            rhs_batch.operator*(A);
+            Tensor slab = block.slab(axes, values);
+            batch.blocks_[sub_key] = ranged.empty() ? slab : slab.view(range);
+            if (A.BT().is_alias(key))
+                batch.aliases_.insert(sub_key);
         }
-    }
+        return LabeledBlockedTensor(batch, sub_indices, A.factor());
+    };
 
     // Figure out all batched indices mo_spaces
     std::vector<std::vector<size_t>> batch_mo_space_keys;
@@ -1528,15 +2490,16 @@ void LabeledBlockedTensor::contract_batched(const LabeledBlockedTensorBatchedPro
         batch_mo_space_keys =
                 BlockedTensor::label_to_block_keys(batched_indices);
     } else {
-        std::vector<size_t> pre_key;
+        std::set<std::vector<size_t>> keys;
         for (const std::vector<size_t> &uik : unique_indices_keys)
         {
-            std::vector<size_t> term_key(uik.begin(), uik.begin() + batched_size);
-            if (pre_key != term_key) {
-                batch_mo_space_keys.push_back(term_key);
-                pre_key = term_key;
+            std::vector<size_t> term_key;
+            for (const std::string &index : batched_indices) {
+                term_key.push_back(uik[index_map[index]]);
             }
+            keys.insert(term_key);
         }
+        batch_mo_space_keys.assign(keys.begin(), keys.end());
     }
 
     for (const std::vector<size_t> &batch_keys : batch_mo_space_keys) {
@@ -1550,102 +2513,53 @@ void LabeledBlockedTensor::contract_batched(const LabeledBlockedTensorBatchedPro
                 expert_info_ptr;
         std::vector<std::shared_ptr<std::tuple<std::vector<std::vector<size_t>>, std::map<std::string, size_t>>>>
                 inter_block_info_ptrs(nterms - 1);
-        while (current_batch[0] < slicing_dims[0]) {
-
-            // Extract result batch
-            for (auto &batch_block_key_tensor : Ltp_batch.blocks_) {
-                const std::vector<size_t> &batch_block_key = batch_block_key_tensor.first;
-                std::vector<size_t> corr_perm_block_key(batch_keys);
-                corr_perm_block_key.insert(
-                            corr_perm_block_key.end(),
-                            batch_block_key.begin(),
-                            batch_block_key.end());
-                if (full_contraction or Lt.BT().is_block(corr_perm_block_key)) {
-                    Tensor Lt_batch_block = batch_block_key_tensor.second;
-                    Tensor Lt_block = Lt.BT().block(corr_perm_block_key);
-                    size_t L_shift = 0, cur_jump = 1;
-                    size_t sub_numel = Lt_batch_block.numel();
-                    for (int i = batched_size - 1; i >= 0; --i) {
-                        L_shift += current_batch[i] * cur_jump;
-                        cur_jump *= slicing_dims[i];
-                    }
-                    L_shift *= sub_numel;
-                    std::vector<double>& Lt_batch_data = Lt_batch_block.data();
-                    std::vector<double>& Lt_data = Lt_block.data();
-                    std::memcpy(Lt_batch_data.data(), Lt_data.data()+L_shift, sub_numel * sizeof(double));
-                } else {
-                    batch_block_key_tensor.second.zero();
+        // A chunk of a batched index keeps it in the batch, so it is labeled
+        // with an index of the space of this batch alone (or the batches
+        // take single values if no such index is free). The intermediates
+        // take the whole dimension of that space, so with intermediates a
+        // chunk must cover the whole space.
+        size_t chunk = batching.chunk;
+        if (nterms > 2 && chunk < slicing_dims[batched_size - 1]) {
+            chunk = 1;
+        }
+        std::string chunk_label = batched_indices.back();
+        if (chunk > 1 && BlockedTensor::context()->index_to_mo_spaces[chunk_label].size() > 1) {
+            chunk_label.clear();
+            MOSpace space = BlockedTensor::mo_space(batch_keys.back());
+            for (const std::string &label : space.mo_indices()) {
+                if (dims.count(label) == 0) {
+                    chunk_label = label;
+                    break;
                 }
             }
+            if (chunk_label.empty()) {
+                chunk = 1;
+            }
+        }
+        size_t nfixed = chunk == 1 ? batched_size : batched_size - 1;
+
+        size_t extent = 0;
+        while (current_batch[0] < slicing_dims[0]) {
+            // The intermediates are shared by all the batches of these spaces
+            // that have as many values
+            size_t last = current_batch[batched_size - 1];
+            size_t this_extent = std::min(chunk, slicing_dims[batched_size - 1] - last);
+            if (this_extent != extent) {
+                std::fill(inter_AB_tensors.begin(), inter_AB_tensors.end(), nullptr);
+                extent = this_extent;
+            }
 
+            LabeledBlockedTensor Lt_batch = batch_of(*this, batch_keys, current_batch, nfixed, chunk, chunk_label);
+            LabeledBlockedTensorProduct rhs_batch;
             for (size_t i = 0; i < nterms; ++i) {
-                if (need_slicing[i][batched_size]) {
-
-                    // Extract tensor batch
-                    for (auto &batch_block_key_tensor : batch_tensors[i].blocks_) {
-                        const std::vector<size_t> &batch_block_key = batch_block_key_tensor.first;
-                        std::vector<size_t> corr_perm_block_key;
-                        for (size_t l = 0; l < batched_size; ++l) {
-                            if (need_slicing[i][l]) {
-                                corr_perm_block_key.push_back(batch_keys[l]);
-                            }
-                        }
-                        corr_perm_block_key.insert(
-                                    corr_perm_block_key.end(),
-                                    batch_block_key.begin(),
-                                    batch_block_key.end());
-                        if (full_contraction or rhsp[i].BT().is_block(corr_perm_block_key)) {
-                            Tensor A_batch_block = batch_block_key_tensor.second;
-                            Tensor A_block = rhsp[i].BT().block(corr_perm_block_key);
-                            size_t cur_shift = 0, cur_jump = 1;
-                            size_t sub_numel_A = A_batch_block.numel();
-                            for (int l = batched_size - 1; l >= 0; --l) {
-                                if (need_slicing[i][l]) {
-                                    cur_shift += current_batch[l] * cur_jump;
-                                    cur_jump *= slicing_dims[l];
-                                }
-                            }
-                            cur_shift *= sub_numel_A;
-                            std::vector<double>& A_batch_data = A_batch_block.data();
-                            const std::vector<double>& A_data = A_block.data();
-                            std::memcpy(A_batch_data.data(), A_data.data()+cur_shift, sub_numel_A * sizeof(double));
-                        } else {
-                            batch_block_key_tensor.second.zero();
-                        }
-                    }
-                }
+                rhs_batch.operator*(batch_of(rhsp[i], batch_keys, current_batch, nfixed, chunk, chunk_label));
             }
 
-            // The following code is identical to Lt_batch.contract(rhs_batch, zero_result, add);
             Lt_batch.contract(rhs_batch, zero_result, add, false, inter_AB_tensors, expert_info_ptr, inter_block_info_ptrs);
 
-            // Copy current batch tensor result to the full result tensor
-            for (auto &batch_block_key_tensor : Lt_batch.BT().blocks_) {
-                const std::vector<size_t> &batch_block_key = batch_block_key_tensor.first;
-                std::vector<size_t> corr_perm_block_key(batch_keys);
-                corr_perm_block_key.insert(
-                            corr_perm_block_key.end(),
-                            batch_block_key.begin(),
-                            batch_block_key.end());
-                if (full_contraction or Lt.BT().is_block(corr_perm_block_key)) {
-                    Tensor Lt_batch_block = batch_block_key_tensor.second;
-                    Tensor Lt_block = Lt.BT().block(corr_perm_block_key);
-                    size_t L_shift = 0, cur_jump = 1;
-                    size_t sub_numel = Lt_batch_block.numel();
-                    for (int i = batched_size - 1; i >= 0; --i) {
-                        L_shift += current_batch[i] * cur_jump;
-                        cur_jump *= slicing_dims[i];
-                    }
-                    L_shift *= sub_numel;
-                    std::vector<double>& Lt_batch_data = Lt_batch_block.data();
-                    std::vector<double>& Lt_data = Lt_block.data();
-                    std::memcpy(Lt_data.data()+L_shift, Lt_batch_data.data(), sub_numel * sizeof(double));
-                }
-            }
-
             // Determine the indices of next batch
             for (int i = batched_size - 1; i >= 0; --i) {
-                current_batch[i]++;
+                current_batch[i] += (i + 1 == int(batched_size) ? chunk : 1);
                 if (current_batch[i] < slicing_dims[i]) {
                     break;
                 } else if (i != 0) {
@@ -1654,59 +2568,63 @@ void LabeledBlockedTensor::contract_batched(const LabeledBlockedTensorBatchedPro
             }
         }
     }
-
-    // Permute result tensor back
-    if (permute_flag) {
-        (*this) = Lt;
-    }
 }
 
 void LabeledBlockedTensor::operator=(const LabeledBlockedTensorAddition &rhs)
 {
-    BT_.zero();
-    for (size_t ind = 0, end = rhs.size(); ind < end; ++ind)
-    {
-        const LabeledBlockedTensor &labeledTensor = rhs[ind];
-        add(labeledTensor, 1.0, 1.0);
-    }
+    if (defer(*this, [](LabeledBlockedTensor &lhs, const LabeledBlockedTensorAddition &x) {
+            lhs = x;
+        }, rhs))
+        return;
+    add_sum(rhs, 1.0, true);
 }
 
 void LabeledBlockedTensor::operator+=(const LabeledBlockedTensorAddition &rhs)
 {
-    for (size_t ind = 0, end = rhs.size(); ind < end; ++ind)
-    {
-        const LabeledBlockedTensor &labeledTensor = rhs[ind];
-        add(labeledTensor, 1.0, 1.0);
-    }
+    if (defer(*this, [](LabeledBlockedTensor &lhs, const LabeledBlockedTensorAddition &x) {
+            lhs += x;
+        }, rhs))
+        return;
+    add_sum(rhs, 1.0, false);
 }
 
 void LabeledBlockedTensor::operator-=(const LabeledBlockedTensorAddition &rhs)
 {
-    for (size_t ind = 0, end = rhs.size(); ind < end; ++ind)
-    {
-        const LabeledBlockedTensor &labeledTensor = rhs[ind];
-        add(labeledTensor, -1.0, 1.0);
-    }
+    if (defer(*this, [](LabeledBlockedTensor &lhs, const LabeledBlockedTensorAddition &x) {
+            lhs -= x;
+        }, rhs))
+        return;
+    add_sum(rhs, -1.0, false);
 }
 
 void LabeledBlockedTensor::operator*=(double scale)
 {
+    if (defer(*this, [](LabeledBlockedTensor &lhs, double x) { lhs *= x; },
+              scale))
+        return;
     std::vector<std::vector<size_t>> keys = label_to_block_keys();
 
     // Loop over all keys and scale blocks
     for (std::vector<size_t> &key : keys)
     {
+        if (BT_.is_alias(key) || is_remote(BT_, key))
+            continue;
         BT_.block(key).scale(scale);
     }
 }
 
 void LabeledBlockedTensor::operator/=(double scale)
 {
+    if (defer(*this, [](LabeledBlockedTensor &lhs, double x) { lhs /= x; },
+              scale))
+        return;
     std::vector<std::vector<size_t>> keys = label_to_block_keys();
 
     // Loop over all keys and scale blocks
     for (std::vector<size_t> &key : keys)
     {
+        if (BT_.is_alias(key) || is_remote(BT_, key))
+            continue;
         BT_.block(key).scale(1.0 / scale);
     }
 }
@@ -1720,11 +2638,17 @@ operator*(const LabeledBlockedTensorAddition &rhs)
 void LabeledBlockedTensor::
 operator=(const LabeledBlockedTensorDistributive &rhs)
 {
+    if (defer(*this, [](LabeledBlockedTensor &lhs, const DistributiveTerms &x) {
+            lhs = LabeledBlockedTensorDistributive(x.first, x.second);
+        }, DistributiveTerms(rhs.A(), rhs.B())))
+        return;
     std::vector<std::vector<size_t>> lhs_keys = label_to_block_keys();
 
     // Loop over all keys of the rhs
     for (std::vector<size_t> &lhs_key : lhs_keys)
     {
+        if (BT_.is_alias(lhs_key) || is_remote(BT_, lhs_key))
+            continue;
         BT_.block(lhs_key).zero();
     }
 
@@ -1738,6 +2662,10 @@ operator=(const LabeledBlockedTensorDistributive &rhs)
 void LabeledBlockedTensor::
 operator+=(const LabeledBlockedTensorDistributive &rhs)
 {
+    if (defer(*this, [](LabeledBlockedTensor &lhs, const DistributiveTerms &x) {
+            lhs += LabeledBlockedTensorDistributive(x.first, x.second);
+        }, DistributiveTerms(rhs.A(), rhs.B())))
+        return;
     for (const LabeledBlockedTensor &B : rhs.B())
     {
         *this += const_cast<LabeledBlockedTensor &>(rhs.A()) *
@@ -1748,6 +2676,10 @@ operator+=(const LabeledBlockedTensorDistributive &rhs)
 void LabeledBlockedTensor::
 operator-=(const LabeledBlockedTensorDistributive &rhs)
 {
+    if (defer(*this, [](LabeledBlockedTensor &lhs, const DistributiveTerms &x) {
+            lhs -= LabeledBlockedTensorDistributive(x.first, x.second);
+        }, DistributiveTerms(rhs.A(), rhs.B())))
+        return;
     for (const LabeledBlockedTensor &B : rhs.B())
     {
         *this -= const_cast<LabeledBlockedTensor &>(rhs.A()) *
@@ -1795,6 +2727,9 @@ std::string LabeledBlockedTensorProduct::str() const
 
 LabeledBlockedTensorProduct::operator double() const
 {
+    if (Graph::recording())
+        throw std::runtime_error(
+            "Scalar contractions cannot be evaluated while a Graph records.");
     double result = 0.0;
 
     size_t nterms = this->size();
@@ -1824,10 +2759,47 @@ LabeledBlockedTensorProduct::operator double() const
             k++;
         }
     }
+    std::vector<std::vector<size_t>> term_pos;
+    for (size_t n = 0; n < nterms; ++n)
+        term_pos.push_back(label_positions(tensors_[n].indices(), index_map));
+
+    // With distributed blocks a product is computed by the owner of its first
+    // distributed block, from copies of the blocks stored elsewhere, and the
+    // partial sums of all processes are added up
+    bool distributed = false;
+    for (size_t n = 0; n < nterms; ++n)
+        distributed = distributed || tensors_[n].BT().block_distributed();
+    std::vector<std::map<std::vector<size_t>, Tensor>> received(nterms);
+    if (distributed)
+    {
+        std::vector<std::vector<std::pair<int, std::vector<size_t>>>> needs(
+            nterms);
+        for (const std::vector<size_t> &uik : unique_indices_keys)
+        {
+            int process = -1;
+            for (size_t n = 0; n < nterms && process < 0; ++n)
+                process = tensors_[n].BT().block_owner(
+                    gather_key(uik, term_pos[n]));
+            for (size_t n = 0; n < nterms; ++n)
+                needs[n].push_back(
+                    std::make_pair(process, gather_key(uik, term_pos[n])));
+        }
+        for (size_t n = 0; n < nterms; ++n)
+            received[n] = tensors_[n].BT().exchange_blocks(needs[n]);
+    }
 
     // Setup and perform contractions
     for (const std::vector<size_t> &uik : unique_indices_keys)
     {
+        if (distributed)
+        {
+            int process = -1;
+            for (size_t n = 0; n < nterms && process < 0; ++n)
+                process = tensors_[n].BT().block_owner(
+                    gather_key(uik, term_pos[n]));
+            if (process != settings::rank)
+                continue;
+        }
 
         bool do_contract = true;
         // In expert mode if a contraction cannot be performed
@@ -1836,11 +2808,7 @@ LabeledBlockedTensorProduct::operator double() const
             for (size_t n = 0; n < nterms; ++n)
             {
                 const LabeledBlockedTensor &lbt = tensors_[n];
-                std::vector<size_t> term_key;
-                for (const std::string &index : lbt.indices())
-                {
-                    term_key.push_back(uik[index_map[index]]);
-                }
+                std::vector<size_t> term_key = gather_key(uik, term_pos[n]);
                 if (not lbt.BT().is_block(term_key))
                     do_contract = false;
             }
@@ -1852,12 +2820,11 @@ LabeledBlockedTensorProduct::operator double() const
             for (size_t n = 0; n < nterms; ++n)
             {
                 const LabeledBlockedTensor &lbt = tensors_[n];
-                std::vector<size_t> term_key;
-                for (const std::string &index : lbt.indices())
-                {
-                    term_key.push_back(uik[index_map[index]]);
-                }
-                const LabeledTensor term(lbt.BT().block(term_key),
+                std::vector<size_t> term_key = gather_key(uik, term_pos[n]);
+                auto it = received[n].find(term_key);
+                const LabeledTensor term(it != received[n].end()
+                                             ? it->second
+                                             : lbt.BT().block(term_key),
                                          lbt.indices(), lbt.factor());
                 prod *= term;
             }
@@ -1865,7 +2832,7 @@ LabeledBlockedTensorProduct::operator double() const
         }
     }
 
-    return result;
+    return distributed ? reduce_over_processes(result, false) : result;
 }
 
 pair<double, double> LabeledBlockedTensorProduct::compute_contraction_cost(
@@ -1882,100 +2849,149 @@ pair<double, double> LabeledBlockedTensorProduct::compute_contraction_cost(
         Indices second = tensors_[perm[i]].indices();
         std::sort(first.begin(), first.end());
         std::sort(second.begin(), second.end());
-        Indices common, first_unique, second_unique;
 
-        // cannot use common.begin() here, need to use back_inserter() because
-        // common.begin() of an
-        // empty vector is not a valid output iterator
-        std::set_intersection(first.begin(), first.end(), second.begin(),
-                              second.end(), back_inserter(common));
+        pair<double, double> cost = compute_pair_contraction_cost(
+            first, second, unique_indices_keys, index_map, full_contraction);
+        cpu_cost_total += cost.first;
+        memory_cost_max = std::max({memory_cost_max, cost.second});
+
+        Indices first_unique, second_unique;
         std::set_difference(first.begin(), first.end(), second.begin(),
                             second.end(), back_inserter(first_unique));
         std::set_difference(second.begin(), second.end(), first.begin(),
                             first.end(), back_inserter(second_unique));
+        Indices stored_indices(first_unique);
+        stored_indices.insert(stored_indices.end(), second_unique.begin(),
+                              second_unique.end());
+        first = stored_indices;
+    }
 
-        Indices all = common;
-        all.insert(all.end(), first_unique.begin(), first_unique.end());
-        all.insert(all.end(), second_unique.begin(), second_unique.end());
+    return std::make_pair(cpu_cost_total, memory_cost_max);
+}
 
-        std::vector<std::vector<size_t>> sub_uiks;
-        if (full_contraction) {
-            sub_uiks = BlockedTensor::label_to_block_keys(all);
-        } else {
-            size_t max_path = 1;
-            for (const auto &index : all) {
-                max_path *= BlockedTensor::index_to_mo_spaces_[index].size();
-            }
-            std::set<std::vector<size_t>> set_uiks;
-            std::vector<size_t> sub_indices;
-            for (const std::string &s : common) {
-                sub_indices.push_back(index_map.at(s));
-            }
-            for (const std::string &s : first_unique) {
-                sub_indices.push_back(index_map.at(s));
-            }
-            for (const std::string &s : second_unique) {
-                sub_indices.push_back(index_map.at(s));
-            }
-            for (const std::vector<size_t> &uik : unique_indices_keys) {
-                std::vector<size_t> new_uik;
-                for (size_t i : sub_indices) {
-                    new_uik.push_back(uik[i]);
-                }
-                set_uiks.insert(new_uik);
-                if (set_uiks.size() == max_path)
-                    break;
-            }
-            sub_uiks.reserve(set_uiks.size());
-            for (const auto &uik : set_uiks) {
-                sub_uiks.push_back(uik);
-            }
-        }
+pair<double, double> LabeledBlockedTensorProduct::compute_pair_contraction_cost(
+    const Indices &first, const Indices &second,
+    const std::vector<std::vector<size_t>> &unique_indices_keys,
+    const std::map<std::string, size_t> &index_map,
+    bool full_contraction) const
+{
+    Indices common, first_unique, second_unique;
 
-        size_t common_max = common.size();
-        size_t first_unique_max = common_max + first_unique.size();
-        size_t second_unique_max = first_unique_max + second_unique.size();
+    // cannot use common.begin() here, need to use back_inserter() because
+    // common.begin() of an
+    // empty vector is not a valid output iterator
+    std::set_intersection(first.begin(), first.end(), second.begin(),
+                          second.end(), back_inserter(common));
+    std::set_difference(first.begin(), first.end(), second.begin(),
+                        second.end(), back_inserter(first_unique));
+    std::set_difference(second.begin(), second.end(), first.begin(),
+                        first.end(), back_inserter(second_unique));
 
-        double cpu_cost = 0.0, memory_cost = 0.0;
-        for (const std::vector<size_t> &uik : sub_uiks) {
-            size_t j = 0;
-            double common_size = 1.0;
-            while (j < common_max) {
-                common_size *= BlockedTensor::mo_space(uik[j++]).dim();
-            }
-            double first_unique_size = 1.0;
-            while (j < first_unique_max) {
-                first_unique_size *= BlockedTensor::mo_space(uik[j++]).dim();
-            }
-            double second_unique_size = 1.0;
-            while (j < second_unique_max) {
-                second_unique_size *= BlockedTensor::mo_space(uik[j++]).dim();
-            }
+    Indices all = common;
+    all.insert(all.end(), first_unique.begin(), first_unique.end());
+    all.insert(all.end(), second_unique.begin(), second_unique.end());
 
-            cpu_cost += common_size * first_unique_size * second_unique_size;
-            memory_cost += common_size * first_unique_size
-                         + common_size * second_unique_size
-                         + first_unique_size * second_unique_size;
+    std::vector<std::vector<size_t>> sub_uiks;
+    if (full_contraction) {
+        sub_uiks = BlockedTensor::label_to_block_keys(all);
+    } else {
+        size_t max_path = 1;
+        for (const auto &index : all) {
+            max_path *= BlockedTensor::context()->index_to_mo_spaces[index].size();
+        }
+        std::set<std::vector<size_t>> set_uiks;
+        std::vector<size_t> sub_indices;
+        for (const std::string &s : common) {
+            sub_indices.push_back(index_map.at(s));
+        }
+        for (const std::string &s : first_unique) {
+            sub_indices.push_back(index_map.at(s));
+        }
+        for (const std::string &s : second_unique) {
+            sub_indices.push_back(index_map.at(s));
+        }
+        for (const std::vector<size_t> &uik : unique_indices_keys) {
+            std::vector<size_t> new_uik;
+            for (size_t i : sub_indices) {
+                new_uik.push_back(uik[i]);
+            }
+            set_uiks.insert(new_uik);
+            if (set_uiks.size() == max_path)
+                break;
+        }
+        sub_uiks.reserve(set_uiks.size());
+        for (const auto &uik : set_uiks) {
+            sub_uiks.push_back(uik);
         }
+    }
 
-        Indices stored_indices(first_unique);
-        stored_indices.insert(stored_indices.end(), second_unique.begin(),
-                              second_unique.end());
+    size_t common_max = common.size();
+    size_t first_unique_max = common_max + first_unique.size();
+    size_t second_unique_max = first_unique_max + second_unique.size();
 
-        cpu_cost_total += cpu_cost;
-        memory_cost_max = std::max({memory_cost_max, memory_cost});
+    double cpu_cost = 0.0, memory_cost = 0.0;
+    for (const std::vector<size_t> &uik : sub_uiks) {
+        size_t j = 0;
+        double common_size = 1.0;
+        while (j < common_max) {
+            common_size *= BlockedTensor::mo_space(uik[j++]).dim();
+        }
+        double first_unique_size = 1.0;
+        while (j < first_unique_max) {
+            first_unique_size *= BlockedTensor::mo_space(uik[j++]).dim();
+        }
+        double second_unique_size = 1.0;
+        while (j < second_unique_max) {
+            second_unique_size *= BlockedTensor::mo_space(uik[j++]).dim();
+        }
 
-        first = stored_indices;
+        cpu_cost += common_size * first_unique_size * second_unique_size;
+        memory_cost += common_size * first_unique_size
+                     + common_size * second_unique_size
+                     + first_unique_size * second_unique_size;
     }
 
-    std::vector<std::string> vec_str;
-    for (size_t i : perm)
+    return std::make_pair(cpu_cost, memory_cost);
+}
+
+vector<size_t> LabeledBlockedTensorProduct::optimal_order(
+    const Indices &result,
+    const std::vector<std::vector<size_t>> &unique_indices_keys,
+    const std::map<std::string, size_t> &index_map,
+    bool full_contraction) const
+{
+    size_t nterms = tensors_.size();
+    vector<Indices> terms;
+    for (const LabeledBlockedTensor &lbt : tensors_)
+        terms.push_back(lbt.indices());
+
+    contraction_path::PairCost cost = [&](const Indices &first,
+                                          const Indices &second,
+                                          const Indices &) {
+        return compute_pair_contraction_cost(first, second, unique_indices_keys,
+                                             index_map, full_contraction);
+    };
+
+    // The search is only memoized when every block combination exists, since
+    // the cost then depends on nothing but the labels and the MO spaces
+    contraction_path::Path path;
+    if (full_contraction)
     {
-        vec_str.push_back(tensors_[i].str());
+        std::string key = indices::to_string(result) + "=";
+        for (const Indices &term : terms)
+            key += "|" + indices::to_string(term);
+        key += "|";
+        for (size_t n = 0; n < BlockedTensor::context()->mo_spaces.size(); ++n)
+            key += std::to_string(BlockedTensor::mo_space(n).dim()) + ",";
+        path = contraction_path::optimize_cached(key, terms, result, cost,
+                                                 true);
+    }
+    else
+    {
+        path = contraction_path::optimize(terms, result, cost, true);
     }
 
-    return std::make_pair(cpu_cost_total, memory_cost_max);
-
+    return contraction_path::chain_order(path, nterms);
 }
 
 std::vector<std::string> spin_cases(const std::vector<std::string> &in_str_vec)
@@ -2010,4 +3026,9 @@ LabeledBlockedTensorBatchedProduct batched(const string &batched_indices, const
     return LabeledBlockedTensorBatchedProduct(product, indices::split(batched_indices));
 }
 
+LabeledBlockedTensorBatchedProduct batched(const LabeledBlockedTensorProduct &product)
+{
+    return LabeledBlockedTensorBatchedProduct(product, Indices());
+}
+
 }
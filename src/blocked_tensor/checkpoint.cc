@@ -0,0 +1,577 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <ambit/blocked_tensor.h>
+#include <ambit/sym_blocked_tensor.h>
+#include <ambit/io/hdf5/dataset.h>
+#include <ambit/io/hdf5/dataspace.h>
+#include <ambit/io/hdf5/group.h>
+#include <ambit/settings.h>
+#include <ambit/timer.h>
+
+#include "checkpoint.h"
+
+namespace ambit
+{
+
+namespace checkpoint
+{
+
+std::recursive_mutex &hdf5_mutex()
+{
+    static std::recursive_mutex mutex;
+    return mutex;
+}
+
+void write_attribute(hid_t id, const string &name, const string &value)
+{
+    if (H5Aexists(id, name.c_str()) > 0)
+        H5Adelete(id, name.c_str());
+
+    hid_t type = H5Tcopy(H5T_C_S1);
+    H5Tset_size(type, std::max<size_t>(value.size(), 1L));
+    hid_t space = H5Screate(H5S_SCALAR);
+    hid_t attribute =
+        H5Acreate2(id, name.c_str(), type, space, H5P_DEFAULT, H5P_DEFAULT);
+    herr_t status = H5Awrite(attribute, type, value.c_str());
+    H5Aclose(attribute);
+    H5Sclose(space);
+    H5Tclose(type);
+    if (attribute < 0 || status < 0)
+        throw std::runtime_error("Unable to write the attribute \"" + name +
+                                 "\"");
+}
+
+string read_attribute(hid_t id, const string &name)
+{
+    if (H5Aexists(id, name.c_str()) <= 0)
+        throw std::runtime_error("The checkpoint has no attribute \"" + name +
+                                 "\"");
+
+    hid_t attribute = H5Aopen(id, name.c_str(), H5P_DEFAULT);
+    hid_t type = H5Aget_type(attribute);
+    size_t size = H5Tget_size(type);
+    vector<char> value(size + 1, '\0');
+    H5Aread(attribute, type, value.data());
+    H5Tclose(type);
+    H5Aclose(attribute);
+    return string(value.data());
+}
+
+void write_vector(const io::hdf5::Location &location, const string &name,
+                  const vector<long> &values)
+{
+    if (location.has_link(name))
+        H5Ldelete(location.id(), name.c_str(), H5P_DEFAULT);
+
+    io::hdf5::Dataspace space(Dimension{values.size()});
+    io::hdf5::Dataset<long> set(location, name, space);
+    set.write(values);
+}
+
+vector<long> read_vector(const io::hdf5::Location &location,
+                         const string &name)
+{
+    if (!location.has_link(name))
+        throw std::runtime_error("The checkpoint has no dataset \"" + name +
+                                 "\"");
+    io::hdf5::Dataset<long> set(location, name);
+    vector<long> values;
+    set.read(values);
+    return values;
+}
+
+void write_block(const io::hdf5::Location &location, const string &label,
+                 const Tensor &block, const map<string, string> &attributes)
+{
+    if (location.has_link(label))
+    {
+        io::hdf5::Dataset<double> set(location, label);
+        if (set.dims() == block.dims())
+        {
+            set.write(block);
+            for (const auto &attribute : attributes)
+                write_attribute(set.id(), attribute.first, attribute.second);
+            return;
+        }
+        set.close();
+        H5Ldelete(location.id(), label.c_str(), H5P_DEFAULT);
+    }
+
+    io::hdf5::Dataspace space(block);
+    io::hdf5::Dataset<double> set(location, label, space);
+    set.write(block);
+    for (const auto &attribute : attributes)
+        write_attribute(set.id(), attribute.first, attribute.second);
+}
+
+vector<string> blocks(const io::hdf5::Location &location,
+                      const string &attribute)
+{
+    vector<string> labels;
+    hsize_t count = 0;
+    H5Gget_num_objs(location.id(), &count);
+    for (hsize_t n = 0; n < count; ++n)
+    {
+        ssize_t size = H5Lget_name_by_idx(location.id(), ".", H5_INDEX_NAME,
+                                          H5_ITER_INC, n, nullptr, 0,
+                                          H5P_DEFAULT);
+        vector<char> name(static_cast<size_t>(size) + 1, '\0');
+        H5Lget_name_by_idx(location.id(), ".", H5_INDEX_NAME, H5_ITER_INC, n,
+                           name.data(), name.size(), H5P_DEFAULT);
+        if (H5Aexists_by_name(location.id(), name.data(), attribute.c_str(),
+                              H5P_DEFAULT) > 0)
+            labels.push_back(name.data());
+    }
+    return labels;
+}
+
+Tensor read_block(const io::hdf5::Location &location, const string &label,
+                  const string &name, TensorType type)
+{
+    io::hdf5::Dataset<double> set(location, label);
+    Dimension dims = set.dims();
+
+    if (type == CoreTensor)
+    {
+        // Read on first use, through a handle of its own: the file may have
+        // been closed by then
+        ssize_t size = H5Fget_name(set.id(), nullptr, 0);
+        vector<char> filename(static_cast<size_t>(size) + 1, '\0');
+        H5Fget_name(set.id(), filename.data(), filename.size());
+        size = H5Iget_name(set.id(), nullptr, 0);
+        vector<char> path(static_cast<size_t>(size) + 1, '\0');
+        H5Iget_name(set.id(), path.data(), path.size());
+
+        string file(filename.data());
+        string dataset(path.data());
+        return Tensor::build_deferred(name, dims, [file, dataset](double *data) {
+            std::lock_guard<std::recursive_mutex> lock(hdf5_mutex());
+            hid_t fid = H5Fopen(file.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+            hid_t did = fid < 0 ? -1 : H5Dopen2(fid, dataset.c_str(),
+                                                H5P_DEFAULT);
+            herr_t status = did < 0 ? -1
+                                    : H5Dread(did, H5T_NATIVE_DOUBLE, H5S_ALL,
+                                              H5S_ALL, H5P_DEFAULT, data);
+            if (did >= 0)
+                H5Dclose(did);
+            if (fid >= 0)
+                H5Fclose(fid);
+            if (status < 0)
+                throw std::runtime_error("Unable to read the block \"" +
+                                         dataset + "\" of \"" + file + "\"");
+        });
+    }
+
+    Tensor block = Tensor::build(type, name, dims);
+    set.read(block);
+    return block;
+}
+
+std::future<void>
+save_async(const string &filename, const string &group,
+           const function<void(const io::hdf5::Location &)> &save)
+{
+    return std::async(std::launch::async, [filename, group, save]() {
+        if (settings::rank != 0)
+            return;
+
+        std::lock_guard<std::recursive_mutex> lock(hdf5_mutex());
+        AMBIT_TIMER_PUSH("checkpoint::save_async");
+        // A file of this process alone, whatever the number of processes
+        bool exists = std::ifstream(filename).good();
+        hid_t file =
+            exists ? H5Fopen(filename.c_str(), H5F_ACC_RDWR, H5P_DEFAULT)
+                   : H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
+                               H5P_DEFAULT);
+        if (file < 0)
+        {
+            AMBIT_TIMER_POP();
+            throw std::runtime_error("Unable to open \"" + filename + "\"");
+        }
+        try
+        {
+            io::hdf5::Location root(file);
+            if (group.empty())
+                save(root);
+            else
+                save(root.group(group));
+        }
+        catch (...)
+        {
+            H5Fclose(file);
+            AMBIT_TIMER_POP();
+            throw;
+        }
+        H5Fclose(file);
+        AMBIT_TIMER_POP();
+    });
+}
+
+string join(const vector<string> &names)
+{
+    string joined;
+    for (size_t n = 0; n < names.size(); ++n)
+        joined += (n ? "," : "") + names[n];
+    return joined;
+}
+
+vector<string> split(const string &names)
+{
+    vector<string> result;
+    std::stringstream ss(names);
+    string name;
+    while (std::getline(ss, name, ','))
+        result.push_back(name);
+    return result;
+}
+}
+
+// => BlockedTensor <= //
+
+void BlockedTensor::save(const io::hdf5::Location &location) const
+{
+    if (block_distributed())
+        throw std::runtime_error("BlockedTensor::save: \"" + name_ +
+                                 "\" is block distributed");
+
+    std::lock_guard<std::recursive_mutex> lock(checkpoint::hdf5_mutex());
+    AMBIT_TIMER_PUSH("BlockedTensor::save");
+
+    checkpoint::write_attribute(location.id(), "name", name_);
+
+    std::set<size_t> spaces;
+    for (const auto &key_tensor : blocks_)
+        spaces.insert(key_tensor.first.begin(), key_tensor.first.end());
+    io::hdf5::Group space_group = location.group("mo_spaces");
+    for (size_t ms : spaces)
+    {
+        const MOSpace &space = context()->mo_spaces[ms];
+        io::hdf5::Group group = space_group.group(space.name());
+        checkpoint::write_attribute(group.id(), "indices",
+                                    checkpoint::join(space.mo_indices()));
+        checkpoint::write_vector(group, "mos", vector<long>(space.mos().begin(),
+                                                            space.mos().end()));
+        vector<SpinType> spin = space.spin();
+        checkpoint::write_vector(group, "spin",
+                                 vector<long>(spin.begin(), spin.end()));
+    }
+
+    for (const auto &key_tensor : blocks_)
+    {
+        vector<string> names;
+        string label;
+        for (size_t ms : key_tensor.first)
+        {
+            names.push_back(context()->mo_spaces[ms].name());
+            label += context()->mo_spaces[ms].name();
+        }
+        map<string, string> attributes = {{"spaces", checkpoint::join(names)}};
+        // An alias is saved as a reference to the block it shares
+        if (is_alias(key_tensor.first))
+        {
+            vector<size_t> flipped = spin_flipped_key(key_tensor.first);
+            vector<string> partner;
+            for (size_t ms : flipped)
+                partner.push_back(context()->mo_spaces[ms].name());
+            checkpoint::write_vector(location, label, {});
+            attributes["alias"] = checkpoint::join(partner);
+            io::hdf5::Dataset<long> set(location, label);
+            for (const auto &attribute : attributes)
+                checkpoint::write_attribute(set.id(), attribute.first,
+                                            attribute.second);
+            continue;
+        }
+        checkpoint::write_block(location, label, key_tensor.second,
+                                attributes);
+    }
+
+    AMBIT_TIMER_POP();
+}
+
+std::future<void> BlockedTensor::save_async(const std::string &filename,
+                                            const std::string &group) const
+{
+    if (block_distributed())
+        throw std::runtime_error("BlockedTensor::save_async: \"" + name_ +
+                                 "\" is block distributed");
+
+    // The snapshot owns copies of the blocks, aliases included
+    BlockedTensor snapshot(*this);
+    for (auto &key_tensor : snapshot.blocks_)
+    {
+        TensorType type = key_tensor.second.type();
+        if (type != CoreTensor && type != DiskTensor)
+            throw std::runtime_error(
+                "BlockedTensor::save_async: only CoreTensor and DiskTensor "
+                "blocks can be saved in the background");
+        if (!snapshot.is_alias(key_tensor.first))
+            key_tensor.second = key_tensor.second.clone();
+    }
+    for (const std::vector<size_t> &key : snapshot.aliases_)
+        snapshot.blocks_[key] = snapshot.blocks_[spin_flipped_key(key)];
+
+    return checkpoint::save_async(
+        filename, group,
+        [snapshot](const io::hdf5::Location &location) {
+            snapshot.save(location);
+        });
+}
+
+BlockedTensor BlockedTensor::load(const io::hdf5::Location &location,
+                                  TensorType type)
+{
+    std::lock_guard<std::recursive_mutex> lock(checkpoint::hdf5_mutex());
+    AMBIT_TIMER_PUSH("BlockedTensor::load");
+
+    BlockedTensor newObject;
+    newObject.set_name(checkpoint::read_attribute(location.id(), "name"));
+
+    // Define the MO spaces, or check them against the current ones
+    io::hdf5::Group space_group = location.group("mo_spaces");
+    for (const string &label : checkpoint::blocks(location, "spaces"))
+    {
+        io::hdf5::Dataset<double> set(location, label);
+        for (const string &space :
+             checkpoint::split(checkpoint::read_attribute(set.id(), "spaces")))
+        {
+            io::hdf5::Group group = space_group.group(space);
+            vector<long> mos = checkpoint::read_vector(group, "mos");
+            vector<long> spin = checkpoint::read_vector(group, "spin");
+            if (context()->name_to_mo_space.count(space) == 0)
+            {
+                std::vector<std::pair<size_t, SpinType>> mo_spin;
+                for (size_t n = 0; n < mos.size(); ++n)
+                    mo_spin.push_back(
+                        {static_cast<size_t>(mos[n]),
+                         static_cast<SpinType>(spin[n])});
+                add_mo_space(space,
+                             checkpoint::read_attribute(group.id(), "indices"),
+                             mo_spin);
+                continue;
+            }
+            const MOSpace &current = context()->mo_spaces[context()->name_to_mo_space[space]];
+            vector<SpinType> current_spin = current.spin();
+            if (vector<long>(current.mos().begin(), current.mos().end()) !=
+                    mos ||
+                vector<long>(current_spin.begin(), current_spin.end()) != spin)
+            {
+                AMBIT_TIMER_POP();
+                throw std::runtime_error(
+                    "BlockedTensor::load: the MO space \"" + space +
+                    "\" differs from the one \"" + newObject.name_ +
+                    "\" was saved with");
+            }
+        }
+    }
+
+    map<string, vector<size_t>> keys;
+    for (const string &label : checkpoint::blocks(location, "spaces"))
+    {
+        string spaces, alias;
+        {
+            io::hdf5::Dataset<double> set(location, label);
+            spaces = checkpoint::read_attribute(set.id(), "spaces");
+            if (H5Aexists(set.id(), "alias") > 0)
+                alias = checkpoint::read_attribute(set.id(), "alias");
+        }
+        vector<size_t> key;
+        for (const string &space : checkpoint::split(spaces))
+            key.push_back(context()->name_to_mo_space[space]);
+        newObject.rank_ = key.size();
+        if (!alias.empty())
+        {
+            newObject.aliases_.insert(key);
+            continue;
+        }
+        newObject.blocks_[key] = checkpoint::read_block(
+            location, label, newObject.name_ + "[" + label + "]", type);
+    }
+    for (const vector<size_t> &key : newObject.aliases_)
+        newObject.blocks_[key] = newObject.blocks_.at(spin_flipped_key(key));
+
+    AMBIT_TIMER_POP();
+    return newObject;
+}
+
+// => SymBlockedTensor <= //
+
+void SymBlockedTensor::save(const io::hdf5::Location &location) const
+{
+    std::lock_guard<std::recursive_mutex> lock(checkpoint::hdf5_mutex());
+    AMBIT_TIMER_PUSH("SymBlockedTensor::save");
+
+    checkpoint::write_attribute(location.id(), "name", name_);
+    checkpoint::write_attribute(location.id(), "symmetry",
+                                std::to_string(symmetry_));
+
+    std::set<size_t> spaces;
+    for (const auto &key_tensor : blocks_)
+        for (const std::pair<size_t, int> &ms_h : key_tensor.first)
+            spaces.insert(ms_h.first);
+    io::hdf5::Group space_group = location.group("mo_spaces");
+    for (size_t ms : spaces)
+    {
+        const SymMOSpace &space = context()->mo_spaces[ms];
+        io::hdf5::Group group = space_group.group(space.name());
+        checkpoint::write_attribute(group.id(), "indices",
+                                    checkpoint::join(space.mo_indices()));
+        checkpoint::write_attribute(group.id(), "nirrep",
+                                    std::to_string(space.nirrep()));
+        vector<long> mos, irreps;
+        for (const std::pair<size_t, int> &mo_h : space.mos())
+        {
+            mos.push_back(static_cast<long>(mo_h.first));
+            irreps.push_back(mo_h.second);
+        }
+        checkpoint::write_vector(group, "mos", mos);
+        checkpoint::write_vector(group, "irreps", irreps);
+        vector<SpinType> spin = space.spin();
+        checkpoint::write_vector(group, "spin",
+                                 vector<long>(spin.begin(), spin.end()));
+    }
+
+    for (const auto &key_tensor : blocks_)
+    {
+        vector<string> names, irreps;
+        for (const std::pair<size_t, int> &ms_h : key_tensor.first)
+        {
+            names.push_back(context()->mo_spaces[ms_h.first].name());
+            irreps.push_back(std::to_string(ms_h.second));
+        }
+        checkpoint::write_block(location, block_label(key_tensor.first),
+                                key_tensor.second,
+                                {{"spaces", checkpoint::join(names)},
+                                 {"irreps", checkpoint::join(irreps)}});
+    }
+
+    AMBIT_TIMER_POP();
+}
+
+std::future<void>
+SymBlockedTensor::save_async(const std::string &filename,
+                             const std::string &group) const
+{
+    SymBlockedTensor snapshot(*this);
+    for (auto &key_tensor : snapshot.blocks_)
+    {
+        TensorType type = key_tensor.second.type();
+        if (type != CoreTensor && type != DiskTensor)
+            throw std::runtime_error(
+                "SymBlockedTensor::save_async: only CoreTensor and "
+                "DiskTensor blocks can be saved in the background");
+        key_tensor.second = key_tensor.second.clone();
+    }
+
+    return checkpoint::save_async(
+        filename, group,
+        [snapshot](const io::hdf5::Location &location) {
+            snapshot.save(location);
+        });
+}
+
+SymBlockedTensor SymBlockedTensor::load(const io::hdf5::Location &location,
+                                        TensorType type)
+{
+    std::lock_guard<std::recursive_mutex> lock(checkpoint::hdf5_mutex());
+    AMBIT_TIMER_PUSH("SymBlockedTensor::load");
+
+    SymBlockedTensor newObject;
+    newObject.set_name(checkpoint::read_attribute(location.id(), "name"));
+    newObject.symmetry_ =
+        std::stoi(checkpoint::read_attribute(location.id(), "symmetry"));
+
+    io::hdf5::Group space_group = location.group("mo_spaces");
+    for (const string &label : checkpoint::blocks(location, "spaces"))
+    {
+        vector<string> spaces, irreps;
+        {
+            io::hdf5::Dataset<double> set(location, label);
+            spaces = checkpoint::split(
+                checkpoint::read_attribute(set.id(), "spaces"));
+            irreps = checkpoint::split(
+                checkpoint::read_attribute(set.id(), "irreps"));
+        }
+
+        SymBlockKey key;
+        for (size_t n = 0; n < spaces.size(); ++n)
+        {
+            const string &space = spaces[n];
+            io::hdf5::Group group = space_group.group(space);
+            vector<long> mos = checkpoint::read_vector(group, "mos");
+            vector<long> mo_irreps = checkpoint::read_vector(group, "irreps");
+            vector<long> spin = checkpoint::read_vector(group, "spin");
+            int nirrep =
+                std::stoi(checkpoint::read_attribute(group.id(), "nirrep"));
+            std::vector<std::pair<size_t, int>> mo_h;
+            for (size_t m = 0; m < mos.size(); ++m)
+                mo_h.push_back({static_cast<size_t>(mos[m]),
+                                static_cast<int>(mo_irreps[m])});
+
+            if (context()->name_to_mo_space.count(space) == 0)
+            {
+                add_mo_space(space,
+                             checkpoint::read_attribute(group.id(), "indices"),
+                             nirrep, mo_h,
+                             spin.empty() ? AlphaSpin
+                                          : static_cast<SpinType>(spin[0]));
+            }
+            else
+            {
+                const SymMOSpace &current =
+                    context()->mo_spaces[context()->name_to_mo_space[space]];
+                vector<SpinType> current_spin = current.spin();
+                if (current.mos() != mo_h || current.nirrep() != nirrep ||
+                    vector<long>(current_spin.begin(), current_spin.end()) !=
+                        spin)
+                {
+                    AMBIT_TIMER_POP();
+                    throw std::runtime_error(
+                        "SymBlockedTensor::load: the MO space \"" + space +
+                        "\" differs from the one \"" + newObject.name_ +
+                        "\" was saved with");
+                }
+            }
+            key.push_back({context()->name_to_mo_space[space], std::stoi(irreps[n])});
+        }
+
+        newObject.rank_ = key.size();
+        newObject.blocks_[key] = checkpoint::read_block(
+            location, label, newObject.name_ + "[" + label + "]", type);
+        newObject.block_labels_.push_back(label);
+    }
+
+    AMBIT_TIMER_POP();
+    return newObject;
+}
+}
@@ -0,0 +1,98 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#if !defined(BLOCKED_TENSOR_CHECKPOINT_H)
+#define BLOCKED_TENSOR_CHECKPOINT_H
+
+#include <future>
+#include <mutex>
+
+#include <ambit/tensor.h>
+#include <ambit/io/hdf5/location.h>
+
+namespace ambit
+{
+
+// => Checkpoints of Blocked Tensors <= //
+
+/**
+ * The HDF5 layout shared by BlockedTensor::save and SymBlockedTensor::save.
+ *
+ * A tensor is a location holding one dataset per block, named by the block
+ * label and carrying the names of its MO spaces (and irreps) as attributes,
+ * and a group "mo_spaces" with a group per MO space: its orbitals, their
+ * spins (and irreps), and the space indices as an attribute.
+ */
+namespace checkpoint
+{
+
+/// Serializes the HDF5 calls of saves, background saves and the first-use
+/// reads of loaded blocks, as the HDF5 library is not thread safe. It is
+/// recursive, as saving a loaded block may read it first.
+std::recursive_mutex &hdf5_mutex();
+
+/// Writes a string attribute of the object id, replacing an old one
+void write_attribute(hid_t id, const string &name, const string &value);
+/// @return The string attribute name of the object id
+string read_attribute(hid_t id, const string &name);
+
+/// Writes a vector of integers as the dataset name of location
+void write_vector(const io::hdf5::Location &location, const string &name,
+                  const vector<long> &values);
+/// @return The vector of integers in the dataset name of location
+vector<long> read_vector(const io::hdf5::Location &location,
+                         const string &name);
+
+/// Writes block as the dataset label of location, with the string
+/// attributes; a dataset of the same shape is overwritten in place
+void write_block(const io::hdf5::Location &location, const string &label,
+                 const Tensor &block, const map<string, string> &attributes);
+
+/// @return The names of the datasets of location that have attribute
+vector<string> blocks(const io::hdf5::Location &location,
+                      const string &attribute);
+
+/// @return The dataset label of location as a tensor of type named name
+/// (CoreTensor's are read on first use)
+Tensor read_block(const io::hdf5::Location &location, const string &label,
+                  const string &name, TensorType type);
+
+/// Runs save on the group of an HDF5 file (created if needed, the root if
+/// empty) in the background, on the first process only
+std::future<void>
+save_async(const string &filename, const string &group,
+           const function<void(const io::hdf5::Location &)> &save);
+
+/// Joins names with commas, and splits them back
+string join(const vector<string> &names);
+vector<string> split(const string &names);
+}
+}
+
+#endif
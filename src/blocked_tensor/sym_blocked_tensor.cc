@@ -28,23 +28,42 @@
  */
 
 #include <cmath>
+#include <exception>
 #include <stdexcept>
 #include <string>
 #include <algorithm>
+#include <set>
 #include <ambit/sym_blocked_tensor.h>
 #include <tensor/indices.h>
+#include <tensor/threads.h>
 
 namespace ambit
 {
 
-// Static members of SymBlockedTensor
-std::vector<SymMOSpace> SymBlockedTensor::mo_spaces_;
-std::map<std::string, size_t> SymBlockedTensor::name_to_mo_space_;
-std::map<std::string, std::vector<size_t>>
-    SymBlockedTensor::composite_name_to_mo_spaces_;
-std::map<std::string, std::vector<size_t>> SymBlockedTensor::index_to_mo_spaces_;
+namespace
+{
+
+/// The MO spaces of the threads that did not set a context of their own
+const std::shared_ptr<SymMOSpaceContext> default_context =
+    std::make_shared<SymMOSpaceContext>();
 
-bool SymBlockedTensor::expert_mode_ = false;
+/// The context set on this thread, if any
+thread_local std::shared_ptr<SymMOSpaceContext> thread_context;
+
+} // anonymous namespace
+
+const std::shared_ptr<SymMOSpaceContext> &SymBlockedTensor::context()
+{
+    return thread_context ? thread_context : default_context;
+}
+
+std::shared_ptr<SymMOSpaceContext>
+SymBlockedTensor::set_context(const std::shared_ptr<SymMOSpaceContext> &context)
+{
+    std::shared_ptr<SymMOSpaceContext> previous = thread_context;
+    thread_context = context;
+    return previous;
+}
 
 SymMOSpace::SymMOSpace(const std::string &name, const std::string &mo_indices, int nirrep,
                  std::vector<std::pair<size_t,int>> mos, SpinType spin)
@@ -58,6 +77,12 @@ SymMOSpace::SymMOSpace(const std::string &name, const std::string &mo_indices, i
     {
         size_t mo = mo_sym.first;
         int sym = mo_sym.second;
+        if (sym < 0 || sym >= nirrep_)
+        {
+            throw std::runtime_error("The MO " + std::to_string(mo) +
+                                     " of space \"" + name +
+                                     "\" has an irrep out of range.");
+        }
         mos_map_.push_back(std::make_pair(sym,mos_sym_[sym].size()));
         mos_sym_[sym].push_back(mo);
     }
@@ -108,30 +133,30 @@ void SymBlockedTensor::add_mo_space(const std::string &name,
         throw std::runtime_error(
             "No MO indices were specified for the MO space \"" + name + "\"");
     }
-    if (name_to_mo_space_.count(name) != 0)
+    if (context()->name_to_mo_space.count(name) != 0)
     {
         throw std::runtime_error("The MO space \"" + name +
                                  "\" is already defined.");
     }
 
-    size_t mo_space_idx = mo_spaces_.size();
+    size_t mo_space_idx = context()->mo_spaces.size();
 
     SymMOSpace ms(name, mo_indices, nirrep, mos, spin);
     // Add the MOSpace object
-    mo_spaces_.push_back(ms);
+    context()->mo_spaces.push_back(ms);
 
     // Link the name to the mo_space_ vector
-    name_to_mo_space_[name] = mo_space_idx;
+    context()->name_to_mo_space[name] = mo_space_idx;
 
     // Link the composite name to the mo_space_ vector
-    composite_name_to_mo_spaces_[name] = {mo_space_idx};
+    context()->composite_name_to_mo_spaces[name] = {mo_space_idx};
 
     // Link the indices to the mo_space_
     for (const std::string &mo_index : indices::split(mo_indices))
     {
-        if (index_to_mo_spaces_.count(mo_index) == 0)
+        if (context()->index_to_mo_spaces.count(mo_index) == 0)
         {
-            index_to_mo_spaces_[mo_index] = {mo_space_idx};
+            context()->index_to_mo_spaces[mo_index] = {mo_space_idx};
         }
         else
         {
@@ -156,7 +181,7 @@ void SymBlockedTensor::add_composite_mo_space(
             "No MO indices were specified for the composite MO space \"" +
             name + "\"");
     }
-    if (name_to_mo_space_.count(name) != 0)
+    if (context()->name_to_mo_space.count(name) != 0)
     {
         throw std::runtime_error("The MO space \"" + name +
                                  "\" is already defined.");
@@ -166,24 +191,24 @@ void SymBlockedTensor::add_composite_mo_space(
     for (std::string subspace : subspaces)
     {
         // Is this simple MO space in our list of spaces?
-        if (name_to_mo_space_.count(subspace) == 0)
+        if (context()->name_to_mo_space.count(subspace) == 0)
         {
             throw std::runtime_error("The simple MO space \"" + subspace +
                                      "\" is not defined.");
         }
         else
         {
-            simple_spaces.push_back(name_to_mo_space_[subspace]);
+            simple_spaces.push_back(context()->name_to_mo_space[subspace]);
         }
     }
-    composite_name_to_mo_spaces_[name] = simple_spaces;
+    context()->composite_name_to_mo_spaces[name] = simple_spaces;
 
     // Link the indices to the mo_space_
     for (const std::string &mo_index : indices::split(mo_indices))
     {
-        if (index_to_mo_spaces_.count(mo_index) == 0)
+        if (context()->index_to_mo_spaces.count(mo_index) == 0)
         {
-            index_to_mo_spaces_[mo_index] = simple_spaces;
+            context()->index_to_mo_spaces[mo_index] = simple_spaces;
         }
         else
         {
@@ -196,118 +221,142 @@ void SymBlockedTensor::add_composite_mo_space(
 //void BlockedTensor::print_mo_spaces()
 //{
 //    printf("\n  List of Molecular Orbital Spaces:");
-//    for (size_t ms = 0; ms < mo_spaces_.size(); ++ms)
+//    for (size_t ms = 0; ms < context()->mo_spaces.size(); ++ms)
 //    {
-//        mo_spaces_[ms].print();
+//        context()->mo_spaces[ms].print();
 //    }
 //}
 
 void SymBlockedTensor::reset_mo_spaces()
 {
-    mo_spaces_.clear();
-    name_to_mo_space_.clear();
-    composite_name_to_mo_spaces_.clear();
-    index_to_mo_spaces_.clear();
+    context()->mo_spaces.clear();
+    context()->name_to_mo_space.clear();
+    context()->composite_name_to_mo_spaces.clear();
+    context()->index_to_mo_spaces.clear();
 }
 
-SymBlockedTensor::SymBlockedTensor() : rank_(0) {}
-
-//SymBlockedTensor SymBlockedTensor::build(TensorType type, const std::string &name,
-//                                   const std::vector<std::string> &blocks)
-//{
-//    SymBlockedTensor newObject;
+SymBlockedTensor::SymBlockedTensor() : rank_(0), symmetry_(0) {}
 
-//    newObject.set_name(name);
-//    newObject.rank_ = 0;
+SymBlockedTensor SymBlockedTensor::build(TensorType type,
+                                         const std::string &name,
+                                         const std::vector<std::string> &blocks,
+                                         int symmetry)
+{
+    SymBlockedTensor newObject;
 
-//    std::vector<std::vector<size_t>> tensor_blocks;
+    newObject.set_name(name);
+    newObject.rank_ = 0;
+    newObject.symmetry_ = symmetry;
 
-//    // This algorithm takes a vector of strings that define the blocks of this
-//    // tensor and unpacks them.
-//    // This may require taking composite spaces ("G" = {"O","V"}) and expanding
-//    // the string
-//    // "G,G" -> {"O,O" , "O,V" , "V,O" , "V,V"}.
-//    // The way we proceed is by forming partial strings that we keep expanding
-//    // as we
-//    // process all the indices.
+    // Expand composite spaces ("g" = {"o","v"}) into the simple ones, as in
+    // BlockedTensor::build
+    std::vector<std::vector<size_t>> tensor_blocks;
+    for (const std::string &this_block : blocks)
+    {
+        std::vector<std::vector<size_t>> final_blocks(1);
+        for (std::string mo_space_name : indices::split(this_block))
+        {
+            if (context()->composite_name_to_mo_spaces.count(mo_space_name) == 0)
+            {
+                throw std::runtime_error("The MO space \"" + mo_space_name +
+                                         "\" is not defined.");
+            }
+            std::vector<std::vector<size_t>> partial_blocks;
+            for (const std::vector<size_t> &block : final_blocks)
+            {
+                for (size_t mo_space_idx :
+                     context()->composite_name_to_mo_spaces[mo_space_name])
+                {
+                    std::vector<size_t> new_block(block);
+                    new_block.push_back(mo_space_idx);
+                    partial_blocks.push_back(new_block);
+                }
+            }
+            final_blocks = partial_blocks;
+        }
+        for (std::vector<size_t> &block : final_blocks)
+            tensor_blocks.push_back(block);
+    }
 
-//    // Transform composite indices into simple indices
-//    for (const std::string &this_block : blocks)
-//    {
-//        std::vector<std::vector<size_t>> final_blocks;
-
-//        std::vector<std::string> this_block_vec = indices::split(this_block);
-//        // Loop over indices of this block
-//        for (std::string mo_space_name : this_block_vec)
-//        {
-//            std::vector<std::vector<size_t>> partial_blocks;
-//            // How does this MO space name map to the MOSpace objects contained
-//            // in mo_spaces_? (e.g. "G" -> {0,1})
-//            for (size_t mo_space_idx :
-//                 composite_name_to_mo_spaces_[mo_space_name])
-//            {
-//                // Special case
-//                if (final_blocks.size() == 0)
-//                {
-//                    partial_blocks.push_back({mo_space_idx});
-//                }
-//                else
-//                {
-//                    // Add each this primitive set to all the partial block
-//                    // labels
-//                    for (std::vector<size_t> &block : final_blocks)
-//                    {
-//                        std::vector<size_t> new_block(block);
-//                        new_block.push_back(mo_space_idx);
-//                        partial_blocks.push_back(new_block);
-//                    }
-//                }
-//            }
-//            final_blocks = partial_blocks;
-//        }
-//        for (std::vector<size_t> &block : final_blocks)
-//            tensor_blocks.push_back(block);
-//    }
+    for (std::vector<size_t> &this_block : tensor_blocks)
+    {
+        // Set or check the rank
+        if (newObject.rank_ > 0)
+        {
+            if (newObject.rank_ != this_block.size())
+            {
+                throw std::runtime_error(
+                    "Attempting to create the SymBlockedTensor \"" + name +
+                    "\" with nonunique rank.");
+            }
+        }
+        else
+        {
+            newObject.rank_ = this_block.size();
+        }
 
-//    // Create the blocks
-//    for (std::vector<size_t> &this_block : tensor_blocks)
-//    {
-//        // Grab the dims
-//        std::vector<size_t> dims;
-//        for (size_t ms : this_block)
-//        {
-//            size_t dim = mo_spaces_[ms].dim();
-//            dims.push_back(dim);
-//        }
-//        // Grab the orbital spaces names
-//        std::string block_label;
-//        for (size_t ms : this_block)
-//        {
-//            block_label += mo_spaces_[ms].name();
-//        }
-//        newObject.blocks_[this_block] =
-//            Tensor::build(type, name + "[" + block_label + "]", dims);
-//        newObject.block_labels_.push_back(block_label);
-
-//        // Set or check the rank
-//        if (newObject.rank_ > 0)
-//        {
-//            if (newObject.rank_ != this_block.size())
-//            {
-//                throw std::runtime_error(
-//                    "Attempting to create the SymBlockedTensor \"" + name +
-//                    "\" with nonunique rank.");
-//            }
-//        }
-//        else
-//        {
-//            newObject.rank_ = this_block.size();
-//        }
-//    }
+        // Enumerate the irreps of all but the last index; the last irrep is
+        // fixed by the symmetry of the tensor
+        size_t rank = this_block.size();
+        std::vector<int> irreps(rank, 0);
+        while (true)
+        {
+            int product = symmetry;
+            for (size_t n = 0; n + 1 < rank; ++n)
+                product ^= irreps[n];
+            bool allowed = true;
+            if (rank > 0)
+            {
+                irreps[rank - 1] = product;
+                allowed = product < context()->mo_spaces[this_block[rank - 1]].nirrep();
+            }
+            else
+            {
+                allowed = (symmetry == 0);
+            }
+
+            SymBlockKey key;
+            std::vector<size_t> dims;
+            for (size_t n = 0; n < rank && allowed; ++n)
+            {
+                const SymMOSpace &ms = context()->mo_spaces[this_block[n]];
+                key.push_back(std::make_pair(this_block[n], irreps[n]));
+                dims.push_back(ms.dim(irreps[n]));
+                // Blocks without orbitals hold nothing
+                allowed = ms.dim(irreps[n]) > 0;
+            }
+            if (allowed && newObject.blocks_.count(key) == 0)
+            {
+                std::string label = block_label(key);
+                newObject.blocks_[key] =
+                    Tensor::build(type, name + "[" + label + "]", dims);
+                newObject.block_labels_.push_back(label);
+            }
+
+            // Next combination of irreps
+            int n = static_cast<int>(rank) - 2;
+            for (; n >= 0; --n)
+            {
+                if (++irreps[n] < context()->mo_spaces[this_block[n]].nirrep())
+                    break;
+                irreps[n] = 0;
+            }
+            if (n < 0)
+                break;
+        }
+    }
+    return newObject;
+}
 
-//    //    newObject.print(stdout);
-//    return newObject;
-//}
+std::string SymBlockedTensor::block_label(const SymBlockKey &key)
+{
+    std::string label;
+    for (const std::pair<size_t, int> &ms_h : key)
+    {
+        label += context()->mo_spaces[ms_h.first].name() + std::to_string(ms_h.second);
+    }
+    return label;
+}
 
 size_t SymBlockedTensor::numblocks() const { return blocks_.size(); }
 
@@ -315,848 +364,584 @@ std::string SymBlockedTensor::name() const { return name_; }
 
 size_t SymBlockedTensor::rank() const { return rank_; }
 
-//void SymBlockedTensor::set_name(const std::string &name) { name_ = name; }
-
-//std::vector<size_t> SymBlockedTensor::indices_to_key(const std::string &indices)
-//{
-//    std::vector<size_t> key;
-//    for (const std::string &index : indices::split(indices))
-//    {
-//        if (name_to_mo_space_.count(index) != 0)
-//        {
-//            key.push_back(name_to_mo_space_[index]);
-//        }
-//        else
-//        {
-//            throw std::runtime_error(
-//                "The index " + index +
-//                " does not indentify a unique space (indices_to_key).");
-//        }
-//    }
-//    return key;
-//}
-
-//bool SymBlockedTensor::is_block(const std::string &indices) const
-//{
-//    return is_block(indices_to_key(indices));
-//}
+void SymBlockedTensor::set_name(const std::string &name) { name_ = name; }
 
-//bool SymBlockedTensor::is_block(const std::vector<size_t> &key) const
-//{
-//    return (blocks_.count(key) != 0);
-//}
-
-//Tensor SymBlockedTensor::block(const std::string &indices)
-//{
-//    std::vector<size_t> key;
-//    for (const std::string &index : indices::split(indices))
-//    {
-//        if (name_to_mo_space_.count(index) != 0)
-//        {
-//            key.push_back(name_to_mo_space_[index]);
-//        }
-//        else
-//        {
-//            throw std::runtime_error(
-//                "Cannot retrieve block " + indices + " of tensor " + name() +
-//                ". The index " + index + " does not indentify a unique space");
-//        }
-//    }
-//    return block(key);
-//}
-
-//Tensor SymBlockedTensor::block(const std::vector<size_t> &key)
-//{
-//    if (!is_block(key))
-//    {
-//        std::string labels;
-//        for (size_t k : key)
-//        {
-//            labels += mo_space(k).name();
-//        }
-//        throw std::runtime_error("Tensor " + name() +
-//                                 " does not contain block \"" + labels + "\"");
-//    }
-//    return blocks_.at(key);
-//}
-
-//const Tensor SymBlockedTensor::block(const std::vector<size_t> &key) const
-//{
-//    if (!is_block(key))
-//    {
-//        std::string labels;
-//        for (size_t k : key)
-//        {
-//            labels += mo_space(k).name();
-//        }
-//        throw std::runtime_error("Tensor " + name() +
-//                                 " does not contain block \"" + labels + "\"");
-//    }
-//    return blocks_.at(key);
-//}
-
-//double SymBlockedTensor::norm(int type) const
-//{
-//    if (type == 0)
-//    {
-//        double val = 0.0;
-//        for (auto block_tensor : blocks_)
-//        {
-//            val = std::max(val, std::fabs(block_tensor.second.norm(type)));
-//        }
-//        return val;
-//    }
-//    else if (type == 1)
-//    {
-//        double val = 0.0;
-//        for (auto block_tensor : blocks_)
-//        {
-//            val += std::fabs(block_tensor.second.norm(type));
-//        }
-//        return val;
-//    }
-//    else if (type == 2)
-//    {
-//        double val = 0.0;
-//        for (auto block_tensor : blocks_)
-//        {
-//            val += std::pow(block_tensor.second.norm(type), 2.0);
-//        }
-//        return std::sqrt(val);
-//    }
-//    else
-//    {
-//        throw std::runtime_error(
-//            "Norm must be 0 (infty-norm), 1 (1-norm), or 2 (2-norm)");
-//    }
-//    return 0.0;
-//}
-
-//void SymBlockedTensor::zero()
-//{
-//    for (auto block_tensor : blocks_)
-//    {
-//        block_tensor.second.zero();
-//    }
-//}
-
-//void SymBlockedTensor::scale(double beta)
-//{
-//    for (auto block_tensor : blocks_)
-//    {
-//        block_tensor.second.scale(beta);
-//    }
-//}
-
-//void SymBlockedTensor::set(double gamma)
-//{
-//    for (auto block_tensor : blocks_)
-//    {
-//        block_tensor.second.set(gamma);
-//    }
-//}
-
-//bool SymBlockedTensor::operator==(const SymBlockedTensor &other) const
-//{
-//    bool same = false;
-//    for (auto block_tensor : blocks_)
-//    {
-//        const std::vector<size_t> &key = block_tensor.first;
-//        if (other.is_block(key))
-//        {
-//            if (block_tensor.second == other.block(key))
-//            {
-//                same = true;
-//            }
-//        }
-//    }
-//    return same;
-//}
-
-//bool SymBlockedTensor::operator!=(const SymBlockedTensor &other) const
-//{
-//    return not(*this == other);
-//}
-
-//// void SymBlockedTensor::copy(const SymBlockedTensor& other)
-////{
-////    blocks_.clear();
-////    for (auto key_tensor : other.blocks_){
-////        Tensor T;
-////        T.copy(key_tensor.second);
-////        blocks_[key_tensor.first] = T;
-////    }
-////}(const std::vector<size_t>&,const std::vector<SpinType>&, double&)
-
-//void SymBlockedTensor::iterate(
-//    const std::function<void(const std::vector<size_t> &,
-//                             const std::vector<SpinType> &, double &)> &func)
-//{
-//    for (auto key_tensor : blocks_)
-//    {
-//        const std::vector<size_t> &key = key_tensor.first;
-
-//        // Assemble the map from the block indices to the MO indices
-
-//        size_t rank = key_tensor.second.rank();
-//        std::vector<size_t> mo(rank);
-//        std::vector<SpinType> spin(rank);
-
-//        std::vector<std::vector<size_t>> index_to_mo;
-//        std::vector<std::vector<SpinType>> index_to_spin;
-//        for (size_t k : key)
-//        {
-//            index_to_mo.push_back(mo_spaces_[k].mos());
-//            index_to_spin.push_back(mo_spaces_[k].spin());
-//        }
-
-//        // Call iterate on this tensor block
-//        key_tensor.second.iterate(
-//            [&](const std::vector<size_t> &indices, double &value)
-//            {
-//                for (size_t n = 0; n < rank; ++n)
-//                {
-//                    mo[n] = index_to_mo[n][indices[n]];
-//                    spin[n] = index_to_spin[n][indices[n]];
-//                }
-//                func(mo, spin, value);
-//            });
-//    }
-//}
+bool SymBlockedTensor::is_block(const SymBlockKey &key) const
+{
+    return (blocks_.count(key) != 0);
+}
 
-//void SymBlockedTensor::citerate(
-//    const std::function<void(const std::vector<size_t> &,
-//                             const std::vector<SpinType> &, const double &)>
-//        &func) const
-//{
-//    for (const auto key_tensor : blocks_)
-//    {
-//        const std::vector<size_t> &key = key_tensor.first;
-
-//        // Assemble the map from the block indices to the MO indices
-
-//        size_t rank = key_tensor.second.rank();
-//        std::vector<size_t> mo(rank);
-//        std::vector<SpinType> spin(rank);
-
-//        std::vector<std::vector<size_t>> index_to_mo;
-//        std::vector<std::vector<SpinType>> index_to_spin;
-//        for (size_t k : key)
-//        {
-//            index_to_mo.push_back(mo_spaces_[k].mos());
-//            index_to_spin.push_back(mo_spaces_[k].spin());
-//        }
-
-//        // Call iterate on this tensor block
-//        key_tensor.second.citerate(
-//            [&](const std::vector<size_t> &indices, const double &value)
-//            {
-//                for (size_t n = 0; n < rank; ++n)
-//                {
-//                    mo[n] = index_to_mo[n][indices[n]];
-//                    spin[n] = index_to_spin[n][indices[n]];
-//                }
-//                func(mo, spin, value);
-//            });
-//    }
-//}
+bool SymBlockedTensor::is_block(const std::string &spaces,
+                                const std::vector<int> &irreps) const
+{
+    std::vector<std::string> names = indices::split(spaces);
+    if (names.size() != irreps.size())
+        return false;
+    SymBlockKey key;
+    for (size_t n = 0; n < names.size(); ++n)
+    {
+        if (context()->name_to_mo_space.count(names[n]) == 0)
+            return false;
+        key.push_back(std::make_pair(context()->name_to_mo_space[names[n]], irreps[n]));
+    }
+    return is_block(key);
+}
 
-//void SymBlockedTensor::print(FILE *fh, bool level, std::string const &format,
-//                          int maxcols) const
-//{
-//    fprintf(fh, "  ## Blocked Tensor %s ##\n\n", name().c_str());
-//    fprintf(fh, "  Number of blocks = %zu\n", numblocks());
-//    for (auto kv : blocks_)
-//    {
-//        fprintf(fh, "\n");
-//        kv.second.print(fh, level, format, maxcols);
-//    }
-//}
+Tensor SymBlockedTensor::block(const SymBlockKey &key)
+{
+    if (!is_block(key))
+    {
+        throw std::runtime_error("Tensor " + name() +
+                                 " does not contain block \"" +
+                                 block_label(key) + "\"");
+    }
+    return blocks_.at(key);
+}
 
-//LabeledBlockedTensor SymBlockedTensor::operator()(const std::string &indices)
-//{
-//    return LabeledBlockedTensor(*this, indices::split(indices));
-//}
+const Tensor SymBlockedTensor::block(const SymBlockKey &key) const
+{
+    if (!is_block(key))
+    {
+        throw std::runtime_error("Tensor " + name() +
+                                 " does not contain block \"" +
+                                 block_label(key) + "\"");
+    }
+    return blocks_.at(key);
+}
 
-//LabeledBlockedTensor SymBlockedTensor::operator[](const std::string &indices)
-//{
-//    return LabeledBlockedTensor(*this, indices::split(indices));
-//}
+Tensor SymBlockedTensor::block(const std::string &spaces,
+                               const std::vector<int> &irreps)
+{
+    std::vector<std::string> names = indices::split(spaces);
+    if (names.size() != irreps.size())
+    {
+        throw std::runtime_error("Cannot retrieve block " + spaces +
+                                 " of tensor " + name() +
+                                 ". The number of irreps does not match.");
+    }
+    SymBlockKey key;
+    for (size_t n = 0; n < names.size(); ++n)
+    {
+        if (context()->name_to_mo_space.count(names[n]) == 0)
+        {
+            throw std::runtime_error(
+                "Cannot retrieve block " + spaces + " of tensor " + name() +
+                ". The index " + names[n] + " does not indentify a unique space");
+        }
+        key.push_back(std::make_pair(context()->name_to_mo_space[names[n]], irreps[n]));
+    }
+    return block(key);
+}
 
-//std::vector<std::vector<size_t>>
-//SymBlockedTensor::label_to_block_keys(const std::vector<std::string> &indices)
-//{
-//    // This function takes in the labels used to form a LabeledBlockedTensor and
-//    // returns the keys
-//    // to access the corresponding blocks.
-//    // For example, suppose that indices "i,j,k" are reserved for occupied
-//    // orbitals ("o") and that index "p"
-//    // belongs to the composite space of occupied and virtual orbitals ("o" +
-//    // "v").
-//    // Then if this function is called with {"i","j","k","p"} it will return the
-//    // vectors
-//    // {0,0,0,0} and {0,0,0,1}, which stand for the "oooo" and "ooov" blocks,
-//    // respectively.
-//    // The way we proceed is by forming partial vectors that we keep expanding
-//    // as we
-//    // process all the indices.
-
-//    std::vector<std::vector<size_t>> final_blocks;
-
-//    // Loop over indices of this block
-//    for (const std::string &index : indices)
-//    {
-//        std::vector<std::vector<size_t>> partial_blocks;
-//        // How does this MO space name map to the MOSpace objects contained in
-//        // mo_spaces_? (e.g. "G" -> {0,1})
-//        if (index_to_mo_spaces_.count(index) != 0)
-//        {
-//            for (size_t mo_space_idx : index_to_mo_spaces_[index])
-//            {
-//                // Special case
-//                if (final_blocks.size() == 0)
-//                {
-//                    partial_blocks.push_back({mo_space_idx});
-//                }
-//                else
-//                {
-//                    // Add each this primitive set to all the partial block
-//                    // labels
-//                    for (std::vector<size_t> &block : final_blocks)
-//                    {
-//                        std::vector<size_t> new_block(block);
-//                        new_block.push_back(mo_space_idx);
-//                        partial_blocks.push_back(new_block);
-//                    }
-//                }
-//            }
-//        }
-//        else
-//        {
-//            throw std::runtime_error("Index \"" + index + "\" is not defined.");
-//        }
-//        final_blocks = partial_blocks;
-//    }
-//    return final_blocks;
-//}
+double SymBlockedTensor::norm(int type) const
+{
+    if (type == 0)
+    {
+        double val = 0.0;
+        for (auto block_tensor : blocks_)
+        {
+            val = std::max(val, std::fabs(block_tensor.second.norm(type)));
+        }
+        return val;
+    }
+    else if (type == 1)
+    {
+        double val = 0.0;
+        for (auto block_tensor : blocks_)
+        {
+            val += std::fabs(block_tensor.second.norm(type));
+        }
+        return val;
+    }
+    else if (type == 2)
+    {
+        double val = 0.0;
+        for (auto block_tensor : blocks_)
+        {
+            val += std::pow(block_tensor.second.norm(type), 2.0);
+        }
+        return std::sqrt(val);
+    }
+    else
+    {
+        throw std::runtime_error(
+            "Norm must be 0 (infty-norm), 1 (1-norm), or 2 (2-norm)");
+    }
+    return 0.0;
+}
 
-//LabeledBlockedTensor::LabeledBlockedTensor(
-//    SymBlockedTensor BT, const std::vector<std::string> &indices, double factor)
-//    : BT_(BT), indices_(indices), factor_(factor)
-//{
-//    if (BT_.rank() != indices.size())
-//        throw std::runtime_error("Labeled tensor does not have correct number "
-//                                 "of indices for underlying tensor's rank");
-//}
+void SymBlockedTensor::zero()
+{
+    for (auto block_tensor : blocks_)
+    {
+        block_tensor.second.zero();
+    }
+}
 
-//std::string LabeledBlockedTensor::str() const
-//{
-//    std::string s(BT_.name());
-//    s += "[" + indices::to_string(indices_) + "]";
-//    return s;
-//}
+void SymBlockedTensor::scale(double beta)
+{
+    for (auto block_tensor : blocks_)
+    {
+        block_tensor.second.scale(beta);
+    }
+}
 
-//void LabeledBlockedTensor::operator=(const LabeledBlockedTensor &rhs)
-//{
-//    try
-//    {
-//        add(rhs, 1.0, 0.0);
-//    }
-//    catch (std::exception &e)
-//    {
-//        std::string msg = "\n" + this->str() + " = " + rhs.str() + " <- " +
-//                          std::string(e.what());
-//        throw std::runtime_error(msg);
-//    }
-//}
+void SymBlockedTensor::set(double gamma)
+{
+    for (auto block_tensor : blocks_)
+    {
+        block_tensor.second.set(gamma);
+    }
+}
 
-//void LabeledBlockedTensor::operator+=(const LabeledBlockedTensor &rhs)
-//{
-//    try
-//    {
-//        add(rhs, 1.0, 1.0);
-//    }
-//    catch (std::exception &e)
-//    {
-//        std::string msg = "\n" + this->str() + " += " + rhs.str() + " <- " +
-//                          std::string(e.what());
-//        throw std::runtime_error(msg);
-//    }
-//}
+std::map<std::string, SymBlockedTensor> SymBlockedTensor::map_diagonal_blocks(
+    const std::string &caller,
+    const std::function<std::map<std::string, Tensor>(const Tensor &)> &op)
+    const
+{
+    if (rank_ != 2 || symmetry_ != 0)
+        throw std::runtime_error(caller + ": the SymBlockedTensor \"" + name_ +
+                                 "\" is not a totally symmetric matrix.");
 
-//void LabeledBlockedTensor::operator-=(const LabeledBlockedTensor &rhs)
-//{
-//    try
-//    {
-//        add(rhs, -1.0, 1.0);
-//    }
-//    catch (std::exception &e)
-//    {
-//        std::string msg = "\n" + this->str() + " -= " + rhs.str() + " <- " +
-//                          std::string(e.what());
-//        throw std::runtime_error(msg);
-//    }
-//}
+    std::vector<SymBlockKey> keys;
+    for (const auto &block_tensor : blocks_)
+    {
+        if (block_tensor.first[0] != block_tensor.first[1])
+            throw std::runtime_error(caller + ": the SymBlockedTensor \"" +
+                                     name_ + "\" has the off-diagonal block " +
+                                     block_label(block_tensor.first) + ".");
+        keys.push_back(block_tensor.first);
+    }
 
-//void LabeledBlockedTensor::add(const LabeledBlockedTensor &rhs, double alpha,
-//                               double beta)
-//{
-//    std::vector<std::vector<size_t>> rhs_keys = rhs.label_to_block_keys();
+    // One LAPACK call per irrep block, the blocks concurrently
+    std::vector<std::map<std::string, Tensor>> results(keys.size());
+    std::exception_ptr error;
+    threads::TaskThreads split(keys.size());
+#pragma omp parallel for schedule(dynamic, 1) num_threads(split.outer())     \
+    proc_bind(spread) if (keys.size() > 1)
+    for (size_t b = 0; b < keys.size(); ++b)
+    {
+        split.enter();
+        try
+        {
+            results[b] = op(blocks_.at(keys[b]));
+        }
+        catch (...)
+        {
+#pragma omp critical(ambit_sym_diagonal_blocks_error)
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
 
-//    std::vector<size_t> perm =
-//        indices::permutation_order(indices_, rhs.indices_);
+    std::map<std::string, SymBlockedTensor> result;
+    for (size_t b = 0; b < keys.size(); ++b)
+    {
+        for (const auto &label_tensor : results[b])
+        {
+            SymBlockedTensor &T = result[label_tensor.first];
+            T.name_ = name_;
+            T.rank_ = rank_;
+            T.symmetry_ = symmetry_;
+            T.block_labels_ = block_labels_;
+            T.blocks_[keys[b]] = label_tensor.second;
+        }
+    }
+    return result;
+}
 
-//    // Loop over all keys of the rhs
-//    for (std::vector<size_t> &rhs_key : rhs_keys)
-//    {
-//        // Map the rhs key to the lhs key
-//        std::vector<size_t> lhs_key;
-//        for (size_t p : perm)
-//        {
-//            lhs_key.push_back(rhs_key[p]);
-//        }
-
-//        bool do_add = true;
-//        // In expert mode if a contraction cannot be performed
-//        if (BlockedTensor::expert_mode())
-//        {
-//            if (not BT().is_block(lhs_key))
-//                do_add = false;
-//            if (not rhs.BT().is_block(rhs_key))
-//                do_add = false;
-//        }
-//        if (do_add)
-//        {
-//            // Call LabeledTensor's operation
-//            Tensor LHS = BT().block(lhs_key);
-//            const Tensor RHS = rhs.BT().block(rhs_key);
-
-//            if (LHS == RHS)
-//                throw std::runtime_error("Self assignment is not allowed.");
-//            if (LHS.rank() != RHS.rank())
-//                throw std::runtime_error(
-//                    "Permuted tensors do not have same rank");
-//            LHS.permute(RHS, indices_, rhs.indices_, alpha * rhs.factor(),
-//                        beta);
-//        }
-//    }
-//}
+std::map<std::string, SymBlockedTensor>
+SymBlockedTensor::syev(EigenvalueOrder order) const
+{
+    std::map<std::string, SymBlockedTensor> result = map_diagonal_blocks(
+        "SymBlockedTensor::syev", [order](const Tensor &block) {
+            std::map<std::string, Tensor> diag = block.syev(order);
+            // The eigenvalues go on the diagonal of a block like this one
+            size_t n = block.dim(0);
+            Tensor values = Tensor::build(CoreTensor, "Eigenvalues", {n, n});
+            for (size_t p = 0; p < n; ++p)
+                values.data()[p * n + p] = diag["eigenvalues"].data()[p];
+            diag["eigenvalues"] = values;
+            return diag;
+        });
+    result["eigenvalues"].set_name("Eigenvalues of " + name_);
+    result["eigenvectors"].set_name("Eigenvectors of " + name_);
+    return result;
+}
 
-//LabeledBlockedTensorProduct LabeledBlockedTensor::
-//operator*(const LabeledBlockedTensor &rhs)
-//{
-//    return LabeledBlockedTensorProduct(*this, rhs);
-//}
+SymBlockedTensor SymBlockedTensor::power(double alpha, double condition) const
+{
+    std::map<std::string, SymBlockedTensor> result = map_diagonal_blocks(
+        "SymBlockedTensor::power", [alpha, condition](const Tensor &block) {
+            return std::map<std::string, Tensor>{
+                {"power", block.power(alpha, condition)}};
+        });
+    result["power"].set_name(name_ + "^" + std::to_string(alpha));
+    return result["power"];
+}
 
-//LabeledBlockedTensorAddition LabeledBlockedTensor::
-//operator+(const LabeledBlockedTensor &rhs)
-//{
-//    return LabeledBlockedTensorAddition(*this, rhs);
-//}
+SymBlockedTensor SymBlockedTensor::inverse() const
+{
+    std::map<std::string, SymBlockedTensor> result = map_diagonal_blocks(
+        "SymBlockedTensor::inverse", [](const Tensor &block) {
+            return std::map<std::string, Tensor>{{"inverse", block.inverse()}};
+        });
+    result["inverse"].set_name(name_ + "^-1");
+    return result["inverse"];
+}
 
-//LabeledBlockedTensorAddition LabeledBlockedTensor::
-//operator-(const LabeledBlockedTensor &rhs)
-//{
-//    return LabeledBlockedTensorAddition(*this, -rhs);
-//}
+bool SymBlockedTensor::operator==(const SymBlockedTensor &other) const
+{
+    bool same = false;
+    for (auto block_tensor : blocks_)
+    {
+        const SymBlockKey &key = block_tensor.first;
+        if (other.is_block(key))
+        {
+            if (block_tensor.second == other.block(key))
+            {
+                same = true;
+            }
+        }
+    }
+    return same;
+}
 
-//void LabeledBlockedTensor::operator=(const LabeledBlockedTensorProduct &rhs)
-//{
-//    try
-//    {
-//        contract(rhs, true, true);
-//    }
-//    catch (std::exception &e)
-//    {
-//        std::string msg = "\n" + this->str() + " = " + rhs.str() + " <- " +
-//                          std::string(e.what());
-//        throw std::runtime_error(msg);
-//    }
-//}
+bool SymBlockedTensor::operator!=(const SymBlockedTensor &other) const
+{
+    return not(*this == other);
+}
 
-//void LabeledBlockedTensor::operator+=(const LabeledBlockedTensorProduct &rhs)
-//{
-//    try
-//    {
-//        contract(rhs, false, true);
-//    }
-//    catch (std::exception &e)
-//    {
-//        std::string msg = "\n" + this->str() + " += " + rhs.str() + " <- " +
-//                          std::string(e.what());
-//        throw std::runtime_error(msg);
-//    }
-//}
+void SymBlockedTensor::iterate(
+    const std::function<void(const std::vector<size_t> &,
+                             const std::vector<int> &, double &)> &func)
+{
+    for (auto key_tensor : blocks_)
+    {
+        const SymBlockKey &key = key_tensor.first;
+
+        // Assemble the map from the block indices to the MO indices
+        size_t rank = key.size();
+        std::vector<size_t> mo(rank);
+        std::vector<int> irreps(rank);
+        std::vector<const std::vector<size_t> *> index_to_mo;
+        for (size_t n = 0; n < rank; ++n)
+        {
+            index_to_mo.push_back(&context()->mo_spaces[key[n].first].mos(key[n].second));
+            irreps[n] = key[n].second;
+        }
 
-//void LabeledBlockedTensor::operator-=(const LabeledBlockedTensorProduct &rhs)
-//{
-//    try
-//    {
-//        contract(rhs, false, false);
-//    }
-//    catch (std::exception &e)
-//    {
-//        std::string msg = "\n" + this->str() + " -= " + rhs.str() + " <- " +
-//                          std::string(e.what());
-//        throw std::runtime_error(msg);
-//    }
-//}
+        key_tensor.second.iterate(
+            [&](const std::vector<size_t> &indices, double &value) {
+                for (size_t n = 0; n < rank; ++n)
+                    mo[n] = (*index_to_mo[n])[indices[n]];
+                func(mo, irreps, value);
+            });
+    }
+}
 
-//void LabeledBlockedTensor::contract(const LabeledBlockedTensorProduct &rhs,
-//                                    bool zero_result, bool add)
-//{
-//    size_t nterms = rhs.size();
+void SymBlockedTensor::citerate(
+    const std::function<void(const std::vector<size_t> &,
+                             const std::vector<int> &, const double &)> &func)
+    const
+{
+    for (const auto &key_tensor : blocks_)
+    {
+        const SymBlockKey &key = key_tensor.first;
 
-//    // Check for self assignment
-//    for (size_t n = 0; n < nterms; ++n)
-//    {
-//        const BlockedTensor &bt = rhs[n].BT();
-//        if (BT_ == bt)
-//        {
-//            throw std::runtime_error(
-//                "Tensor contractions does not support self assignment.");
-//        }
-//    }
+        size_t rank = key.size();
+        std::vector<size_t> mo(rank);
+        std::vector<int> irreps(rank);
+        std::vector<const std::vector<size_t> *> index_to_mo;
+        for (size_t n = 0; n < rank; ++n)
+        {
+            index_to_mo.push_back(&context()->mo_spaces[key[n].first].mos(key[n].second));
+            irreps[n] = key[n].second;
+        }
 
-//    // Find the unique indices in the contraction
-//    std::vector<std::string> unique_indices;
-//    for (size_t n = 0; n < nterms; ++n)
-//    {
-//        for (const std::string &index : rhs[n].indices())
-//        {
-//            unique_indices.push_back(index);
-//        }
-//    }
-//    sort(unique_indices.begin(), unique_indices.end());
-//    unique_indices.erase(
-//        std::unique(unique_indices.begin(), unique_indices.end()),
-//        unique_indices.end());
-
-//    std::vector<std::vector<size_t>> unique_indices_keys =
-//        BlockedTensor::label_to_block_keys(unique_indices);
-//    std::map<std::string, size_t> index_map;
-//    {
-//        size_t k = 0;
-//        for (const std::string &index : unique_indices)
-//        {
-//            index_map[index] = k;
-//            k++;
-//        }
-//    }
+        key_tensor.second.citerate(
+            [&](const std::vector<size_t> &indices, const double &value) {
+                for (size_t n = 0; n < rank; ++n)
+                    mo[n] = (*index_to_mo[n])[indices[n]];
+                func(mo, irreps, value);
+            });
+    }
+}
 
-//    if (zero_result)
-//    {
-//        // Zero the results blocks
-//        for (const std::vector<size_t> &uik : unique_indices_keys)
-//        {
-//            std::vector<size_t> result_key;
-//            for (const std::string &index : indices())
-//            {
-//                result_key.push_back(uik[index_map[index]]);
-//            }
-//            if (BlockedTensor::expert_mode_)
-//            {
-//                if (BT_.is_block(result_key))
-//                {
-//                    BT_.block(result_key).zero();
-//                }
-//            }
-//            else
-//            {
-//                BT_.block(result_key).zero();
-//            }
-//        }
-//    }
+std::vector<SymBlockKey> SymBlockedTensor::label_to_block_keys(
+    const std::vector<std::string> &indices) const
+{
+    if (indices.size() != rank_)
+    {
+        throw std::runtime_error("Tensor " + name() + " has rank " +
+                                 std::to_string(rank_) + " but " +
+                                 std::to_string(indices.size()) +
+                                 " indices were given.");
+    }
+    for (const std::string &index : indices)
+    {
+        if (context()->index_to_mo_spaces.count(index) == 0)
+        {
+            throw std::runtime_error("The index " + index +
+                                     " is not defined in any MO space.");
+        }
+    }
 
-//    // Setup and perform contractions
-//    for (const std::vector<size_t> &uik : unique_indices_keys)
-//    {
-//        std::vector<size_t> result_key;
-//        for (const std::string &index : indices())
-//        {
-//            result_key.push_back(uik[index_map[index]]);
-//        }
-
-//        bool do_contract = true;
-//        // In expert mode if a contraction cannot be performed
-//        if (BlockedTensor::expert_mode_)
-//        {
-//            if (not BT().is_block(result_key))
-//                do_contract = false;
-//            for (size_t n = 0; n < nterms; ++n)
-//            {
-//                const LabeledBlockedTensor &lbt = rhs[n];
-//                std::vector<size_t> term_key;
-//                for (const std::string &index : lbt.indices())
-//                {
-//                    term_key.push_back(uik[index_map[index]]);
-//                }
-//                if (not lbt.BT().is_block(term_key))
-//                    do_contract = false;
-//            }
-//        }
-
-//        if (do_contract)
-//        {
-//            LabeledTensor result(BT().block(result_key), indices(), factor());
-
-//            LabeledTensorContraction prod;
-//            for (size_t n = 0; n < nterms; ++n)
-//            {
-//                const LabeledBlockedTensor &lbt = rhs[n];
-//                std::vector<size_t> term_key;
-//                for (const std::string &index : lbt.indices())
-//                {
-//                    term_key.push_back(uik[index_map[index]]);
-//                }
-//                const LabeledTensor term(lbt.BT().block(term_key),
-//                                         lbt.indices(), lbt.factor());
-//                prod *= term;
-//            }
-//            if (add)
-//            {
-//                result += prod;
-//            }
-//            else
-//            {
-//                result -= prod;
-//            }
-//        }
-//    }
-//}
+    std::vector<SymBlockKey> keys;
+    for (const auto &key_tensor : blocks_)
+    {
+        const SymBlockKey &key = key_tensor.first;
+        bool match = true;
+        for (size_t n = 0; n < rank_ && match; ++n)
+        {
+            const std::vector<size_t> &spaces =
+                context()->index_to_mo_spaces.at(indices[n]);
+            match = std::find(spaces.begin(), spaces.end(), key[n].first) !=
+                    spaces.end();
+        }
+        if (match)
+            keys.push_back(key);
+    }
+    return keys;
+}
 
-//void LabeledBlockedTensor::operator=(const LabeledBlockedTensorAddition &rhs)
-//{
-//    BT_.zero();
-//    for (size_t ind = 0, end = rhs.size(); ind < end; ++ind)
-//    {
-//        const LabeledBlockedTensor &labeledTensor = rhs[ind];
-//        add(labeledTensor, 1.0, 1.0);
-//    }
-//}
+LabeledSymBlockedTensor SymBlockedTensor::operator()(const std::string &indices)
+{
+    return LabeledSymBlockedTensor(*this, indices::split(indices));
+}
 
-//void LabeledBlockedTensor::operator+=(const LabeledBlockedTensorAddition &rhs)
-//{
-//    for (size_t ind = 0, end = rhs.size(); ind < end; ++ind)
-//    {
-//        const LabeledBlockedTensor &labeledTensor = rhs[ind];
-//        add(labeledTensor, 1.0, 1.0);
-//    }
-//}
+LabeledSymBlockedTensor SymBlockedTensor::operator[](const std::string &indices)
+{
+    return LabeledSymBlockedTensor(*this, indices::split(indices));
+}
 
-//void LabeledBlockedTensor::operator-=(const LabeledBlockedTensorAddition &rhs)
-//{
-//    for (size_t ind = 0, end = rhs.size(); ind < end; ++ind)
-//    {
-//        const LabeledBlockedTensor &labeledTensor = rhs[ind];
-//        add(labeledTensor, -1.0, 1.0);
-//    }
-//}
+// => LabeledSymBlockedTensor <= //
 
-//void LabeledBlockedTensor::operator*=(double scale)
-//{
-//    std::vector<std::vector<size_t>> keys = label_to_block_keys();
+LabeledSymBlockedTensor::LabeledSymBlockedTensor(
+    SymBlockedTensor T, const std::vector<std::string> &indices,
+    double factor)
+    : BT_(T), indices_(indices), factor_(factor)
+{
+    if (T.rank() != indices.size())
+    {
+        throw std::runtime_error(
+            "Labeled tensor does not have correct number of indices for "
+            "underlying tensor's rank\n");
+    }
+}
 
-//    // Loop over all keys and scale blocks
-//    for (std::vector<size_t> &key : keys)
-//    {
-//        BT_.block(key).scale(scale);
-//    }
-//}
+LabeledSymBlockedTensorProduct LabeledSymBlockedTensor::
+operator*(const LabeledSymBlockedTensor &rhs) const
+{
+    return LabeledSymBlockedTensorProduct(*this, rhs);
+}
 
-//void LabeledBlockedTensor::operator/=(double scale)
-//{
-//    std::vector<std::vector<size_t>> keys = label_to_block_keys();
+void LabeledSymBlockedTensor::operator=(const LabeledSymBlockedTensor &rhs)
+{
+    add(rhs, 1.0, 0.0);
+}
 
-//    // Loop over all keys and scale blocks
-//    for (std::vector<size_t> &key : keys)
-//    {
-//        BT_.block(key).scale(1.0 / scale);
-//    }
-//}
+void LabeledSymBlockedTensor::operator+=(const LabeledSymBlockedTensor &rhs)
+{
+    add(rhs, 1.0, 1.0);
+}
 
-//LabeledBlockedTensorDistributive LabeledBlockedTensor::
-//operator*(const LabeledBlockedTensorAddition &rhs)
-//{
-//    return LabeledBlockedTensorDistributive(*this, rhs);
-//}
+void LabeledSymBlockedTensor::operator-=(const LabeledSymBlockedTensor &rhs)
+{
+    add(rhs, -1.0, 1.0);
+}
 
-//void LabeledBlockedTensor::
-//operator=(const LabeledBlockedTensorDistributive &rhs)
-//{
-//    std::vector<std::vector<size_t>> lhs_keys = label_to_block_keys();
+void LabeledSymBlockedTensor::operator=(
+    const LabeledSymBlockedTensorProduct &rhs)
+{
+    contract(rhs, 1.0, 0.0);
+}
 
-//    // Loop over all keys of the rhs
-//    for (std::vector<size_t> &lhs_key : lhs_keys)
-//    {
-//        BT_.block(lhs_key).zero();
-//    }
+void LabeledSymBlockedTensor::operator+=(
+    const LabeledSymBlockedTensorProduct &rhs)
+{
+    contract(rhs, 1.0, 1.0);
+}
 
-//    for (const LabeledBlockedTensor &B : rhs.B())
-//    {
-//        *this += const_cast<LabeledBlockedTensor &>(rhs.A()) *
-//                 const_cast<LabeledBlockedTensor &>(B);
-//    }
-//}
+void LabeledSymBlockedTensor::operator-=(
+    const LabeledSymBlockedTensorProduct &rhs)
+{
+    contract(rhs, -1.0, 1.0);
+}
 
-//void LabeledBlockedTensor::
-//operator+=(const LabeledBlockedTensorDistributive &rhs)
-//{
-//    for (const LabeledBlockedTensor &B : rhs.B())
-//    {
-//        *this += const_cast<LabeledBlockedTensor &>(rhs.A()) *
-//                 const_cast<LabeledBlockedTensor &>(B);
-//    }
-//}
+void LabeledSymBlockedTensor::operator*=(double scale)
+{
+    for (const SymBlockKey &key : BT_.label_to_block_keys(indices_))
+    {
+        BT_.block(key).scale(scale);
+    }
+}
 
-//void LabeledBlockedTensor::
-//operator-=(const LabeledBlockedTensorDistributive &rhs)
-//{
-//    for (const LabeledBlockedTensor &B : rhs.B())
-//    {
-//        *this -= const_cast<LabeledBlockedTensor &>(rhs.A()) *
-//                 const_cast<LabeledBlockedTensor &>(B);
-//    }
-//}
+void LabeledSymBlockedTensor::operator/=(double scale)
+{
+    for (const SymBlockKey &key : BT_.label_to_block_keys(indices_))
+    {
+        BT_.block(key).scale(1.0 / scale);
+    }
+}
 
-//LabeledBlockedTensorDistributive LabeledBlockedTensorAddition::
-//operator*(const LabeledBlockedTensor &other)
-//{
-//    return LabeledBlockedTensorDistributive(other, *this);
-//}
+void LabeledSymBlockedTensor::add(const LabeledSymBlockedTensor &rhs,
+                                  double alpha, double beta)
+{
+    if (BT_ == rhs.BT_ && indices_ != rhs.indices_)
+    {
+        throw std::runtime_error("Cannot assign a SymBlockedTensor to a "
+                                 "permutation of itself.");
+    }
 
-//LabeledBlockedTensorAddition &LabeledBlockedTensorAddition::
-//operator*(double scalar)
-//{
-//    // distribute the scalar to each term
-//    for (LabeledBlockedTensor &T : tensors_)
-//    {
-//        T *= scalar;
-//    }
+    // Position in this tensor of each index of rhs
+    std::vector<size_t> rhs_position;
+    for (const std::string &index : rhs.indices())
+    {
+        auto it = std::find(indices_.begin(), indices_.end(), index);
+        if (it == indices_.end())
+        {
+            throw std::runtime_error("The index " + index + " of " +
+                                     rhs.BT().name() + " is not in " +
+                                     BT_.name() + ".");
+        }
+        rhs_position.push_back(it - indices_.begin());
+    }
 
-//    return *this;
-//}
+    for (const SymBlockKey &key : BT_.label_to_block_keys(indices_))
+    {
+        SymBlockKey rhs_key;
+        for (size_t position : rhs_position)
+            rhs_key.push_back(key[position]);
 
-//LabeledBlockedTensorAddition &LabeledBlockedTensorAddition::operator-()
-//{
-//    for (LabeledBlockedTensor &T : tensors_)
-//    {
-//        T *= -1.0;
-//    }
+        Tensor C = BT_.block(key);
+        if (rhs.BT().is_block(rhs_key))
+        {
+            C.permute(rhs.BT().block(rhs_key), indices_, rhs.indices(),
+                      alpha * rhs.factor(), beta);
+        }
+        else
+        {
+            // The corresponding block of rhs is zero by symmetry
+            C.scale(beta);
+        }
+    }
+}
 
-//    return *this;
-//}
+void LabeledSymBlockedTensor::contract(
+    const LabeledSymBlockedTensorProduct &rhs, double alpha, double beta)
+{
+    const LabeledSymBlockedTensor &A = rhs.A();
+    const LabeledSymBlockedTensor &B = rhs.B();
+    if (BT_ == A.BT() || BT_ == B.BT())
+    {
+        throw std::runtime_error("A SymBlockedTensor cannot be the result of "
+                                 "a contraction it takes part in.");
+    }
 
-//std::string LabeledBlockedTensorProduct::str() const
-//{
-//    std::vector<std::string> vec_str;
-//    for (const auto &tensor : tensors_)
-//    {
-//        vec_str.push_back(tensor.str());
-//    }
-//    return indices::to_string(vec_str, " * ");
-//}
+    std::vector<SymBlockKey> Ckeys = BT_.label_to_block_keys(indices_);
+    std::set<SymBlockKey> Cset(Ckeys.begin(), Ckeys.end());
+    for (const SymBlockKey &key : Ckeys)
+    {
+        BT_.block(key).scale(beta);
+    }
 
-//LabeledBlockedTensorProduct::operator double() const
-//{
-//    double result = 0.0;
+    double factor = alpha * A.factor() * B.factor();
+    rhs.for_each_block_pair(
+        [&](const Tensor &Ablock, const Tensor &Bblock,
+            const std::map<std::string, std::pair<size_t, int>> &irreps) {
+            SymBlockKey key;
+            for (const std::string &index : indices_)
+            {
+                auto it = irreps.find(index);
+                if (it == irreps.end())
+                {
+                    throw std::runtime_error(
+                        "The index " + index + " of " + BT_.name() +
+                        " does not appear in the contraction.");
+                }
+                key.push_back(it->second);
+            }
+            // Blocks of C absent by symmetry receive nothing
+            if (Cset.count(key) == 0)
+                return;
+            BT_.block(key).contract(Ablock, Bblock, indices_, A.indices(),
+                                    B.indices(), factor, 1.0);
+        });
+}
 
-//    size_t nterms = this->size();
+// => LabeledSymBlockedTensorProduct <= //
 
-//    // Find the unique indices in the contraction
-//    std::vector<std::string> unique_indices;
-//    for (size_t n = 0; n < nterms; ++n)
-//    {
-//        for (const std::string &index : tensors_[n].indices())
-//        {
-//            unique_indices.push_back(index);
-//        }
-//    }
-//    sort(unique_indices.begin(), unique_indices.end());
-//    unique_indices.erase(
-//        std::unique(unique_indices.begin(), unique_indices.end()),
-//        unique_indices.end());
-
-//    std::vector<std::vector<size_t>> unique_indices_keys =
-//        BlockedTensor::label_to_block_keys(unique_indices);
-//    std::map<std::string, size_t> index_map;
-//    {
-//        size_t k = 0;
-//        for (const std::string &index : unique_indices)
-//        {
-//            index_map[index] = k;
-//            k++;
-//        }
-//    }
+void LabeledSymBlockedTensorProduct::for_each_block_pair(
+    const std::function<void(const Tensor &, const Tensor &,
+                             const std::map<std::string, std::pair<size_t, int>>
+                                 &)> &func) const
+{
+    std::vector<SymBlockKey> Akeys = A_.BT().label_to_block_keys(A_.indices());
+    std::vector<SymBlockKey> Bkeys = B_.BT().label_to_block_keys(B_.indices());
 
-//    // Setup and perform contractions
-//    for (const std::vector<size_t> &uik : unique_indices_keys)
-//    {
+    // Positions in B of the indices shared with A
+    std::vector<std::pair<size_t, size_t>> shared;
+    for (size_t a = 0; a < A_.indices().size(); ++a)
+    {
+        for (size_t b = 0; b < B_.indices().size(); ++b)
+        {
+            if (A_.indices()[a] == B_.indices()[b])
+                shared.push_back(std::make_pair(a, b));
+        }
+    }
 
-//        bool do_contract = true;
-//        // In expert mode if a contraction cannot be performed
-//        if (BlockedTensor::expert_mode())
-//        {
-//            for (size_t n = 0; n < nterms; ++n)
-//            {
-//                const LabeledBlockedTensor &lbt = tensors_[n];
-//                std::vector<size_t> term_key;
-//                for (const std::string &index : lbt.indices())
-//                {
-//                    term_key.push_back(uik[index_map[index]]);
-//                }
-//                if (not lbt.BT().is_block(term_key))
-//                    do_contract = false;
-//            }
-//        }
-
-//        if (do_contract)
-//        {
-//            LabeledTensorContraction prod;
-//            for (size_t n = 0; n < nterms; ++n)
-//            {
-//                const LabeledBlockedTensor &lbt = tensors_[n];
-//                std::vector<size_t> term_key;
-//                for (const std::string &index : lbt.indices())
-//                {
-//                    term_key.push_back(uik[index_map[index]]);
-//                }
-//                const LabeledTensor term(lbt.BT().block(term_key),
-//                                         lbt.indices(), lbt.factor());
-//                prod *= term;
-//            }
-//            result += prod;
-//        }
-//    }
+    std::map<std::string, std::pair<size_t, int>> irreps;
+    for (const SymBlockKey &Akey : Akeys)
+    {
+        const Tensor Ablock = A_.BT().block(Akey);
+        for (const SymBlockKey &Bkey : Bkeys)
+        {
+            bool match = true;
+            for (const std::pair<size_t, size_t> &ab : shared)
+            {
+                if (Akey[ab.first] != Bkey[ab.second])
+                {
+                    match = false;
+                    break;
+                }
+            }
+            if (!match)
+                continue;
+
+            irreps.clear();
+            for (size_t a = 0; a < Akey.size(); ++a)
+                irreps[A_.indices()[a]] = Akey[a];
+            for (size_t b = 0; b < Bkey.size(); ++b)
+                irreps[B_.indices()[b]] = Bkey[b];
+            func(Ablock, B_.BT().block(Bkey), irreps);
+        }
+    }
+}
 
-//    return result;
-//}
+LabeledSymBlockedTensorProduct::operator double() const
+{
+    std::vector<std::string> Asorted = A_.indices();
+    std::vector<std::string> Bsorted = B_.indices();
+    std::sort(Asorted.begin(), Asorted.end());
+    std::sort(Bsorted.begin(), Bsorted.end());
+    if (Asorted != Bsorted)
+    {
+        throw std::runtime_error("A dot product of SymBlockedTensors needs "
+                                 "the same indices on both tensors.");
+    }
 
-//std::vector<std::string> spin_cases(const std::vector<std::string> &in_str_vec)
-//{
-//    std::vector<std::string> out_str_vec;
-//    for (const std::string &s : in_str_vec)
-//    {
-//        if (s.size() % 2 == 1)
-//        {
-//            throw std::runtime_error("String \"" + s +
-//                                     "\" passed to spin_cases() is not valid.");
-//        }
-//        size_t n = s.size() / 2;
-//        for (size_t i = 0; i < n + 1; ++i)
-//        {
-//            std::string mod_s = s;
-//            std::transform(mod_s.begin(), mod_s.end(), mod_s.begin(),
-//                           ::tolower);
-//            for (size_t j = n - i; j < n; ++j)
-//            {
-//                mod_s[j] = ::toupper(mod_s[j]);
-//                mod_s[n + j] = ::toupper(mod_s[n + j]);
-//            }
-//            out_str_vec.push_back(mod_s);
-//        }
-//    }
-//    return out_str_vec;
-//}
+    double result = 0.0;
+    double factor = A_.factor() * B_.factor();
+    for_each_block_pair(
+        [&](const Tensor &Ablock, const Tensor &Bblock,
+            const std::map<std::string, std::pair<size_t, int>> &) {
+            result += factor * static_cast<double>(
+                                   Ablock(indices::to_string(A_.indices())) *
+                                   Bblock(indices::to_string(B_.indices())));
+        });
+    return result;
+}
 }
-
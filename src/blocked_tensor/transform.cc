@@ -0,0 +1,214 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+#include <ambit/memory.h>
+#include <ambit/settings.h>
+#include <ambit/timer.h>
+#include <ambit/transform.h>
+
+namespace ambit
+{
+
+namespace
+{
+
+/// The blocks to compute, grouped by their fourth, third and second MO
+/// space so that each quarter transformation is done once per slab
+using TransformTree =
+    std::map<size_t, std::map<size_t, std::map<size_t, std::vector<std::vector<size_t>>>>>;
+
+/// The columns of C for the MOs of space n, as an AO x MO CoreTensor
+Tensor space_coefficients(const Tensor &C, size_t n)
+{
+    MOSpace space = BlockedTensor::mo_space(n);
+    const std::vector<size_t> mos = space.mos();
+    size_t nbf = C.dims()[0];
+    size_t nmo = C.dims()[1];
+
+    Tensor Cfull = C;
+    if (C.type() != CoreTensor)
+    {
+        Cfull = Tensor::build(CoreTensor, C.name(), C.dims());
+        Cfull.copy(C);
+    }
+    const std::vector<double> &Cdata = Cfull.data();
+
+    Tensor Cs = Tensor::build(CoreTensor, "C " + space.name(),
+                              {nbf, mos.size()});
+    std::vector<double> &Csdata = Cs.data();
+    for (size_t p = 0; p < mos.size(); ++p)
+    {
+        if (mos[p] >= nmo)
+            throw std::runtime_error(
+                "transform_ao_to_mo: MO space " + space.name() +
+                " has more orbitals than the coefficients.");
+        for (size_t mu = 0; mu < nbf; ++mu)
+            Csdata[mu * mos.size() + p] = Cdata[mu * nmo + mos[p]];
+    }
+    return Cs;
+}
+
+BlockedTensor transform(const Tensor *ao, const AOSlabFunction &generate,
+                        size_t nbf, const Tensor &C, TensorType type,
+                        const std::string &name,
+                        const std::vector<std::string> &blocks, size_t memory)
+{
+    if (C.rank() != 2 || C.dims()[0] != nbf)
+        throw std::runtime_error("transform_ao_to_mo: C must be a matrix with "
+                                 "a row per basis function.");
+
+    BlockedTensor result = BlockedTensor::build(type, name, blocks);
+    if (result.rank() != 4)
+        throw std::runtime_error(
+            "transform_ao_to_mo: the blocks must have four indices.");
+    result.zero();
+
+    TransformTree tree;
+    std::map<size_t, Tensor> Cs;
+    size_t maxdim[4] = {0, 0, 0, 0};
+    for (const auto &kv : result.blocks())
+    {
+        const std::vector<size_t> &key = kv.first;
+        if (result.is_alias(key))
+            continue;
+        tree[key[3]][key[2]][key[1]].push_back(key);
+        for (size_t i = 0; i < 4; ++i)
+        {
+            if (Cs.count(key[i]) == 0)
+                Cs[key[i]] = space_coefficients(C, key[i]);
+            maxdim[i] = std::max(maxdim[i], Cs[key[i]].dims()[1]);
+        }
+    }
+
+    // The slab and its partial transforms, per first AO index
+    size_t n = nbf;
+    size_t per_row = sizeof(double) *
+                     ((ao != nullptr && ao->type() == CoreTensor ? 0 : n * n * n) +
+                      n * n * maxdim[3] + n * maxdim[2] * maxdim[3] +
+                      maxdim[1] * maxdim[2] * maxdim[3] + maxdim[0]);
+    if (memory == 0)
+    {
+        size_t live = memory::live_bytes();
+        memory = settings::memory_limit > live ? settings::memory_limit - live
+                                               : 0;
+    }
+    size_t rows = std::max<size_t>(1, std::min(n, memory / per_row));
+
+    AMBIT_TIMER_PUSH("AO to MO transformation");
+    for (size_t first = 0; first < n; first += rows)
+    {
+        size_t last = std::min(n, first + rows);
+        size_t nrow = last - first;
+
+        // A CoreTensor source is transformed in place, anything else is
+        // read (or computed) one slab at a time
+        Tensor slab;
+        if (ao == nullptr || ao->type() != CoreTensor)
+        {
+            slab = Tensor::build(CoreTensor, "AO slab", {nrow, n, n, n});
+            if (ao == nullptr)
+                generate(first, last, slab);
+            else
+                slab.slice(*ao, {{0, nrow}, {0, n}, {0, n}, {0, n}},
+                           {{first, last}, {0, n}, {0, n}, {0, n}});
+        }
+
+        for (const auto &s4 : tree)
+        {
+            const Tensor &C4 = Cs[s4.first];
+            size_t d4 = C4.dims()[1];
+            Tensor T1 = Tensor::build(CoreTensor, "AO slab (q1)",
+                                      {nrow, n, n, d4});
+            if (ao != nullptr && ao->type() == CoreTensor)
+                T1.gemm(*ao, C4, false, false, nrow * n * n, d4, n, n, d4,
+                        d4, first * n * n * n);
+            else
+                T1.gemm(slab, C4, false, false, nrow * n * n, d4, n, n, d4,
+                        d4);
+
+            for (const auto &s3 : s4.second)
+            {
+                Tensor T2 = Tensor::build(CoreTensor, "AO slab (q2)",
+                                          {nrow, n, Cs[s3.first].dims()[1], d4});
+                T2("mnkl") = T1("mnsl") * Cs[s3.first]("sk");
+
+                for (const auto &s2 : s3.second)
+                {
+                    Tensor T3 = Tensor::build(
+                        CoreTensor, "AO slab (q3)",
+                        {nrow, Cs[s2.first].dims()[1], T2.dims()[2], d4});
+                    T3("mjkl") = T2("mnkl") * Cs[s2.first]("nj");
+
+                    for (const std::vector<size_t> &key : s2.second)
+                    {
+                        const Tensor &C1 = Cs[key[0]];
+                        Tensor C1slab = Tensor::build(
+                            CoreTensor, "C slab", {nrow, C1.dims()[1]});
+                        C1slab.slice(C1, {{0, nrow}, {0, C1.dims()[1]}},
+                                     {{first, last}, {0, C1.dims()[1]}});
+                        result.block(key)("ijkl") +=
+                            C1slab("mi") * T3("mjkl");
+                    }
+                }
+            }
+        }
+    }
+    AMBIT_TIMER_POP();
+
+    return result;
+}
+}
+
+BlockedTensor transform_ao_to_mo(const Tensor &ao, const Tensor &C,
+                                 TensorType type, const std::string &name,
+                                 const std::vector<std::string> &blocks,
+                                 size_t memory)
+{
+    const Dimension &dims = ao.dims();
+    if (ao.rank() != 4 || dims[1] != dims[0] || dims[2] != dims[0] ||
+        dims[3] != dims[0])
+        throw std::runtime_error("transform_ao_to_mo: the AO integrals must "
+                                 "be an n x n x n x n tensor.");
+    return transform(&ao, AOSlabFunction(), dims[0], C, type, name, blocks,
+                     memory);
+}
+
+BlockedTensor transform_ao_to_mo(const AOSlabFunction &ao, size_t nbf,
+                                 const Tensor &C, TensorType type,
+                                 const std::string &name,
+                                 const std::vector<std::string> &blocks,
+                                 size_t memory)
+{
+    return transform(nullptr, ao, nbf, C, type, name, blocks, memory);
+}
+}
@@ -31,7 +31,20 @@
 // Created by Justin Turney on 1/5/16.
 //
 
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
 #include <ambit/helpers/psi4/convert.h>
+#include <ambit/sym_blocked_tensor.h>
 #include <ambit/tensor.h>
 #include <tensor/core/core.h>
 
@@ -44,6 +57,119 @@ namespace helpers
 namespace psi4
 {
 
+namespace
+{
+
+/// Can the data of this tensor be read and written in place?
+bool in_place(const Tensor &tensor)
+{
+    return tensor.type() == CoreTensor || tensor.type() == DiskTensor;
+}
+
+/// Copies nrow rows of ncol elements between two strided row layouts
+void copy_rows(double *const *to_rows, size_t to_offset,
+               const double *const *from_rows, size_t from_offset,
+               size_t nrow, size_t ncol)
+{
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < nrow; ++i)
+        std::memcpy(to_rows[i] + to_offset, from_rows[i] + from_offset,
+                    sizeof(double) * ncol);
+}
+
+/// The rows of a row-major matrix, one pointer each
+std::vector<double *> row_pointers(double *data, size_t nrow, size_t ncol)
+{
+    std::vector<double *> rows(nrow);
+    for (size_t i = 0; i < nrow; ++i)
+        rows[i] = data + i * ncol;
+    return rows;
+}
+
+/// Position of each MO within its irrep, among the MOs of the
+/// SymBlockedTensor spaces
+std::vector<std::map<size_t, size_t>> irrep_positions()
+{
+    std::vector<std::set<size_t>> irrep_mos;
+    for (const SymMOSpace &space : SymBlockedTensor::mo_spaces())
+    {
+        if (irrep_mos.size() < static_cast<size_t>(space.nirrep()))
+            irrep_mos.resize(space.nirrep());
+        for (const auto &mo_irrep : space.mos())
+            irrep_mos[mo_irrep.second].insert(mo_irrep.first);
+    }
+    std::vector<std::map<size_t, size_t>> positions(irrep_mos.size());
+    for (size_t h = 0; h < irrep_mos.size(); ++h)
+    {
+        size_t p = 0;
+        for (size_t mo : irrep_mos[h])
+            positions[h][mo] = p++;
+    }
+    return positions;
+}
+
+/// Calls copy(block, rows, cols) for each block of tensor, in parallel,
+/// with the rows and columns of the matrix irrep blocks that it covers
+template <typename Copy>
+void for_each_irrep_block(const SymBlockedTensor &tensor,
+                          const psi::Matrix &matrix, const std::string &caller,
+                          const Copy &copy)
+{
+    if (tensor.rank() != 2)
+        throw std::runtime_error(caller + ": SymBlockedTensor is not rank 2");
+    if (tensor.symmetry() != matrix.symmetry())
+        throw std::runtime_error(caller + ": Matrix and SymBlockedTensor do "
+                                          "not have the same symmetry");
+
+    std::vector<std::map<size_t, size_t>> positions = irrep_positions();
+    if (positions.size() != static_cast<size_t>(matrix.nirrep()))
+        throw std::runtime_error(caller + ": Matrix and SymBlockedTensor do "
+                                          "not have the same number of "
+                                          "irreps");
+
+    std::vector<std::pair<SymBlockKey, Tensor>> blocks(tensor.blocks().begin(),
+                                                       tensor.blocks().end());
+    std::vector<std::vector<size_t>> rows(blocks.size()), cols(blocks.size());
+    for (size_t b = 0; b < blocks.size(); ++b)
+    {
+        const SymBlockKey &key = blocks[b].first;
+        const std::vector<SymMOSpace> &spaces = SymBlockedTensor::mo_spaces();
+        int hr = key[0].second, hc = key[1].second;
+        for (size_t mo : spaces[key[0].first].mos(hr))
+            rows[b].push_back(positions[hr][mo]);
+        for (size_t mo : spaces[key[1].first].mos(hc))
+            cols[b].push_back(positions[hc][mo]);
+        if ((!rows[b].empty() &&
+             *std::max_element(rows[b].begin(), rows[b].end()) >=
+                 static_cast<size_t>(matrix.rowdim(hr))) ||
+            (!cols[b].empty() &&
+             *std::max_element(cols[b].begin(), cols[b].end()) >=
+                 static_cast<size_t>(matrix.coldim(hc))))
+            throw std::runtime_error(caller + ": the MO spaces of "
+                                              "SymBlockedTensor do not fit "
+                                              "in the Matrix dimensions");
+    }
+
+    std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic)
+    for (size_t b = 0; b < blocks.size(); ++b)
+    {
+        try
+        {
+            copy(blocks[b].first[0].second, blocks[b].second, rows[b],
+                 cols[b]);
+        }
+        catch (...)
+        {
+#pragma omp critical
+            error = std::current_exception();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+}
+
 void convert(const psi::Matrix &matrix, ambit::Tensor *target)
 {
     if (target->rank() != 2)
@@ -65,17 +191,22 @@ void convert(const psi::Matrix &matrix, ambit::Tensor *target)
 
     size_t row = target->dim(0);
     size_t col = target->dim(1);
+    if (!row || !col)
+        return;
 
-    Tensor local_tensor = Tensor::build(CoreTensor, "Local Data", {row, col});
+    Tensor local_tensor = *target;
+    if (!in_place(*target))
+        local_tensor = Tensor::build(CoreTensor, "Local Data", {row, col});
 
-    if (row && col) {
-        // copy data from SharedMatrix to local_tensor
-        std::copy(matrix.pointer()[0], matrix.pointer()[0] + (row * col),
-                  local_tensor.data().begin());
-    }
+    // copy data from the Matrix rows straight into the tensor storage
+    double *data = local_tensor.map_data();
+    copy_rows(row_pointers(data, row, col).data(), 0, matrix.pointer(), 0, row,
+              col);
+    local_tensor.unmap_data();
 
     // Splice data into the target tensor
-    (*target)() = local_tensor();
+    if (!in_place(*target))
+        (*target)() = local_tensor();
 }
 
 void convert(const psi::Vector &vector, ambit::Tensor *target)
@@ -94,15 +225,134 @@ void convert(const psi::Vector &vector, ambit::Tensor *target)
                                  "elements (dim(0))");
 
     size_t row = target->dim(0);
+    if (!row)
+        return;
 
-    Tensor local_tensor = Tensor::build(CoreTensor, "Local Data", {row});
+    Tensor local_tensor = *target;
+    if (!in_place(*target))
+        local_tensor = Tensor::build(CoreTensor, "Local Data", {row});
 
-    // copy data from SharedMatrix to local_tensor
-    std::copy(vector.pointer(), vector.pointer() + (row),
-              local_tensor.data().begin());
+    double *data = local_tensor.map_data();
+    std::memcpy(data, vector.pointer(), sizeof(double) * row);
+    local_tensor.unmap_data();
 
-    // Splice data into the target tensor
-    (*target)() = local_tensor();
+    if (!in_place(*target))
+        (*target)() = local_tensor();
+}
+
+void convert(const ambit::Tensor &tensor, psi::Matrix *target)
+{
+    if (tensor.rank() != 2)
+        throw std::runtime_error(
+            "convert(ambit::Tensor, psi::Matrix): Tensor is not rank 2");
+
+    if (target->nirrep() != 1)
+        throw std::runtime_error("convert(ambit::Tensor, psi::Matrix): Matrix "
+                                 "appears to have symmetry (nirrep != 1)");
+
+    if (target->rowdim() != tensor.dim(0) || target->coldim() != tensor.dim(1))
+        throw std::runtime_error("convert(ambit::Tensor, psi::Matrix): Matrix "
+                                 "and Tensor do not have the same dimensions");
+
+    size_t row = tensor.dim(0);
+    size_t col = tensor.dim(1);
+    if (!row || !col)
+        return;
+
+    Tensor local_tensor = tensor;
+    if (!in_place(tensor))
+    {
+        local_tensor = Tensor::build(CoreTensor, "Local Data", {row, col});
+        local_tensor() = tensor();
+    }
+
+    const double *data = local_tensor.map_data();
+    std::vector<const double *> rows(row);
+    for (size_t i = 0; i < row; ++i)
+        rows[i] = data + i * col;
+    copy_rows(target->pointer(), 0, rows.data(), 0, row, col);
+    local_tensor.unmap_data();
+}
+
+void convert(const ambit::Tensor &tensor, psi::Vector *target)
+{
+    if (tensor.rank() != 1)
+        throw std::runtime_error(
+            "convert(ambit::Tensor, psi::Vector): Tensor is not rank 1");
+
+    if (target->nirrep() != 1)
+        throw std::runtime_error("convert(ambit::Tensor, psi::Vector): Vector "
+                                 "appears to have symmetry (nirrep != 1)");
+
+    if (target->dim() != tensor.dim(0))
+        throw std::runtime_error("convert(ambit::Tensor, psi::Vector): Vector "
+                                 "and Tensor do not have the same number of "
+                                 "elements (dim(0))");
+
+    size_t row = tensor.dim(0);
+    if (!row)
+        return;
+
+    Tensor local_tensor = tensor;
+    if (!in_place(tensor))
+    {
+        local_tensor = Tensor::build(CoreTensor, "Local Data", {row});
+        local_tensor() = tensor();
+    }
+
+    std::memcpy(target->pointer(), local_tensor.map_data(),
+                sizeof(double) * row);
+    local_tensor.unmap_data();
+}
+
+void convert(const psi::Matrix &matrix, ambit::SymBlockedTensor *target)
+{
+    for_each_irrep_block(
+        *target, matrix, "convert(psi::Matrix, ambit::SymBlockedTensor)",
+        [&](int h, Tensor block, const std::vector<size_t> &rows,
+            const std::vector<size_t> &cols) {
+            if (rows.empty() || cols.empty())
+                return;
+            Tensor local_tensor = block;
+            if (!in_place(block))
+                local_tensor = Tensor::build(CoreTensor, "Local Data",
+                                             block.dims());
+
+            double *data = local_tensor.map_data();
+            double **from = matrix.pointer(h);
+            for (size_t p = 0; p < rows.size(); ++p)
+                for (size_t q = 0; q < cols.size(); ++q)
+                    data[p * cols.size() + q] = from[rows[p]][cols[q]];
+            local_tensor.unmap_data();
+
+            if (!in_place(block))
+                block() = local_tensor();
+        });
+}
+
+void convert(const ambit::SymBlockedTensor &tensor, psi::Matrix *target)
+{
+    for_each_irrep_block(
+        tensor, *target, "convert(ambit::SymBlockedTensor, psi::Matrix)",
+        [&](int h, Tensor block, const std::vector<size_t> &rows,
+            const std::vector<size_t> &cols) {
+            if (rows.empty() || cols.empty())
+                return;
+            Tensor local_tensor = block;
+            if (!in_place(block))
+            {
+                local_tensor = Tensor::build(CoreTensor, "Local Data",
+                                             block.dims());
+                local_tensor() = block();
+            }
+
+            const double *data = local_tensor.map_data();
+            double **to = target->pointer(h);
+            for (size_t p = 0; p < rows.size(); ++p)
+                for (size_t q = 0; q < cols.size(); ++q)
+                    to[rows[p]][cols[q]] = data[p * cols.size() + q];
+            local_tensor.unmap_data();
+        });
 }
 
 } // namespace psi4
@@ -0,0 +1,270 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#include <ambit/helpers/psi4/df.h>
+#include <ambit/helpers/psi4/integrals.h>
+#include <ambit/memory.h>
+#include <ambit/settings.h>
+#include <ambit/tensor.h>
+
+namespace ambit
+{
+
+namespace helpers
+{
+
+namespace psi4
+{
+
+namespace
+{
+
+/// The columns of C listed in mos, as a CoreTensor
+Tensor columns(const Tensor &C, const std::vector<size_t> &mos)
+{
+    size_t nbf = C.dim(0);
+    size_t nmo = C.dim(1);
+    Tensor Cs = Tensor::build(CoreTensor, "C", {nbf, mos.size()});
+    const vector<double> &from = C.data();
+    vector<double> &to = Cs.data();
+    for (size_t m = 0; m < nbf; ++m)
+        for (size_t p = 0; p < mos.size(); ++p)
+            to[m * mos.size() + p] = from[m * nmo + mos[p]];
+    return Cs;
+}
+
+/// Computes (P|mn) for the auxiliary functions [first, last) of the shells
+/// [P0, P1) into A (last - first, nbf, nbf), one engine per thread
+void three_index(const std::vector<psi::TwoBodyAOInt *> &engines, int P0,
+                 int P1, size_t first, Tensor &A)
+{
+    const psi::BasisSet &aux = *engines[0]->basis1().get();
+    const psi::BasisSet &primary = *engines[0]->basis3().get();
+    int nshell = primary.nshell();
+    size_t nbf = static_cast<size_t>(primary.nbf());
+    double *data = A.data().data();
+
+    // (P|mn) = (P|nm): only M >= N is computed
+    int npair = nshell * (nshell + 1) / 2;
+#pragma omp parallel for schedule(dynamic) collapse(2)                        \
+    num_threads(engines.size())
+    for (int P = P0; P < P1; ++P)
+    {
+        for (int MN = 0; MN < npair; ++MN)
+        {
+            int thread = 0;
+#if defined(_OPENMP)
+            thread = omp_get_thread_num();
+#endif
+            psi::TwoBodyAOInt &engine = *engines[thread];
+            int M = 0;
+            while ((M + 1) * (M + 2) / 2 <= MN)
+                ++M;
+            int N = MN - M * (M + 1) / 2;
+
+            engine.compute_shell(P, 0, M, N);
+            const double *buffer = engine.buffer();
+
+            int nP = aux.shell(P).nfunction();
+            int nM = primary.shell(M).nfunction();
+            int nN = primary.shell(N).nfunction();
+            size_t startP = aux.shell(P).function_index() - first;
+            size_t startM = primary.shell(M).function_index();
+            size_t startN = primary.shell(N).function_index();
+            size_t pmn = 0;
+            for (int p = 0; p < nP; ++p)
+                for (int m = 0; m < nM; ++m)
+                    for (int n = 0; n < nN; ++n, ++pmn)
+                    {
+                        size_t row = (startP + p) * nbf * nbf;
+                        data[row + (startM + m) * nbf + startN + n] =
+                            buffer[pmn];
+                        data[row + (startN + n) * nbf + startM + m] =
+                            buffer[pmn];
+                    }
+        }
+    }
+}
+}
+
+Tensor df_metric_inverse_sqrt(psi::TwoBodyAOInt &metric, double condition)
+{
+    size_t naux = static_cast<size_t>(metric.basis1()->nbf());
+    Tensor J = Tensor::build(CoreTensor, "(P|Q)", {naux, naux});
+    integrals(metric, &J);
+    return J.power(-0.5, condition);
+}
+
+BlockedTensor df_b_tensor(const std::vector<psi::TwoBodyAOInt *> &engines,
+                          psi::TwoBodyAOInt &metric, const Tensor &C,
+                          const std::string &name,
+                          const std::vector<std::string> &blocks,
+                          TensorType type, size_t memory)
+{
+    if (engines.empty())
+        throw std::runtime_error("df_b_tensor: no integral objects given.");
+    if (C.type() != CoreTensor || C.rank() != 2)
+        throw std::runtime_error(
+            "df_b_tensor: C must be an AO x MO CoreTensor.");
+
+    const psi::BasisSet &aux = *engines[0]->basis1().get();
+    size_t naux = static_cast<size_t>(aux.nbf());
+    size_t nbf = static_cast<size_t>(engines[0]->basis3()->nbf());
+    if (C.dim(0) != nbf)
+        throw std::runtime_error(
+            "df_b_tensor: C does not have a row per basis function.");
+
+    BlockedTensor B = BlockedTensor::build(type, name, blocks);
+    B.zero();
+    if (B.rank() != 3)
+        throw std::runtime_error("df_b_tensor: the blocks must be rank 3.");
+
+    Tensor Jm = df_metric_inverse_sqrt(metric);
+
+    // The coefficients of every MO space, and the rows of (Q|P)^-1/2 of
+    // every auxiliary space
+    std::map<size_t, Tensor> Cs, Js;
+    for (const auto &key_tensor : B.blocks())
+    {
+        const std::vector<size_t> &key = key_tensor.first;
+        for (size_t k = 1; k < 3; ++k)
+        {
+            if (Cs.count(key[k]) == 0)
+                Cs[key[k]] =
+                    columns(C, BlockedTensor::mo_space(key[k]).mos());
+        }
+        if (Js.count(key[0]) == 0)
+        {
+            MOSpace space = BlockedTensor::mo_space(key[0]);
+            const std::vector<size_t> &mos = space.mos();
+            if (!mos.empty() && *std::max_element(mos.begin(), mos.end()) >=
+                                    naux)
+                throw std::runtime_error(
+                    "df_b_tensor: the auxiliary space of block " +
+                    key_tensor.second.name() +
+                    " is larger than the auxiliary basis.");
+            Js[key[0]] = Tensor::build(CoreTensor, "J^-1/2", {mos.size(),
+                                                               naux});
+            const vector<double> &from = Jm.data();
+            vector<double> &to = Js[key[0]].data();
+            for (size_t Q = 0; Q < mos.size(); ++Q)
+                std::copy(from.begin() + mos[Q] * naux,
+                          from.begin() + (mos[Q] + 1) * naux,
+                          to.begin() + Q * naux);
+        }
+    }
+
+    // Bytes per auxiliary function of a batch: its (P|mn), a (P|pn) per
+    // space and a (P|pq) per block, plus its column of each (Q|P)^-1/2
+    size_t per_function = nbf * nbf;
+    for (const auto &s_C : Cs)
+        per_function += s_C.second.dim(1) * nbf;
+    for (const auto &key_tensor : B.blocks())
+        per_function += key_tensor.second.dim(1) * key_tensor.second.dim(2);
+    for (const auto &s_J : Js)
+        per_function += s_J.second.dim(0);
+    per_function *= sizeof(double);
+
+    if (memory == 0)
+    {
+        size_t live = memory::live_bytes();
+        memory = settings::memory_limit > live
+                     ? settings::memory_limit - live
+                     : 0;
+    }
+
+    int nshell = aux.nshell();
+    for (int P0 = 0; P0 < nshell;)
+    {
+        // Take shells while the batch fits (always at least one)
+        int P1 = P0;
+        size_t nbatch = 0;
+        while (P1 < nshell)
+        {
+            size_t n = static_cast<size_t>(aux.shell(P1).nfunction());
+            if (P1 > P0 && (nbatch + n) * per_function > memory)
+                break;
+            nbatch += n;
+            ++P1;
+        }
+        size_t first = static_cast<size_t>(aux.shell(P0).function_index());
+
+        Tensor A = Tensor::build(CoreTensor, "(P|mn)", {nbatch, nbf, nbf});
+        three_index(engines, P0, P1, first, A);
+
+        // Half-transform to (P|pn) for every space of the second index
+        std::map<size_t, Tensor> H;
+        for (const auto &key_tensor : B.blocks())
+        {
+            size_t s = key_tensor.first[1];
+            if (H.count(s))
+                continue;
+            H[s] = Tensor::build(CoreTensor, "(P|pn)",
+                                 {nbatch, Cs[s].dim(1), nbf});
+            H[s]("Ppn") = Cs[s]("mp") * A("Pmn");
+        }
+        A.reset();
+
+        for (auto &key_tensor : B.blocks())
+        {
+            const std::vector<size_t> &key = key_tensor.first;
+            Tensor block = key_tensor.second;
+            Tensor Bp = Tensor::build(CoreTensor, "(P|pq)",
+                                      {nbatch, block.dim(1), block.dim(2)});
+            Bp("Ppq") = H[key[1]]("Ppn") * Cs[key[2]]("nq");
+
+            // The columns of (Q|P)^-1/2 of this batch
+            const Tensor &J = Js[key[0]];
+            Tensor Jb = Tensor::build(CoreTensor, "J^-1/2",
+                                      {J.dim(0), nbatch});
+            Jb.slice(J, {{0, J.dim(0)}, {0, nbatch}},
+                     {{0, J.dim(0)}, {first, first + nbatch}});
+
+            block("Qpq") += Jb("QP") * Bp("Ppq");
+        }
+
+        P0 = P1;
+    }
+
+    return B;
+}
+
+} // namespace psi4
+
+} // namespace helpers
+
+} // namespace ambit
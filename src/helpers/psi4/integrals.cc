@@ -31,8 +31,14 @@
 // Created by Justin Turney on 12/17/15.
 //
 
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
 
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
 #include <ambit/helpers/psi4/integrals.h>
 #include <ambit/tensor.h>
 #include <tensor/core/core.h>
@@ -85,140 +91,311 @@ void integrals(psi::OneBodyAOInt &integral, ambit::Tensor *target)
     }
 }
 
+namespace
+{
+
+/// Schwarz bound sqrt(max |(pq|pq)|) of every shell pair (P,Q) of the bra,
+/// P * nshell2 + Q, computed with the engines in parallel
+vector<double> schwarz_bounds(const vector<psi::TwoBodyAOInt *> &engines)
+{
+    const psi::BasisSet &basis1 = *engines[0]->basis1().get();
+    const psi::BasisSet &basis2 = *engines[0]->basis2().get();
+    int nshell1 = basis1.nshell();
+    int nshell2 = basis2.nshell();
+    vector<double> bounds(static_cast<size_t>(nshell1 * nshell2), 0.0);
+
+#pragma omp parallel for schedule(dynamic) num_threads(engines.size())
+    for (int PQ = 0; PQ < nshell1 * nshell2; ++PQ)
+    {
+        int thread = 0;
+#if defined(_OPENMP)
+        thread = omp_get_thread_num();
+#endif
+        psi::TwoBodyAOInt &engine = *engines[thread];
+        int P = PQ / nshell2;
+        int Q = PQ % nshell2;
+        int nP = basis1.shell(P).nfunction();
+        int nQ = basis2.shell(Q).nfunction();
+        engine.compute_shell(P, Q, P, Q);
+        const double *buffer = engine.buffer();
+
+        double max_value = 0.0;
+        for (int p = 0; p < nP; ++p)
+            for (int q = 0; q < nQ; ++q)
+            {
+                size_t pq = static_cast<size_t>(p * nQ + q);
+                size_t npq = static_cast<size_t>(nP * nQ);
+                max_value =
+                    std::max(max_value, std::fabs(buffer[pq * npq + pq]));
+            }
+        bounds[static_cast<size_t>(PQ)] = std::sqrt(max_value);
+    }
+    return bounds;
+}
+}
+
 void integrals(psi::TwoBodyAOInt &integral, Tensor *target)
 {
-    if (target->type() != CoreTensor)
-        throw std::runtime_error("integrals(TwoBodyAOInt, Tensor) is only "
-                                 "compatible with CoreTensor type");
+    integrals(vector<psi::TwoBodyAOInt *>{&integral}, target, 0.0);
+}
 
-    Dimension max_quartet;
+void integrals(const vector<psi::TwoBodyAOInt *> &engines, Tensor *target,
+               double screening)
+{
+    if (engines.empty())
+        throw std::runtime_error("integrals: no integral objects given.");
 
+    psi::TwoBodyAOInt &integral = *engines[0];
     const psi::BasisSet &basis1 = *integral.basis1().get();
     const psi::BasisSet &basis2 = *integral.basis2().get();
     const psi::BasisSet &basis3 = *integral.basis3().get();
     const psi::BasisSet &basis4 = *integral.basis4().get();
+    const psi::BasisSet *bases[4] = {&basis1, &basis2, &basis3, &basis4};
 
+    // The centers with more than one function are the indices of the target
     int centers_dim[4] = {-1, -1, -1, -1};
+    size_t rank = 0;
+    for (int center = 0; center < 4; ++center)
+    {
+        if (bases[center]->nbf() > 1)
+            centers_dim[center] = static_cast<int>(rank++);
+    }
+
+    if (rank != target->rank())
+        throw std::runtime_error(
+            "TwoBodyAOInt and Tensor do not have same rank.");
 
+    // Element strides of the target for every center (0 for the collapsed
+    // ones, whose only function has index 0)
+    size_t strides[4] = {0, 0, 0, 0};
     {
-        int count = 0;
-        if (basis1.nbf() > 1)
-        {
-            max_quartet.push_back(
-                static_cast<size_t>(basis1.max_function_per_shell()));
-            centers_dim[0] = count++;
-        }
-        if (basis2.nbf() > 1)
-        {
-            max_quartet.push_back(
-                static_cast<size_t>(basis2.max_function_per_shell()));
-            centers_dim[1] = count++;
-        }
-        if (basis3.nbf() > 1)
-        {
-            max_quartet.push_back(
-                static_cast<size_t>(basis3.max_function_per_shell()));
-            centers_dim[2] = count++;
-        }
-        if (basis4.nbf() > 1)
+        size_t stride = 1;
+        for (int center = 3; center >= 0; --center)
         {
-            max_quartet.push_back(
-                static_cast<size_t>(basis4.max_function_per_shell()));
-            centers_dim[3] = count++;
+            if (centers_dim[center] == -1)
+                continue;
+            strides[center] = stride;
+            stride *= target->dim(static_cast<size_t>(centers_dim[center]));
         }
     }
 
-    if (max_quartet.size() != target->rank())
-        throw std::runtime_error(
-            "TwoBodyAOInt and Tensor do not have same rank.");
+    // (PQ|RS) is (QP|RS), (PQ|SR) and (RS|PQ) when the four basis sets are
+    // one, so only the canonical quartets P >= Q, R >= S, PQ >= RS are
+    // computed. Schwarz screening needs the bra and ket pairs to be the
+    // same, so that (PQ|PQ) is at hand.
+    bool symmetric = integral.basis1() == integral.basis2() &&
+                     integral.basis1() == integral.basis3() &&
+                     integral.basis1() == integral.basis4() && rank == 4;
+    bool screen = screening > 0.0 &&
+                  integral.basis1() == integral.basis3() &&
+                  integral.basis2() == integral.basis4();
+    vector<double> bounds;
+    if (screen)
+        bounds = schwarz_bounds(engines);
+
+    int nshell1 = basis1.nshell();
+    int nshell2 = basis2.nshell();
+    int nshell3 = basis3.nshell();
+    int nshell4 = basis4.nshell();
+    auto negligible = [&](int P, int Q, int R, int S) {
+        return screen && bounds[static_cast<size_t>(P * nshell2 + Q)] *
+                                 bounds[static_cast<size_t>(R * nshell4 + S)] <
+                             screening;
+    };
+
+    // Writes a computed quartet, and its permutations when symmetric, to
+    // data (with the strides of the target)
+    auto at = [&](size_t i, size_t j, size_t k, size_t l) {
+        return i * strides[0] + j * strides[1] + k * strides[2] +
+               l * strides[3];
+    };
+    auto store = [&](double *data, const double *buffer, int P, int Q, int R,
+                     int S) {
+        int n[4] = {basis1.shell(P).nfunction(), basis2.shell(Q).nfunction(),
+                    basis3.shell(R).nfunction(), basis4.shell(S).nfunction()};
+        size_t start[4] = {
+            static_cast<size_t>(basis1.shell(P).function_index()),
+            static_cast<size_t>(basis2.shell(Q).function_index()),
+            static_cast<size_t>(basis3.shell(R).function_index()),
+            static_cast<size_t>(basis4.shell(S).function_index())};
+        size_t pqrs = 0;
+        for (int p = 0; p < n[0]; ++p)
+            for (int q = 0; q < n[1]; ++q)
+                for (int r = 0; r < n[2]; ++r)
+                    for (int s = 0; s < n[3]; ++s, ++pqrs)
+                    {
+                        size_t i = start[0] + p, j = start[1] + q,
+                               k = start[2] + r, l = start[3] + s;
+                        double value = buffer[pqrs];
+                        data[at(i, j, k, l)] = value;
+                        if (!symmetric)
+                            continue;
+                        data[at(i, j, l, k)] = value;
+                        data[at(j, i, k, l)] = value;
+                        data[at(j, i, l, k)] = value;
+                        data[at(k, l, i, j)] = value;
+                        data[at(l, k, i, j)] = value;
+                        data[at(k, l, j, i)] = value;
+                        data[at(l, k, j, i)] = value;
+                    }
+    };
 
-    // Allocate local CoreTensor that can hold a quartets worth
-    // of integrals.
-    Tensor local_tensor = Tensor::build(CoreTensor, "Local Data", max_quartet);
+    auto canonical = [&](int P, int Q, int R, int S) {
+        return !symmetric ||
+               (P >= Q && R >= S && P * nshell2 + Q >= R * nshell4 + S);
+    };
 
-    IndexRange target_range(target->rank());
-    IndexRange local_range(target->rank());
+    int nthread = static_cast<int>(engines.size());
+    bool distributed = target->type() == DistributedTensor;
 
-    for (int i = 0; i < target->rank(); i++)
-    {
-        target_range[i] = {0L, 0L};
-        local_range[i] = {0L, 0L};
-    }
+    // Screened quartets are not written, so the target starts from zero
+    target->zero();
 
-    const double *buffer = integral.buffer();
-    for (int P = 0; P < basis1.nshell(); P++)
+    if (!distributed)
     {
-        int nP = basis1.shell(P).nfunction();
-        int startP = basis1.shell(P).function_index();
-        if (centers_dim[0] != -1)
+        // Each thread has its own integral object and writes its quartets
+        // straight into the target (through the mapping of a DiskTensor);
+        // the quartets are disjoint, their permutations included
+        double *data = target->map_data();
+
+#pragma omp parallel for schedule(dynamic) num_threads(nthread)
+        for (int PQ = 0; PQ < nshell1 * nshell2; ++PQ)
         {
-            max_quartet[centers_dim[0]] = static_cast<size_t>(nP);
-            target_range[centers_dim[0]][0] = static_cast<size_t>(startP);
-            target_range[centers_dim[0]][1] = static_cast<size_t>(startP + nP);
-            local_range[centers_dim[0]][1] = static_cast<size_t>(nP);
+            int thread = 0;
+#if defined(_OPENMP)
+            thread = omp_get_thread_num();
+#endif
+            psi::TwoBodyAOInt &engine = *engines[thread];
+            const double *buffer = engine.buffer();
+            int P = PQ / nshell2;
+            int Q = PQ % nshell2;
+            for (int R = 0; R < nshell3; ++R)
+                for (int S = 0; S < nshell4; ++S)
+                {
+                    if (!canonical(P, Q, R, S) || negligible(P, Q, R, S))
+                        continue;
+                    engine.compute_shell(P, Q, R, S);
+                    store(data, buffer, P, Q, R, S);
+                }
         }
+        target->unmap_data();
+        return;
+    }
 
-        for (int Q = 0; Q < basis2.nshell(); Q++)
+    // A distributed target has its quartets shared out over the processes,
+    // and the quartets of each (P,Q) pair go out as one batch, so the target
+    // sees one collective per shell pair rather than one per quartet. The
+    // quartets of a batch are computed by the threads into pieces of their
+    // own.
+    size_t quartet = 0L;
+    for (int P = 0; P < nshell1; ++P)
+    {
+        for (int Q = 0; Q < nshell2; ++Q)
         {
-            int nQ = basis2.shell(Q).nfunction();
-            int startQ = basis2.shell(Q).function_index();
-            if (centers_dim[1] != -1)
-            {
-                max_quartet[centers_dim[1]] = static_cast<size_t>(nQ);
-                target_range[centers_dim[1]][0] = static_cast<size_t>(startQ);
-                target_range[centers_dim[1]][1] =
-                    static_cast<size_t>(startQ + nQ);
-                local_range[centers_dim[1]][1] = static_cast<size_t>(nQ);
-            }
+            vector<std::pair<int, int>> mine;
+            for (int R = 0; R < nshell3; ++R)
+                for (int S = 0; S < nshell4; ++S)
+                {
+                    if (!canonical(P, Q, R, S))
+                        continue;
+                    if (static_cast<int>(quartet++ % settings::nprocess) !=
+                        settings::rank)
+                        continue;
+                    if (!negligible(P, Q, R, S))
+                        mine.push_back({R, S});
+                }
+
+            // Every piece covers the target ranges its quartet (and, when
+            // symmetric, each permutation of it) writes
+            vector<Tensor> pieces(mine.size());
+            vector<IndexRange> target_ranges(mine.size());
+            vector<IndexRange> piece_ranges(mine.size());
 
-            for (int R = 0; R < basis3.nshell(); R++)
+#pragma omp parallel for schedule(dynamic) num_threads(nthread)
+            for (size_t m = 0; m < mine.size(); ++m)
             {
-                int nR = basis3.shell(R).nfunction();
-                int startR = basis3.shell(R).function_index();
-                if (centers_dim[2] != -1)
+                int thread = 0;
+#if defined(_OPENMP)
+                thread = omp_get_thread_num();
+#endif
+                psi::TwoBodyAOInt &engine = *engines[thread];
+                int R = mine[m].first;
+                int S = mine[m].second;
+                const psi::GaussianShell *shells[4] = {
+                    &basis1.shell(P), &basis2.shell(Q), &basis3.shell(R),
+                    &basis4.shell(S)};
+
+                Dimension dims;
+                IndexRange target_range, piece_range;
+                for (int center = 0; center < 4; ++center)
                 {
-                    max_quartet[centers_dim[2]] = static_cast<size_t>(nR);
-                    target_range[centers_dim[2]][0] =
-                        static_cast<size_t>(startR);
-                    target_range[centers_dim[2]][1] =
-                        static_cast<size_t>(startR + nR);
-                    local_range[centers_dim[2]][1] = static_cast<size_t>(nR);
+                    if (centers_dim[center] == -1)
+                        continue;
+                    size_t n = static_cast<size_t>(shells[center]->nfunction());
+                    size_t start =
+                        static_cast<size_t>(shells[center]->function_index());
+                    dims.push_back(n);
+                    target_range.push_back({start, start + n});
+                    piece_range.push_back({0L, n});
                 }
 
-                for (int S = 0; S < basis4.nshell(); S++)
+                engine.compute_shell(P, Q, R, S);
+                const double *buffer = engine.buffer();
+                Tensor piece = Tensor::build(CoreTensor, "Local Data", dims);
+                std::copy(buffer, buffer + piece.numel(),
+                          piece.data().begin());
+
+                pieces[m] = piece;
+                target_ranges[m] = target_range;
+                piece_ranges[m] = piece_range;
+            }
+
+            if (symmetric)
+            {
+                // the other seven permutations of each quartet go out as
+                // permuted copies
+                size_t nmine = pieces.size();
+                const vector<Indices> perms = {
+                    {"p", "q", "s", "r"}, {"q", "p", "r", "s"},
+                    {"q", "p", "s", "r"}, {"r", "s", "p", "q"},
+                    {"s", "r", "p", "q"}, {"r", "s", "q", "p"},
+                    {"s", "r", "q", "p"}};
+                const Indices pqrs = {"p", "q", "r", "s"};
+                for (size_t m = 0; m < nmine; ++m)
                 {
-                    int nS = basis4.shell(S).nfunction();
-                    int startS = basis4.shell(S).function_index();
-                    if (centers_dim[3] != -1)
+                    // a permutation that lands on ranges already sent (P ==
+                    // Q, R == S or PQ == RS) is skipped, so the ranges of a
+                    // batch stay disjoint
+                    vector<IndexRange> sent = {target_ranges[m]};
+                    for (const Indices &perm : perms)
                     {
-                        max_quartet[centers_dim[3]] = static_cast<size_t>(nS);
-                        target_range[centers_dim[3]][0] =
-                            static_cast<size_t>(startS);
-                        target_range[centers_dim[3]][1] =
-                            static_cast<size_t>(startS + nS);
-                        local_range[centers_dim[3]][1] =
-                            static_cast<size_t>(nS);
+                        // perm names, for each index of the copy, the
+                        // index of the piece it runs over
+                        Dimension dims(4);
+                        IndexRange target_range(4), piece_range(4);
+                        for (size_t d = 0; d < 4; ++d)
+                        {
+                            size_t from = static_cast<size_t>(
+                                perm[d][0] - 'p');
+                            dims[d] = pieces[m].dim(from);
+                            target_range[d] = target_ranges[m][from];
+                            piece_range[d] = piece_ranges[m][from];
+                        }
+                        if (std::find(sent.begin(), sent.end(),
+                                      target_range) != sent.end())
+                            continue;
+                        sent.push_back(target_range);
+                        Tensor copy =
+                            Tensor::build(CoreTensor, "Local Data", dims);
+                        copy.permute(pieces[m], perm, pqrs);
+                        pieces.push_back(copy);
+                        target_ranges.push_back(target_range);
+                        piece_ranges.push_back(piece_range);
                     }
-
-                    // Have Psi4 compute the integral
-                    integral.compute_shell(P, Q, R, S);
-
-                    // Unfortunately we have to perform a memcpy :(
-                    // from Psi4 integral buffer to local_tensor
-                    std::copy(buffer, buffer + (nP * nQ * nR * nS),
-                              local_tensor.data().begin());
-
-                    // "reshape" the local tensor
-                    local_tensor.reshape(max_quartet);
-
-                    // Slice the data from local_tensor into the target.
-                    // For CoreTensor this isn't the optimal procedure to
-                    // follow.
-                    // However, this is similar to the parallel scheme that will
-                    // follow.
-                    (*target)(target_range) = local_tensor(local_range);
                 }
             }
+
+            target->scatter(pieces, target_ranges, piece_ranges);
         }
     }
 }
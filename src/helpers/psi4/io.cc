@@ -41,7 +41,7 @@ namespace psi4
 void load_matrix(const std::string &fn, const std::string &entry,
                  Tensor &target)
 {
-    timer::timer_push("ambit::helpers::psi4::load_matrix");
+    AMBIT_TIMER_PUSH("ambit::helpers::psi4::load_matrix");
     if (settings::rank == 0)
     {
         io::psi4::File handle(fn, io::psi4::kOpenModeOpenExisting);
@@ -65,12 +65,12 @@ void load_matrix(const std::string &fn, const std::string &entry,
 
         target(zero_range) = local_data(zero_range);
     }
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
 }
 
 void load_iwl(const std::string &fn, Tensor &target)
 {
-    timer::timer_push("ambit::helpers::psi4::load_iwl");
+    AMBIT_TIMER_PUSH("ambit::helpers::psi4::load_iwl");
     if (settings::rank == 0)
     {
         Tensor local_data = Tensor::build(CoreTensor, "g", target.dims());
@@ -93,7 +93,7 @@ void load_iwl(const std::string &fn, Tensor &target)
 
         target(zero_range) = local_data(zero_range);
     }
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
 }
 }
 }
@@ -32,3 +32,197 @@
 //
 
 #include <ambit/io/hdf5/dataset.h>
+#include <ambit/settings.h>
+
+namespace ambit
+{
+
+namespace io
+{
+
+namespace hdf5
+{
+
+namespace detail
+{
+
+namespace
+{
+
+/// Filter id registered for Blosc
+const H5Z_filter_t blosc_filter = 32001;
+
+/// Bytes in a chunk chosen for a compressed dataset
+const size_t chunk_bytes = 1024 * 1024;
+
+void require_filter(H5Z_filter_t filter, const string &name)
+{
+    if (H5Zfilter_avail(filter) <= 0)
+        throw std::runtime_error("HDF5 " + name +
+                                 " filter is not available.");
+    unsigned int info = 0;
+    H5Zget_filter_info(filter, &info);
+    if (!(info & H5Z_FILTER_CONFIG_ENCODE_ENABLED))
+        throw std::runtime_error("HDF5 " + name +
+                                 " filter cannot compress.");
+}
+}
+
+bool parallel()
+{
+#if defined(HAVE_MPI) && defined(H5_HAVE_PARALLEL)
+    return settings::nprocess > 1;
+#else
+    return false;
+#endif
+}
+
+hid_t creation_properties(const Dimension &dims, const Storage &storage)
+{
+    hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+
+    Dimension chunk(storage.chunk);
+    if (chunk.empty() && storage.compression != kCompressionNone)
+    {
+        // Whole trailing dimensions, as few rows of the leading ones as
+        // bring a chunk down to about chunk_bytes
+        chunk = dims;
+        size_t bytes = sizeof(double);
+        for (size_t dim : chunk)
+            bytes *= dim;
+        for (size_t ind = 0; ind < chunk.size() && bytes > chunk_bytes; ++ind)
+        {
+            size_t shrink = std::min(chunk[ind], (bytes - 1) / chunk_bytes + 1);
+            bytes /= chunk[ind];
+            chunk[ind] = std::max<size_t>(chunk[ind] / shrink, 1L);
+            bytes *= chunk[ind];
+        }
+    }
+
+    bool empty = dims.empty();
+    for (size_t dim : dims)
+        empty = empty || dim == 0;
+    if (chunk.empty() || empty)
+    {
+        if (storage.compression != kCompressionNone && dims.empty())
+        {
+            H5Pclose(dcpl);
+            throw std::runtime_error(
+                "HDF5 datasets of rank 0 cannot be compressed.");
+        }
+        return dcpl;
+    }
+    if (chunk.size() != dims.size())
+    {
+        H5Pclose(dcpl);
+        throw std::runtime_error(
+            "HDF5 chunk and dataset have different ranks.");
+    }
+
+    vector<hsize_t> cchunk;
+    for (size_t ind = 0; ind < chunk.size(); ++ind)
+        cchunk.push_back(std::max<size_t>(std::min(chunk[ind], dims[ind]), 1L));
+    H5Pset_chunk(dcpl, static_cast<int>(cchunk.size()), cchunk.data());
+
+    try
+    {
+        switch (storage.compression)
+        {
+        case kCompressionNone:
+            break;
+
+        case kCompressionGzip:
+            require_filter(H5Z_FILTER_DEFLATE, "gzip");
+            H5Pset_shuffle(dcpl);
+            H5Pset_deflate(dcpl, storage.level);
+            break;
+
+        case kCompressionSzip:
+            require_filter(H5Z_FILTER_SZIP, "szip");
+            H5Pset_szip(dcpl, H5_SZIP_NN_OPTION_MASK, 16);
+            break;
+
+        case kCompressionBlosc:
+        {
+            require_filter(blosc_filter, "blosc");
+            // The first four values are filled in by the filter; then the
+            // level, byte shuffling and the blosclz compressor
+            unsigned int values[7] = {0, 0, 0, 0, storage.level, 1, 0};
+            H5Pset_filter(dcpl, blosc_filter, H5Z_FLAG_OPTIONAL, 7, values);
+            break;
+        }
+        }
+    }
+    catch (...)
+    {
+        H5Pclose(dcpl);
+        throw;
+    }
+
+    return dcpl;
+}
+
+hid_t transfer_properties()
+{
+#if defined(HAVE_MPI) && defined(H5_HAVE_PARALLEL)
+    if (parallel())
+    {
+        hid_t dxpl = H5Pcreate(H5P_DATASET_XFER);
+        H5Pset_dxpl_mpio(dxpl, H5FD_MPIO_COLLECTIVE);
+        return dxpl;
+    }
+#endif
+    return H5P_DEFAULT;
+}
+
+void select(hid_t space, const IndexRange &range, bool select)
+{
+    bool empty = !select;
+    for (const vector<size_t> &r : range)
+        empty = empty || r[1] == r[0];
+    if (empty)
+    {
+        H5Sselect_none(space);
+        return;
+    }
+    if (range.empty())
+    {
+        H5Sselect_all(space);
+        return;
+    }
+
+    vector<hsize_t> start, count;
+    for (const vector<size_t> &r : range)
+    {
+        start.push_back(r[0]);
+        count.push_back(r[1] - r[0]);
+    }
+    if (H5Sselect_hyperslab(space, H5S_SELECT_SET, start.data(), nullptr,
+                            count.data(), nullptr) < 0)
+        throw std::runtime_error("Unable to select HDF5 hyperslab.");
+}
+
+vector<IndexRange> row_shares(const IndexRange &range, int nprocess)
+{
+    vector<IndexRange> shares(static_cast<size_t>(nprocess), range);
+    if (range.empty())
+        return shares;
+
+    size_t rows = range[0][1] - range[0][0];
+    size_t start = range[0][0];
+    for (size_t p = 0; p < shares.size(); ++p)
+    {
+        size_t size = rows / shares.size() + (p < rows % shares.size());
+        shares[p][0] = {start, start + size};
+        start += size;
+    }
+    return shares;
+}
+
+} // namespace detail
+
+} // namespace hdf5
+
+} // namespace io
+
+} // namespace ambit
@@ -32,7 +32,9 @@
 //
 
 #include <ambit/io/hdf5/file.h>
+#include <ambit/io/hdf5/dataset.h>
 #include <ambit/print.h>
+#include <tensor/globals.h>
 
 namespace ambit {
 
@@ -55,10 +57,23 @@ void File::open(const string& filename, OpenMode om, DeleteMode dm)
 {
     delete_mode_ = dm;
 
+    // Under MPI every process opens the file together, through MPI-IO
+    hid_t fapl = H5P_DEFAULT;
+#if defined(HAVE_MPI) && defined(H5_HAVE_PARALLEL)
+    if (detail::parallel())
+    {
+        fapl = H5Pcreate(H5P_FILE_ACCESS);
+        H5Pset_fapl_mpio(fapl, globals::communicator, MPI_INFO_NULL);
+    }
+#endif
+
     if (om == kOpenModeCreateNew)
-        id_ = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        id_ = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
     else
-        id_ = H5Fopen(filename.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+        id_ = H5Fopen(filename.c_str(), H5F_ACC_RDWR, fapl);
+
+    if (fapl != H5P_DEFAULT)
+        H5Pclose(fapl);
 }
 
 void File::close()
@@ -30,6 +30,8 @@
 #include <ambit/io/psi4/file.h>
 
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <cstdlib>
 #include <cerrno>
@@ -96,19 +98,14 @@ unsigned int Manager::size() const
 
 bool Manager::exists(const std::string& key) const
 {
-    for (const Entry& e : contents_) {
-        if (key == e.key)
-            return true;
-    }
-    return false;
+    return index_.count(key) != 0;
 }
 
 Entry& Manager::entry(const std::string& key)
 {
-    for (Entry& e : contents_) {
-        if (key == e.key)
-            return e;
-    }
+    auto found = index_.find(key);
+    if (found != index_.end())
+        return contents_[found->second];
 
     // if we get here then we didn't find it.
     // take the last entry and use its end address
@@ -120,9 +117,10 @@ Entry& Manager::entry(const std::string& key)
     if (contents_.size() == 0)
         e.start_address = {0, sizeof(uint64_t)};
     else
-        e.start_address = contents_.end()->end_address;
+        e.start_address = contents_.back().end_address;
     e.end_address = util::get_address(e.start_address, sizeof(Entry));
 
+    index_[e.key] = contents_.size();
     contents_.push_back(e);
     return contents_.back();
 }
@@ -179,6 +177,7 @@ void Manager::read()
 
     // clear out existing vector
     contents_.clear();
+    index_.clear();
     if (len) {
         Address zero = {0, 0};
         Address add;
@@ -189,6 +188,7 @@ void Manager::read()
             Entry new_entry;
             owner_.read(&new_entry, add, 1);
 
+            index_[new_entry.key] = contents_.size();
             contents_.push_back(new_entry);
             add = new_entry.end_address;
         }
@@ -263,6 +263,7 @@ void File::close()
 {
     if (handle_ != -1) {
         toc_.finalize();
+        unmap();
         ::close(handle_);
 
         if (delete_mode_ == kDeleteModeDeleteOnClose)
@@ -332,16 +333,60 @@ int File::seek(uint64_t page, uint64_t offset)
     return 0;
 }
 
-void File::read_raw(void *buffer, const Address& add, uint64_t size)
+namespace {
+/// The byte of the file at an address
+off_t file_offset(const Address& add)
 {
-    uint64_t error_code;
+    return static_cast<off_t>(add.page * kIOPageLength + add.offset);
+}
+}
 
-    // seek to the needed address
-    seek(add);
+const char *File::mapped(const Address& add, uint64_t size)
+{
+    uint64_t end = static_cast<uint64_t>(file_offset(add)) + size;
+    if (end > map_size_) {
+        // map the whole file as it is now
+        struct stat info;
+        if (::fstat(handle_, &info) != 0 ||
+            static_cast<uint64_t>(info.st_size) < end)
+            return nullptr;
+        void *map = ::mmap(nullptr, static_cast<size_t>(info.st_size),
+                           PROT_READ, MAP_SHARED, handle_, 0);
+        if (map == MAP_FAILED)
+            return nullptr;
+        if (map_ != nullptr)
+            retired_maps_.push_back({map_, map_size_});
+        map_ = static_cast<char *>(map);
+        map_size_ = static_cast<uint64_t>(info.st_size);
+    }
+    return map_ + file_offset(add);
+}
 
-    error_code = ::read(handle_, buffer, size);
-    if (error_code != size) {
-        printf("size = %zu error_code %zu\n", size, error_code);
+void File::unmap()
+{
+    if (map_ != nullptr)
+        ::munmap(map_, static_cast<size_t>(map_size_));
+    for (const auto& map_size : retired_maps_)
+        ::munmap(map_size.first, static_cast<size_t>(map_size.second));
+    map_ = nullptr;
+    map_size_ = 0;
+    retired_maps_.clear();
+}
+
+void File::read_raw(void *buffer, const Address& add, uint64_t size)
+{
+    // repeated reads of an entry come from the page cache without a system
+    // call each
+    const char *data = mapped(add, size);
+    if (data != nullptr) {
+        ::memcpy(buffer, data, size);
+        read_stat_ += size;
+        return;
+    }
+
+    ssize_t error_code = ::pread(handle_, buffer, size, file_offset(add));
+    if (error_code < 0 || static_cast<uint64_t>(error_code) != size) {
+        printf("size = %zu error_code %zd\n", size, error_code);
         error(kIOErrorRead);
     }
     read_stat_ += size;
@@ -349,14 +394,9 @@ void File::read_raw(void *buffer, const Address& add, uint64_t size)
 
 void File::write_raw(const void *buffer, const Address& add, uint64_t size)
 {
-    uint64_t error_code;
-
-    // seek to the needed address
-    seek(add);
-
-    error_code = ::write(handle_, buffer, size);
-    if (error_code != size)
-        error(kIOErrorRead);
+    ssize_t error_code = ::pwrite(handle_, buffer, size, file_offset(add));
+    if (error_code < 0 || static_cast<uint64_t>(error_code) != size)
+        error(kIOErrorWrite);
 
     write_stat_ += size;
 }
@@ -28,8 +28,16 @@
  */
 
 #include <ambit/io/psi4/iwl.h>
+#include <ambit/blocked_tensor.h>
+
+#include <algorithm>
+#include <future>
 #include <stdexcept>
 
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
 namespace ambit
 {
 namespace io
@@ -115,7 +123,7 @@ void IWL::read_one(File& io, const std::string& label, Tensor& tensor)
     // psi stores lower triangle full block (may be symmetry blocked, but we
     // don't care).
 
-    std::vector<double>& data = tensor.data();
+    double* data = tensor.map_data();
     size_t n = tensor.dims()[0];
     size_t ntri = n * (n + 1) / 2;
 
@@ -131,12 +139,83 @@ void IWL::read_one(File& io, const std::string& label, Tensor& tensor)
     }
 }
 
+void IWL::fetch(details::Batch& batch)
+{
+    constexpr int per_buffer = details::integrals_per_buffer__;
+
+    for (int buffer = 0; buffer < details::buffers_per_batch__; ++buffer) {
+        int last = 0, n = 0;
+        read_entry_stream(details::buffer_key__, read_position_, &last, 1);
+        read_entry_stream(details::buffer_key__, read_position_, &n, 1);
+
+        if (!psi34_compatible_)
+            throw std::runtime_error("Not implemented");
+
+        // read in place at the end of the batch and keep the n valid ones
+        size_t size = batch.values.size();
+        batch.labels.resize(4 * (size + per_buffer));
+        batch.values.resize(size + per_buffer);
+        read_entry_stream(details::buffer_key__, read_position_,
+                          batch.labels.data() + 4 * size, 4 * per_buffer);
+        read_entry_stream(details::buffer_key__, read_position_,
+                          batch.values.data() + size, per_buffer);
+        batch.labels.resize(4 * (size + n));
+        batch.values.resize(size + n);
+
+        batch.last = last != 0;
+        if (batch.last)
+            break;
+    }
+}
+
+void IWL::read_batches(IWL& io,
+                       const std::function<void(const details::Batch&)>& scatter)
+{
+    // the buffer fetched last is the first of the batches
+    details::Batch current;
+    current.labels.assign(io.labels_.begin(),
+                          io.labels_.begin() + 4 * io.nintegral);
+    current.values.assign(io.values.begin(),
+                          io.values.begin() + io.nintegral);
+    current.last = io.last_buffer != 0;
+
+    while (true) {
+        std::future<details::Batch> next;
+        if (!current.last)
+            next = std::async(std::launch::async, [&io]() {
+                details::Batch batch;
+                io.fetch(batch);
+                return batch;
+            });
+
+        scatter(current);
+
+        if (!next.valid())
+            break;
+        current = next.get();
+    }
+
+    // the stream is consumed
+    *(int *) &io.last_buffer = 1;
+    *(int *) &io.nintegral = 0;
+}
+
 namespace {
 size_t position(size_t dim, short int p, short int q, short int r, short int s)
 {
     //    return ((p * dim + q) * dim + r) * dim + s;
     return p * dim * dim * dim + q * dim * dim + r * dim + s;
 }
+
+/// The 8 permutations of (pq|rs) that share its value
+void permutations(const short int *pqrs, short int perms[8][4])
+{
+    short int p = pqrs[0], q = pqrs[1], r = pqrs[2], s = pqrs[3];
+    short int all[8][4] = {{p, q, r, s}, {p, q, s, r}, {q, p, r, s},
+                           {q, p, s, r}, {r, s, p, q}, {r, s, q, p},
+                           {s, r, p, q}, {s, r, q, p}};
+    std::copy(&all[0][0], &all[0][0] + 32, &perms[0][0]);
+}
 }
 
 void IWL::read_two(IWL& io, Tensor& tensor)
@@ -154,37 +233,130 @@ void IWL::read_two(IWL& io, Tensor& tensor)
 
     // psi stores 1 of the 8 possible permutations
 
-    std::vector<double>& values = tensor.data();
-
-    size_t count = 0;
-    do {
-        size_t c = 0;
-
-        for (int i = 0; i < io.nintegral; ++i) {
-            short int p, q, r, s;
-            p = io.p[i];
-            q = io.q[i];
-            r = io.r[i];
-            s = io.s[i];
-
-            values[position(dim, p, q, r, s)] = io.values[i];
-            values[position(dim, p, q, s, r)] = io.values[i];
-            values[position(dim, q, p, r, s)] = io.values[i];
-            values[position(dim, q, p, s, r)] = io.values[i];
-            values[position(dim, r, s, p, q)] = io.values[i];
-            values[position(dim, r, s, q, p)] = io.values[i];
-            values[position(dim, s, r, p, q)] = io.values[i];
-            values[position(dim, s, r, q, p)] = io.values[i];
+    double* values = tensor.map_data();
+
+    read_batches(io, [&](const details::Batch& batch) {
+        size_t nintegral = batch.values.size();
+
+        // each thread writes the permutations whose leading index falls in
+        // its share of [0, dim), so no two threads touch the same slab
+#pragma omp parallel
+        {
+            size_t nthread = 1, thread = 0;
+#if defined(_OPENMP)
+            nthread = static_cast<size_t>(omp_get_num_threads());
+            thread = static_cast<size_t>(omp_get_thread_num());
+#endif
+            size_t first = dim * thread / nthread;
+            size_t last = dim * (thread + 1) / nthread;
+
+            short int perms[8][4];
+            for (size_t i = 0; i < nintegral; ++i) {
+                permutations(&batch.labels[4 * i], perms);
+                for (const auto& pqrs : perms) {
+                    size_t p = static_cast<size_t>(pqrs[0]);
+                    if (p < first || p >= last)
+                        continue;
+                    values[position(dim, pqrs[0], pqrs[1], pqrs[2], pqrs[3])] =
+                            batch.values[i];
+                }
+            }
         }
+    });
+}
 
-        count += c;
+void IWL::read_two(IWL& io, BlockedTensor& tensor)
+{
+    if (tensor.rank() != 4)
+        throw std::runtime_error("tensor must be rank 4");
 
-        values.resize(c);
+    // the blocks that own storage, with the position of every orbital in
+    // each of their four spaces (-1 if absent)
+    struct Target
+    {
+        double *data;
+        std::vector<long int> position[4];
+        size_t stride[4];
+    };
+    std::vector<Target> targets;
+    for (const auto& key_tensor : tensor.blocks()) {
+        if (tensor.is_alias(key_tensor.first))
+            continue;
+        Tensor block = key_tensor.second;
+        Target target;
+        target.data = block.map_data();
+        for (size_t k = 0; k < 4; ++k) {
+            MOSpace space = BlockedTensor::mo_space(key_tensor.first[k]);
+            const std::vector<size_t>& mos = space.mos();
+            for (size_t n = 0; n < mos.size(); ++n) {
+                if (mos[n] >= target.position[k].size())
+                    target.position[k].resize(mos[n] + 1, -1L);
+                target.position[k][mos[n]] = static_cast<long int>(n);
+            }
+        }
+        target.stride[3] = 1;
+        for (size_t k = 3; k > 0; --k)
+            target.stride[k - 1] = target.stride[k] * block.dim(k);
+        targets.push_back(std::move(target));
+    }
 
-        if (io.last_buffer)
-            break;
-        io.fetch();
-    } while (1);
+    read_batches(io, [&](const details::Batch& batch) {
+        size_t nintegral = batch.values.size();
+
+        // a thread owns a block for the whole batch
+#pragma omp parallel for schedule(dynamic)
+        for (size_t b = 0; b < targets.size(); ++b) {
+            const Target& target = targets[b];
+            short int perms[8][4];
+            for (size_t i = 0; i < nintegral; ++i) {
+                permutations(&batch.labels[4 * i], perms);
+                for (const auto& pqrs : perms) {
+                    size_t offset = 0;
+                    bool inside = true;
+                    for (size_t k = 0; k < 4 && inside; ++k) {
+                        size_t mo = static_cast<size_t>(pqrs[k]);
+                        inside = mo < target.position[k].size() &&
+                                 target.position[k][mo] >= 0;
+                        if (inside)
+                            offset += target.stride[k] *
+                                      static_cast<size_t>(target.position[k][mo]);
+                    }
+                    if (inside)
+                        target.data[offset] = batch.values[i];
+                }
+            }
+        }
+    });
+}
+
+void IWL::read_two_packed(IWL& io, Tensor& tensor, size_t n)
+{
+    size_t npair = n * (n + 1) / 2;
+    if (tensor.rank() != 1 || tensor.dim(0) != npair * (npair + 1) / 2)
+        throw std::runtime_error(
+                "tensor must be rank 1 with npair * (npair + 1) / 2 elements");
+
+    double* values = tensor.map_data();
+
+    read_batches(io, [&](const details::Batch& batch) {
+        long int nintegral = static_cast<long int>(batch.values.size());
+
+        // the permutations of an integral share its packed position, so
+        // every integral lands on a position of its own
+#pragma omp parallel for schedule(static)
+        for (long int i = 0; i < nintegral; ++i) {
+            const short int* pqrs = &batch.labels[4 * i];
+            size_t p = std::max(pqrs[0], pqrs[1]);
+            size_t q = std::min(pqrs[0], pqrs[1]);
+            size_t r = std::max(pqrs[2], pqrs[3]);
+            size_t s = std::min(pqrs[2], pqrs[3]);
+            size_t pq = p * (p + 1) / 2 + q;
+            size_t rs = r * (r + 1) / 2 + s;
+            size_t pqrs_packed = pq >= rs ? pq * (pq + 1) / 2 + rs
+                                          : rs * (rs + 1) / 2 + pq;
+            values[pqrs_packed] = batch.values[i];
+        }
+    });
 }
 }
 }
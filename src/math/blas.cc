@@ -51,6 +51,7 @@
 // => BLAS level 2/3 <=
 #define F_DGBMV FC_GLOBAL(dgbmv, DGBMV)
 #define F_DGEMM FC_GLOBAL(dgemm, DGEMM)
+#define F_SGEMM FC_GLOBAL(sgemm, SGEMM)
 #define F_DGEMV FC_GLOBAL(dgemv, DGEMV)
 #define F_DGER FC_GLOBAL(dger, DGER)
 #define F_DSBMV FC_GLOBAL(dsbmv, DSBMV)
@@ -105,6 +106,8 @@ extern void F_DGBMV(char *, int *, int *, int *, int *, double *, double *,
                     int *, double *, int *, double *, double *, int *);
 extern void F_DGEMM(char *, char *, int *, int *, int *, double *, double *,
                     int *, double *, int *, double *, double *, int *);
+extern void F_SGEMM(char *, char *, int *, int *, int *, float *, float *,
+                    int *, float *, int *, float *, float *, int *);
 extern void F_DGEMV(char *, int *, int *, double *, double *, int *, double *,
                     int *, double *, double *, int *);
 extern void F_DGER(int *, int *, double *, double *, int *, double *, int *,
@@ -667,6 +670,20 @@ void C_DGEMM(char transa, char transb, int m, int n, int k, double alpha,
               &ldc);
 }
 
+/**
+ *  Single-precision C_DGEMM: the same arguments and row-major convention,
+ *  for float arrays.
+ **/
+void C_SGEMM(char transa, char transb, int m, int n, int k, float alpha,
+             float *a, int lda, float *b, int ldb, float beta, float *c,
+             int ldc)
+{
+    if (m == 0 || n == 0 || k == 0)
+        return;
+    ::F_SGEMM(&transb, &transa, &n, &m, &k, &alpha, b, &ldb, a, &lda, &beta, c,
+              &ldc);
+}
+
 /**
  *  Purpose
  *  =======
@@ -96,6 +96,11 @@ void C_DSYR2K(char uplo, char trans, int n, int k, double alpha, double *a,
 void C_DTRSV(char uplo, char trans, char diag, int n, double *a, int lda,
              double *x, int incx);
 
+// BLAS 3 Single routines
+void C_SGEMM(char transa, char transb, int m, int n, int k, float alpha,
+             float *a, int lda, float *b, int ldb, float beta, float *c,
+             int ldc);
+
 // => LAPACK <=
 int C_DGESVD(char jobu, char jobvt, int m, int n, double *A, int lda, double *S,
              double *U, int ldu, double *Vt, int ldvt, double *work, int lwork);
@@ -32,11 +32,14 @@
 #include <boost/python/suite/indexing/vector_indexing_suite.hpp>
 #include <boost/python/suite/indexing/map_indexing_suite.hpp>
 
+#include <ambit/blocked_tensor.h>
 #include <ambit/tensor.h>
 #include <../tensor/indices.h>
 
 #include <boost/shared_ptr.hpp>
 
+#include <cstring>
+
 using namespace boost::python;
 using namespace ambit;
 
@@ -109,7 +112,7 @@ dict tensor_array_interface(Tensor ten)
     dict rv;
 
     rv["shape"] = boost::python::tuple(ten.dims());
-    rv["data"] = boost::python::make_tuple((long)ten.data().data(), false);
+    rv["data"] = boost::python::make_tuple((long)ten.map_data(), false);
 
     // Type
     // std::string typestr = is_big_endian() ? ">" : "<";
@@ -122,6 +125,271 @@ dict tensor_array_interface(Tensor ten)
     return rv;
 }
 
+/// Releases the GIL while in scope, so that other Python threads run while a
+/// kernel does. Nothing in scope may touch a Python object.
+class ScopedGILRelease
+{
+  public:
+    ScopedGILRelease() : state_(PyEval_SaveThread()) {}
+    ~ScopedGILRelease() { PyEval_RestoreThread(state_); }
+
+  private:
+    PyThreadState *state_;
+};
+
+// => Buffer protocol <= //
+
+/// Exports the storage of a CoreTensor or DiskTensor (see Tensor::map_data)
+/// as a C-contiguous buffer of doubles, without copying. As with data(),
+/// the buffer is only valid while the tensor is not spilled to disk.
+int tensor_getbuffer(PyObject *object, Py_buffer *view, int flags)
+{
+    view->obj = nullptr;
+    extract<Tensor &> get(object);
+    if (!get.check())
+    {
+        PyErr_SetString(PyExc_BufferError, "not an ambit tensor");
+        return -1;
+    }
+    Tensor &T = get();
+    if ((T.type() != CoreTensor && T.type() != DiskTensor) || T.is_view())
+    {
+        PyErr_SetString(PyExc_BufferError,
+                        "only CoreTensor's and DiskTensor's that own their "
+                        "storage export a buffer");
+        return -1;
+    }
+
+    // the shape and the strides live as long as the view
+    size_t rank = T.rank();
+    Py_ssize_t *layout = new Py_ssize_t[2 * rank + 1];
+    Py_ssize_t stride = sizeof(double);
+    for (size_t n = rank; n > 0; --n)
+    {
+        layout[n - 1] = static_cast<Py_ssize_t>(T.dim(n - 1));
+        layout[rank + n - 1] = stride;
+        stride *= layout[n - 1];
+    }
+
+    view->buf = T.map_data();
+    view->obj = object;
+    Py_INCREF(object);
+    view->len = static_cast<Py_ssize_t>(T.numel() * sizeof(double));
+    view->itemsize = sizeof(double);
+    view->readonly = 0;
+    view->format = (flags & PyBUF_FORMAT) ? const_cast<char *>("d") : nullptr;
+    view->ndim = static_cast<int>(rank);
+    view->shape = (flags & PyBUF_ND) ? layout : nullptr;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? layout + rank
+                                                            : nullptr;
+    view->suboffsets = nullptr;
+    view->internal = layout;
+    return 0;
+}
+
+void tensor_releasebuffer(PyObject *, Py_buffer *view)
+{
+    delete[] static_cast<Py_ssize_t *>(view->internal);
+}
+
+/** Builds a tensor of type from any C-contiguous buffer of doubles (e.g. a
+ * NumPy array).
+ *
+ * The storage of a CoreTensor is its own, so the elements are copied once,
+ * without the GIL; for zero-copy exchange build the tensor first and fill
+ * numpy.asarray(tensor) in place. DiskTensor's are filled through their
+ * mapping and other types through a CoreTensor.
+ */
+Tensor tensor_from_buffer(TensorType type, const std::string &name,
+                          object buffer)
+{
+    Py_buffer view;
+    if (PyObject_GetBuffer(buffer.ptr(), &view,
+                           PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+        throw_error_already_set();
+    if (view.itemsize != sizeof(double) || view.format == nullptr ||
+        std::strcmp(view.format, "d") != 0)
+    {
+        PyBuffer_Release(&view);
+        throw std::runtime_error("from_buffer: the buffer must hold doubles");
+    }
+
+    Dimension dims(view.shape, view.shape + view.ndim);
+    Tensor T;
+    try
+    {
+        ScopedGILRelease release;
+        TensorType storage =
+            type == CoreTensor || type == DiskTensor ? type : CoreTensor;
+        Tensor stored = Tensor::build(storage, name, dims);
+        std::memcpy(stored.map_data(), view.buf,
+                    static_cast<size_t>(view.len));
+        stored.unmap_data();
+        if (storage == type)
+            T = stored;
+        else
+        {
+            T = Tensor::build(type, name, dims);
+            T.copy(stored);
+        }
+    }
+    catch (...)
+    {
+        PyBuffer_Release(&view);
+        throw;
+    }
+    PyBuffer_Release(&view);
+    return T;
+}
+
+// => Tensor kernels, run without the GIL <= //
+
+void tensor_contract(Tensor &C, const Tensor &A, const Tensor &B,
+                     const Indices &Cinds, const Indices &Ainds,
+                     const Indices &Binds, double alpha, double beta)
+{
+    ScopedGILRelease release;
+    C.contract(A, B, Cinds, Ainds, Binds, alpha, beta);
+}
+
+void tensor_permute(Tensor &C, const Tensor &A, const Indices &Cinds,
+                    const Indices &Ainds, double alpha, double beta)
+{
+    ScopedGILRelease release;
+    C.permute(A, Cinds, Ainds, alpha, beta);
+}
+
+void tensor_slice(Tensor &C, const Tensor &A, const IndexRange &Cinds,
+                  const IndexRange &Ainds, double alpha, double beta)
+{
+    ScopedGILRelease release;
+    C.slice(A, Cinds, Ainds, alpha, beta);
+}
+
+void tensor_scale(Tensor &C, double beta)
+{
+    ScopedGILRelease release;
+    C.scale(beta);
+}
+
+void tensor_zero(Tensor &C)
+{
+    ScopedGILRelease release;
+    C.zero();
+}
+
+void tensor_copy(Tensor &C, const Tensor &A)
+{
+    ScopedGILRelease release;
+    C.copy(A);
+}
+
+double tensor_norm(const Tensor &C, int type)
+{
+    ScopedGILRelease release;
+    return C.norm(type);
+}
+
+std::map<std::string, Tensor> tensor_syev(const Tensor &C,
+                                          EigenvalueOrder order)
+{
+    ScopedGILRelease release;
+    return C.syev(order);
+}
+
+std::map<std::string, Tensor> tensor_geev(const Tensor &C,
+                                          EigenvalueOrder order)
+{
+    ScopedGILRelease release;
+    return C.geev(order);
+}
+
+Tensor tensor_power(const Tensor &C, double power, double condition)
+{
+    ScopedGILRelease release;
+    return C.power(power, condition);
+}
+
+// => BlockedTensor, its labeled and batched expressions run without the GIL
+// <= //
+
+/// C[Cinds] = alpha * A[Ainds] * B[Binds] + beta * C[Cinds]
+void blocked_contract(BlockedTensor &C, BlockedTensor &A, BlockedTensor &B,
+                      const std::string &Cinds, const std::string &Ainds,
+                      const std::string &Binds, double alpha, double beta)
+{
+    ScopedGILRelease release;
+    if (beta != 1.0)
+        C.scale(beta);
+    C(Cinds) += (alpha * A(Ainds)) * B(Binds);
+}
+
+/// The same, evaluated in batches over batched (see ambit::batched)
+void blocked_contract_batched(BlockedTensor &C, BlockedTensor &A,
+                              BlockedTensor &B, const std::string &Cinds,
+                              const std::string &Ainds,
+                              const std::string &Binds,
+                              const std::string &batched_indices,
+                              double alpha, double beta)
+{
+    ScopedGILRelease release;
+    if (beta != 1.0)
+        C.scale(beta);
+    C(Cinds) += batched(batched_indices, (alpha * A(Ainds)) * B(Binds));
+}
+
+/// C[Cinds] = alpha * A[Ainds] + beta * C[Cinds]
+void blocked_permute(BlockedTensor &C, BlockedTensor &A,
+                     const std::string &Cinds, const std::string &Ainds,
+                     double alpha, double beta)
+{
+    ScopedGILRelease release;
+    if (beta != 1.0)
+        C.scale(beta);
+    C(Cinds) += alpha * A(Ainds);
+}
+
+BlockedTensor blocked_build(TensorType type, const std::string &name,
+                            const std::vector<std::string> &blocks)
+{
+    return BlockedTensor::build(type, name, blocks);
+}
+
+void blocked_add_mo_space(const std::string &name,
+                          const std::string &mo_indices,
+                          std::vector<size_t> mos, SpinType spin)
+{
+    BlockedTensor::add_mo_space(name, mo_indices, mos, spin);
+}
+
+Tensor blocked_block(BlockedTensor &T, const std::string &indices)
+{
+    return T.block(indices);
+}
+
+bool blocked_is_block(const BlockedTensor &T, const std::string &indices)
+{
+    return T.is_block(indices);
+}
+
+double blocked_norm(const BlockedTensor &T, int type)
+{
+    ScopedGILRelease release;
+    return T.norm(type);
+}
+
+void blocked_scale(BlockedTensor &T, double beta)
+{
+    ScopedGILRelease release;
+    T.scale(beta);
+}
+
+void blocked_zero(BlockedTensor &T)
+{
+    ScopedGILRelease release;
+    T.zero();
+}
+
 void initialize_wrapper() { ambit::initialize(0, nullptr); }
 
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(tensor_print_ov, Tensor::print, 0, 4)
@@ -163,7 +431,9 @@ BOOST_PYTHON_MODULE(pyambit)
         .value("CoreTensor", CoreTensor)
         .value("DiskTensor", DiskTensor)
         .value("DistributedTensor", DistributedTensor)
-        .value("AgnosticTensor", AgnosticTensor);
+        .value("AgnosticTensor", AgnosticTensor)
+        .value("GpuTensor", GpuTensor)
+        .value("LazyTensor", LazyTensor);
 
     enum_<EigenvalueOrder>("EigenvalueOrder", "docstring")
         .value("AscendingEigenvalue", AscendingEigenvalue)
@@ -191,9 +461,12 @@ BOOST_PYTHON_MODULE(pyambit)
                           return_value_policy<copy_const_reference>()))
         .def("dim_by_index", &LabeledTensor::dim_by_index);
 
+    object tensor_class =
     class_<Tensor>("ITensor", no_init)
         .def("build", &Tensor::build)
         .staticmethod("build")
+        .def("from_buffer", tensor_from_buffer)
+        .staticmethod("from_buffer")
         .add_property("dtype", &Tensor::type, "docstring")
         .add_property("name", &Tensor::name, &Tensor::set_name, "docstring")
         .add_property(
@@ -203,22 +476,71 @@ BOOST_PYTHON_MODULE(pyambit)
         .add_property("rank", &Tensor::rank, "docstring")
         .add_property("numel", &Tensor::numel, "docstring")
         .def("data", data, return_value_policy<reference_existing_object>())
-        .def("scale", &Tensor::scale)
-        .def("permute", &Tensor::permute)
-        .def("slice", &Tensor::slice)
-        .def("contract", &Tensor::contract)
-        .def("syev", &Tensor::syev)
-        .def("geev", &Tensor::geev)
-        .def("power", &Tensor::power)
-        .def("norm", &Tensor::norm)
-        .def("zero", &Tensor::zero)
-        .def("copy", &Tensor::copy)
+        .def("scale", tensor_scale, (arg("self"), arg("beta") = 0.0))
+        .def("permute", tensor_permute,
+             (arg("self"), arg("A"), arg("Cinds"), arg("Ainds"),
+              arg("alpha") = 1.0, arg("beta") = 0.0))
+        .def("slice", tensor_slice,
+             (arg("self"), arg("A"), arg("Cinds"), arg("Ainds"),
+              arg("alpha") = 1.0, arg("beta") = 0.0))
+        .def("contract", tensor_contract,
+             (arg("self"), arg("A"), arg("B"), arg("Cinds"), arg("Ainds"),
+              arg("Binds"), arg("alpha") = 1.0, arg("beta") = 0.0))
+        .def("syev", tensor_syev)
+        .def("geev", tensor_geev)
+        .def("power", tensor_power,
+             (arg("self"), arg("power"), arg("condition") = 1.0E-12))
+        .def("norm", tensor_norm, (arg("self"), arg("type") = 2))
+        .def("zero", tensor_zero)
+        .def("copy", tensor_copy)
         .def("min", &Tensor::min)
         .def("max", &Tensor::max)
         .def("printf", &Tensor::print, tensor_print_ov())
         .def("reset", &Tensor::reset)
         .def("__array_interface__", tensor_array_interface);
 
+    // NumPy (and anything else speaking PEP 3118) can view a tensor in place
+    static PyBufferProcs tensor_buffer_procs = {tensor_getbuffer,
+                                                tensor_releasebuffer};
+    PyTypeObject *tensor_type =
+        reinterpret_cast<PyTypeObject *>(tensor_class.ptr());
+    tensor_type->tp_as_buffer = &tensor_buffer_procs;
+    PyType_Modified(tensor_type);
+
+    enum_<SpinType>("ISpinType")
+        .value("AlphaSpin", AlphaSpin)
+        .value("BetaSpin", BetaSpin)
+        .value("NoSpin", NoSpin);
+
+    class_<BlockedTensor>("IBlockedTensor")
+        .def("build", blocked_build)
+        .staticmethod("build")
+        .def("add_mo_space", blocked_add_mo_space)
+        .staticmethod("add_mo_space")
+        .def("add_composite_mo_space", &BlockedTensor::add_composite_mo_space)
+        .staticmethod("add_composite_mo_space")
+        .def("reset_mo_spaces", &BlockedTensor::reset_mo_spaces)
+        .staticmethod("reset_mo_spaces")
+        .add_property("name", &BlockedTensor::name, &BlockedTensor::set_name)
+        .add_property("rank", &BlockedTensor::rank)
+        .add_property("numblocks", &BlockedTensor::numblocks)
+        .def("block_labels", &BlockedTensor::block_labels)
+        .def("block", blocked_block)
+        .def("is_block", blocked_is_block)
+        .def("norm", blocked_norm, (arg("self"), arg("type") = 2))
+        .def("scale", blocked_scale, (arg("self"), arg("beta") = 0.0))
+        .def("zero", blocked_zero)
+        .def("contract", blocked_contract,
+             (arg("self"), arg("A"), arg("B"), arg("Cinds"), arg("Ainds"),
+              arg("Binds"), arg("alpha") = 1.0, arg("beta") = 0.0))
+        .def("contract_batched", blocked_contract_batched,
+             (arg("self"), arg("A"), arg("B"), arg("Cinds"), arg("Ainds"),
+              arg("Binds"), arg("batched"), arg("alpha") = 1.0,
+              arg("beta") = 0.0))
+        .def("permute", blocked_permute,
+             (arg("self"), arg("A"), arg("Cinds"), arg("Ainds"),
+              arg("alpha") = 1.0, arg("beta") = 0.0));
+
     def("initialize", initialize_wrapper);
     def("finalize", ambit::finalize);
 }
@@ -0,0 +1,177 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#include "accounting.h"
+#include "core/scratch.h"
+#include "core/spill.h"
+#include "tensorimpl.h"
+#include <algorithm>
+#include <ambit/print.h>
+#include <ambit/settings.h>
+#include <mutex>
+
+namespace ambit
+{
+
+namespace memory
+{
+
+namespace
+{
+
+std::mutex usage_mutex;
+map<string, Usage> usage_by_name;
+size_t live = 0L;
+size_t peak = 0L;
+
+/// Number of the largest tensors named in reports and errors
+const size_t nlargest = 5;
+
+double megabytes(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+/// The names sorted by decreasing usage (live, or peak)
+vector<pair<string, Usage>> largest(const map<string, Usage> &usages,
+                                    bool by_peak)
+{
+    vector<pair<string, Usage>> sorted(usages.begin(), usages.end());
+    std::sort(sorted.begin(), sorted.end(),
+              [by_peak](const pair<string, Usage> &a,
+                        const pair<string, Usage> &b) {
+                  return by_peak ? a.second.peak > b.second.peak
+                                 : a.second.live > b.second.live;
+              });
+    return sorted;
+}
+
+string out_of_memory_message(const string &name, size_t bytes)
+{
+    char buffer[256];
+    snprintf(buffer, 256,
+             "Out of memory: %.1f MB for tensor \"%s\" with %.1f MB live "
+             "(settings::memory_limit is %.1f MB). Largest live tensors:",
+             megabytes(bytes), name.c_str(), megabytes(live),
+             megabytes(settings::memory_limit));
+    string message(buffer);
+    vector<pair<string, Usage>> sorted = largest(usage_by_name, false);
+    for (size_t n = 0; n < std::min(nlargest, sorted.size()); ++n)
+    {
+        if (sorted[n].second.live == 0L)
+            break;
+        snprintf(buffer, 256, "%s \"%s\" %.1f MB", n ? "," : "",
+                 sorted[n].first.c_str(), megabytes(sorted[n].second.live));
+        message += buffer;
+    }
+    return message;
+}
+}
+
+void charge(const string &name, size_t bytes)
+{
+    spill::clock.fetch_add(1L, std::memory_order_relaxed);
+    if (settings::enforce_memory_limit || settings::spill_to_disk)
+    {
+        // Idle scratch buffers are real memory too, and go first
+        if (live_bytes() + scratch::pooled_bytes() + bytes >
+            settings::memory_limit)
+            scratch::clear();
+        // Then the coldest tensors
+        size_t current = live_bytes();
+        if (settings::spill_to_disk &&
+            current + bytes > settings::memory_limit)
+            spill::make_room(current + bytes - settings::memory_limit);
+    }
+
+    std::lock_guard<std::mutex> lock(usage_mutex);
+    if (settings::enforce_memory_limit && live + bytes > settings::memory_limit)
+        throw detail::OutOfMemoryException(out_of_memory_message(name, bytes));
+
+    live += bytes;
+    peak = std::max(peak, live);
+    Usage &entry = usage_by_name[name];
+    entry.live += bytes;
+    entry.peak = std::max(entry.peak, entry.live);
+    entry.allocations++;
+}
+
+void discharge(const string &name, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(usage_mutex);
+    live -= std::min(live, bytes);
+    Usage &entry = usage_by_name[name];
+    entry.live -= std::min(entry.live, bytes);
+}
+
+size_t live_bytes()
+{
+    std::lock_guard<std::mutex> lock(usage_mutex);
+    return live;
+}
+
+size_t peak_bytes()
+{
+    std::lock_guard<std::mutex> lock(usage_mutex);
+    return peak;
+}
+
+void reset_peak()
+{
+    std::lock_guard<std::mutex> lock(usage_mutex);
+    peak = live;
+    for (auto &entry : usage_by_name)
+        entry.second.peak = entry.second.live;
+}
+
+map<string, Usage> usage()
+{
+    std::lock_guard<std::mutex> lock(usage_mutex);
+    return usage_by_name;
+}
+
+void report()
+{
+    map<string, Usage> usages = usage();
+    print("\nMemory usage: %.1f MB live, %.1f MB peak, %.1f MB idle scratch "
+          "(limit %.1f MB)\n\n",
+          megabytes(live_bytes()), megabytes(peak_bytes()),
+          megabytes(scratch::pooled_bytes()),
+          megabytes(settings::memory_limit));
+    vector<pair<string, Usage>> sorted = largest(usages, true);
+    print("  %12s %12s %12s  %s\n", "Live (MB)", "Peak (MB)", "Allocations",
+          "Tensor");
+    for (size_t n = 0; n < std::min<size_t>(4 * nlargest, sorted.size()); ++n)
+    {
+        const Usage &entry = sorted[n].second;
+        print("  %12.1f %12.1f %12zu  %s\n", megabytes(entry.live),
+              megabytes(entry.peak), entry.allocations,
+              sorted[n].first.c_str());
+    }
+}
+}
+}
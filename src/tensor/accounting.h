@@ -0,0 +1,55 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#if !defined(TENSOR_ACCOUNTING_H)
+#define TENSOR_ACCOUNTING_H
+
+#include <ambit/memory.h>
+
+namespace ambit
+{
+
+namespace memory
+{
+
+/** Charges bytes about to be allocated for the tensor name.
+ *
+ * Throws detail::OutOfMemoryException if settings::enforce_memory_limit is
+ * set and the allocation would not fit in settings::memory_limit, even
+ * after dropping the idle scratch buffers. Nothing is charged then.
+ */
+void charge(const string &name, size_t bytes);
+
+/// Returns bytes charged to name
+void discharge(const string &name, size_t bytes);
+}
+}
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#include <ambit/call_trace.h>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+namespace ambit
+{
+
+namespace call_trace
+{
+
+namespace
+{
+
+std::mutex log_mutex;
+std::ofstream trace_file;
+std::atomic<bool> logging(false);
+
+const char *type_name(TensorType type)
+{
+    switch (type)
+    {
+    case CoreTensor:
+        return "core";
+    case DiskTensor:
+        return "disk";
+    case DistributedTensor:
+        return "distributed";
+    case GpuTensor:
+        return "gpu";
+    case LazyTensor:
+        return "lazy";
+    default:
+        throw std::runtime_error("call_trace: Unexpected tensor type");
+    }
+}
+
+TensorType parse_type(const string &name)
+{
+    if (name == "core")
+        return CoreTensor;
+    if (name == "disk")
+        return DiskTensor;
+    if (name == "distributed")
+        return DistributedTensor;
+    if (name == "gpu")
+        return GpuTensor;
+    // The generator is not recorded, so a lazy tensor is replayed as a core
+    // tensor of random elements
+    if (name == "lazy")
+        return CoreTensor;
+    throw std::runtime_error("call_trace: Unknown tensor type " + name);
+}
+
+/// The comma-separated items of list, "-" for none
+template <typename T, typename Write>
+void write_list(std::ostream &out, const vector<T> &list, Write write)
+{
+    if (list.empty())
+        out << "-";
+    for (size_t n = 0; n < list.size(); ++n)
+    {
+        if (n)
+            out << ",";
+        write(out, list[n]);
+    }
+}
+
+vector<string> split(const string &list)
+{
+    vector<string> items;
+    if (list == "-")
+        return items;
+    std::istringstream in(list);
+    string item;
+    while (std::getline(in, item, ','))
+        items.push_back(item);
+    return items;
+}
+
+size_t parse_size(const string &value)
+{
+    size_t pos = 0;
+    unsigned long long number = std::stoull(value, &pos);
+    if (pos != value.size())
+        throw std::runtime_error("call_trace: Bad number " + value);
+    return static_cast<size_t>(number);
+}
+}
+
+void start(const string &filename)
+{
+    std::lock_guard<std::mutex> lock(log_mutex);
+    if (trace_file.is_open())
+        trace_file.close();
+    trace_file.open(filename);
+    if (!trace_file)
+        throw std::runtime_error("call_trace: Unable to open " + filename);
+    trace_file
+        << "# ambit call trace: kind alpha beta (type dims labels)...\n";
+    trace_file.precision(17);
+    logging = true;
+}
+
+void stop()
+{
+    std::lock_guard<std::mutex> lock(log_mutex);
+    logging = false;
+    if (trace_file.is_open())
+        trace_file.close();
+}
+
+bool active() { return logging; }
+
+void record(const Call &call)
+{
+    if (!logging)
+        return;
+
+    std::ostringstream line;
+    line.precision(17);
+    line << call.kind << " " << call.alpha << " " << call.beta;
+    for (size_t n = 0; n < call.types.size(); ++n)
+    {
+        line << " " << type_name(call.types[n]) << " ";
+        write_list(line, call.dims[n],
+                   [](std::ostream &out, size_t dim) { out << dim; });
+        line << " ";
+        if (call.kind == "slice")
+            write_list(line, call.ranges[n],
+                       [](std::ostream &out, const vector<size_t> &range) {
+                           out << range[0] << ":" << range[1];
+                       });
+        else
+            write_list(line, call.indices[n],
+                       [](std::ostream &out, const string &index) {
+                           out << index;
+                       });
+    }
+    line << "\n";
+
+    std::lock_guard<std::mutex> lock(log_mutex);
+    if (trace_file.is_open())
+        trace_file << line.str();
+}
+
+vector<Call> read(const string &filename)
+{
+    std::ifstream in(filename);
+    if (!in)
+        throw std::runtime_error("call_trace: Unable to open " + filename);
+
+    vector<Call> calls;
+    string line;
+    size_t lineno = 0;
+    while (std::getline(in, line))
+    {
+        lineno++;
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream tokens(line);
+        Call call;
+        tokens >> call.kind >> call.alpha >> call.beta;
+        size_t noperand;
+        if (call.kind == "contract")
+            noperand = 3;
+        else if (call.kind == "permute" || call.kind == "slice")
+            noperand = 2;
+        else
+            throw std::runtime_error("call_trace: Unknown call on line " +
+                                     std::to_string(lineno));
+
+        try
+        {
+            for (size_t n = 0; n < noperand; ++n)
+            {
+                string type, dims, labels;
+                if (!(tokens >> type >> dims >> labels))
+                    throw std::runtime_error("missing operand");
+                call.types.push_back(parse_type(type));
+                Dimension dim;
+                for (const string &value : split(dims))
+                    dim.push_back(parse_size(value));
+                call.dims.push_back(dim);
+                if (call.kind == "slice")
+                {
+                    IndexRange range;
+                    for (const string &item : split(labels))
+                    {
+                        size_t colon = item.find(':');
+                        if (colon == string::npos)
+                            throw std::runtime_error("bad range " + item);
+                        range.push_back({parse_size(item.substr(0, colon)),
+                                         parse_size(item.substr(colon + 1))});
+                    }
+                    call.ranges.push_back(range);
+                }
+                else
+                {
+                    call.indices.push_back(split(labels));
+                }
+            }
+        }
+        catch (const std::exception &e)
+        {
+            throw std::runtime_error("call_trace: Malformed line " +
+                                     std::to_string(lineno) + " of " +
+                                     filename + ": " + e.what());
+        }
+        calls.push_back(call);
+    }
+    return calls;
+}
+}
+}
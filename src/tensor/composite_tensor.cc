@@ -0,0 +1,353 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#include <ambit/composite_tensor.h>
+#include <ambit/timer.h>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include "math/math.h"
+
+namespace ambit
+{
+
+namespace composite
+{
+
+namespace
+{
+
+/// Elements of all the tensors of a pass held in one chunk (1 MB)
+const size_t chunk_elements__ = 131072L;
+
+void check_shapes(const vector<Tensor> &X, const Tensor &reference,
+                  const string &caller)
+{
+    for (const Tensor &T : X)
+        if (T.dims() != reference.dims())
+            throw std::runtime_error(caller + ": the tensor \"" + T.name() +
+                                     "\" does not have the dimensions of \"" +
+                                     reference.name() + "\".");
+}
+
+bool in_core(const Tensor &T)
+{
+    return T.type() == CoreTensor && !T.is_view();
+}
+
+/// The dimensions of nrow rows of a tensor of dimensions dims
+Dimension rows_dims(Dimension dims, size_t nrow)
+{
+    if (!dims.empty())
+        dims[0] = nrow;
+    return dims;
+}
+
+/// The rows [r0, r1) of the first index of a tensor of dimensions dims
+IndexRange rows_range(const Dimension &dims, size_t r0, size_t r1)
+{
+    IndexRange range;
+    for (size_t d = 0; d < dims.size(); ++d)
+        range.push_back(d == 0 ? IndexRange::value_type{r0, r1}
+                               : IndexRange::value_type{0, dims[d]});
+    return range;
+}
+
+/// The rows [r0, r1) of T, read into a CoreTensor
+Tensor read_rows(const Tensor &T, size_t r0, size_t r1)
+{
+    Dimension dims = rows_dims(T.dims(), r1 - r0);
+    Tensor R = Tensor::build(CoreTensor, T.name() + " rows", dims);
+    R.slice(T, rows_range(dims, 0, r1 - r0), rows_range(T.dims(), r0, r1));
+    return R;
+}
+
+/// Chunks along the first index of tensors of dimensions dims, sized so
+/// that a chunk of ntensor tensors fits in chunk_elements__
+struct Chunks
+{
+    Chunks(const Dimension &dims, size_t ntensor)
+    {
+        nrow = dims.empty() ? 1 : dims[0];
+        row = 1;
+        for (size_t d = 1; d < dims.size(); ++d)
+            row *= dims[d];
+        step = std::max<size_t>(
+            chunk_elements__ / std::max<size_t>(ntensor * row, 1), 1);
+        nchunk = (nrow + step - 1) / step;
+    }
+    size_t first(size_t c) const { return c * step; }
+    size_t last(size_t c) const { return std::min(nrow, (c + 1) * step); }
+
+    size_t nrow;
+    size_t row;
+    size_t step;
+    size_t nchunk;
+};
+
+/// The rows of chunk c of T: a pointer into its data if T is in core, else
+/// into a copy appended to copies
+double *chunk_data(const Tensor &T, const Chunks &chunks, size_t c,
+                   vector<Tensor> &copies)
+{
+    size_t r0 = chunks.first(c);
+    if (in_core(T))
+        return const_cast<double *>(T.data().data()) + r0 * chunks.row;
+    copies.push_back(read_rows(T, r0, chunks.last(c)));
+    return copies.back().data().data();
+}
+
+vector<vector<double>> dots_pass(const vector<Tensor> &X,
+                                 const vector<Tensor> &Y, bool symmetric)
+{
+    size_t m = X.size();
+    size_t n = Y.size();
+    vector<vector<double>> S(m, vector<double>(n, 0.0));
+    if (m == 0 || n == 0)
+        return S;
+    check_shapes(X, X[0], "composite::dots");
+    check_shapes(Y, X[0], "composite::dots");
+
+    Chunks chunks(X[0].dims(), symmetric ? m : m + n);
+    bool threaded = chunks.nchunk > 1;
+    for (const Tensor &T : X)
+        threaded = threaded && in_core(T);
+    for (const Tensor &T : Y)
+        threaded = threaded && in_core(T);
+
+    AMBIT_TIMER_PUSH("composite::dots");
+    AMBIT_TIMER_FLOPS(2.0 * (symmetric ? 0.5 * m * (m + 1) : double(m) * n) *
+                      X[0].numel());
+    AMBIT_TIMER_BYTES(sizeof(double) * (symmetric ? m : m + n) *
+                      double(X[0].numel()));
+
+    // All the pairs of a chunk are formed while it is in cache
+    auto dots_of_chunk = [&](size_t c, vector<vector<double>> &local) {
+        size_t len = (chunks.last(c) - chunks.first(c)) * chunks.row;
+        vector<Tensor> copies;
+        vector<double *> x, y;
+        for (const Tensor &T : X)
+            x.push_back(chunk_data(T, chunks, c, copies));
+        if (symmetric)
+            y = x;
+        else
+            for (const Tensor &T : Y)
+                y.push_back(chunk_data(T, chunks, c, copies));
+
+        for (size_t i = 0; i < m; ++i)
+            for (size_t j = 0; j < (symmetric ? i + 1 : n); ++j)
+                local[i][j] += C_DDOT(len, x[i], 1, y[j], 1);
+    };
+
+    // The DiskTensor's of a pass are read one chunk after another; only
+    // passes over CoreTensor's share their chunks among threads
+    std::exception_ptr error;
+#pragma omp parallel if (threaded)
+    {
+        vector<vector<double>> local(m, vector<double>(n, 0.0));
+#pragma omp for schedule(dynamic)
+        for (size_t c = 0; c < chunks.nchunk; ++c)
+        {
+            try
+            {
+                dots_of_chunk(c, local);
+            }
+            catch (...)
+            {
+#pragma omp critical(ambit_composite_error)
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+#pragma omp critical(ambit_composite_dots)
+        for (size_t i = 0; i < m; ++i)
+            for (size_t j = 0; j < n; ++j)
+                S[i][j] += local[i][j];
+    }
+    AMBIT_TIMER_POP();
+    if (error)
+        std::rethrow_exception(error);
+
+    if (symmetric)
+        for (size_t i = 0; i < m; ++i)
+            for (size_t j = 0; j < i; ++j)
+                S[j][i] = S[i][j];
+    return S;
+}
+
+void add_to(vector<vector<double>> &S, const vector<vector<double>> &block)
+{
+    for (size_t i = 0; i < S.size(); ++i)
+        for (size_t j = 0; j < S[i].size(); ++j)
+            S[i][j] += block[i][j];
+}
+
+/// The block with the given key of each BlockedTensor
+vector<Tensor> blocks_of(const vector<BlockedTensor> &X,
+                         const vector<size_t> &key)
+{
+    vector<Tensor> blocks;
+    for (const BlockedTensor &T : X)
+        blocks.push_back(T.block(key));
+    return blocks;
+}
+
+vector<vector<double>> blocked_dots(const vector<BlockedTensor> &X,
+                                    const vector<BlockedTensor> &Y,
+                                    bool symmetric)
+{
+    vector<vector<double>> S(X.size(), vector<double>(Y.size(), 0.0));
+    if (X.empty() || Y.empty())
+        return S;
+    BlockedTensor first = X[0];
+    for (const auto &key_tensor : first.blocks())
+    {
+        vector<Tensor> Xb = blocks_of(X, key_tensor.first);
+        if (symmetric)
+            add_to(S, dots_pass(Xb, Xb, true));
+        else
+            add_to(S, dots_pass(Xb, blocks_of(Y, key_tensor.first), false));
+    }
+    return S;
+}
+} // anonymous namespace
+
+vector<vector<double>> dots(const vector<Tensor> &X, const vector<Tensor> &Y)
+{
+    return dots_pass(X, Y, false);
+}
+
+vector<vector<double>> dots(const vector<BlockedTensor> &X,
+                            const vector<BlockedTensor> &Y)
+{
+    return blocked_dots(X, Y, false);
+}
+
+vector<vector<double>> gram(const vector<Tensor> &X)
+{
+    return dots_pass(X, X, true);
+}
+
+vector<vector<double>> gram(const vector<BlockedTensor> &X)
+{
+    return blocked_dots(X, X, true);
+}
+
+void linear_combination(Tensor &C, const vector<Tensor> &X,
+                        const vector<double> &c, double beta)
+{
+    if (c.size() != X.size())
+        throw std::runtime_error(
+            "composite::linear_combination: " + std::to_string(X.size()) +
+            " tensors but " + std::to_string(c.size()) + " coefficients.");
+    check_shapes(X, C, "composite::linear_combination");
+
+    Chunks chunks(C.dims(), X.size() + 1);
+    bool threaded = chunks.nchunk > 1 && in_core(C);
+    for (const Tensor &T : X)
+        threaded = threaded && in_core(T);
+    double *Cp = in_core(C) ? C.data().data() : nullptr;
+
+    AMBIT_TIMER_PUSH("composite::linear_combination");
+    AMBIT_TIMER_FLOPS(2.0 * X.size() * C.numel());
+    AMBIT_TIMER_BYTES(sizeof(double) * (X.size() + 2) * double(C.numel()));
+
+    // Chunks of C that are not in core are formed in a CoreTensor and
+    // written back
+    auto combine_chunk = [&](size_t ch) {
+        size_t r0 = chunks.first(ch);
+        size_t r1 = chunks.last(ch);
+        size_t len = (r1 - r0) * chunks.row;
+
+        Tensor Crows;
+        double *out;
+        if (Cp != nullptr)
+            out = Cp + r0 * chunks.row;
+        else
+        {
+            Crows = beta == 0.0
+                        ? Tensor::build(CoreTensor, C.name() + " rows",
+                                        rows_dims(C.dims(), r1 - r0))
+                        : read_rows(C, r0, r1);
+            out = Crows.data().data();
+        }
+        if (beta == 0.0)
+            std::fill(out, out + len, 0.0);
+        else if (beta != 1.0)
+            C_DSCAL(len, beta, out, 1);
+
+        for (size_t i = 0; i < X.size(); ++i)
+        {
+            if (c[i] == 0.0)
+                continue;
+            vector<Tensor> copies;
+            C_DAXPY(len, c[i], chunk_data(X[i], chunks, ch, copies), 1, out,
+                    1);
+        }
+
+        if (Cp == nullptr)
+            C.slice(Crows, rows_range(C.dims(), r0, r1),
+                    rows_range(Crows.dims(), 0, r1 - r0));
+    };
+
+    std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic) if (threaded)
+    for (size_t ch = 0; ch < chunks.nchunk; ++ch)
+    {
+        try
+        {
+            combine_chunk(ch);
+        }
+        catch (...)
+        {
+#pragma omp critical(ambit_composite_error)
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    AMBIT_TIMER_POP();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void linear_combination(BlockedTensor &C, const vector<BlockedTensor> &X,
+                        const vector<double> &c, double beta)
+{
+    for (const auto &key_tensor : C.blocks())
+    {
+        // An aliased block shares the storage of its partner
+        if (C.is_alias(key_tensor.first))
+            continue;
+        Tensor block = key_tensor.second;
+        linear_combination(block, blocks_of(X, key_tensor.first), c, beta);
+    }
+}
+}
+}
@@ -0,0 +1,543 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <ambit/settings.h>
+#include "contraction_path.h"
+
+namespace ambit
+{
+
+namespace contraction_path
+{
+
+namespace
+{
+
+/// Maximum number of paths kept before the cache is flushed
+const size_t max_cached_paths = 4096;
+
+std::mutex path_cache_mutex;
+std::map<string, Path> path_cache;
+
+Indices sorted(Indices inds)
+{
+    std::sort(inds.begin(), inds.end());
+    inds.erase(std::unique(inds.begin(), inds.end()), inds.end());
+    return inds;
+}
+
+Indices set_union(const Indices &a, const Indices &b)
+{
+    Indices c;
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(),
+                   std::back_inserter(c));
+    return c;
+}
+
+Indices set_intersection(const Indices &a, const Indices &b)
+{
+    Indices c;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                          std::back_inserter(c));
+    return c;
+}
+
+/// Accumulated cost of a (partial) evaluation order
+struct Cost
+{
+    double cpu;
+    double memory;
+};
+
+/**
+ * Orders costs by cpu cost and then peak memory. An order that fits in
+ * settings::memory_limit always beats one that does not, and among orders
+ * that do not fit the smaller peak memory wins.
+ */
+bool cheaper(const Cost &a, const Cost &b)
+{
+    double limit = double(settings::memory_limit) / sizeof(double);
+    bool a_fits = a.memory <= limit;
+    bool b_fits = b.memory <= limit;
+    if (a_fits != b_fits)
+        return a_fits;
+    if (a_fits)
+    {
+        if (a.cpu != b.cpu)
+            return a.cpu < b.cpu;
+        return a.memory < b.memory;
+    }
+    if (a.memory != b.memory)
+        return a.memory < b.memory;
+    return a.cpu < b.cpu;
+}
+
+/// Memoizes the cost model for a single search
+class CostTable
+{
+  public:
+    explicit CostTable(const PairCost &cost) : cost_(cost) {}
+
+    Cost step(const Cost &first, const Cost &second, const Indices &inds1,
+              const Indices &inds2, const Indices &result)
+    {
+        std::tuple<Indices, Indices, Indices> key(inds1, inds2, result);
+        auto it = table_.find(key);
+        if (it == table_.end())
+        {
+            pair<double, double> value = cost_(inds1, inds2, result);
+            it = table_.insert(std::make_pair(key, value)).first;
+        }
+        Cost total;
+        total.cpu = first.cpu + second.cpu + it->second.first;
+        total.memory =
+            std::max({first.memory, second.memory, it->second.second});
+        return total;
+    }
+
+  private:
+    const PairCost &cost_;
+    std::map<std::tuple<Indices, Indices, Indices>, pair<double, double>>
+        table_;
+};
+
+// => Dynamic Programming over Subsets <= //
+
+Path optimize_subsets(const vector<Indices> &terms, const Indices &result,
+                      const PairCost &cost, bool linear)
+{
+    size_t nterms = terms.size();
+    size_t full = (size_t(1) << nterms) - 1;
+
+    // Indices carried by the operand holding the product of each subset
+    vector<Indices> all_inds(full + 1);
+    for (size_t mask = 1; mask <= full; ++mask)
+    {
+        size_t low = 0;
+        while (!(mask & (size_t(1) << low)))
+            ++low;
+        all_inds[mask] =
+            set_union(all_inds[mask ^ (size_t(1) << low)], terms[low]);
+    }
+    vector<Indices> kept(full + 1);
+    for (size_t mask = 1; mask <= full; ++mask)
+    {
+        kept[mask] = set_intersection(
+            all_inds[mask], set_union(result, all_inds[full ^ mask]));
+    }
+    kept[full] = result;
+
+    CostTable table(cost);
+    vector<Cost> best(full + 1, Cost{0.0, 0.0});
+    vector<size_t> split(full + 1, 0);
+    vector<bool> done(full + 1, false);
+    for (size_t n = 0; n < nterms; ++n)
+        done[size_t(1) << n] = true;
+
+    // Masks in increasing order visit every subset after its subsets
+    for (size_t mask = 1; mask <= full; ++mask)
+    {
+        if (done[mask])
+            continue;
+        size_t low = mask & (~mask + 1);
+        bool found = false;
+        if (linear)
+        {
+            // The last term added to a chain can be any term of the subset
+            for (size_t n = 0; n < nterms; ++n)
+            {
+                size_t bit = size_t(1) << n;
+                if (!(mask & bit))
+                    continue;
+                size_t rest = mask ^ bit;
+                Cost c = table.step(best[rest], best[bit], kept[rest],
+                                    kept[bit], kept[mask]);
+                if (!found || cheaper(c, best[mask]))
+                {
+                    best[mask] = c;
+                    split[mask] = rest;
+                    found = true;
+                }
+            }
+        }
+        else
+        {
+            // Proper subsets holding the lowest term avoid counting a split
+            // twice
+            for (size_t sub = (mask - 1) & mask; sub != 0;
+                 sub = (sub - 1) & mask)
+            {
+                if (!(sub & low))
+                    continue;
+                size_t other = mask ^ sub;
+                Cost c = table.step(best[sub], best[other], kept[sub],
+                                    kept[other], kept[mask]);
+                if (!found || cheaper(c, best[mask]))
+                {
+                    best[mask] = c;
+                    split[mask] = sub;
+                    found = true;
+                }
+            }
+        }
+        done[mask] = true;
+    }
+
+    // Unfold the winning tree into steps
+    Path path;
+    std::function<size_t(size_t)> build = [&](size_t mask) -> size_t {
+        if ((mask & (mask - 1)) == 0)
+        {
+            size_t n = 0;
+            while (mask != (size_t(1) << n))
+                ++n;
+            return n;
+        }
+        size_t first = build(split[mask]);
+        size_t second = build(mask ^ split[mask]);
+        path.push_back(std::make_pair(first, second));
+        return nterms + path.size() - 1;
+    };
+    build(full);
+    return path;
+}
+
+// => Greedy Search <= //
+
+Path optimize_greedy(const vector<Indices> &terms, const Indices &result,
+                     const PairCost &cost, bool linear)
+{
+    size_t nterms = terms.size();
+    CostTable table(cost);
+    vector<Indices> inds(terms);
+    vector<Cost> costs(nterms, Cost{0.0, 0.0});
+    vector<size_t> alive(nterms);
+    for (size_t n = 0; n < nterms; ++n)
+        alive[n] = n;
+
+    Path path;
+    while (alive.size() > 1)
+    {
+        bool found = false;
+        Cost best_cost{0.0, 0.0};
+        size_t best_a = 0, best_b = 0;
+        Indices best_inds;
+        for (size_t a = 0; a < alive.size(); ++a)
+        {
+            for (size_t b = a + 1; b < alive.size(); ++b)
+            {
+                // Chains always extend the last intermediate
+                if (linear && !path.empty() && alive[b] != inds.size() - 1 &&
+                    alive[a] != inds.size() - 1)
+                    continue;
+                Indices others = result;
+                for (size_t c = 0; c < alive.size(); ++c)
+                {
+                    if (c != a && c != b)
+                        others = set_union(others, inds[alive[c]]);
+                }
+                Indices ab = set_intersection(
+                    set_union(inds[alive[a]], inds[alive[b]]), others);
+                if (alive.size() == 2)
+                    ab = result;
+                Cost c = table.step(costs[alive[a]], costs[alive[b]],
+                                    inds[alive[a]], inds[alive[b]], ab);
+                if (!found || cheaper(c, best_cost))
+                {
+                    best_cost = c;
+                    best_a = a;
+                    best_b = b;
+                    best_inds = ab;
+                    found = true;
+                }
+            }
+        }
+        size_t first = alive[best_a];
+        size_t second = alive[best_b];
+        path.push_back(std::make_pair(first, second));
+        inds.push_back(best_inds);
+        costs.push_back(best_cost);
+        alive.erase(alive.begin() + best_b);
+        alive.erase(alive.begin() + best_a);
+        alive.push_back(inds.size() - 1);
+    }
+    return path;
+}
+}
+
+Path chain(const vector<size_t> &order)
+{
+    Path path;
+    if (order.size() < 2)
+        return path;
+    path.push_back(std::make_pair(order[0], order[1]));
+    for (size_t n = 2; n < order.size(); ++n)
+    {
+        path.push_back(std::make_pair(order.size() + n - 2, order[n]));
+    }
+    return path;
+}
+
+vector<size_t> chain_order(const Path &path, size_t nterms)
+{
+    vector<size_t> order;
+    if (path.empty())
+    {
+        for (size_t n = 0; n < nterms; ++n)
+            order.push_back(n);
+        return order;
+    }
+    order.push_back(path[0].first);
+    order.push_back(path[0].second);
+    // Every later step adds one term to the last intermediate
+    for (size_t k = 1; k < path.size(); ++k)
+    {
+        order.push_back(path[k].first < nterms ? path[k].first
+                                               : path[k].second);
+    }
+    return order;
+}
+
+size_t max_optimal_terms(bool linear) { return linear ? 16 : 10; }
+
+Path optimize(const vector<Indices> &terms, const Indices &result,
+              const PairCost &cost, bool linear)
+{
+    vector<Indices> sorted_terms;
+    for (const Indices &term : terms)
+        sorted_terms.push_back(sorted(term));
+    Indices sorted_result = sorted(result);
+
+    if (terms.size() < 2)
+        return Path();
+    if (terms.size() == 2)
+        return chain({0, 1});
+    if (terms.size() <= max_optimal_terms(linear))
+        return optimize_subsets(sorted_terms, sorted_result, cost, linear);
+    return optimize_greedy(sorted_terms, sorted_result, cost, linear);
+}
+
+Path optimize_cached(const string &key, const vector<Indices> &terms,
+                     const Indices &result, const PairCost &cost, bool linear)
+{
+    string full_key = (linear ? "L:" : "T:") + key;
+    {
+        std::lock_guard<std::mutex> lock(path_cache_mutex);
+        auto it = path_cache.find(full_key);
+        if (it != path_cache.end())
+            return it->second;
+    }
+
+    Path path = optimize(terms, result, cost, linear);
+
+    std::lock_guard<std::mutex> lock(path_cache_mutex);
+    if (path_cache.size() >= max_cached_paths)
+        path_cache.clear();
+    path_cache[full_key] = path;
+    return path;
+}
+
+vector<Indices> intermediate_indices(const vector<Indices> &terms,
+                                     const Indices &result, const Path &path)
+{
+    vector<Indices> inds;
+    for (const Indices &term : terms)
+        inds.push_back(sorted(term));
+    Indices sorted_result = sorted(result);
+
+    vector<bool> consumed(terms.size() + path.size(), false);
+    for (size_t k = 0; k < path.size(); ++k)
+    {
+        size_t first = path[k].first;
+        size_t second = path[k].second;
+        consumed[first] = consumed[second] = true;
+
+        Indices others = sorted_result;
+        for (size_t n = 0; n < inds.size(); ++n)
+        {
+            if (!consumed[n])
+                others = set_union(others, inds[n]);
+        }
+        if (k + 1 == path.size())
+            inds.push_back(sorted_result);
+        else
+            inds.push_back(set_intersection(
+                set_union(inds[first], inds[second]), others));
+    }
+    return vector<Indices>(inds.begin() + terms.size(), inds.end());
+}
+
+pair<double, double> path_cost(const vector<Indices> &terms,
+                               const Indices &result, const Path &path,
+                               const PairCost &cost)
+{
+    vector<Indices> inds;
+    for (const Indices &term : terms)
+        inds.push_back(sorted(term));
+    vector<Indices> inter = intermediate_indices(terms, result, path);
+    inds.insert(inds.end(), inter.begin(), inter.end());
+
+    double cpu = 0.0;
+    double memory = 0.0;
+    for (size_t k = 0; k < path.size(); ++k)
+    {
+        pair<double, double> c = cost(inds[path[k].first],
+                                      inds[path[k].second],
+                                      inds[terms.size() + k]);
+        cpu += c.first;
+        memory = std::max(memory, c.second);
+    }
+    return std::make_pair(cpu, memory);
+}
+
+namespace
+{
+
+/**
+ * Elements of the operands held in one batch, with the indices fixed taking
+ * one value and index taking chunk values.
+ */
+double batch_footprint(const vector<Indices> &held,
+                       const map<string, size_t> &dims, const Indices &fixed,
+                       const string &index, size_t chunk)
+{
+    double total = 0.0;
+    for (const Indices &operand : held)
+    {
+        double numel = 1.0;
+        for (const string &label : operand)
+        {
+            if (label == index)
+                numel *= double(chunk);
+            else if (std::find(fixed.begin(), fixed.end(), label) ==
+                     fixed.end())
+                numel *= double(dims.at(label));
+        }
+        total += numel;
+    }
+    return total;
+}
+
+/// Largest number of values of index whose batches fit in budget elements
+/// (at least one)
+size_t fitting_chunk(const vector<Indices> &inter,
+                     const map<string, size_t> &dims, const Indices &fixed,
+                     const string &index, double budget)
+{
+    size_t dim = dims.at(index);
+    double base = batch_footprint(inter, dims, fixed, index, 0L);
+    double per_value = batch_footprint(inter, dims, fixed, index, 1L) - base;
+    if (per_value <= 0.0)
+        return std::max<size_t>(dim, 1L);
+    if (base + per_value >= budget)
+        return 1L;
+    double chunk = std::floor((budget - base) / per_value);
+    return std::max<size_t>(
+        1L, chunk >= double(dim) ? dim : static_cast<size_t>(chunk));
+}
+}
+
+Batching plan_batching(const vector<Indices> &terms, const Indices &result,
+                       const Path &path, const map<string, size_t> &dims,
+                       const Indices &batched, size_t budget,
+                       const vector<Indices> &staged)
+{
+    // The intermediates (but the last, which is the result) and two batches
+    // of each staged operand
+    vector<Indices> inter = intermediate_indices(terms, result, path);
+    inter.pop_back();
+    for (const Indices &operand : staged)
+    {
+        inter.push_back(operand);
+        inter.push_back(operand);
+    }
+    double elements = double(budget) / sizeof(double);
+
+    Batching batching;
+    batching.chunk = 1L;
+    if (!batched.empty())
+    {
+        Indices fixed(batched.begin(), batched.end() - 1);
+        batching.indices = batched;
+        batching.chunk =
+            fitting_chunk(inter, dims, fixed, batched.back(), elements);
+        return batching;
+    }
+
+    // Indices whose batches fit beat those that do not; among the former the
+    // fewest (and then largest) batches win, among the latter the smallest
+    // batches
+    bool best_fits = false;
+    size_t best_batches = 0L;
+    double best_footprint = 0.0;
+    for (const string &index : result)
+    {
+        size_t dim = dims.at(index);
+        if (dim == 0L)
+            continue;
+        size_t chunk = fitting_chunk(inter, dims, Indices(), index, elements);
+        size_t nbatches = (dim + chunk - 1L) / chunk;
+        double footprint = batch_footprint(inter, dims, Indices(), index, chunk);
+        bool fits = footprint <= elements;
+        bool better;
+        if (batching.indices.empty() || fits != best_fits)
+            better = batching.indices.empty() || fits;
+        else if (fits)
+            better = nbatches < best_batches ||
+                     (nbatches == best_batches && chunk > batching.chunk);
+        else
+            better = footprint < best_footprint;
+        if (better)
+        {
+            batching.indices = {index};
+            batching.chunk = chunk;
+            best_fits = fits;
+            best_batches = nbatches;
+            best_footprint = footprint;
+        }
+    }
+    if (best_batches == 1L)
+        batching.indices.clear();
+    return batching;
+}
+
+void clear_cache()
+{
+    std::lock_guard<std::mutex> lock(path_cache_mutex);
+    path_cache.clear();
+}
+}
+}
@@ -0,0 +1,150 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#if !defined(TENSOR_CONTRACTION_PATH_H)
+#define TENSOR_CONTRACTION_PATH_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <ambit/tensor.h>
+
+namespace ambit
+{
+
+// => Contraction Path Optimizer <= //
+
+/**
+ * Selects the pairwise evaluation order of a product of tensors.
+ *
+ * A product of n terms is evaluated with n - 1 pairwise contractions. Step k
+ * of a Path contracts the operands path[k].first and path[k].second into a
+ * new operand with id n + k; operands 0 ... n - 1 are the terms and the last
+ * step produces the result. The operands of a step may be terms or any
+ * earlier intermediates, so a Path describes an arbitrary binary tree.
+ */
+namespace contraction_path
+{
+
+typedef vector<pair<size_t, size_t>> Path;
+
+/** Cost of a single pairwise contraction.
+ *
+ * Receives the (sorted) indices of the two operands and of the operand they
+ * are contracted into, and returns the pair (cpu cost, memory cost).
+ */
+typedef std::function<pair<double, double>(
+    const Indices &first, const Indices &second, const Indices &result)>
+    PairCost;
+
+/// The left-to-right chain ((t0 * t1) * t2) * ... over the terms in order
+Path chain(const vector<size_t> &order);
+
+/// The order of the terms in a path built with linear = true (or by chain)
+vector<size_t> chain_order(const Path &path, size_t nterms);
+
+/** Returns the cheapest evaluation order of the product of terms.
+ *
+ * Costs are compared by cpu cost first and peak memory second. Orders whose
+ * peak memory exceeds settings::memory_limit lose against any order that
+ * fits. Products of up to max_optimal_terms() terms are searched exhaustively
+ * by dynamic programming over subsets of terms; larger products are built
+ * greedily by contracting the cheapest pair first.
+ *
+ * @param terms the indices of each term
+ * @param result the indices of the result of the whole product
+ * @param cost the cost model
+ * @param linear if true only left-to-right chains are considered
+ */
+Path optimize(const vector<Indices> &terms, const Indices &result,
+              const PairCost &cost, bool linear = false);
+
+/** Same as optimize, but memoized on key.
+ *
+ * key must identify the terms, the result, and everything the cost model
+ * depends on (typically the dimensions of the indices).
+ */
+Path optimize_cached(const string &key, const vector<Indices> &terms,
+                     const Indices &result, const PairCost &cost,
+                     bool linear = false);
+
+/** Cheapest evaluation order of the product rhs into a tensor labeled with
+ * result, using the dimensions of the terms of rhs as the cost model.
+ */
+Path optimal_path(const LabeledTensorContraction &rhs, const Indices &result,
+                  bool linear);
+
+/// The (sorted) indices of each operand produced by the steps of path
+vector<Indices> intermediate_indices(const vector<Indices> &terms,
+                                     const Indices &result, const Path &path);
+
+/// Total cpu cost and peak memory of path
+pair<double, double> path_cost(const vector<Indices> &terms,
+                               const Indices &result, const Path &path,
+                               const PairCost &cost);
+
+/// How a product is batched over indices of its result
+struct Batching
+{
+    /// The batched indices (none if the product is done in one go); all but
+    /// the last take one value per batch
+    Indices indices;
+    /// Number of values of the last batched index taken per batch
+    size_t chunk;
+};
+
+/** Sizes the batches of the product of terms evaluated along path, so that
+ * the intermediates of one batch take at most budget bytes.
+ *
+ * The last of batched takes as many values per batch as fit, so that small
+ * batches do not reduce the contractions to thin GEMMs. If batched is empty,
+ * the index of result that needs the fewest batches is picked, and no
+ * indices are returned when a single batch would cover the whole product.
+ *
+ * @param dims the dimension of every index
+ * @param staged the indices of the operands whose batches are copied into
+ * memory (two at a time, the batch in use and the next one)
+ */
+Batching plan_batching(const vector<Indices> &terms, const Indices &result,
+                       const Path &path, const map<string, size_t> &dims,
+                       const Indices &batched, size_t budget,
+                       const vector<Indices> &staged = vector<Indices>());
+
+/// Largest product that is searched exhaustively
+size_t max_optimal_terms(bool linear);
+
+/// Drops all memoized paths
+void clear_cache();
+}
+}
+
+#endif
@@ -30,112 +30,577 @@
 
 #include "core.h"
 #include "math/math.h"
+#include "tensor/accounting.h"
+#include "scratch.h"
+#include "storage.h"
+#include "tensor/disk/codec.h"
+#include "tensor/disk/disk.h"
+#include "tensor/disk/disk_io.h"
 #include "tensor/indices.h"
+#include "tensor/threads.h"
 #include <algorithm>
 #include <ambit/print.h>
 #include <ambit/timer.h>
+#include <chrono>
 #include <cmath>
+#include <exception>
+#include <future>
 #include <limits>
+#include <map>
+#include <mutex>
+#include <numeric>
 #include <stdexcept>
 #include <string.h>
+#include <tuple>
+#include <unistd.h>
 
 //#include <boost/timer/timer.hpp>
 
 namespace ambit
 {
 
+namespace
+{
+
+Dimension view_dims(const IndexRange &range, const vector<size_t> &fixed)
+{
+    Dimension dims;
+    for (size_t dim = 0; dim < range.size(); dim++)
+    {
+        if (std::find(fixed.begin(), fixed.end(), dim) != fixed.end())
+            continue;
+        const vector<size_t> &bounds = range[dim];
+        dims.push_back(bounds.size() == 2 && bounds[1] > bounds[0]
+                           ? bounds[1] - bounds[0]
+                           : 0L);
+    }
+    return dims;
+}
+}
+
 CoreTensorImpl::CoreTensorImpl(const string &name, const Dimension &dims)
-    : TensorImpl(CoreTensor, name, dims)
+    : TensorImpl(CoreTensor, name, dims), charged_(numel() * sizeof(double)),
+      charged_name_(name), enrolled_(false), spilled_(false), last_use_(0L),
+      pins_(0), spill_fd_(-1)
 {
-    data_.resize(numel(), 0L);
+    memory::charge(charged_name_, charged_);
+    storage::allocate(data_, numel());
 }
 
-void CoreTensorImpl::reshape(const Dimension &dims)
+CoreTensorImpl::CoreTensorImpl(const string &name, const Dimension &dims,
+                               vector<double> &&data)
+    : TensorImpl(CoreTensor, name, dims), data_(std::move(data)), charged_(0L),
+      enrolled_(false), spilled_(false), last_use_(0L), pins_(0),
+      spill_fd_(-1)
 {
-    TensorImpl::reshape(dims);
+    if (data_.size() < numel())
+        throw std::runtime_error(
+            "CoreTensorImpl: storage is smaller than the tensor");
 }
 
-double CoreTensorImpl::norm(int type) const
+CoreTensorImpl::CoreTensorImpl(const string &name, const Dimension &dims,
+                               const function<void(double *)> &loader)
+    : TensorImpl(CoreTensor, name, dims), charged_(numel() * sizeof(double)),
+      charged_name_(name), enrolled_(false), spilled_(true), last_use_(0L),
+      pins_(0), spill_fd_(-1), loader_(loader)
 {
-    double val = 0.0;
-    switch (type)
+}
+
+CoreTensorImpl::CoreTensorImpl(shared_ptr<CoreTensorImpl> parent,
+                               const IndexRange &range)
+    : CoreTensorImpl(parent, range, vector<size_t>())
+{
+}
+
+CoreTensorImpl::CoreTensorImpl(shared_ptr<CoreTensorImpl> parent,
+                               const IndexRange &range,
+                               const vector<size_t> &fixed)
+    : TensorImpl(CoreTensor, parent->name() + " view",
+                 view_dims(range, fixed)),
+      charged_(0L), enrolled_(false), spilled_(false), last_use_(0L),
+      pins_(0), spill_fd_(-1)
+{
+    if (range.size() != parent->rank())
+        throw std::runtime_error(
+            "CoreTensorImpl: view range rank must match the tensor rank");
+    for (size_t dim = 0; dim < range.size(); dim++)
     {
-    case 0:
-        for (size_t ind = 0L; ind < numel(); ind++)
+        if (range[dim].size() != 2 || range[dim][0] > range[dim][1] ||
+            range[dim][1] > parent->dim(dim))
+            throw std::runtime_error(
+                "CoreTensorImpl: view range is out of bounds");
+    }
+    for (size_t dim : fixed)
+    {
+        if (dim >= range.size() || range[dim][1] != range[dim][0] + 1L)
+            throw std::runtime_error(
+                "CoreTensorImpl: a fixed index of a view must have a range "
+                "of one element");
+    }
+
+    // A view of a view looks into the same storage
+    vector<size_t> axes(range.size());
+    std::iota(axes.begin(), axes.end(), 0L);
+    if (parent->is_view())
+    {
+        view_range_ = parent->view_range_;
+        for (size_t dim = 0; dim < range.size(); dim++)
         {
-            val = std::max(val, fabs(data_[ind]));
+            size_t axis = parent->view_axes_[dim];
+            view_range_[axis][0] = parent->view_range_[axis][0] + range[dim][0];
+            view_range_[axis][1] = parent->view_range_[axis][0] + range[dim][1];
         }
-        return val;
-    case 1:
-        for (size_t ind = 0L; ind < numel(); ind++)
+        axes = parent->view_axes_;
+        parent = parent->view_parent_;
+    }
+    else
+        view_range_ = range;
+    for (size_t dim = 0; dim < range.size(); dim++)
+    {
+        if (std::find(fixed.begin(), fixed.end(), dim) == fixed.end())
+            view_axes_.push_back(axes[dim]);
+    }
+    view_parent_ = parent;
+}
+
+CoreTensorImpl::~CoreTensorImpl()
+{
+    if (enrolled_)
+        spill::withdraw(this);
+    if (spilled_)
+    {
+        // The charge went with the data
+        if (spill_fd_ != -1)
         {
-            val += fabs(data_[ind]);
+            disk_io::close(spill_fd_);
+            remove(spill_file_.c_str());
         }
-        return val;
-    case 2:
-        for (size_t ind = 0L; ind < numel(); ind++)
+    }
+    // Storage handed over by the scratch pool is accounted by the pool
+    else if (charged_)
+        memory::discharge(charged_name_, charged_);
+}
+
+void CoreTensorImpl::enroll()
+{
+    enrolled_ = true;
+    spill::enroll(this);
+}
+
+void CoreTensorImpl::pin() const
+{
+    if (view_parent_)
+        return view_parent_->pin();
+    std::lock_guard<std::mutex> lock(spill_mutex_);
+    pins_++;
+}
+
+void CoreTensorImpl::unpin() const
+{
+    if (view_parent_)
+        return view_parent_->unpin();
+    std::lock_guard<std::mutex> lock(spill_mutex_);
+    pins_--;
+}
+
+void CoreTensorImpl::view_error() const
+{
+    throw std::runtime_error(
+        "CoreTensorImpl: \"" + name() +
+        "\" is a view; only contract, copy, slice, scale and zero support "
+        "views");
+}
+
+double *CoreTensorImpl::strided_data(vector<size_t> &strides)
+{
+    const CoreTensorImpl *self = this;
+    return const_cast<double *>(self->strided_data(strides));
+}
+
+const double *CoreTensorImpl::strided_data(vector<size_t> &strides) const
+{
+    const CoreTensorImpl *owner = is_view() ? view_parent_.get() : this;
+    strides.assign(owner->rank(), 1L);
+    for (int dim = static_cast<int>(owner->rank()) - 2; dim >= 0; dim--)
+        strides[dim] = strides[dim + 1] * owner->dim(dim + 1);
+
+    const double *values = owner->data().data();
+    if (is_view())
+    {
+        for (size_t dim = 0; dim < owner->rank(); dim++)
+            values += view_range_[dim][0] * strides[dim];
+        vector<size_t> kept;
+        for (size_t axis : view_axes_)
+            kept.push_back(strides[axis]);
+        strides.swap(kept);
+    }
+    return values;
+}
+
+size_t CoreTensorImpl::spill()
+{
+    // A busy tensor is being pinned or read back, and is not cold anyway
+    std::unique_lock<std::mutex> lock(spill_mutex_, std::try_to_lock);
+    if (!lock.owns_lock() || pins_ > 0 || spilled_ || charged_ == 0L)
+        return 0L;
+
+    stringstream ss;
+    ss << Tensor::scratch_path() << "/Spill." << getpid() << "."
+       << disk_next_id() << ".dat";
+    spill_file_ = ss.str();
+    spill_fd_ = disk_io::open(spill_file_);
+    AMBIT_TIMER_PUSH("spill to disk");
+    if (settings::disk_compression)
+    {
+        // Runs are compressed in parallel and written one after another
+        size_t nrun = (numel() + disk_io::extent_size__ - 1L) /
+                      disk_io::extent_size__;
+        vector<vector<double>> packed(nrun);
+#pragma omp parallel for schedule(dynamic)
+        for (size_t run = 0L; run < nrun; run++)
         {
-            val += data_[ind] * data_[ind];
+            size_t offset = run * disk_io::extent_size__;
+            codec::compress(data_.data() + offset,
+                            std::min(disk_io::extent_size__, numel() - offset),
+                            packed[run]);
         }
-        return sqrt(val);
-    default:
-        throw std::runtime_error(
-            "Norm must be 0 (infty-norm), 1 (1-norm), or 2 (2-norm)");
-        break;
+        spill_runs_.clear();
+        size_t offset = 0L;
+        for (const vector<double> &run : packed)
+        {
+            disk_io::write(spill_fd_, run.data(), run.size(), offset);
+            spill_runs_.push_back(run.size());
+            offset += run.size();
+        }
+    }
+    else
+    {
+        spill_runs_.clear();
+        disk_io::write(spill_fd_, data_.data(), numel(), 0L);
     }
+    AMBIT_TIMER_POP();
+    vector<double>().swap(data_);
+    spilled_ = true;
+    memory::discharge(charged_name_, charged_);
+    return charged_;
 }
 
-tuple<double, vector<size_t>> CoreTensorImpl::max() const
+void CoreTensorImpl::fault_in() const
 {
-    tuple<double, vector<size_t>> element;
-
-    std::get<0>(element) = std::numeric_limits<double>::lowest();
+    std::lock_guard<std::mutex> lock(spill_mutex_);
+    if (!spilled_)
+        return;
 
-    citerate([&](const vector<size_t> &indices, const double &value) {
-        if (std::get<0>(element) < value)
+    // May spill other tensors in turn
+    memory::charge(charged_name_, charged_);
+    storage::allocate(data_, numel());
+    if (loader_)
+    {
+        AMBIT_TIMER_PUSH("load deferred data");
+        try
         {
-            std::get<0>(element) = value;
-            std::get<1>(element) = indices;
+            loader_(data_.data());
         }
-    });
+        catch (...)
+        {
+            vector<double>().swap(data_);
+            memory::discharge(charged_name_, charged_);
+            AMBIT_TIMER_POP();
+            throw;
+        }
+        AMBIT_TIMER_POP();
+        loader_ = nullptr;
+        spilled_ = false;
+        return;
+    }
+    AMBIT_TIMER_PUSH("read back from disk");
+    if (spill_runs_.empty())
+    {
+        disk_io::read(spill_fd_, data_.data(), numel(), 0L);
+    }
+    else
+    {
+        // Each thread reads and expands its own runs
+        vector<size_t> offsets(spill_runs_.size(), 0L);
+        for (size_t run = 1L; run < spill_runs_.size(); run++)
+            offsets[run] = offsets[run - 1] + spill_runs_[run - 1];
+#pragma omp parallel for schedule(dynamic)
+        for (size_t run = 0L; run < spill_runs_.size(); run++)
+        {
+            vector<double> packed(spill_runs_[run]);
+            disk_io::read(spill_fd_, packed.data(), packed.size(),
+                          offsets[run]);
+            size_t offset = run * disk_io::extent_size__;
+            codec::decompress(
+                packed.data(), data_.data() + offset,
+                std::min(disk_io::extent_size__, numel() - offset));
+        }
+        spill_runs_.clear();
+    }
+    AMBIT_TIMER_POP();
+    disk_io::close(spill_fd_);
+    remove(spill_file_.c_str());
+    spill_fd_ = -1;
+    spilled_ = false;
+}
 
-    return element;
+void CoreTensorImpl::reshape(const Dimension &dims)
+{
+    TensorImpl::reshape(dims);
 }
 
-tuple<double, vector<size_t>> CoreTensorImpl::min() const
+namespace
+{
+
+/// Elements per chunk of the statistics reduction, small enough for the
+/// position search to find the chunk in cache
+const size_t stats_chunk = 32768L;
+
+struct ChunkStats
+{
+    double sum1;
+    double sum2;
+    double max_abs;
+    size_t max_pos;
+    size_t min_pos;
+};
+
+vector<size_t> unravel(size_t pos, const Dimension &dims)
 {
-    tuple<double, vector<size_t>> element;
+    vector<size_t> indices(dims.size());
+    for (size_t d = dims.size(); d-- > 0;)
+    {
+        indices[d] = pos % dims[d];
+        pos /= dims[d];
+    }
+    return indices;
+}
+}
+
+TensorStats CoreTensorImpl::stats() const
+{
+    TensorStats result;
+    result.numel = numel();
+    if (numel() == 0L)
+    {
+        result.max = std::numeric_limits<double>::lowest();
+        result.min = std::numeric_limits<double>::max();
+        return result;
+    }
+
+    const double *values = data().data();
+    size_t nchunk = (numel() + stats_chunk - 1) / stats_chunk;
+    vector<ChunkStats> chunks(nchunk);
 
-    std::get<0>(element) = std::numeric_limits<double>::max();
+    // Chunks are combined in order below, so the result does not depend on
+    // the number of threads
+#pragma omp parallel for schedule(static) if (nchunk > 1)
+    for (long c = 0; c < static_cast<long>(nchunk); ++c)
+    {
+        size_t begin = c * stats_chunk;
+        size_t end = std::min(numel(), begin + stats_chunk);
+
+        double sum1 = 0.0, sum2 = 0.0, max_abs = 0.0;
+#pragma omp simd reduction(+ : sum1, sum2) reduction(max : max_abs)
+        for (size_t ind = begin; ind < end; ++ind)
+        {
+            double value = values[ind];
+            double abs_value = fabs(value);
+            sum1 += abs_value;
+            sum2 += value * value;
+            max_abs = std::max(max_abs, abs_value);
+        }
 
-    citerate([&](const vector<size_t> &indices, const double &value) {
-        if (std::get<0>(element) > value)
+        size_t max_pos = begin, min_pos = begin;
+        for (size_t ind = begin + 1; ind < end; ++ind)
         {
-            std::get<0>(element) = value;
-            std::get<1>(element) = indices;
+            if (values[ind] > values[max_pos])
+                max_pos = ind;
+            if (values[ind] < values[min_pos])
+                min_pos = ind;
         }
-    });
+        chunks[c] = {sum1, sum2, max_abs, max_pos, min_pos};
+    }
+
+    double sum2 = 0.0;
+    size_t max_pos = chunks[0].max_pos, min_pos = chunks[0].min_pos;
+    for (const ChunkStats &chunk : chunks)
+    {
+        result.norm1 += chunk.sum1;
+        sum2 += chunk.sum2;
+        result.norm_inf = std::max(result.norm_inf, chunk.max_abs);
+        if (values[chunk.max_pos] > values[max_pos])
+            max_pos = chunk.max_pos;
+        if (values[chunk.min_pos] < values[min_pos])
+            min_pos = chunk.min_pos;
+    }
+    result.norm2 = sqrt(sum2);
+    result.rms = sqrt(sum2 / static_cast<double>(numel()));
+    result.max = values[max_pos];
+    result.max_indices = unravel(max_pos, dims());
+    result.min = values[min_pos];
+    result.min_indices = unravel(min_pos, dims());
+    return result;
+}
+
+double CoreTensorImpl::norm(int type) const
+{
+    switch (type)
+    {
+    case 0:
+        return stats().norm_inf;
+    case 1:
+        return stats().norm1;
+    case 2:
+        return stats().norm2;
+    default:
+        throw std::runtime_error(
+            "Norm must be 0 (infty-norm), 1 (1-norm), or 2 (2-norm)");
+        break;
+    }
+}
+
+tuple<double, vector<size_t>> CoreTensorImpl::max() const
+{
+    TensorStats result = stats();
+    return std::make_tuple(result.max, result.max_indices);
+}
 
-    return element;
+tuple<double, vector<size_t>> CoreTensorImpl::min() const
+{
+    TensorStats result = stats();
+    return std::make_tuple(result.min, result.min_indices);
 }
 
 void CoreTensorImpl::scale(double beta)
 {
+    if (is_view())
+    {
+        // One run of the last index at a time
+        vector<size_t> strides;
+        double *values = strided_data(strides);
+        size_t nrun = rank() ? dim(rank() - 1) : 1L;
+        size_t step = rank() ? strides[rank() - 1] : 1L;
+        if (nrun == 0L)
+            return;
+        vector<size_t> counter(rank(), 0L);
+        for (size_t run = 0L, nruns = numel() / nrun; run < nruns; run++)
+        {
+            double *x = values;
+            for (size_t dim = 0; dim + 1 < rank(); dim++)
+                x += counter[dim] * strides[dim];
+            for (size_t n = 0L; n < nrun; n++)
+                x[n * step] = (beta == 0.0 ? 0.0 : beta * x[n * step]);
+            for (int dim = static_cast<int>(rank()) - 2; dim >= 0; dim--)
+            {
+                if (++counter[dim] < this->dim(dim))
+                    break;
+                counter[dim] = 0L;
+            }
+        }
+        return;
+    }
     if (beta == 0.0)
-        memset(data_.data(), '\0', sizeof(double) * numel());
+        memset(data().data(), '\0', sizeof(double) * numel());
     else
-        C_DSCAL(numel(), beta, data_.data(), 1);
+        C_DSCAL(numel(), beta, data().data(), 1);
 }
 
 void CoreTensorImpl::set(double alpha)
 {
+    double *values = data().data();
     for (size_t i = 0; i < numel(); ++i)
-        data_[i] = alpha;
+        values[i] = alpha;
 }
 
 namespace
 {
 
+/// Largest per-slice GEMM (nrow * ncol * nzip) of a Hadamard contraction
+/// that is batched across threads rather than handed to threaded BLAS
+const size_t hadamard_batch_work__ = 2097152L;
+
+/// Sets the nrow x ncol block of C (leading dimension ldaC) to beta * C
+void scale_block(size_t nrow, size_t ncol, double beta, double *Cp,
+                 size_t ldaC)
+{
+    for (size_t row = 0L; row < nrow; row++)
+    {
+        // Zeroing without DSCAL so unset scratch cannot leave NaNs behind
+        if (beta == 0.0)
+            memset(Cp + row * ldaC, '\0', sizeof(double) * ncol);
+        else
+            C_DSCAL(ncol, beta, Cp + row * ldaC, 1);
+    }
+}
+
+/**
+ * C = alpha * op(L) * op(R) + beta * C with row-major operands, as C_DGEMM.
+ *
+ * Shapes with a unit dimension are sent to BLAS1/BLAS2: matrix-vector
+ * products to DGEMV, outer products to DGER, dot products to DDOT, and
+ * vector scalings to DAXPY.
+ */
+void product(char transL, char transR, size_t nrow, size_t ncol, size_t nzip,
+             double alpha, double *Lp, size_t ldaL, double *Rp, size_t ldaR,
+             double beta, double *Cp, size_t ldaC)
+{
+    // Strides of L along its row index and of R along its column index
+    int incLrow = (transL == 'N' ? ldaL : 1);
+    int incRcol = (transR == 'N' ? 1 : ldaR);
+    // Strides of L and R along the contracted index
+    int incLzip = (transL == 'N' ? 1 : ldaL);
+    int incRzip = (transR == 'N' ? ldaR : 1);
+
+    if (nrow != 1L && ncol != 1L && nzip != 1L)
+    {
+        C_DGEMM(transL, transR, nrow, ncol, nzip, alpha, Lp, ldaL, Rp, ldaR,
+                beta, Cp, ldaC);
+    }
+    else if (nrow != 1L && ncol != 1L)
+    {
+        scale_block(nrow, ncol, beta, Cp, ldaC);
+        C_DGER(nrow, ncol, alpha, Lp, incLrow, Rp, incRcol, Cp, ldaC);
+    }
+    else if (nrow != 1L && nzip != 1L)
+    {
+        if (transL == 'N')
+            C_DGEMV('N', nrow, nzip, alpha, Lp, ldaL, Rp, incRzip, beta, Cp,
+                    ldaC);
+        else
+            C_DGEMV('T', nzip, nrow, alpha, Lp, ldaL, Rp, incRzip, beta, Cp,
+                    ldaC);
+    }
+    else if (ncol != 1L && nzip != 1L)
+    {
+        if (transR == 'N')
+            C_DGEMV('T', nzip, ncol, alpha, Rp, ldaR, Lp, incLzip, beta, Cp,
+                    1);
+        else
+            C_DGEMV('N', ncol, nzip, alpha, Rp, ldaR, Lp, incLzip, beta, Cp,
+                    1);
+    }
+    else if (nrow != 1L)
+    {
+        scale_block(nrow, 1L, beta, Cp, ldaC);
+        C_DAXPY(nrow, alpha * (*Rp), Lp, incLrow, Cp, ldaC);
+    }
+    else if (ncol != 1L)
+    {
+        scale_block(1L, ncol, beta, Cp, ldaC);
+        C_DAXPY(ncol, alpha * (*Lp), Rp, incRcol, Cp, 1);
+    }
+    else if (nzip != 1L)
+    {
+        double dot = C_DDOT(nzip, Lp, incLzip, Rp, incRzip);
+        (*Cp) = alpha * dot + (beta == 0.0 ? 0.0 : beta * (*Cp));
+    }
+    else
+    {
+        (*Cp) = alpha * (*Lp) * (*Rp) + (beta == 0.0 ? 0.0 : beta * (*Cp));
+    }
+}
+
 std::string describe_tensor(ConstTensorImplPtr A, const Indices &Ainds)
 {
     std::ostringstream buffer;
@@ -154,30 +619,68 @@ std::string describe_contraction(ConstTensorImplPtr C, const Indices &Cinds,
     return buffer.str();
 }
 
-} // anonymous namespace
-
-void CoreTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
-                              const Indices &Cinds, const Indices &Ainds,
-                              const Indices &Binds, double alpha, double beta)
+/// The GEMM layout of a contraction C[Cinds] = A[Ainds] * B[Binds]: which
+/// operands must be permuted, to which index order, and the GEMM sizes
+struct ContractionPlan
 {
-    shared_ptr<TensorImpl> A2;
-    shared_ptr<TensorImpl> B2;
-    shared_ptr<TensorImpl> C2;
-    contract(A, B, Cinds, Ainds, Binds, A2, B2, C2, alpha, beta);
-}
-
-void CoreTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
-                              const Indices &Cinds, const Indices &Ainds,
-                              const Indices &Binds,
-                              std::shared_ptr<TensorImpl> &A2,
-                              std::shared_ptr<TensorImpl> &B2,
-                              std::shared_ptr<TensorImpl> &C2, double alpha,
-                              double beta)
+    bool permC;
+    bool permA;
+    bool permB;
+    bool C_transpose;
+    bool A_transpose;
+    bool B_transpose;
+    // Whether the Hadamard indices of an operand sit between its two GEMM
+    // index groups ([G1, P, G2]) rather than in front of them ([P, G1, G2])
+    bool C_Pmid;
+    bool A_Pmid;
+    bool B_Pmid;
+    size_t ABC_size;
+    size_t BC_size;
+    size_t AC_size;
+    size_t AB_size;
+    Indices Cinds2;
+    Indices Ainds2;
+    Indices Binds2;
+};
+
+/// A plan only depends on the shapes and labels of the operands, and on
+/// how it was tuned: whether C is read (beta != 0) and the layout settings
+typedef std::tuple<Dimension, Dimension, Dimension, Indices, Indices, Indices,
+                   bool, int, int>
+    ContractionPlanKey;
+
+/// Maximum number of plans kept before the cache is flushed
+const size_t max_contraction_plans = 4096;
+
+std::mutex contraction_plan_mutex;
+std::map<ContractionPlanKey, ContractionPlan> contraction_plans;
+
+/**
+ * Choices between the equivalent GEMM layouts of a contraction, as bits:
+ * which side of a mismatched index group adopts the order of the other
+ * (C for i and j, A for k, when set), and whether a permuted C, A or B is
+ * stored with its two GEMM index groups swapped (so that it is transposed
+ * in the GEMM). The fixed rules of build_contraction_plan are used
+ * instead when the layout is rule_layout.
+ */
+const unsigned layout_fix_i = 1u << 0;
+const unsigned layout_fix_j = 1u << 1;
+const unsigned layout_fix_k = 1u << 2;
+const unsigned layout_swap_C = 1u << 3;
+const unsigned layout_swap_A = 1u << 4;
+const unsigned layout_swap_B = 1u << 5;
+const unsigned num_layouts = 1u << 6;
+const unsigned rule_layout = ~0u;
+
+ContractionPlan build_contraction_plan(ConstTensorImplPtr C,
+                                       ConstTensorImplPtr A,
+                                       ConstTensorImplPtr B,
+                                       const Indices &Cinds,
+                                       const Indices &Ainds,
+                                       const Indices &Binds, double alpha,
+                                       double beta,
+                                       unsigned layout = rule_layout)
 {
-    ambit::timer::timer_push("pre-BLAS: internal overhead");
-
-    TensorImplPtr C = this;
-
     // => Permutation Logic <= //
 
     // Determine unique indices
@@ -303,22 +806,50 @@ void CoreTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
     permB = permB || !indices::contiguous(compound_inds["jB"]);
     permB = permB || !indices::contiguous(compound_inds["kB"]);
 
-    // Hadamard Test (always requires permutation)
+    // Hadamard Test: the P indices must lead, or sit between the two other
+    // index groups so that each P slice is a matrix with a larger leading
+    // dimension. Anything else requires permutation.
+    //
+    // P sits in the middle only between two non-empty groups: the transpose
+    // flags below take the group in front of P as the GEMM row group and
+    // the group after it as the one the leading dimension comes from, which
+    // an empty group would leave undetermined.
     size_t Psize = compound_inds["PC"].size();
+    auto P_in_middle = [Psize](const vector<pair<int, string>> &P,
+                               const vector<pair<int, string>> &G1,
+                               const vector<pair<int, string>> &G2) {
+        if (!Psize || P[0].first == 0 || G1.empty() || G2.empty())
+            return false;
+        const vector<pair<int, string>> &front =
+            G1[0].first == 0 ? G1 : G2;
+        const vector<pair<int, string>> &back = G1[0].first == 0 ? G2 : G1;
+        return front[0].first == 0 &&
+               static_cast<int>(front.size()) == P[0].first &&
+               back[0].first == static_cast<int>(front.size() + Psize);
+    };
+    bool C_Pmid = P_in_middle(compound_inds["PC"], compound_inds["iC"],
+                               compound_inds["jC"]);
+    bool A_Pmid = P_in_middle(compound_inds["PA"], compound_inds["iA"],
+                               compound_inds["kA"]);
+    bool B_Pmid = P_in_middle(compound_inds["PB"], compound_inds["jB"],
+                               compound_inds["kB"]);
     if (Psize)
     {
-        permC = permC || (compound_inds["PC"][0].first != 0);
-        permA = permA || (compound_inds["PA"][0].first != 0);
-        permB = permB || (compound_inds["PB"][0].first != 0);
+        permC = permC || (compound_inds["PC"][0].first != 0 && !C_Pmid);
+        permA = permA || (compound_inds["PA"][0].first != 0 && !A_Pmid);
+        permB = permB || (compound_inds["PB"][0].first != 0 && !B_Pmid);
     }
 
     /// Figure out the initial transposes (will be fixed if perm is set)
-    bool A_transpose =
-        compound_inds["iA"].size() && compound_inds["iA"][0].first != Psize;
-    bool B_transpose =
-        compound_inds["jB"].size() && compound_inds["jB"][0].first == Psize;
-    bool C_transpose =
-        compound_inds["iC"].size() && compound_inds["iC"][0].first != Psize;
+    size_t Cstart = (C_Pmid ? 0L : Psize);
+    size_t Astart = (A_Pmid ? 0L : Psize);
+    size_t Bstart = (B_Pmid ? 0L : Psize);
+    bool A_transpose = compound_inds["iA"].size() &&
+                       compound_inds["iA"][0].first != (int)Astart;
+    bool B_transpose = compound_inds["jB"].size() &&
+                       compound_inds["jB"][0].first == (int)Bstart;
+    bool C_transpose = compound_inds["iC"].size() &&
+                       compound_inds["iC"][0].first != (int)Cstart;
 
     // Fix contiguous considerations (already in correct order for contiguous
     // cases)
@@ -337,7 +868,7 @@ void CoreTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
     /**
     * Fix permutation order considerations
     *
-    * Rules if a permutation mismatch is detected:
+    * Rules if a permutation mismatch is detected (unless a layout is given):
     * -If both tensors are already on the permute list, it doesn't matter which
     *is fixed
     * -Else if one tensor is already on the permute list but not the other, fix
@@ -348,17 +879,12 @@ void CoreTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
     *for reasons of simplicity, A and B are
     * permuted to C's P order, with no present considerations of better pathways
     **/
+    bool rules = (layout == rule_layout);
     if (!indices::equivalent(compound_inds2["iC"], compound_inds2["iA"]))
     {
-        if (permC)
-        {
-            compound_inds2["iC"] = compound_inds2["iA"];
-        }
-        else if (permA)
-        {
-            compound_inds2["iA"] = compound_inds2["iC"];
-        }
-        else if (C->numel() <= A->numel())
+        bool fixC = rules ? permC || (!permA && C->numel() <= A->numel())
+                          : (layout & layout_fix_i) != 0;
+        if (fixC)
         {
             compound_inds2["iC"] = compound_inds2["iA"];
             permC = true;
@@ -371,15 +897,9 @@ void CoreTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
     }
     if (!indices::equivalent(compound_inds2["jC"], compound_inds2["jB"]))
     {
-        if (permC)
-        {
-            compound_inds2["jC"] = compound_inds2["jB"];
-        }
-        else if (permB)
-        {
-            compound_inds2["jB"] = compound_inds2["jC"];
-        }
-        else if (C->numel() <= B->numel())
+        bool fixC = rules ? permC || (!permB && C->numel() <= B->numel())
+                          : (layout & layout_fix_j) != 0;
+        if (fixC)
         {
             compound_inds2["jC"] = compound_inds2["jB"];
             permC = true;
@@ -392,15 +912,9 @@ void CoreTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
     }
     if (!indices::equivalent(compound_inds2["kA"], compound_inds2["kB"]))
     {
-        if (permA)
-        {
-            compound_inds2["kA"] = compound_inds2["kB"];
-        }
-        else if (permB)
-        {
-            compound_inds2["kB"] = compound_inds2["kA"];
-        }
-        else if (A->numel() <= B->numel())
+        bool fixA = rules ? permA || (!permB && A->numel() <= B->numel())
+                          : (layout & layout_fix_k) != 0;
+        if (fixA)
         {
             compound_inds2["kA"] = compound_inds2["kB"];
             permA = true;
@@ -422,20 +936,32 @@ void CoreTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
         permB = true;
     }
 
+    // Permuted operands take the standard [P, G1, G2] order
+    C_Pmid = C_Pmid && !permC;
+    A_Pmid = A_Pmid && !permA;
+    B_Pmid = B_Pmid && !permB;
+
     /// Assign the permuted indices (if flagged for permute) or the original
     /// indices
     Indices Cinds2;
     Indices Ainds2;
     Indices Binds2;
+    // Swapping an empty group changes nothing
+    bool swapC = !rules && (layout & layout_swap_C) &&
+                 !compound_inds2["iC"].empty() && !compound_inds2["jC"].empty();
+    bool swapA = !rules && (layout & layout_swap_A) &&
+                 !compound_inds2["iA"].empty() && !compound_inds2["kA"].empty();
+    bool swapB = !rules && (layout & layout_swap_B) &&
+                 !compound_inds2["jB"].empty() && !compound_inds2["kB"].empty();
     if (permC)
     {
+        const Indices &first = compound_inds2[swapC ? "jC" : "iC"];
+        const Indices &second = compound_inds2[swapC ? "iC" : "jC"];
         Cinds2.insert(Cinds2.end(), compound_inds2["PC"].begin(),
                       compound_inds2["PC"].end());
-        Cinds2.insert(Cinds2.end(), compound_inds2["iC"].begin(),
-                      compound_inds2["iC"].end());
-        Cinds2.insert(Cinds2.end(), compound_inds2["jC"].begin(),
-                      compound_inds2["jC"].end());
-        C_transpose = false;
+        Cinds2.insert(Cinds2.end(), first.begin(), first.end());
+        Cinds2.insert(Cinds2.end(), second.begin(), second.end());
+        C_transpose = swapC;
     }
     else
     {
@@ -443,13 +969,13 @@ void CoreTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
     }
     if (permA)
     {
+        const Indices &first = compound_inds2[swapA ? "kA" : "iA"];
+        const Indices &second = compound_inds2[swapA ? "iA" : "kA"];
         Ainds2.insert(Ainds2.end(), compound_inds2["PA"].begin(),
                       compound_inds2["PA"].end());
-        Ainds2.insert(Ainds2.end(), compound_inds2["iA"].begin(),
-                      compound_inds2["iA"].end());
-        Ainds2.insert(Ainds2.end(), compound_inds2["kA"].begin(),
-                      compound_inds2["kA"].end());
-        A_transpose = false;
+        Ainds2.insert(Ainds2.end(), first.begin(), first.end());
+        Ainds2.insert(Ainds2.end(), second.begin(), second.end());
+        A_transpose = swapA;
     }
     else
     {
@@ -457,13 +983,13 @@ void CoreTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
     }
     if (permB)
     {
+        const Indices &first = compound_inds2[swapB ? "kB" : "jB"];
+        const Indices &second = compound_inds2[swapB ? "jB" : "kB"];
         Binds2.insert(Binds2.end(), compound_inds2["PB"].begin(),
                       compound_inds2["PB"].end());
-        Binds2.insert(Binds2.end(), compound_inds2["jB"].begin(),
-                      compound_inds2["jB"].end());
-        Binds2.insert(Binds2.end(), compound_inds2["kB"].begin(),
-                      compound_inds2["kB"].end());
-        B_transpose = true;
+        Binds2.insert(Binds2.end(), first.begin(), first.end());
+        Binds2.insert(Binds2.end(), second.begin(), second.end());
+        B_transpose = !swapB;
     }
     else
     {
@@ -505,208 +1031,1175 @@ void CoreTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
     printf("\n");
     **/
 
-    ambit::timer::timer_pop();
+    ContractionPlan plan;
+    plan.permC = permC;
+    plan.permA = permA;
+    plan.permB = permB;
+    plan.C_transpose = C_transpose;
+    plan.A_transpose = A_transpose;
+    plan.B_transpose = B_transpose;
+    plan.C_Pmid = C_Pmid;
+    plan.A_Pmid = A_Pmid;
+    plan.B_Pmid = B_Pmid;
+    plan.ABC_size = ABC_size;
+    plan.BC_size = BC_size;
+    plan.AC_size = AC_size;
+    plan.AB_size = AB_size;
+    plan.Cinds2 = Cinds2;
+    plan.Ainds2 = Ainds2;
+    plan.Binds2 = Binds2;
+    return plan;
+}
+
+/// GETT tile sizes (rows of C, columns of C, and contracted elements)
+const size_t gett_mc__ = 128L;
+const size_t gett_nc__ = 128L;
+const size_t gett_kc__ = 128L;
+
+/// Offsets of every element of the index group labels (in the given order)
+/// inside a tensor with indices inds, dimensions dims and element strides
+vector<size_t> group_offsets(const Indices &labels, const Indices &inds,
+                             const Dimension &dims,
+                             const vector<size_t> &strides)
+{
+    vector<size_t> sizes;
+    vector<size_t> steps;
+    size_t total = 1L;
+    for (const string &label : labels)
+    {
+        size_t pos = std::find(inds.begin(), inds.end(), label) - inds.begin();
+        sizes.push_back(dims[pos]);
+        steps.push_back(strides[pos]);
+        total *= dims[pos];
+    }
+
+    // Odometer walk with the last label fastest
+    vector<size_t> offsets(total);
+    vector<size_t> counter(labels.size(), 0L);
+    size_t offset = 0L;
+    for (size_t n = 0L; n < total; n++)
+    {
+        offsets[n] = offset;
+        for (int ind = static_cast<int>(labels.size()) - 1; ind >= 0; ind--)
+        {
+            offset += steps[ind];
+            if (++counter[ind] < sizes[ind])
+                break;
+            offset -= steps[ind] * sizes[ind];
+            counter[ind] = 0L;
+        }
+    }
+    return offsets;
+}
+
+/**
+ * Leading dimension of a tensor seen as a row-major matrix, when its indices
+ * inds are the labels rows followed by the labels cols and its strides let
+ * each group be addressed as one index. Returns 0 when they do not.
+ */
+size_t matrix_ld(const Indices &inds, const Dimension &dims,
+                 const vector<size_t> &strides, const Indices &rows,
+                 const Indices &cols)
+{
+    Indices order(rows);
+    order.insert(order.end(), cols.begin(), cols.end());
+    if (order != inds)
+        return 0L;
+
+    size_t nrow = rows.size();
+    size_t rank = inds.size();
+    for (size_t dim = 0; dim + 1 < rank; dim++)
+    {
+        if (dim + 1 == nrow)
+            continue;
+        if (strides[dim] != strides[dim + 1] * dims[dim + 1])
+            return 0L;
+    }
+    if (nrow < rank && strides[rank - 1] != 1L)
+        return 0L;
+
+    size_t ncol = 1L;
+    for (size_t dim = nrow; dim < rank; dim++)
+        ncol *= dims[dim];
+    return nrow == 0 ? std::max<size_t>(1L, ncol) : strides[nrow - 1];
+}
 
-    // => Alias or Allocate A, B, C <= //
-    // => Permute A, B, and C if Necessary <= //
+/**
+ * C = alpha * A * B + beta * C by GETT: tiles of A and B are packed straight
+ * from their strides, multiplied by GEMM, and the product tile is scattered
+ * back into C, so the working set is a few tiles per thread rather than the
+ * permuted copies of whole operands. The operands may be views with any
+ * strides; when all three are matrices in their strides (no Hadamard
+ * indices), a single GEMM runs on them in place. The indices must already
+ * be validated.
+ */
+void strided_contract(double *Cp, const Dimension &Cdims,
+                      const vector<size_t> &Cstrides, const Indices &Cinds,
+                      const double *Ap, const Dimension &Adims,
+                      const vector<size_t> &Astrides, const Indices &Ainds,
+                      const double *Bp, const Dimension &Bdims,
+                      const vector<size_t> &Bstrides, const Indices &Binds,
+                      double alpha, double beta)
+{
+    auto has = [](const Indices &inds, const string &label) {
+        return std::find(inds.begin(), inds.end(), label) != inds.end();
+    };
+
+    // Hadamard (P), row (I), column (J), and contracted (K) index groups
+    Indices Pinds;
+    Indices Iinds;
+    Indices Jinds;
+    Indices Kinds;
+    for (const string &label : Cinds)
+    {
+        if (has(Ainds, label) && has(Binds, label))
+            Pinds.push_back(label);
+        else if (has(Ainds, label))
+            Iinds.push_back(label);
+        else
+            Jinds.push_back(label);
+    }
+    for (const string &label : Ainds)
+    {
+        if (!has(Cinds, label))
+            Kinds.push_back(label);
+    }
 
+    const vector<size_t> CP = group_offsets(Pinds, Cinds, Cdims, Cstrides);
+    const vector<size_t> AP = group_offsets(Pinds, Ainds, Adims, Astrides);
+    const vector<size_t> BP = group_offsets(Pinds, Binds, Bdims, Bstrides);
+    const vector<size_t> CI = group_offsets(Iinds, Cinds, Cdims, Cstrides);
+    const vector<size_t> AI = group_offsets(Iinds, Ainds, Adims, Astrides);
+    const vector<size_t> CJ = group_offsets(Jinds, Cinds, Cdims, Cstrides);
+    const vector<size_t> BJ = group_offsets(Jinds, Binds, Bdims, Bstrides);
+    const vector<size_t> AK = group_offsets(Kinds, Ainds, Adims, Astrides);
+    const vector<size_t> BK = group_offsets(Kinds, Binds, Bdims, Bstrides);
+
+    const size_t np = CP.size();
+    const size_t ni = CI.size();
+    const size_t nj = CJ.size();
+    const size_t nk = AK.size();
+
+    // => GEMM on the Operands in Place <= //
+
+    if (Pinds.empty())
+    {
+        size_t ldaA = matrix_ld(Ainds, Adims, Astrides, Iinds, Kinds);
+        size_t ldaAt = matrix_ld(Ainds, Adims, Astrides, Kinds, Iinds);
+        size_t ldaB = matrix_ld(Binds, Bdims, Bstrides, Kinds, Jinds);
+        size_t ldaBt = matrix_ld(Binds, Bdims, Bstrides, Jinds, Kinds);
+        size_t ldaC = matrix_ld(Cinds, Cdims, Cstrides, Iinds, Jinds);
+        size_t ldaCt = matrix_ld(Cinds, Cdims, Cstrides, Jinds, Iinds);
+        if ((ldaA || ldaAt) && (ldaB || ldaBt) && (ldaC || ldaCt))
+        {
+            char transA = (ldaA ? 'N' : 'T');
+            char transB = (ldaB ? 'N' : 'T');
+            double *A2p = const_cast<double *>(Ap);
+            double *B2p = const_cast<double *>(Bp);
+            if (ldaC)
+                product(transA, transB, ni, nj, nk, alpha, A2p,
+                        ldaA ? ldaA : ldaAt, B2p, ldaB ? ldaB : ldaBt, beta,
+                        Cp, ldaC);
+            else
+                // C^T = B^T A^T
+                product(transB == 'N' ? 'T' : 'N', transA == 'N' ? 'T' : 'N',
+                        nj, ni, nk, alpha, B2p, ldaB ? ldaB : ldaBt, A2p,
+                        ldaA ? ldaA : ldaAt, beta, Cp, ldaCt);
+            return;
+        }
+    }
+    const size_t itiles = (ni + gett_mc__ - 1L) / gett_mc__;
+    const size_t jtiles = (nj + gett_nc__ - 1L) / gett_nc__;
+    const long int ntask = static_cast<long int>(np * itiles * jtiles);
+
+#pragma omp parallel if (ntask > 1L)
+    {
+        vector<double> Apack(gett_mc__ * gett_kc__);
+        vector<double> Bpack(gett_kc__ * gett_nc__);
+        vector<double> Ctile(gett_mc__ * gett_nc__);
+
+#pragma omp for schedule(dynamic)
+        for (long int task = 0L; task < ntask; task++)
+        {
+            size_t p = task / (itiles * jtiles);
+            size_t i0 = (task / jtiles) % itiles * gett_mc__;
+            size_t j0 = task % jtiles * gett_nc__;
+            size_t mc = std::min(gett_mc__, ni - i0);
+            size_t nc = std::min(gett_nc__, nj - j0);
+            const double *Ptr = Ap + AP[p];
+            const double *Qtr = Bp + BP[p];
+            double *Rtr = Cp + CP[p];
+
+            for (size_t k0 = 0L; k0 < nk; k0 += gett_kc__)
+            {
+                size_t kc = std::min(gett_kc__, nk - k0);
+                for (size_t i = 0L; i < mc; i++)
+                {
+                    const double *row = Ptr + AI[i0 + i];
+                    for (size_t k = 0L; k < kc; k++)
+                        Apack[i * kc + k] = row[AK[k0 + k]];
+                }
+                for (size_t k = 0L; k < kc; k++)
+                {
+                    const double *row = Qtr + BK[k0 + k];
+                    for (size_t j = 0L; j < nc; j++)
+                        Bpack[k * nc + j] = row[BJ[j0 + j]];
+                }
+                product('N', 'N', mc, nc, kc, 1.0, Apack.data(), kc,
+                        Bpack.data(), nc, (k0 == 0L ? 0.0 : 1.0),
+                        Ctile.data(), nc);
+            }
+
+            for (size_t i = 0L; i < mc; i++)
+            {
+                double *row = Rtr + CI[i0 + i];
+                const double *tile = Ctile.data() + i * nc;
+                for (size_t j = 0L; j < nc; j++)
+                {
+                    double &c = row[CJ[j0 + j]];
+                    c = alpha * tile[j] + (beta == 0.0 ? 0.0 : beta * c);
+                }
+            }
+        }
+    }
+}
+
+/// The GEMM calls of a plan, C = alpha * op(L) * op(R) + beta * C for every
+/// Hadamard slice, with L and R the (permuted) A and B or, when C is
+/// transposed, B and A
+struct GemmLayout
+{
+    bool swap;
+    char transL;
+    char transR;
+    size_t nrow;
+    size_t ncol;
+    size_t nzip;
+    size_t ldaL;
+    size_t ldaR;
+    size_t ldaC;
+    size_t strideL;
+    size_t strideR;
+    size_t strideC;
+    size_t nslice;
+
+    double flops() const
+    {
+        return 2.0 * static_cast<double>(nrow * ncol * nzip) *
+               static_cast<double>(nslice);
+    }
+
+    double bytes(double beta) const
+    {
+        return sizeof(double) * static_cast<double>(nslice) *
+               static_cast<double>(nrow * nzip + nzip * ncol +
+                                   (beta != 0.0 ? 2L : 1L) * nrow * ncol);
+    }
+};
+
+GemmLayout gemm_layout(const ContractionPlan &plan)
+{
+    // Each Hadamard slice P is a matrix whose leading dimension is that of
+    // its trailing index group. When P leads, the slices are stacked; when P
+    // sits in the middle, they interleave at the leading-dimension stride.
+    size_t ldaC = (plan.C_transpose ? plan.AC_size : plan.BC_size);
+    size_t ldaA = (plan.A_transpose ? plan.AC_size : plan.AB_size);
+    size_t ldaB = (plan.B_transpose ? plan.AB_size : plan.BC_size);
+    size_t strideC = (plan.C_Pmid ? ldaC : plan.AC_size * plan.BC_size);
+    size_t strideA = (plan.A_Pmid ? ldaA : plan.AB_size * plan.AC_size);
+    size_t strideB = (plan.B_Pmid ? ldaB : plan.AB_size * plan.BC_size);
+    if (plan.C_Pmid)
+        ldaC *= plan.ABC_size;
+    if (plan.A_Pmid)
+        ldaA *= plan.ABC_size;
+    if (plan.B_Pmid)
+        ldaB *= plan.ABC_size;
+
+    GemmLayout layout;
+    layout.swap = plan.C_transpose;
+    layout.nzip = plan.AB_size;
+    layout.ldaC = ldaC;
+    layout.strideC = strideC;
+    layout.nslice = plan.ABC_size;
+    if (plan.C_transpose)
+    {
+        layout.nrow = plan.BC_size;
+        layout.ncol = plan.AC_size;
+        layout.transL = (plan.B_transpose ? 'N' : 'T');
+        layout.transR = (plan.A_transpose ? 'N' : 'T');
+        layout.ldaL = ldaB;
+        layout.ldaR = ldaA;
+        layout.strideL = strideB;
+        layout.strideR = strideA;
+    }
+    else
+    {
+        layout.nrow = plan.AC_size;
+        layout.ncol = plan.BC_size;
+        layout.transL = (plan.A_transpose ? 'T' : 'N');
+        layout.transR = (plan.B_transpose ? 'T' : 'N');
+        layout.ldaL = ldaA;
+        layout.ldaR = ldaB;
+        layout.strideL = strideA;
+        layout.strideR = strideB;
+    }
+    return layout;
+}
+
+/// Runs the GEMMs of layout on C, A and B (in GEMM order), the slices on
+/// all threads if threaded
+void run_gemms(const GemmLayout &layout, double *Cp, double *Ap, double *Bp,
+               double alpha, double beta, bool threaded)
+{
+    double *Lp = layout.swap ? Bp : Ap;
+    double *Rp = layout.swap ? Ap : Bp;
+    long int nslice = static_cast<long int>(layout.nslice);
+#pragma omp parallel for schedule(static) if (threaded)
+    for (long int P = 0L; P < nslice; P++)
+    {
+        product(layout.transL, layout.transR, layout.nrow, layout.ncol,
+                layout.nzip, alpha, Lp + P * layout.strideL, layout.ldaL,
+                Rp + P * layout.strideR, layout.ldaR, beta,
+                Cp + P * layout.strideC, layout.ldaC);
+    }
+}
+
+/**
+ * Should a contraction of plan run by GETT rather than on permuted copies?
+ * Yes on request, or automatically when the copies still to be allocated
+ * (those flagged new) would take more than a quarter of the memory limit.
+ * Views are always contracted in place.
+ */
+bool use_gett(const ContractionPlan &plan, ConstCoreTensorImplPtr C,
+              ConstCoreTensorImplPtr A, ConstCoreTensorImplPtr B, bool newC,
+              bool newA, bool newB)
+{
+    size_t copies = (plan.permC && newC ? C->numel() : 0L) +
+                    (plan.permA && newA ? A->numel() : 0L) +
+                    (plan.permB && newB ? B->numel() : 0L);
+    bool views = C->is_view() || A->is_view() || B->is_view();
+    return views || settings::contraction_kernel == settings::StridedKernel ||
+           (settings::contraction_kernel == settings::AutoKernel &&
+            copies * sizeof(double) > settings::memory_limit / 4L);
+}
+
+/**
+ * Permutes the operands of plan that need it into C2, A2 and B2 (drawn from
+ * the scratch pool unless given) and points C2p, A2p and B2p at the GEMM
+ * operands: the permuted copies, or the tensors themselves.
+ */
+void permute_operands(const ContractionPlan &plan, CoreTensorImplPtr C,
+                      ConstTensorImplPtr A, ConstTensorImplPtr B,
+                      const Indices &Cinds, const Indices &Ainds,
+                      const Indices &Binds, shared_ptr<TensorImpl> &A2,
+                      shared_ptr<TensorImpl> &B2, shared_ptr<TensorImpl> &C2,
+                      double beta, double *&C2p, double *&A2p, double *&B2p)
+{
+    const bool permC = plan.permC;
+    const bool permA = plan.permA;
+    const bool permB = plan.permB;
+    const Indices &Cinds2 = plan.Cinds2;
+    const Indices &Ainds2 = plan.Ainds2;
+    const Indices &Binds2 = plan.Binds2;
 
     double *Cp = ((CoreTensorImplPtr)C)->data().data();
     double *Ap = ((CoreTensorImplPtr)A)->data().data();
     double *Bp = ((CoreTensorImplPtr)B)->data().data();
-    double *C2p = Cp;
-    double *A2p = Ap;
-    double *B2p = Bp;
+    C2p = Cp;
+    A2p = Ap;
+    B2p = Bp;
 
     if (permC)
     {
-        ambit::timer::timer_push("pre-BLAS: internal C allocation");
+        AMBIT_TIMER_PUSH("pre-BLAS: internal C allocation");
         if (!C2)
         {
             Dimension Cdims2 = indices::permuted_dimension(C->dims(), Cinds2, Cinds);
-            C2 = std::make_shared<CoreTensorImpl>("C2", Cdims2);
+            C2 = scratch::build("C2", Cdims2);
+            AMBIT_TIMER_ALLOCATED(sizeof(double) *
+                                  static_cast<double>(C2->numel()));
         }
         C2p = C2->data().data();
-        ambit::timer::timer_pop();
+        AMBIT_TIMER_POP();
         if (beta != 0.0)
         {
-            ambit::timer::timer_push("pre-BLAS: internal C permutation");
+            AMBIT_TIMER_PUSH("pre-BLAS: internal C permutation");
             C2->permute(C, Cinds2, Cinds);
-            ambit::timer::timer_pop();
+            AMBIT_TIMER_POP();
+        }
+        else
+        {
+            // Scratch storage is uninitialized and BLAS may scale it by beta
+            C2->scale(0.0);
         }
     }
     if (permA)
     {
-        ambit::timer::timer_push("pre-BLAS: internal A allocation");
+        AMBIT_TIMER_PUSH("pre-BLAS: internal A allocation");
         if (!A2)
         {
             Dimension Adims2 = indices::permuted_dimension(A->dims(), Ainds2, Ainds);
-            A2 = std::make_shared<CoreTensorImpl>("A2", Adims2);
+            A2 = scratch::build("A2", Adims2);
+            AMBIT_TIMER_ALLOCATED(sizeof(double) *
+                                  static_cast<double>(A2->numel()));
         }
         A2p = A2->data().data();
-        ambit::timer::timer_pop();
-        ambit::timer::timer_push("pre-BLAS: internal A permutation");
+        AMBIT_TIMER_POP();
+        AMBIT_TIMER_PUSH("pre-BLAS: internal A permutation");
         A2->permute(A, Ainds2, Ainds);
-        ambit::timer::timer_pop();
+        AMBIT_TIMER_POP();
     }
     if (permB)
     {
-        ambit::timer::timer_push("pre-BLAS: internal B allocation");
+        AMBIT_TIMER_PUSH("pre-BLAS: internal B allocation");
         if (!B2)
         {
             Dimension Bdims2 = indices::permuted_dimension(B->dims(), Binds2, Binds);
-            B2 = std::make_shared<CoreTensorImpl>("B2", Bdims2);
+            B2 = scratch::build("B2", Bdims2);
+            AMBIT_TIMER_ALLOCATED(sizeof(double) *
+                                  static_cast<double>(B2->numel()));
         }
         B2p = B2->data().data();
-        ambit::timer::timer_pop();
-        ambit::timer::timer_push("pre-BLAS: internal B permutation");
+        AMBIT_TIMER_POP();
+        AMBIT_TIMER_PUSH("pre-BLAS: internal B permutation");
         B2->permute(B, Binds2, Binds);
-        ambit::timer::timer_pop();
+        AMBIT_TIMER_POP();
     }
+}
 
-    // => GEMM Indexing <= //
+/**
+ * Runs a contraction by plan: permutes the operands that need it, calls
+ * the GEMMs, and permutes the result back into C.
+ */
+void run_plan(const ContractionPlan &plan, CoreTensorImplPtr C,
+              ConstTensorImplPtr A, ConstTensorImplPtr B, const Indices &Cinds,
+              const Indices &Ainds, const Indices &Binds,
+              shared_ptr<TensorImpl> &A2, shared_ptr<TensorImpl> &B2,
+              shared_ptr<TensorImpl> &C2, double alpha, double beta)
+{
+    // => Alias or Allocate A, B, C and Permute if Necessary <= //
+
+    double *C2p;
+    double *A2p;
+    double *B2p;
+    permute_operands(plan, C, A, B, Cinds, Ainds, Binds, A2, B2, C2, beta,
+                     C2p, A2p, B2p);
 
     // => GEMM <= //
 
-    ambit::timer::timer_push("BLAS");
-    for (size_t P = 0L; P < ABC_size; P++)
+    // The Hadamard slices are independent, so small ones are run as a
+    // strided batch across threads; large ones are left to threaded BLAS
+    AMBIT_TIMER_PUSH("BLAS");
+    GemmLayout layout = gemm_layout(plan);
+    AMBIT_TIMER_FLOPS(layout.flops());
+    AMBIT_TIMER_BYTES(layout.bytes(beta));
+    run_gemms(layout, C2p, A2p, B2p, alpha, beta,
+              layout.nslice > 1L &&
+                  layout.nrow * layout.ncol * layout.nzip <=
+                      hadamard_batch_work__);
+    AMBIT_TIMER_POP();
+
+    // => Permute C if Necessary <= //
+
+    if (plan.permC)
+    {
+        AMBIT_TIMER_PUSH("post-BLAS: internal C permutation");
+        C->permute(C2.get(), Cinds, plan.Cinds2);
+        AMBIT_TIMER_POP();
+    }
+}
+
+/// Elements moved by permuting a tensor from one index order to another: a
+/// read and a write of each, doubled when the unit-stride index changes
+/// (a tiled transpose rather than runs of copies)
+double permute_moves(size_t numel, const Indices &from, const Indices &to)
+{
+    double moves = 2.0 * static_cast<double>(numel);
+    if (!from.empty() && from.back() != to.back())
+        moves *= 2.0;
+    return moves;
+}
+
+/// Elements moved by the permutations of a plan
+double estimated_cost(const ContractionPlan &plan, ConstTensorImplPtr C,
+                      ConstTensorImplPtr A, ConstTensorImplPtr B,
+                      const Indices &Cinds, const Indices &Ainds,
+                      const Indices &Binds, double beta)
+{
+    double cost = 0.0;
+    if (plan.permC)
     {
+        // C is permuted back, and first permuted in or zeroed
+        double moves = permute_moves(C->numel(), Cinds, plan.Cinds2);
+        cost += moves + (beta != 0.0 ? moves : static_cast<double>(C->numel()));
+    }
+    if (plan.permA)
+        cost += permute_moves(A->numel(), Ainds, plan.Ainds2);
+    if (plan.permB)
+        cost += permute_moves(B->numel(), Binds, plan.Binds2);
+    return cost;
+}
 
-        char transL;
-        char transR;
-        size_t nrow;
-        size_t ncol;
-        double *Lp;
-        double *Rp;
-        size_t ldaL;
-        size_t ldaR;
+/// Seconds taken by a contraction by plan, into a scratch copy of C
+double measured_cost(const ContractionPlan &plan, ConstCoreTensorImplPtr C,
+                     ConstTensorImplPtr A, ConstTensorImplPtr B,
+                     const Indices &Cinds, const Indices &Ainds,
+                     const Indices &Binds, double alpha, double beta)
+{
+    shared_ptr<CoreTensorImpl> Ct = scratch::build("Tuning C", C->dims());
+    std::copy(C->data().begin(), C->data().end(), Ct->data().begin());
+    shared_ptr<TensorImpl> A2;
+    shared_ptr<TensorImpl> B2;
+    shared_ptr<TensorImpl> C2;
+    auto start = std::chrono::steady_clock::now();
+    run_plan(plan, Ct.get(), A, B, Cinds, Ainds, Binds, A2, B2, C2, alpha,
+             beta);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+}
 
-        if (C_transpose)
+bool same_layout(const ContractionPlan &a, const ContractionPlan &b)
+{
+    return a.permC == b.permC && a.permA == b.permA && a.permB == b.permB &&
+           a.C_transpose == b.C_transpose && a.A_transpose == b.A_transpose &&
+           a.B_transpose == b.B_transpose && a.Cinds2 == b.Cinds2 &&
+           a.Ainds2 == b.Ainds2 && a.Binds2 == b.Binds2;
+}
+
+/**
+ * Picks the GEMM layout of a contraction. The fixed rules give the first
+ * candidate; unless settings::contraction_layout is FixedLayout and as long
+ * as that candidate permutes anything, every other way of fixing the
+ * mismatched index groups, and of orienting each permuted operand, is
+ * enumerated. The winner moves the fewest elements in its permutations
+ * (EstimatedLayout) or runs fastest on the operands (MeasuredLayout, with
+ * ties and non-CoreTensor data going to the estimate). Earlier candidates
+ * win ties, so the rules are kept when nothing is better.
+ */
+ContractionPlan tune_contraction_plan(ConstTensorImplPtr C,
+                                      ConstTensorImplPtr A,
+                                      ConstTensorImplPtr B,
+                                      const Indices &Cinds,
+                                      const Indices &Ainds,
+                                      const Indices &Binds, double alpha,
+                                      double beta)
+{
+    ContractionPlan rules =
+        build_contraction_plan(C, A, B, Cinds, Ainds, Binds, alpha, beta);
+    if (settings::contraction_layout == settings::FixedLayout ||
+        (!rules.permC && !rules.permA && !rules.permB))
+        return rules;
+
+    // The fixes of the mismatched groups, then the orientations of the
+    // operands each of them permutes
+    vector<ContractionPlan> candidates(1, rules);
+    auto add = [&](const ContractionPlan &plan) {
+        for (const ContractionPlan &seen : candidates)
+            if (same_layout(seen, plan))
+                return false;
+        candidates.push_back(plan);
+        return true;
+    };
+    for (unsigned fix = 0; fix <= (layout_fix_i | layout_fix_j | layout_fix_k);
+         ++fix)
+    {
+        ContractionPlan plan = build_contraction_plan(C, A, B, Cinds, Ainds,
+                                                      Binds, alpha, beta, fix);
+        add(plan);
+        for (unsigned swap = layout_swap_C; swap < num_layouts;
+             swap += layout_swap_C)
         {
-            Lp = B2p;
-            Rp = A2p;
-            nrow = BC_size;
-            ncol = AC_size;
-            transL = (B_transpose ? 'N' : 'T');
-            transR = (A_transpose ? 'N' : 'T');
-            ldaL = (B_transpose ? AB_size : BC_size);
-            ldaR = (A_transpose ? AC_size : AB_size);
+            if (((swap & layout_swap_C) && !plan.permC) ||
+                ((swap & layout_swap_A) && !plan.permA) ||
+                ((swap & layout_swap_B) && !plan.permB))
+                continue;
+            add(build_contraction_plan(C, A, B, Cinds, Ainds, Binds, alpha,
+                                       beta, fix | swap));
         }
-        else
+    }
+
+    if (settings::contraction_layout_candidate >= 0)
+        return candidates[static_cast<size_t>(
+                              settings::contraction_layout_candidate) %
+                          candidates.size()];
+
+    bool measure = settings::contraction_layout == settings::MeasuredLayout &&
+                   C->type() == CoreTensor && A->type() == CoreTensor &&
+                   B->type() == CoreTensor &&
+                   !((ConstCoreTensorImplPtr)C)->is_view() &&
+                   !((ConstCoreTensorImplPtr)A)->is_view() &&
+                   !((ConstCoreTensorImplPtr)B)->is_view();
+    size_t best = 0;
+    double best_cost = std::numeric_limits<double>::max();
+    for (size_t n = 0; n < candidates.size(); ++n)
+    {
+        double cost =
+            measure ? measured_cost(candidates[n], (ConstCoreTensorImplPtr)C,
+                                    A, B, Cinds, Ainds, Binds, alpha, beta)
+                    : estimated_cost(candidates[n], C, A, B, Cinds, Ainds,
+                                     Binds, beta);
+        if (cost < best_cost)
         {
-            Lp = A2p;
-            Rp = B2p;
-            nrow = AC_size;
-            ncol = BC_size;
-            transL = (A_transpose ? 'T' : 'N');
-            transR = (B_transpose ? 'T' : 'N');
-            ldaL = (A_transpose ? AC_size : AB_size);
-            ldaR = (B_transpose ? AB_size : BC_size);
+            best = n;
+            best_cost = cost;
         }
+    }
+    return candidates[best];
+}
 
-        size_t nzip = AB_size;
-        size_t ldaC = (C_transpose ? AC_size : BC_size);
+/// Returns the cached plan for this contraction, tuning it on a miss
+ContractionPlan find_contraction_plan(ConstTensorImplPtr C,
+                                      ConstTensorImplPtr A,
+                                      ConstTensorImplPtr B,
+                                      const Indices &Cinds,
+                                      const Indices &Ainds,
+                                      const Indices &Binds, double alpha,
+                                      double beta)
+{
+    ContractionPlanKey key(C->dims(), A->dims(), B->dims(), Cinds, Ainds,
+                           Binds, beta != 0.0,
+                           static_cast<int>(settings::contraction_layout),
+                           settings::contraction_layout_candidate);
+    {
+        std::lock_guard<std::mutex> lock(contraction_plan_mutex);
+        auto it = contraction_plans.find(key);
+        if (it != contraction_plans.end())
+            return it->second;
+    }
+
+    ContractionPlan plan =
+        tune_contraction_plan(C, A, B, Cinds, Ainds, Binds, alpha, beta);
+
+    std::lock_guard<std::mutex> lock(contraction_plan_mutex);
+    if (contraction_plans.size() >= max_contraction_plans)
+        contraction_plans.clear();
+    contraction_plans[key] = plan;
+    return plan;
+}
+
+} // anonymous namespace
+
+void CoreTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
+                              const Indices &Cinds, const Indices &Ainds,
+                              const Indices &Binds, double alpha, double beta)
+{
+    shared_ptr<TensorImpl> A2;
+    shared_ptr<TensorImpl> B2;
+    shared_ptr<TensorImpl> C2;
+    contract(A, B, Cinds, Ainds, Binds, A2, B2, C2, alpha, beta);
+}
+
+void CoreTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
+                              const Indices &Cinds, const Indices &Ainds,
+                              const Indices &Binds,
+                              std::shared_ptr<TensorImpl> &A2,
+                              std::shared_ptr<TensorImpl> &B2,
+                              std::shared_ptr<TensorImpl> &C2, double alpha,
+                              double beta)
+{
+    if (A->type() != CoreTensor || B->type() != CoreTensor)
+    {
+        out_of_core_contract(this, A, B, Cinds, Ainds, Binds, alpha, beta);
+        return;
+    }
+
+    AMBIT_TIMER_PUSH("pre-BLAS: internal overhead");
+
+    TensorImplPtr C = this;
 
-        if (nrow != 1L)
+    // => Permutation Logic (cached per shape and labels) <= //
+
+    ContractionPlan plan =
+        find_contraction_plan(C, A, B, Cinds, Ainds, Binds, alpha, beta);
+
+    AMBIT_TIMER_POP();
+
+    // => Strided (GETT) Kernel <= //
+
+    // Used on request, or automatically when the permuted copies would take
+    // more than a quarter of the memory limit. Views are always contracted
+    // in place.
+    if (use_gett(plan, this, (ConstCoreTensorImplPtr)A,
+                 (ConstCoreTensorImplPtr)B, !C2, !A2, !B2))
+    {
+        AMBIT_TIMER_PUSH("GETT");
+        // Every element of C is a sum over the contracted indices of A
+        double nzip = 1.0;
+        for (size_t dim = 0; dim < Ainds.size(); dim++)
+            if (std::find(Cinds.begin(), Cinds.end(), Ainds[dim]) ==
+                Cinds.end())
+                nzip *= static_cast<double>(A->dims()[dim]);
+        AMBIT_TIMER_FLOPS(2.0 * static_cast<double>(C->numel()) * nzip);
+        AMBIT_TIMER_BYTES(sizeof(double) * static_cast<double>(
+            A->numel() + B->numel() + (beta != 0.0 ? 2L : 1L) * C->numel()));
+        vector<size_t> Cstrides, Astrides, Bstrides;
+        double *Cp = strided_data(Cstrides);
+        const double *Ap =
+            ((ConstCoreTensorImplPtr)A)->strided_data(Astrides);
+        const double *Bp =
+            ((ConstCoreTensorImplPtr)B)->strided_data(Bstrides);
+        strided_contract(Cp, dims(), Cstrides, Cinds, Ap, A->dims(), Astrides,
+                         Ainds, Bp, B->dims(), Bstrides, Binds, alpha, beta);
+        AMBIT_TIMER_POP();
+        return;
+    }
+
+    run_plan(plan, this, A, B, Cinds, Ainds, Binds, A2, B2, C2, alpha, beta);
+}
+
+namespace
+{
+
+/// Elements of C finished by the epilogue after each GEMM panel (256 KB)
+const size_t epilogue_panel__ = 32768L;
+
+/**
+ * Applies epilogue to count elements of T (dimensions Tdims) from the flat
+ * offset, in runs along the last index of T. Tpos holds the index of C
+ * that each index of T is.
+ */
+void finish_range(const Epilogue &epilogue, double *Tp, const Dimension &Tdims,
+                  const vector<size_t> &Tpos, size_t offset, size_t count)
+{
+    size_t rank = Tdims.size();
+    vector<size_t> Cidx(rank, 0L);
+    if (rank == 0)
+    {
+        epilogue.apply(Cidx, 0, Tp, 1);
+        return;
+    }
+    vector<size_t> Tidx(rank);
+    size_t num = offset;
+    for (int dim = rank - 1; dim >= 0; dim--)
+    {
+        Tidx[dim] = num % Tdims[dim];
+        num /= Tdims[dim];
+    }
+    while (count > 0L)
+    {
+        size_t len = std::min(count, Tdims[rank - 1] - Tidx[rank - 1]);
+        for (size_t dim = 0; dim < rank; dim++)
+            Cidx[Tpos[dim]] = Tidx[dim];
+        epilogue.apply(Cidx, Tpos[rank - 1], Tp + offset, len);
+        offset += len;
+        count -= len;
+        Tidx[rank - 1] = 0L;
+        for (int dim = rank - 2; dim >= 0; dim--)
         {
-            if (ncol != 1L)
+            if (++Tidx[dim] < Tdims[dim])
+                break;
+            Tidx[dim] = 0L;
+        }
+    }
+}
+
+} // anonymous namespace
+
+void contract_epilogue(CoreTensorImplPtr C, ConstCoreTensorImplPtr A,
+                       ConstCoreTensorImplPtr B, const Indices &Cinds,
+                       const Indices &Ainds, const Indices &Binds,
+                       const Epilogue &epilogue, double alpha, double beta)
+{
+    ContractionPlan plan =
+        find_contraction_plan(C, A, B, Cinds, Ainds, Binds, alpha, beta);
+    size_t rank = C->rank();
+
+    // The strided kernel scatters its tiles into C, which is then finished
+    // in a pass of its own
+    if (use_gett(plan, C, A, B, true, true, true))
+    {
+        C->contract(A, B, Cinds, Ainds, Binds, alpha, beta);
+        AMBIT_TIMER_PUSH("epilogue");
+        vector<size_t> Cpos(rank);
+        std::iota(Cpos.begin(), Cpos.end(), 0L);
+        double *Cp = C->data().data();
+        long int nchunk = static_cast<long int>(
+            (C->numel() + epilogue_panel__ - 1L) / epilogue_panel__);
+#pragma omp parallel for schedule(static)
+        for (long int chunk = 0L; chunk < nchunk; chunk++)
+        {
+            size_t offset = chunk * epilogue_panel__;
+            finish_range(epilogue, Cp, C->dims(), Cpos, offset,
+                         std::min(epilogue_panel__, C->numel() - offset));
+        }
+        AMBIT_TIMER_POP();
+        return;
+    }
+
+    shared_ptr<TensorImpl> A2;
+    shared_ptr<TensorImpl> B2;
+    shared_ptr<TensorImpl> C2;
+    double *C2p;
+    double *A2p;
+    double *B2p;
+    permute_operands(plan, C, A, B, Cinds, Ainds, Binds, A2, B2, C2, beta,
+                     C2p, A2p, B2p);
+
+    // The GEMMs write C, or its permuted copy, whose indices are Tinds
+    const Indices &Tinds = plan.permC ? plan.Cinds2 : Cinds;
+    const Dimension &Tdims = plan.permC ? C2->dims() : C->dims();
+    vector<size_t> Tpos(rank);
+    for (size_t dim = 0; dim < rank; dim++)
+        Tpos[dim] = std::find(Cinds.begin(), Cinds.end(), Tinds[dim]) -
+                    Cinds.begin();
+
+    // => GEMM and Epilogue <= //
+
+    // Every row of a GEMM is a contiguous run of C, so the GEMMs are split
+    // into panels of rows that the epilogue finishes right after they are
+    // computed
+    AMBIT_TIMER_PUSH("BLAS + epilogue");
+    GemmLayout layout = gemm_layout(plan);
+    AMBIT_TIMER_FLOPS(layout.flops());
+    AMBIT_TIMER_BYTES(layout.bytes(beta));
+    double *Lp = layout.swap ? B2p : A2p;
+    double *Rp = layout.swap ? A2p : B2p;
+    size_t panel = std::max<size_t>(
+        1L, epilogue_panel__ / std::max<size_t>(1L, layout.ncol));
+    size_t npanel = std::max<size_t>(
+        1L, (layout.nrow + panel - 1L) / panel);
+    long int ntask = static_cast<long int>(layout.nslice * npanel);
+#pragma omp parallel for schedule(dynamic) if (ntask > 1L)
+    for (long int task = 0L; task < ntask; task++)
+    {
+        size_t P = task / npanel;
+        size_t r0 = (task % npanel) * panel;
+        size_t rows = std::min(panel, layout.nrow - r0);
+        if (layout.nrow == 0L)
+            continue;
+        product(layout.transL, layout.transR, rows, layout.ncol, layout.nzip,
+                alpha,
+                Lp + P * layout.strideL +
+                    (layout.transL == 'N' ? r0 * layout.ldaL : r0),
+                layout.ldaL, Rp + P * layout.strideR, layout.ldaR, beta,
+                C2p + P * layout.strideC + r0 * layout.ldaC, layout.ldaC);
+        for (size_t row = r0; row < r0 + rows; row++)
+            finish_range(epilogue, C2p, Tdims, Tpos,
+                         P * layout.strideC + row * layout.ldaC, layout.ncol);
+    }
+    AMBIT_TIMER_POP();
+
+    if (plan.permC)
+    {
+        AMBIT_TIMER_PUSH("post-BLAS: internal C permutation");
+        C->permute(C2.get(), Cinds, plan.Cinds2);
+        AMBIT_TIMER_POP();
+    }
+}
+
+void contract_batch(const vector<CoreTensorImplPtr> &Cs,
+                    const vector<ConstCoreTensorImplPtr> &As,
+                    const vector<ConstCoreTensorImplPtr> &Bs,
+                    const Indices &Cinds, const Indices &Ainds,
+                    const Indices &Binds, double alpha, double beta)
+{
+    AMBIT_TIMER_PUSH("batched contract");
+
+    // The plan and GEMM layout are looked up once per shape. Products whose
+    // operands are GEMM ready in place go straight to BLAS; the others are
+    // permuted by contract as usual.
+    size_t nproduct = Cs.size();
+    map<std::tuple<Dimension, Dimension, Dimension>, size_t> shapes;
+    vector<ContractionPlan> plans;
+    vector<GemmLayout> layouts;
+    vector<bool> direct;
+    vector<size_t> shape_of(nproduct);
+    double flops = 0.0;
+    double bytes = 0.0;
+    for (size_t n = 0; n < nproduct; ++n)
+    {
+        auto key = std::make_tuple(Cs[n]->dims(), As[n]->dims(), Bs[n]->dims());
+        auto it = shapes.find(key);
+        if (it == shapes.end())
+        {
+            ContractionPlan plan = find_contraction_plan(
+                Cs[n], As[n], Bs[n], Cinds, Ainds, Binds, alpha, beta);
+            it = shapes.insert(std::make_pair(key, layouts.size())).first;
+            plans.push_back(plan);
+            layouts.push_back(gemm_layout(plan));
+            direct.push_back(!plan.permC && !plan.permA && !plan.permB);
+        }
+        shape_of[n] = it->second;
+        flops += layouts[it->second].flops();
+        bytes += layouts[it->second].bytes(beta);
+    }
+    AMBIT_TIMER_FLOPS(flops);
+    AMBIT_TIMER_BYTES(bytes);
+
+    // Small products are shared among threads, one product per thread. Large
+    // ones run one at a time on threaded BLAS.
+    vector<size_t> small;
+    vector<size_t> large;
+    for (size_t n = 0; n < nproduct; ++n)
+    {
+        const GemmLayout &layout = layouts[shape_of[n]];
+        if (layout.nrow * layout.ncol * layout.nzip * layout.nslice <=
+            hadamard_batch_work__)
+            small.push_back(n);
+        else
+            large.push_back(n);
+    }
+
+    std::exception_ptr error;
+    long int nsmall = static_cast<long int>(small.size());
+    {
+        threads::TaskThreads split(small.size());
+#pragma omp parallel for schedule(dynamic, 1) num_threads(split.outer())     \
+    proc_bind(spread)
+        for (long int k = 0L; k < nsmall; k++)
+        {
+            split.enter();
+            try
             {
-                if (nzip != 1L)
-                {
-                    C_DGEMM(transL, transR, nrow, ncol, nzip, alpha, Lp, ldaL,
-                            Rp, ldaR, beta, C2p, ldaC);
-                }
+                size_t n = small[k];
+                CoreTensorImplPtr C = Cs[n];
+                ConstCoreTensorImplPtr A = As[n];
+                ConstCoreTensorImplPtr B = Bs[n];
+                if (direct[shape_of[n]] && !C->is_view() && !A->is_view() &&
+                    !B->is_view())
+                    run_gemms(layouts[shape_of[n]], C->data().data(),
+                              const_cast<double *>(A->data().data()),
+                              const_cast<double *>(B->data().data()), alpha,
+                              beta, false);
                 else
-                {
-                    for (size_t row = 0L; row < nrow; row++)
-                    {
-                        C_DSCAL(ncol, beta, C2p + row * ldaC, 1);
-                    }
-                    C_DGER(nrow, ncol, alpha, Lp, 1, Rp, 1, C2p, ldaC);
-                }
+                    C->contract(A, B, Cinds, Ainds, Binds, alpha, beta);
             }
-            else
+            catch (...)
             {
-                if (nzip != 1L)
-                {
-                    if (transL == 'N')
-                    {
-                        C_DGEMV('N', nrow, nzip, alpha, Lp, ldaL, Rp, 1, beta,
-                                C2p, 1);
-                    }
-                    else
-                    {
-                        C_DGEMV('T', nzip, nrow, alpha, Lp, ldaL, Rp, 1, beta,
-                                C2p, 1);
-                    }
-                }
-                else
-                {
-                    C_DSCAL(nrow, beta, C2p, 1);
-                    C_DAXPY(nrow, alpha * (*Rp), Lp, 1, C2p, 1);
-                }
+#pragma omp critical(ambit_contract_batch_error)
+                if (!error)
+                    error = std::current_exception();
             }
         }
-        else
+    }
+    if (error)
+    {
+        AMBIT_TIMER_POP();
+        std::rethrow_exception(error);
+    }
+
+    // Large products that need permuted operands are pipelined: the operands
+    // of the next one are permuted into their own scratch buffers on a helper
+    // thread while the current one is in BLAS.
+    struct Staged
+    {
+        shared_ptr<TensorImpl> A2;
+        shared_ptr<TensorImpl> B2;
+        shared_ptr<TensorImpl> C2;
+        double *C2p;
+        double *A2p;
+        double *B2p;
+    };
+    auto pipelined = [&](size_t n) {
+        return !direct[shape_of[n]] &&
+               !use_gett(plans[shape_of[n]], Cs[n], As[n], Bs[n], true, true,
+                         true);
+    };
+    auto stage = [&](size_t n) {
+        Staged staged;
+        permute_operands(plans[shape_of[n]], Cs[n], As[n], Bs[n], Cinds, Ainds,
+                         Binds, staged.A2, staged.B2, staged.C2, beta,
+                         staged.C2p, staged.A2p, staged.B2p);
+        return staged;
+    };
+
+    std::future<Staged> next;
+    for (size_t k = 0; k < large.size(); ++k)
+    {
+        size_t n = large[k];
+        CoreTensorImplPtr C = Cs[n];
+        ConstCoreTensorImplPtr A = As[n];
+        ConstCoreTensorImplPtr B = Bs[n];
+        if (!pipelined(n))
         {
-            if (ncol != 1L)
-            {
-                if (nzip != 1L)
-                {
-                    if (transR == 'N')
-                    {
-                        C_DGEMV('T', nzip, ncol, alpha, Rp, ldaR, Lp, 1, beta,
-                                C2p, 1);
-                    }
-                    else
-                    {
-                        C_DGEMV('N', ncol, nzip, alpha, Rp, ldaR, Lp, 1, beta,
-                                C2p, 1);
-                    }
-                }
-                else
-                {
-                    C_DSCAL(ncol, beta, C2p, 1);
-                    C_DAXPY(ncol, alpha * (*Lp), Rp, 1, C2p, 1);
-                }
-            }
+            if (direct[shape_of[n]] && !C->is_view() && !A->is_view() &&
+                !B->is_view())
+                run_gemms(layouts[shape_of[n]], C->data().data(),
+                          const_cast<double *>(A->data().data()),
+                          const_cast<double *>(B->data().data()), alpha, beta,
+                          false);
             else
+                C->contract(A, B, Cinds, Ainds, Binds, alpha, beta);
+            continue;
+        }
+
+        Staged staged = next.valid() ? next.get() : stage(n);
+        for (size_t j = k + 1; j < large.size(); ++j)
+            if (pipelined(large[j]))
             {
-                if (nzip != 1L)
-                {
-                    (*C2p) *= beta;
-                    (*C2p) += alpha * C_DDOT(nzip, Lp, 1, Rp, 1);
-                }
-                else
-                {
-                    (*C2p) = alpha * (*Lp) * (*Rp) + beta * (*C2p);
-                }
+                next = std::async(std::launch::async, stage, large[j]);
+                break;
             }
+
+        AMBIT_TIMER_PUSH("BLAS");
+        run_gemms(layouts[shape_of[n]], staged.C2p, staged.A2p, staged.B2p,
+                  alpha, beta, false);
+        AMBIT_TIMER_POP();
+        if (plans[shape_of[n]].permC)
+        {
+            AMBIT_TIMER_PUSH("post-BLAS: internal C permutation");
+            C->permute(staged.C2.get(), Cinds, plans[shape_of[n]].Cinds2);
+            AMBIT_TIMER_POP();
         }
+    }
+    AMBIT_TIMER_POP();
+}
+
+namespace
+{
+
+/// Edge length of the square tiles used by permute_tiled
+const size_t permute_tile = 32L;
 
-        C2p += AC_size * BC_size;
-        A2p += AB_size * AC_size;
-        B2p += AB_size * BC_size;
+/**
+ * C += alpha * A for a permutation without fast indices (C_ij = A_ji and
+ * friends), where each element would otherwise be fetched with a stride.
+ *
+ * The walk is blocked into square tiles spanning the unit-stride index of C
+ * (the last slow index) and the unit-stride index of A, so both tensors are
+ * streamed through cache. The remaining indices and the tiles are flattened
+ * into one parallel loop.
+ **/
+void permute_tiled(double *Cp, const double *Ap, const Dimension &Csizes,
+                   const vector<size_t> &Cstrides,
+                   const vector<size_t> &AstridesC, int slow_dims, int Aunit,
+                   double alpha)
+{
+    int Cunit = slow_dims - 1;
+
+    /// Sizes and strides of the remaining (outer) indices
+    vector<size_t> outer_sizes;
+    vector<size_t> outer_Cstrides;
+    vector<size_t> outer_Astrides;
+    size_t outer_size = 1L;
+    for (int dim = 0; dim < slow_dims; dim++)
+    {
+        if (dim == Aunit || dim == Cunit)
+            continue;
+        outer_sizes.push_back(Csizes[dim]);
+        outer_Cstrides.push_back(Cstrides[dim]);
+        outer_Astrides.push_back(AstridesC[dim]);
+        outer_size *= Csizes[dim];
     }
-    ambit::timer::timer_pop();
 
-    // => Permute C if Necessary <= //
+    size_t nA = Csizes[Aunit];
+    size_t nC = Csizes[Cunit];
+    size_t CstrideA = Cstrides[Aunit];
+    size_t AstrideC = AstridesC[Cunit];
+    size_t ntileA = (nA + permute_tile - 1L) / permute_tile;
+    size_t ntileC = (nC + permute_tile - 1L) / permute_tile;
+    size_t ntask = outer_size * ntileA * ntileC;
+    int nouter = outer_sizes.size();
+
+#pragma omp parallel for schedule(static)
+    for (size_t task = 0L; task < ntask; task++)
+    {
+        size_t num = task;
+        size_t tileC = num % ntileC;
+        num /= ntileC;
+        size_t tileA = num % ntileA;
+        num /= ntileA;
+
+        double *Cb = Cp;
+        const double *Ab = Ap;
+        for (int dim = nouter - 1; dim >= 0; dim--)
+        {
+            size_t val = num % outer_sizes[dim];
+            num /= outer_sizes[dim];
+            Cb += val * outer_Cstrides[dim];
+            Ab += val * outer_Astrides[dim];
+        }
 
-    if (permC)
+        size_t A0 = tileA * permute_tile;
+        size_t A1 = std::min(A0 + permute_tile, nA);
+        size_t C0 = tileC * permute_tile;
+        size_t C1 = std::min(C0 + permute_tile, nC);
+        for (size_t indA = A0; indA < A1; indA++)
+        {
+            double *Ctp = Cb + indA * CstrideA;
+            const double *Atp = Ab + indA;
+            for (size_t indC = C0; indC < C1; indC++)
+            {
+                Ctp[indC] += alpha * Atp[indC * AstrideC];
+            }
+        }
+    }
+}
+
+/// C += alpha * A over one run of fast_size elements per value of the
+/// remaining N slow indices, whose loops unroll at compile time
+template <int N> struct PermuteRuns
+{
+    static void run(double *&Ctp, const double *Atp, const size_t *Csizes,
+                    const size_t *AstridesC, size_t fast_size, double alpha)
+    {
+        for (size_t Cind = 0L; Cind < Csizes[0]; Cind++)
+        {
+            PermuteRuns<N - 1>::run(Ctp, Atp + Cind * AstridesC[0],
+                                    Csizes + 1, AstridesC + 1, fast_size,
+                                    alpha);
+        }
+    }
+};
+
+template <> struct PermuteRuns<0>
+{
+    static void run(double *&Ctp, const double *Atp, const size_t *,
+                    const size_t *, size_t fast_size, double alpha)
     {
-        ambit::timer::timer_push("post-BLAS: internal C permutation");
-        C->permute(C2.get(), Cinds, Cinds2);
-        ambit::timer::timer_pop();
+        C_DAXPY(fast_size, alpha, const_cast<double *>(Atp), 1, Ctp, 1);
+        Ctp += fast_size;
+    }
+};
+
+/**
+ * C += alpha * A for a permutation with fast indices and N slow ones. The
+ * first slow index is shared among the threads and the loops over the others
+ * are nested at compile time.
+ **/
+template <int N>
+void permute_runs(double *Cp, const double *Ap, const Dimension &Csizes,
+                  const vector<size_t> &Cstrides,
+                  const vector<size_t> &AstridesC, size_t fast_size,
+                  double alpha)
+{
+#pragma omp parallel for
+    for (size_t Cind0 = 0L; Cind0 < Csizes[0]; Cind0++)
+    {
+        double *Ctp = Cp + Cind0 * Cstrides[0];
+        PermuteRuns<N - 1>::run(Ctp, Ap + Cind0 * AstridesC[0],
+                                Csizes.data() + 1, AstridesC.data() + 1,
+                                fast_size, alpha);
     }
 }
 
+typedef void (*RunKernel)(double *, const double *, const Dimension &,
+                          const vector<size_t> &, const vector<size_t> &,
+                          size_t, double);
+
+/// permute_runs by number of slow indices; more go through the generic loop
+const RunKernel run_kernels[] = {
+    nullptr,          permute_runs<1>, permute_runs<2>, permute_runs<3>,
+    permute_runs<4>, permute_runs<5>, permute_runs<6>, permute_runs<7>,
+    permute_runs<8>};
+const int num_run_kernels = sizeof(run_kernels) / sizeof(run_kernels[0]);
+
+} // anonymous namespace
+
 void CoreTensorImpl::permute(ConstTensorImplPtr A, const Indices &CindsS,
                              const Indices &AindsS, double alpha, double beta)
 {
-    ambit::timer::timer_push("P: " + std::to_string(beta) + " " + A->name() +
-                             "[" + indices::to_string(CindsS) + "] = " +
-                             std::to_string(alpha) + " " + A->name() + "[" +
-                             indices::to_string(AindsS) + "]");
+    if (A->type() != CoreTensor)
+    {
+        out_of_core_permute(this, A, CindsS, AindsS, alpha, beta);
+        return;
+    }
+
+    AMBIT_TIMER_PUSH("P: " + std::to_string(beta) + " " + A->name() +
+                     "[" + indices::to_string(CindsS) + "] = " +
+                     std::to_string(alpha) + " " + A->name() + "[" +
+                     indices::to_string(AindsS) + "]");
 
     // => Convert to indices of A <= //
 
@@ -722,6 +2215,9 @@ void CoreTensorImpl::permute(ConstTensorImplPtr A, const Indices &CindsS,
     double *Cp = data().data();
     double *Ap = ((const CoreTensorImplPtr)A)->data().data();
 
+    AMBIT_TIMER_BYTES(sizeof(double) * static_cast<double>(numel()) *
+                      (beta != 0.0 ? 3.0 : 2.0));
+
     /// Beta scale
     scale(beta);
 
@@ -756,7 +2252,7 @@ void CoreTensorImpl::permute(ConstTensorImplPtr A, const Indices &CindsS,
     {
         //::memcpy(Cp,Ap,sizeof(double)*fast_size);
         C_DAXPY(fast_size, alpha, Ap, 1, Cp, 1);
-        ambit::timer::timer_pop();
+        AMBIT_TIMER_POP();
         return;
     }
 
@@ -799,436 +2295,22 @@ void CoreTensorImpl::permute(ConstTensorImplPtr A, const Indices &CindsS,
 
     if (fast_size == 1L)
     {
-        if (slow_dims == 2)
-        {
-#pragma omp parallel for
-            for (size_t Cind0 = 0L; Cind0 < Csizes[0]; Cind0++)
-            {
-                double *Ctp = Cp + Cind0 * Cstrides[0];
-                for (size_t Cind1 = 0L; Cind1 < Csizes[1]; Cind1++)
-                {
-                    double *Atp =
-                        Ap + Cind0 * AstridesC[0] + Cind1 * AstridesC[1];
-                    //::memcpy(Ctp,Atp,sizeof(double)*fast_size);
-                    (*Ctp) += alpha * (*Atp);
-                    Ctp += fast_size;
-                }
-            }
-        }
-        else if (slow_dims == 3)
-        {
-#pragma omp parallel for
-            for (size_t Cind0 = 0L; Cind0 < Csizes[0]; Cind0++)
-            {
-                double *Ctp = Cp + Cind0 * Cstrides[0];
-                for (size_t Cind1 = 0L; Cind1 < Csizes[1]; Cind1++)
-                {
-                    for (size_t Cind2 = 0L; Cind2 < Csizes[2]; Cind2++)
-                    {
-                        double *Atp = Ap + Cind0 * AstridesC[0] +
-                                      Cind1 * AstridesC[1] +
-                                      Cind2 * AstridesC[2];
-                        //::memcpy(Ctp,Atp,sizeof(double)*fast_size);
-                        (*Ctp) += alpha * (*Atp);
-                        Ctp += fast_size;
-                    }
-                }
-            }
-        }
-        else if (slow_dims == 4)
-        {
-#pragma omp parallel for
-            for (size_t Cind0 = 0L; Cind0 < Csizes[0]; Cind0++)
-            {
-                double *Ctp = Cp + Cind0 * Cstrides[0];
-                for (size_t Cind1 = 0L; Cind1 < Csizes[1]; Cind1++)
-                {
-                    for (size_t Cind2 = 0L; Cind2 < Csizes[2]; Cind2++)
-                    {
-                        for (size_t Cind3 = 0L; Cind3 < Csizes[3]; Cind3++)
-                        {
-                            double *Atp = Ap + Cind0 * AstridesC[0] +
-                                          Cind1 * AstridesC[1] +
-                                          Cind2 * AstridesC[2] +
-                                          Cind3 * AstridesC[3];
-                            //::memcpy(Ctp,Atp,sizeof(double)*fast_size);
-                            (*Ctp) += alpha * (*Atp);
-                            Ctp += fast_size;
-                        }
-                    }
-                }
-            }
-        }
-        else if (slow_dims == 5)
-        {
-#pragma omp parallel for
-            for (size_t Cind0 = 0L; Cind0 < Csizes[0]; Cind0++)
-            {
-                double *Ctp = Cp + Cind0 * Cstrides[0];
-                for (size_t Cind1 = 0L; Cind1 < Csizes[1]; Cind1++)
-                {
-                    for (size_t Cind2 = 0L; Cind2 < Csizes[2]; Cind2++)
-                    {
-                        for (size_t Cind3 = 0L; Cind3 < Csizes[3]; Cind3++)
-                        {
-                            for (size_t Cind4 = 0L; Cind4 < Csizes[4]; Cind4++)
-                            {
-                                double *Atp = Ap + Cind0 * AstridesC[0] +
-                                              Cind1 * AstridesC[1] +
-                                              Cind2 * AstridesC[2] +
-                                              Cind3 * AstridesC[3] +
-                                              Cind4 * AstridesC[4];
-                                //::memcpy(Ctp,Atp,sizeof(double)*fast_size);
-                                (*Ctp) += alpha * (*Atp);
-                                Ctp += fast_size;
-                            }
-                        }
-                    }
-                }
-            }
-        }
-        else if (slow_dims == 6)
-        {
-#pragma omp parallel for
-            for (size_t Cind0 = 0L; Cind0 < Csizes[0]; Cind0++)
-            {
-                double *Ctp = Cp + Cind0 * Cstrides[0];
-                for (size_t Cind1 = 0L; Cind1 < Csizes[1]; Cind1++)
-                {
-                    for (size_t Cind2 = 0L; Cind2 < Csizes[2]; Cind2++)
-                    {
-                        for (size_t Cind3 = 0L; Cind3 < Csizes[3]; Cind3++)
-                        {
-                            for (size_t Cind4 = 0L; Cind4 < Csizes[4]; Cind4++)
-                            {
-                                for (size_t Cind5 = 0L; Cind5 < Csizes[5];
-                                     Cind5++)
-                                {
-                                    double *Atp = Ap + Cind0 * AstridesC[0] +
-                                                  Cind1 * AstridesC[1] +
-                                                  Cind2 * AstridesC[2] +
-                                                  Cind3 * AstridesC[3] +
-                                                  Cind4 * AstridesC[4] +
-                                                  Cind5 * AstridesC[5];
-                                    //::memcpy(Ctp,Atp,sizeof(double)*fast_size);
-                                    (*Ctp) += alpha * (*Atp);
-                                    Ctp += fast_size;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
-        else if (slow_dims == 7)
+        /// The unit-stride index of A is a slow index of C
+        int Aunit = 0;
+        for (int dim = 0; dim < slow_dims; dim++)
         {
-#pragma omp parallel for
-            for (size_t Cind0 = 0L; Cind0 < Csizes[0]; Cind0++)
-            {
-                double *Ctp = Cp + Cind0 * Cstrides[0];
-                for (size_t Cind1 = 0L; Cind1 < Csizes[1]; Cind1++)
-                {
-                    for (size_t Cind2 = 0L; Cind2 < Csizes[2]; Cind2++)
-                    {
-                        for (size_t Cind3 = 0L; Cind3 < Csizes[3]; Cind3++)
-                        {
-                            for (size_t Cind4 = 0L; Cind4 < Csizes[4]; Cind4++)
-                            {
-                                for (size_t Cind5 = 0L; Cind5 < Csizes[5];
-                                     Cind5++)
-                                {
-                                    for (size_t Cind6 = 0L; Cind6 < Csizes[6];
-                                         Cind6++)
-                                    {
-                                        double *Atp = Ap +
-                                                      Cind0 * AstridesC[0] +
-                                                      Cind1 * AstridesC[1] +
-                                                      Cind2 * AstridesC[2] +
-                                                      Cind3 * AstridesC[3] +
-                                                      Cind4 * AstridesC[4] +
-                                                      Cind5 * AstridesC[5] +
-                                                      Cind6 * AstridesC[6];
-                                        //::memcpy(Ctp,Atp,sizeof(double)*fast_size);
-                                        (*Ctp) += alpha * (*Atp);
-                                        Ctp += fast_size;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
-        else if (slow_dims == 8)
-        {
-#pragma omp parallel for
-            for (size_t Cind0 = 0L; Cind0 < Csizes[0]; Cind0++)
-            {
-                double *Ctp = Cp + Cind0 * Cstrides[0];
-                for (size_t Cind1 = 0L; Cind1 < Csizes[1]; Cind1++)
-                {
-                    for (size_t Cind2 = 0L; Cind2 < Csizes[2]; Cind2++)
-                    {
-                        for (size_t Cind3 = 0L; Cind3 < Csizes[3]; Cind3++)
-                        {
-                            for (size_t Cind4 = 0L; Cind4 < Csizes[4]; Cind4++)
-                            {
-                                for (size_t Cind5 = 0L; Cind5 < Csizes[5];
-                                     Cind5++)
-                                {
-                                    for (size_t Cind6 = 0L; Cind6 < Csizes[6];
-                                         Cind6++)
-                                    {
-                                        for (size_t Cind7 = 0L;
-                                             Cind7 < Csizes[7]; Cind7++)
-                                        {
-                                            double *Atp = Ap +
-                                                          Cind0 * AstridesC[0] +
-                                                          Cind1 * AstridesC[1] +
-                                                          Cind2 * AstridesC[2] +
-                                                          Cind3 * AstridesC[3] +
-                                                          Cind4 * AstridesC[4] +
-                                                          Cind5 * AstridesC[5] +
-                                                          Cind6 * AstridesC[6] +
-                                                          Cind7 * AstridesC[7];
-                                            //::memcpy(Ctp,Atp,sizeof(double)*fast_size);
-                                            (*Ctp) += alpha * (*Atp);
-                                            Ctp += fast_size;
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
-        else
-        {
-#pragma omp parallel for
-            for (size_t ind = 0L; ind < slow_size; ind++)
-            {
-                double *Ctp = Cp + ind * fast_size;
-                double *Atp = Ap;
-                size_t num = ind;
-                for (int dim = slow_dims - 1; dim >= 0; dim--)
-                {
-                    size_t val = num % Csizes[dim]; // value of the dim-th index
-                    num /= Csizes[dim];
-                    Atp += val * AstridesC[dim];
-                }
-                //::memcpy(Ctp,Atp,sizeof(double)*fast_size);
-                (*Ctp) += alpha * (*Atp);
-            }
+            if (Ainds[dim] == (size_t)(slow_dims - 1))
+                Aunit = dim;
         }
+        permute_tiled(Cp, Ap, Csizes, Cstrides, AstridesC, slow_dims, Aunit,
+                      alpha);
     }
     else
     {
-        if (slow_dims == 2)
-        {
-#pragma omp parallel for
-            for (size_t Cind0 = 0L; Cind0 < Csizes[0]; Cind0++)
-            {
-                double *Ctp = Cp + Cind0 * Cstrides[0];
-                for (size_t Cind1 = 0L; Cind1 < Csizes[1]; Cind1++)
-                {
-                    double *Atp =
-                        Ap + Cind0 * AstridesC[0] + Cind1 * AstridesC[1];
-                    //::memcpy(Ctp,Atp,sizeof(double)*fast_size);
-                    C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
-                    Ctp += fast_size;
-                }
-            }
-        }
-        else if (slow_dims == 3)
-        {
-#pragma omp parallel for
-            for (size_t Cind0 = 0L; Cind0 < Csizes[0]; Cind0++)
-            {
-                double *Ctp = Cp + Cind0 * Cstrides[0];
-                for (size_t Cind1 = 0L; Cind1 < Csizes[1]; Cind1++)
-                {
-                    for (size_t Cind2 = 0L; Cind2 < Csizes[2]; Cind2++)
-                    {
-                        double *Atp = Ap + Cind0 * AstridesC[0] +
-                                      Cind1 * AstridesC[1] +
-                                      Cind2 * AstridesC[2];
-                        //::memcpy(Ctp,Atp,sizeof(double)*fast_size);
-                        C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
-                        Ctp += fast_size;
-                    }
-                }
-            }
-        }
-        else if (slow_dims == 4)
-        {
-#pragma omp parallel for
-            for (size_t Cind0 = 0L; Cind0 < Csizes[0]; Cind0++)
-            {
-                double *Ctp = Cp + Cind0 * Cstrides[0];
-                for (size_t Cind1 = 0L; Cind1 < Csizes[1]; Cind1++)
-                {
-                    for (size_t Cind2 = 0L; Cind2 < Csizes[2]; Cind2++)
-                    {
-                        for (size_t Cind3 = 0L; Cind3 < Csizes[3]; Cind3++)
-                        {
-                            double *Atp = Ap + Cind0 * AstridesC[0] +
-                                          Cind1 * AstridesC[1] +
-                                          Cind2 * AstridesC[2] +
-                                          Cind3 * AstridesC[3];
-                            //::memcpy(Ctp,Atp,sizeof(double)*fast_size);
-                            C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
-                            Ctp += fast_size;
-                        }
-                    }
-                }
-            }
-        }
-        else if (slow_dims == 5)
-        {
-#pragma omp parallel for
-            for (size_t Cind0 = 0L; Cind0 < Csizes[0]; Cind0++)
-            {
-                double *Ctp = Cp + Cind0 * Cstrides[0];
-                for (size_t Cind1 = 0L; Cind1 < Csizes[1]; Cind1++)
-                {
-                    for (size_t Cind2 = 0L; Cind2 < Csizes[2]; Cind2++)
-                    {
-                        for (size_t Cind3 = 0L; Cind3 < Csizes[3]; Cind3++)
-                        {
-                            for (size_t Cind4 = 0L; Cind4 < Csizes[4]; Cind4++)
-                            {
-                                double *Atp = Ap + Cind0 * AstridesC[0] +
-                                              Cind1 * AstridesC[1] +
-                                              Cind2 * AstridesC[2] +
-                                              Cind3 * AstridesC[3] +
-                                              Cind4 * AstridesC[4];
-                                //::memcpy(Ctp,Atp,sizeof(double)*fast_size);
-                                C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
-                                Ctp += fast_size;
-                            }
-                        }
-                    }
-                }
-            }
-        }
-        else if (slow_dims == 6)
-        {
-#pragma omp parallel for
-            for (size_t Cind0 = 0L; Cind0 < Csizes[0]; Cind0++)
-            {
-                double *Ctp = Cp + Cind0 * Cstrides[0];
-                for (size_t Cind1 = 0L; Cind1 < Csizes[1]; Cind1++)
-                {
-                    for (size_t Cind2 = 0L; Cind2 < Csizes[2]; Cind2++)
-                    {
-                        for (size_t Cind3 = 0L; Cind3 < Csizes[3]; Cind3++)
-                        {
-                            for (size_t Cind4 = 0L; Cind4 < Csizes[4]; Cind4++)
-                            {
-                                for (size_t Cind5 = 0L; Cind5 < Csizes[5];
-                                     Cind5++)
-                                {
-                                    double *Atp = Ap + Cind0 * AstridesC[0] +
-                                                  Cind1 * AstridesC[1] +
-                                                  Cind2 * AstridesC[2] +
-                                                  Cind3 * AstridesC[3] +
-                                                  Cind4 * AstridesC[4] +
-                                                  Cind5 * AstridesC[5];
-                                    //::memcpy(Ctp,Atp,sizeof(double)*fast_size);
-                                    C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
-                                    Ctp += fast_size;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
-        else if (slow_dims == 7)
+        if (slow_dims < num_run_kernels)
         {
-#pragma omp parallel for
-            for (size_t Cind0 = 0L; Cind0 < Csizes[0]; Cind0++)
-            {
-                double *Ctp = Cp + Cind0 * Cstrides[0];
-                for (size_t Cind1 = 0L; Cind1 < Csizes[1]; Cind1++)
-                {
-                    for (size_t Cind2 = 0L; Cind2 < Csizes[2]; Cind2++)
-                    {
-                        for (size_t Cind3 = 0L; Cind3 < Csizes[3]; Cind3++)
-                        {
-                            for (size_t Cind4 = 0L; Cind4 < Csizes[4]; Cind4++)
-                            {
-                                for (size_t Cind5 = 0L; Cind5 < Csizes[5];
-                                     Cind5++)
-                                {
-                                    for (size_t Cind6 = 0L; Cind6 < Csizes[6];
-                                         Cind6++)
-                                    {
-                                        double *Atp = Ap +
-                                                      Cind0 * AstridesC[0] +
-                                                      Cind1 * AstridesC[1] +
-                                                      Cind2 * AstridesC[2] +
-                                                      Cind3 * AstridesC[3] +
-                                                      Cind4 * AstridesC[4] +
-                                                      Cind5 * AstridesC[5] +
-                                                      Cind6 * AstridesC[6];
-                                        //::memcpy(Ctp,Atp,sizeof(double)*fast_size);
-                                        C_DAXPY(fast_size, alpha, Atp, 1, Ctp,
-                                                1);
-                                        Ctp += fast_size;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
-        else if (slow_dims == 8)
-        {
-#pragma omp parallel for
-            for (size_t Cind0 = 0L; Cind0 < Csizes[0]; Cind0++)
-            {
-                double *Ctp = Cp + Cind0 * Cstrides[0];
-                for (size_t Cind1 = 0L; Cind1 < Csizes[1]; Cind1++)
-                {
-                    for (size_t Cind2 = 0L; Cind2 < Csizes[2]; Cind2++)
-                    {
-                        for (size_t Cind3 = 0L; Cind3 < Csizes[3]; Cind3++)
-                        {
-                            for (size_t Cind4 = 0L; Cind4 < Csizes[4]; Cind4++)
-                            {
-                                for (size_t Cind5 = 0L; Cind5 < Csizes[5];
-                                     Cind5++)
-                                {
-                                    for (size_t Cind6 = 0L; Cind6 < Csizes[6];
-                                         Cind6++)
-                                    {
-                                        for (size_t Cind7 = 0L;
-                                             Cind7 < Csizes[7]; Cind7++)
-                                        {
-                                            double *Atp = Ap +
-                                                          Cind0 * AstridesC[0] +
-                                                          Cind1 * AstridesC[1] +
-                                                          Cind2 * AstridesC[2] +
-                                                          Cind3 * AstridesC[3] +
-                                                          Cind4 * AstridesC[4] +
-                                                          Cind5 * AstridesC[5] +
-                                                          Cind6 * AstridesC[6] +
-                                                          Cind7 * AstridesC[7];
-                                            //::memcpy(Ctp,Atp,sizeof(double)*fast_size);
-                                            C_DAXPY(fast_size, alpha, Atp, 1,
-                                                    Ctp, 1);
-                                            Ctp += fast_size;
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
+            run_kernels[slow_dims](Cp, Ap, Csizes, Cstrides, AstridesC,
+                                   fast_size, alpha);
         }
         else
         {
@@ -1250,7 +2332,7 @@ void CoreTensorImpl::permute(ConstTensorImplPtr A, const Indices &CindsS,
         }
     }
 
-    ambit::timer::timer_pop();
+    AMBIT_TIMER_POP();
 }
 void CoreTensorImpl::gemm(ConstTensorImplPtr A, ConstTensorImplPtr B,
                           bool transA, bool transB, size_t nrow, size_t ncol,
@@ -1262,7 +2344,7 @@ void CoreTensorImpl::gemm(ConstTensorImplPtr A, ConstTensorImplPtr B,
     double *Ap = ((const CoreTensorImplPtr)A)->data().data();
     double *Bp = ((const CoreTensorImplPtr)B)->data().data();
 
-    C_DGEMM((transA ? 'T' : 'N'), (transB ? 'T' : 'N'), nrow, ncol, nzip, alpha,
+    product((transA ? 'T' : 'N'), (transB ? 'T' : 'N'), nrow, ncol, nzip, alpha,
             Ap + offA, ldaA, Bp + offB, ldaB, beta, Cp + offC, ldaC);
 }
 
@@ -1277,40 +2359,105 @@ map<string, TensorImplPtr> CoreTensorImpl::syev(EigenvalueOrder order) const
 
     vecs->copy(this);
 
+    // Divide and conquer: much faster than dsyev for the full spectrum
     const size_t n = dims()[0];
+    const int lda = std::max<int>(n, 1);
     double dwork;
-    C_DSYEV('V', 'U', n, vecs->data().data(), n, vals->data().data(), &dwork,
-            -1);
-    size_t lwork = (size_t)dwork;
-    double *work = new double[lwork];
-    C_DSYEV('V', 'U', n, vecs->data().data(), n, vals->data().data(), work,
-            lwork);
-    delete[] work;
-
-    // If descending is required, the canonical order must be reversed
-    // Sort is stable
-    if (order == DescendingEigenvalue)
+    int diwork;
+    C_DSYEVD('V', 'U', n, vecs->data().data(), lda, vals->data().data(),
+             &dwork, -1, &diwork, -1);
+    vector<double> work(static_cast<size_t>(dwork));
+    vector<int> iwork(static_cast<size_t>(diwork));
+    int info = C_DSYEVD('V', 'U', n, vecs->data().data(), lda,
+                        vals->data().data(), work.data(), work.size(),
+                        iwork.data(), iwork.size());
+    if (info != 0)
     {
-        double *Temp_sqrsp_col = new double[n];
-        double w_Temp_sqrsp;
+        delete vecs;
+        delete vals;
+        throw std::runtime_error("CoreTensorImpl::syev: dsyevd failed for " +
+                                 name() + ", info = " + std::to_string(info));
+    }
 
-        const size_t half_n = n >> 1;
-        for (size_t c = 0; c < half_n; c++)
+    // The eigenvectors are the rows of vecs. If descending is required, the
+    // canonical order must be reversed
+    if (order == DescendingEigenvalue)
+    {
+        for (size_t c = 0; c < n / 2; c++)
         {
+            std::swap_ranges(vecs->data().begin() + c * n,
+                             vecs->data().begin() + (c + 1) * n,
+                             vecs->data().begin() + (n - c - 1) * n);
+            std::swap(vals->data()[c], vals->data()[n - c - 1]);
+        }
+    }
 
-            // Swap eigenvectors
-            C_DCOPY(n, vecs->data().data() + c, n, Temp_sqrsp_col, 1);
-            C_DCOPY(n, vecs->data().data() + n - c - 1, n,
-                    vecs->data().data() + c, n);
-            C_DCOPY(n, Temp_sqrsp_col, 1, vecs->data().data() + n - c - 1, n);
+    map<string, TensorImplPtr> result;
+    result["eigenvectors"] = vecs;
+    result["eigenvalues"] = vals;
 
-            // Swap eigenvalues
-            w_Temp_sqrsp = vals->data().data()[c];
-            vals->data().data()[c] = vals->data().data()[n - c - 1];
-            vals->data().data()[n - c - 1] = w_Temp_sqrsp;
-        }
+    return result;
+}
+
+map<string, TensorImplPtr> CoreTensorImpl::syev(EigenvalueOrder order,
+                                                size_t count) const
+{
+    squareCheck(this, true);
+
+    const size_t n = dims()[0];
+    if (count > n)
+        throw std::runtime_error("CoreTensorImpl::syev: " +
+                                 std::to_string(count) +
+                                 " eigenpairs requested for a matrix of " +
+                                 "dimension " + std::to_string(n));
+
+    CoreTensorImpl *vecs =
+        new CoreTensorImpl("Eigenvectors of " + name(), {count, n});
+    CoreTensorImpl *vals =
+        new CoreTensorImpl("Eigenvalues of " + name(), {count});
+    if (count == 0)
+    {
+        map<string, TensorImplPtr> result;
+        result["eigenvectors"] = vecs;
+        result["eigenvalues"] = vals;
+        return result;
+    }
+
+    // dsyevr overwrites its input; eigenpairs il..iu (1-based, ascending)
+    vector<double> A(data());
+    vector<double> w(n);
+    vector<int> isuppz(2 * count);
+    int il = order == AscendingEigenvalue ? 1 : n - count + 1;
+    int iu = order == AscendingEigenvalue ? count : n;
+    int m = 0;
+    double dwork;
+    int diwork;
+    C_DSYEVR('V', 'I', 'U', n, A.data(), n, 0.0, 0.0, il, iu, 0.0, &m,
+             w.data(), vecs->data().data(), n, isuppz.data(), &dwork, -1,
+             &diwork, -1);
+    vector<double> work(static_cast<size_t>(dwork));
+    vector<int> iwork(static_cast<size_t>(diwork));
+    int info = C_DSYEVR('V', 'I', 'U', n, A.data(), n, 0.0, 0.0, il, iu, 0.0,
+                        &m, w.data(), vecs->data().data(), n, isuppz.data(),
+                        work.data(), work.size(), iwork.data(), iwork.size());
+    if (info != 0 || static_cast<size_t>(m) != count)
+    {
+        delete vecs;
+        delete vals;
+        throw std::runtime_error("CoreTensorImpl::syev: dsyevr failed for " +
+                                 name() + ", info = " + std::to_string(info));
+    }
+    std::copy(w.begin(), w.begin() + count, vals->data().begin());
 
-        delete[] Temp_sqrsp_col;
+    if (order == DescendingEigenvalue)
+    {
+        for (size_t c = 0; c < count / 2; c++)
+        {
+            std::swap_ranges(vecs->data().begin() + c * n,
+                             vecs->data().begin() + (c + 1) * n,
+                             vecs->data().begin() + (count - c - 1) * n);
+            std::swap(vals->data()[c], vals->data()[count - c - 1]);
+        }
     }
 
     map<string, TensorImplPtr> result;
@@ -1431,6 +2578,8 @@ TensorImplPtr CoreTensorImpl::inverse() const
     size_t n = dim(0);
     CoreTensorImpl *inverted = new CoreTensorImpl(name() + " Inverse", dims());
     vector<double> &a = inverted->data();
+    if (n == 0)
+        return inverted;
 
     memcpy(a.data(), data().data(), sizeof(double) * n * n);
 
@@ -1484,6 +2633,12 @@ TensorImplPtr CoreTensorImpl::inverse() const
 
 TensorImplPtr CoreTensorImpl::power(double alpha, double condition) const
 {
+    if (dim(0) == 0)
+    {
+        squareCheck(this, true);
+        return new CoreTensorImpl(name() + "^" + std::to_string(alpha), dims());
+    }
+
     // this call will ensure squareness
     map<string, TensorImplPtr> diag = syev(AscendingEigenvalue);
 
@@ -1523,7 +2678,7 @@ TensorImplPtr CoreTensorImpl::power(double alpha, double condition) const
     CoreTensorImpl *powered =
         new CoreTensorImpl(name() + "^" + std::to_string(alpha), dims());
 
-    C_DGEMM('T', 'N', n, n, n, 1.0, a2, n, a1, n, 0.0, powered->data_.data(),
+    C_DGEMM('T', 'N', n, n, n, 1.0, a2, n, a1, n, 0.0, powered->data().data(),
             n);
 
     delete[] a2;
@@ -1537,57 +2692,366 @@ TensorImplPtr CoreTensorImpl::power(double alpha, double condition) const
     return powered;
 }
 
-void CoreTensorImpl::iterate(
-    const function<void(const vector<size_t> &, double &)> &func)
+double fused_reduction(const vector<const double *> &data,
+                       const vector<Dimension> &dims,
+                       const vector<Indices> &inds, double alpha)
 {
-    vector<size_t> indices(rank(), 0);
-    vector<size_t> addressing(rank(), 1);
+    size_t nterm = data.size();
+    if (dims.size() != nterm || inds.size() != nterm)
+        throw std::runtime_error("fused_reduction: one set of indices is "
+                                 "needed per term");
 
-    // form addressing array
-    for (int n = static_cast<int>(rank() - 2); n >= 0; --n)
+    // => Index Logic <= //
+
+    // Distinct indices, their dimensions, and their stride in each term
+    Indices labels;
+    vector<size_t> sizes;
+    vector<vector<size_t>> strides;
+    for (size_t t = 0; t < nterm; ++t)
+    {
+        if (inds[t].size() != dims[t].size())
+            throw std::runtime_error("fused_reduction: term " +
+                                     std::to_string(t) +
+                                     " has the wrong number of indices");
+        size_t stride = 1L;
+        for (int dim = dims[t].size() - 1; dim >= 0; --dim)
+        {
+            size_t pos = std::find(labels.begin(), labels.end(), inds[t][dim]) -
+                         labels.begin();
+            if (pos == labels.size())
+            {
+                labels.push_back(inds[t][dim]);
+                sizes.push_back(dims[t][dim]);
+                strides.push_back(vector<size_t>(nterm, 0L));
+            }
+            else if (sizes[pos] != dims[t][dim])
+            {
+                throw std::runtime_error("fused_reduction: index " +
+                                         inds[t][dim] +
+                                         " has inconsistent dimensions");
+            }
+            strides[pos][t] += stride;
+            stride *= dims[t][dim];
+        }
+    }
+
+    size_t total = 1L;
+    for (size_t size : sizes)
+        total *= size;
+    if (total == 0L)
+        return 0.0;
+
+    // => Special Case: Scalars <= //
+
+    if (labels.empty())
+    {
+        double value = alpha;
+        for (const double *Tp : data)
+            value *= Tp[0];
+        return value;
+    }
+
+    // => Special Case: Dot Product <= //
+
+    if (nterm == 2L && inds[0] == inds[1] && labels.size() == inds[0].size())
+    {
+        return alpha * C_DDOT(total, const_cast<double *>(data[0]), 1,
+                              const_cast<double *>(data[1]), 1);
+    }
+
+    // => Loop Order <= //
+
+    // The innermost index has the most unit strides, then the largest size
+    size_t inner = 0L;
+    int best_units = -1;
+    for (size_t pos = 0L; pos < labels.size(); ++pos)
+    {
+        int units = 0;
+        for (size_t t = 0; t < nterm; ++t)
+            units += (strides[pos][t] == 1L);
+        if (units > best_units ||
+            (units == best_units && sizes[pos] > sizes[inner]))
+        {
+            inner = pos;
+            best_units = units;
+        }
+    }
+    size_t ninner = sizes[inner];
+    vector<size_t> inner_strides = strides[inner];
+
+    vector<size_t> outer_sizes;
+    vector<vector<size_t>> outer_strides;
+    for (size_t pos = 0L; pos < labels.size(); ++pos)
     {
-        addressing[n] = addressing[n + 1] * dim(n + 1);
+        if (pos == inner)
+            continue;
+        outer_sizes.push_back(sizes[pos]);
+        outer_strides.push_back(strides[pos]);
     }
+    size_t nouter = total / ninner;
+    int nloop = outer_sizes.size();
 
-    const size_t nelem = numel();
-    const size_t nrank = rank();
-    for (size_t n = 0; n < nelem; ++n)
+    // => Reduction <= //
+
+    double sum = 0.0;
+#pragma omp parallel reduction(+ : sum)
     {
-        size_t d = n;
-        for (size_t k = 0; k < nrank; ++k)
+        size_t nthread = 1L;
+        size_t thread = 0L;
+#if defined(_OPENMP)
+        nthread = omp_get_num_threads();
+        thread = omp_get_thread_num();
+#endif
+        size_t begin = nouter * thread / nthread;
+        size_t end = nouter * (thread + 1) / nthread;
+
+        // Only the first outer position is decoded, the rest are increments
+        vector<size_t> index(nloop, 0L);
+        vector<size_t> offsets(nterm, 0L);
+        size_t num = begin;
+        for (int k = nloop - 1; k >= 0; --k)
         {
-            indices[k] = d / addressing[k];
-            d = d % addressing[k];
+            index[k] = num % outer_sizes[k];
+            num /= outer_sizes[k];
+            for (size_t t = 0; t < nterm; ++t)
+                offsets[t] += index[k] * outer_strides[k][t];
         }
 
-        func(indices, data_[n]);
+        for (size_t outer = begin; outer < end; ++outer)
+        {
+            if (nterm == 2L)
+            {
+                const double *Ap = data[0] + offsets[0];
+                const double *Bp = data[1] + offsets[1];
+                size_t As = inner_strides[0];
+                size_t Bs = inner_strides[1];
+                for (size_t i = 0L; i < ninner; ++i)
+                    sum += Ap[i * As] * Bp[i * Bs];
+            }
+            else
+            {
+                for (size_t i = 0L; i < ninner; ++i)
+                {
+                    double value = 1.0;
+                    for (size_t t = 0; t < nterm; ++t)
+                        value *= data[t][offsets[t] + i * inner_strides[t]];
+                    sum += value;
+                }
+            }
+
+            for (int k = nloop - 1; k >= 0; --k)
+            {
+                if (++index[k] < outer_sizes[k])
+                {
+                    for (size_t t = 0; t < nterm; ++t)
+                        offsets[t] += outer_strides[k][t];
+                    break;
+                }
+                index[k] = 0L;
+                for (size_t t = 0; t < nterm; ++t)
+                    offsets[t] -= (outer_sizes[k] - 1L) * outer_strides[k][t];
+            }
+        }
     }
+
+    return alpha * sum;
 }
 
-void CoreTensorImpl::citerate(
-    const function<void(const vector<size_t> &, const double &)> &func) const
+void permute_sum(CoreTensorImplPtr C, const vector<ConstCoreTensorImplPtr> &As,
+                 const Indices &Cinds, const vector<Indices> &Ainds,
+                 const vector<double> &alphas, double beta)
 {
-    vector<size_t> indices(rank(), 0);
-    vector<size_t> addressing(rank(), 1);
+    size_t nterm = As.size();
+    if (Ainds.size() != nterm || alphas.size() != nterm)
+        throw std::runtime_error("permute_sum: every term needs indices and "
+                                 "a scale");
+
+    // => Index Logic <= //
+
+    int rank = C->rank();
+    const Dimension &Csizes = C->dims();
+
+    /// Strides of each term in the ordering of tensor C
+    vector<vector<size_t>> AstridesC(nterm, vector<size_t>(rank, 0L));
+    vector<const double *> Aps(nterm);
+    for (size_t t = 0; t < nterm; ++t)
+    {
+        if ((int)As[t]->rank() != rank)
+            throw std::runtime_error(
+                "Permuted tensors do not have same rank");
+        vector<size_t> order = indices::permutation_order(Cinds, Ainds[t]);
+        vector<size_t> Astrides(rank, 1L);
+        for (int dim = rank - 2; dim >= 0; dim--)
+            Astrides[dim] = Astrides[dim + 1] * As[t]->dims()[dim + 1];
+        for (int dim = 0; dim < rank; dim++)
+        {
+            if (Csizes[dim] != As[t]->dims()[order[dim]])
+                throw std::runtime_error(
+                    "Permuted tensors do not have same dimensions");
+            AstridesC[t][dim] = Astrides[order[dim]];
+        }
+        Aps[t] = As[t]->data().data();
+    }
+
+    double *Cp = C->data().data();
+    size_t numel = C->numel();
+    if (numel == 0L)
+        return;
+
+    AMBIT_TIMER_PUSH("P: fused sum of " + std::to_string(nterm) + " terms");
+    AMBIT_TIMER_BYTES(sizeof(double) * static_cast<double>(numel) *
+                      (nterm + (beta != 0.0 ? 2.0 : 1.0)));
+
+    // => Special Case: Scalars <= //
+
+    if (rank == 0)
+    {
+        double value = (beta == 0.0 ? 0.0 : beta * Cp[0]);
+        for (size_t t = 0; t < nterm; ++t)
+            value += alphas[t] * Aps[t][0];
+        Cp[0] = value;
+        AMBIT_TIMER_POP();
+        return;
+    }
+
+    // => Tiling <= //
+
+    /// The unit-stride index of C, and the index of C that is unit-stride in
+    /// the first term that runs along C with a stride (-1 if there is none)
+    int Cunit = rank - 1;
+    int Aunit = -1;
+    for (size_t t = 0; t < nterm && Aunit < 0; ++t)
+    {
+        if (AstridesC[t][Cunit] == 1L)
+            continue;
+        for (int dim = 0; dim < Cunit; dim++)
+            if (AstridesC[t][dim] == 1L)
+                Aunit = dim;
+    }
 
-    // form addressing array
-    for (int n = static_cast<int>(rank() - 2); n >= 0; --n)
+    vector<size_t> Cstrides(rank, 1L);
+    for (int dim = rank - 2; dim >= 0; dim--)
+        Cstrides[dim] = Cstrides[dim + 1] * Csizes[dim + 1];
+
+    /// Sizes and strides of the remaining (outer) indices
+    vector<size_t> outer_sizes;
+    vector<size_t> outer_Cstrides;
+    vector<vector<size_t>> outer_Astrides;
+    size_t outer_size = 1L;
+    for (int dim = 0; dim < Cunit; dim++)
+    {
+        if (dim == Aunit)
+            continue;
+        outer_sizes.push_back(Csizes[dim]);
+        outer_Cstrides.push_back(Cstrides[dim]);
+        vector<size_t> strides(nterm);
+        for (size_t t = 0; t < nterm; ++t)
+            strides[t] = AstridesC[t][dim];
+        outer_Astrides.push_back(strides);
+        outer_size *= Csizes[dim];
+    }
+    int nouter = outer_sizes.size();
+
+    /// Without a transposed term the rows of C are not tiled
+    size_t nA = (Aunit < 0 ? 1L : Csizes[Aunit]);
+    size_t nC = Csizes[Cunit];
+    size_t tileA = (Aunit < 0 ? 1L : permute_tile);
+    size_t tileC = (Aunit < 0 ? nC : permute_tile);
+    size_t CstrideA = (Aunit < 0 ? 0L : Cstrides[Aunit]);
+    vector<size_t> AstridesA(nterm, 0L);
+    vector<size_t> AstridesCunit(nterm);
+    for (size_t t = 0; t < nterm; ++t)
     {
-        addressing[n] = addressing[n + 1] * dim(n + 1);
+        if (Aunit >= 0)
+            AstridesA[t] = AstridesC[t][Aunit];
+        AstridesCunit[t] = AstridesC[t][Cunit];
     }
+    size_t ntileA = (nA + tileA - 1L) / tileA;
+    size_t ntileC = (nC + tileC - 1L) / tileC;
+    size_t ntask = outer_size * ntileA * ntileC;
+
+    // => Fused Sum <= //
 
-    const size_t nelem = numel();
-    const size_t nrank = rank();
-    for (size_t n = 0; n < nelem; ++n)
+#pragma omp parallel
     {
-        size_t d = n;
-        for (size_t k = 0; k < nrank; ++k)
+        vector<double> row(tileC);
+        vector<size_t> Aoffs(nterm);
+
+#pragma omp for schedule(static)
+        for (size_t task = 0L; task < ntask; task++)
         {
-            indices[k] = d / addressing[k];
-            d = d % addressing[k];
-        }
+            size_t num = task;
+            size_t C0 = (num % ntileC) * tileC;
+            num /= ntileC;
+            size_t A0 = (num % ntileA) * tileA;
+            num /= ntileA;
+
+            size_t Coff = 0L;
+            std::fill(Aoffs.begin(), Aoffs.end(), 0L);
+            for (int dim = nouter - 1; dim >= 0; dim--)
+            {
+                size_t val = num % outer_sizes[dim];
+                num /= outer_sizes[dim];
+                Coff += val * outer_Cstrides[dim];
+                for (size_t t = 0; t < nterm; ++t)
+                    Aoffs[t] += val * outer_Astrides[dim][t];
+            }
 
-        func(indices, data_[n]);
+            size_t A1 = std::min(A0 + tileA, nA);
+            size_t C1 = std::min(C0 + tileC, nC);
+            size_t len = C1 - C0;
+            for (size_t indA = A0; indA < A1; indA++)
+            {
+                double *Ctp = Cp + Coff + indA * CstrideA + C0;
+                if (beta == 0.0)
+                    std::fill(row.begin(), row.begin() + len, 0.0);
+                else
+                    for (size_t k = 0L; k < len; k++)
+                        row[k] = beta * Ctp[k];
+                for (size_t t = 0; t < nterm; ++t)
+                {
+                    double alpha = alphas[t];
+                    size_t stride = AstridesCunit[t];
+                    const double *Atp =
+                        Aps[t] + Aoffs[t] + indA * AstridesA[t] + C0 * stride;
+                    if (stride == 1L)
+                        for (size_t k = 0L; k < len; k++)
+                            row[k] += alpha * Atp[k];
+                    else
+                        for (size_t k = 0L; k < len; k++)
+                            row[k] += alpha * Atp[k * stride];
+                }
+                std::copy(row.begin(), row.begin() + len, Ctp);
+            }
+        }
     }
+
+    AMBIT_TIMER_POP();
+}
+
+void CoreTensorImpl::iterate(
+    const function<void(const vector<size_t> &, double &)> &func)
+{
+    typedef const function<void(const vector<size_t> &, double &)> Func;
+    elementwise::ElementRows<double, Func> rows(func);
+    elementwise::for_rows(dims(), data().data(), 0L, elementwise::row_count(dims()),
+                     rows);
+}
+
+void CoreTensorImpl::parallel_iterate(
+    const function<void(const vector<size_t> &, double &)> &func)
+{
+    typedef const function<void(const vector<size_t> &, double &)> Func;
+    elementwise::ElementRows<double, Func> rows(func);
+    elementwise::parallel_for_rows(dims(), data().data(), rows);
+}
+
+void CoreTensorImpl::citerate(
+    const function<void(const vector<size_t> &, const double &)> &func) const
+{
+    typedef const function<void(const vector<size_t> &, const double &)> Func;
+    elementwise::ElementRows<const double, Func> rows(func);
+    elementwise::for_rows(dims(), data().data(), 0L, elementwise::row_count(dims()),
+                     rows);
 }
 }
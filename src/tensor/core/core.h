@@ -30,7 +30,9 @@
 #if !defined(TENSOR_CORE_H)
 #define TENSOR_CORE_H
 
+#include "spill.h"
 #include "tensor/tensorimpl.h"
+#include <mutex>
 
 namespace ambit
 {
@@ -40,13 +42,78 @@ class CoreTensorImpl : public TensorImpl
   public:
     CoreTensorImpl(const string &name, const Dimension &dims);
 
+    // Takes ownership of existing storage (of at least numel() elements)
+    // without initializing it. Used by the scratch pool.
+    CoreTensorImpl(const string &name, const Dimension &dims,
+                   vector<double> &&data);
+
+    // Holds no storage until the first access, which allocates it and has
+    // loader fill it, as if the data had been spilled. Used by
+    // Tensor::build_deferred.
+    CoreTensorImpl(const string &name, const Dimension &dims,
+                   const function<void(double *)> &loader);
+
+    // A view of range of parent: it shares the storage of parent and keeps
+    // parent alive. Views can be contracted (as any operand), copied,
+    // sliced and scaled; data() and the other operations throw.
+    CoreTensorImpl(shared_ptr<CoreTensorImpl> parent, const IndexRange &range);
+    // The same, without the indices fixed (whose range must hold a single
+    // element), so the view has a lower rank than parent
+    CoreTensorImpl(shared_ptr<CoreTensorImpl> parent, const IndexRange &range,
+                   const vector<size_t> &fixed);
+
+    ~CoreTensorImpl();
+
     // Changes the internal dims_ object but does not change memory
     // allocation. This is an expert function. Used to change
     // the strides in the slice codes.
     void reshape(const Dimension &dims);
 
-    vector<double> &data() { return data_; }
-    const vector<double> &data() const { return data_; }
+    // The accessors read the data back first if it was spilled to disk
+    vector<double> &data()
+    {
+        if (view_parent_)
+            view_error();
+        touch();
+        return data_;
+    }
+    const vector<double> &data() const
+    {
+        if (view_parent_)
+            view_error();
+        touch();
+        return data_;
+    }
+    double *map_data() { return data().data(); }
+    const double *map_data() const { return data().data(); }
+
+    // => Views <= //
+
+    bool is_view() const { return view_parent_ != nullptr; }
+    const shared_ptr<CoreTensorImpl> &view_parent() const
+    {
+        return view_parent_;
+    }
+    const IndexRange &view_range() const { return view_range_; }
+    /// Indices of the parent a view keeps, in order
+    const vector<size_t> &view_axes() const { return view_axes_; }
+    /// Address of the first element, and the element strides of every index
+    /// (those of the parent for a view)
+    double *strided_data(vector<size_t> &strides);
+    const double *strided_data(vector<size_t> &strides) const;
+
+    // => Spilling (see spill.h) <= //
+
+    /// Writes the data to a scratch file and frees it, unless the tensor is
+    /// pinned, already spilled or busy
+    /// @return the number of bytes freed
+    size_t spill();
+    /// Makes the tensor a candidate for spilling (done by Tensor::build)
+    void enroll();
+    bool spilled() const { return spilled_; }
+    size_t last_use() const { return last_use_; }
+    void pin() const;
+    void unpin() const;
 
     // => Simple Single Tensor Operations <= //
 
@@ -56,6 +123,9 @@ class CoreTensorImpl : public TensorImpl
 
     tuple<double, vector<size_t>> min() const;
 
+    /// All of the above in one parallel pass
+    TensorStats stats() const;
+
     void scale(double beta = 0.0);
 
     void set(double alpha);
@@ -83,6 +153,7 @@ class CoreTensorImpl : public TensorImpl
     // => Order-2 Operations <= //
 
     map<string, TensorImplPtr> syev(EigenvalueOrder order) const;
+    map<string, TensorImplPtr> syev(EigenvalueOrder order, size_t count) const;
     map<string, TensorImplPtr> geev(EigenvalueOrder order) const;
     map<string, TensorImplPtr> gesvd() const;
 
@@ -95,15 +166,113 @@ class CoreTensorImpl : public TensorImpl
     TensorImplPtr power(double power, double condition = 1.0E-12) const;
 
     void iterate(const function<void(const vector<size_t> &, double &)> &func);
+    void parallel_iterate(
+        const function<void(const vector<size_t> &, double &)> &func);
     void citerate(const function<void(const vector<size_t> &, const double &)>
                       &func) const;
 
   private:
-    vector<double> data_;
+    void touch() const
+    {
+        if (spilled_)
+            fault_in();
+        last_use_.store(spill::clock.load(std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+    }
+    void fault_in() const;
+    [[noreturn]] void view_error() const;
+
+    mutable vector<double> data_;
+    /// Bytes charged to the memory accounting, under the original name
+    size_t charged_;
+    string charged_name_;
+
+    bool enrolled_;
+    mutable std::mutex spill_mutex_;
+    mutable std::atomic<bool> spilled_;
+    mutable std::atomic<size_t> last_use_;
+    /// Number of operations using the tensor, guarded by spill_mutex_
+    mutable int pins_;
+    /// Scratch file of spilled data, and its descriptor
+    mutable string spill_file_;
+    mutable int spill_fd_;
+    /// Sizes of the compressed runs of disk_io::extent_size__ elements of a
+    /// spill file (see settings::disk_compression), empty if uncompressed
+    mutable vector<size_t> spill_runs_;
+    /// Source of deferred data, used in place of the scratch file
+    mutable function<void(double *)> loader_;
+
+    /// Tensor whose storage a view looks into, the range it covers (over all
+    /// the indices of the parent) and the indices it keeps
+    shared_ptr<CoreTensorImpl> view_parent_;
+    IndexRange view_range_;
+    vector<size_t> view_axes_;
 };
 
 typedef CoreTensorImpl *CoreTensorImplPtr;
 typedef const CoreTensorImpl *ConstCoreTensorImplPtr;
+
+/** Contracts C[Cinds] = epilogue(alpha * A[Ainds] * B[Binds] + beta *
+ * C[Cinds]).
+ *
+ * The GEMMs of the contraction plan run in panels of rows of C (or of its
+ * permuted copy), and each panel is finished by the epilogue right after it
+ * is computed, while it is in cache. The panels of all the Hadamard slices
+ * are shared among OpenMP threads. Contractions that take the strided
+ * kernel are finished in a separate pass.
+ */
+void contract_epilogue(CoreTensorImplPtr C, ConstCoreTensorImplPtr A,
+                       ConstCoreTensorImplPtr B, const Indices &Cinds,
+                       const Indices &Ainds, const Indices &Binds,
+                       const Epilogue &epilogue, double alpha, double beta);
+
+/** Contracts Cs[n][Cinds] = alpha * As[n][Ainds] * Bs[n][Binds] + beta *
+ * Cs[n][Cinds] for every n, e.g. the block products of a blocked
+ * contraction that write to different result blocks.
+ *
+ * The Cs must be distinct. Small products are shared among OpenMP threads,
+ * and the contraction plan is looked up once per shape, so products whose
+ * operands need no permutation (most small blocks) are single BLAS calls
+ * without the per-call overhead of CoreTensorImpl::contract. Large products
+ * run one after another on threaded BLAS, with the operands of the next one
+ * permuted on a helper thread while the current one is in BLAS.
+ */
+void contract_batch(const vector<CoreTensorImplPtr> &Cs,
+                    const vector<ConstCoreTensorImplPtr> &As,
+                    const vector<ConstCoreTensorImplPtr> &Bs,
+                    const Indices &Cinds, const Indices &Ainds,
+                    const Indices &Binds, double alpha, double beta);
+
+/** Computes C[Cinds] = sum_n alphas[n] * As[n][Ainds[n]] + beta * C[Cinds]
+ * in one pass over C.
+ *
+ * The walk over C is blocked into tiles spanning its unit-stride index and
+ * the unit-stride index of the first transposed term, as in
+ * CoreTensorImpl::permute. Each row of a tile is accumulated in a buffer
+ * over all the terms and stored once, so C is read and written a single
+ * time however many terms there are. A term may only alias C if its
+ * indices are Cinds.
+ */
+void permute_sum(CoreTensorImplPtr C, const vector<ConstCoreTensorImplPtr> &As,
+                 const Indices &Cinds, const vector<Indices> &Ainds,
+                 const vector<double> &alphas, double beta);
+
+/** Returns alpha times the full contraction of the terms: the sum over every
+ * index of the product of the labeled elements.
+ *
+ * The terms are streamed in place, so no intermediates are formed. Two terms
+ * with the same index order reduce to a single DDOT. Otherwise the index
+ * with the most unit strides runs innermost and the remaining index space is
+ * shared among OpenMP threads.
+ *
+ * @param data the elements of each tensor, as in CoreTensorImpl::data()
+ * @param dims the dimensions of each tensor
+ * @param inds the indices of each tensor
+ * @param alpha the scale of the result
+ */
+double fused_reduction(const vector<const double *> &data,
+                       const vector<Dimension> &dims,
+                       const vector<Indices> &inds, double alpha = 1.0);
 }
 
 #endif
@@ -0,0 +1,128 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#include "scratch.h"
+#include "storage.h"
+#include "tensor/accounting.h"
+#include <ambit/settings.h>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace ambit
+{
+
+namespace scratch
+{
+
+namespace
+{
+
+std::mutex pool_mutex;
+
+/// Idle buffers sorted by capacity (in doubles) for best-fit lookup, the
+/// most recently released (cache-warm) one first among equal capacities
+std::multimap<size_t, vector<double>> pool;
+
+size_t pool_bytes = 0L;
+
+vector<double> acquire(size_t numel)
+{
+    vector<double> buffer;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        auto it = pool.lower_bound(numel);
+        if (it != pool.end())
+        {
+            buffer.swap(it->second);
+            pool_bytes -= it->first * sizeof(double);
+            pool.erase(it);
+        }
+    }
+    // Shrinking never reallocates, so a recycled buffer is not touched here
+    storage::allocate(buffer, numel);
+    return buffer;
+}
+
+void release(vector<double> &buffer)
+{
+    size_t capacity = buffer.capacity();
+    size_t bytes = capacity * sizeof(double);
+    // Idle buffers only get what the live tensors leave of the limit
+    size_t live = memory::live_bytes();
+    size_t room =
+        live < settings::memory_limit ? settings::memory_limit - live : 0L;
+    if (capacity == 0L || bytes > room)
+        return;
+
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    // Make room by dropping the smallest buffers first
+    while (!pool.empty() && pool_bytes + bytes > room)
+    {
+        pool_bytes -= pool.begin()->first * sizeof(double);
+        pool.erase(pool.begin());
+    }
+    pool.emplace_hint(pool.lower_bound(capacity), capacity,
+                      std::move(buffer));
+    pool_bytes += bytes;
+}
+}
+
+shared_ptr<CoreTensorImpl> build(const string &name, const Dimension &dims)
+{
+    size_t numel = 1L;
+    for (size_t dim : dims)
+        numel *= dim;
+
+    size_t bytes = numel * sizeof(double);
+    memory::charge(name, bytes);
+    CoreTensorImpl *tensor = new CoreTensorImpl(name, dims, acquire(numel));
+    return shared_ptr<CoreTensorImpl>(
+        tensor, [name, bytes](CoreTensorImpl *ptr) {
+            memory::discharge(name, bytes);
+            release(ptr->data());
+            delete ptr;
+        });
+}
+
+size_t pooled_bytes()
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    return pool_bytes;
+}
+
+void clear()
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    pool.clear();
+    pool_bytes = 0L;
+}
+}
+}
@@ -0,0 +1,69 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#if !defined(TENSOR_CORE_SCRATCH_H)
+#define TENSOR_CORE_SCRATCH_H
+
+#include "core.h"
+
+namespace ambit
+{
+
+// => Scratch Buffer Pool <= //
+
+/**
+ * Library-wide pool of idle double buffers used for contraction
+ * intermediates.
+ *
+ * Buffers are handed back to the pool instead of being freed, so repeated
+ * contractions of the same shapes do not pay for a fresh (zero-filled)
+ * allocation every time. The total size of the idle buffers is capped by
+ * what the live tensors leave of settings::memory_limit; buffers that do not
+ * fit are freed. Buffers in use are charged to the memory accounting.
+ */
+namespace scratch
+{
+
+/** Builds a CoreTensorImpl whose storage is drawn from the pool.
+ *
+ * The contents of the tensor are undefined. The storage is returned to the
+ * pool when the last reference to the tensor goes away.
+ */
+shared_ptr<CoreTensorImpl> build(const string &name, const Dimension &dims);
+
+/// Total size in bytes of the idle buffers held by the pool
+size_t pooled_bytes();
+
+/// Frees all idle buffers
+void clear();
+}
+}
+
+#endif
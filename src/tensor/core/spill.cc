@@ -0,0 +1,111 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#include "spill.h"
+#include "core.h"
+#include <algorithm>
+#include <mutex>
+#include <set>
+
+namespace ambit
+{
+
+namespace spill
+{
+
+std::atomic<size_t> clock(0L);
+
+namespace
+{
+
+std::mutex registry_mutex;
+std::set<CoreTensorImpl *> registry;
+
+/// Tensors smaller than this stay in memory; they would cost more file
+/// operations than they save
+const size_t min_spill_bytes = 1048576L;
+}
+
+void enroll(CoreTensorImpl *tensor)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.insert(tensor);
+}
+
+void withdraw(CoreTensorImpl *tensor)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.erase(tensor);
+}
+
+size_t make_room(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    vector<CoreTensorImpl *> candidates;
+    for (CoreTensorImpl *tensor : registry)
+    {
+        if (!tensor->spilled() &&
+            tensor->numel() * sizeof(double) >= min_spill_bytes)
+            candidates.push_back(tensor);
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const CoreTensorImpl *a, const CoreTensorImpl *b) {
+                  return a->last_use() < b->last_use();
+              });
+
+    size_t freed = 0L;
+    for (size_t n = 0; n < candidates.size() && freed < bytes; ++n)
+        freed += candidates[n]->spill();
+    return freed;
+}
+
+Pin::Pin(const TensorImpl *A, const TensorImpl *B, const TensorImpl *C)
+{
+    const TensorImpl *tensors[3] = {A, B, C};
+    for (int n = 0; n < 3; ++n)
+    {
+        tensors_[n] = nullptr;
+        if (tensors[n] != nullptr && tensors[n]->type() == CoreTensor)
+        {
+            tensors_[n] = static_cast<const CoreTensorImpl *>(tensors[n]);
+            tensors_[n]->pin();
+        }
+    }
+}
+
+Pin::~Pin()
+{
+    for (int n = 0; n < 3; ++n)
+        if (tensors_[n] != nullptr)
+            tensors_[n]->unpin();
+}
+}
+}
@@ -0,0 +1,91 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#if !defined(TENSOR_CORE_SPILL_H)
+#define TENSOR_CORE_SPILL_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace ambit
+{
+
+class TensorImpl;
+class CoreTensorImpl;
+
+// => Spilling to Disk <= //
+
+/**
+ * Eviction of cold CoreTensor's to Tensor::scratch_path() under memory
+ * pressure (settings::spill_to_disk).
+ *
+ * The CoreTensor's built by Tensor::build are enrolled. When an allocation
+ * would take the live tensors past settings::memory_limit, the enrolled
+ * tensors that are not pinned are written out in least recently used order
+ * and their storage is freed. The next access through
+ * CoreTensorImpl::data() reads them back.
+ *
+ * The Tensor operations pin their operands for their duration, so the data
+ * pointers they hold stay valid. References returned by Tensor::data() are
+ * only valid until the next allocation.
+ */
+namespace spill
+{
+
+/// Advances on every allocation; the last use of a tensor is the value at
+/// its last access
+extern std::atomic<size_t> clock;
+
+void enroll(CoreTensorImpl *tensor);
+void withdraw(CoreTensorImpl *tensor);
+
+/// Spills least recently used tensors until bytes are freed (or no tensor
+/// is left to spill)
+/// @return the number of bytes freed
+size_t make_room(size_t bytes);
+
+/// Pins the CoreTensor's among up to three tensors while in scope
+class Pin
+{
+  public:
+    explicit Pin(const TensorImpl *A, const TensorImpl *B = nullptr,
+                 const TensorImpl *C = nullptr);
+    ~Pin();
+
+    Pin(const Pin &) = delete;
+    Pin &operator=(const Pin &) = delete;
+
+  private:
+    const CoreTensorImpl *tensors_[3];
+};
+}
+}
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#include "storage.h"
+#include <ambit/settings.h>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ambit
+{
+
+namespace storage
+{
+
+namespace
+{
+
+/// Smaller buffers are left to the allocator
+const size_t min_placed_bytes = 1048576L;
+
+const size_t page_bytes = 4096L;
+
+#if defined(__linux__) && defined(SYS_mbind)
+/// Number of the highest online NUMA node plus one (1 if unknown)
+int numa_nodes()
+{
+    static const int nodes = [] {
+        // e.g. "0-1" or "0"
+        std::ifstream online("/sys/devices/system/node/online");
+        std::string range;
+        if (!(online >> range))
+            return 1;
+        size_t dash = range.find_last_of("-,");
+        return std::stoi(dash == std::string::npos ? range
+                                                   : range.substr(dash + 1)) +
+               1;
+    }();
+    return nodes;
+}
+
+void interleave(char *begin, size_t bytes)
+{
+    int nodes = numa_nodes();
+    if (nodes < 2 || nodes > 64)
+        return;
+    // MPOL_INTERLEAVE from <numaif.h>, which needs libnuma
+    const int mpol_interleave = 3;
+    unsigned long mask = (nodes == 64 ? ~0UL : (1UL << nodes) - 1UL);
+    // Best effort: on failure the pages are placed by first touch
+    syscall(SYS_mbind, begin, bytes, mpol_interleave, &mask,
+            static_cast<unsigned long>(nodes + 1), 0);
+}
+#endif
+
+void first_touch(char *begin, size_t bytes)
+{
+    long npage = static_cast<long>(bytes / page_bytes);
+#pragma omp parallel for schedule(static)
+    for (long page = 0; page < npage; ++page)
+        begin[page * page_bytes] = 0;
+}
+}
+
+void allocate(std::vector<double> &buffer, size_t numel)
+{
+    size_t bytes = numel * sizeof(double);
+    if (numel <= buffer.capacity() || bytes < min_placed_bytes)
+    {
+        buffer.resize(numel);
+        return;
+    }
+
+    buffer.reserve(numel);
+
+    // The whole pages of the new storage, which nothing has touched yet
+    // except possibly the old elements copied into it
+    uintptr_t first = reinterpret_cast<uintptr_t>(buffer.data() + buffer.size());
+    uintptr_t last = reinterpret_cast<uintptr_t>(buffer.data() + numel);
+    first = (first + page_bytes - 1) / page_bytes * page_bytes;
+    last = last / page_bytes * page_bytes;
+    if (last > first)
+    {
+        char *begin = reinterpret_cast<char *>(first);
+        size_t length = last - first;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        if (settings::huge_page_threshold != 0L &&
+            bytes >= settings::huge_page_threshold)
+            madvise(begin, length, MADV_HUGEPAGE);
+#endif
+        switch (settings::page_placement)
+        {
+        case settings::ParallelFirstTouch:
+            first_touch(begin, length);
+            break;
+        case settings::InterleavePlacement:
+#if defined(__linux__) && defined(SYS_mbind)
+            interleave(begin, length);
+#endif
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Pages already placed stay where they are
+    buffer.resize(numel);
+}
+}
+}
@@ -0,0 +1,59 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#if !defined(TENSOR_CORE_STORAGE_H)
+#define TENSOR_CORE_STORAGE_H
+
+#include <cstddef>
+#include <vector>
+
+namespace ambit
+{
+
+// => CoreTensor Storage <= //
+
+/**
+ * Allocation of the storage of CoreTensor's.
+ *
+ * The storage stays a std::vector<double>, as Tensor::data() exposes it.
+ * Large new buffers are reserved first, then their pages are advised
+ * (transparent huge pages, settings::huge_page_threshold) and placed
+ * (settings::page_placement) before they are zero-filled.
+ */
+namespace storage
+{
+
+/// Resizes buffer to numel zeroed elements, placing any new large storage.
+/// Existing elements are kept.
+void allocate(std::vector<double> &buffer, size_t numel);
+}
+}
+
+#endif
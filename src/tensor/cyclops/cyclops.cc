@@ -31,6 +31,9 @@
 #error The Cyclops interface is being compiled without Cyclops present.
 #endif
 
+#include <exception>
+#include <map>
+#include <mutex>
 #include <stdexcept>
 
 #include "cyclops.h"
@@ -91,6 +94,22 @@ std::vector<std::string> generateCyclopsLabels(const std::vector<Indices> &inds)
     }
     return cyclops_inds;
 }
+
+// The translations of the label lists seen so far; iterative solvers repeat
+// the same few contractions
+std::mutex label_cache_mutex;
+std::map<std::vector<Indices>, std::vector<std::string>> label_cache;
+
+/// generateCyclopsLabels, cached per list of labels
+std::vector<std::string> cyclopsLabels(const std::vector<Indices> &inds)
+{
+    std::lock_guard<std::mutex> lock(label_cache_mutex);
+    auto it = label_cache.find(inds);
+    if (it == label_cache.end())
+        it = label_cache.insert(std::make_pair(inds, generateCyclopsLabels(inds)))
+                 .first;
+    return it->second;
+}
 }
 
 int initialize(int argc, char **argv)
@@ -374,13 +393,12 @@ void CyclopsTensorImpl::permute(ConstTensorImplPtr A,
 {
     GET_CTF_TENSOR(A);
 
-    std::vector<std::string> cyclops_inds =
-        generateCyclopsLabels({Cinds, Ainds});
-    std::string Ccyclops = cyclops_inds[0];
-    std::string Acyclops = cyclops_inds[1];
+    std::vector<std::string> cyclops_inds = cyclopsLabels({Cinds, Ainds});
+    const std::string &Ccyclops = cyclops_inds[0];
+    const std::string &Acyclops = cyclops_inds[1];
 
-    scale(beta);
-    (*cyclops_)[Ccyclops.c_str()] += alpha * (*tA)[Acyclops.c_str()];
+    // One summation with beta, so C is mapped (and redistributed) once
+    cyclops_->sum(alpha, *tA, Acyclops.c_str(), beta, Ccyclops.c_str());
 }
 
 void CyclopsTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
@@ -393,14 +411,15 @@ void CyclopsTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
     GET_CTF_TENSOR(B);
 
     std::vector<std::string> cyclops_inds =
-        generateCyclopsLabels({Cinds, Ainds, Binds});
-    std::string Ccyclops = cyclops_inds[0];
-    std::string Acyclops = cyclops_inds[1];
-    std::string Bcyclops = cyclops_inds[2];
-
-    scale(beta);
-    (*cyclops_)[Ccyclops.c_str()] +=
-        alpha * (*tA)[Acyclops.c_str()] * (*tB)[Bcyclops.c_str()];
+        cyclopsLabels({Cinds, Ainds, Binds});
+    const std::string &Ccyclops = cyclops_inds[0];
+    const std::string &Acyclops = cyclops_inds[1];
+    const std::string &Bcyclops = cyclops_inds[2];
+
+    // One contraction with beta instead of a scale pass followed by an
+    // accumulation, so C is mapped (and redistributed) once
+    cyclops_->contract(alpha, *tA, Acyclops.c_str(), *tB, Bcyclops.c_str(),
+                       beta, Ccyclops.c_str());
 }
 
 std::map<std::string, TensorImplPtr>
@@ -509,7 +528,19 @@ TensorImplPtr CyclopsTensorImpl::power(double alpha, double condition) const
 void CyclopsTensorImpl::iterate(
     const std::function<void(const std::vector<size_t> &, double &)> &func)
 {
-    std::vector<size_t> indices(rank(), 0);
+    iterate_local(func, false);
+}
+
+void CyclopsTensorImpl::parallel_iterate(
+    const std::function<void(const std::vector<size_t> &, double &)> &func)
+{
+    iterate_local(func, true);
+}
+
+void CyclopsTensorImpl::iterate_local(
+    const std::function<void(const std::vector<size_t> &, double &)> &func,
+    bool threaded)
+{
     std::vector<size_t> addressing(rank(), 1);
 
     // form addressing array
@@ -523,22 +554,59 @@ void CyclopsTensorImpl::iterate(
     kv_pair *pairs;
 
     cyclops_->read_local(&nelem, &pairs);
-    for (size_t n = 0; n < nelem; ++n)
+
+    // Every process only visits the elements it owns, so the threads of a
+    // process share them without communication
+    std::vector<char> changed(nelem, 0);
+    std::exception_ptr error;
+#pragma omp parallel if (threaded)
     {
-        size_t d = pairs[n].k;
-        for (int k = nrank - 1; k >= 0; --k)
+        std::vector<size_t> indices(nrank, 0);
+#pragma omp for schedule(static)
+        for (long_int n = 0; n < nelem; ++n)
         {
-            indices[k] = d / addressing[k];
-            d = d % addressing[k];
+            try
+            {
+                size_t d = pairs[n].k;
+                for (int k = nrank - 1; k >= 0; --k)
+                {
+                    indices[k] = d / addressing[k];
+                    d = d % addressing[k];
+                }
+
+                double value = pairs[n].d;
+                func(indices, value);
+                if (value != pairs[n].d)
+                {
+                    pairs[n].d = value;
+                    changed[n] = 1;
+                }
+            }
+            catch (...)
+            {
+#pragma omp critical(ambit_cyclops_iterate_error)
+                if (!error)
+                    error = std::current_exception();
+            }
         }
-
-        func(indices, pairs[n].d);
     }
 
-    // the user may have modified the data, must write to the tensor
-    cyclops_->write(nelem, pairs);
+    // Only the changed elements are written back, and the (collective)
+    // write is skipped altogether when no process changed any
+    long_int nchanged = 0;
+    for (long_int n = 0; n < nelem; ++n)
+        if (changed[n])
+            pairs[nchanged++] = pairs[n];
+    int local_write = (nchanged > 0 && !error) ? 1 : 0;
+    int any_write = 0;
+    MPI_Allreduce(&local_write, &any_write, 1, MPI_INT, MPI_MAX,
+                  globals::communicator);
+    if (any_write)
+        cyclops_->write(local_write ? nchanged : 0, pairs);
 
     free(pairs);
+    if (error)
+        std::rethrow_exception(error);
 }
 
 void CyclopsTensorImpl::citerate(
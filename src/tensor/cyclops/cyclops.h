@@ -84,10 +84,17 @@ class CyclopsTensorImpl : public TensorImpl
 
     void iterate(
         const std::function<void(const std::vector<size_t> &, double &)> &func);
+    void parallel_iterate(
+        const std::function<void(const std::vector<size_t> &, double &)> &func);
     void citerate(const std::function<void(const std::vector<size_t> &,
                                            const double &)> &func) const;
 
   private:
+    /// Applies func to the local elements and writes back the changed ones
+    void iterate_local(
+        const std::function<void(const std::vector<size_t> &, double &)> &func,
+        bool threaded);
+
 #if defined(HAVE_ELEMENTAL)
     // => Order-2 Helper Functions <=
     void copyToElemental2(El::DistMatrix<double> &x) const;
@@ -0,0 +1,137 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#include "codec.h"
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(HAVE_ZLIB)
+#include <zlib.h>
+#endif
+
+namespace ambit
+{
+namespace codec
+{
+
+namespace
+{
+
+/// How a run is stored, in the first double of the run with its byte count
+enum Method : uint64_t
+{
+    Stored = 0,
+    Deflated = 1
+};
+
+/// The first double holds the method in the top byte, the payload bytes in
+/// the others
+double header(Method method, uint64_t bytes)
+{
+    uint64_t word = (static_cast<uint64_t>(method) << 56) | bytes;
+    double result;
+    std::memcpy(&result, &word, sizeof(double));
+    return result;
+}
+
+void read_header(const double *in, Method &method, uint64_t &bytes)
+{
+    uint64_t word;
+    std::memcpy(&word, in, sizeof(double));
+    method = static_cast<Method>(word >> 56);
+    bytes = word & ((static_cast<uint64_t>(1) << 56) - 1);
+}
+
+void store(const double *data, size_t count, std::vector<double> &out)
+{
+    out.resize(1 + count);
+    out[0] = header(Stored, count * sizeof(double));
+    std::memcpy(out.data() + 1, data, count * sizeof(double));
+}
+}
+
+void compress(const double *data, size_t count, std::vector<double> &out)
+{
+#if defined(HAVE_ZLIB)
+    size_t bytes = count * sizeof(double);
+    std::vector<unsigned char> shuffled(bytes);
+    const unsigned char *raw = reinterpret_cast<const unsigned char *>(data);
+    for (size_t plane = 0; plane < sizeof(double); ++plane)
+        for (size_t n = 0; n < count; ++n)
+            shuffled[plane * count + n] = raw[n * sizeof(double) + plane];
+
+    uLongf size = compressBound(bytes);
+    out.resize(1 + (size + sizeof(double) - 1) / sizeof(double));
+    if (compress2(reinterpret_cast<Bytef *>(out.data() + 1), &size,
+                  shuffled.data(), bytes, Z_BEST_SPEED) == Z_OK &&
+        size < bytes)
+    {
+        out.resize(1 + (size + sizeof(double) - 1) / sizeof(double));
+        out[0] = header(Deflated, size);
+        return;
+    }
+#endif
+    store(data, count, out);
+}
+
+void decompress(const double *in, double *data, size_t count)
+{
+    Method method;
+    uint64_t bytes;
+    read_header(in, method, bytes);
+
+    if (method == Stored)
+    {
+        if (bytes != count * sizeof(double))
+            throw std::runtime_error("codec::decompress: Corrupt run");
+        std::memcpy(data, in + 1, bytes);
+        return;
+    }
+#if defined(HAVE_ZLIB)
+    if (method == Deflated)
+    {
+        std::vector<unsigned char> shuffled(count * sizeof(double));
+        uLongf size = shuffled.size();
+        if (uncompress(shuffled.data(), &size,
+                       reinterpret_cast<const Bytef *>(in + 1),
+                       bytes) != Z_OK ||
+            size != shuffled.size())
+            throw std::runtime_error("codec::decompress: Corrupt run");
+        unsigned char *raw = reinterpret_cast<unsigned char *>(data);
+        for (size_t plane = 0; plane < sizeof(double); ++plane)
+            for (size_t n = 0; n < count; ++n)
+                raw[n * sizeof(double) + plane] = shuffled[plane * count + n];
+        return;
+    }
+#endif
+    throw std::runtime_error("codec::decompress: Unknown method");
+}
+}
+}
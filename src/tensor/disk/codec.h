@@ -0,0 +1,64 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#if !defined(TENSOR_CODEC_H)
+#define TENSOR_CODEC_H
+
+#include <cstddef>
+#include <vector>
+
+namespace ambit
+{
+
+/**
+ * Lossless compression of runs of doubles for disk tensors and spilled
+ * tensors (see settings::disk_compression).
+ *
+ * The bytes of the doubles are shuffled into eight planes (all first bytes,
+ * then all second bytes, ...), which gathers the sign and exponent bytes of
+ * similar values and the zero bytes of small ones, and the planes are then
+ * deflated at the fastest level. Runs that do not shrink, or every run when
+ * ambit is built without zlib, are stored as they are.
+ *
+ * Compressed runs are padded to whole doubles so they can be stored with
+ * the positioned I/O of disk_io.
+ */
+namespace codec
+{
+
+/// Compresses count doubles into out, resized to the doubles it takes
+void compress(const double *data, size_t count, std::vector<double> &out);
+
+/// Expands a run made by compress into count doubles
+void decompress(const double *in, double *data, size_t count);
+}
+}
+
+#endif
@@ -28,9 +28,20 @@
  */
 
 #include "disk.h"
+#include "codec.h"
+#include "disk_io.h"
+#include "tile_cache.h"
 #include "memory.h"
 #include "math/math.h"
+#include "tensor/core/core.h"
 #include "tensor/indices.h"
+#include "tensor/slice.h"
+#include <algorithm>
+#include <ambit/settings.h>
+#include <ambit/timer.h>
+#include <atomic>
+#include <future>
+#include <map>
 #include <sstream>
 #include <string.h>
 #include <cmath>
@@ -41,77 +52,717 @@
 namespace ambit
 {
 
-static size_t disk_next_id__ = 0L;
+static std::atomic<size_t> disk_next_id__(0L);
 size_t disk_next_id() { return disk_next_id__++; }
 
+/// No extent cached or read ahead
+static constexpr size_t not_cached__ = static_cast<size_t>(-1);
+
 DiskTensorImpl::DiskTensorImpl(const string &name, const Dimension &dims)
-    : TensorImpl(DiskTensor, name, dims)
+    : TensorImpl(DiskTensor, name, dims), map_(nullptr),
+      compressed_(settings::disk_compression), end_(0L),
+      cache_extent_(not_cached__), cache_dirty_(false),
+      prefetch_extent_(not_cached__)
 {
     stringstream ss;
     ss << Tensor::scratch_path();
     ss << "/";
     ss << "DiskTensor.";
+    // The processes of different nodes may share a pid on a parallel
+    // filesystem
+    if (settings::nprocess > 1)
+        ss << settings::rank << ".";
     ss << getpid();
     ss << ".";
     ss << disk_next_id();
     ss << ".dat";
 
     filename_ = ss.str();
-    fh_ = fopen(filename_.c_str(), "wb+");
-    scale(0.0); // Prestripe
+    fd_ = disk_io::open(filename_);
+    // Sparse prestripe, nothing is written until the data is. Compressed
+    // extents are appended as they are written.
+    if (!compressed_)
+        disk_io::resize(fd_, numel());
+    touched_.assign((numel() + disk_io::extent_size__ - 1L) /
+                        disk_io::extent_size__,
+                    0);
+    if (compressed_)
+        records_.resize(touched_.size());
 }
 DiskTensorImpl::~DiskTensorImpl()
 {
-    fclose(fh_);
+    if (compressed_)
+        cancel_prefetch();
+    else
+    {
+        unmap_data();
+        tile_cache::drop(this, false);
+    }
+    disk_io::close(fd_);
     remove(filename_.c_str());
 }
-void DiskTensorImpl::scale(double beta)
+double *DiskTensorImpl::map_data()
+{
+    return const_cast<double *>(
+        const_cast<const DiskTensorImpl *>(this)->map_data());
+}
+const double *DiskTensorImpl::map_data() const
 {
-    size_t fast_size = 1L;
-    for (int ind = ((int)rank()) - 1; ind >= 0; ind--)
+    if (compressed_)
     {
-        if (fast_size * dims()[ind] <= disk_buffer__)
+        // A compressed file cannot be mapped, so the whole tensor is
+        // decompressed until unmap_data() compresses it back
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (mapped_.empty() && numel() > 0L)
         {
-            fast_size *= dims()[ind];
+            mapped_.assign(numel(), 0.0);
+            for (size_t extent = 0L; extent < touched_.size(); extent++)
+            {
+                if (touched_[extent])
+                    std::copy_n(load(extent), extent_length(extent),
+                                mapped_.data() +
+                                    extent * disk_io::extent_size__);
+            }
+            flush();
+            cancel_prefetch();
+            cache_extent_ = not_cached__;
         }
+        std::fill(touched_.begin(), touched_.end(), 1);
+        return mapped_.data();
+    }
+    // The mapping shows the file, so the cached tiles are written back and
+    // forgotten
+    tile_cache::drop(this, true);
+    if (map_ == nullptr && numel() > 0L)
+        map_ = disk_io::map(fd_, numel());
+    // Writes through the mapping cannot be tracked
+    std::fill(touched_.begin(), touched_.end(), 1);
+    return map_;
+}
+void DiskTensorImpl::unmap_data() const
+{
+    if (compressed_)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (mapped_.empty())
+            return;
+        // The extents are compressed in parallel and stored in order
+        vector<vector<double>> packed(touched_.size());
+#pragma omp parallel for schedule(dynamic)
+        for (size_t extent = 0L; extent < touched_.size(); extent++)
+            codec::compress(mapped_.data() + extent * disk_io::extent_size__,
+                            extent_length(extent), packed[extent]);
+        for (size_t extent = 0L; extent < touched_.size(); extent++)
+        {
+            Record &record = records_[extent];
+            if (packed[extent].size() > record.capacity)
+            {
+                record.offset = end_;
+                record.capacity = packed[extent].size();
+                end_ += record.capacity;
+            }
+            record.size = packed[extent].size();
+            disk_io::write(fd_, packed[extent].data(), record.size,
+                           record.offset);
+        }
+        vector<double>().swap(mapped_);
+        return;
+    }
+    if (map_ != nullptr)
+    {
+        tile_cache::drop(this, true);
+        disk_io::unmap(map_, numel());
+    }
+    map_ = nullptr;
+}
+size_t DiskTensorImpl::extent_length(size_t extent) const
+{
+    return std::min(disk_io::extent_size__,
+                    numel() - extent * disk_io::extent_size__);
+}
+void DiskTensorImpl::read(double *buffer, size_t count, size_t offset) const
+{
+    if (!compressed_)
+    {
+        if (is_zero(offset, count))
+            memset(buffer, '\0', sizeof(double) * count);
+        else if (tile_cache::enabled())
+            tile_cache::read(this, buffer, count, offset);
         else
+            disk_io::read(fd_, buffer, count, offset);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!mapped_.empty())
+    {
+        std::copy_n(mapped_.data() + offset, count, buffer);
+        return;
+    }
+    while (count > 0L)
+    {
+        size_t extent = offset / disk_io::extent_size__;
+        size_t first = offset - extent * disk_io::extent_size__;
+        size_t n = std::min(count, extent_length(extent) - first);
+        if (touched_[extent])
+            std::copy_n(load(extent) + first, n, buffer);
+        else
+            std::fill_n(buffer, n, 0.0);
+        buffer += n;
+        offset += n;
+        count -= n;
+    }
+}
+void DiskTensorImpl::write(const double *buffer, size_t count, size_t offset)
+{
+    if (!compressed_)
+    {
+        if (tile_cache::enabled())
         {
-            break;
+            tile_cache::write(this, buffer, count, offset);
+            return;
         }
+        touch(offset, count);
+        disk_io::write(fd_, buffer, count, offset);
+        return;
     }
 
-    size_t slow_size = numel() / fast_size;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!mapped_.empty())
+    {
+        std::copy_n(buffer, count, mapped_.data() + offset);
+        return;
+    }
+    while (count > 0L)
+    {
+        size_t extent = offset / disk_io::extent_size__;
+        size_t first = offset - extent * disk_io::extent_size__;
+        size_t n = std::min(count, extent_length(extent) - first);
+        double *values;
+        if (touched_[extent] && n < extent_length(extent))
+        {
+            values = load(extent);
+        }
+        else
+        {
+            // Nothing of the extent needs reading back
+            if (cache_extent_ != extent)
+            {
+                flush();
+                cache_.assign(extent_length(extent), 0.0);
+                cache_extent_ = extent;
+            }
+            values = cache_.data();
+        }
+        std::copy_n(buffer, n, values + first);
+        cache_dirty_ = true;
+        touched_[extent] = 1;
+        buffer += n;
+        offset += n;
+        count -= n;
+    }
+}
+double *DiskTensorImpl::load(size_t extent) const
+{
+    if (cache_extent_ == extent)
+        return cache_.data();
+    flush();
 
-    double *buffer = new double[fast_size];
-    memset(buffer, '\0', sizeof(double) * fast_size);
+    vector<double> packed;
+    if (prefetch_extent_ == extent)
+    {
+        packed = prefetch_.get();
+        prefetch_extent_ = not_cached__;
+    }
+    else
+    {
+        const Record &record = records_[extent];
+        packed.resize(record.size);
+        disk_io::read(fd_, packed.data(), record.size, record.offset);
+    }
 
-    if (beta == 0.0)
+    // The next extent is read on a helper thread while this one is
+    // decompressed
+    size_t next = extent + 1L;
+    if (next < records_.size() && touched_[next] && records_[next].size > 0L)
+    {
+        cancel_prefetch();
+        Record record = records_[next];
+        int fd = fd_;
+        prefetch_ = std::async(std::launch::async, [fd, record]() {
+            vector<double> bytes(record.size);
+            disk_io::read(fd, bytes.data(), record.size, record.offset);
+            return bytes;
+        });
+        prefetch_extent_ = next;
+    }
+
+    cache_.resize(extent_length(extent));
+    codec::decompress(packed.data(), cache_.data(), cache_.size());
+    cache_extent_ = extent;
+    cache_dirty_ = false;
+    return cache_.data();
+}
+void DiskTensorImpl::flush() const
+{
+    if (cache_extent_ == not_cached__ || !cache_dirty_)
+        return;
+
+    vector<double> packed;
+    codec::compress(cache_.data(), cache_.size(), packed);
+    Record &record = records_[cache_extent_];
+    // A read ahead of the old contents would now be stale
+    if (prefetch_extent_ == cache_extent_)
+        cancel_prefetch();
+    if (packed.size() > record.capacity)
+    {
+        record.offset = end_;
+        record.capacity = packed.size();
+        end_ += record.capacity;
+    }
+    record.size = packed.size();
+    disk_io::write(fd_, packed.data(), record.size, record.offset);
+    cache_dirty_ = false;
+}
+void DiskTensorImpl::cancel_prefetch() const
+{
+    if (prefetch_.valid())
+        prefetch_.wait();
+    prefetch_ = std::future<vector<double>>();
+    prefetch_extent_ = not_cached__;
+}
+bool DiskTensorImpl::is_zero(size_t offset, size_t count) const
+{
+    if (count == 0L)
+        return true;
+    size_t first = offset / disk_io::extent_size__;
+    size_t last = (offset + count - 1L) / disk_io::extent_size__;
+    for (size_t extent = first; extent <= last; extent++)
+    {
+        if (touched_[extent])
+            return false;
+    }
+    return true;
+}
+void DiskTensorImpl::touch(size_t offset, size_t count)
+{
+    if (count == 0L)
+        return;
+    size_t first = offset / disk_io::extent_size__;
+    size_t last = (offset + count - 1L) / disk_io::extent_size__;
+    for (size_t extent = first; extent <= last; extent++)
+        touched_[extent] = 1;
+}
+double DiskTensorImpl::norm(int type) const
+{
+    if (type < 0 || type > 2)
+        throw std::runtime_error(
+            "Norm must be 0 (infty-norm), 1 (1-norm), or 2 (2-norm)");
+
+    // The file is read a batch at a time, skipping the extents never written
+    vector<double> buffer(std::min(numel(), disk_io::batch_size__));
+    double val = 0.0;
+    for (size_t offset = 0L; offset < numel(); offset += buffer.size())
     {
-        fseek(fh_, 0L, SEEK_SET);
-        for (size_t ind = 0L; ind < slow_size; ind++)
+        size_t count = std::min(buffer.size(), numel() - offset);
+        if (is_zero(offset, count))
+            continue;
+        read(buffer.data(), count, offset);
+        for (size_t n = 0L; n < count; n++)
         {
-            fwrite(buffer, sizeof(double), fast_size, fh_);
+            double x = std::fabs(buffer[n]);
+            if (type == 0)
+                val = std::max(val, x);
+            else
+                val += type == 1 ? x : x * x;
         }
-        fseek(fh_, 0L, SEEK_SET);
     }
-    else
+    return type == 2 ? std::sqrt(val) : val;
+}
+
+void DiskTensorImpl::scale(double beta)
+{
+    if (numel() == 0L)
+        return;
+
+    if (compressed_)
     {
-        fseek(fh_, 0L, SEEK_SET);
-        for (size_t ind = 0L; ind < slow_size; ind++)
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!mapped_.empty())
         {
-            fread(buffer, sizeof(double), fast_size, fh_);
-            fseek(fh_, sizeof(double) * ind * fast_size, SEEK_SET);
-            C_DSCAL(fast_size, beta, buffer, 1);
-            fwrite(buffer, sizeof(double), fast_size, fh_);
-            fseek(fh_, sizeof(double) * ind * fast_size, SEEK_SET);
+            C_DSCAL(numel(), beta, mapped_.data(), 1);
+            return;
         }
+        if (beta == 0.0)
+        {
+            // Every extent goes back to an implicit zero
+            cancel_prefetch();
+            cache_extent_ = not_cached__;
+            cache_dirty_ = false;
+            records_.assign(records_.size(), Record());
+            end_ = 0L;
+            disk_io::resize(fd_, 0L);
+            std::fill(touched_.begin(), touched_.end(), 0);
+            return;
+        }
+        for (size_t extent = 0L; extent < touched_.size(); extent++)
+        {
+            if (!touched_[extent])
+                continue;
+            C_DSCAL(extent_length(extent), beta, load(extent), 1);
+            cache_dirty_ = true;
+        }
+        flush();
+        return;
+    }
+
+    // The file is scaled in place, so the cached tiles are written back (or
+    // dropped, when they go to zero) and forgotten
+    tile_cache::drop(this, beta != 0.0);
+    if (beta == 0.0)
+    {
+        // The file goes back to being sparse
+        disk_io::discard(fd_, numel());
+        std::fill(touched_.begin(), touched_.end(), 0);
+        return;
     }
 
-    delete[] buffer;
+    // Batches of written extents are read, scaled, and written back together
+    vector<double> buffer(std::min(numel(), disk_io::batch_size__));
+    vector<size_t> extents;
+    disk_io::Queue queue;
+    for (size_t start = 0L; start < touched_.size();)
+    {
+        extents.clear();
+        size_t size = 0L;
+        for (; start < touched_.size() && size < buffer.size(); start++)
+        {
+            if (!touched_[start])
+                continue;
+            extents.push_back(start);
+            size_t offset = start * disk_io::extent_size__;
+            size_t count =
+                std::min(disk_io::extent_size__, numel() - offset);
+            queue.read(fd_, buffer.data() + size, count, offset);
+            size += count;
+        }
+        queue.flush();
+        C_DSCAL(size, beta, buffer.data(), 1);
+        size = 0L;
+        for (size_t extent : extents)
+        {
+            size_t offset = extent * disk_io::extent_size__;
+            size_t count =
+                std::min(disk_io::extent_size__, numel() - offset);
+            queue.write(fd_, buffer.data() + size, count, offset);
+            size += count;
+        }
+        queue.flush();
+    }
 }
 void DiskTensorImpl::permute(ConstTensorImplPtr A, const Indices &CindsS,
                              const Indices &AindsS, double alpha, double beta)
 {
-    // TODO
+    out_of_core_permute(this, A, CindsS, AindsS, alpha, beta);
+}
+void DiskTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
+                              const Indices &Cinds, const Indices &Ainds,
+                              const Indices &Binds, double alpha, double beta)
+{
+    out_of_core_contract(this, A, B, Cinds, Ainds, Binds, alpha, beta);
+}
+void DiskTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
+                              const Indices &Cinds, const Indices &Ainds,
+                              const Indices &Binds,
+                              std::shared_ptr<TensorImpl> & /*A2*/,
+                              std::shared_ptr<TensorImpl> & /*B2*/,
+                              std::shared_ptr<TensorImpl> & /*C2*/,
+                              double alpha, double beta)
+{
+    out_of_core_contract(this, A, B, Cinds, Ainds, Binds, alpha, beta);
+}
+
+namespace
+{
+
+/// Number of doubles in a single in-core tile. A, B, and C tiles plus the
+/// prefetched A and B tiles must fit in settings::memory_limit.
+size_t tile_size()
+{
+    size_t size = settings::memory_limit / sizeof(double) / 6L;
+    return std::max<size_t>(1L, std::min(size, disk_buffer__));
+}
+
+/**
+ * Splits a tensor into boxes of at most max_size elements (as long as a
+ * single row of the last index fits). Leading indices take single values,
+ * one index is chunked, and the trailing indices are kept whole, so each box
+ * is a run of contiguous stripes on disk.
+ */
+vector<IndexRange> tile_boxes(const Dimension &dims, size_t max_size)
+{
+    vector<IndexRange> boxes;
+    int rank = dims.size();
+    if (rank == 0)
+    {
+        boxes.push_back(IndexRange());
+        return boxes;
+    }
+    for (size_t dim : dims)
+    {
+        if (dim == 0L)
+            return boxes;
+    }
+
+    int split = rank - 1;
+    size_t trailing = 1L;
+    while (split > 0 && trailing * dims[split] <= max_size)
+    {
+        trailing *= dims[split];
+        split--;
+    }
+    size_t chunk =
+        std::max<size_t>(1L, std::min(dims[split], max_size / trailing));
+
+    size_t outer_size = 1L;
+    for (int dim = 0; dim < split; dim++)
+        outer_size *= dims[dim];
+
+    for (size_t outer = 0L; outer < outer_size; outer++)
+    {
+        IndexRange box(rank);
+        size_t num = outer;
+        for (int dim = split - 1; dim >= 0; dim--)
+        {
+            size_t val = num % dims[dim];
+            num /= dims[dim];
+            box[dim] = {val, val + 1};
+        }
+        for (int dim = split + 1; dim < rank; dim++)
+            box[dim] = {0L, dims[dim]};
+        for (size_t start = 0L; start < dims[split]; start += chunk)
+        {
+            box[split] = {start, std::min(start + chunk, dims[split])};
+            boxes.push_back(box);
+        }
+    }
+    return boxes;
+}
+
+Dimension box_dims(const IndexRange &box)
+{
+    Dimension dims;
+    for (const vector<size_t> &range : box)
+        dims.push_back(range[1] - range[0]);
+    return dims;
+}
+
+IndexRange full_box(const Dimension &dims)
+{
+    IndexRange box;
+    for (size_t dim : dims)
+        box.push_back({0L, dim});
+    return box;
+}
+
+/// Reads a box of T into a new core tensor
+shared_ptr<CoreTensorImpl> read_box(ConstTensorImplPtr T, const IndexRange &box)
+{
+    Dimension dims = box_dims(box);
+    shared_ptr<CoreTensorImpl> tile =
+        std::make_shared<CoreTensorImpl>(T->name() + " tile", dims);
+    slice(tile.get(), T, full_box(dims), box, 1.0, 0.0);
+    return tile;
+}
+
+/// Writes a core tensor to a box of T
+void write_box(TensorImplPtr T, const CoreTensorImpl *tile,
+               const IndexRange &box)
+{
+    slice(T, tile, box, full_box(tile->dims()), 1.0, 0.0);
+}
+
+/// The box of a tensor labeled by inds for the index ranges in ranges;
+/// indices missing from ranges span their full dimension
+IndexRange labeled_box(ConstTensorImplPtr T, const Indices &inds,
+                       const map<string, vector<size_t>> &ranges)
+{
+    IndexRange box;
+    for (size_t dim = 0; dim < inds.size(); dim++)
+    {
+        auto it = ranges.find(inds[dim]);
+        if (it != ranges.end())
+            box.push_back(it->second);
+        else
+            box.push_back({0L, T->dims()[dim]});
+    }
+    return box;
+}
+
+size_t box_numel(const IndexRange &box)
+{
+    size_t numel = 1L;
+    for (const vector<size_t> &range : box)
+        numel *= range[1] - range[0];
+    return numel;
+}
+}
+
+void out_of_core_permute(TensorImplPtr C, ConstTensorImplPtr A,
+                         const Indices &Cinds, const Indices &Ainds,
+                         double alpha, double beta)
+{
+    AMBIT_TIMER_PUSH("out-of-core permute");
+
+    if (C->rank() != A->rank() || Cinds.size() != C->rank() ||
+        Ainds.size() != A->rank())
+        throw std::runtime_error("Permuted tensors do not have same rank");
+    vector<size_t> perm = indices::permutation_order(Cinds, Ainds);
+    for (size_t dim = 0; dim < C->rank(); dim++)
+    {
+        if (C->dims()[dim] != A->dims()[perm[dim]])
+            throw std::runtime_error(
+                "Permuted tensors do not have same dimensions");
+    }
+
+    vector<IndexRange> boxes = tile_boxes(C->dims(), tile_size());
+    auto A_box = [&](const IndexRange &Cbox) {
+        IndexRange Abox(Cbox.size());
+        for (size_t dim = 0; dim < Cbox.size(); dim++)
+            Abox[perm[dim]] = Cbox[dim];
+        return Abox;
+    };
+
+    // Double buffering: the next box of A is read while this one is permuted
+    std::future<shared_ptr<CoreTensorImpl>> next;
+    if (!boxes.empty())
+        next = std::async(std::launch::async, read_box, A, A_box(boxes[0]));
+    for (size_t n = 0; n < boxes.size(); n++)
+    {
+        shared_ptr<CoreTensorImpl> Atile = next.get();
+        if (n + 1 < boxes.size())
+            next = std::async(std::launch::async, read_box, A,
+                              A_box(boxes[n + 1]));
+
+        shared_ptr<CoreTensorImpl> Ctile =
+            (beta != 0.0) ? read_box(C, boxes[n])
+                          : std::make_shared<CoreTensorImpl>(
+                                C->name() + " tile", box_dims(boxes[n]));
+        Ctile->permute(Atile.get(), Cinds, Ainds, alpha, beta);
+        write_box(C, Ctile.get(), boxes[n]);
+    }
+
+    AMBIT_TIMER_POP();
+}
+
+void out_of_core_contract(TensorImplPtr C, ConstTensorImplPtr A,
+                          ConstTensorImplPtr B, const Indices &Cinds,
+                          const Indices &Ainds, const Indices &Binds,
+                          double alpha, double beta)
+{
+    AMBIT_TIMER_PUSH("out-of-core contract");
+
+    if (Cinds.size() != C->rank() || Ainds.size() != A->rank() ||
+        Binds.size() != B->rank())
+        throw std::runtime_error(
+            "Contracted tensors do not match their number of indices");
+
+    // The contracted index that is split when the A and B boxes are too big
+    string split_index;
+    size_t split_dim = 0L;
+    for (size_t dim = 0; dim < Ainds.size(); dim++)
+    {
+        const string &index = Ainds[dim];
+        if (std::find(Cinds.begin(), Cinds.end(), index) == Cinds.end() &&
+            A->dims()[dim] > split_dim)
+        {
+            split_index = index;
+            split_dim = A->dims()[dim];
+        }
+    }
+
+    // => Work Plan <= //
+
+    struct Task
+    {
+        size_t box;
+        IndexRange Abox;
+        IndexRange Bbox;
+        bool first;
+        bool last;
+    };
+    size_t max_size = tile_size();
+    vector<IndexRange> boxes = tile_boxes(C->dims(), max_size);
+    vector<Task> tasks;
+    for (size_t n = 0; n < boxes.size(); n++)
+    {
+        map<string, vector<size_t>> ranges;
+        for (size_t dim = 0; dim < Cinds.size(); dim++)
+            ranges[Cinds[dim]] = boxes[n][dim];
+
+        size_t nsplit = 1L;
+        if (!split_index.empty())
+        {
+            size_t size =
+                std::max(box_numel(labeled_box(A, Ainds, ranges)),
+                         box_numel(labeled_box(B, Binds, ranges)));
+            nsplit = std::min(split_dim, (size + max_size - 1L) / max_size);
+            nsplit = std::max<size_t>(1L, nsplit);
+        }
+        size_t chunk = (split_dim + nsplit - 1L) / nsplit;
+        for (size_t start = 0L; start < std::max<size_t>(1L, split_dim);
+             start += std::max<size_t>(1L, chunk))
+        {
+            if (nsplit > 1L)
+                ranges[split_index] = {start,
+                                       std::min(start + chunk, split_dim)};
+            Task task;
+            task.box = n;
+            task.Abox = labeled_box(A, Ainds, ranges);
+            task.Bbox = labeled_box(B, Binds, ranges);
+            task.first = (start == 0L);
+            task.last = (nsplit == 1L) || (start + chunk >= split_dim);
+            tasks.push_back(task);
+            if (nsplit == 1L)
+                break;
+        }
+    }
+
+    // => Tiled Contraction <= //
+
+    typedef pair<shared_ptr<CoreTensorImpl>, shared_ptr<CoreTensorImpl>>
+        TilePair;
+    auto read_tiles = [A, B](const IndexRange &Abox, const IndexRange &Bbox) {
+        return TilePair(read_box(A, Abox), read_box(B, Bbox));
+    };
+
+    // Double buffering: the next A and B boxes are read during each GEMM
+    std::future<TilePair> next;
+    if (!tasks.empty())
+        next = std::async(std::launch::async, read_tiles, tasks[0].Abox,
+                          tasks[0].Bbox);
+    shared_ptr<CoreTensorImpl> Ctile;
+    for (size_t n = 0; n < tasks.size(); n++)
+    {
+        const Task &task = tasks[n];
+        TilePair tiles = next.get();
+        if (n + 1 < tasks.size())
+            next = std::async(std::launch::async, read_tiles,
+                              tasks[n + 1].Abox, tasks[n + 1].Bbox);
+
+        if (task.first)
+        {
+            Ctile = (beta != 0.0)
+                        ? read_box(C, boxes[task.box])
+                        : std::make_shared<CoreTensorImpl>(
+                              C->name() + " tile", box_dims(boxes[task.box]));
+        }
+        Ctile->contract(tiles.first.get(), tiles.second.get(), Cinds, Ainds,
+                        Binds, alpha, task.first ? beta : 1.0);
+        if (task.last)
+            write_box(C, Ctile.get(), boxes[task.box]);
+    }
+
+    AMBIT_TIMER_POP();
 }
 }
@@ -31,6 +31,8 @@
 #define TENSOR_DISK_H
 
 #include "tensor/tensorimpl.h"
+#include <future>
+#include <mutex>
 
 namespace ambit
 {
@@ -38,28 +40,139 @@ namespace ambit
 /// 1 GiB in doubles
 static constexpr size_t disk_buffer__ = 125000000L;
 
+/// Unique number for the names of scratch files
+size_t disk_next_id();
+
 class DiskTensorImpl : public TensorImpl
 {
   public:
     DiskTensorImpl(const std::string &name, const Dimension &dims);
     ~DiskTensorImpl();
 
+    double norm(int type = 2) const;
+
     void scale(double beta = 0.0);
 
     void permute(ConstTensorImplPtr A, const std::vector<std::string> &Cinds,
                  const std::vector<std::string> &Ainds, double alpha = 1.0,
                  double beta = 0.0);
 
+    void contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
+                  const Indices &Cinds, const Indices &Ainds,
+                  const Indices &Binds, double alpha = 1.0, double beta = 0.0);
+
+    // The intermediates are managed tile by tile, so A2, B2, and C2 are not
+    // used.
+    void contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
+                  const Indices &Cinds, const Indices &Ainds,
+                  const Indices &Binds, std::shared_ptr<TensorImpl> &A2,
+                  std::shared_ptr<TensorImpl> &B2,
+                  std::shared_ptr<TensorImpl> &C2, double alpha = 1.0,
+                  double beta = 0.0);
+
+    /// Maps the file into memory, see Tensor::map_data()
+    double *map_data();
+    const double *map_data() const;
+    void unmap_data() const;
+
+    /**
+     * The file starts out sparse and is filled in extents of
+     * disk_io::extent_size__ doubles as they are written. Extents that were
+     * never written are implicit zeros, so they need not be read.
+     */
+    bool is_zero(size_t offset, size_t count) const;
+    /// Marks the extents overlapping [offset, offset + count) as written
+    void touch(size_t offset, size_t count);
+
     std::string filename() const { return filename_; }
-    FILE *fh() const { return fh_; }
+    /// File descriptor for positioned I/O (see disk_io.h), only for a tensor
+    /// that is not compressed
+    int fd() const { return fd_; }
+
+    /**
+     * Whether the file holds each extent compressed (see codec.h), as
+     * settings::disk_compression asked when the tensor was built. Its
+     * elements are then only reached through read() and write(), which
+     * keep the last extent used decompressed and fetch the compressed
+     * next extent on a helper thread while the current one is decompressed.
+     */
+    bool compressed() const { return compressed_; }
+
+    /// Reads count doubles at offset
+    void read(double *buffer, size_t count, size_t offset) const;
+    /// Writes count doubles at offset
+    void write(const double *buffer, size_t count, size_t offset);
 
   private:
+    /// Where a compressed extent is stored, in doubles
+    struct Record
+    {
+        size_t offset = 0L;
+        size_t size = 0L;
+        size_t capacity = 0L;
+    };
+
+    /// Makes extent the cached one, @return the cache
+    double *load(size_t extent) const;
+    /// Compresses the cached extent back to the file if it was written
+    void flush() const;
+    /// Waits for and forgets the read ahead, if any
+    void cancel_prefetch() const;
+    /// Number of elements in extent
+    size_t extent_length(size_t extent) const;
+
     std::string filename_;
-    FILE *fh_;
+    int fd_;
+    /// Shared mapping of the file, or nullptr
+    mutable double *map_;
+    /// Whether each extent has been written
+    mutable std::vector<char> touched_;
+
+    bool compressed_;
+    /// Guards the members below
+    mutable std::mutex mutex_;
+    mutable std::vector<Record> records_;
+    /// End of the file, in doubles
+    mutable size_t end_;
+    /// The cached extent, decompressed; not_cached__ if none
+    mutable std::vector<double> cache_;
+    mutable size_t cache_extent_;
+    mutable bool cache_dirty_;
+    /// The compressed extent being read ahead, and the read
+    mutable size_t prefetch_extent_;
+    mutable std::future<std::vector<double>> prefetch_;
+    /// A decompressed copy of the whole tensor while mapped
+    mutable std::vector<double> mapped_;
 };
 
 typedef DiskTensorImpl *DiskTensorImplPtr;
 typedef const DiskTensorImpl *ConstDiskTensorImplPtr;
+
+// => Out-of-Core Engine <= //
+
+/** C = alpha * A + beta * C with permuted indices, for tensors that need
+ * not fit in memory.
+ *
+ * C is processed in tiles that fit in a fraction of settings::memory_limit.
+ * For each tile the matching box of A is read into core (the read of the
+ * next box overlaps with the current tile), permuted in core, and written
+ * back. C and A may be any mix of core and disk tensors.
+ */
+void out_of_core_permute(TensorImplPtr C, ConstTensorImplPtr A,
+                         const Indices &Cinds, const Indices &Ainds,
+                         double alpha = 1.0, double beta = 0.0);
+
+/** C = alpha * A * B + beta * C for tensors that need not fit in memory.
+ *
+ * C is processed in tiles as in out_of_core_permute. If the boxes of A and B
+ * feeding a tile are too large, the largest contracted index is split and
+ * the pieces are accumulated into the tile. Reads of the next boxes of A and
+ * B overlap with the core contraction of the current ones.
+ */
+void out_of_core_contract(TensorImplPtr C, ConstTensorImplPtr A,
+                          ConstTensorImplPtr B, const Indices &Cinds,
+                          const Indices &Ainds, const Indices &Binds,
+                          double alpha = 1.0, double beta = 0.0);
 }
 
 #endif
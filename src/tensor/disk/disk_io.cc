@@ -0,0 +1,304 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // fallocate
+#endif
+
+#include "disk_io.h"
+#include <algorithm>
+#include <ambit/timer.h>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fcntl.h>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+namespace ambit
+{
+namespace disk_io
+{
+
+namespace
+{
+
+void io_error(const char *call)
+{
+    throw std::runtime_error(std::string("DiskTensor: ") + call +
+                             " failed: " + strerror(errno));
+}
+
+/// Batches of fewer doubles than an extent are served on the calling thread
+const size_t inline_count = extent_size__;
+
+/**
+ * The threads that serve the lanes of Queue::flush other than the calling
+ * thread's. They start with the first large batch and then wait for work
+ * for the life of the process, so a flush does not start threads.
+ */
+class Lanes
+{
+  public:
+    static Lanes &get()
+    {
+        // Never destroyed: the threads may still wait for work at exit
+        static Lanes *lanes = new Lanes();
+        return *lanes;
+    }
+
+    void run(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(std::move(job));
+        }
+        ready_.notify_one();
+    }
+
+  private:
+    Lanes()
+    {
+        for (size_t lane = 1L; lane < queue_depth__; lane++)
+            std::thread([this]() { serve(); }).detach();
+    }
+
+    void serve()
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_.wait(lock, [this]() { return !jobs_.empty(); });
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::function<void()>> jobs_;
+};
+}
+
+int open(const std::string &filename)
+{
+    int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        io_error("open");
+#if defined(POSIX_FADV_SEQUENTIAL)
+    // Sweeps over disk tensors go stripe by stripe in file order
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return fd;
+}
+
+void close(int fd) { ::close(fd); }
+
+void resize(int fd, size_t count)
+{
+    if (::ftruncate(fd, sizeof(double) * count) != 0)
+        io_error("ftruncate");
+}
+
+void discard(int fd, size_t count)
+{
+#if defined(FALLOC_FL_PUNCH_HOLE)
+    if (::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0,
+                    sizeof(double) * count) == 0)
+        return;
+#endif
+    // Filesystems without hole punching drop the blocks by truncation
+    resize(fd, 0L);
+    resize(fd, count);
+}
+
+void read(int fd, double *buffer, size_t count, size_t offset)
+{
+    char *data = reinterpret_cast<char *>(buffer);
+    size_t left = sizeof(double) * count;
+    off_t position = sizeof(double) * offset;
+    while (left > 0L)
+    {
+        ssize_t done = ::pread(fd, data, left, position);
+        if (done < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            io_error("pread");
+        }
+        if (done == 0)
+        {
+            // Past the end of the file, which only happens before the file
+            // has been striped
+            memset(data, '\0', left);
+            break;
+        }
+        data += done;
+        left -= done;
+        position += done;
+    }
+}
+
+void write(int fd, const double *buffer, size_t count, size_t offset)
+{
+    const char *data = reinterpret_cast<const char *>(buffer);
+    size_t left = sizeof(double) * count;
+    off_t position = sizeof(double) * offset;
+    while (left > 0L)
+    {
+        ssize_t done = ::pwrite(fd, data, left, position);
+        if (done < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            io_error("pwrite");
+        }
+        data += done;
+        left -= done;
+        position += done;
+    }
+}
+
+double *map(int fd, size_t count)
+{
+    void *data = ::mmap(nullptr, sizeof(double) * count, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+        io_error("mmap");
+    return static_cast<double *>(data);
+}
+
+void unmap(double *data, size_t count)
+{
+    ::munmap(data, sizeof(double) * count);
+}
+
+// => Queue <= //
+
+void Queue::read(int fd, double *buffer, size_t count, size_t offset)
+{
+    AMBIT_TIMER_BYTES(sizeof(double) * static_cast<double>(count));
+    requests_.push_back({fd, buffer, count, offset, false});
+}
+
+void Queue::write(int fd, const double *buffer, size_t count, size_t offset)
+{
+    AMBIT_TIMER_BYTES(sizeof(double) * static_cast<double>(count));
+    requests_.push_back(
+        {fd, const_cast<double *>(buffer), count, offset, true});
+}
+
+void Queue::flush()
+{
+    std::vector<Request> requests;
+    requests.swap(requests_);
+    if (requests.empty())
+        return;
+
+    // Each lane serves every nlane-th request, so neighbouring stripes are
+    // in flight together. Small batches are not worth waking the lanes.
+    size_t total = 0L;
+    for (const Request &request : requests)
+        total += request.count;
+    size_t nlane = std::min(queue_depth__, requests.size());
+    if (total < inline_count)
+        nlane = 1L;
+    auto serve = [&requests, nlane](size_t lane) {
+        for (size_t ind = lane; ind < requests.size(); ind += nlane)
+        {
+            const Request &request = requests[ind];
+            if (request.write)
+                disk_io::write(request.fd, request.buffer, request.count,
+                               request.offset);
+            else
+                disk_io::read(request.fd, request.buffer, request.count,
+                              request.offset);
+        }
+    };
+    if (nlane == 1L)
+    {
+        serve(0L);
+        return;
+    }
+
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t running = nlane - 1L;
+    std::exception_ptr error;
+    auto keep_error = [&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error)
+            error = std::current_exception();
+    };
+    for (size_t lane = 1L; lane < nlane; lane++)
+    {
+        Lanes::get().run([&, lane]() {
+            try
+            {
+                serve(lane);
+            }
+            catch (...)
+            {
+                keep_error();
+            }
+            // Notified under the lock, as the waiter may return right after
+            std::lock_guard<std::mutex> lock(mutex);
+            running--;
+            done.notify_one();
+        });
+    }
+
+    try
+    {
+        serve(0L);
+    }
+    catch (...)
+    {
+        keep_error();
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&running]() { return running == 0L; });
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+}
+}
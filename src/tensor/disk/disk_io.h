@@ -0,0 +1,123 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#if !defined(TENSOR_DISK_IO_H)
+#define TENSOR_DISK_IO_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace ambit
+{
+
+/**
+ * Positioned I/O for disk tensors.
+ *
+ * Every request carries its own file offset (pread/pwrite), so there is no
+ * shared file position and requests on the same file can be issued from
+ * several threads at once. Offsets and counts are in doubles.
+ */
+namespace disk_io
+{
+
+/// Maximum number of requests a Queue keeps in flight
+static constexpr size_t queue_depth__ = 8L;
+
+/// Doubles staged per batch of stripes by the slice kernels (32 MiB)
+static constexpr size_t batch_size__ = 4194304L;
+
+/// Granularity (in doubles, 1 MiB) at which disk tensors track which parts
+/// of their file have been written
+static constexpr size_t extent_size__ = 131072L;
+
+/// Creates (or truncates) a file for reading and writing
+int open(const std::string &filename);
+
+void close(int fd);
+
+/// Sets the file length to count doubles without writing; the file is sparse
+/// and reads as zeros
+void resize(int fd, size_t count);
+
+/// Drops the storage of the first count doubles, which then read as zeros
+void discard(int fd, size_t count);
+
+/// Reads count doubles at offset, retrying short and interrupted reads
+void read(int fd, double *buffer, size_t count, size_t offset);
+
+/// Writes count doubles at offset, retrying short and interrupted writes
+void write(int fd, const double *buffer, size_t count, size_t offset);
+
+/**
+ * Maps the first count doubles of the file into memory, shared with the
+ * file, so pages written through the mapping and through read()/write()
+ * are the same pages.
+ */
+double *map(int fd, size_t count);
+
+void unmap(double *data, size_t count);
+
+/**
+ * A batch of independent reads and writes.
+ *
+ * Requests are only recorded until flush(), which issues them with up to
+ * queue_depth__ in flight and returns once all have completed. The lanes
+ * beside the calling thread are threads kept for the life of the process,
+ * and batches smaller than an extent are issued by the calling thread
+ * alone. Requests in one batch must not overlap if any of them is a write.
+ */
+class Queue
+{
+  public:
+    void read(int fd, double *buffer, size_t count, size_t offset);
+    void write(int fd, const double *buffer, size_t count, size_t offset);
+
+    /// Issues all pending requests; the first error is rethrown
+    void flush();
+
+    size_t size() const { return requests_.size(); }
+
+  private:
+    struct Request
+    {
+        int fd;
+        double *buffer;
+        size_t count;
+        size_t offset;
+        bool write;
+    };
+
+    std::vector<Request> requests_;
+};
+}
+}
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#include "tile_cache.h"
+#include "disk.h"
+#include "disk_io.h"
+#include "tensor/accounting.h"
+#include <algorithm>
+#include <ambit/settings.h>
+#include <atomic>
+#include <list>
+#include <map>
+#include <mutex>
+
+namespace ambit
+{
+
+namespace tile_cache
+{
+
+namespace
+{
+
+typedef std::pair<const DiskTensorImpl *, size_t> Key;
+
+struct Tile
+{
+    std::vector<double> data;
+    bool dirty = false;
+    std::list<Key>::iterator lru;
+};
+
+/// Name the tiles are charged to in the memory accounting
+const string charge_name = "DiskTensor tiles";
+
+/// Guards the members below
+std::mutex cache_mutex;
+std::map<Key, Tile> tiles;
+/// The keys of the tiles, most recently used first
+std::list<Key> lru;
+std::atomic<size_t> cached_bytes(0L);
+/// The last tile each tensor missed, for the readahead
+std::map<const DiskTensorImpl *, size_t> last_miss;
+
+size_t capacity()
+{
+    return std::min(settings::disk_cache_size, settings::memory_limit / 4L);
+}
+
+size_t ntiles(const DiskTensorImpl *T)
+{
+    return (T->numel() + disk_io::extent_size__ - 1L) / disk_io::extent_size__;
+}
+
+size_t tile_length(const DiskTensorImpl *T, size_t tile)
+{
+    return std::min(disk_io::extent_size__,
+                    T->numel() - tile * disk_io::extent_size__);
+}
+
+void write_back(const Key &key, Tile &tile)
+{
+    if (!tile.dirty)
+        return;
+    disk_io::write(key.first->fd(), tile.data.data(), tile.data.size(),
+                   key.second * disk_io::extent_size__);
+    tile.dirty = false;
+}
+
+void erase(std::map<Key, Tile>::iterator it, bool write)
+{
+    if (write)
+        write_back(it->first, it->second);
+    size_t bytes = sizeof(double) * it->second.data.size();
+    lru.erase(it->second.lru);
+    tiles.erase(it);
+    cached_bytes -= bytes;
+    memory::discharge(charge_name, bytes);
+}
+
+/// Evicts the least recently used tiles until bytes more fit, @return
+/// whether they do
+bool make_room(size_t bytes)
+{
+    size_t limit = capacity();
+    while (!lru.empty() && cached_bytes + bytes > limit)
+        erase(tiles.find(lru.back()), true);
+    if (cached_bytes + bytes > limit)
+        return false;
+    try
+    {
+        memory::charge(charge_name, bytes);
+    }
+    catch (const detail::OutOfMemoryException &)
+    {
+        // The tensors in core come first; the tile is not cached
+        return false;
+    }
+    return true;
+}
+
+/**
+ * The cached tile of T, loaded on a miss if contents is set (else zeroed,
+ * for a tile about to be overwritten), or nullptr if it does not fit.
+ * Sequential misses of reads also load the next readahead__ tiles.
+ */
+Tile *get(const DiskTensorImpl *T, size_t tile, bool contents, bool reading)
+{
+    auto it = tiles.find(Key(T, tile));
+    if (it != tiles.end())
+    {
+        lru.splice(lru.begin(), lru, it->second.lru);
+        return &it->second;
+    }
+
+    size_t last = tile + 1L;
+    if (reading)
+    {
+        auto miss = last_miss.find(T);
+        bool sequential = miss != last_miss.end() && miss->second + 1L == tile;
+        last_miss[T] = tile;
+        // Only when the readahead cannot evict the tile asked for
+        if (sequential && capacity() >= sizeof(double) * (readahead__ + 2L) *
+                                            disk_io::extent_size__)
+            last = std::min(ntiles(T), tile + 1L + readahead__);
+    }
+
+    disk_io::Queue queue;
+    std::vector<Key> loaded;
+    Tile *result = nullptr;
+    for (size_t t = tile; t < last; ++t)
+    {
+        Key key(T, t);
+        if (t != tile && tiles.count(key))
+            continue;
+        size_t length = tile_length(T, t);
+        if (!make_room(sizeof(double) * length))
+            break;
+        lru.push_front(key);
+        Tile &entry = tiles[key];
+        entry.lru = lru.begin();
+        entry.data.assign(length, 0.0);
+        cached_bytes += sizeof(double) * length;
+        size_t offset = t * disk_io::extent_size__;
+        if ((t != tile || contents) && !T->is_zero(offset, length))
+            queue.read(T->fd(), entry.data.data(), length, offset);
+        loaded.push_back(key);
+        if (t == tile)
+            result = &entry;
+    }
+    try
+    {
+        queue.flush();
+    }
+    catch (...)
+    {
+        for (const Key &key : loaded)
+            erase(tiles.find(key), false);
+        throw;
+    }
+    return result;
+}
+
+/// Applies erase to the tiles of T
+void erase_tiles(const DiskTensorImpl *T, bool write)
+{
+    auto it = tiles.lower_bound(Key(T, 0L));
+    while (it != tiles.end() && it->first.first == T)
+        erase(it++, write);
+    last_miss.erase(T);
+}
+} // anonymous namespace
+
+bool enabled() { return capacity() > 0L || cached_bytes > 0L; }
+
+void read(const DiskTensorImpl *T, double *buffer, size_t count,
+          size_t offset)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    while (count > 0L)
+    {
+        size_t tile = offset / disk_io::extent_size__;
+        size_t first = offset - tile * disk_io::extent_size__;
+        size_t n = std::min(count, tile_length(T, tile) - first);
+        if (T->is_zero(offset, n))
+        {
+            std::fill_n(buffer, n, 0.0);
+        }
+        else
+        {
+            Tile *entry = get(T, tile, true, true);
+            if (entry != nullptr)
+                std::copy_n(entry->data.data() + first, n, buffer);
+            else
+                disk_io::read(T->fd(), buffer, n, offset);
+        }
+        buffer += n;
+        offset += n;
+        count -= n;
+    }
+}
+
+void write(DiskTensorImpl *T, const double *buffer, size_t count,
+           size_t offset)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    while (count > 0L)
+    {
+        size_t tile = offset / disk_io::extent_size__;
+        size_t first = offset - tile * disk_io::extent_size__;
+        size_t length = tile_length(T, tile);
+        size_t n = std::min(count, length - first);
+        // A tile written in full need not be read first
+        bool contents =
+            n < length && !T->is_zero(tile * disk_io::extent_size__, length);
+        Tile *entry = get(T, tile, contents, false);
+        T->touch(offset, n);
+        if (entry != nullptr)
+        {
+            std::copy_n(buffer, n, entry->data.data() + first);
+            entry->dirty = true;
+        }
+        else
+        {
+            disk_io::write(T->fd(), buffer, n, offset);
+        }
+        buffer += n;
+        offset += n;
+        count -= n;
+    }
+}
+
+void drop(const DiskTensorImpl *T, bool write_back)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    erase_tiles(T, write_back);
+}
+
+void clear()
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    while (!lru.empty())
+        erase(tiles.find(lru.back()), true);
+    last_miss.clear();
+}
+}
+}
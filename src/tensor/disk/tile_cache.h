@@ -0,0 +1,84 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#if !defined(TENSOR_TILE_CACHE_H)
+#define TENSOR_TILE_CACHE_H
+
+#include <cstddef>
+
+namespace ambit
+{
+
+class DiskTensorImpl;
+
+/**
+ * An in-memory LRU cache of the tiles of uncompressed disk tensors.
+ *
+ * Tiles are the extents of disk_io::extent_size__ doubles at which a
+ * DiskTensor tracks its written regions, and the cache is shared by all
+ * disk tensors. It holds at most settings::disk_cache_size bytes, and never
+ * more than a quarter of settings::memory_limit; its tiles are charged to
+ * the memory accounting (see ambit/memory.h) as "DiskTensor tiles". Writes
+ * go to the cached tiles and reach the file when a tile is evicted, or
+ * when its tensor is mapped or scaled (write-back). A miss that follows a miss on the
+ * previous tile of the same tensor, the pattern of the stripes of a slice
+ * or of the boxes of a batched contraction, also reads the next
+ * readahead__ tiles in the same batch of requests.
+ *
+ * While the cache is enabled every read and write of an uncompressed disk
+ * tensor must go through it; compressed tensors keep their own extent
+ * cache and bypass it.
+ */
+namespace tile_cache
+{
+
+/// Tiles read ahead of a sequential miss
+static constexpr size_t readahead__ = 4L;
+
+/// Is the cache in use (settings::disk_cache_size not zero)?
+bool enabled();
+
+/// Reads count doubles at offset of T
+void read(const DiskTensorImpl *T, double *buffer, size_t count,
+          size_t offset);
+
+/// Writes count doubles at offset of T
+void write(DiskTensorImpl *T, const double *buffer, size_t count,
+           size_t offset);
+
+/// Forgets the tiles of T, writing the dirty ones back first if write_back
+void drop(const DiskTensorImpl *T, bool write_back);
+
+/// Writes back and forgets every tile
+void clear();
+}
+}
+
+#endif
@@ -0,0 +1,275 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#include <ambit/factorized_tensor.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace ambit
+{
+
+namespace
+{
+
+/// Label of the vector index of the factors; not a valid user label
+const string vector_label = "#Q";
+
+/// Labels for the full indices of a tensor of this rank
+Indices full_labels(size_t rank)
+{
+    Indices labels;
+    for (size_t i = 0; i < rank; ++i)
+        labels.push_back("#" + std::to_string(i));
+    return labels;
+}
+
+size_t product(const Dimension &dims, size_t first, size_t last)
+{
+    size_t n = 1;
+    for (size_t i = first; i < last; ++i)
+        n *= dims[i];
+    return n;
+}
+
+/// Copies a CoreTensor into a new tensor of the given type
+Tensor store(const Tensor &T, TensorType type)
+{
+    if (type == CoreTensor)
+        return T;
+    Tensor stored = Tensor::build(type, T.name(), T.dims());
+    stored.copy(T);
+    return stored;
+}
+}
+
+FactorizedTensor::FactorizedTensor() {}
+
+FactorizedTensor::FactorizedTensor(const string &name, const Tensor &left,
+                                   const Tensor &right)
+    : name_(name), left_(left), right_(right)
+{
+    if (left.rank() < 2 || right.rank() < 2 || left.dim(0) != right.dim(0))
+        throw std::runtime_error("FactorizedTensor: the factors of " + name +
+                                 " must have the same number of vectors and "
+                                 "at least one other index.");
+    dims_.assign(left.dims().begin() + 1, left.dims().end());
+    dims_.insert(dims_.end(), right.dims().begin() + 1, right.dims().end());
+}
+
+FactorizedTensor FactorizedTensor::cholesky(const Tensor &T, double tolerance,
+                                            size_t max_vectors,
+                                            TensorType type)
+{
+    const Dimension &dims = T.dims();
+    size_t half = T.rank() / 2;
+    if (T.rank() == 0 || T.rank() % 2 != 0 ||
+        !std::equal(dims.begin(), dims.begin() + half, dims.begin() + half))
+        throw std::runtime_error("FactorizedTensor::cholesky: " + T.name() +
+                                 " is not a square matrix of index pairs.");
+    if (T.type() != CoreTensor && T.type() != DiskTensor)
+        throw std::runtime_error("FactorizedTensor::cholesky: " + T.name() +
+                                 " must be a CoreTensor or a DiskTensor.");
+
+    size_t n = product(dims, 0, half);
+    if (max_vectors == 0 || max_vectors > n)
+        max_vectors = n;
+
+    const double *M = T.map_data();
+    std::vector<double> diagonal(n);
+    for (size_t I = 0; I < n; ++I)
+        diagonal[I] = M[I * n + I];
+
+    // The vectors found so far, one row of n elements each
+    std::vector<double> L;
+    size_t nvec = 0;
+    while (nvec < max_vectors)
+    {
+        size_t J = std::max_element(diagonal.begin(), diagonal.end()) -
+                   diagonal.begin();
+        double pivot = diagonal[J];
+        if (pivot < tolerance)
+            break;
+
+        // L(K, I) = (M(J, I) - sum_k<K L(k, J) L(k, I)) / sqrt(d(J))
+        L.resize((nvec + 1) * n);
+        double *vec = L.data() + nvec * n;
+        const double *row = M + J * n;
+        double scale = 1.0 / std::sqrt(pivot);
+#pragma omp parallel for schedule(static)
+        for (size_t I = 0; I < n; ++I)
+        {
+            double value = row[I];
+            for (size_t k = 0; k < nvec; ++k)
+                value -= L[k * n + J] * L[k * n + I];
+            vec[I] = value * scale;
+            diagonal[I] -= vec[I] * vec[I];
+        }
+        diagonal[J] = 0.0;
+        ++nvec;
+    }
+    T.unmap_data();
+
+    Dimension ldims = {nvec};
+    ldims.insert(ldims.end(), dims.begin(), dims.begin() + half);
+    Tensor left = Tensor::build(CoreTensor, "L of " + T.name(), ldims);
+    std::copy(L.begin(), L.begin() + nvec * n, left.data().begin());
+    left = store(left, type);
+    return FactorizedTensor(T.name(), left, left);
+}
+
+FactorizedTensor FactorizedTensor::svd(const Tensor &T, size_t split,
+                                       double tolerance, TensorType type)
+{
+    const Dimension &dims = T.dims();
+    if (split == 0 || split >= T.rank())
+        throw std::runtime_error("FactorizedTensor::svd: " + T.name() +
+                                 " must have indices on both sides of the "
+                                 "split.");
+
+    size_t m = product(dims, 0, split);
+    size_t n = product(dims, split, dims.size());
+    Tensor M = Tensor::build(CoreTensor, "M of " + T.name(), {m, n});
+    {
+        Tensor Tcore = T;
+        if (T.type() != CoreTensor)
+        {
+            Tcore = Tensor::build(CoreTensor, T.name(), dims);
+            Tcore.copy(T);
+        }
+        std::copy(Tcore.data().begin(), Tcore.data().end(),
+                  M.data().begin());
+    }
+
+    // M(i, j) = sum_k U(i, k) sigma(k) V(k, j), sigma in descending order
+    map<string, Tensor> decomposition = M.gesvd();
+    const std::vector<double> &U = decomposition["U"].data();
+    const std::vector<double> &V = decomposition["V"].data();
+    const std::vector<double> &sigma = decomposition["Sigma"].data();
+    size_t nvec = 0;
+    while (nvec < sigma.size() && sigma[nvec] > tolerance)
+        ++nvec;
+
+    Dimension ldims = {nvec}, rdims = {nvec};
+    ldims.insert(ldims.end(), dims.begin(), dims.begin() + split);
+    rdims.insert(rdims.end(), dims.begin() + split, dims.end());
+    Tensor left = Tensor::build(CoreTensor, "L of " + T.name(), ldims);
+    Tensor right = Tensor::build(CoreTensor, "R of " + T.name(), rdims);
+    std::vector<double> &Ldata = left.data();
+    std::vector<double> &Rdata = right.data();
+    for (size_t k = 0; k < nvec; ++k)
+    {
+        double root = std::sqrt(sigma[k]);
+        for (size_t i = 0; i < m; ++i)
+            Ldata[k * m + i] = U[i * m + k] * root;
+        for (size_t j = 0; j < n; ++j)
+            Rdata[k * n + j] = V[k * n + j] * root;
+    }
+    return FactorizedTensor(T.name(), store(left, type), store(right, type));
+}
+
+Tensor FactorizedTensor::expand(TensorType type) const
+{
+    Indices labels = full_labels(rank());
+    Indices llabels = {vector_label}, rlabels = {vector_label};
+    llabels.insert(llabels.end(), labels.begin(), labels.begin() + split());
+    rlabels.insert(rlabels.end(), labels.begin() + split(), labels.end());
+
+    Tensor full = Tensor::build(type, name_, dims_);
+    full.contract(left_, right_, labels, llabels, rlabels, 1.0, 0.0);
+    return full;
+}
+
+void FactorizedTensor::contract(Tensor &C, const Tensor &A,
+                                const Indices &Cinds, const Indices &Tinds,
+                                const Indices &Ainds, double alpha,
+                                double beta) const
+{
+    if (Tinds.size() != rank())
+        throw std::runtime_error("FactorizedTensor::contract: " + name_ +
+                                 " has " + std::to_string(rank()) +
+                                 " indices.");
+
+    // The dimension of every label
+    map<string, size_t> label_dims;
+    for (size_t i = 0; i < Tinds.size(); ++i)
+        label_dims[Tinds[i]] = dims_[i];
+    for (size_t i = 0; i < Ainds.size(); ++i)
+        label_dims[Ainds[i]] = A.dim(i);
+    label_dims[vector_label] = size();
+
+    Indices Linds = {vector_label}, Rinds = {vector_label};
+    Linds.insert(Linds.end(), Tinds.begin(), Tinds.begin() + split());
+    Rinds.insert(Rinds.end(), Tinds.begin() + split(), Tinds.end());
+
+    // X(Xinds) = first(first_inds) * A(Ainds) keeps the vector index and
+    // the labels still needed by C or by the other factor
+    auto intermediate = [&](const Indices &first_inds,
+                            const Indices &other_inds) {
+        Indices Xinds = {vector_label};
+        for (const Indices *inds : {&Ainds, &first_inds})
+        {
+            for (const string &label : *inds)
+            {
+                bool needed =
+                    std::count(Cinds.begin(), Cinds.end(), label) != 0 ||
+                    std::count(other_inds.begin(), other_inds.end(), label) !=
+                        0;
+                if (needed &&
+                    std::count(Xinds.begin(), Xinds.end(), label) == 0)
+                    Xinds.push_back(label);
+            }
+        }
+        return Xinds;
+    };
+    auto numel = [&](const Indices &inds) {
+        size_t n = 1;
+        for (const string &label : inds)
+            n *= label_dims[label];
+        return n;
+    };
+
+    Indices XRinds = intermediate(Rinds, Linds);
+    Indices XLinds = intermediate(Linds, Rinds);
+    bool right_first = numel(XRinds) <= numel(XLinds);
+    const Tensor &first = right_first ? right_ : left_;
+    const Tensor &second = right_first ? left_ : right_;
+    const Indices &first_inds = right_first ? Rinds : Linds;
+    const Indices &second_inds = right_first ? Linds : Rinds;
+    const Indices &Xinds = right_first ? XRinds : XLinds;
+
+    Dimension Xdims;
+    for (const string &label : Xinds)
+        Xdims.push_back(label_dims[label]);
+    Tensor X = Tensor::build(CoreTensor, "X of " + name_, Xdims);
+    X.contract(first, A, Xinds, first_inds, Ainds, 1.0, 0.0);
+    C.contract(second, X, Cinds, second_inds, Xinds, alpha, beta);
+}
+}
@@ -0,0 +1,410 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#include <ambit/float_tensor.h>
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "math/math.h"
+#include "tensor/disk/disk.h"
+#include "tensor/disk/disk_io.h"
+
+namespace ambit
+{
+
+namespace
+{
+
+/// Contracted elements per single-precision GEMM in contract_mixed, whose
+/// products are then summed in double precision
+constexpr size_t mixed_chunk__ = 256;
+
+size_t product(const Dimension &dims)
+{
+    size_t n = 1;
+    for (size_t d : dims)
+        n *= d;
+    return n;
+}
+
+/// out(out_inds) = in(in_inds), the dimensions of out being those of in in
+/// the order of out_inds
+template <typename T>
+void permute_elements(const T *in, const Dimension &in_dims,
+                      const Indices &in_inds, const Indices &out_inds, T *out)
+{
+    size_t rank = in_dims.size();
+    std::vector<size_t> in_strides(rank, 1);
+    for (size_t i = rank; i-- > 1;)
+        in_strides[i - 1] = in_strides[i] * in_dims[i];
+
+    // The dimension and input stride of each output index
+    Dimension out_dims(rank);
+    std::vector<size_t> strides(rank);
+    for (size_t k = 0; k < rank; ++k)
+    {
+        size_t i = std::find(in_inds.begin(), in_inds.end(), out_inds[k]) -
+                   in_inds.begin();
+        out_dims[k] = in_dims[i];
+        strides[k] = in_strides[i];
+    }
+    size_t numel = product(out_dims);
+    if (numel == 0)
+        return;
+    if (rank == 0)
+    {
+        out[0] = in[0];
+        return;
+    }
+
+    size_t inner = numel / out_dims[0];
+#pragma omp parallel for schedule(static)
+    for (size_t o0 = 0; o0 < out_dims[0]; ++o0)
+    {
+        std::vector<size_t> counter(rank, 0);
+        size_t offset = o0 * strides[0];
+        T *target = out + o0 * inner;
+        for (size_t n = 0; n < inner; ++n)
+        {
+            target[n] = in[offset];
+            // Odometer over the indices after the first
+            for (size_t k = rank; k-- > 1;)
+            {
+                offset += strides[k];
+                if (++counter[k] < out_dims[k])
+                    break;
+                offset -= strides[k] * out_dims[k];
+                counter[k] = 0;
+            }
+        }
+    }
+}
+
+/// The GEMM layout of C(Cinds) = A(Ainds) * B(Binds): A as (I, K), B as
+/// (K, J) and C as (I, J)
+struct GemmLayout
+{
+    Indices Ainds, Binds, Cinds;
+    size_t ni = 1, nj = 1, nk = 1;
+};
+
+GemmLayout gemm_layout(const Dimension &Cdims, const Dimension &Adims,
+                       const Dimension &Bdims, const Indices &Cinds,
+                       const Indices &Ainds, const Indices &Binds)
+{
+    if (Cinds.size() != Cdims.size() || Ainds.size() != Adims.size() ||
+        Binds.size() != Bdims.size())
+        throw std::runtime_error("FloatTensor::contract: the number of "
+                                 "indices does not match the rank.");
+
+    auto position = [](const Indices &inds, const string &label) {
+        return static_cast<size_t>(
+            std::find(inds.begin(), inds.end(), label) - inds.begin());
+    };
+    auto dimension = [&](const string &label) {
+        size_t a = position(Ainds, label);
+        size_t b = position(Binds, label);
+        if (a < Ainds.size() && b < Binds.size() && Adims[a] != Bdims[b])
+            throw std::runtime_error("FloatTensor::contract: index " + label +
+                                     " has different dimensions in A and B.");
+        return a < Ainds.size() ? Adims[a] : Bdims[b];
+    };
+
+    GemmLayout layout;
+    Indices I, J, K;
+    for (size_t c = 0; c < Cinds.size(); ++c)
+    {
+        const string &label = Cinds[c];
+        bool inA = position(Ainds, label) < Ainds.size();
+        bool inB = position(Binds, label) < Binds.size();
+        if (inA == inB)
+            throw std::runtime_error(
+                "FloatTensor::contract: index " + label +
+                " of C must be in exactly one of A and B.");
+        if (dimension(label) != Cdims[c])
+            throw std::runtime_error("FloatTensor::contract: index " + label +
+                                     " has a different dimension in C.");
+        (inA ? I : J).push_back(label);
+        (inA ? layout.ni : layout.nj) *= Cdims[c];
+    }
+    for (const string &label : Ainds)
+    {
+        if (position(Cinds, label) < Cinds.size())
+            continue;
+        if (position(Binds, label) == Binds.size())
+            throw std::runtime_error("FloatTensor::contract: index " + label +
+                                     " of A is in neither B nor C.");
+        K.push_back(label);
+        layout.nk *= dimension(label);
+    }
+    for (const string &label : Binds)
+    {
+        if (position(Cinds, label) == Cinds.size() &&
+            position(Ainds, label) == Ainds.size())
+            throw std::runtime_error("FloatTensor::contract: index " + label +
+                                     " of B is in neither A nor C.");
+    }
+
+    layout.Ainds = I;
+    layout.Ainds.insert(layout.Ainds.end(), K.begin(), K.end());
+    layout.Binds = K;
+    layout.Binds.insert(layout.Binds.end(), J.begin(), J.end());
+    layout.Cinds = I;
+    layout.Cinds.insert(layout.Cinds.end(), J.begin(), J.end());
+    return layout;
+}
+
+/// The elements of T in the order of inds: T itself if it is in that order
+/// already, else a permuted copy held by buffer
+const float *gemm_operand(const FloatTensor &T, const Indices &Tinds,
+                          const Indices &inds, std::vector<float> &buffer)
+{
+    if (Tinds == inds)
+        return T.data();
+    buffer.resize(T.numel());
+    permute_elements(T.data(), T.dims(), Tinds, inds, buffer.data());
+    return buffer.data();
+}
+}
+
+struct FloatTensor::Storage
+{
+    TensorType type;
+    string name;
+    Dimension dims;
+    size_t numel;
+    std::vector<float> core;
+    string filename;
+    int fd = -1;
+    float *map = nullptr;
+
+    /// The file holds the floats in whole doubles
+    size_t doubles() const { return (numel + 1) / 2; }
+
+    ~Storage()
+    {
+        if (map != nullptr)
+            disk_io::unmap(reinterpret_cast<double *>(map), doubles());
+        if (fd >= 0)
+        {
+            disk_io::close(fd);
+            std::remove(filename.c_str());
+        }
+    }
+};
+
+FloatTensor::FloatTensor() {}
+
+FloatTensor FloatTensor::build(TensorType type, const string &name,
+                               const Dimension &dims)
+{
+    if (type != CoreTensor && type != DiskTensor)
+        throw std::runtime_error("FloatTensor::build: " + name +
+                                 " must be a CoreTensor or a DiskTensor.");
+
+    FloatTensor T;
+    T.storage_ = std::make_shared<Storage>();
+    Storage &S = *T.storage_;
+    S.type = type;
+    S.name = name;
+    S.dims = dims;
+    S.numel = product(dims);
+    if (type == CoreTensor)
+    {
+        S.core.assign(S.numel, 0.0f);
+    }
+    else
+    {
+        std::stringstream ss;
+        ss << Tensor::scratch_path() << "/FloatTensor." << getpid() << "."
+           << disk_next_id() << ".dat";
+        S.filename = ss.str();
+        S.fd = disk_io::open(S.filename);
+        // Sparse, so it reads as zeros until written
+        disk_io::resize(S.fd, S.doubles());
+        if (S.numel > 0)
+            S.map = reinterpret_cast<float *>(disk_io::map(S.fd, S.doubles()));
+    }
+    return T;
+}
+
+FloatTensor FloatTensor::build(TensorType type, const Tensor &A)
+{
+    FloatTensor T = build(type, A.name(), A.dims());
+    T.assign(A);
+    return T;
+}
+
+TensorType FloatTensor::type() const { return storage_->type; }
+
+string FloatTensor::name() const { return storage_->name; }
+
+const Dimension &FloatTensor::dims() const { return storage_->dims; }
+
+size_t FloatTensor::numel() const { return storage_->numel; }
+
+float *FloatTensor::data()
+{
+    return storage_->type == CoreTensor ? storage_->core.data()
+                                        : storage_->map;
+}
+
+const float *FloatTensor::data() const
+{
+    return const_cast<FloatTensor *>(this)->data();
+}
+
+void FloatTensor::assign(const Tensor &A, double alpha, double beta)
+{
+    if (A.dims() != dims())
+        throw std::runtime_error("FloatTensor::assign: " + A.name() +
+                                 " and " + name() +
+                                 " have different dimensions.");
+
+    Tensor Alocal = A;
+    if (A.type() != CoreTensor && A.type() != DiskTensor)
+    {
+        Alocal = Tensor::build(CoreTensor, A.name(), A.dims());
+        Alocal.copy(A);
+    }
+    const double *a = Alocal.map_data();
+    float *c = data();
+    size_t n = numel();
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < n; ++i)
+        c[i] = static_cast<float>(alpha * a[i] +
+                                  (beta == 0.0 ? 0.0 : beta * c[i]));
+    Alocal.unmap_data();
+}
+
+Tensor FloatTensor::to_double(TensorType type) const
+{
+    Tensor T = Tensor::build(CoreTensor, name(), dims());
+    std::vector<double> &t = T.data();
+    const float *c = data();
+    size_t n = numel();
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < n; ++i)
+        t[i] = c[i];
+    if (type == CoreTensor)
+        return T;
+    Tensor stored = Tensor::build(type, name(), dims());
+    stored.copy(T);
+    return stored;
+}
+
+void FloatTensor::zero() { std::fill(data(), data() + numel(), 0.0f); }
+
+void FloatTensor::contract(const FloatTensor &A, const FloatTensor &B,
+                           const Indices &Cinds, const Indices &Ainds,
+                           const Indices &Binds, double alpha, double beta)
+{
+    GemmLayout layout =
+        gemm_layout(dims(), A.dims(), B.dims(), Cinds, Ainds, Binds);
+
+    std::vector<float> Abuffer, Bbuffer;
+    const float *a = gemm_operand(A, Ainds, layout.Ainds, Abuffer);
+    const float *b = gemm_operand(B, Binds, layout.Binds, Bbuffer);
+
+    if (Cinds == layout.Cinds)
+    {
+        C_SGEMM('N', 'N', layout.ni, layout.nj, layout.nk,
+                static_cast<float>(alpha), const_cast<float *>(a), layout.nk,
+                const_cast<float *>(b), layout.nj, static_cast<float>(beta),
+                data(), layout.nj);
+        if (layout.nk == 0)
+            std::transform(data(), data() + numel(), data(),
+                           [beta](float x) { return beta * x; });
+        return;
+    }
+
+    // The product in GEMM layout, then permuted into place
+    std::vector<float> product(numel(), 0.0f), permuted(numel());
+    C_SGEMM('N', 'N', layout.ni, layout.nj, layout.nk, 1.0f,
+            const_cast<float *>(a), layout.nk, const_cast<float *>(b),
+            layout.nj, 0.0f, product.data(), layout.nj);
+    Dimension Pdims;
+    for (const string &label : layout.Cinds)
+        Pdims.push_back(
+            dims()[std::find(Cinds.begin(), Cinds.end(), label) -
+                   Cinds.begin()]);
+    permute_elements(product.data(), Pdims, layout.Cinds, Cinds,
+                     permuted.data());
+    float *c = data();
+    size_t n = numel();
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < n; ++i)
+        c[i] = static_cast<float>(alpha * permuted[i] +
+                                  (beta == 0.0 ? 0.0 : beta * c[i]));
+}
+
+void FloatTensor::contract_mixed(Tensor &C, const FloatTensor &A,
+                                 const FloatTensor &B, const Indices &Cinds,
+                                 const Indices &Ainds, const Indices &Binds,
+                                 double alpha, double beta)
+{
+    GemmLayout layout =
+        gemm_layout(C.dims(), A.dims(), B.dims(), Cinds, Ainds, Binds);
+
+    std::vector<float> Abuffer, Bbuffer;
+    const float *a = gemm_operand(A, Ainds, layout.Ainds, Abuffer);
+    const float *b = gemm_operand(B, Binds, layout.Binds, Bbuffer);
+
+    // Single-precision products over runs of the contracted index, summed
+    // in double precision
+    Dimension Pdims;
+    for (const string &label : layout.Cinds)
+        Pdims.push_back(
+            C.dims()[std::find(Cinds.begin(), Cinds.end(), label) -
+                     Cinds.begin()]);
+    Tensor P = Tensor::build(CoreTensor, "Product of " + A.name() + " and " +
+                                             B.name(),
+                             Pdims);
+    std::vector<double> &p = P.data();
+    std::vector<float> chunk(layout.ni * layout.nj);
+    for (size_t k0 = 0; k0 < layout.nk; k0 += mixed_chunk__)
+    {
+        size_t nk = std::min(mixed_chunk__, layout.nk - k0);
+        C_SGEMM('N', 'N', layout.ni, layout.nj, nk, 1.0f,
+                const_cast<float *>(a) + k0, layout.nk,
+                const_cast<float *>(b) + k0 * layout.nj, layout.nj, 0.0f,
+                chunk.data(), layout.nj);
+        size_t n = chunk.size();
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < n; ++i)
+            p[i] += chunk[i];
+    }
+
+    C.permute(P, Cinds, layout.Cinds, alpha, beta);
+}
+}
@@ -0,0 +1,872 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#if !defined(HAVE_CUDA)
+#error The GPU backend is being compiled without CUDA present.
+#endif
+
+#include "gpu.h"
+#include "tensor/core/core.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <cublas_v2.h>
+#include <cuda_runtime.h>
+#include <cutensor.h>
+
+namespace ambit
+{
+namespace gpu
+{
+
+namespace
+{
+
+/// Largest count handed to one cuBLAS call, whose counts are ints
+constexpr size_t blas_chunk__ = 1073741824L;
+
+/// The mode of the single element a rank-0 tensor is described with
+constexpr int32_t scalar_mode__ = INT32_MAX;
+
+void check(cudaError_t status, const char *what)
+{
+    if (status != cudaSuccess)
+        throw std::runtime_error(std::string("GpuTensorImpl: ") + what + ": " +
+                                 cudaGetErrorString(status));
+}
+
+void check(cublasStatus_t status, const char *what)
+{
+    if (status != CUBLAS_STATUS_SUCCESS)
+        throw std::runtime_error(std::string("GpuTensorImpl: ") + what +
+                                 ": cuBLAS error " + std::to_string(status));
+}
+
+void check(cutensorStatus_t status, const char *what)
+{
+    if (status != CUTENSOR_STATUS_SUCCESS)
+        throw std::runtime_error(std::string("GpuTensorImpl: ") + what + ": " +
+                                 cutensorGetErrorString(status));
+}
+
+/// Device memory that grows to the largest size asked of it
+class DeviceBuffer
+{
+  public:
+    ~DeviceBuffer()
+    {
+        if (data_ != nullptr)
+            cudaFree(data_);
+    }
+    void *get(size_t bytes)
+    {
+        if (bytes > bytes_)
+        {
+            if (data_ != nullptr)
+                check(cudaFree(data_), "cudaFree");
+            data_ = nullptr;
+            check(cudaMalloc(&data_, bytes), "cudaMalloc");
+            bytes_ = bytes;
+        }
+        return data_;
+    }
+
+  private:
+    void *data_ = nullptr;
+    size_t bytes_ = 0L;
+};
+
+/// The handles, stream and buffers of one device. Operations on the device
+/// hold its mutex and run in order on its stream.
+struct Context
+{
+    int device;
+    cudaStream_t stream;
+    cublasHandle_t cublas;
+    cutensorHandle_t cutensor;
+    /// Pinned host buffers of gpu_staging__ doubles
+    double *staging[2];
+    /// Device buffers for the chunks in transit
+    DeviceBuffer chunk[2];
+    /// Recorded once the transfer through staging[n] is done with it
+    cudaEvent_t done[2];
+    /// Workspace of cuTENSOR plans
+    DeviceBuffer work;
+    std::mutex mutex;
+};
+
+std::vector<std::unique_ptr<Context>> contexts__;
+
+std::atomic<size_t> next_device__(0L);
+
+/// Makes a device current for the lifetime of the guard
+class DeviceGuard
+{
+  public:
+    explicit DeviceGuard(int device)
+    {
+        check(cudaGetDevice(&previous_), "cudaGetDevice");
+        check(cudaSetDevice(device), "cudaSetDevice");
+    }
+    ~DeviceGuard() { cudaSetDevice(previous_); }
+
+  private:
+    int previous_;
+};
+
+Context &context(int device)
+{
+    if (contexts__.empty())
+        throw std::runtime_error(
+            "GpuTensorImpl: Ambit was initialized without a visible GPU.");
+    return *contexts__[device];
+}
+
+/// Device memory freed at the end of the scope
+class DeviceArray
+{
+  public:
+    explicit DeviceArray(size_t count)
+    {
+        check(cudaMalloc(&data_, std::max<size_t>(1L, count) * sizeof(double)),
+              "cudaMalloc");
+    }
+    ~DeviceArray() { cudaFree(data_); }
+    double *data() const { return data_; }
+
+  private:
+    double *data_ = nullptr;
+};
+
+/// A cuTENSOR descriptor of a box of extents inside a row-major tensor of
+/// dims (packed, if dims is empty). A rank-0 tensor is described as a
+/// single element of rank 1.
+class Descriptor
+{
+  public:
+    Descriptor(cutensorHandle_t handle, const Dimension &extents,
+               const Dimension &dims = {})
+    {
+        std::vector<int64_t> ext(extents.begin(), extents.end());
+        std::vector<int64_t> strides(extents.size(), 1);
+        const Dimension &full = dims.empty() ? extents : dims;
+        for (size_t k = full.size(); k-- > 1;)
+            strides[k - 1] = strides[k] * static_cast<int64_t>(full[k]);
+        if (ext.empty())
+        {
+            ext.push_back(1);
+            strides.push_back(1);
+        }
+        check(cutensorCreateTensorDescriptor(
+                  handle, &desc_, static_cast<uint32_t>(ext.size()),
+                  ext.data(), strides.data(), CUTENSOR_R_64F,
+                  sizeof(double)),
+              "cutensorCreateTensorDescriptor");
+    }
+    ~Descriptor() { cutensorDestroyTensorDescriptor(desc_); }
+    operator cutensorTensorDescriptor_t() const { return desc_; }
+
+  private:
+    cutensorTensorDescriptor_t desc_;
+};
+
+/// Integer modes of the index labels, numbered as first seen in ids
+std::vector<int32_t> modes(const Indices &inds,
+                           std::map<string, int32_t> &ids)
+{
+    std::vector<int32_t> result;
+    for (const string &label : inds)
+        result.push_back(
+            ids.emplace(label, static_cast<int32_t>(ids.size())).first->second);
+    if (result.empty())
+        result.push_back(scalar_mode__);
+    return result;
+}
+
+/// Modes 0, 1, ... of a box of rank
+std::vector<int32_t> identity_modes(size_t rank)
+{
+    std::vector<int32_t> result(std::max<size_t>(1L, rank));
+    for (size_t k = 0; k < result.size(); ++k)
+        result[k] = static_cast<int32_t>(k);
+    return result;
+}
+
+/// Plans op with the default algorithm, runs it by run(plan, workspace,
+/// size) and destroys op
+template <typename Run>
+void execute(Context &ctx, cutensorOperationDescriptor_t op, Run run)
+{
+    cutensorPlanPreference_t preference;
+    check(cutensorCreatePlanPreference(ctx.cutensor, &preference,
+                                       CUTENSOR_ALGO_DEFAULT,
+                                       CUTENSOR_JIT_MODE_NONE),
+          "cutensorCreatePlanPreference");
+    uint64_t size = 0;
+    check(cutensorEstimateWorkspaceSize(ctx.cutensor, op, preference,
+                                        CUTENSOR_WORKSPACE_DEFAULT, &size),
+          "cutensorEstimateWorkspaceSize");
+    cutensorPlan_t plan;
+    check(cutensorCreatePlan(ctx.cutensor, &plan, op, preference, size),
+          "cutensorCreatePlan");
+    void *work = size > 0 ? ctx.work.get(size) : nullptr;
+    run(plan, work, size);
+    cutensorDestroyPlan(plan);
+    cutensorDestroyPlanPreference(preference);
+    cutensorDestroyOperationDescriptor(op);
+}
+
+/**
+ * D(Dmodes) = alpha * A(Amodes) + beta * D(Dmodes) on the stream of ctx.
+ * With beta zero D is not read, so it may hold anything.
+ */
+void axpby(Context &ctx, const Descriptor &Adesc, const double *A,
+           const std::vector<int32_t> &Amodes, const Descriptor &Ddesc,
+           double *D, const std::vector<int32_t> &Dmodes, double alpha,
+           double beta)
+{
+    cutensorOperationDescriptor_t op;
+    if (beta == 0.0)
+    {
+        check(cutensorCreatePermutation(ctx.cutensor, &op, Adesc,
+                                        Amodes.data(), CUTENSOR_OP_IDENTITY,
+                                        Ddesc, Dmodes.data(),
+                                        CUTENSOR_COMPUTE_DESC_64F),
+              "cutensorCreatePermutation");
+        execute(ctx, op, [&](cutensorPlan_t plan, void *, uint64_t) {
+            check(cutensorPermute(ctx.cutensor, plan, &alpha, A, D,
+                                  ctx.stream),
+                  "cutensorPermute");
+        });
+        return;
+    }
+    check(cutensorCreateElementwiseBinary(
+              ctx.cutensor, &op, Adesc, Amodes.data(), CUTENSOR_OP_IDENTITY,
+              Ddesc, Dmodes.data(), CUTENSOR_OP_IDENTITY, Ddesc,
+              Dmodes.data(), CUTENSOR_OP_ADD, CUTENSOR_COMPUTE_DESC_64F),
+          "cutensorCreateElementwiseBinary");
+    execute(ctx, op, [&](cutensorPlan_t plan, void *, uint64_t) {
+        check(cutensorElementwiseBinaryExecute(ctx.cutensor, plan, &alpha, A,
+                                               &beta, D, D, ctx.stream),
+              "cutensorElementwiseBinaryExecute");
+    });
+}
+
+/// Row-major offset of an element of a tensor of dims
+size_t offset_of(const Dimension &dims, const std::vector<size_t> &index)
+{
+    size_t offset = 0L;
+    for (size_t k = 0; k < dims.size(); ++k)
+        offset = offset * dims[k] + index[k];
+    return offset;
+}
+
+/// The lower corner of a range
+std::vector<size_t> origin_of(const IndexRange &range)
+{
+    std::vector<size_t> origin;
+    for (const std::vector<size_t> &r : range)
+        origin.push_back(r[0]);
+    return origin;
+}
+
+/// The extents of a range
+Dimension extents_of(const IndexRange &range)
+{
+    Dimension extents;
+    for (const std::vector<size_t> &r : range)
+        extents.push_back(r[1] - r[0]);
+    return extents;
+}
+
+size_t product(const Dimension &dims)
+{
+    size_t n = 1L;
+    for (size_t d : dims)
+        n *= d;
+    return n;
+}
+
+/**
+ * Splits a box of extents into boxes of at most max_size elements (as long
+ * as a single element of the leading indices fits). Leading indices take
+ * single values, one index is chunked, and the trailing indices are kept
+ * whole. The boxes are relative to the corner of the box.
+ */
+std::vector<IndexRange> chunk_boxes(const Dimension &extents, size_t max_size)
+{
+    size_t rank = extents.size();
+    if (rank == 0)
+        return {IndexRange()};
+    if (product(extents) == 0L)
+        return {};
+
+    size_t d = rank - 1;
+    size_t trailing = 1L;
+    while (d > 0 && trailing * extents[d] <= max_size)
+        trailing *= extents[d--];
+    size_t step = std::max<size_t>(1L, max_size / trailing);
+
+    std::vector<IndexRange> boxes;
+    std::vector<size_t> lead(d, 0L);
+    while (true)
+    {
+        for (size_t s = 0; s < extents[d]; s += step)
+        {
+            IndexRange box;
+            for (size_t k = 0; k < d; ++k)
+                box.push_back({lead[k], lead[k] + 1});
+            box.push_back({s, std::min(s + step, extents[d])});
+            for (size_t k = d + 1; k < rank; ++k)
+                box.push_back({0L, extents[k]});
+            boxes.push_back(box);
+        }
+        size_t k = d;
+        while (k > 0 && ++lead[k - 1] == extents[k - 1])
+            lead[--k] = 0L;
+        if (k == 0)
+            break;
+    }
+    return boxes;
+}
+
+/**
+ * Calls run(T, offset, count) for every contiguous run of the box at origin
+ * of a row-major tensor of dims, T being the position of the run in the
+ * packed box. Runs are taken in parallel.
+ */
+template <typename Run>
+void for_each_run(const Dimension &dims, const std::vector<size_t> &origin,
+                  const Dimension &extents, Run run)
+{
+    size_t rank = extents.size();
+    if (rank == 0)
+    {
+        run(0L, 0L, 1L);
+        return;
+    }
+    size_t count = extents[rank - 1];
+    size_t nruns = product(extents) / std::max<size_t>(1L, count);
+#pragma omp parallel for schedule(static)
+    for (size_t n = 0; n < nruns; ++n)
+    {
+        std::vector<size_t> index(rank);
+        size_t rest = n;
+        for (size_t k = rank - 1; k-- > 0;)
+        {
+            index[k] = origin[k] + rest % extents[k];
+            rest /= extents[k];
+        }
+        index[rank - 1] = origin[rank - 1];
+        run(n * count, offset_of(dims, index), count);
+    }
+}
+
+/// The box moved by corner
+IndexRange shift(const IndexRange &box, const std::vector<size_t> &corner)
+{
+    IndexRange result(box);
+    for (size_t k = 0; k < box.size(); ++k)
+    {
+        result[k][0] += corner[k];
+        result[k][1] += corner[k];
+    }
+    return result;
+}
+
+/// T itself if it is a GpuTensorImpl on device, else a copy of it there
+/// held by copy
+ConstGpuTensorImplPtr on_device(ConstTensorImplPtr T, int device,
+                                std::unique_ptr<GpuTensorImpl> &copy)
+{
+    if (T->type() == GpuTensor &&
+        static_cast<ConstGpuTensorImplPtr>(T)->device() == device)
+        return static_cast<ConstGpuTensorImplPtr>(T);
+    copy.reset(new GpuTensorImpl(T->name(), T->dims(), device));
+    copy->copy(T);
+    return copy.get();
+}
+}
+
+void initialize()
+{
+    int count = 0;
+    if (cudaGetDeviceCount(&count) != cudaSuccess)
+        count = 0;
+    for (int device = 0; device < count; ++device)
+    {
+        DeviceGuard guard(device);
+        std::unique_ptr<Context> ctx(new Context);
+        ctx->device = device;
+        check(cudaStreamCreateWithFlags(&ctx->stream, cudaStreamNonBlocking),
+              "cudaStreamCreate");
+        check(cublasCreate(&ctx->cublas), "cublasCreate");
+        check(cublasSetStream(ctx->cublas, ctx->stream), "cublasSetStream");
+        check(cutensorCreate(&ctx->cutensor), "cutensorCreate");
+        for (int n = 0; n < 2; ++n)
+        {
+            check(cudaMallocHost(reinterpret_cast<void **>(&ctx->staging[n]),
+                                 gpu_staging__ * sizeof(double)),
+                  "cudaMallocHost");
+            check(cudaEventCreateWithFlags(&ctx->done[n],
+                                           cudaEventDisableTiming),
+                  "cudaEventCreate");
+        }
+        // Lets cuTENSOR read operands on the other devices
+        for (int peer = 0; peer < count; ++peer)
+        {
+            int access = 0;
+            if (peer != device &&
+                cudaDeviceCanAccessPeer(&access, device, peer) ==
+                    cudaSuccess &&
+                access)
+                cudaDeviceEnablePeerAccess(peer, 0);
+        }
+        contexts__.push_back(std::move(ctx));
+    }
+}
+
+void finalize()
+{
+    for (std::unique_ptr<Context> &ctx : contexts__)
+    {
+        DeviceGuard guard(ctx->device);
+        cudaStreamSynchronize(ctx->stream);
+        for (int n = 0; n < 2; ++n)
+        {
+            cudaFreeHost(ctx->staging[n]);
+            cudaEventDestroy(ctx->done[n]);
+        }
+        cutensorDestroy(ctx->cutensor);
+        cublasDestroy(ctx->cublas);
+        cudaStreamDestroy(ctx->stream);
+        // The chunk and work buffers are freed with the device current
+        ctx.reset();
+    }
+    contexts__.clear();
+}
+
+int device_count() { return static_cast<int>(contexts__.size()); }
+
+GpuTensorImpl::GpuTensorImpl(const std::string &name, const Dimension &dims,
+                             int device)
+    : TensorImpl(GpuTensor, name, dims), device_(device), data_(nullptr)
+{
+    if (device_ < 0)
+        device_ = static_cast<int>(next_device__++ %
+                                   std::max<size_t>(1L, contexts__.size()));
+    Context &ctx = context(device_);
+    DeviceGuard guard(device_);
+    check(cudaMalloc(reinterpret_cast<void **>(&data_),
+                     std::max<size_t>(1L, numel()) * sizeof(double)),
+          "cudaMalloc");
+    std::lock_guard<std::mutex> lock(ctx.mutex);
+    check(cudaMemsetAsync(data_, 0, numel() * sizeof(double), ctx.stream),
+          "cudaMemsetAsync");
+    check(cudaStreamSynchronize(ctx.stream), "cudaStreamSynchronize");
+}
+
+GpuTensorImpl::~GpuTensorImpl()
+{
+    DeviceGuard guard(device_);
+    cudaFree(data_);
+}
+
+double GpuTensorImpl::norm(int type) const
+{
+    Context &ctx = context(device_);
+    DeviceGuard guard(device_);
+    std::lock_guard<std::mutex> lock(ctx.mutex);
+
+    double result = 0.0;
+    for (size_t first = 0L; first < numel(); first += blas_chunk__)
+    {
+        int n = static_cast<int>(std::min(blas_chunk__, numel() - first));
+        double *x = data_ + first;
+        double value = 0.0;
+        if (type == 0)
+        {
+            int position = 0;
+            check(cublasIdamax(ctx.cublas, n, x, 1, &position),
+                  "cublasIdamax");
+            check(cudaMemcpyAsync(&value, x + position - 1, sizeof(double),
+                                  cudaMemcpyDeviceToHost, ctx.stream),
+                  "cudaMemcpyAsync");
+            check(cudaStreamSynchronize(ctx.stream), "cudaStreamSynchronize");
+            result = std::max(result, std::fabs(value));
+        }
+        else if (type == 1)
+        {
+            check(cublasDasum(ctx.cublas, n, x, 1, &value), "cublasDasum");
+            result += value;
+        }
+        else if (type == 2)
+        {
+            check(cublasDnrm2(ctx.cublas, n, x, 1, &value), "cublasDnrm2");
+            result += value * value;
+        }
+        else
+        {
+            throw std::runtime_error("GpuTensorImpl::norm: Unknown norm type");
+        }
+    }
+    return type == 2 ? std::sqrt(result) : result;
+}
+
+std::tuple<double, std::vector<size_t>> GpuTensorImpl::max() const
+{
+    std::unique_ptr<TensorImpl> core(to_core());
+    return core->max();
+}
+
+std::tuple<double, std::vector<size_t>> GpuTensorImpl::min() const
+{
+    std::unique_ptr<TensorImpl> core(to_core());
+    return core->min();
+}
+
+void GpuTensorImpl::scale(double beta)
+{
+    Context &ctx = context(device_);
+    DeviceGuard guard(device_);
+    std::lock_guard<std::mutex> lock(ctx.mutex);
+
+    if (beta == 0.0)
+        check(cudaMemsetAsync(data_, 0, numel() * sizeof(double), ctx.stream),
+              "cudaMemsetAsync");
+    else
+        for (size_t first = 0L; first < numel(); first += blas_chunk__)
+        {
+            int n = static_cast<int>(std::min(blas_chunk__, numel() - first));
+            check(cublasDscal(ctx.cublas, n, &beta, data_ + first, 1),
+                  "cublasDscal");
+        }
+    check(cudaStreamSynchronize(ctx.stream), "cudaStreamSynchronize");
+}
+
+void GpuTensorImpl::set(double alpha)
+{
+    if (alpha == 0.0)
+    {
+        scale(0.0);
+        return;
+    }
+
+    Context &ctx = context(device_);
+    DeviceGuard guard(device_);
+    std::lock_guard<std::mutex> lock(ctx.mutex);
+
+    // Every chunk is copied from the same pinned run of alpha's
+    size_t size = std::min(numel(), gpu_staging__);
+    std::fill(ctx.staging[0], ctx.staging[0] + size, alpha);
+    for (size_t first = 0L; first < numel(); first += size)
+    {
+        size_t count = std::min(size, numel() - first);
+        check(cudaMemcpyAsync(data_ + first, ctx.staging[0],
+                              count * sizeof(double), cudaMemcpyHostToDevice,
+                              ctx.stream),
+              "cudaMemcpyAsync");
+    }
+    check(cudaStreamSynchronize(ctx.stream), "cudaStreamSynchronize");
+}
+
+void GpuTensorImpl::permute(ConstTensorImplPtr A, const Indices &Cinds,
+                            const Indices &Ainds, double alpha, double beta)
+{
+    std::unique_ptr<GpuTensorImpl> Acopy;
+    ConstGpuTensorImplPtr Ag = on_device(A, device_, Acopy);
+
+    Context &ctx = context(device_);
+    DeviceGuard guard(device_);
+    std::lock_guard<std::mutex> lock(ctx.mutex);
+
+    std::map<string, int32_t> ids;
+    std::vector<int32_t> Cmodes = modes(Cinds, ids);
+    std::vector<int32_t> Amodes = modes(Ainds, ids);
+    Descriptor Cdesc(ctx.cutensor, dims());
+    Descriptor Adesc(ctx.cutensor, A->dims());
+    axpby(ctx, Adesc, Ag->device_data(), Amodes, Cdesc, data_, Cmodes, alpha,
+          beta);
+    check(cudaStreamSynchronize(ctx.stream), "cudaStreamSynchronize");
+}
+
+void GpuTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
+                             const Indices &Cinds, const Indices &Ainds,
+                             const Indices &Binds, double alpha, double beta)
+{
+    std::unique_ptr<GpuTensorImpl> Acopy, Bcopy;
+    ConstGpuTensorImplPtr Ag = on_device(A, device_, Acopy);
+    ConstGpuTensorImplPtr Bg = on_device(B, device_, Bcopy);
+
+    Context &ctx = context(device_);
+    DeviceGuard guard(device_);
+    std::lock_guard<std::mutex> lock(ctx.mutex);
+
+    std::map<string, int32_t> ids;
+    std::vector<int32_t> Cmodes = modes(Cinds, ids);
+    std::vector<int32_t> Amodes = modes(Ainds, ids);
+    std::vector<int32_t> Bmodes = modes(Binds, ids);
+    Descriptor Cdesc(ctx.cutensor, dims());
+    Descriptor Adesc(ctx.cutensor, A->dims());
+    Descriptor Bdesc(ctx.cutensor, B->dims());
+
+    cutensorOperationDescriptor_t op;
+    check(cutensorCreateContraction(
+              ctx.cutensor, &op, Adesc, Amodes.data(), CUTENSOR_OP_IDENTITY,
+              Bdesc, Bmodes.data(), CUTENSOR_OP_IDENTITY, Cdesc,
+              Cmodes.data(), CUTENSOR_OP_IDENTITY, Cdesc, Cmodes.data(),
+              CUTENSOR_COMPUTE_DESC_64F),
+          "cutensorCreateContraction");
+    execute(ctx, op, [&](cutensorPlan_t plan, void *work, uint64_t size) {
+        check(cutensorContract(ctx.cutensor, plan, &alpha, Ag->device_data(),
+                               Bg->device_data(), &beta, data_, data_, work,
+                               size, ctx.stream),
+              "cutensorContract");
+    });
+    check(cudaStreamSynchronize(ctx.stream), "cudaStreamSynchronize");
+}
+
+void GpuTensorImpl::contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
+                             const Indices &Cinds, const Indices &Ainds,
+                             const Indices &Binds,
+                             std::shared_ptr<TensorImpl> & /*A2*/,
+                             std::shared_ptr<TensorImpl> & /*B2*/,
+                             std::shared_ptr<TensorImpl> & /*C2*/,
+                             double alpha, double beta)
+{
+    contract(A, B, Cinds, Ainds, Binds, alpha, beta);
+}
+
+std::map<std::string, TensorImplPtr>
+GpuTensorImpl::syev(EigenvalueOrder order) const
+{
+    std::unique_ptr<TensorImpl> core(to_core());
+    std::map<std::string, TensorImplPtr> result = core->syev(order);
+    for (auto &kv : result)
+    {
+        std::unique_ptr<TensorImpl> host(kv.second);
+        kv.second = new GpuTensorImpl(host->name(), host->dims(), device_);
+        kv.second->copy(host.get());
+    }
+    return result;
+}
+
+TensorImplPtr GpuTensorImpl::power(double alpha, double condition) const
+{
+    std::unique_ptr<TensorImpl> core(to_core());
+    std::unique_ptr<TensorImpl> host(core->power(alpha, condition));
+    TensorImplPtr result = new GpuTensorImpl(host->name(), host->dims(), device_);
+    result->copy(host.get());
+    return result;
+}
+
+TensorImplPtr GpuTensorImpl::inverse() const
+{
+    std::unique_ptr<TensorImpl> core(to_core());
+    std::unique_ptr<TensorImpl> host(core->inverse());
+    TensorImplPtr result = new GpuTensorImpl(host->name(), host->dims(), device_);
+    result->copy(host.get());
+    return result;
+}
+
+void GpuTensorImpl::iterate(
+    const std::function<void(const std::vector<size_t> &, double &)> &func)
+{
+    std::unique_ptr<TensorImpl> core(to_core());
+    core->iterate(func);
+    copy(core.get());
+}
+
+void GpuTensorImpl::citerate(
+    const std::function<void(const std::vector<size_t> &, const double &)>
+        &func) const
+{
+    std::unique_ptr<TensorImpl> core(to_core());
+    core->citerate(func);
+}
+
+TensorImplPtr GpuTensorImpl::to_core() const
+{
+    CoreTensorImpl *core = new CoreTensorImpl(name(), dims());
+    core->copy(this);
+    return core;
+}
+
+void GpuTensorImpl::slice_device(const GpuTensorImpl *A,
+                                 const IndexRange &Cinds,
+                                 const IndexRange &Ainds, double alpha,
+                                 double beta)
+{
+    Dimension extents = extents_of(Cinds);
+    if (product(extents) == 0L)
+        return;
+    std::vector<int32_t> box_modes = identity_modes(rank());
+
+    // A box on another device is packed there and copied over
+    std::unique_ptr<DeviceArray> packed;
+    const double *Ap = A->device_data() + offset_of(A->dims(), origin_of(Ainds));
+    Dimension Adims = A->dims();
+    if (A->device() != device_)
+    {
+        Context &actx = context(A->device());
+        DeviceGuard guard(A->device());
+        DeviceArray remote(product(extents));
+        {
+            std::lock_guard<std::mutex> lock(actx.mutex);
+            Descriptor Adesc(actx.cutensor, extents, A->dims());
+            Descriptor Pdesc(actx.cutensor, extents);
+            axpby(actx, Adesc, Ap, box_modes, Pdesc, remote.data(), box_modes,
+                  1.0, 0.0);
+            check(cudaStreamSynchronize(actx.stream), "cudaStreamSynchronize");
+        }
+        DeviceGuard local(device_);
+        packed.reset(new DeviceArray(product(extents)));
+        check(cudaMemcpyPeer(packed->data(), device_, remote.data(),
+                             A->device(), product(extents) * sizeof(double)),
+              "cudaMemcpyPeer");
+        Ap = packed->data();
+        Adims = extents;
+    }
+
+    Context &ctx = context(device_);
+    DeviceGuard guard(device_);
+    std::lock_guard<std::mutex> lock(ctx.mutex);
+    Descriptor Adesc(ctx.cutensor, extents, Adims);
+    Descriptor Cdesc(ctx.cutensor, extents, dims());
+    axpby(ctx, Adesc, Ap, box_modes, Cdesc,
+          data_ + offset_of(dims(), origin_of(Cinds)), box_modes, alpha, beta);
+    check(cudaStreamSynchronize(ctx.stream), "cudaStreamSynchronize");
+}
+
+void GpuTensorImpl::slice_from_host(const double *A, const Dimension &Adims,
+                                    const IndexRange &Cinds,
+                                    const IndexRange &Ainds, double alpha,
+                                    double beta)
+{
+    Context &ctx = context(device_);
+    DeviceGuard guard(device_);
+    std::lock_guard<std::mutex> lock(ctx.mutex);
+
+    std::vector<size_t> Aorigin = origin_of(Ainds);
+    std::vector<size_t> Corigin = origin_of(Cinds);
+    std::vector<int32_t> box_modes = identity_modes(rank());
+    std::vector<IndexRange> boxes =
+        chunk_boxes(extents_of(Cinds), gpu_staging__);
+    for (size_t b = 0; b < boxes.size(); ++b)
+    {
+        int n = b % 2;
+        Dimension extents = extents_of(boxes[b]);
+        size_t count = product(extents);
+
+        // Packs the box while the previous one is in flight
+        check(cudaEventSynchronize(ctx.done[n]), "cudaEventSynchronize");
+        double *staging = ctx.staging[n];
+        for_each_run(Adims, origin_of(shift(boxes[b], Aorigin)), extents,
+                     [&](size_t T, size_t offset, size_t run) {
+                         std::memcpy(staging + T, A + offset,
+                                     run * sizeof(double));
+                     });
+
+        double *chunk = static_cast<double *>(
+            ctx.chunk[n].get(std::max<size_t>(1L, count) * sizeof(double)));
+        check(cudaMemcpyAsync(chunk, staging, count * sizeof(double),
+                              cudaMemcpyHostToDevice, ctx.stream),
+              "cudaMemcpyAsync");
+        Descriptor Pdesc(ctx.cutensor, extents);
+        Descriptor Cdesc(ctx.cutensor, extents, dims());
+        axpby(ctx, Pdesc, chunk, box_modes, Cdesc,
+              data_ + offset_of(dims(), origin_of(shift(boxes[b], Corigin))),
+              box_modes, alpha, beta);
+        check(cudaEventRecord(ctx.done[n], ctx.stream), "cudaEventRecord");
+    }
+    check(cudaStreamSynchronize(ctx.stream), "cudaStreamSynchronize");
+}
+
+void GpuTensorImpl::slice_to_host(double *C, const Dimension &Cdims,
+                                  const IndexRange &Cinds,
+                                  const IndexRange &Ainds, double alpha,
+                                  double beta) const
+{
+    Context &ctx = context(device_);
+    DeviceGuard guard(device_);
+    std::lock_guard<std::mutex> lock(ctx.mutex);
+
+    std::vector<size_t> Aorigin = origin_of(Ainds);
+    std::vector<size_t> Corigin = origin_of(Cinds);
+    std::vector<int32_t> box_modes = identity_modes(rank());
+    std::vector<IndexRange> boxes =
+        chunk_boxes(extents_of(Ainds), gpu_staging__);
+
+    // Queues the packing and transfer of box b into staging[b % 2]
+    auto fetch = [&](size_t b) {
+        int n = b % 2;
+        Dimension extents = extents_of(boxes[b]);
+        size_t count = product(extents);
+        double *chunk = static_cast<double *>(
+            ctx.chunk[n].get(std::max<size_t>(1L, count) * sizeof(double)));
+        Descriptor Adesc(ctx.cutensor, extents, dims());
+        Descriptor Pdesc(ctx.cutensor, extents);
+        axpby(ctx, Adesc,
+              data_ + offset_of(dims(), origin_of(shift(boxes[b], Aorigin))),
+              box_modes, Pdesc, chunk, box_modes, 1.0, 0.0);
+        check(cudaMemcpyAsync(ctx.staging[n], chunk, count * sizeof(double),
+                              cudaMemcpyDeviceToHost, ctx.stream),
+              "cudaMemcpyAsync");
+        check(cudaEventRecord(ctx.done[n], ctx.stream), "cudaEventRecord");
+    };
+
+    // Unpacks box b - 1 while box b is in flight
+    for (size_t b = 0; b <= boxes.size(); ++b)
+    {
+        if (b < boxes.size())
+            fetch(b);
+        if (b == 0)
+            continue;
+        int n = (b - 1) % 2;
+        check(cudaEventSynchronize(ctx.done[n]), "cudaEventSynchronize");
+        const double *staging = ctx.staging[n];
+        for_each_run(Cdims, origin_of(shift(boxes[b - 1], Corigin)),
+                     extents_of(boxes[b - 1]),
+                     [&](size_t T, size_t offset, size_t run) {
+                         double *Cp = C + offset;
+                         const double *Ap = staging + T;
+                         for (size_t k = 0; k < run; ++k)
+                             Cp[k] = alpha * Ap[k] +
+                                     (beta == 0.0 ? 0.0 : beta * Cp[k]);
+                     });
+    }
+}
+}
+}
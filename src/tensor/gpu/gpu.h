@@ -0,0 +1,155 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#if !defined(TENSOR_GPU_H)
+#define TENSOR_GPU_H
+
+#include "tensor/tensorimpl.h"
+
+namespace ambit
+{
+
+namespace gpu
+{
+
+/// 64 MiB in doubles, the size of each pinned host staging buffer
+static constexpr size_t gpu_staging__ = 8388608L;
+
+/// Sets up a context (cuBLAS and cuTENSOR handles, a stream and two pinned
+/// staging buffers) on every visible device
+void initialize();
+
+/// Releases the device contexts
+void finalize();
+
+/// @return The number of visible devices
+int device_count();
+
+/**
+ * A tensor resident in the memory of one GPU. Tensors are placed on the
+ * devices round robin as they are built, so independent contractions spread
+ * over every GPU of the node; operands on another device are copied over
+ * peer to peer before a contraction.
+ *
+ * Permutations and contractions (Hadamard indices included) run in
+ * cuTENSOR, scaling and norms in cuBLAS. Slices to and from CoreTensor's go
+ * through the pinned staging buffers in chunks of whole leading rows, the
+ * packing of one chunk on the host overlapping the asynchronous transfer of
+ * the previous one. Anything else (iterators, eigenvalues, max and min) is
+ * staged through a CoreTensor.
+ */
+class GpuTensorImpl : public TensorImpl
+{
+  public:
+    /// Builds a zeroed tensor on device, or on the next device round robin
+    /// if device is -1
+    GpuTensorImpl(const std::string &name, const Dimension &dims,
+                  int device = -1);
+    ~GpuTensorImpl();
+
+    /// @return The device holding the tensor
+    int device() const { return device_; }
+    /// @return The elements in device memory, row-major
+    double *device_data() const { return data_; }
+
+    // => Simple Single Tensor Operations <= //
+
+    double norm(int type = 2) const;
+
+    std::tuple<double, std::vector<size_t>> max() const;
+
+    std::tuple<double, std::vector<size_t>> min() const;
+
+    void scale(double beta = 0.0);
+
+    void set(double alpha);
+
+    void permute(ConstTensorImplPtr A, const Indices &Cinds,
+                 const Indices &Ainds, double alpha = 1.0, double beta = 0.0);
+
+    void contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
+                  const Indices &Cinds, const Indices &Ainds,
+                  const Indices &Binds, double alpha = 1.0, double beta = 0.0);
+
+    // The operands stay on the device, so A2, B2, and C2 are not used.
+    void contract(ConstTensorImplPtr A, ConstTensorImplPtr B,
+                  const Indices &Cinds, const Indices &Ainds,
+                  const Indices &Binds, std::shared_ptr<TensorImpl> &A2,
+                  std::shared_ptr<TensorImpl> &B2,
+                  std::shared_ptr<TensorImpl> &C2, double alpha = 1.0,
+                  double beta = 0.0);
+
+    // => Order-2 Operations <= //
+
+    std::map<std::string, TensorImplPtr> syev(EigenvalueOrder order) const;
+
+    TensorImplPtr power(double alpha, double condition = 1.0E-12) const;
+
+    TensorImplPtr inverse() const;
+
+    // => Iterators <= //
+
+    void iterate(
+        const std::function<void(const std::vector<size_t> &, double &)> &func);
+    void citerate(const std::function<void(const std::vector<size_t> &,
+                                           const double &)> &func) const;
+
+    // => Transfers <= //
+
+    /// C(Cinds) = alpha * A(Ainds) + beta * C(Cinds) on the device, A
+    /// being a GpuTensorImpl on any device
+    void slice_device(const GpuTensorImpl *A, const IndexRange &Cinds,
+                      const IndexRange &Ainds, double alpha, double beta);
+
+    /// C(Cinds) = alpha * A(Ainds) + beta * C(Cinds) for host elements A,
+    /// row-major with dimensions Adims
+    void slice_from_host(const double *A, const Dimension &Adims,
+                         const IndexRange &Cinds, const IndexRange &Ainds,
+                         double alpha, double beta);
+
+    /// C(Cinds) = alpha * this(Ainds) + beta * C(Cinds) for host elements C,
+    /// row-major with dimensions Cdims
+    void slice_to_host(double *C, const Dimension &Cdims,
+                       const IndexRange &Cinds, const IndexRange &Ainds,
+                       double alpha, double beta) const;
+
+  private:
+    /// @return A copy of the tensor as a CoreTensor
+    TensorImplPtr to_core() const;
+
+    int device_;
+    double *data_;
+};
+}
+
+typedef gpu::GpuTensorImpl *GpuTensorImplPtr;
+typedef const gpu::GpuTensorImpl *ConstGpuTensorImplPtr;
+}
+
+#endif
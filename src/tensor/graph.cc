@@ -0,0 +1,493 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#include <algorithm>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <ambit/graph.h>
+#include <ambit/settings.h>
+#include <ambit/timer.h>
+#include "contraction_path.h"
+#include "indices.h"
+#include "threads.h"
+
+namespace ambit
+{
+
+namespace
+{
+
+/// The Graph recording on this thread
+thread_local Graph *active_graph = nullptr;
+
+/// An operand of a recorded product: a term or a pairwise intermediate
+struct Operand
+{
+    /// Identifies the value of the operand up to the names of its indices
+    string key;
+    Indices indices;
+    double factor;
+    /// The term, or npos for intermediates
+    size_t term;
+    /// The intermediate, or npos for terms
+    size_t intermediate;
+};
+
+struct Step
+{
+    size_t first;
+    size_t second;
+    /// The operand produced
+    size_t result;
+    /// The intermediate produced (npos for the last step)
+    size_t intermediate;
+};
+
+struct Intermediate
+{
+    Tensor T;
+    /// The statement that computes the intermediate
+    size_t creator;
+    /// Number of steps that still read the intermediate
+    size_t uses;
+    bool computed;
+};
+
+const size_t npos = static_cast<size_t>(-1);
+
+/// Dimension of index, found in operand A (held by tA) or B (held by tB)
+size_t dim_by_index(const Operand &A, const Tensor &tA, const Operand &B,
+                    const Tensor &tB, const string &index)
+{
+    auto it = std::find(A.indices.begin(), A.indices.end(), index);
+    if (it != A.indices.end())
+        return tA.dim(it - A.indices.begin());
+    it = std::find(B.indices.begin(), B.indices.end(), index);
+    return tB.dim(it - B.indices.begin());
+}
+
+/// Key of the product A * B into result, with the indices renamed by order
+/// of first appearance so that equal products with other names match
+string product_key(const Operand &A, const Operand &B, const Indices &result)
+{
+    map<string, size_t> names;
+    auto rename = [&](const Indices &inds) {
+        string s;
+        for (const string &index : inds)
+        {
+            auto it = names.insert(std::make_pair(index, names.size())).first;
+            s += std::to_string(it->second) + ",";
+        }
+        return s;
+    };
+    string key = "(" + A.key + ":" + rename(A.indices) + ")*";
+    key += "(" + B.key + ":" + rename(B.indices) + ")";
+    return key + "->" + rename(result);
+}
+}
+
+Graph::Graph() : shared_products_(0L) {}
+
+Graph::~Graph()
+{
+    if (active_graph == this)
+        active_graph = nullptr;
+}
+
+void Graph::begin()
+{
+    if (active_graph != nullptr && active_graph != this)
+        throw std::runtime_error(
+            "Graph::begin: another Graph is recording on this thread.");
+    active_graph = this;
+}
+
+void Graph::end()
+{
+    if (active_graph == this)
+        active_graph = nullptr;
+}
+
+bool Graph::is_recording() const { return active_graph == this; }
+
+Graph *Graph::recording() { return active_graph; }
+
+void Graph::record(const LabeledTensor &target,
+                   const LabeledTensorContraction &rhs, bool zero_result,
+                   bool add, bool optimize_order)
+{
+    Statement statement;
+    statement.writes.push_back(target.T());
+    statement.reads.push_back(target.T());
+    statement.target = target.T();
+    statement.indices = target.indices();
+    for (size_t n = 0; n < rhs.size(); ++n)
+    {
+        statement.reads.push_back(rhs[n].T());
+        statement.terms.push_back(rhs[n]);
+    }
+    statement.zero_result = zero_result;
+    statement.add = add;
+    statement.optimize_order = optimize_order;
+    statements_.push_back(statement);
+}
+
+void Graph::record(const vector<Tensor> &writes, const vector<Tensor> &reads,
+                   const std::function<void()> &action)
+{
+    Statement statement;
+    statement.writes = writes;
+    statement.reads = reads;
+    statement.action = action;
+    statements_.push_back(statement);
+}
+
+void Graph::flush(std::initializer_list<const Tensor *> writes,
+                  std::initializer_list<const Tensor *> reads)
+{
+    Graph *graph = active_graph;
+    if (graph == nullptr || graph->statements_.empty())
+        return;
+
+    auto in = [](const Tensor *T, const vector<Tensor> &tensors) {
+        return std::find(tensors.begin(), tensors.end(), *T) != tensors.end();
+    };
+    bool depends = false;
+    for (const Statement &statement : graph->statements_)
+    {
+        for (const Tensor *T : writes)
+            depends = depends || in(T, statement.writes) ||
+                      in(T, statement.reads);
+        for (const Tensor *T : reads)
+            depends = depends || in(T, statement.writes);
+        if (depends)
+            break;
+    }
+    if (!depends)
+        return;
+
+    graph->execute();
+    graph->begin();
+}
+
+void Graph::execute()
+{
+    end();
+    vector<Statement> statements;
+    statements.swap(statements_);
+    shared_products_ = 0L;
+    size_t nstatements = statements.size();
+
+    // => Planning <= //
+
+    // Tensors are told apart by identity; a tensor's version counts the
+    // statements that wrote it, so reads separated by a write never match
+    vector<Tensor> tensors;
+    vector<size_t> versions;
+    // The first level at which a statement may read (write) each tensor
+    vector<size_t> read_level;
+    vector<size_t> write_level;
+    auto tensor_id = [&](const Tensor &T) {
+        for (size_t id = 0; id < tensors.size(); ++id)
+        {
+            if (tensors[id] == T)
+                return id;
+        }
+        tensors.push_back(T);
+        versions.push_back(0L);
+        read_level.push_back(0L);
+        write_level.push_back(0L);
+        return tensors.size() - 1;
+    };
+
+    vector<vector<Operand>> operands(nstatements);
+    vector<vector<Step>> steps(nstatements);
+    vector<Intermediate> intermediates;
+    map<string, size_t> key_to_intermediate;
+
+    // Statements of the same level are independent of each other
+    vector<size_t> levels(nstatements, 0L);
+    // Bytes of the intermediates each statement builds
+    vector<size_t> bytes(nstatements, 0L);
+    vector<bool> threadable(nstatements, true);
+
+    for (size_t s = 0; s < nstatements; ++s)
+    {
+        const Statement &statement = statements[s];
+        size_t level = 0L;
+        for (const Tensor &T : statement.reads)
+        {
+            level = std::max(level, read_level[tensor_id(T)]);
+            threadable[s] = threadable[s] && (T.type() == CoreTensor);
+        }
+        for (const Tensor &T : statement.writes)
+        {
+            level = std::max(level, write_level[tensor_id(T)]);
+            threadable[s] = threadable[s] && (T.type() == CoreTensor);
+        }
+
+        if (!statement.action)
+        {
+            size_t nterms = statement.terms.size();
+            vector<Indices> terms;
+            map<string, size_t> indices_to_size;
+            for (size_t n = 0; n < nterms; ++n)
+            {
+                const LabeledTensor &term = statement.terms[n];
+                size_t id = tensor_id(term.T());
+                terms.push_back(term.indices());
+                for (size_t i = 0; i < term.indices().size(); ++i)
+                    indices_to_size[term.indices()[i]] = term.T().dim(i);
+                operands[s].push_back(
+                    {"T" + std::to_string(id) + "." +
+                         std::to_string(versions[id]),
+                     term.indices(), term.factor(), n, npos});
+            }
+
+            contraction_path::Path path;
+            if (statement.optimize_order && nterms > 2)
+            {
+                LabeledTensorContraction rhs(statement.terms[0],
+                                             statement.terms[1]);
+                for (size_t n = 2; n < nterms; ++n)
+                    rhs *= statement.terms[n];
+                path = contraction_path::optimal_path(rhs, statement.indices,
+                                                      false);
+            }
+            else
+            {
+                vector<size_t> order(nterms);
+                std::iota(order.begin(), order.end(), 0);
+                path = contraction_path::chain(order);
+            }
+            vector<Indices> kept = contraction_path::intermediate_indices(
+                terms, statement.indices, path);
+
+            for (size_t k = 0; k < path.size(); ++k)
+            {
+                Step step{path[k].first, path[k].second, nterms + k, npos};
+                if (k + 1 < path.size())
+                {
+                    // Either order gives the same product; take the one with
+                    // the smaller key so that A * B and B * A match
+                    const Operand &A = operands[s][step.first];
+                    const Operand &B = operands[s][step.second];
+                    Indices AB = indices::pair_contraction_result(
+                        A.indices, B.indices, kept[k]);
+                    Indices BA = indices::pair_contraction_result(
+                        B.indices, A.indices, kept[k]);
+                    string AB_key = product_key(A, B, AB);
+                    string BA_key = product_key(B, A, BA);
+                    if (BA_key < AB_key)
+                    {
+                        std::swap(step.first, step.second);
+                        AB.swap(BA);
+                        AB_key.swap(BA_key);
+                    }
+                    double factor = A.factor * B.factor;
+
+                    auto it = key_to_intermediate.find(AB_key);
+                    if (it == key_to_intermediate.end())
+                    {
+                        it = key_to_intermediate
+                                 .insert(std::make_pair(AB_key,
+                                                        intermediates.size()))
+                                 .first;
+                        intermediates.push_back({Tensor(), s, 0L, false});
+                        size_t numel = 1L;
+                        for (const string &index : AB)
+                            numel *= indices_to_size[index];
+                        bytes[s] += numel * sizeof(double);
+                    }
+                    else
+                    {
+                        // Reused products wait for the statement computing
+                        // them
+                        shared_products_++;
+                        size_t creator = intermediates[it->second].creator;
+                        if (creator != s)
+                            level = std::max(level, levels[creator] + 1);
+                    }
+                    step.intermediate = it->second;
+                    intermediates[step.intermediate].uses++;
+
+                    operands[s].push_back(
+                        {"{" + AB_key + "}", AB, factor, npos, it->second});
+                }
+                steps[s].push_back(step);
+            }
+        }
+
+        levels[s] = level;
+        for (const Tensor &T : statement.reads)
+        {
+            size_t id = tensor_id(T);
+            write_level[id] = std::max(write_level[id], level + 1);
+        }
+        for (const Tensor &T : statement.writes)
+        {
+            size_t id = tensor_id(T);
+            versions[id]++;
+            read_level[id] = std::max(read_level[id], level + 1);
+            write_level[id] = std::max(write_level[id], level + 1);
+        }
+    }
+
+    // => Execution <= //
+
+    std::mutex intermediates_mutex;
+    auto run = [&](size_t s) {
+        const Statement &statement = statements[s];
+        if (statement.action)
+        {
+            statement.action();
+            return;
+        }
+
+        Tensor target = statement.target;
+        vector<Tensor> values;
+        for (const LabeledTensor &term : statement.terms)
+            values.push_back(term.T());
+        values.resize(operands[s].size());
+
+        for (const Step &step : steps[s])
+        {
+            const Operand &A = operands[s][step.first];
+            const Operand &B = operands[s][step.second];
+            const Tensor &tA = values[step.first];
+            const Tensor &tB = values[step.second];
+
+            if (step.intermediate == npos)
+            {
+                double factor = A.factor * B.factor;
+                target.contract(tA, tB, statement.indices, A.indices,
+                                B.indices, statement.add ? factor : -factor,
+                                statement.zero_result ? 0.0 : 1.0);
+            }
+            else
+            {
+                Intermediate &I = intermediates[step.intermediate];
+                const Indices &inds = operands[s][step.result].indices;
+                std::unique_lock<std::mutex> lock(intermediates_mutex);
+                if (!I.computed)
+                {
+                    lock.unlock();
+                    Dimension dims;
+                    for (const string &index : inds)
+                        dims.push_back(dim_by_index(A, tA, B, tB, index));
+                    Tensor T = Tensor::build_uninitialized(
+                        tA.type(), tA.name() + " * " + tB.name(), dims);
+                    T.contract(tA, tB, inds, A.indices, B.indices, 1.0, 0.0);
+                    lock.lock();
+                    I.T = T;
+                    I.computed = true;
+                }
+                values[step.result] = I.T;
+            }
+
+            // Free the intermediates read for the last time
+            std::lock_guard<std::mutex> lock(intermediates_mutex);
+            for (size_t operand : {step.first, step.second})
+            {
+                size_t id = operands[s][operand].intermediate;
+                if (id == npos)
+                    continue;
+                values[operand] = Tensor();
+                if (--intermediates[id].uses == 0L)
+                    intermediates[id].T = Tensor();
+            }
+        }
+    };
+
+    size_t nlevels = 0L;
+    for (size_t level : levels)
+        nlevels = std::max(nlevels, level + 1);
+    vector<vector<size_t>> by_level(nlevels);
+    for (size_t s = 0; s < nstatements; ++s)
+        by_level[levels[s]].push_back(s);
+
+    for (const vector<size_t> &level : by_level)
+    {
+        // Admit independent statements together while their intermediates
+        // fit in memory_limit; the others run one at a time
+        vector<vector<size_t>> batches;
+        vector<size_t> batch;
+        size_t batch_bytes = 0L;
+        for (size_t s : level)
+        {
+            if (!threadable[s])
+            {
+                batches.push_back({s});
+                continue;
+            }
+            if (!batch.empty() &&
+                batch_bytes + bytes[s] > settings::memory_limit)
+            {
+                batches.push_back(batch);
+                batch.clear();
+                batch_bytes = 0L;
+            }
+            batch.push_back(s);
+            batch_bytes += bytes[s];
+        }
+        if (!batch.empty())
+            batches.push_back(batch);
+
+        for (const vector<size_t> &b : batches)
+        {
+            size_t nbatch = b.size();
+            std::exception_ptr error;
+            threads::TaskThreads split(nbatch);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(split.outer())     \
+    proc_bind(spread) if (nbatch > 1)
+            for (size_t n = 0; n < nbatch; ++n)
+            {
+                split.enter();
+                AMBIT_TIMER_PUSH("graph statement");
+                try
+                {
+                    run(b[n]);
+                }
+                catch (...)
+                {
+#pragma omp critical(ambit_graph_error)
+                    if (!error)
+                        error = std::current_exception();
+                }
+                AMBIT_TIMER_POP();
+            }
+            if (error)
+                std::rethrow_exception(error);
+        }
+    }
+}
+}
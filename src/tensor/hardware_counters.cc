@@ -0,0 +1,150 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#include "hardware_counters.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#endif
+
+namespace ambit
+{
+
+namespace hardware_counters
+{
+
+#if defined(__linux__)
+
+namespace
+{
+
+const uint64_t events[] = {PERF_COUNT_HW_CPU_CYCLES,
+                           PERF_COUNT_HW_INSTRUCTIONS,
+                           PERF_COUNT_HW_CACHE_MISSES};
+const int nevent = sizeof(events) / sizeof(events[0]);
+
+/// The counters of one thread, read together as a group led by the cycles
+struct Group
+{
+    int fds[nevent];
+    bool opened = false;
+
+    Group()
+    {
+        for (int n = 0; n < nevent; ++n)
+            fds[n] = -1;
+
+        for (int n = 0; n < nevent; ++n)
+        {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = events[n];
+            // User space only, which unprivileged processes may count
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP |
+                               PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[n] = static_cast<int>(
+                syscall(__NR_perf_event_open, &attr, 0, -1,
+                        n == 0 ? -1 : fds[0], 0));
+            // No PMU (e.g. in a virtual machine) or not permitted
+            if (fds[n] < 0)
+            {
+                close_all();
+                return;
+            }
+        }
+        opened = true;
+    }
+    ~Group() { close_all(); }
+
+    void close_all()
+    {
+        for (int n = nevent - 1; n >= 0; --n)
+        {
+            if (fds[n] >= 0)
+                close(fds[n]);
+            fds[n] = -1;
+        }
+        opened = false;
+    }
+};
+
+Group &thread_group()
+{
+    thread_local Group group;
+    return group;
+}
+} // anonymous namespace
+
+bool available() { return thread_group().opened; }
+
+Sample read()
+{
+    Sample sample;
+    Group &group = thread_group();
+    if (!group.opened)
+        return sample;
+
+    struct
+    {
+        uint64_t nr;
+        uint64_t time_enabled;
+        uint64_t time_running;
+        uint64_t values[nevent];
+    } data;
+    if (::read(group.fds[0], &data, sizeof(data)) !=
+            static_cast<ssize_t>(sizeof(data)) ||
+        data.time_running == 0)
+        return sample;
+
+    double scale = static_cast<double>(data.time_enabled) /
+                   static_cast<double>(data.time_running);
+    sample.cycles = scale * data.values[0];
+    sample.instructions = scale * data.values[1];
+    sample.llc_misses = scale * data.values[2];
+    return sample;
+}
+
+#else
+
+bool available() { return false; }
+
+Sample read() { return Sample(); }
+
+#endif
+}
+}
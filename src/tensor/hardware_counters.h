@@ -0,0 +1,75 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#if !defined(TENSOR_HARDWARE_COUNTERS_H)
+#define TENSOR_HARDWARE_COUNTERS_H
+
+namespace ambit
+{
+
+namespace hardware_counters
+{
+
+/// Hardware event counts of the calling thread (scaled up when the kernel
+/// multiplexed the counters)
+struct Sample
+{
+    double cycles = 0.0;
+    double instructions = 0.0;
+    /// Last-level cache misses
+    double llc_misses = 0.0;
+
+    Sample &operator+=(const Sample &other)
+    {
+        cycles += other.cycles;
+        instructions += other.instructions;
+        llc_misses += other.llc_misses;
+        return *this;
+    }
+    Sample operator-(const Sample &other) const
+    {
+        Sample result = *this;
+        result.cycles -= other.cycles;
+        result.instructions -= other.instructions;
+        result.llc_misses -= other.llc_misses;
+        return result;
+    }
+};
+
+/// @return Can the counters be read on the calling thread? The counters of
+/// a thread are opened (through Linux perf_event) by its first call.
+bool available();
+
+/// @return The counts of the calling thread since its counters were opened,
+/// zero if they are not available
+Sample read();
+}
+}
+
+#endif
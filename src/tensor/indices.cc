@@ -245,6 +245,37 @@ vector<Indices> determine_contraction_result(const LabeledTensor &A,
     return determine_contraction_result_from_indices(A.indices(), B.indices());
 }
 
+Indices pair_contraction_result(const Indices &A, const Indices &B,
+                                const Indices &kept)
+{
+    vector<Indices> AB_indices =
+        determine_contraction_result_from_indices(A, B);
+    Indices result;
+
+    // Common indices that are still needed are Hadamard indices
+    for (const string &index : AB_indices[0])
+    {
+        if (std::binary_search(kept.begin(), kept.end(), index))
+            result.push_back(index);
+    }
+    result.insert(result.end(), AB_indices[1].begin(), AB_indices[1].end());
+    result.insert(result.end(), AB_indices[2].begin(), AB_indices[2].end());
+    return result;
+}
+
+Dimension pair_contraction_dims(const LabeledTensor &A, const LabeledTensor &B,
+                                const Indices &indices)
+{
+    Dimension dims;
+    for (const string &index : indices)
+    {
+        bool in_A = std::find(A.indices().begin(), A.indices().end(),
+                              index) != A.indices().end();
+        dims.push_back(in_A ? A.dim_by_index(index) : B.dim_by_index(index));
+    }
+    return dims;
+}
+
 } // namespace  indices
 
 } // namespace tensor
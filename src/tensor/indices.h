@@ -68,6 +68,15 @@ vector<Indices> determine_contraction_result(const LabeledTensor &A,
 vector<Indices> determine_contraction_result_from_indices(Indices Aindices,
                                                           Indices Bindices);
 
+/// Indices of the intermediate A * B that keeps the (sorted) indices kept:
+/// the kept common indices followed by those found only in A and only in B
+Indices pair_contraction_result(const Indices &A, const Indices &B,
+                                const Indices &kept);
+
+/// Dimension of each of indices, each found in A or B
+Dimension pair_contraction_dims(const LabeledTensor &A, const LabeledTensor &B,
+                                const Indices &indices);
+
 // Returns a comma separated list of the indices
 string to_string(const Indices &indices, const string &sep = ",");
 
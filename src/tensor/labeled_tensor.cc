@@ -29,17 +29,183 @@
 
 #include <list>
 #include <algorithm>
+#include <exception>
+#include <future>
 #include <numeric>
 #include <ambit/tensor.h>
+#include <ambit/graph.h>
+#include <ambit/memory.h>
+#include <ambit/settings.h>
 #include "tensorimpl.h"
 #include "indices.h"
-#include <cstring>
+#include "contraction_path.h"
+#include "threads.h"
+#include "core/core.h"
 
 namespace ambit
 {
 
+namespace
+{
+
+/// The type of an intermediate of A and B: that of A, or that of B when A
+/// is a LazyTensor, which cannot be written
+TensorType intermediate_type(const Tensor &A, const Tensor &B)
+{
+    if (A.type() != LazyTensor)
+        return A.type();
+    if (B.type() != LazyTensor)
+        return B.type();
+    return AgnosticTensor;
+}
+
+/// Cost of contracting two index sets into result: the number of
+/// multiply-adds and the number of elements held by the three operands
+pair<double, double> pair_contraction_cost(
+    const Indices &first, const Indices &second, const Indices &result,
+    const map<string, size_t> &indices_to_size)
+{
+    auto size_of = [&](const Indices &inds) {
+        double size = 1.0;
+        for (const string &s : inds)
+            size *= indices_to_size.at(s);
+        return size;
+    };
+    Indices all;
+    std::set_union(first.begin(), first.end(), second.begin(), second.end(),
+                   back_inserter(all));
+    return std::make_pair(size_of(all), size_of(first) + size_of(second) +
+                                            size_of(result));
+}
+
+/// The tensors read by the right-hand side of a statement
+vector<Tensor> read_tensors(const LabeledTensor &rhs) { return {rhs.T()}; }
+vector<Tensor> read_tensors(const LabeledTensorAddition &rhs)
+{
+    vector<Tensor> reads;
+    for (const LabeledTensor &ti : rhs)
+        reads.push_back(ti.T());
+    return reads;
+}
+vector<Tensor> read_tensors(const LabeledTensorPermutation &rhs)
+{
+    vector<Tensor> reads;
+    for (size_t n = 0; n < rhs.terms().size(); ++n)
+        reads.push_back(rhs.terms()[n].T());
+    return reads;
+}
+vector<Tensor> read_tensors(double) { return {}; }
+
+/**
+ * Records lhs op rhs in the Graph recording on this thread, if any. The
+ * statement keeps copies of lhs and rhs and calls op on them when the Graph
+ * executes. Returns false if nothing is recording.
+ */
+template <typename Rhs, typename Op>
+bool defer(const LabeledTensor &lhs, Op op, const Rhs &rhs)
+{
+    Graph *graph = Graph::recording();
+    if (graph == nullptr)
+        return false;
+    LabeledTensor target(lhs);
+    vector<Tensor> reads = read_tensors(rhs);
+    reads.push_back(target.T());
+    graph->record({target.T()}, reads, [=]() mutable { op(target, rhs); });
+    return true;
+}
+
+/**
+ * Evaluates a full contraction of CoreTensor's with fused_reduction, which
+ * streams the terms instead of forming intermediates. This is used when
+ * the single pass over all indices costs no more than twice the multiply-adds
+ * of the best pairwise order (it always is for two terms). Returns false if
+ * the contraction is left to the pairwise path.
+ */
+bool fused_scalar(const vector<LabeledTensor> &terms, double factor,
+                  double &value)
+{
+    map<string, size_t> indices_to_size;
+    map<string, size_t> counts;
+    vector<const double *> data;
+    vector<Dimension> dims;
+    vector<Indices> inds;
+    for (const LabeledTensor &ti : terms)
+    {
+        if (ti.T().type() != CoreTensor || ti.T().is_view())
+            return false;
+        Indices unique = ti.indices();
+        std::sort(unique.begin(), unique.end());
+        unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+        for (const string &index : unique)
+            counts[index]++;
+        data.push_back(ti.T().data().data());
+        dims.push_back(ti.T().dims());
+        inds.push_back(ti.indices());
+        factor *= ti.factor();
+        for (size_t i = 0; i < ti.indices().size(); ++i)
+            indices_to_size[ti.indices()[i]] = ti.T().dim(i);
+    }
+
+    // Indices found in a single term are errors for the pairwise path
+    for (const auto &count : counts)
+    {
+        if (count.second < 2L)
+            return false;
+    }
+
+    if (terms.size() > 2L)
+    {
+        double fused_cost = 1.0;
+        for (const auto &index : indices_to_size)
+            fused_cost *= index.second;
+        auto cost = [&](const Indices &first, const Indices &second,
+                        const Indices &result) {
+            return pair_contraction_cost(first, second, result,
+                                         indices_to_size);
+        };
+        contraction_path::Path path =
+            contraction_path::optimize(inds, {}, cost);
+        double pair_cost =
+            contraction_path::path_cost(inds, {}, path, cost).first;
+        if (fused_cost > 2.0 * pair_cost)
+            return false;
+    }
+
+    value = fused_reduction(data, dims, inds, factor);
+    return true;
+}
+}
+
+contraction_path::Path
+contraction_path::optimal_path(const LabeledTensorContraction &rhs,
+                               const Indices &result, bool linear)
+{
+    vector<Indices> terms;
+    map<string, size_t> indices_to_size;
+    string key = indices::to_string(result) + "=";
+    for (size_t n = 0; n < rhs.size(); ++n)
+    {
+        const LabeledTensor &ti = rhs[n];
+        terms.push_back(ti.indices());
+        key += "|" + indices::to_string(ti.indices()) + ":";
+        for (size_t i = 0; i < ti.indices().size(); ++i)
+        {
+            indices_to_size[ti.indices()[i]] = ti.T().dim(i);
+            key += std::to_string(ti.T().dim(i)) + ",";
+        }
+    }
+    return contraction_path::optimize_cached(
+        key, terms, result,
+        [&](const Indices &first, const Indices &second,
+            const Indices &inds) {
+            return pair_contraction_cost(first, second, inds,
+                                         indices_to_size);
+        },
+        linear);
+}
+
 LabeledTensor::LabeledTensor(Tensor T, const Indices &indices, double factor)
-    : T_(T), indices_(indices), factor_(factor)
+    : T_(std::move(T)), indices_(indices), factor_(factor)
 {
     if (T_.rank() != indices.size())
         throw std::runtime_error("Labeled tensor does not have correct number "
@@ -71,6 +237,10 @@ void LabeledTensor::operator=(const LabeledTensor &rhs)
         throw std::runtime_error("Self assignment is not allowed.");
     if (T_.rank() != rhs.T().rank())
         throw std::runtime_error("Permuted tensors do not have same rank");
+    if (defer(*this, [](LabeledTensor &lhs, const LabeledTensor &x) {
+            lhs = x;
+        }, rhs))
+        return;
     T_.permute(rhs.T(), indices_, rhs.indices(), rhs.factor(), 0.0);
 }
 
@@ -80,6 +250,10 @@ void LabeledTensor::operator+=(const LabeledTensor &rhs)
         throw std::runtime_error("Self assignment is not allowed.");
     if (T_.rank() != rhs.T().rank())
         throw std::runtime_error("Permuted tensors do not have same rank");
+    if (defer(*this, [](LabeledTensor &lhs, const LabeledTensor &x) {
+            lhs += x;
+        }, rhs))
+        return;
     T_.permute(rhs.T(), indices_, rhs.indices(), rhs.factor(), 1.0);
 }
 
@@ -89,6 +263,10 @@ void LabeledTensor::operator-=(const LabeledTensor &rhs)
         throw std::runtime_error("Self assignment is not allowed.");
     if (T_.rank() != rhs.T().rank())
         throw std::runtime_error("Permuted tensors do not have same rank");
+    if (defer(*this, [](LabeledTensor &lhs, const LabeledTensor &x) {
+            lhs -= x;
+        }, rhs))
+        return;
     T_.permute(rhs.T(), indices_, rhs.indices(), -rhs.factor(), 1.0);
 }
 
@@ -131,8 +309,8 @@ LabeledTensor tensor_product_get_temp_AB(const LabeledTensor &A,
         indices.push_back(B_fix_idx[i]);
     }
 
-    Tensor T =
-        Tensor::build(A.T().type(), A.T().name() + " * " + B.T().name(), dims);
+    Tensor T = Tensor::build(intermediate_type(A.T(), B.T()),
+                             A.T().name() + " * " + B.T().name(), dims);
     return T(indices::to_string(indices));
 }
 }
@@ -140,75 +318,56 @@ LabeledTensor tensor_product_get_temp_AB(const LabeledTensor &A,
 void LabeledTensor::contract(const LabeledTensorContraction &rhs,
                              bool zero_result, bool add, bool optimize_order)
 {
+    if (Graph *graph = Graph::recording())
+    {
+        graph->record(*this, rhs, zero_result, add, optimize_order);
+        return;
+    }
+
     size_t nterms = rhs.size();
-    std::vector<size_t> perm(nterms);
-    std::vector<size_t> best_perm(nterms);
-    std::iota(perm.begin(), perm.end(), 0);
-    std::pair<double, double> best_cpu_memory_cost(1.0e200, 1.0e200);
+    vector<Indices> terms;
+    for (size_t n = 0; n < nterms; ++n)
+        terms.push_back(rhs[n].indices());
 
-    if (optimize_order) {
-        do
-        {
-            std::pair<double, double> cpu_memory_cost =
-                rhs.compute_contraction_cost(perm);
-            if (cpu_memory_cost.first < best_cpu_memory_cost.first)
-            {
-                best_perm = perm;
-                best_cpu_memory_cost = cpu_memory_cost;
-            }
-        } while (std::next_permutation(perm.begin(), perm.end()));
-        // at this point 'best_perm' should be used to perform contraction in
-        // optimal order.
-    } else {
-        best_perm = perm;
+    contraction_path::Path path;
+    if (optimize_order && nterms > 2)
+    {
+        path = contraction_path::optimal_path(rhs, indices(), false);
     }
-
-    const LabeledTensor &Aref = rhs[best_perm[0]];
-    LabeledTensor A(Aref.T_, Aref.indices_, Aref.factor_);
-    int maxn = int(nterms) - 2;
-    for (int n = 0; n < maxn; ++n)
+    else
     {
-        const LabeledTensor &B = rhs[best_perm[n + 1]];
+        vector<size_t> order(nterms);
+        std::iota(order.begin(), order.end(), 0);
+        path = contraction_path::chain(order);
+    }
+    vector<Indices> kept =
+        contraction_path::intermediate_indices(terms, indices(), path);
 
-        std::vector<Indices> AB_indices =
-            indices::determine_contraction_result(A, B);
-        const Indices &AB_common_idx = AB_indices[0];
-        const Indices &A_fix_idx = AB_indices[1];
-        const Indices &B_fix_idx = AB_indices[2];
-        Dimension dims;
-        Indices indices;
+    // Operands of the path: the terms followed by the intermediates
+    vector<LabeledTensor> operands;
+    for (size_t n = 0; n < nterms; ++n)
+        operands.push_back(rhs[n]);
 
-        for (size_t i = 0; i < AB_common_idx.size(); ++i)
-        {
-            // If a common index is also found in the rhs it's a Hadamard index
-            if (std::find(this->indices().begin(), this->indices().end(),
-                          AB_common_idx[i]) != this->indices().end())
-            {
-                dims.push_back(A.dim_by_index(AB_common_idx[i]));
-                indices.push_back(AB_common_idx[i]);
-            }
-        }
+    for (size_t k = 0; k + 1 < path.size(); ++k)
+    {
+        const LabeledTensor &A = operands[path[k].first];
+        const LabeledTensor &B = operands[path[k].second];
 
-        for (size_t i = 0; i < A_fix_idx.size(); ++i)
-        {
-            dims.push_back(A.dim_by_index(A_fix_idx[i]));
-            indices.push_back(A_fix_idx[i]);
-        }
-        for (size_t i = 0; i < B_fix_idx.size(); ++i)
-        {
-            dims.push_back(B.dim_by_index(B_fix_idx[i]));
-            indices.push_back(B_fix_idx[i]);
-        }
+        Indices AB_indices =
+            indices::pair_contraction_result(A.indices(), B.indices(), kept[k]);
+        Dimension dims = indices::pair_contraction_dims(A, B, AB_indices);
 
-        Tensor tAB = Tensor::build(A.T().type(),
-                                   A.T().name() + " * " + B.T().name(), dims);
+        Tensor tAB = Tensor::build_uninitialized(
+            intermediate_type(A.T(), B.T()),
+            A.T().name() + " * " + B.T().name(), dims);
 
-        tAB.contract(A.T(), B.T(), indices, A.indices(), B.indices(),
+        tAB.contract(A.T(), B.T(), AB_indices, A.indices(), B.indices(),
                      A.factor() * B.factor(), 0.0);
 
-        A.set(LabeledTensor(tAB, indices, 1.0));
+        operands.push_back(LabeledTensor(std::move(tAB), AB_indices, 1.0));
     }
-    const LabeledTensor &B = rhs[best_perm[nterms - 1]];
+    const LabeledTensor &A = operands[path.back().first];
+    const LabeledTensor &B = operands[path.back().second];
 
     T_.contract(A.T(), B.T(), indices(), A.indices(), B.indices(),
                 add ? A.factor() * B.factor() : -A.factor() * B.factor(),
@@ -247,47 +406,216 @@ void LabeledTensor::operator-=(const LabeledTensorBatchedContraction &rhs)
 
 void LabeledTensor::operator=(const LabeledTensorAddition &rhs)
 {
-    T_.zero();
+    if (defer(*this, [](LabeledTensor &lhs, const LabeledTensorAddition &x) {
+            lhs = x;
+        }, rhs))
+        return;
+    sum(rhs, 1.0, 0.0);
+}
+
+void LabeledTensor::operator+=(const LabeledTensorAddition &rhs)
+{
+    if (defer(*this, [](LabeledTensor &lhs, const LabeledTensorAddition &x) {
+            lhs += x;
+        }, rhs))
+        return;
+    sum(rhs, 1.0, 1.0);
+}
+
+void LabeledTensor::operator-=(const LabeledTensorAddition &rhs)
+{
+    if (defer(*this, [](LabeledTensor &lhs, const LabeledTensorAddition &x) {
+            lhs -= x;
+        }, rhs))
+        return;
+    sum(rhs, -1.0, 1.0);
+}
+
+void LabeledTensor::sum(const LabeledTensorAddition &rhs, double sign,
+                        double beta)
+{
+    vector<Tensor> As;
+    vector<Indices> Ainds;
+    vector<double> alphas;
     for (size_t ind = 0, end = rhs.size(); ind < end; ++ind)
     {
         if (T_ == rhs[ind].T())
             throw std::runtime_error("Self assignment is not allowed.");
         if (T_.rank() != rhs[ind].T().rank())
             throw std::runtime_error("Permuted tensors do not have same rank");
-        T_.permute(rhs[ind].T(), indices_, rhs[ind].indices(),
-                   rhs[ind].factor(), 1.0);
+        As.push_back(rhs[ind].T());
+        Ainds.push_back(rhs[ind].indices());
+        alphas.push_back(sign * rhs[ind].factor());
     }
+    // All the terms are added in one pass over T_
+    T_.permute_sum(As, indices_, Ainds, alphas, beta);
 }
 
-void LabeledTensor::operator+=(const LabeledTensorAddition &rhs)
+void LabeledTensor::operator=(const LabeledTensorPermutation &rhs)
 {
-    for (size_t ind = 0, end = rhs.size(); ind < end; ++ind)
+    if (defer(*this, [](LabeledTensor &lhs, const LabeledTensorPermutation &x) {
+            lhs = x;
+        }, rhs))
+        return;
+    permute_terms(rhs, 1.0, 0.0);
+}
+
+void LabeledTensor::operator+=(const LabeledTensorPermutation &rhs)
+{
+    if (defer(*this, [](LabeledTensor &lhs, const LabeledTensorPermutation &x) {
+            lhs += x;
+        }, rhs))
+        return;
+    permute_terms(rhs, 1.0, 1.0);
+}
+
+void LabeledTensor::operator-=(const LabeledTensorPermutation &rhs)
+{
+    if (defer(*this, [](LabeledTensor &lhs, const LabeledTensorPermutation &x) {
+            lhs -= x;
+        }, rhs))
+        return;
+    permute_terms(rhs, -1.0, 1.0);
+}
+
+void LabeledTensor::permute_terms(const LabeledTensorPermutation &rhs,
+                                  double sign, double beta)
+{
+    const LabeledTensorContraction &terms = rhs.terms();
+    for (const Indices &group : rhs.permutation().groups())
     {
-        if (T_ == rhs[ind].T())
+        for (const string &index : group)
+        {
+            if (std::find(indices_.begin(), indices_.end(), index) ==
+                indices_.end())
+                throw std::runtime_error("P: index " + index +
+                                         " is not an index of the result");
+        }
+    }
+
+    // A single tensor is permuted in place, a product is contracted once
+    // into a temporary with the indices of the result
+    Tensor X;
+    Indices Xinds;
+    double factor = sign;
+    if (terms.size() == 1)
+    {
+        if (T_ == terms[0].T())
             throw std::runtime_error("Self assignment is not allowed.");
-        if (T_.rank() != rhs[ind].T().rank())
+        if (T_.rank() != terms[0].T().rank())
             throw std::runtime_error("Permuted tensors do not have same rank");
-        T_.permute(rhs[ind].T(), indices_, rhs[ind].indices(),
-                   rhs[ind].factor(), 1.0);
+        X = terms[0].T();
+        Xinds = terms[0].indices();
+        factor *= terms[0].factor();
+    }
+    else
+    {
+        X = Tensor::build(T_.type(), "P(" + T_.name() + ")", T_.dims());
+        LabeledTensor(X, indices_) = terms;
+        Xinds = indices_;
+    }
+
+    vector<Tensor> As;
+    vector<Indices> Ainds;
+    vector<double> alphas;
+    for (const auto &term : rhs.permutation().apply(Xinds))
+    {
+        As.push_back(X);
+        Ainds.push_back(term.first);
+        alphas.push_back(factor * term.second);
     }
+    T_.permute_sum(As, indices_, Ainds, alphas, beta);
 }
 
-void LabeledTensor::operator-=(const LabeledTensorAddition &rhs)
+IndexPermutation P(const string &indices)
 {
-    for (size_t ind = 0, end = rhs.size(); ind < end; ++ind)
+    return IndexPermutation(indices::split(indices));
+}
+
+IndexPermutation IndexPermutation::operator*(const IndexPermutation &other) const
+{
+    IndexPermutation product(*this);
+    for (const Indices &group : other.groups_)
     {
-        if (T_ == rhs[ind].T())
-            throw std::runtime_error("Self assignment is not allowed.");
-        if (T_.rank() != rhs[ind].T().rank())
-            throw std::runtime_error("Permuted tensors do not have same rank");
-        T_.permute(rhs[ind].T(), indices_, rhs[ind].indices(),
-                   -rhs[ind].factor(), 1.0);
+        for (const string &index : group)
+        {
+            for (const Indices &mine : groups_)
+                if (std::find(mine.begin(), mine.end(), index) != mine.end())
+                    throw std::runtime_error(
+                        "P: index " + index + " is permuted twice");
+        }
+        product.groups_.push_back(group);
     }
+    return product;
+}
+
+LabeledTensorPermutation IndexPermutation::operator*(const LabeledTensor &rhs) const
+{
+    LabeledTensorContraction terms;
+    terms *= rhs;
+    return LabeledTensorPermutation(*this, terms);
 }
 
-void LabeledTensor::operator*=(double scale) { T_.scale(scale); }
+LabeledTensorPermutation
+IndexPermutation::operator*(const LabeledTensorContraction &rhs) const
+{
+    return LabeledTensorPermutation(*this, rhs);
+}
 
-void LabeledTensor::operator/=(double scale) { T_.scale(1.0 / scale); }
+vector<pair<Indices, double>> IndexPermutation::apply(const Indices &indices) const
+{
+    vector<pair<Indices, double>> terms(1, std::make_pair(indices, 1.0));
+    for (const Indices &group : groups_)
+    {
+        // Every ordering of the group, with the sign of its inversions
+        vector<size_t> order(group.size());
+        std::iota(order.begin(), order.end(), 0L);
+        vector<pair<vector<size_t>, double>> orders;
+        do
+        {
+            size_t inversions = 0L;
+            for (size_t a = 0; a < order.size(); ++a)
+                for (size_t b = a + 1; b < order.size(); ++b)
+                    inversions += (order[a] > order[b]);
+            orders.push_back(
+                std::make_pair(order, inversions % 2L ? -1.0 : 1.0));
+        } while (std::next_permutation(order.begin(), order.end()));
+
+        vector<pair<Indices, double>> next;
+        for (const auto &term : terms)
+        {
+            for (const auto &ordering : orders)
+            {
+                Indices relabeled = term.first;
+                for (string &index : relabeled)
+                {
+                    size_t pos = std::find(group.begin(), group.end(), index) -
+                                 group.begin();
+                    if (pos < group.size())
+                        index = group[ordering.first[pos]];
+                }
+                next.push_back(
+                    std::make_pair(relabeled, term.second * ordering.second));
+            }
+        }
+        terms.swap(next);
+    }
+    return terms;
+}
+
+void LabeledTensor::operator*=(double scale)
+{
+    if (defer(*this, [](LabeledTensor &lhs, double x) { lhs *= x; }, scale))
+        return;
+    T_.scale(scale);
+}
+
+void LabeledTensor::operator/=(double scale)
+{
+    if (defer(*this, [](LabeledTensor &lhs, double x) { lhs /= x; }, scale))
+        return;
+    T_.scale(1.0 / scale);
+}
 
 LabeledTensorDistribution LabeledTensor::
 operator*(const LabeledTensorAddition &rhs)
@@ -297,7 +625,8 @@ operator*(const LabeledTensorAddition &rhs)
 
 void LabeledTensor::operator=(const LabeledTensorDistribution &rhs)
 {
-    T_.zero();
+    if (!defer(*this, [](LabeledTensor &lhs, double) { lhs.T_.zero(); }, 0.0))
+        T_.zero();
 
     for (const LabeledTensor &B : rhs.B())
     {
@@ -353,7 +682,15 @@ LabeledTensorAddition &LabeledTensorAddition::operator-()
 
 LabeledTensorContraction::operator double() const
 {
-    Tensor R = Tensor::build(tensors_[0].T().type(), "R", {});
+    if (Graph::recording())
+        throw std::runtime_error(
+            "Scalar contractions cannot be evaluated while a Graph records.");
+    double value;
+    if (fused_scalar(tensors_, 1.0, value))
+        return value;
+
+    Tensor R = Tensor::build(
+        intermediate_type(tensors_[0].T(), tensors_.back().T()), "R", {});
     LabeledTensor lR(R, {}, 1.0);
     lR.contract(*this, true, true);
 
@@ -464,364 +801,350 @@ pair<double, double> LabeledTensorContraction::compute_contraction_cost(
 
 LabeledTensorDistribution::operator double() const
 {
-    Tensor R = Tensor::build(A_.T().type(), "R", {});
-
+    if (Graph::recording())
+        throw std::runtime_error(
+            "Scalar contractions cannot be evaluated while a Graph records.");
+    bool fused = (A_.T().type() == CoreTensor);
+    for (const LabeledTensor &B : B_)
+        fused = fused && (B.T().type() == CoreTensor);
+
+    // Terms the fused kernel does not take (e.g. indices that do not pair
+    // up) go through R.contract, which reports an invalid topology
+    double sum = 0.0;
+    Tensor R;
+    bool pairwise = false;
     for (size_t ind = 0L; ind < B_.size(); ind++)
     {
+        double value = 0.0;
+        if (fused && fused_scalar({A_, B_[ind]}, 1.0, value))
+        {
+            sum += value;
+            continue;
+        }
+        if (!pairwise)
+            R = Tensor::build(intermediate_type(A_.T(), A_.T()), "R", {});
+        pairwise = true;
 
         R.contract(A_.T(), B_[ind].T(), {}, A_.indices(), B_[ind].indices(),
                    A_.factor() * B_[ind].factor(), 1.0);
     }
+    if (!pairwise)
+        return sum;
 
     Tensor C = Tensor::build(CoreTensor, "C", {});
     C.slice(R, {}, {});
 
-    return C.data()[0];
-}
-
-LabeledTensorBatchedContraction batched(const string &batched_indices, const LabeledTensorContraction &contraction) {
-    return LabeledTensorBatchedContraction(contraction, indices::split(batched_indices));
+    return sum + C.data()[0];
 }
 
-void LabeledTensor::contract_batched(const LabeledTensorBatchedContraction &rhs_batched,
-                             bool zero_result, bool add, bool optimize_order)
+namespace
 {
-    const LabeledTensorContraction &rhs = rhs_batched.get_contraction();
-    const Indices &batched_indices = rhs_batched.get_batched_indices();
 
-    // Find the indices to be batched in result labeled tensor.
-    size_t batched_size = batched_indices.size();
-    std::vector<size_t> slicing_axis(batched_size);
-    for (size_t l = 0; l < batched_size; ++l) {
-        auto it = std::find(indices_.begin(), indices_.end(), batched_indices[l]);
-        if (it != indices_.end()) {
-            slicing_axis[l] = std::distance(indices_.begin(), it);
-        } else {
-            throw std::runtime_error("Slicing indices do not exist in tensor indices.");
+/// One operand of a batch
+struct BatchOperand
+{
+    /// The operand, labeled with its indices that are not fixed
+    LabeledTensor labeled;
+    /// For operands that are not CoreTensor's, the core copy of the batch
+    Tensor staged;
+    /// The range of the operand in the batch
+    IndexRange range;
+};
+
+/**
+ * The part of A in a batch: the indices of A among the first nfixed of
+ * batched are fixed to their values in current, and the next batched index
+ * (if A has it) spans chunk values from its value in current.
+ *
+ * CoreTensor's are batched through views. Other tensors have none, so their
+ * batch is copied into a core tensor, which is read from A if read is set.
+ */
+BatchOperand batch_of(const LabeledTensor &A, const Indices &batched,
+                      size_t nfixed, const vector<size_t> &current,
+                      size_t chunk, bool read)
+{
+    vector<size_t> axes;
+    Indices indices;
+    IndexRange range;
+    bool ranged = false;
+    for (size_t d = 0; d < A.indices().size(); ++d)
+    {
+        size_t l = std::find(batched.begin(), batched.end(), A.indices()[d]) -
+                   batched.begin();
+        if (l < nfixed)
+        {
+            axes.push_back(d);
+            range.push_back({current[l], current[l] + 1L});
+            continue;
+        }
+        indices.push_back(A.indices()[d]);
+        if (l < batched.size())
+        {
+            range.push_back({current[l],
+                             std::min(current[l] + chunk, A.T().dim(d))});
+            ranged = true;
         }
+        else
+            range.push_back({0L, A.T().dim(d)});
     }
 
-    // Determine if the result need permutation to permute the batched indices to the front
-    bool permute_flag = false;
-    for (size_t l = 0; l < batched_size; ++l) {
-        if (slicing_axis[l] != l) {
-            permute_flag = true;
-            break;
+    if (A.T().type() == CoreTensor)
+    {
+        if (axes.empty() && !ranged)
+            return BatchOperand{A, Tensor(), range};
+        vector<size_t> values;
+        for (size_t d : axes)
+            values.push_back(range[d][0]);
+        Tensor T = A.T().slab(axes, values);
+        if (ranged)
+        {
+            IndexRange kept;
+            for (size_t d = 0; d < range.size(); ++d)
+            {
+                if (std::find(axes.begin(), axes.end(), d) == axes.end())
+                    kept.push_back(range[d]);
+            }
+            T = T.view(kept);
         }
+        return BatchOperand{LabeledTensor(T, indices, A.factor()), Tensor(),
+                            range};
     }
 
-    // Determine batched dimensions.
-    Indices permuted_indices;
-    Dimension slicing_dims;
-    for (const string& s : batched_indices) {
-        slicing_dims.push_back(dim_by_index(s));
+    Dimension dims;
+    IndexRange whole;
+    for (const vector<size_t> &r : range)
+    {
+        dims.push_back(r[1] - r[0]);
+        whole.push_back({0L, r[1] - r[0]});
     }
+    Tensor S = Tensor::build(CoreTensor, A.T().name() + " batch", dims);
+    if (read)
+        S.slice(A.T(), whole, range);
+    Tensor T = axes.empty() ? S : S.slab(axes, vector<size_t>(axes.size(), 0L));
+    return BatchOperand{LabeledTensor(T, indices, A.factor()), S, range};
+}
 
-    // Permute result labeled tensor.
-    Tensor Ltp;
-    if (permute_flag) {
-        permuted_indices = batched_indices;
-        for (size_t l = 0, l_max = numdim(); l < l_max; ++l) {
-            if (std::find(slicing_axis.begin(), slicing_axis.end(),l) == slicing_axis.end()) {
-                permuted_indices.push_back(indices_[l]);
-            }
-        }
-        Dimension dims;
-        for (const string& s : permuted_indices) {
-            dims.push_back(dim_by_index(s));
-        }
-        Ltp = Tensor::build(T().type(), T().name() + " permute", dims);
-        Ltp.permute(T_, permuted_indices, indices_);
-    } else {
-        Ltp = T().clone();
-        permuted_indices = indices_;
-    }
-    LabeledTensor Lt(Ltp, permuted_indices);
+/// Number of batches of a product batched over indices of dimensions dims,
+/// the last one taking chunk values per batch
+size_t count_batches(const Dimension &dims, size_t chunk)
+{
+    size_t nbatches = 1L;
+    for (size_t l = 0; l + 1 < dims.size(); ++l)
+        nbatches *= dims[l];
+    return nbatches * ((dims.back() + chunk - 1L) / chunk);
+}
+}
 
+LabeledTensorBatchedContraction batched(const string &batched_indices, const LabeledTensorContraction &contraction) {
+    return LabeledTensorBatchedContraction(contraction, indices::split(batched_indices));
+}
+
+LabeledTensorBatchedContraction batched(const LabeledTensorContraction &contraction) {
+    return LabeledTensorBatchedContraction(contraction, Indices());
+}
 
+void LabeledTensor::contract_batched(const LabeledTensorBatchedContraction &rhs_batched,
+                             bool zero_result, bool add, bool optimize_order)
+{
+    if (Graph *graph = Graph::recording())
+    {
+        LabeledTensor lhs(*this);
+        LabeledTensorContraction rhs(rhs_batched.get_contraction());
+        Indices batched_indices(rhs_batched.get_batched_indices());
+        vector<Tensor> reads{T_};
+        for (size_t n = 0; n < rhs.size(); ++n)
+            reads.push_back(rhs[n].T());
+        graph->record({T_}, reads, [=]() mutable {
+            lhs.contract_batched(
+                LabeledTensorBatchedContraction(rhs, batched_indices),
+                zero_result, add, optimize_order);
+        });
+        return;
+    }
+
+    const LabeledTensorContraction &rhs = rhs_batched.get_contraction();
     size_t nterms = rhs.size();
-    std::vector<size_t> perm(nterms);
-    std::vector<size_t> best_perm(nterms);
-    std::iota(perm.begin(), perm.end(), 0);
-    std::pair<double, double> best_cpu_memory_cost(1.0e200, 1.0e200);
 
-    if (optimize_order) {
-        do
-        {
-            std::pair<double, double> cpu_memory_cost =
-                rhs.compute_contraction_cost(perm);
-            if (cpu_memory_cost.first < best_cpu_memory_cost.first)
-            {
-                best_perm = perm;
-                best_cpu_memory_cost = cpu_memory_cost;
-            }
-        } while (std::next_permutation(perm.begin(), perm.end()));
-        // at this point 'best_perm' should be used to perform contraction in
-        // optimal order.
-    } else {
-        best_perm = perm;
+    // The terms are read through views while the result is written, so a
+    // term that is the result would be overwritten batch by batch.
+    for (size_t n = 0; n < nterms; ++n) {
+        if (T_ == rhs[n].T()) {
+            throw std::runtime_error("Self assignment is not allowed.");
+        }
     }
 
-    std::vector<std::vector<bool>> need_slicing(nterms, std::vector<bool>(batched_size + 1));
+    std::vector<size_t> best_perm(nterms);
+    std::iota(best_perm.begin(), best_perm.end(), 0);
+
+    if (optimize_order && nterms > 2) {
+        best_perm = contraction_path::chain_order(
+            contraction_path::optimal_path(rhs, indices_, true), nterms);
+    }
 
-    // Permute tensor indices if the corresponding tensor needs to be batched.
     LabeledTensorContraction rhsp;
+    std::vector<Indices> terms;
+    map<string, size_t> dims;
     for (size_t i = 0; i < nterms; ++i) {
         const LabeledTensor& A = rhs[best_perm[i]];
-        const Indices& A_indices = A.indices();
-        Indices gemm_indices;
-        for (const string& s : A_indices) {
-            auto it = std::find(batched_indices.begin(), batched_indices.end(), s);
-            if (it != batched_indices.end()) {
-                need_slicing[i][std::distance(batched_indices.begin(), it)] = true;
-            } else {
-                gemm_indices.push_back(s);
-            }
-        }
-        Indices permuted_indices;
-        for (size_t l = 0; l < batched_size; ++l) {
-            if (need_slicing[i][l]) {
-                permuted_indices.push_back(batched_indices[l]);
-                need_slicing[i][batched_size] = true;
-            }
-        }
-        if (permuted_indices.size() == 0) {
-            rhsp.operator*(A);
-        } else {
-            permuted_indices.insert(permuted_indices.end(),gemm_indices.begin(),gemm_indices.end());
-            if (permuted_indices == A_indices) {
-                rhsp.operator*(A);
-            } else {
-                Dimension dims;
-                for (const string& s : permuted_indices) {
-                    dims.push_back(A.dim_by_index(s));
-                }
-                Tensor Atp = Tensor::build(A.T().type(), A.T().name() + " permute", dims);
-                Atp.permute(A.T(), permuted_indices, A.indices());
-                LabeledTensor At(Atp, permuted_indices, A.factor());
-                rhsp.operator*(At);
-            }
+        rhsp.operator*(A);
+        terms.push_back(A.indices());
+        for (size_t d = 0; d < A.indices().size(); ++d) {
+            dims[A.indices()[d]] = A.T().dim(d);
         }
     }
+    for (size_t d = 0; d < indices_.size(); ++d) {
+        dims[indices_[d]] = T_.dim(d);
+    }
 
-    // Create intermediate batch tensor for result tensor.
-    const Indices& Lt_indices = Lt.indices();
-    const Dimension& Lt_dims = Lt.T().dims();
-    Dimension sub_dims;
-    Indices sub_indices;
-    sub_dims.insert(sub_dims.end(), Lt_dims.begin()+batched_size, Lt_dims.end());
-    sub_indices.insert(sub_indices.end(), Lt_indices.begin()+batched_size, Lt_indices.end());
-    Tensor Ltp_batch = Tensor::build(Lt.T().type(), Lt.T().name() + " batch", sub_dims);
-    LabeledTensor Lt_batch(Ltp_batch, sub_indices);
-
-    // Create intermediate batch tensors for tensors to be contracted.
-    LabeledTensorContraction rhs_batch;
-    std::vector<Tensor> batch_tensors;
+    // Terms (and a result) that are not CoreTensor's have no views, so their
+    // batches are staged in core tensors
+    std::vector<Indices> staged;
     for (size_t i = 0; i < nterms; ++i) {
-        const LabeledTensor& A = rhsp[i];
-        if (need_slicing[i][batched_size]) {
-            const Indices& A_indices = A.indices();
-            const Dimension& A_dims = A.T().dims();
-            Dimension dims;
-            Indices indices;
-            size_t count = 0;
-            for (size_t l = 0; l < batched_size; ++l) {
-                if (need_slicing[i][l]) {
-                    count++;
-                }
-            }
-            indices.insert(indices.end(), A_indices.begin()+count, A_indices.end());
-            dims.insert(dims.end(), A_dims.begin()+count, A_dims.end());
-
-            Tensor Atp = Tensor::build(A.T().type(), A.T().name() + " batch", dims);
-            LabeledTensor At(Atp, indices, A.factor());
-            rhs_batch.operator*(At);
-            batch_tensors.push_back(Atp);
-        } else {
-            rhs_batch.operator*(A);
-            batch_tensors.push_back(A.T());
+        if (rhsp[i].T().type() != CoreTensor) {
+            staged.push_back(rhsp[i].indices());
         }
     }
+    bool pipelined = !staged.empty();
+    if (T_.type() != CoreTensor) {
+        staged.push_back(indices_);
+    }
 
-    if (nterms == 2) {
-        // Loop over batches to perform contraction
-        std::vector<size_t> current_batch(batched_size, 0);
-        shared_ptr<TensorImpl> A2;
-        shared_ptr<TensorImpl> B2;
-        shared_ptr<TensorImpl> C2;
-        while (current_batch[0] < slicing_dims[0]) {
-            size_t L_shift = 0, cur_jump = 1;
-            size_t sub_numel = Lt_batch.T().numel();
-            for (int i = batched_size - 1; i >= 0; --i) {
-                L_shift += current_batch[i] * cur_jump;
-                cur_jump *= slicing_dims[i];
-            }
-            L_shift *= sub_numel;
-            std::vector<double>& Lt_batch_data = Ltp_batch.data();
-            std::vector<double>& Lt_data = Ltp.data();
-            std::memcpy(Lt_batch_data.data(), Lt_data.data()+L_shift, sub_numel * sizeof(double));
-
-            for (size_t i = 0; i < nterms; ++i) {
-                if (need_slicing[i][batched_size]) {
-                    size_t cur_shift = 0, cur_jump = 1;
-                    size_t sub_numel_A = batch_tensors[i].numel();
-                    for (int l = batched_size - 1; l >= 0; --l) {
-                        if (need_slicing[i][l]) {
-                            cur_shift += current_batch[l] * cur_jump;
-                            cur_jump *= slicing_dims[l];
-                        }
-                    }
-                    cur_shift *= sub_numel_A;
-                    std::vector<double>& A_batch_data = batch_tensors[i].data();
-                    const std::vector<double>& A_data = rhsp[i].T().data();
-                    std::memcpy(A_batch_data.data(), A_data.data()+cur_shift, sub_numel_A * sizeof(double));
-                }
-            }
+    // Size the batches so that their intermediates fit in what the live
+    // tensors leave of the memory limit.
+    std::vector<size_t> order(nterms);
+    std::iota(order.begin(), order.end(), 0);
+    contraction_path::Path path = contraction_path::chain(order);
+    size_t live = memory::live_bytes();
+    size_t room = live < settings::memory_limit ? settings::memory_limit - live : 0L;
+    contraction_path::Batching batching = contraction_path::plan_batching(
+        terms, indices_, path, dims, rhs_batched.get_batched_indices(), room,
+        staged);
+    const Indices batched_indices = batching.indices;
+    if (batched_indices.empty()) {
+        contract(rhsp, zero_result, add, false);
+        return;
+    }
 
-            // The following code is identical to Lt_batch.contract(rhs_batch, zero_result, add);
-            const LabeledTensor &A = rhs_batch[0];
-            const LabeledTensor &B = rhs_batch[1];
-
-            Ltp_batch.contract(batch_tensors[0], batch_tensors[1], sub_indices, A.indices(), B.indices(),
-                        A2, B2, C2,
-                        add ? A.factor() * B.factor() : -A.factor() * B.factor(),
-                        zero_result ? 0.0 : 1.0);
-
-            // Copy current batch tensor result to the full result tensor
-            const std::vector<double>& Ltc_batch_data = Ltp_batch.data();
-            std::memcpy(Lt_data.data() + L_shift, Ltc_batch_data.data(), sub_numel * sizeof(double));
-
-            // Determine the indices of next batch
-            for (int i = batched_size - 1; i >= 0; --i) {
-                current_batch[i]++;
-                if (current_batch[i] < slicing_dims[i]) {
-                    break;
-                } else if (i != 0) {
-                    current_batch[i] = 0;
-                }
-            }
+    // Find the indices to be batched in result labeled tensor.
+    size_t batched_size = batched_indices.size();
+    for (size_t l = 0; l < batched_size; ++l) {
+        if (std::find(indices_.begin(), indices_.end(), batched_indices[l]) == indices_.end()) {
+            throw std::runtime_error("Slicing indices do not exist in tensor indices.");
         }
-    } else {
-        // Prepare batch contraction intermediate tensors.
-        std::vector<Tensor> inter_tensors;
-        std::vector<Indices> inter_indices;
-        LabeledTensor A = rhs_batch[0];
-        int maxn = int(nterms) - 2;
-        for (int n = 0; n < maxn; ++n)
-        {
-            LabeledTensor B = rhs_batch[n + 1];
+    }
 
-            std::vector<Indices> AB_indices =
-                indices::determine_contraction_result(A, B);
-            const Indices &AB_common_idx = AB_indices[0];
-            const Indices &A_fix_idx = AB_indices[1];
-            const Indices &B_fix_idx = AB_indices[2];
-            Dimension dims;
-            Indices indices;
+    // Determine batched dimensions.
+    Dimension slicing_dims;
+    for (const string& s : batched_indices) {
+        slicing_dims.push_back(dim_by_index(s));
+    }
 
-            for (size_t i = 0; i < AB_common_idx.size(); ++i)
-            {
-                // If a common index is also found in the rhs it's a Hadamard index
-                if (std::find(this->indices().begin(), this->indices().end(),
-                              AB_common_idx[i]) != this->indices().end())
-                {
-                    dims.push_back(A.dim_by_index(AB_common_idx[i]));
-                    indices.push_back(AB_common_idx[i]);
-                }
-            }
+    // Batches write disjoint parts of the result, so when every operand is a
+    // CoreTensor they are contracted on all threads at once, each with its
+    // share of the memory.
+    bool threaded = staged.empty() && !omp_in_parallel();
+    size_t nthread = threaded ? omp_get_max_threads() : 1;
+    if (nthread > 1) {
+        contraction_path::Batching shared = contraction_path::plan_batching(
+            terms, indices_, path, dims, batched_indices, room / nthread);
+        threaded = count_batches(slicing_dims, shared.chunk) >= nthread;
+        if (threaded) {
+            batching = shared;
+        }
+    } else {
+        threaded = false;
+    }
 
-            for (size_t i = 0; i < A_fix_idx.size(); ++i)
-            {
-                dims.push_back(A.dim_by_index(A_fix_idx[i]));
-                indices.push_back(A_fix_idx[i]);
-            }
-            for (size_t i = 0; i < B_fix_idx.size(); ++i)
-            {
-                dims.push_back(B.dim_by_index(B_fix_idx[i]));
-                indices.push_back(B_fix_idx[i]);
+    // The result and every term of a batch are slabs of the full tensors at
+    // the current values of the batched indices they carry (the last one
+    // spanning a chunk of values), so each batch is contracted straight into
+    // the result and only the intermediates of one batch are alive at a time.
+    size_t chunk = batching.chunk;
+    size_t nfixed = chunk == 1 ? batched_size : batched_size - 1;
+
+    // The first values of the batched indices in every batch
+    std::vector<std::vector<size_t>> batches;
+    std::vector<size_t> current_batch(batched_size, 0);
+    while (current_batch[0] < slicing_dims[0]) {
+        batches.push_back(current_batch);
+
+        // Determine the indices of next batch
+        for (int i = batched_size - 1; i >= 0; --i) {
+            current_batch[i] += (i + 1 == int(batched_size) ? chunk : 1);
+            if (current_batch[i] < slicing_dims[i]) {
+                break;
+            } else if (i != 0) {
+                current_batch[i] = 0;
             }
-
-            Tensor tAB = Tensor::build(A.T().type(),
-                                       A.T().name() + " * " + B.T().name(), dims);
-            inter_tensors.push_back(tAB);
-            inter_indices.push_back(indices);
-
-            A.set(LabeledTensor(tAB, indices, 1.0));
         }
+    }
+    size_t nbatches = batches.size();
 
-        // Loop over batches to perform contraction
-        std::vector<size_t> current_batch(batched_size, 0);
-        std::vector<shared_ptr<TensorImpl>> A2s(maxn+1);
-        std::vector<shared_ptr<TensorImpl>> B2s(maxn+1);
-        std::vector<shared_ptr<TensorImpl>> C2s(maxn+1);
-        while (current_batch[0] < slicing_dims[0]) {
-            size_t L_shift = 0, cur_jump = 1;
-            size_t sub_numel = Lt_batch.T().numel();
-            for (int i = batched_size - 1; i >= 0; --i) {
-                L_shift += current_batch[i] * cur_jump;
-                cur_jump *= slicing_dims[i];
-            }
-            L_shift *= sub_numel;
-            std::vector<double>& Lt_batch_data = Ltp_batch.data();
-            std::vector<double>& Lt_data = Ltp.data();
-            std::memcpy(Lt_batch_data.data(), Lt_data.data()+L_shift, sub_numel * sizeof(double));
-
-            for (size_t i = 0; i < nterms; ++i) {
-                if (need_slicing[i][batched_size]) {
-                    size_t cur_shift = 0, cur_jump = 1;
-                    size_t sub_numel_A = batch_tensors[i].numel();
-                    for (int l = batched_size - 1; l >= 0; --l) {
-                        if (need_slicing[i][l]) {
-                            cur_shift += current_batch[l] * cur_jump;
-                            cur_jump *= slicing_dims[l];
-                        }
-                    }
-                    cur_shift *= sub_numel_A;
-                    std::vector<double>& A_batch_data = batch_tensors[i].data();
-                    const std::vector<double>& A_data = rhsp[i].T().data();
-                    std::memcpy(A_batch_data.data(), A_data.data()+cur_shift, sub_numel_A * sizeof(double));
-                }
-            }
+    auto terms_of = [&](size_t b) {
+        std::vector<BatchOperand> operands;
+        for (size_t i = 0; i < nterms; ++i) {
+            operands.push_back(batch_of(rhsp[i], batched_indices, nfixed,
+                                        batches[b], chunk, true));
+        }
+        return operands;
+    };
+    auto contract_batch = [&](size_t b, const std::vector<BatchOperand> &operands) {
+        BatchOperand Lt_batch = batch_of(*this, batched_indices, nfixed,
+                                         batches[b], chunk, !zero_result);
+
+        LabeledTensorContraction rhs_batch;
+        for (const BatchOperand &operand : operands) {
+            rhs_batch.operator*(operand.labeled);
+        }
 
-            // The following code is identical to Lt_batch.contract(rhs_batch, zero_result, add);
-            const LabeledTensor &A = rhs_batch[0];
-            const LabeledTensor &B0 = rhs_batch[1];
-            Tensor tAB = inter_tensors[0];
-            tAB.contract(batch_tensors[0], B0.T(), inter_indices[0], A.indices(), B0.indices(),
-                         A2s[0], B2s[0], C2s[0], A.factor() * B0.factor(), 0.0);
+        Lt_batch.labeled.contract(rhs_batch, zero_result, add, false);
 
-            for (int n = 1; n < maxn; ++n)
-            {
-                const LabeledTensor &B = rhs_batch[n + 1];
-                inter_tensors[n].contract(inter_tensors[n-1], batch_tensors[n+1], inter_indices[n], inter_indices[n-1], B.indices(),
-                             A2s[n], B2s[n], C2s[n], B.factor(), 0.0);
+        if (T_.type() != CoreTensor) {
+            IndexRange whole;
+            for (size_t d = 0; d < Lt_batch.staged.rank(); ++d) {
+                whole.push_back({0L, Lt_batch.staged.dim(d)});
             }
-            const LabeledTensor &B = rhs_batch[nterms - 1];
-
-            Ltp_batch.contract(inter_tensors[nterms-3], B.T(), sub_indices, inter_indices[nterms-3], B.indices(),
-                        A2s[maxn], B2s[maxn], C2s[maxn], add ? B.factor() : -B.factor(),
-                        zero_result ? 0.0 : 1.0);
-            // The intermediate tensors in this contraction should be reused for all the batches
-            // to avoid recreating the intermediate of the same size multiple times.
-
-            // Copy current batch tensor result to the full result tensor
-            const std::vector<double>& Ltc_batch_data = Ltp_batch.data();
-            std::memcpy(Lt_data.data() + L_shift, Ltc_batch_data.data(), sub_numel * sizeof(double));
-
-            // Determine the indices of next batch
-            for (int i = batched_size - 1; i >= 0; --i) {
-                current_batch[i]++;
-                if (current_batch[i] < slicing_dims[i]) {
-                    break;
-                } else if (i != 0) {
-                    current_batch[i] = 0;
+            T_.slice(Lt_batch.staged, Lt_batch.range, whole);
+        }
+    };
+
+    // Loop over batches to perform contraction
+    if (threaded) {
+        std::exception_ptr error;
+        threads::TaskThreads split(nbatches);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(split.outer())     \
+    proc_bind(spread)
+        for (size_t b = 0; b < nbatches; ++b) {
+            split.enter();
+            try {
+                contract_batch(b, terms_of(b));
+            } catch (...) {
+#pragma omp critical(ambit_contract_batched_error)
+                if (!error) {
+                    error = std::current_exception();
                 }
             }
         }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    } else if (pipelined) {
+        // Double buffering: the staged terms of the next batch are read while
+        // this one is contracted
+        std::future<std::vector<BatchOperand>> next =
+            std::async(std::launch::async, terms_of, 0L);
+        for (size_t b = 0; b < nbatches; ++b) {
+            std::vector<BatchOperand> operands = next.get();
+            if (b + 1 < nbatches) {
+                next = std::async(std::launch::async, terms_of, b + 1);
+            }
+            contract_batch(b, operands);
+        }
+    } else {
+        for (size_t b = 0; b < nbatches; ++b) {
+            contract_batch(b, terms_of(b));
+        }
     }
-
-    // Permute result tensor back
-    T_.permute(Ltp, indices_, permuted_indices);
 }
 
 }
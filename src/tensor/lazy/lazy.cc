@@ -0,0 +1,222 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#include "lazy.h"
+#include "tensor/slice.h"
+#include <ambit/settings.h>
+#include <ambit/timer.h>
+#include <algorithm>
+#include <cmath>
+
+namespace ambit
+{
+
+size_t lazy_tile_size()
+{
+    return std::max<size_t>(1L, settings::memory_limit / sizeof(double) / 6L);
+}
+
+LazyTensorImpl::LazyTensorImpl(const string &name, const Dimension &dims,
+                               const TileGenerator &generator)
+    : TensorImpl(LazyTensor, name, dims), generator_(generator)
+{
+    if (!generator_)
+        throw std::runtime_error("LazyTensorImpl: " + name +
+                                 " needs a generator");
+}
+
+void LazyTensorImpl::generate(const IndexRange &box, double *buffer) const
+{
+    AMBIT_TIMER_PUSH("lazy generate");
+    generator_(box, buffer);
+    AMBIT_TIMER_POP();
+}
+
+void LazyTensorImpl::for_tiles(
+    const IndexRange &box,
+    const function<void(const CoreTensorImpl &, const IndexRange &)> &func)
+    const
+{
+    int rank = box.size();
+    Dimension dims;
+    for (const vector<size_t> &range : box)
+    {
+        if (range[1] <= range[0])
+            return;
+        dims.push_back(range[1] - range[0]);
+    }
+    if (rank == 0)
+    {
+        CoreTensorImpl tile(name() + " tile", dims);
+        generate(box, tile.data().data());
+        func(tile, box);
+        return;
+    }
+
+    // As the out-of-core tiles: leading indices take single values, one
+    // index is chunked, and the trailing indices are kept whole
+    size_t max_size = lazy_tile_size();
+    int split = rank - 1;
+    size_t trailing = 1L;
+    while (split > 0 && trailing * dims[split] <= max_size)
+    {
+        trailing *= dims[split];
+        split--;
+    }
+    size_t chunk =
+        std::max<size_t>(1L, std::min(dims[split], max_size / trailing));
+
+    size_t outer_size = 1L;
+    for (int dim = 0; dim < split; dim++)
+        outer_size *= dims[dim];
+
+    for (size_t outer = 0L; outer < outer_size; outer++)
+    {
+        IndexRange tile_box(box);
+        size_t num = outer;
+        for (int dim = split - 1; dim >= 0; dim--)
+        {
+            size_t val = box[dim][0] + num % dims[dim];
+            num /= dims[dim];
+            tile_box[dim] = {val, val + 1};
+        }
+        for (size_t start = 0L; start < dims[split]; start += chunk)
+        {
+            tile_box[split] = {box[split][0] + start,
+                               box[split][0] +
+                                   std::min(start + chunk, dims[split])};
+            Dimension tile_dims;
+            for (const vector<size_t> &range : tile_box)
+                tile_dims.push_back(range[1] - range[0]);
+            CoreTensorImpl tile(name() + " tile", tile_dims);
+            generate(tile_box, tile.data().data());
+            func(tile, tile_box);
+        }
+    }
+}
+
+TensorStats LazyTensorImpl::stats() const
+{
+    TensorStats result;
+    result.numel = numel();
+    double sum2 = 0.0;
+    bool first = true;
+    IndexRange box;
+    for (size_t dim : dims())
+        box.push_back({0L, dim});
+    for_tiles(box, [&](const CoreTensorImpl &tile, const IndexRange &tile_box) {
+        TensorStats part = tile.stats();
+        result.norm1 += part.norm1;
+        sum2 += part.norm2 * part.norm2;
+        result.norm_inf = std::max(result.norm_inf, part.norm_inf);
+        for (size_t dim = 0; dim < rank(); dim++)
+        {
+            part.max_indices[dim] += tile_box[dim][0];
+            part.min_indices[dim] += tile_box[dim][0];
+        }
+        if (first || part.max > result.max)
+        {
+            result.max = part.max;
+            result.max_indices = part.max_indices;
+        }
+        if (first || part.min < result.min)
+        {
+            result.min = part.min;
+            result.min_indices = part.min_indices;
+        }
+        first = false;
+    });
+    result.norm2 = std::sqrt(sum2);
+    if (numel() != 0L)
+        result.rms = result.norm2 / std::sqrt(static_cast<double>(numel()));
+    return result;
+}
+
+double LazyTensorImpl::norm(int type) const
+{
+    switch (type)
+    {
+    case 0:
+        return stats().norm_inf;
+    case 1:
+        return stats().norm1;
+    case 2:
+        return stats().norm2;
+    default:
+        throw std::runtime_error(
+            "Norm must be 0 (infty-norm), 1 (1-norm), or 2 (2-norm)");
+    }
+}
+
+tuple<double, vector<size_t>> LazyTensorImpl::max() const
+{
+    TensorStats result = stats();
+    return std::make_tuple(result.max, result.max_indices);
+}
+
+tuple<double, vector<size_t>> LazyTensorImpl::min() const
+{
+    TensorStats result = stats();
+    return std::make_tuple(result.min, result.min_indices);
+}
+
+void LazyTensorImpl::citerate(
+    const function<void(const vector<size_t> &, const double &)> &func) const
+{
+    IndexRange box;
+    for (size_t dim : dims())
+        box.push_back({0L, dim});
+    for_tiles(box, [&](const CoreTensorImpl &tile, const IndexRange &tile_box) {
+        tile.citerate([&](const vector<size_t> &indices, const double &value) {
+            vector<size_t> shifted(indices);
+            for (size_t dim = 0; dim < shifted.size(); dim++)
+                shifted[dim] += tile_box[dim][0];
+            func(shifted, value);
+        });
+    });
+}
+
+void slice(TensorImplPtr C, ConstLazyTensorImplPtr A, const IndexRange &Cinds,
+           const IndexRange &Ainds, double alpha, double beta)
+{
+    A->for_tiles(Ainds, [&](const CoreTensorImpl &tile,
+                            const IndexRange &tile_box) {
+        IndexRange Ctile_inds;
+        IndexRange whole;
+        for (size_t dim = 0; dim < tile_box.size(); dim++)
+        {
+            size_t start = Cinds[dim][0] + tile_box[dim][0] - Ainds[dim][0];
+            size_t size = tile_box[dim][1] - tile_box[dim][0];
+            Ctile_inds.push_back({start, start + size});
+            whole.push_back({0L, size});
+        }
+        slice(C, &tile, Ctile_inds, whole, alpha, beta);
+    });
+}
+}
@@ -0,0 +1,90 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+#if !defined(TENSOR_LAZY_H)
+#define TENSOR_LAZY_H
+
+#include "tensor/tensorimpl.h"
+#include "tensor/core/core.h"
+
+namespace ambit
+{
+
+/**
+ * A tensor that holds no elements: every box of it that an operation reads
+ * is computed by the generator given to Tensor::build_lazy. Slices of it
+ * generate the box they read, and contractions and permutations reach it
+ * through the out-of-core engine, which reads one tile at a time. A lazy
+ * tensor is read only.
+ */
+class LazyTensorImpl : public TensorImpl
+{
+  public:
+    LazyTensorImpl(const std::string &name, const Dimension &dims,
+                   const TileGenerator &generator);
+
+    /// Fills buffer with box, in the row-major order of the box
+    void generate(const IndexRange &box, double *buffer) const;
+
+    /**
+     * Calls func on tiles of at most lazy_tile_size() elements (as long as
+     * a single row of the last index fits) that cover box, each generated
+     * into a core tensor. The second argument of func is the box of the
+     * tile in T.
+     */
+    void for_tiles(const IndexRange &box,
+                   const std::function<void(const CoreTensorImpl &,
+                                            const IndexRange &)> &func) const;
+
+    /// Gathered over the tiles of the whole tensor
+    TensorStats stats() const;
+    double norm(int type = 2) const;
+    std::tuple<double, std::vector<size_t>> max() const;
+    std::tuple<double, std::vector<size_t>> min() const;
+
+    void citerate(const std::function<void(const std::vector<size_t> &,
+                                           const double &)> &func) const;
+
+  private:
+    TileGenerator generator_;
+};
+
+typedef LazyTensorImpl *LazyTensorImplPtr;
+typedef const LazyTensorImpl *ConstLazyTensorImplPtr;
+
+/// Number of doubles generated at once when a lazy tensor is read in tiles,
+/// a sixth of settings::memory_limit as for the out-of-core tiles
+size_t lazy_tile_size();
+
+/// C(Cinds) = alpha * A(Ainds) + beta * C(Cinds), generating A tile by tile
+void slice(TensorImplPtr C, ConstLazyTensorImplPtr A, const IndexRange &Cinds,
+           const IndexRange &Ainds, double alpha = 1.0, double beta = 0.0);
+}
+
+#endif
@@ -0,0 +1,383 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#include <ambit/packed_tensor.h>
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+namespace ambit
+{
+
+namespace
+{
+
+/// Packed dimension of a pair of indices of dimension n
+size_t pair_size(size_t n, int sign)
+{
+    return (sign < 0 ? n * (n - 1L) / 2L : n * (n + 1L) / 2L);
+}
+
+/// One index of the packed storage and where its elements land in the full
+/// tensor: direct offsets for (p,q), swapped offsets for (q,p)
+struct PackedAxis
+{
+    bool paired;
+    int sign;
+    vector<size_t> direct;
+    vector<size_t> swapped;
+    vector<bool> diagonal;
+};
+
+vector<PackedAxis> packed_axes(const Dimension &dims,
+                               const vector<PairSymmetry> &pairs)
+{
+    vector<size_t> strides(dims.size(), 1L);
+    for (int ind = static_cast<int>(dims.size()) - 2; ind >= 0; ind--)
+        strides[ind] = strides[ind + 1] * dims[ind + 1];
+
+    vector<PackedAxis> axes;
+    size_t pair = 0L;
+    for (size_t ind = 0L; ind < dims.size(); ind++)
+    {
+        PackedAxis axis;
+        if (pair < pairs.size() && pairs[pair].first == ind)
+        {
+            axis.paired = true;
+            axis.sign = pairs[pair].sign;
+            size_t sa = strides[ind];
+            size_t sb = strides[ind + 1];
+            for (size_t q = 0L; q < dims[ind]; q++)
+            {
+                size_t pmax = (axis.sign < 0 ? q : q + 1L);
+                for (size_t p = 0L; p < pmax; p++)
+                {
+                    axis.direct.push_back(p * sa + q * sb);
+                    axis.swapped.push_back(q * sa + p * sb);
+                    axis.diagonal.push_back(p == q);
+                }
+            }
+            pair++;
+            ind++;
+        }
+        else
+        {
+            axis.paired = false;
+            axis.sign = 1;
+            for (size_t p = 0L; p < dims[ind]; p++)
+            {
+                axis.direct.push_back(p * strides[ind]);
+                axis.swapped.push_back(p * strides[ind]);
+                axis.diagonal.push_back(false);
+            }
+        }
+        axes.push_back(axis);
+    }
+    return axes;
+}
+
+/// Calls func(n, digits) for every packed element n, where digits holds the
+/// position of n along each packed axis (last axis fastest)
+template <typename Func>
+void for_each_packed(const vector<PackedAxis> &axes, Func func)
+{
+    size_t total = 1L;
+    for (const PackedAxis &axis : axes)
+        total *= axis.direct.size();
+
+    vector<size_t> digits(axes.size(), 0L);
+    for (size_t n = 0L; n < total; n++)
+    {
+        func(n, digits);
+        for (int ind = static_cast<int>(axes.size()) - 1; ind >= 0; ind--)
+        {
+            if (++digits[ind] < axes[ind].direct.size())
+                break;
+            digits[ind] = 0L;
+        }
+    }
+}
+
+/**
+ * The labels of the packed storage of T(inds): each pair becomes one label
+ * "a|b" with a < b. A pair labelled in the opposite order multiplies the
+ * packed elements by the pair sign, which is accumulated in sign.
+ */
+Indices packed_labels(const PackedTensor &T, const Indices &inds,
+                      double &sign)
+{
+    if (inds.size() != T.rank())
+        throw std::runtime_error("PackedTensor: " + T.name() + " has rank " +
+                                 std::to_string(T.rank()) + " but " +
+                                 std::to_string(inds.size()) +
+                                 " indices were given");
+    Indices labels;
+    size_t pair = 0L;
+    for (size_t ind = 0L; ind < inds.size(); ind++)
+    {
+        if (pair < T.pairs().size() && T.pairs()[pair].first == ind)
+        {
+            const string &a = inds[ind];
+            const string &b = inds[ind + 1];
+            if (a < b)
+            {
+                labels.push_back(a + "|" + b);
+            }
+            else
+            {
+                labels.push_back(b + "|" + a);
+                sign *= T.pairs()[pair].sign;
+            }
+            pair++;
+            ind++;
+        }
+        else
+        {
+            labels.push_back(inds[ind]);
+        }
+    }
+    return labels;
+}
+
+/// Whether every label is paired with the same partner label, under the same
+/// symmetry, in every tensor that carries it
+bool pairs_match(const vector<const PackedTensor *> &tensors,
+                 const vector<const Indices *> &inds)
+{
+    std::map<string, std::pair<string, int>> partners;
+    for (size_t t = 0L; t < tensors.size(); t++)
+    {
+        const PackedTensor &T = *tensors[t];
+        const Indices &labels = *inds[t];
+        vector<std::pair<string, int>> partner(labels.size(),
+                                               std::make_pair(string(), 0));
+        for (const PairSymmetry &pair : T.pairs())
+        {
+            partner[pair.first] =
+                std::make_pair(labels[pair.first + 1], pair.sign);
+            partner[pair.first + 1] =
+                std::make_pair(labels[pair.first], pair.sign);
+        }
+        for (size_t ind = 0L; ind < labels.size(); ind++)
+        {
+            auto it = partners.find(labels[ind]);
+            if (it == partners.end())
+                partners[labels[ind]] = partner[ind];
+            else if (it->second != partner[ind])
+                return false;
+        }
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+PackedTensor::PackedTensor() {}
+
+PackedTensor PackedTensor::build(TensorType type, const string &name,
+                                 const Dimension &dims,
+                                 const vector<PairSymmetry> &pairs)
+{
+    PackedTensor T;
+    T.dims_ = dims;
+    T.pairs_ = pairs;
+    std::sort(T.pairs_.begin(), T.pairs_.end(),
+              [](const PairSymmetry &a, const PairSymmetry &b) {
+                  return a.first < b.first;
+              });
+
+    Dimension packed_dims;
+    size_t pair = 0L;
+    for (size_t ind = 0L; ind < dims.size(); ind++)
+    {
+        if (pair < T.pairs_.size() && T.pairs_[pair].first == ind)
+        {
+            const PairSymmetry &sym = T.pairs_[pair];
+            if (ind + 1L >= dims.size())
+                throw std::runtime_error(
+                    "PackedTensor: index pair runs past the last index");
+            if (dims[ind] != dims[ind + 1])
+                throw std::runtime_error(
+                    "PackedTensor: paired indices must have equal dimensions");
+            if (sym.sign != 1 && sym.sign != -1)
+                throw std::runtime_error(
+                    "PackedTensor: pair sign must be +1 or -1");
+            packed_dims.push_back(pair_size(dims[ind], sym.sign));
+            pair++;
+            ind++;
+        }
+        else
+        {
+            packed_dims.push_back(dims[ind]);
+        }
+    }
+    if (pair != T.pairs_.size())
+        throw std::runtime_error(
+            "PackedTensor: index pairs must not overlap or exceed the rank");
+
+    T.packed_ = Tensor::build(type, name, packed_dims);
+    return T;
+}
+
+string PackedTensor::name() const { return packed_.name(); }
+
+Tensor PackedTensor::expand(TensorType type) const
+{
+    Tensor full = Tensor::build(CoreTensor, name(), dims_);
+    double *Fp = full.map_data();
+    const double *Pp = packed_.map_data();
+
+    vector<PackedAxis> axes = packed_axes(dims_, pairs_);
+    size_t nimage = static_cast<size_t>(1) << pairs_.size();
+    for_each_packed(axes, [&](size_t n, const vector<size_t> &digits) {
+        // Every combination of swapped pairs is an image of element n
+        for (size_t image = 0L; image < nimage; image++)
+        {
+            size_t offset = 0L;
+            double sign = 1.0;
+            size_t bit = 0L;
+            bool duplicate = false;
+            for (size_t ind = 0L; ind < axes.size(); ind++)
+            {
+                const PackedAxis &axis = axes[ind];
+                if (axis.paired && ((image >> bit++) & 1L))
+                {
+                    duplicate = duplicate || axis.diagonal[digits[ind]];
+                    offset += axis.swapped[digits[ind]];
+                    sign *= axis.sign;
+                }
+                else
+                {
+                    offset += axis.direct[digits[ind]];
+                }
+            }
+            if (!duplicate)
+                Fp[offset] = sign * Pp[n];
+        }
+    });
+    packed_.unmap_data();
+
+    if (type == CoreTensor || type == CurrentTensor)
+        return full;
+    Tensor result = Tensor::build(type, name(), dims_);
+    result.copy(full);
+    return result;
+}
+
+void PackedTensor::pack(const Tensor &A, double alpha, double beta)
+{
+    if (A.dims() != dims_)
+        throw std::runtime_error(
+            "PackedTensor::pack: dimensions do not match " + name());
+    const double *Ap = A.map_data();
+    double *Pp = packed_.map_data();
+
+    vector<PackedAxis> axes = packed_axes(dims_, pairs_);
+    for_each_packed(axes, [&](size_t n, const vector<size_t> &digits) {
+        size_t offset = 0L;
+        for (size_t ind = 0L; ind < axes.size(); ind++)
+            offset += axes[ind].direct[digits[ind]];
+        Pp[n] = alpha * Ap[offset] + (beta == 0.0 ? 0.0 : beta * Pp[n]);
+    });
+    A.unmap_data();
+    packed_.unmap_data();
+}
+
+void PackedTensor::permute(const PackedTensor &A, const Indices &Cinds,
+                           const Indices &Ainds, double alpha, double beta)
+{
+    if (pairs_match({this, &A}, {&Cinds, &Ainds}))
+    {
+        double sign = 1.0;
+        Indices Clabels = packed_labels(*this, Cinds, sign);
+        Indices Alabels = packed_labels(A, Ainds, sign);
+        packed_.permute(A.packed_, Clabels, Alabels, sign * alpha, beta);
+        return;
+    }
+
+    Tensor full = Tensor::build(CoreTensor, name(), dims_);
+    full.permute(A.expand(), Cinds, Ainds);
+    pack(full, alpha, beta);
+}
+
+void PackedTensor::contract(const PackedTensor &A, const PackedTensor &B,
+                            const Indices &Cinds, const Indices &Ainds,
+                            const Indices &Binds, double alpha, double beta)
+{
+    if (pairs_match({this, &A, &B}, {&Cinds, &Ainds, &Binds}))
+    {
+        double sign = 1.0;
+        Indices Clabels = packed_labels(*this, Cinds, sign);
+        Indices Alabels = packed_labels(A, Ainds, sign);
+        Indices Blabels = packed_labels(B, Binds, sign);
+
+        // A contracted pair is summed over its unique triangle only. Both
+        // halves of an antisymmetric pair carry the same product, so the
+        // sum is doubled; the diagonal of a symmetric pair is counted once,
+        // so it is halved in a copy of A before doubling.
+        Tensor Ap = A.packed_;
+        vector<PackedAxis> axes = packed_axes(A.dims_, A.pairs_);
+        vector<bool> halve(axes.size(), false);
+        bool any_halved = false;
+        for (size_t ind = 0L; ind < Alabels.size(); ind++)
+        {
+            if (!axes[ind].paired ||
+                std::find(Clabels.begin(), Clabels.end(), Alabels[ind]) !=
+                    Clabels.end())
+                continue;
+            alpha *= 2.0;
+            halve[ind] = (axes[ind].sign > 0);
+            any_halved = any_halved || halve[ind];
+        }
+        if (any_halved)
+        {
+            Ap = A.packed_.clone(CoreTensor);
+            vector<double> &data = Ap.data();
+            for_each_packed(axes, [&](size_t n, const vector<size_t> &digits) {
+                for (size_t ind = 0L; ind < axes.size(); ind++)
+                {
+                    if (halve[ind] && axes[ind].diagonal[digits[ind]])
+                        data[n] *= 0.5;
+                }
+            });
+        }
+
+        packed_.contract(Ap, B.packed_, Clabels, Alabels, Blabels,
+                         sign * alpha, beta);
+        return;
+    }
+
+    Tensor full = Tensor::build(CoreTensor, name(), dims_);
+    if (beta != 0.0)
+        full.copy(expand());
+    full.contract(A.expand(), B.expand(), Cinds, Ainds, Binds, alpha, beta);
+    pack(full);
+}
+}
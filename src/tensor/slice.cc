@@ -29,12 +29,163 @@
 
 #include "slice.h"
 #include "math/math.h"
+#include "disk/disk_io.h"
+#include "disk/tile_cache.h"
+#include <algorithm>
+#include <array>
 #include <ambit/timer.h>
 #include <string.h>
 
 namespace ambit
 {
 
+namespace
+{
+
+/// Element offsets of the ind-th stripe in A and C
+void stripe_offsets(size_t ind, int slow_dims, const vector<size_t> &sizes,
+                    const IndexRange &Ainds, const IndexRange &Cinds,
+                    const vector<size_t> &Astrides,
+                    const vector<size_t> &Cstrides, size_t &Aoff, size_t &Coff)
+{
+    size_t num = ind;
+    Aoff = 0L;
+    Coff = 0L;
+    for (int dim = slow_dims - 1; dim >= 0; dim--)
+    {
+        size_t val = num % sizes[dim]; // value of the dim-th index
+        num /= sizes[dim];
+        Aoff += (Ainds[dim][0] + val) * Astrides[dim];
+        Coff += (Cinds[dim][0] + val) * Cstrides[dim];
+    }
+    Aoff += Ainds[slow_dims][0] * Astrides[slow_dims];
+    Coff += Cinds[slow_dims][0] * Cstrides[slow_dims];
+}
+
+/// Core -> Core slices below this many elements stay on one thread
+const size_t slice_parallel_min = 32768L;
+
+/// Elements per unit of work of a Core -> Core slice
+const size_t slice_piece = 32768L;
+
+/// C = alpha * A + beta * C over a contiguous run of count elements, without
+/// reading C when beta is zero
+void slice_run(double *Cp, const double *Ap, size_t count, double alpha,
+               double beta)
+{
+    if (beta == 0.0 && alpha == 1.0)
+    {
+        memcpy(Cp, Ap, sizeof(double) * count);
+    }
+    else if (beta == 0.0)
+    {
+#pragma omp simd
+        for (size_t n = 0L; n < count; n++)
+            Cp[n] = alpha * Ap[n];
+    }
+    else if (beta == 1.0)
+    {
+#pragma omp simd
+        for (size_t n = 0L; n < count; n++)
+            Cp[n] += alpha * Ap[n];
+    }
+    else
+    {
+#pragma omp simd
+        for (size_t n = 0L; n < count; n++)
+            Cp[n] = alpha * Ap[n] + beta * Cp[n];
+    }
+}
+
+/**
+ * Stripes [first, last) of a Core -> Core slice with short runs, the first
+ * one at Cp and Ap, for N slow indices. The odometer over the slow indices
+ * is unrolled at compile time and keeps its digits and strides in registers
+ * rather than in vectors.
+ */
+template <int N>
+void slice_stripes(double *Cp, const double *Ap,
+                   const vector<size_t> &slow_sizes,
+                   const vector<size_t> &slow_Astrides,
+                   const vector<size_t> &slow_Cstrides, size_t first,
+                   size_t last, size_t fast_size, double alpha, double beta)
+{
+    std::array<size_t, N> sizes, Astrides, Cstrides, digits;
+    size_t num = first;
+    for (int dim = N - 1; dim >= 0; dim--)
+    {
+        sizes[dim] = slow_sizes[dim];
+        Astrides[dim] = slow_Astrides[dim];
+        Cstrides[dim] = slow_Cstrides[dim];
+        digits[dim] = num % sizes[dim];
+        num /= sizes[dim];
+    }
+
+    for (size_t stripe = first; stripe < last; stripe++)
+    {
+        slice_run(Cp, Ap, fast_size, alpha, beta);
+
+        // Advance to the next stripe
+        for (int dim = N - 1; dim >= 0; dim--)
+        {
+            Ap += Astrides[dim];
+            Cp += Cstrides[dim];
+            if (++digits[dim] < sizes[dim])
+                break;
+            Ap -= sizes[dim] * Astrides[dim];
+            Cp -= sizes[dim] * Cstrides[dim];
+            digits[dim] = 0L;
+        }
+    }
+}
+
+typedef void (*StripeKernel)(double *, const double *, const vector<size_t> &,
+                             const vector<size_t> &, const vector<size_t> &,
+                             size_t, size_t, size_t, double, double);
+
+/// slice_stripes by number of slow indices; more go through the generic loop
+const StripeKernel stripe_kernels[] = {
+    slice_stripes<0>, slice_stripes<1>, slice_stripes<2>,
+    slice_stripes<3>, slice_stripes<4>, slice_stripes<5>,
+    slice_stripes<6>, slice_stripes<7>};
+const int num_stripe_kernels =
+    sizeof(stripe_kernels) / sizeof(stripe_kernels[0]);
+
+/// Queues a read of a stripe of T, or zeros the buffer if T never wrote it.
+/// A compressed T, or any T while the tile cache is in use, is read at once.
+void read_stripe(disk_io::Queue &queue, ConstDiskTensorImplPtr T,
+                 double *buffer, size_t count, size_t offset)
+{
+    if (T->is_zero(offset, count))
+        memset(buffer, '\0', sizeof(double) * count);
+    else if (T->compressed() || tile_cache::enabled())
+        T->read(buffer, count, offset);
+    else
+        queue.read(T->fd(), buffer, count, offset);
+}
+
+/// Queues a write of a stripe of T. A compressed T, or any T while the tile
+/// cache is in use, is written at once.
+void write_stripe(disk_io::Queue &queue, DiskTensorImplPtr T,
+                  const double *buffer, size_t count, size_t offset)
+{
+    if (T->compressed() || tile_cache::enabled())
+    {
+        T->write(buffer, count, offset);
+        return;
+    }
+    T->touch(offset, count);
+    queue.write(T->fd(), buffer, count, offset);
+}
+
+/// Number of stripes of fast_size doubles staged together
+size_t stripe_batch(size_t fast_size, size_t slow_size)
+{
+    size_t batch = disk_io::batch_size__ / std::max<size_t>(1L, fast_size);
+    return std::max<size_t>(1L, std::min(batch, slow_size));
+}
+}
+
 void slice(TensorImplPtr C, ConstTensorImplPtr A, const IndexRange &Cinds,
            const IndexRange &Ainds, double alpha, double beta)
 {
@@ -53,7 +204,12 @@ void slice(TensorImplPtr C, ConstTensorImplPtr A, const IndexRange &Cinds,
 
     // => Type Logic <= //
 
-    if (C->type() == CoreTensor and A->type() == CoreTensor)
+    if (A->type() == LazyTensor)
+    {
+        slice(C, static_cast<ConstLazyTensorImplPtr>(A), Cinds, Ainds, alpha,
+              beta);
+    }
+    else if (C->type() == CoreTensor and A->type() == CoreTensor)
     {
         slice(dynamic_cast<CoreTensorImplPtr>(C),
               dynamic_cast<ConstCoreTensorImplPtr>(A), Cinds, Ainds, alpha,
@@ -93,6 +249,12 @@ void slice(TensorImplPtr C, ConstTensorImplPtr A, const IndexRange &Cinds,
     {
         slice((CyclopsTensorImplPtr)C, (ConstCyclopsTensorImplPtr)A, Cinds,
               Ainds, alpha, beta);
+#endif
+#ifdef HAVE_CUDA
+    }
+    else if (C->type() == GpuTensor or A->type() == GpuTensor)
+    {
+        slice_gpu(C, A, Cinds, Ainds, alpha, beta);
 #endif
     }
     else
@@ -101,20 +263,112 @@ void slice(TensorImplPtr C, ConstTensorImplPtr A, const IndexRange &Cinds,
     }
 }
 
+void slice_batch(TensorImplPtr C, const vector<ConstTensorImplPtr> &As,
+                 const vector<IndexRange> &Cinds,
+                 const vector<IndexRange> &Ainds, double alpha, double beta)
+{
+#ifdef HAVE_CYCLOPS
+    bool core = C->type() == DistributedTensor && C->rank() > 0;
+    for (ConstTensorImplPtr A : As)
+        core = core && A->type() == CoreTensor;
+    if (core)
+    {
+        for (size_t n = 0; n < As.size(); ++n)
+            for (size_t ind = 0L; ind < C->rank(); ind++)
+                if (Cinds[n][ind][1] - Cinds[n][ind][0] !=
+                    Ainds[n][ind][1] - Ainds[n][ind][0])
+                    throw std::runtime_error("Slice range sizes must agree "
+                                             "between tensors A and C.");
+        vector<ConstCoreTensorImplPtr> Acores;
+        for (ConstTensorImplPtr A : As)
+            Acores.push_back(static_cast<ConstCoreTensorImplPtr>(A));
+        slice_batch(static_cast<CyclopsTensorImplPtr>(C), Acores, Cinds, Ainds,
+                    alpha, beta);
+        return;
+    }
+#endif
+    for (size_t n = 0; n < As.size(); ++n)
+        slice(C, As[n], Cinds[n], Ainds[n], alpha, beta);
+}
+
+void gather_batch(const vector<TensorImplPtr> &Cs, ConstTensorImplPtr A,
+                  const vector<IndexRange> &Cinds,
+                  const vector<IndexRange> &Ainds, double alpha, double beta)
+{
+#ifdef HAVE_CYCLOPS
+    bool core = A->type() == DistributedTensor && A->rank() > 0;
+    for (TensorImplPtr C : Cs)
+        core = core && C->type() == CoreTensor;
+    if (core)
+    {
+        for (size_t n = 0; n < Cs.size(); ++n)
+            for (size_t ind = 0L; ind < A->rank(); ind++)
+                if (Cinds[n][ind][1] - Cinds[n][ind][0] !=
+                    Ainds[n][ind][1] - Ainds[n][ind][0])
+                    throw std::runtime_error("Slice range sizes must agree "
+                                             "between tensors A and C.");
+        vector<CoreTensorImplPtr> Ccores;
+        for (TensorImplPtr C : Cs)
+            Ccores.push_back(static_cast<CoreTensorImplPtr>(C));
+        gather_batch(Ccores, static_cast<ConstCyclopsTensorImplPtr>(A), Cinds,
+                     Ainds, alpha, beta);
+        return;
+    }
+#endif
+    for (size_t n = 0; n < Cs.size(); ++n)
+        slice(Cs[n], A, Cinds[n], Ainds[n], alpha, beta);
+}
+
 void slice(CoreTensorImplPtr C, ConstCoreTensorImplPtr A,
            const IndexRange &Cinds, const IndexRange &Ainds, double alpha,
            double beta)
 {
-    timer::timer_push("slice Core -> Core");
+    // A view is sliced as the matching range of the tensor it looks into
+    if (C->is_view() || A->is_view())
+    {
+        auto retarget = [](ConstCoreTensorImplPtr T, const IndexRange &inds) {
+            if (!T->is_view())
+                return inds;
+            IndexRange inds2(T->view_range());
+            for (size_t dim = 0; dim < T->rank(); dim++)
+            {
+                size_t axis = T->view_axes()[dim];
+                size_t shift = T->view_range()[axis][0];
+                inds2[axis] = {inds[dim][0] + shift, inds[dim][1] + shift};
+            }
+            return inds2;
+        };
+        IndexRange Cinds2 = retarget(C, Cinds);
+        IndexRange Ainds2 = retarget(A, Ainds);
+        if (Cinds2.size() != Ainds2.size())
+            throw std::runtime_error(
+                "Slice: a view with fixed indices can only be sliced against "
+                "a tensor of the rank of its parent");
+        slice(C->is_view() ? C->view_parent().get() : C,
+              A->is_view() ? A->view_parent().get() : A, Cinds2, Ainds2, alpha,
+              beta);
+        return;
+    }
+
+    AMBIT_TIMER_PUSH("slice Core -> Core");
+#if !defined(AMBIT_DISABLE_TIMERS)
+    if (timer::enabled())
+    {
+        double count = 1.0;
+        for (const vector<size_t> &range : Cinds)
+            count *= static_cast<double>(range[1] - range[0]);
+        timer::add_bytes(sizeof(double) * (beta == 0.0 ? 2.0 : 3.0) * count);
+    }
+#endif
     /// Data pointers
     double *Cp = C->data().data();
-    double *Ap = const_cast<CoreTensorImplPtr>(A)->data().data();
+    const double *Ap = A->data().data();
 
     // => Special Case: Rank-0 <= //
 
     if (C->rank() == 0)
     {
-        Cp[0] = alpha * Ap[0] + beta * Cp[0];
+        slice_run(Cp, Ap, 1L, alpha, beta);
     }
     else
     {
@@ -127,7 +381,7 @@ void slice(CoreTensorImplPtr C, ConstCoreTensorImplPtr A,
             sizes[ind] = Cinds[ind][1] - Cinds[ind][0];
         }
 
-        /// Size of contiguous DAXPY call
+        /// Size of contiguous runs
         int fast_dims = 1;
         size_t fast_size = sizes[C->rank() - 1];
         for (int ind = ((int)C->rank()) - 2; ind >= 0; ind--)
@@ -167,270 +421,148 @@ void slice(CoreTensorImplPtr C, ConstCoreTensorImplPtr A,
 
         // => Slice Operation <= //
 
-        if (slow_dims == 0)
-        {
-            double *Atp = Ap + Ainds[slow_dims][0] * Astrides[slow_dims];
-            double *Ctp = Cp + Cinds[slow_dims][0] * Cstrides[slow_dims];
-            C_DSCAL(fast_size, beta, Ctp, 1);
-            C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
-        }
-        else if (slow_dims == 1)
-        {
-#pragma omp parallel for
-            for (size_t ind0 = 0L; ind0 < sizes[0]; ind0++)
-            {
-                double *Atp = Ap + (Ainds[0][0] + ind0) * Astrides[0] +
-                              Ainds[slow_dims][0] * Astrides[slow_dims];
-                double *Ctp = Cp + (Cinds[0][0] + ind0) * Cstrides[0] +
-                              Cinds[slow_dims][0] * Cstrides[slow_dims];
-                C_DSCAL(fast_size, beta, Ctp, 1);
-                C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
-            }
-        }
-        else if (slow_dims == 2)
-        {
-#pragma omp parallel for
-            for (size_t ind0 = 0L; ind0 < sizes[0]; ind0++)
-            {
-                for (size_t ind1 = 0L; ind1 < sizes[1]; ind1++)
-                {
-                    double *Atp = Ap + (Ainds[0][0] + ind0) * Astrides[0] +
-                                  (Ainds[1][0] + ind1) * Astrides[1] +
-                                  Ainds[slow_dims][0] * Astrides[slow_dims];
-                    double *Ctp = Cp + (Cinds[0][0] + ind0) * Cstrides[0] +
-                                  (Cinds[1][0] + ind1) * Cstrides[1] +
-                                  Cinds[slow_dims][0] * Cstrides[slow_dims];
-                    C_DSCAL(fast_size, beta, Ctp, 1);
-                    C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
-                }
-            }
-        }
-        else if (slow_dims == 3)
-        {
-#pragma omp parallel for
-            for (size_t ind0 = 0L; ind0 < sizes[0]; ind0++)
-            {
-                for (size_t ind1 = 0L; ind1 < sizes[1]; ind1++)
-                {
-                    for (size_t ind2 = 0L; ind2 < sizes[2]; ind2++)
-                    {
-                        double *Atp = Ap + (Ainds[0][0] + ind0) * Astrides[0] +
-                                      (Ainds[1][0] + ind1) * Astrides[1] +
-                                      (Ainds[2][0] + ind2) * Astrides[2] +
-                                      Ainds[slow_dims][0] * Astrides[slow_dims];
-                        double *Ctp = Cp + (Cinds[0][0] + ind0) * Cstrides[0] +
-                                      (Cinds[1][0] + ind1) * Cstrides[1] +
-                                      (Cinds[2][0] + ind2) * Cstrides[2] +
-                                      Cinds[slow_dims][0] * Cstrides[slow_dims];
-                        C_DSCAL(fast_size, beta, Ctp, 1);
-                        C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
-                    }
-                }
-            }
-        }
-        else if (slow_dims == 4)
+        bool threaded = slow_size * fast_size >= slice_parallel_min;
+
+        if (fast_size >= slice_piece)
         {
-#pragma omp parallel for
-            for (size_t ind0 = 0L; ind0 < sizes[0]; ind0++)
+            // Long runs are cut into pieces, so that a single run (a slice
+            // that is contiguous in both tensors) still spreads over the
+            // threads
+            size_t npiece = (fast_size + slice_piece - 1) / slice_piece;
+            long nwork = static_cast<long>(slow_size * npiece);
+#pragma omp parallel for schedule(static) if (threaded)
+            for (long work = 0L; work < nwork; work++)
             {
-                for (size_t ind1 = 0L; ind1 < sizes[1]; ind1++)
-                {
-                    for (size_t ind2 = 0L; ind2 < sizes[2]; ind2++)
-                    {
-                        for (size_t ind3 = 0L; ind3 < sizes[3]; ind3++)
-                        {
-                            double *Atp =
-                                Ap + (Ainds[0][0] + ind0) * Astrides[0] +
-                                (Ainds[1][0] + ind1) * Astrides[1] +
-                                (Ainds[2][0] + ind2) * Astrides[2] +
-                                (Ainds[3][0] + ind3) * Astrides[3] +
-                                Ainds[slow_dims][0] * Astrides[slow_dims];
-                            double *Ctp =
-                                Cp + (Cinds[0][0] + ind0) * Cstrides[0] +
-                                (Cinds[1][0] + ind1) * Cstrides[1] +
-                                (Cinds[2][0] + ind2) * Cstrides[2] +
-                                (Cinds[3][0] + ind3) * Cstrides[3] +
-                                Cinds[slow_dims][0] * Cstrides[slow_dims];
-                            C_DSCAL(fast_size, beta, Ctp, 1);
-                            C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
-                        }
-                    }
-                }
+                size_t Aoff, Coff;
+                stripe_offsets(work / npiece, slow_dims, sizes, Ainds, Cinds,
+                               Astrides, Cstrides, Aoff, Coff);
+                size_t begin = (work % npiece) * slice_piece;
+                size_t count = std::min(slice_piece, fast_size - begin);
+                slice_run(Cp + Coff + begin, Ap + Aoff + begin, count, alpha,
+                          beta);
             }
         }
-        else if (slow_dims == 5)
+        else
         {
-#pragma omp parallel for
-            for (size_t ind0 = 0L; ind0 < sizes[0]; ind0++)
+            // Short runs go in batches of consecutive stripes, stepping the
+            // offsets like an odometer instead of recomputing them
+            size_t nbatch = std::max<size_t>(
+                1L, std::min(slow_size, slow_size * fast_size / slice_piece));
+            long nbatch_l = static_cast<long>(nbatch);
+#pragma omp parallel for schedule(static) if (threaded)
+            for (long batch = 0L; batch < nbatch_l; batch++)
             {
-                for (size_t ind1 = 0L; ind1 < sizes[1]; ind1++)
+                size_t first = batch * slow_size / nbatch;
+                size_t last = (batch + 1) * slow_size / nbatch;
+
+                size_t Aoff, Coff;
+                stripe_offsets(first, slow_dims, sizes, Ainds, Cinds,
+                               Astrides, Cstrides, Aoff, Coff);
+                if (slow_dims < num_stripe_kernels)
                 {
-                    for (size_t ind2 = 0L; ind2 < sizes[2]; ind2++)
-                    {
-                        for (size_t ind3 = 0L; ind3 < sizes[3]; ind3++)
-                        {
-                            for (size_t ind4 = 0L; ind4 < sizes[4]; ind4++)
-                            {
-                                double *Atp =
-                                    Ap + (Ainds[0][0] + ind0) * Astrides[0] +
-                                    (Ainds[1][0] + ind1) * Astrides[1] +
-                                    (Ainds[2][0] + ind2) * Astrides[2] +
-                                    (Ainds[3][0] + ind3) * Astrides[3] +
-                                    (Ainds[4][0] + ind4) * Astrides[4] +
-                                    Ainds[slow_dims][0] * Astrides[slow_dims];
-                                double *Ctp =
-                                    Cp + (Cinds[0][0] + ind0) * Cstrides[0] +
-                                    (Cinds[1][0] + ind1) * Cstrides[1] +
-                                    (Cinds[2][0] + ind2) * Cstrides[2] +
-                                    (Cinds[3][0] + ind3) * Cstrides[3] +
-                                    (Cinds[4][0] + ind4) * Cstrides[4] +
-                                    Cinds[slow_dims][0] * Cstrides[slow_dims];
-                                C_DSCAL(fast_size, beta, Ctp, 1);
-                                C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
-                            }
-                        }
-                    }
+                    stripe_kernels[slow_dims](Cp + Coff, Ap + Aoff, sizes,
+                                              Astrides, Cstrides, first, last,
+                                              fast_size, alpha, beta);
+                    continue;
                 }
-            }
-        }
-        else if (slow_dims == 6)
-        {
-#pragma omp parallel for
-            for (size_t ind0 = 0L; ind0 < sizes[0]; ind0++)
-            {
-                for (size_t ind1 = 0L; ind1 < sizes[1]; ind1++)
+
+                std::vector<size_t> digits(slow_dims, 0L);
+                size_t num = first;
+                for (int dim = slow_dims - 1; dim >= 0; dim--)
                 {
-                    for (size_t ind2 = 0L; ind2 < sizes[2]; ind2++)
-                    {
-                        for (size_t ind3 = 0L; ind3 < sizes[3]; ind3++)
-                        {
-                            for (size_t ind4 = 0L; ind4 < sizes[4]; ind4++)
-                            {
-                                for (size_t ind5 = 0L; ind5 < sizes[5]; ind5++)
-                                {
-                                    double *Atp =
-                                        Ap +
-                                        (Ainds[0][0] + ind0) * Astrides[0] +
-                                        (Ainds[1][0] + ind1) * Astrides[1] +
-                                        (Ainds[2][0] + ind2) * Astrides[2] +
-                                        (Ainds[3][0] + ind3) * Astrides[3] +
-                                        (Ainds[4][0] + ind4) * Astrides[4] +
-                                        (Ainds[5][0] + ind5) * Astrides[5] +
-                                        Ainds[slow_dims][0] *
-                                            Astrides[slow_dims];
-                                    double *Ctp =
-                                        Cp +
-                                        (Cinds[0][0] + ind0) * Cstrides[0] +
-                                        (Cinds[1][0] + ind1) * Cstrides[1] +
-                                        (Cinds[2][0] + ind2) * Cstrides[2] +
-                                        (Cinds[3][0] + ind3) * Cstrides[3] +
-                                        (Cinds[4][0] + ind4) * Cstrides[4] +
-                                        (Cinds[5][0] + ind5) * Cstrides[5] +
-                                        Cinds[slow_dims][0] *
-                                            Cstrides[slow_dims];
-                                    C_DSCAL(fast_size, beta, Ctp, 1);
-                                    C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
-                                }
-                            }
-                        }
-                    }
+                    digits[dim] = num % sizes[dim];
+                    num /= sizes[dim];
                 }
-            }
-        }
-        else if (slow_dims == 7)
-        {
-#pragma omp parallel for
-            for (size_t ind0 = 0L; ind0 < sizes[0]; ind0++)
-            {
-                for (size_t ind1 = 0L; ind1 < sizes[1]; ind1++)
+
+                for (size_t stripe = first; stripe < last; stripe++)
                 {
-                    for (size_t ind2 = 0L; ind2 < sizes[2]; ind2++)
+                    slice_run(Cp + Coff, Ap + Aoff, fast_size, alpha, beta);
+
+                    // Advance to the next stripe
+                    for (int dim = slow_dims - 1; dim >= 0; dim--)
                     {
-                        for (size_t ind3 = 0L; ind3 < sizes[3]; ind3++)
-                        {
-                            for (size_t ind4 = 0L; ind4 < sizes[4]; ind4++)
-                            {
-                                for (size_t ind5 = 0L; ind5 < sizes[5]; ind5++)
-                                {
-                                    for (size_t ind6 = 0L; ind6 < sizes[6];
-                                         ind6++)
-                                    {
-                                        double *Atp =
-                                            Ap +
-                                            (Ainds[0][0] + ind0) * Astrides[0] +
-                                            (Ainds[1][0] + ind1) * Astrides[1] +
-                                            (Ainds[2][0] + ind2) * Astrides[2] +
-                                            (Ainds[3][0] + ind3) * Astrides[3] +
-                                            (Ainds[4][0] + ind4) * Astrides[4] +
-                                            (Ainds[5][0] + ind5) * Astrides[5] +
-                                            (Ainds[6][0] + ind6) * Astrides[6] +
-                                            Ainds[slow_dims][0] *
-                                                Astrides[slow_dims];
-                                        double *Ctp =
-                                            Cp +
-                                            (Cinds[0][0] + ind0) * Cstrides[0] +
-                                            (Cinds[1][0] + ind1) * Cstrides[1] +
-                                            (Cinds[2][0] + ind2) * Cstrides[2] +
-                                            (Cinds[3][0] + ind3) * Cstrides[3] +
-                                            (Cinds[4][0] + ind4) * Cstrides[4] +
-                                            (Cinds[5][0] + ind5) * Cstrides[5] +
-                                            (Cinds[6][0] + ind6) * Cstrides[6] +
-                                            Cinds[slow_dims][0] *
-                                                Cstrides[slow_dims];
-                                        C_DSCAL(fast_size, beta, Ctp, 1);
-                                        C_DAXPY(fast_size, alpha, Atp, 1, Ctp,
-                                                1);
-                                    }
-                                }
-                            }
-                        }
+                        Aoff += Astrides[dim];
+                        Coff += Cstrides[dim];
+                        if (++digits[dim] < sizes[dim])
+                            break;
+                        Aoff -= sizes[dim] * Astrides[dim];
+                        Coff -= sizes[dim] * Cstrides[dim];
+                        digits[dim] = 0L;
                     }
                 }
             }
         }
-        else
-        {
-#pragma omp parallel for
-            for (size_t ind = 0L; ind < slow_size; ind++)
-            {
-                double *Ctp = Cp;
-                double *Atp = Ap;
-                size_t num = ind;
-                for (int dim = slow_dims - 1; dim >= 0; dim--)
-                {
-                    size_t val = num % sizes[dim]; // value of the dim-th index
-                    num /= sizes[dim];
-                    Atp += (Ainds[dim][0] + val) * Astrides[dim];
-                    Ctp += (Cinds[dim][0] + val) * Cstrides[dim];
-                }
-                Atp += Ainds[slow_dims][0] * Astrides[slow_dims];
-                Ctp += Cinds[slow_dims][0] * Cstrides[slow_dims];
-                C_DSCAL(fast_size, beta, Ctp, 1);
-                C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
-            }
-        }
     }
 
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
 }
+void cat(CoreTensorImplPtr C, const vector<ConstCoreTensorImplPtr> &As,
+         size_t dim)
+{
+    AMBIT_TIMER_PUSH("cat Core");
+#if !defined(AMBIT_DISABLE_TIMERS)
+    if (timer::enabled())
+        timer::add_bytes(sizeof(double) * 2.0 *
+                         static_cast<double>(C->numel()));
+#endif
+
+    size_t nrow = 1L;
+    for (size_t ind = 0L; ind < dim; ind++)
+        nrow *= C->dims()[ind];
+    size_t inner = 1L;
+    for (size_t ind = dim + 1; ind < C->rank(); ind++)
+        inner *= C->dims()[ind];
+    size_t Crow = C->dims()[dim] * inner;
+
+    // The rows of every A are cut into pieces of at most slice_piece
+    // elements; work units first[k] to first[k + 1] are the pieces of As[k]
+    size_t nA = As.size();
+    vector<size_t> runs(nA), shifts(nA), npieces(nA), first(nA + 1, 0L);
+    for (size_t k = 0L, shift = 0L; k < nA; k++)
+    {
+        runs[k] = As[k]->dims()[dim] * inner;
+        shifts[k] = shift;
+        shift += runs[k];
+        npieces[k] = (runs[k] + slice_piece - 1) / slice_piece;
+        first[k + 1] = first[k] + nrow * npieces[k];
+    }
+
+    double *Cp = C->data().data();
+    bool threaded = C->numel() >= slice_parallel_min;
+    long nwork = static_cast<long>(first[nA]);
+#pragma omp parallel for schedule(static) if (threaded)
+    for (long work = 0L; work < nwork; work++)
+    {
+        size_t k = std::upper_bound(first.begin(), first.end(),
+                                    static_cast<size_t>(work)) -
+                   first.begin() - 1;
+        size_t piece = static_cast<size_t>(work) - first[k];
+        size_t row = piece / npieces[k];
+        size_t begin = (piece % npieces[k]) * slice_piece;
+        size_t count = std::min(slice_piece, runs[k] - begin);
+        memcpy(Cp + row * Crow + shifts[k] + begin,
+               As[k]->data().data() + row * runs[k] + begin,
+               sizeof(double) * count);
+    }
+
+    AMBIT_TIMER_POP();
+}
+
 void slice(CoreTensorImplPtr C, ConstDiskTensorImplPtr A,
            const IndexRange &Cinds, const IndexRange &Ainds, double alpha,
            double beta)
 {
-    timer::timer_push("slice Disk -> Core");
+    AMBIT_TIMER_PUSH("slice Disk -> Core");
 
     /// Data pointers
     double *Cp = C->data().data();
-    FILE *Af = ((DiskTensorImplPtr)A)->fh();
 
     // => Special Case: Rank-0 <= //
 
     if (C->rank() == 0)
     {
         double Ap = 0.0;
-        fseek(Af, 0L, SEEK_SET);
-        fread(&Ap, sizeof(double), 1L, Af);
-        fseek(Af, 0L, SEEK_SET);
+        A->read(&Ap, 1L, 0L);
         Cp[0] = alpha * Ap + beta * Cp[0];
     }
     else
@@ -489,50 +621,52 @@ void slice(CoreTensorImplPtr C, ConstDiskTensorImplPtr A,
             Cstrides[ind] = Cstrides[ind + 1] * C->dims()[ind + 1];
         }
 
+        // Stripes of A are read straight into C when no update is needed
+        bool direct = (alpha == 1.0 && beta == 0.0);
+        size_t batch = stripe_batch(fast_size, slow_size);
+
         /// Buffer of A
-        double *Ap = new double[fast_size];
-        memset(Ap, '\0', sizeof(double) * fast_size);
+        vector<double> Ap(direct ? 0L : batch * fast_size);
+        vector<size_t> Coffs(batch);
 
         // => Slice Operation <= //
 
-        for (size_t ind = 0L; ind < slow_size; ind++)
+        disk_io::Queue queue;
+        for (size_t start = 0L; start < slow_size; start += batch)
         {
-            size_t num = ind;
-            size_t Aoff = 0L;
-            size_t Coff = 0L;
-            for (int dim = slow_dims - 1; dim >= 0; dim--)
+            size_t nstripe = std::min(batch, slow_size - start);
+            for (size_t ind = 0L; ind < nstripe; ind++)
             {
-                size_t val = num % sizes[dim]; // value of the dim-th index
-                num /= sizes[dim];
-                Aoff += (Ainds[dim][0] + val) * Astrides[dim];
-                Coff += (Cinds[dim][0] + val) * Cstrides[dim];
+                size_t Aoff;
+                stripe_offsets(start + ind, slow_dims, sizes, Ainds, Cinds,
+                               Astrides, Cstrides, Aoff, Coffs[ind]);
+                double *Atp =
+                    direct ? Cp + Coffs[ind] : Ap.data() + ind * fast_size;
+                read_stripe(queue, A, Atp, fast_size, Aoff);
             }
-            Aoff += Ainds[slow_dims][0] * Astrides[slow_dims];
-            Coff += Cinds[slow_dims][0] * Cstrides[slow_dims];
+            queue.flush();
 
-            double *Ctp = Cp + Coff;
-            double *Atp = Ap;
-            fseek(Af, sizeof(double) * Aoff, SEEK_SET);
-            fread(Atp, sizeof(double), fast_size, Af);
-
-            C_DSCAL(fast_size, beta, Ctp, 1);
-            C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
+            if (direct)
+                continue;
+            for (size_t ind = 0L; ind < nstripe; ind++)
+            {
+                double *Ctp = Cp + Coffs[ind];
+                double *Atp = Ap.data() + ind * fast_size;
+                C_DSCAL(fast_size, beta, Ctp, 1);
+                C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
+            }
         }
-
-        delete[] Ap;
-        fseek(Af, 0L, SEEK_SET);
     }
 
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
 }
 void slice(DiskTensorImplPtr C, ConstCoreTensorImplPtr A,
            const IndexRange &Cinds, const IndexRange &Ainds, double alpha,
            double beta)
 {
-    timer::timer_push("slice Core -> Disk");
+    AMBIT_TIMER_PUSH("slice Core -> Disk");
 
     /// Data pointers
-    FILE *Cf = C->fh();
     double *Ap = ((CoreTensorImplPtr)A)->data().data();
 
     // => Special Case: Rank-0 <= //
@@ -541,14 +675,9 @@ void slice(DiskTensorImplPtr C, ConstCoreTensorImplPtr A,
     {
         double Cp = 0.0;
         if (beta != 0.0)
-        {
-            fseek(Cf, 0L, SEEK_SET);
-            fread(&Cp, sizeof(double), 1L, Cf);
-        }
+            C->read(&Cp, 1L, 0L);
         Cp = alpha * Ap[0] + beta * Cp;
-        fseek(Cf, 0L, SEEK_SET);
-        fwrite(&Cp, sizeof(double), 1L, Cf);
-        fseek(Cf, 0L, SEEK_SET);
+        C->write(&Cp, 1L, 0L);
     }
     else
     {
@@ -606,58 +735,62 @@ void slice(DiskTensorImplPtr C, ConstCoreTensorImplPtr A,
             Cstrides[ind] = Cstrides[ind + 1] * C->dims()[ind + 1];
         }
 
+        // Stripes of A are written straight to disk when no update is needed
+        bool direct = (alpha == 1.0 && beta == 0.0);
+        size_t batch = stripe_batch(fast_size, slow_size);
+
         /// Buffer of C
-        double *Cp = new double[fast_size];
-        memset(Cp, '\0', sizeof(double) * fast_size);
+        vector<double> Cp(direct ? 0L : batch * fast_size);
+        vector<size_t> Aoffs(batch);
+        vector<size_t> Coffs(batch);
 
         // => Slice Operation <= //
 
-        for (size_t ind = 0L; ind < slow_size; ind++)
+        disk_io::Queue queue;
+        for (size_t start = 0L; start < slow_size; start += batch)
         {
-            size_t num = ind;
-            size_t Aoff = 0L;
-            size_t Coff = 0L;
-            for (int dim = slow_dims - 1; dim >= 0; dim--)
+            size_t nstripe = std::min(batch, slow_size - start);
+            for (size_t ind = 0L; ind < nstripe; ind++)
             {
-                size_t val = num % sizes[dim]; // value of the dim-th index
-                num /= sizes[dim];
-                Aoff += (Ainds[dim][0] + val) * Astrides[dim];
-                Coff += (Cinds[dim][0] + val) * Cstrides[dim];
+                stripe_offsets(start + ind, slow_dims, sizes, Ainds, Cinds,
+                               Astrides, Cstrides, Aoffs[ind], Coffs[ind]);
             }
-            Aoff += Ainds[slow_dims][0] * Astrides[slow_dims];
-            Coff += Cinds[slow_dims][0] * Cstrides[slow_dims];
 
-            double *Ctp = Cp;
-            double *Atp = Ap + Aoff;
+            if (direct)
+            {
+                for (size_t ind = 0L; ind < nstripe; ind++)
+                    write_stripe(queue, C, Ap + Aoffs[ind], fast_size,
+                                 Coffs[ind]);
+                queue.flush();
+                continue;
+            }
 
             if (beta != 0.0)
             {
-                fseek(Cf, sizeof(double) * Coff, SEEK_SET);
-                fread(Ctp, sizeof(double), fast_size, Cf);
+                for (size_t ind = 0L; ind < nstripe; ind++)
+                    read_stripe(queue, C, Cp.data() + ind * fast_size,
+                                fast_size, Coffs[ind]);
+                queue.flush();
             }
-
-            C_DSCAL(fast_size, beta, Ctp, 1);
-            C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
-
-            fseek(Cf, sizeof(double) * Coff, SEEK_SET);
-            fwrite(Ctp, sizeof(double), fast_size, Cf);
+            for (size_t ind = 0L; ind < nstripe; ind++)
+            {
+                double *Ctp = Cp.data() + ind * fast_size;
+                double *Atp = Ap + Aoffs[ind];
+                C_DSCAL(fast_size, beta, Ctp, 1);
+                C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
+                write_stripe(queue, C, Ctp, fast_size, Coffs[ind]);
+            }
+            queue.flush();
         }
-
-        delete[] Cp;
-        fseek(Cf, 0L, SEEK_SET);
     }
 
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
 }
 void slice(DiskTensorImplPtr C, ConstDiskTensorImplPtr A,
            const IndexRange &Cinds, const IndexRange &Ainds, double alpha,
            double beta)
 {
-    timer::timer_push("slice Disk -> Disk");
-
-    /// Data pointers
-    FILE *Cf = C->fh();
-    FILE *Af = A->fh();
+    AMBIT_TIMER_PUSH("slice Disk -> Disk");
 
     // => Special Case: Rank-0 <= //
 
@@ -666,17 +799,10 @@ void slice(DiskTensorImplPtr C, ConstDiskTensorImplPtr A,
         double Cp = 0.0;
         double Ap;
         if (beta != 0.0)
-        {
-            fseek(Cf, 0L, SEEK_SET);
-            fread(&Cp, sizeof(double), 1L, Cf);
-        }
-        fseek(Af, 0L, SEEK_SET);
-        fread(&Ap, sizeof(double), 1L, Af);
+            C->read(&Cp, 1L, 0L);
+        A->read(&Ap, 1L, 0L);
         Cp = alpha * Ap + beta * Cp;
-        fseek(Cf, 0L, SEEK_SET);
-        fwrite(&Cp, sizeof(double), 1L, Cf);
-        fseek(Cf, 0L, SEEK_SET);
-        fseek(Af, 0L, SEEK_SET);
+        C->write(&Cp, 1L, 0L);
     }
     else
     {
@@ -734,64 +860,104 @@ void slice(DiskTensorImplPtr C, ConstDiskTensorImplPtr A,
             Cstrides[ind] = Cstrides[ind + 1] * C->dims()[ind + 1];
         }
 
+        size_t batch = stripe_batch(fast_size, slow_size);
+
         /// Buffer of A
-        double *Ap = new double[fast_size];
-        memset(Ap, '\0', sizeof(double) * fast_size);
+        vector<double> Ap(batch * fast_size);
         /// Buffer of C
-        double *Cp = new double[fast_size];
-        memset(Cp, '\0', sizeof(double) * fast_size);
+        vector<double> Cp(batch * fast_size);
+        vector<size_t> Coffs(batch);
 
         // => Slice Operation <= //
 
-        for (size_t ind = 0L; ind < slow_size; ind++)
+        disk_io::Queue queue;
+        for (size_t start = 0L; start < slow_size; start += batch)
         {
-            size_t num = ind;
-            size_t Aoff = 0L;
-            size_t Coff = 0L;
-            for (int dim = slow_dims - 1; dim >= 0; dim--)
+            size_t nstripe = std::min(batch, slow_size - start);
+            for (size_t ind = 0L; ind < nstripe; ind++)
             {
-                size_t val = num % sizes[dim]; // value of the dim-th index
-                num /= sizes[dim];
-                Aoff += (Ainds[dim][0] + val) * Astrides[dim];
-                Coff += (Cinds[dim][0] + val) * Cstrides[dim];
+                size_t Aoff;
+                stripe_offsets(start + ind, slow_dims, sizes, Ainds, Cinds,
+                               Astrides, Cstrides, Aoff, Coffs[ind]);
+                read_stripe(queue, A, Ap.data() + ind * fast_size,
+                            fast_size, Aoff);
+                if (beta != 0.0)
+                    read_stripe(queue, C, Cp.data() + ind * fast_size,
+                                fast_size, Coffs[ind]);
             }
-            Aoff += Ainds[slow_dims][0] * Astrides[slow_dims];
-            Coff += Cinds[slow_dims][0] * Cstrides[slow_dims];
-
-            double *Ctp = Cp;
-            double *Atp = Ap;
+            queue.flush();
 
-            if (beta != 0.0)
+            for (size_t ind = 0L; ind < nstripe; ind++)
             {
-                fseek(Cf, sizeof(double) * Coff, SEEK_SET);
-                fread(Ctp, sizeof(double), fast_size, Cf);
+                double *Ctp = Cp.data() + ind * fast_size;
+                double *Atp = Ap.data() + ind * fast_size;
+                C_DSCAL(fast_size, beta, Ctp, 1);
+                C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
+                write_stripe(queue, C, Ctp, fast_size, Coffs[ind]);
             }
+            queue.flush();
+        }
+    }
 
-            fseek(Af, sizeof(double) * Aoff, SEEK_SET);
-            fread(Atp, sizeof(double), fast_size, Af);
+    AMBIT_TIMER_POP();
+}
 
-            C_DSCAL(fast_size, beta, Ctp, 1);
-            C_DAXPY(fast_size, alpha, Atp, 1, Ctp, 1);
+#ifdef HAVE_CYCLOPS
+namespace
+{
 
-            fseek(Cf, sizeof(double) * Coff, SEEK_SET);
-            fwrite(Ctp, sizeof(double), fast_size, Cf);
-        }
+// Appends to idx the global offsets, first index fastest as Cyclops stores
+// them, of the elements of range of T, in the row-major order of the range
+void append_offsets(ConstCyclopsTensorImplPtr T, const IndexRange &range,
+                    std::vector<long_int> &idx)
+{
+    size_t numel = 1L;
+    for (size_t ind = 0; ind < range.size(); ind++)
+        numel *= range[ind][1] - range[ind][0];
+
+    std::vector<size_t> strides(T->rank());
+    strides[0] = 1L;
+    for (size_t ind = 1L; ind < T->rank(); ind++)
+    {
+        strides[ind] = strides[ind - 1] * T->dim(ind - 1);
+    }
 
-        delete[] Ap;
-        delete[] Cp;
-        fseek(Af, 0L, SEEK_SET);
-        fseek(Cf, 0L, SEEK_SET);
+    size_t start = idx.size();
+    idx.resize(start + numel);
+    for (size_t ind = 0L; ind < numel; ind++)
+    {
+        size_t num = ind;
+        size_t off = 0L;
+        for (int dim = ((int)T->rank()) - 1; dim >= 0; dim--)
+        {
+            size_t size = range[dim][1] - range[dim][0];
+            size_t val = num % size; // value of the dim-th index
+            num /= size;
+            off += (range[dim][0] + val) * strides[dim];
+        }
+        idx[start + ind] = off;
     }
+}
 
-    timer::timer_pop();
+// The sizes of range, and the range of a tensor of those sizes
+Dimension range_sizes(const IndexRange &range, IndexRange &range2)
+{
+    Dimension sizes(range.size());
+    range2.resize(range.size());
+    for (size_t ind = 0; ind < range.size(); ind++)
+    {
+        sizes[ind] = range[ind][1] - range[ind][0];
+        range2[ind] = {0L, sizes[ind]};
+    }
+    return sizes;
+}
 }
 
-#ifdef HAVE_CYCLOPS
 void slice(CoreTensorImplPtr C, ConstCyclopsTensorImplPtr A,
            const IndexRange &Cinds, const IndexRange &Ainds, double alpha,
            double beta)
 {
-    timer::timer_push("slice Cyclops -> Core");
+    AMBIT_TIMER_PUSH("slice Cyclops -> Core");
 
     if (C->rank() == 0)
     {
@@ -815,40 +981,22 @@ void slice(CoreTensorImplPtr C, ConstCyclopsTensorImplPtr A,
         shared_ptr<CoreTensorImpl> C2(new CoreTensorImpl("C2", sizes));
         double *C2p = C2->data().data();
 
-        std::vector<long_int> Aidx(numel);
-        std::vector<size_t> Astrides(A->rank());
-        Astrides[0] = 1L;
-        for (size_t ind = 1L; ind < A->rank(); ind++)
-        {
-            Astrides[ind] = Astrides[ind - 1] * A->dim(ind - 1);
-        }
-
-        for (size_t ind = 0L; ind < numel; ind++)
-        {
-            size_t num = ind;
-            size_t Aoff = 0L;
-            for (int dim = ((int)A->rank()) - 1; dim >= 0; dim--)
-            {
-                size_t val = num % sizes[dim]; // value of the dim-th index
-                num /= sizes[dim];
-                Aoff += (Ainds[dim][0] + val) * Astrides[dim];
-            }
-            Aidx[ind] = Aoff;
-        }
+        std::vector<long_int> Aidx;
+        append_offsets(A, Ainds, Aidx);
 
         (A->cyclops())->read(numel, 1.0, 0.0, Aidx.data(), C2p);
 
         C->slice(C2.get(), Cinds, C2inds, alpha, beta);
     }
 
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
 }
 
 void slice(CyclopsTensorImplPtr C, ConstCoreTensorImplPtr A,
            const IndexRange &Cinds, const IndexRange &Ainds, double alpha,
            double beta)
 {
-    timer::timer_push("slice Core -> Cyclops");
+    AMBIT_TIMER_PUSH("slice Core -> Cyclops");
 
     if (C->rank() == 0)
     {
@@ -873,38 +1021,20 @@ void slice(CyclopsTensorImplPtr C, ConstCoreTensorImplPtr A,
         A2->slice(A, A2inds, Ainds, 1.0, 0.0);
         double *A2p = A2->data().data();
 
-        std::vector<long_int> Cidx(numel);
-        std::vector<size_t> Cstrides(C->rank());
-        Cstrides[0] = 1L;
-        for (size_t ind = 1L; ind < C->rank(); ind++)
-        {
-            Cstrides[ind] = Cstrides[ind - 1] * C->dim(ind - 1);
-        }
-
-        for (size_t ind = 0L; ind < numel; ind++)
-        {
-            size_t num = ind;
-            size_t Coff = 0L;
-            for (int dim = ((int)C->rank()) - 1; dim >= 0; dim--)
-            {
-                size_t val = num % sizes[dim]; // value of the dim-th index
-                num /= sizes[dim];
-                Coff += (Cinds[dim][0] + val) * Cstrides[dim];
-            }
-            Cidx[ind] = Coff;
-        }
+        std::vector<long_int> Cidx;
+        append_offsets(C, Cinds, Cidx);
 
         (C->cyclops())->write(numel, alpha, beta, Cidx.data(), A2p);
     }
 
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
 }
 
 void slice(CyclopsTensorImplPtr C, ConstCyclopsTensorImplPtr A,
            const IndexRange &Cinds, const IndexRange &Ainds, double alpha,
            double beta)
 {
-    timer::timer_push("slice Cyclops -> Cyclops");
+    AMBIT_TIMER_PUSH("slice Cyclops -> Cyclops");
 
     CTF_Tensor *tC = C->cyclops();
     CTF_Tensor *tA = A->cyclops();
@@ -925,8 +1055,118 @@ void slice(CyclopsTensorImplPtr C, ConstCyclopsTensorImplPtr A,
     tC->slice(Coffs.data(), Cends.data(), beta, *tA, Aoffs.data(), Aends.data(),
               alpha);
 
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
 }
 
+void slice_batch(CyclopsTensorImplPtr C,
+                 const vector<ConstCoreTensorImplPtr> &As,
+                 const vector<IndexRange> &Cinds,
+                 const vector<IndexRange> &Ainds, double alpha, double beta)
+{
+    AMBIT_TIMER_PUSH("slice batch Core -> Cyclops");
+
+    // Every piece is packed behind the last, in the order of its offsets
+    std::vector<long_int> Cidx;
+    std::vector<double> data;
+    for (size_t n = 0; n < As.size(); ++n)
+    {
+        IndexRange A2inds;
+        Dimension sizes = range_sizes(Cinds[n], A2inds);
+        size_t numel = 1L;
+        for (size_t size : sizes)
+            numel *= size;
+        if (numel == 0)
+            continue;
+
+        CoreTensorImpl A2("A2", sizes);
+        A2.slice(As[n], A2inds, Ainds[n], 1.0, 0.0);
+        data.insert(data.end(), A2.data().begin(), A2.data().end());
+        append_offsets(C, Cinds[n], Cidx);
+    }
+
+    // One collective however many pieces this process holds
+    (C->cyclops())->write(static_cast<long_int>(Cidx.size()), alpha, beta,
+                          Cidx.data(), data.data());
+
+    AMBIT_TIMER_POP();
+}
+
+void gather_batch(const vector<CoreTensorImplPtr> &Cs,
+                  ConstCyclopsTensorImplPtr A, const vector<IndexRange> &Cinds,
+                  const vector<IndexRange> &Ainds, double alpha, double beta)
+{
+    AMBIT_TIMER_PUSH("slice batch Cyclops -> Core");
+
+    std::vector<long_int> Aidx;
+    for (size_t n = 0; n < Cs.size(); ++n)
+        append_offsets(A, Ainds[n], Aidx);
+
+    // One collective fetching only the elements this process asked for
+    std::vector<double> data(Aidx.size());
+    (A->cyclops())->read(static_cast<long_int>(Aidx.size()), 1.0, 0.0,
+                         Aidx.data(), data.data());
+
+    size_t start = 0L;
+    for (size_t n = 0; n < Cs.size(); ++n)
+    {
+        IndexRange C2inds;
+        Dimension sizes = range_sizes(Ainds[n], C2inds);
+        size_t numel = 1L;
+        for (size_t size : sizes)
+            numel *= size;
+        if (numel == 0)
+            continue;
+
+        CoreTensorImpl C2("C2", sizes);
+        std::copy(data.begin() + start, data.begin() + start + numel,
+                  C2.data().begin());
+        start += numel;
+        Cs[n]->slice(&C2, Cinds[n], C2inds, alpha, beta);
+    }
+
+    AMBIT_TIMER_POP();
+}
+
+#endif
+
+#ifdef HAVE_CUDA
+void slice_gpu(TensorImplPtr C, ConstTensorImplPtr A, const IndexRange &Cinds,
+               const IndexRange &Ainds, double alpha, double beta)
+{
+    AMBIT_TIMER_PUSH("slice GPU");
+
+    if (C->type() == GpuTensor and A->type() == GpuTensor)
+    {
+        static_cast<GpuTensorImplPtr>(C)->slice_device(
+            static_cast<ConstGpuTensorImplPtr>(A), Cinds, Ainds, alpha, beta);
+    }
+    else if (C->type() == GpuTensor and A->type() == CoreTensor)
+    {
+        static_cast<GpuTensorImplPtr>(C)->slice_from_host(
+            static_cast<ConstCoreTensorImplPtr>(A)->data().data(), A->dims(),
+            Cinds, Ainds, alpha, beta);
+    }
+    else if (C->type() == CoreTensor and A->type() == GpuTensor)
+    {
+        static_cast<ConstGpuTensorImplPtr>(A)->slice_to_host(
+            static_cast<CoreTensorImplPtr>(C)->data().data(), C->dims(),
+            Cinds, Ainds, alpha, beta);
+    }
+    else
+    {
+        IndexRange box;
+        Dimension extents;
+        for (size_t ind = 0L; ind < C->rank(); ind++)
+        {
+            extents.push_back(Cinds[ind][1] - Cinds[ind][0]);
+            box.push_back({0L, extents.back()});
+        }
+        CoreTensorImpl T("Staging", extents);
+        slice(&T, A, box, Ainds);
+        slice(C, &T, Cinds, box, alpha, beta);
+    }
+
+    AMBIT_TIMER_POP();
+}
 #endif
 }
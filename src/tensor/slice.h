@@ -33,11 +33,16 @@
 #include "tensorimpl.h"
 #include "core/core.h"
 #include "disk/disk.h"
+#include "lazy/lazy.h"
 
 #ifdef HAVE_CYCLOPS
 #include "cyclops/cyclops.h"
 #endif
 
+#ifdef HAVE_CUDA
+#include "gpu/gpu.h"
+#endif
+
 namespace ambit
 {
 
@@ -48,6 +53,36 @@ void slice(CoreTensorImplPtr C, ConstCoreTensorImplPtr A,
            const IndexRange &Cinds, const IndexRange &Ainds, double alpha = 1.0,
            double beta = 0.0);
 
+/**
+ * Performs C(Cinds[n]) = alpha * As[n](Ainds[n]) + beta * C(Cinds[n]) for
+ * every n. A Cyclops C takes core pieces as one write of all their elements;
+ * any other pairing is sliced piece by piece.
+ */
+void slice_batch(TensorImplPtr C, const vector<ConstTensorImplPtr> &As,
+                 const vector<IndexRange> &Cinds,
+                 const vector<IndexRange> &Ainds, double alpha = 1.0,
+                 double beta = 0.0);
+
+/**
+ * Performs Cs[n](Cinds[n]) = alpha * A(Ainds[n]) + beta * Cs[n](Cinds[n])
+ * for every n. Core pieces of a Cyclops A are fetched by one read of all
+ * their elements; any other pairing is sliced piece by piece.
+ */
+void gather_batch(const vector<TensorImplPtr> &Cs, ConstTensorImplPtr A,
+                  const vector<IndexRange> &Cinds,
+                  const vector<IndexRange> &Ainds, double alpha = 1.0,
+                  double beta = 0.0);
+
+/**
+ * Concatenates As along index dim into C, whose dimension dim is the sum of
+ * theirs and whose other dimensions are those of every A. Each row of an A
+ * (its elements at one value of the indices before dim) is a contiguous run
+ * of a row of C, so every element of C is written once in a single parallel
+ * pass. None of C and As may be a view.
+ */
+void cat(CoreTensorImplPtr C, const vector<ConstCoreTensorImplPtr> &As,
+         size_t dim);
+
 void slice(CoreTensorImplPtr C, ConstDiskTensorImplPtr A,
            const IndexRange &Cinds, const IndexRange &Ainds, double alpha = 1.0,
            double beta = 0.0);
@@ -72,6 +107,28 @@ void slice(CyclopsTensorImplPtr C, ConstCoreTensorImplPtr A,
 void slice(CyclopsTensorImplPtr C, ConstCyclopsTensorImplPtr A,
            const IndexRange &Cinds, const IndexRange &Ainds, double alpha = 1.0,
            double beta = 0.0);
+
+void slice_batch(CyclopsTensorImplPtr C,
+                 const vector<ConstCoreTensorImplPtr> &As,
+                 const vector<IndexRange> &Cinds,
+                 const vector<IndexRange> &Ainds, double alpha = 1.0,
+                 double beta = 0.0);
+
+void gather_batch(const vector<CoreTensorImplPtr> &Cs,
+                  ConstCyclopsTensorImplPtr A, const vector<IndexRange> &Cinds,
+                  const vector<IndexRange> &Ainds, double alpha = 1.0,
+                  double beta = 0.0);
+#endif
+
+#ifdef HAVE_CUDA
+/**
+ * Slices with a GpuTensor on either side. CoreTensor's are transferred
+ * through the pinned staging buffers of the device; any other host tensor
+ * is staged through a CoreTensor holding the range.
+ */
+void slice_gpu(TensorImplPtr C, ConstTensorImplPtr A, const IndexRange &Cinds,
+               const IndexRange &Ainds, double alpha = 1.0,
+               double beta = 0.0);
 #endif
 }
 
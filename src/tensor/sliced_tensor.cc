@@ -29,6 +29,7 @@
 
 #include <stdexcept>
 #include <ambit/tensor.h>
+#include "indices.h"
 
 namespace ambit
 {
@@ -83,4 +84,9 @@ void SlicedTensor::operator-=(const SlicedTensor &rhs)
         throw std::runtime_error("Sliced tensors do not have same rank");
     T_.slice(rhs.T(), range_, rhs.range_, -rhs.factor_, 1.0);
 }
+
+LabeledTensor SlicedTensor::operator()(const string &indices) const
+{
+    return LabeledTensor(T_.view(range_), indices::split(indices), factor_);
+}
 }
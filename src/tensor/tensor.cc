@@ -32,11 +32,18 @@
 #include <algorithm>
 
 #include <ambit/tensor.h>
+#include <ambit/graph.h>
+#include <ambit/call_trace.h>
 #include <ambit/print.h>
+#include <ambit/memory.h>
 #include "tensorimpl.h"
 #include "core/core.h"
+#include "core/scratch.h"
 #include "disk/disk.h"
+#include "disk/tile_cache.h"
+#include "lazy/lazy.h"
 #include "indices.h"
+#include "slice.h"
 
 #include "globals.h"
 
@@ -46,6 +53,9 @@
 #if defined(HAVE_CYCLOPS)
 #include "cyclops/cyclops.h"
 #endif
+#if defined(HAVE_CUDA)
+#include "gpu/gpu.h"
+#endif
 
 namespace ambit
 {
@@ -65,7 +75,15 @@ int rank = 0;
 
 bool debug = false;
 
-size_t memory = 1 * 1024 * 1024 * 1024;
+size_t memory_limit = 1 * 1024 * 1024 * 1024;
+
+bool enforce_memory_limit = false;
+
+bool spill_to_disk = false;
+
+bool disk_compression = false;
+
+size_t disk_cache_size = 64 * 1024 * 1024;
 
 #if defined(HAVE_CYCLOPS)
 const bool distributed_capable = true;
@@ -73,7 +91,27 @@ const bool distributed_capable = true;
 const bool distributed_capable = false;
 #endif
 
+size_t distributed_threshold = 1024 * 1024;
+
+int num_threads = 0;
+
 bool timers = false;
+
+bool timer_trace = false;
+
+bool timer_counters = false;
+
+ContractionKernel contraction_kernel = AutoKernel;
+
+ContractionLayout contraction_layout = EstimatedLayout;
+
+int contraction_layout_candidate = -1;
+
+PagePlacement page_placement = ParallelFirstTouch;
+
+size_t huge_page_threshold = 4 * 1024 * 1024;
+
+double block_screening = 0.0;
 }
 
 namespace
@@ -101,6 +139,32 @@ void common_initialize(int /*argc*/, char *const * /*argv*/)
     {
         Tensor::set_scratch_path(".");
     }
+
+    // Log the contract/permute/slice calls of the run
+    const char *trace_env = std::getenv("AMBIT_CALL_TRACE");
+    if (trace_env != nullptr)
+    {
+        call_trace::start(trace_env);
+    }
+}
+
+/// Logs a call on the tensors (C, A[, B]) if a call trace is active
+void record_call(const string &kind, double alpha, double beta,
+                 const vector<const Tensor *> &tensors,
+                 const vector<Indices> &inds, const vector<IndexRange> &ranges)
+{
+    call_trace::Call call;
+    call.kind = kind;
+    call.alpha = alpha;
+    call.beta = beta;
+    for (const Tensor *tensor : tensors)
+    {
+        call.types.push_back(tensor->type());
+        call.dims.push_back(tensor->dims());
+    }
+    call.indices = inds;
+    call.ranges = ranges;
+    call_trace::record(call);
 }
 }
 
@@ -108,6 +172,10 @@ int initialize(int argc, char **argv)
 {
     common_initialize(argc, argv);
 
+#if defined(HAVE_CUDA)
+    gpu::initialize();
+#endif
+
 #if defined(HAVE_CYCLOPS)
     return cyclops::initialize(argc, argv);
 #else
@@ -127,6 +195,13 @@ void finalize()
 #if defined(HAVE_CYCLOPS)
     cyclops::finalize();
 #endif
+#if defined(HAVE_CUDA)
+    gpu::finalize();
+#endif
+
+    scratch::clear();
+    tile_cache::clear();
+    call_trace::stop();
 
     timer::report();
     timer::finalize();
@@ -150,22 +225,19 @@ Tensor Tensor::build(TensorType type, const string &name, const Dimension &dims)
                 "ambit::Tensor::build: Ambit has not been initialized.");
     }
 
-    ambit::timer::timer_push("Tensor::build");
+    AMBIT_TIMER_PUSH("Tensor::build");
 
     Tensor newObject;
 
     if (type == AgnosticTensor)
-    {
-#if defined(HAVE_CYCLOPS)
-        type = DistributedTensor;
-#else
-        type = CoreTensor;
-#endif
-    }
+        type = choose_type(dims);
     switch (type)
     {
     case CoreTensor:
         newObject.tensor_.reset(new CoreTensorImpl(name, dims));
+        static_cast<CoreTensorImpl *>(newObject.tensor_.get())->enroll();
+        AMBIT_TIMER_ALLOCATED(sizeof(double) *
+                              static_cast<double>(newObject.numel()));
         break;
 
     case DiskTensor:
@@ -182,28 +254,144 @@ Tensor Tensor::build(TensorType type, const string &name, const Dimension &dims)
 
         break;
 
+    case GpuTensor:
+#if defined(HAVE_CUDA)
+        newObject.tensor_.reset(new gpu::GpuTensorImpl(name, dims));
+#else
+        throw std::runtime_error(
+            "Tensor::build: Unable to construct GPU tensor object");
+#endif
+
+        break;
+
+    case LazyTensor:
+        throw std::runtime_error(
+            "Tensor::build: a LazyTensor is built by Tensor::build_lazy");
+
     default:
         throw std::runtime_error(
             "Tensor::build: Unknown parameter passed into 'type'.");
     }
 
-    ambit::timer::timer_pop();
+    AMBIT_TIMER_POP();
 
     return newObject;
 }
 
+Tensor Tensor::build_uninitialized(TensorType type, const string &name,
+                                  const Dimension &dims)
+{
+    if (settings::ninitialized == 0) {
+        throw std::runtime_error(
+                "ambit::Tensor::build_uninitialized: Ambit has not been initialized.");
+    }
+
+    if (type == AgnosticTensor)
+        type = choose_type(dims);
+    if (type != CoreTensor)
+        return build(type, name, dims);
+
+    AMBIT_TIMER_PUSH("Tensor::build_uninitialized");
+    Tensor newObject(scratch::build(name, dims));
+    AMBIT_TIMER_POP();
+
+    return newObject;
+}
+
+Tensor Tensor::build_deferred(const string &name, const Dimension &dims,
+                              const function<void(double *)> &loader)
+{
+    if (settings::ninitialized == 0) {
+        throw std::runtime_error(
+                "ambit::Tensor::build_deferred: Ambit has not been initialized.");
+    }
+
+    shared_ptr<CoreTensorImpl> tensor(new CoreTensorImpl(name, dims, loader));
+    tensor->enroll();
+    return Tensor(tensor);
+}
+
+Tensor Tensor::build_lazy(const string &name, const Dimension &dims,
+                          const TileGenerator &generator)
+{
+    if (settings::ninitialized == 0) {
+        throw std::runtime_error(
+                "ambit::Tensor::build_lazy: Ambit has not been initialized.");
+    }
+
+    return Tensor(shared_ptr<TensorImpl>(
+        new LazyTensorImpl(name, dims, generator)));
+}
+
 Tensor Tensor::clone(TensorType type) const
 {
     if (type == CurrentTensor)
         type = this->type();
+
     Tensor current = Tensor::build(type, name(), dims());
     current.copy(*this);
     return current;
 }
 
-void Tensor::reshape(const Dimension &dims) { tensor_->reshape(dims); }
+namespace
+{
 
-void Tensor::copy(const Tensor &other) { tensor_->copy(other.tensor_.get()); }
+// The choice of Tensor::choose_type for a tensor of bytes, of which held are
+// already in memory as a CoreTensor
+TensorType choose_type(size_t bytes, size_t held, TensorAccess access)
+{
+    if (settings::distributed_capable && settings::nprocess > 1 &&
+        bytes >= settings::distributed_threshold)
+        return DistributedTensor;
+
+    size_t live = memory::live_bytes() - std::min(held, memory::live_bytes());
+    size_t left =
+        live < settings::memory_limit ? settings::memory_limit - live : 0L;
+    if (access == StreamedAccess)
+        left /= 2;
+    return bytes <= left ? CoreTensor : DiskTensor;
+}
+}
+
+TensorType Tensor::choose_type(const Dimension &dims, TensorAccess access)
+{
+    size_t numel = 1L;
+    for (size_t dim : dims)
+        numel *= dim;
+    return ambit::choose_type(sizeof(double) * numel, 0L, access);
+}
+
+TensorType Tensor::migrate(TensorAccess access)
+{
+    Graph::flush({this}, {});
+    size_t bytes = sizeof(double) * numel();
+    TensorType target = ambit::choose_type(
+        bytes, type() == CoreTensor ? bytes : 0L, access);
+    if (target == type())
+        return target;
+
+    AMBIT_TIMER_PUSH("Tensor::migrate");
+    // Slices between disk and distributed tensors go through memory
+    if (type() != CoreTensor && target != CoreTensor)
+        *this = clone(CoreTensor);
+    *this = clone(target);
+    AMBIT_TIMER_POP();
+
+    return target;
+}
+
+void Tensor::reshape(const Dimension &dims)
+{
+    Graph::flush({this}, {});
+    tensor_->reshape(dims);
+}
+
+void Tensor::copy(const Tensor &other)
+{
+    Graph::flush({this}, {&other});
+    spill::Pin pin(tensor_.get(), other.tensor_.get());
+    tensor_->copy(other.tensor_.get());
+}
 
 Tensor::Tensor() {}
 
@@ -226,6 +414,8 @@ size_t Tensor::numel() const { return tensor_->numel(); }
 void Tensor::print(FILE *fh, bool level, string const &format,
                    int maxcols) const
 {
+    Graph::flush({}, {this});
+    spill::Pin pin(tensor_.get());
     tensor_->print(fh, level, format, maxcols);
 }
 
@@ -249,73 +439,297 @@ SlicedTensor Tensor::operator()() const
     return SlicedTensor(*this, range);
 }
 
-std::vector<double> &Tensor::data() { return tensor_->data(); }
+Tensor Tensor::view(const IndexRange &range) const
+{
+    Graph::flush({this}, {});
+    if (type() != CoreTensor)
+        throw std::runtime_error("Tensor::view: only CoreTensor's have views");
+    return Tensor(std::make_shared<CoreTensorImpl>(
+        std::static_pointer_cast<CoreTensorImpl>(tensor_), range));
+}
+
+Tensor Tensor::slab(const std::vector<size_t> &axes,
+                    const std::vector<size_t> &values) const
+{
+    Graph::flush({this}, {});
+    if (type() != CoreTensor)
+        throw std::runtime_error("Tensor::slab: only CoreTensor's have views");
+    if (axes.size() != values.size())
+        throw std::runtime_error(
+            "Tensor::slab: every fixed index needs one value");
+    IndexRange range;
+    for (size_t ind = 0L; ind < rank(); ind++)
+    {
+        range.push_back({0L, dim(ind)});
+    }
+    for (size_t n = 0L; n < axes.size(); n++)
+    {
+        if (axes[n] >= rank())
+            throw std::runtime_error("Tensor::slab: index out of range");
+        range[axes[n]] = {values[n], values[n] + 1L};
+    }
+    return Tensor(std::make_shared<CoreTensorImpl>(
+        std::static_pointer_cast<CoreTensorImpl>(tensor_), range, axes));
+}
 
-const std::vector<double> &Tensor::data() const { return tensor_->data(); }
+Epilogue Epilogue::denominator(const vector<vector<double>> &energies,
+                               const vector<double> &signs, double shift)
+{
+    if (signs.size() != energies.size())
+        throw std::runtime_error(
+            "Epilogue::denominator: every index needs energies and a sign");
+    Epilogue epilogue;
+    epilogue.energies_ = energies;
+    epilogue.signs_ = signs;
+    epilogue.shift_ = shift;
+    return epilogue;
+}
 
-Tensor Tensor::cat(std::vector<Tensor> const, int dim)
+void Epilogue::check(const Dimension &dims) const
 {
-    ThrowNotImplementedException;
+    if (func_)
+        return;
+    if (energies_.size() != dims.size())
+        throw std::runtime_error(
+            "Epilogue: the denominator has " +
+            std::to_string(energies_.size()) + " indices, C has rank " +
+            std::to_string(dims.size()));
+    for (size_t dim = 0; dim < dims.size(); ++dim)
+        if (energies_[dim].size() != dims[dim])
+            throw std::runtime_error(
+                "Epilogue: the energies of index " + std::to_string(dim) +
+                " do not match the dimension of C");
+}
+
+void Epilogue::apply(vector<size_t> &indices, size_t dim, double *data,
+                     size_t n) const
+{
+    if (func_)
+    {
+        if (indices.empty())
+        {
+            func_(indices, data[0]);
+            return;
+        }
+        size_t first = indices[dim];
+        for (size_t m = 0; m < n; ++m)
+        {
+            indices[dim] = first + m;
+            func_(indices, data[m]);
+        }
+        indices[dim] = first;
+        return;
+    }
+
+    double base = shift_;
+    for (size_t k = 0; k < indices.size(); ++k)
+        if (k != dim)
+            base += signs_[k] * energies_[k][indices[k]];
+    if (indices.empty())
+    {
+        data[0] /= base;
+        return;
+    }
+    const double *energy = energies_[dim].data() + indices[dim];
+    double sign = signs_[dim];
+    for (size_t m = 0; m < n; ++m)
+        data[m] /= base + sign * energy[m];
+}
+
+bool Tensor::is_view() const
+{
+    return type() == CoreTensor &&
+           static_cast<const CoreTensorImpl *>(tensor_.get())->is_view();
+}
+
+std::vector<double> &Tensor::data()
+{
+    Graph::flush({this}, {});
+    return tensor_->data();
+}
+
+const std::vector<double> &Tensor::data() const
+{
+    Graph::flush({}, {this});
+    return const_cast<const TensorImpl *>(tensor_.get())->data();
+}
+
+double *Tensor::map_data()
+{
+    Graph::flush({this}, {});
+    return tensor_->map_data();
+}
+
+const double *Tensor::map_data() const
+{
+    Graph::flush({}, {this});
+    return const_cast<const TensorImpl *>(tensor_.get())->map_data();
+}
+
+void Tensor::unmap_data() const { tensor_->unmap_data(); }
+
+Tensor Tensor::cat(const vector<Tensor> &tensors, int dim)
+{
+    for (const Tensor &T : tensors)
+        Graph::flush({}, {&T});
+    if (tensors.empty())
+        throw std::runtime_error("Tensor::cat: no tensors to concatenate");
+    const Tensor &first = tensors[0];
+    if (dim < 0 || static_cast<size_t>(dim) >= first.rank())
+        throw std::runtime_error("Tensor::cat: dim is out of range");
+
+    Dimension dims = first.dims();
+    dims[dim] = 0L;
+    for (const Tensor &T : tensors)
+    {
+        if (T.rank() != first.rank())
+            throw std::runtime_error("Tensor::cat: tensors differ in rank");
+        for (size_t ind = 0L; ind < T.rank(); ind++)
+        {
+            if (ind != static_cast<size_t>(dim) && T.dim(ind) != first.dim(ind))
+                throw std::runtime_error(
+                    "Tensor::cat: tensors differ in an index other than dim");
+        }
+        dims[dim] += T.dim(dim);
+    }
+
+    AMBIT_TIMER_PUSH("Tensor::cat");
+
+    // Every element of C is written below
+    Tensor C =
+        Tensor::build_uninitialized(first.type(), first.name() + " cat", dims);
+
+    // Core tensors are concatenated in one pass over C, others by slicing
+    // each of them into its range of C (disk slices stream their stripes)
+    bool fused = (C.type() == CoreTensor);
+    for (const Tensor &T : tensors)
+        fused = fused && T.type() == CoreTensor && !T.is_view();
+    if (fused)
+    {
+        std::list<spill::Pin> pins;
+        vector<ConstCoreTensorImplPtr> As;
+        for (const Tensor &T : tensors)
+        {
+            pins.emplace_back(T.tensor_.get());
+            As.push_back(static_cast<ConstCoreTensorImplPtr>(T.tensor_.get()));
+        }
+        spill::Pin pin(C.tensor_.get());
+        ambit::cat(static_cast<CoreTensorImplPtr>(C.tensor_.get()), As, dim);
+    }
+    else
+    {
+        size_t offset = 0L;
+        for (const Tensor &T : tensors)
+        {
+            IndexRange Ainds;
+            for (size_t ind = 0L; ind < T.rank(); ind++)
+                Ainds.push_back({0L, T.dim(ind)});
+            IndexRange Cinds(Ainds);
+            Cinds[dim] = {offset, offset + T.dim(dim)};
+            C.slice(T, Cinds, Ainds);
+            offset += T.dim(dim);
+        }
+    }
+
+    AMBIT_TIMER_POP();
+
+    return C;
 }
 
 double Tensor::norm(int type) const
 {
-    timer::timer_push("Tensor::norm");
+    Graph::flush({}, {this});
+    AMBIT_TIMER_PUSH("Tensor::norm");
+    spill::Pin pin(tensor_.get());
     auto result = tensor_->norm(type);
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
     return result;
 }
 void Tensor::zero()
 {
-    timer::timer_push("Tensor::zero");
+    Graph::flush({this}, {});
+    AMBIT_TIMER_PUSH("Tensor::zero");
+    spill::Pin pin(tensor_.get());
     tensor_->scale(0.0);
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
 }
 
 void Tensor::scale(double beta)
 {
-    timer::timer_push("Tensor::scale");
+    Graph::flush({this}, {});
+    AMBIT_TIMER_PUSH("Tensor::scale");
+    spill::Pin pin(tensor_.get());
     tensor_->scale(beta);
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
 }
 
 void Tensor::set(double alpha)
 {
-    timer::timer_push("Timer::set");
+    Graph::flush({this}, {});
+    AMBIT_TIMER_PUSH("Timer::set");
+    spill::Pin pin(tensor_.get());
     tensor_->set(alpha);
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
 }
 
 void Tensor::iterate(
     const std::function<void(const std::vector<size_t> &, double &)> &func)
 {
-    timer::timer_push("Tensor::iterate");
+    Graph::flush({this}, {});
+    AMBIT_TIMER_PUSH("Tensor::iterate");
+    spill::Pin pin(tensor_.get());
     tensor_->iterate(func);
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
+}
+
+void Tensor::parallel_iterate(
+    const std::function<void(const std::vector<size_t> &, double &)> &func)
+{
+    Graph::flush({this}, {});
+    AMBIT_TIMER_PUSH("Tensor::parallel_iterate");
+    spill::Pin pin(tensor_.get());
+    tensor_->parallel_iterate(func);
+    AMBIT_TIMER_POP();
 }
 
 void Tensor::citerate(const std::function<void(const std::vector<size_t> &,
                                                const double &)> &func) const
 {
-    timer::timer_push("Tensor::citerate");
+    Graph::flush({}, {this});
+    AMBIT_TIMER_PUSH("Tensor::citerate");
+    spill::Pin pin(tensor_.get());
     tensor_->citerate(func);
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
+}
+
+TensorStats Tensor::stats() const
+{
+    Graph::flush({}, {this});
+    AMBIT_TIMER_PUSH("Tensor::stats");
+    spill::Pin pin(tensor_.get());
+    auto result = tensor_->stats();
+    AMBIT_TIMER_POP();
+    return result;
 }
 
 std::tuple<double, std::vector<size_t>> Tensor::max() const
 {
-    timer::timer_push("Tensor::max");
+    Graph::flush({}, {this});
+    AMBIT_TIMER_PUSH("Tensor::max");
+    spill::Pin pin(tensor_.get());
     auto result = tensor_->max();
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
 
     return result;
 }
 
 tuple<double, vector<size_t>> Tensor::min() const
 {
-    timer::timer_push("Tensor::min");
+    Graph::flush({}, {this});
+    AMBIT_TIMER_PUSH("Tensor::min");
+    spill::Pin pin(tensor_.get());
     auto result = tensor_->min();
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
 
     return result;
 }
@@ -334,22 +748,38 @@ map<string, Tensor> Tensor::map_to_tensor(const map<string, TensorImplPtr> &x)
 
 map<string, Tensor> Tensor::syev(EigenvalueOrder order) const
 {
-    timer::timer_push("Tensor::syev");
+    Graph::flush({}, {this});
+    AMBIT_TIMER_PUSH("Tensor::syev");
+    spill::Pin pin(tensor_.get());
     auto result = map_to_tensor(tensor_->syev(order));
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
+    return result;
+}
+
+map<string, Tensor> Tensor::syev(EigenvalueOrder order, size_t count) const
+{
+    Graph::flush({}, {this});
+    AMBIT_TIMER_PUSH("Tensor::syev");
+    spill::Pin pin(tensor_.get());
+    auto result = map_to_tensor(tensor_->syev(order, count));
+    AMBIT_TIMER_POP();
     return result;
 }
 
 map<string, Tensor> Tensor::geev(EigenvalueOrder order) const
 {
-    timer::timer_push("Tensor::geev");
+    Graph::flush({}, {this});
+    AMBIT_TIMER_PUSH("Tensor::geev");
+    spill::Pin pin(tensor_.get());
     auto result = map_to_tensor(tensor_->geev(order));
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
     return result;
 }
 
 std::map<std::string, Tensor> Tensor::gesvd() const
 {
+    Graph::flush({}, {this});
+    spill::Pin pin(tensor_.get());
     return map_to_tensor(tensor_->gesvd());
 }
 
@@ -375,11 +805,15 @@ std::map<std::string, Tensor> Tensor::gesvd() const
 
 Tensor Tensor::inverse() const
 {
+    Graph::flush({}, {this});
+    spill::Pin pin(tensor_.get());
     return Tensor(shared_ptr<TensorImpl>(tensor_->inverse()));
 }
 
 Tensor Tensor::power(double alpha, double condition) const
 {
+    Graph::flush({}, {this});
+    spill::Pin pin(tensor_.get());
     return Tensor(shared_ptr<TensorImpl>(tensor_->power(alpha, condition)));
 }
 
@@ -390,6 +824,7 @@ void Tensor::contract(const Tensor &A, const Tensor &B, const Indices &Cinds,
                       std::shared_ptr<TensorImpl> &C2,
                       double alpha, double beta)
 {
+    Graph::flush({this}, {&A, &B});
     if (ambit::settings::debug) {
         ambit::print("    #: " + std::to_string(beta) + " " + name() + "[" +
                      indices::to_string(Cinds) + "] = " +
@@ -398,21 +833,26 @@ void Tensor::contract(const Tensor &A, const Tensor &B, const Indices &Cinds,
                      indices::to_string(Binds) + "]\n");
     }
 
-    timer::timer_push("#: " + std::to_string(beta) + " " + name() + "[" +
-                      indices::to_string(Cinds) + "] = " +
-                      std::to_string(alpha) + " " + A.name() + "[" +
-                      indices::to_string(Ainds) + "] * " + B.name() + "[" +
-                      indices::to_string(Binds) + "]");
+    AMBIT_TIMER_PUSH("#: " + std::to_string(beta) + " " + name() + "[" +
+                     indices::to_string(Cinds) + "] = " +
+                     std::to_string(alpha) + " " + A.name() + "[" +
+                     indices::to_string(Ainds) + "] * " + B.name() + "[" +
+                     indices::to_string(Binds) + "]");
 
+    spill::Pin pin(tensor_.get(), A.tensor_.get(), B.tensor_.get());
     tensor_->contract(A.tensor_.get(), B.tensor_.get(), Cinds, Ainds, Binds,
                       A2, B2, C2, alpha, beta);
+    if (call_trace::active())
+        record_call("contract", alpha, beta, {this, &A, &B},
+                    {Cinds, Ainds, Binds}, {});
 
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
 }
 void Tensor::contract(const Tensor &A, const Tensor &B, const Indices &Cinds,
                       const Indices &Ainds, const Indices &Binds, double alpha,
                       double beta)
 {
+    Graph::flush({this}, {&A, &B});
     if (ambit::settings::debug) {
         ambit::print("    #: " + std::to_string(beta) + " " + name() + "[" +
                      indices::to_string(Cinds) + "] = " +
@@ -421,53 +861,271 @@ void Tensor::contract(const Tensor &A, const Tensor &B, const Indices &Cinds,
                      indices::to_string(Binds) + "]\n");
     }
 
-    timer::timer_push("#: " + std::to_string(beta) + " " + name() + "[" +
-                      indices::to_string(Cinds) + "] = " +
-                      std::to_string(alpha) + " " + A.name() + "[" +
-                      indices::to_string(Ainds) + "] * " + B.name() + "[" +
-                      indices::to_string(Binds) + "]");
+    AMBIT_TIMER_PUSH("#: " + std::to_string(beta) + " " + name() + "[" +
+                     indices::to_string(Cinds) + "] = " +
+                     std::to_string(alpha) + " " + A.name() + "[" +
+                     indices::to_string(Ainds) + "] * " + B.name() + "[" +
+                     indices::to_string(Binds) + "]");
 
+    spill::Pin pin(tensor_.get(), A.tensor_.get(), B.tensor_.get());
     tensor_->contract(A.tensor_.get(), B.tensor_.get(), Cinds, Ainds, Binds,
                       alpha, beta);
+    if (call_trace::active())
+        record_call("contract", alpha, beta, {this, &A, &B},
+                    {Cinds, Ainds, Binds}, {});
+
+    AMBIT_TIMER_POP();
+}
+void Tensor::contract(const Tensor &A, const Tensor &B, const Indices &Cinds,
+                      const Indices &Ainds, const Indices &Binds,
+                      const Epilogue &epilogue, double alpha, double beta)
+{
+    Graph::flush({this}, {&A, &B});
+    epilogue.check(dims());
+
+    // Other backends (and views) contract first and finish C in a second
+    // pass over its elements
+    if (type() != CoreTensor || A.type() != CoreTensor ||
+        B.type() != CoreTensor || is_view() || A.is_view() || B.is_view())
+    {
+        contract(A, B, Cinds, Ainds, Binds, alpha, beta);
+        size_t dim = rank() == 0 ? 0L : rank() - 1L;
+        parallel_iterate([&](const vector<size_t> &indices, double &value) {
+            vector<size_t> idx(indices);
+            epilogue.apply(idx, dim, &value, 1L);
+        });
+        return;
+    }
+
+    if (ambit::settings::debug) {
+        ambit::print("    #: " + std::to_string(beta) + " " + name() + "[" +
+                     indices::to_string(Cinds) + "] = epilogue(" +
+                     std::to_string(alpha) + " " + A.name() + "[" +
+                     indices::to_string(Ainds) + "] * " + B.name() + "[" +
+                     indices::to_string(Binds) + "])\n");
+    }
 
-    timer::timer_pop();
+    AMBIT_TIMER_PUSH("#: " + std::to_string(beta) + " " + name() + "[" +
+                     indices::to_string(Cinds) + "] = epilogue(" +
+                     std::to_string(alpha) + " " + A.name() + "[" +
+                     indices::to_string(Ainds) + "] * " + B.name() + "[" +
+                     indices::to_string(Binds) + "])");
+
+    spill::Pin pin(tensor_.get(), A.tensor_.get(), B.tensor_.get());
+    ambit::contract_epilogue(
+        static_cast<CoreTensorImplPtr>(tensor_.get()),
+        static_cast<ConstCoreTensorImplPtr>(A.tensor_.get()),
+        static_cast<ConstCoreTensorImplPtr>(B.tensor_.get()), Cinds, Ainds,
+        Binds, epilogue, alpha, beta);
+    if (call_trace::active())
+        record_call("contract", alpha, beta, {this, &A, &B},
+                    {Cinds, Ainds, Binds}, {});
+
+    AMBIT_TIMER_POP();
+}
+void Tensor::contract_batch(const vector<Tensor> &Cs,
+                            const vector<Tensor> &As,
+                            const vector<Tensor> &Bs, const Indices &Cinds,
+                            const Indices &Ainds, const Indices &Binds,
+                            double alpha, double beta)
+{
+    if (As.size() != Cs.size() || Bs.size() != Cs.size())
+        throw std::runtime_error(
+            "Tensor::contract_batch: every product needs a C, an A and a B");
+    for (size_t n = 0; n < Cs.size(); ++n)
+        Graph::flush({&Cs[n]}, {&As[n], &Bs[n]});
+
+    bool core = true;
+    for (size_t n = 0; n < Cs.size(); ++n)
+        core = core && Cs[n].type() == CoreTensor &&
+               As[n].type() == CoreTensor && Bs[n].type() == CoreTensor;
+    if (!core || call_trace::active())
+    {
+        for (size_t n = 0; n < Cs.size(); ++n)
+        {
+            Tensor C(Cs[n]);
+            C.contract(As[n], Bs[n], Cinds, Ainds, Binds, alpha, beta);
+        }
+        return;
+    }
+
+    std::list<spill::Pin> pins;
+    vector<CoreTensorImplPtr> Cimpls;
+    vector<ConstCoreTensorImplPtr> Aimpls;
+    vector<ConstCoreTensorImplPtr> Bimpls;
+    for (size_t n = 0; n < Cs.size(); ++n)
+    {
+        pins.emplace_back(Cs[n].tensor_.get(), As[n].tensor_.get(),
+                          Bs[n].tensor_.get());
+        Cimpls.push_back(static_cast<CoreTensorImplPtr>(Cs[n].tensor_.get()));
+        Aimpls.push_back(
+            static_cast<ConstCoreTensorImplPtr>(As[n].tensor_.get()));
+        Bimpls.push_back(
+            static_cast<ConstCoreTensorImplPtr>(Bs[n].tensor_.get()));
+    }
+    ambit::contract_batch(Cimpls, Aimpls, Bimpls, Cinds, Ainds, Binds, alpha,
+                          beta);
 }
 void Tensor::permute(const Tensor &A, const Indices &Cinds,
                      const Indices &Ainds, double alpha, double beta)
 {
+    Graph::flush({this}, {&A});
     if (ambit::settings::debug) {
         ambit::print("    P: " + name() + "[" + indices::to_string(Cinds) +
                      "] = " + A.name() + "[" + indices::to_string(Ainds) +
                      "]\n");
     }
 
-    timer::timer_push("P: " + name() + "[" + indices::to_string(Cinds) +
-                      "] = " + A.name() + "[" + indices::to_string(Ainds) +
-                      "]");
+    AMBIT_TIMER_PUSH("P: " + name() + "[" + indices::to_string(Cinds) +
+                     "] = " + A.name() + "[" + indices::to_string(Ainds) +
+                     "]");
 
+    spill::Pin pin(tensor_.get(), A.tensor_.get());
     tensor_->permute(A.tensor_.get(), Cinds, Ainds, alpha, beta);
+    if (call_trace::active())
+        record_call("permute", alpha, beta, {this, &A}, {Cinds, Ainds}, {});
 
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
+}
+void Tensor::permute_sum(const vector<Tensor> &As, const Indices &Cinds,
+                         const vector<Indices> &Ainds,
+                         const vector<double> &alphas, double beta)
+{
+    for (const Tensor &A : As)
+        Graph::flush({this}, {&A});
+    Graph::flush({this}, {});
+    if (Ainds.size() != As.size() || alphas.size() != As.size())
+        throw std::runtime_error(
+            "Tensor::permute_sum: every term needs indices and a scale");
+    if (As.empty())
+    {
+        scale(beta);
+        return;
+    }
+
+    // A term that reads C in another order would see elements that were
+    // already overwritten, and spilled tensors would all be faulted back in
+    // at once, so those go through the separate permutes
+    auto fusable = [](const Tensor &T) {
+        return T.type() == CoreTensor && !T.is_view() &&
+               !static_cast<const CoreTensorImpl *>(T.tensor_.get())
+                    ->spilled();
+    };
+    bool fused = As.size() > 1 && fusable(*this);
+    for (size_t n = 0; n < As.size(); ++n)
+        fused = fused && fusable(As[n]) &&
+                (As[n].tensor_ != tensor_ || Ainds[n] == Cinds);
+    if (!fused)
+    {
+        for (size_t n = 0; n < As.size(); ++n)
+            permute(As[n], Cinds, Ainds[n], alphas[n], n == 0 ? beta : 1.0);
+        return;
+    }
+
+    if (ambit::settings::debug) {
+        for (size_t n = 0; n < As.size(); ++n)
+            ambit::print("    P: " + name() + "[" +
+                         indices::to_string(Cinds) + "] += " + As[n].name() +
+                         "[" + indices::to_string(Ainds[n]) + "]\n");
+    }
+
+    AMBIT_TIMER_PUSH("Tensor::permute_sum");
+
+    std::list<spill::Pin> pins;
+    vector<ConstCoreTensorImplPtr> Aimpls;
+    for (const Tensor &A : As)
+    {
+        pins.emplace_back(tensor_.get(), A.tensor_.get());
+        Aimpls.push_back(static_cast<ConstCoreTensorImplPtr>(A.tensor_.get()));
+    }
+    ambit::permute_sum(static_cast<CoreTensorImplPtr>(tensor_.get()), Aimpls,
+                       Cinds, Ainds, alphas, beta);
+    if (call_trace::active())
+        for (size_t n = 0; n < As.size(); ++n)
+            record_call("permute", alphas[n], n == 0 ? beta : 1.0,
+                        {this, &As[n]}, {Cinds, Ainds[n]}, {});
+
+    AMBIT_TIMER_POP();
 }
 void Tensor::slice(const Tensor &A, const IndexRange &Cinds,
                    const IndexRange &Ainds, double alpha, double beta)
 {
-    timer::timer_push("Tensor::slice");
+    Graph::flush({this}, {&A});
+    AMBIT_TIMER_PUSH("Tensor::slice");
 
+    spill::Pin pin(tensor_.get(), A.tensor_.get());
     tensor_->slice(A.tensor_.get(), Cinds, Ainds, alpha, beta);
+    if (call_trace::active())
+        record_call("slice", alpha, beta, {this, &A}, {}, {Cinds, Ainds});
+
+    AMBIT_TIMER_POP();
+}
+void Tensor::scatter(const vector<Tensor> &As, const vector<IndexRange> &Cinds,
+                     const vector<IndexRange> &Ainds, double alpha,
+                     double beta)
+{
+    for (const Tensor &A : As)
+        Graph::flush({this}, {&A});
+    if (As.size() != Cinds.size() || Ainds.size() != Cinds.size())
+        throw std::runtime_error(
+            "Tensor::scatter: every piece needs an A and two ranges");
+
+    AMBIT_TIMER_PUSH("Tensor::scatter");
+
+    std::list<spill::Pin> pins;
+    vector<ConstTensorImplPtr> Aimpls;
+    for (const Tensor &A : As)
+    {
+        pins.emplace_back(tensor_.get(), A.tensor_.get());
+        Aimpls.push_back(A.tensor_.get());
+    }
+    slice_batch(tensor_.get(), Aimpls, Cinds, Ainds, alpha, beta);
+    if (call_trace::active())
+        for (size_t n = 0; n < As.size(); ++n)
+            record_call("slice", alpha, beta, {this, &As[n]}, {},
+                        {Cinds[n], Ainds[n]});
+
+    AMBIT_TIMER_POP();
+}
+void Tensor::gather(const vector<Tensor> &Cs, const vector<IndexRange> &Cinds,
+                    const vector<IndexRange> &Ainds, double alpha,
+                    double beta) const
+{
+    for (const Tensor &C : Cs)
+        Graph::flush({&C}, {this});
+    if (Cs.size() != Cinds.size() || Ainds.size() != Cinds.size())
+        throw std::runtime_error(
+            "Tensor::gather: every piece needs a C and two ranges");
+
+    AMBIT_TIMER_PUSH("Tensor::gather");
+
+    std::list<spill::Pin> pins;
+    vector<TensorImplPtr> Cimpls;
+    for (const Tensor &C : Cs)
+    {
+        pins.emplace_back(C.tensor_.get(), tensor_.get());
+        Cimpls.push_back(C.tensor_.get());
+    }
+    gather_batch(Cimpls, tensor_.get(), Cinds, Ainds, alpha, beta);
+    if (call_trace::active())
+        for (size_t n = 0; n < Cs.size(); ++n)
+            record_call("slice", alpha, beta, {&Cs[n], this}, {},
+                        {Cinds[n], Ainds[n]});
 
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
 }
 void Tensor::gemm(const Tensor &A, const Tensor &B, bool transA, bool transB,
                   size_t nrow, size_t ncol, size_t nzip, size_t ldaA,
                   size_t ldaB, size_t ldaC, size_t offA, size_t offB,
                   size_t offC, double alpha, double beta)
 {
-    timer::timer_push("Tensor::gemm");
+    Graph::flush({this}, {&A, &B});
+    AMBIT_TIMER_PUSH("Tensor::gemm");
+    spill::Pin pin(tensor_.get(), A.tensor_.get(), B.tensor_.get());
     tensor_->gemm(A.tensor_.get(), B.tensor_.get(), transA, transB, nrow, ncol,
                   nzip, ldaA, ldaB, ldaC, offA, offB, offC, alpha, beta);
 
-    timer::timer_pop();
+    AMBIT_TIMER_POP();
 }
 
 bool Tensor::operator==(const Tensor &other) const
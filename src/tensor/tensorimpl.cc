@@ -27,6 +27,7 @@
  * @END LICENSE
  */
 
+#include <cmath>
 #include <numeric>
 #include "tensorimpl.h"
 #include "core/core.h"
@@ -36,6 +37,9 @@
 #if defined(HAVE_CYCLOPS)
 #include "cyclops/cyclops.h"
 #endif
+#if defined(HAVE_CUDA)
+#include "gpu/gpu.h"
+#endif
 
 namespace ambit
 {
@@ -57,6 +61,20 @@ void TensorImpl::slice(ConstTensorImplPtr A, const IndexRange &Cinds,
 void TensorImpl::zero()
 { scale(0.0); }
 
+TensorStats TensorImpl::stats() const
+{
+    TensorStats result;
+    result.numel = numel();
+    result.norm1 = norm(1);
+    result.norm2 = norm(2);
+    result.norm_inf = norm(0);
+    if (numel() != 0L)
+        result.rms = result.norm2 / std::sqrt(static_cast<double>(numel()));
+    std::tie(result.max, result.max_indices) = max();
+    std::tie(result.min, result.min_indices) = min();
+    return result;
+}
+
 void TensorImpl::copy(ConstTensorImplPtr other)
 {
     TensorImpl::dimensionCheck(this, other);
@@ -89,6 +107,12 @@ TensorImplPtr TensorImpl::clone(TensorType t) const
         {
             tensor = new cyclops::CyclopsTensorImpl(name(), dims());
         }
+#endif
+#if defined(HAVE_CUDA)
+    else if (t == GpuTensor)
+    {
+        tensor = new gpu::GpuTensorImpl(name(), dims());
+    }
 #endif
     else
     {
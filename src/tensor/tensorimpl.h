@@ -61,6 +61,7 @@ class OutOfMemoryException : public std::runtime_error
 {
   public:
     OutOfMemoryException() : std::runtime_error("Out of memory") {}
+    OutOfMemoryException(const std::string &str) : std::runtime_error(str) {}
 };
 }
 
@@ -106,6 +107,19 @@ class TensorImpl
             "TensorImpl::data() not supported for tensor type " +
             std::to_string(type()));
     }
+    virtual double *map_data()
+    {
+        throw std::runtime_error(
+            "TensorImpl::map_data() not supported for tensor type " +
+            std::to_string(type()));
+    }
+    virtual const double *map_data() const
+    {
+        throw std::runtime_error(
+            "TensorImpl::map_data() not supported for tensor type " +
+            std::to_string(type()));
+    }
+    virtual void unmap_data() const {}
 
     // => Simple Single Tensor Operations <= //
 
@@ -127,6 +141,9 @@ class TensorImpl
             "Operation not support in this tensor implementation.");
     }
 
+    // Gathered from norm(), max() and min() unless overridden
+    virtual TensorStats stats() const;
+
     void zero();
 
     virtual void scale(double beta = 0.0)
@@ -195,6 +212,12 @@ class TensorImpl
             "Operation not supported in this tensor implementation.");
     }
     virtual std::map<std::string, TensorImplPtr>
+    syev(EigenvalueOrder order, size_t count) const
+    {
+        throw std::runtime_error(
+            "Operation not supported in this tensor implementation.");
+    }
+    virtual std::map<std::string, TensorImplPtr>
     geev(EigenvalueOrder order) const
     {
         throw std::runtime_error(
@@ -236,6 +259,12 @@ class TensorImpl
         throw std::runtime_error(
             "Operation not supported in this tensor implementation.");
     }
+    /// Like iterate, but func may be called concurrently from several threads
+    virtual void parallel_iterate(
+        const std::function<void(const std::vector<size_t> &, double &)> &func)
+    {
+        iterate(func);
+    }
 
     void reshape(const Dimension &dims) { dims_ = dims; }
 
@@ -0,0 +1,174 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#include <algorithm>
+#include <mutex>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#include <ambit/settings.h>
+
+#include "threads.h"
+
+// The thread controls of the BLAS libraries, where the linked one has them
+#if defined(__GNUC__)
+extern "C" {
+void openblas_set_num_threads(int) __attribute__((weak));
+int openblas_get_num_threads() __attribute__((weak));
+int MKL_Set_Num_Threads_Local(int) __attribute__((weak));
+}
+#define AMBIT_BLAS_THREADS 1
+#endif
+
+namespace ambit
+{
+
+namespace threads
+{
+
+namespace
+{
+
+/// The cap of the Limit in scope on this thread (0 if none)
+thread_local int limit = 0;
+
+/// The global settings changed by the TaskThreads in scope, on any thread
+std::mutex global_mutex;
+/// Number of TaskThreads holding each setting changed, and its value before
+int blas_holders = 0;
+int saved_blas = 0;
+int levels_holders = 0;
+int saved_levels = 0;
+
+int omp_threads()
+{
+#if defined(_OPENMP)
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+int omp_level()
+{
+#if defined(_OPENMP)
+    return omp_get_level();
+#else
+    return 0;
+#endif
+}
+}
+
+int max_threads()
+{
+    int n = omp_threads();
+    if (settings::num_threads > 0)
+        n = std::min(n, settings::num_threads);
+    if (limit > 0)
+        n = std::min(n, limit);
+    return std::max(n, 1);
+}
+
+Limit::Limit(int nthread) : previous_(limit)
+{
+    if (nthread > 0)
+        limit = (limit > 0) ? std::min(limit, nthread) : nthread;
+}
+
+Limit::~Limit() { limit = previous_; }
+
+TaskThreads::TaskThreads(size_t ntask) : blas_(false), levels_(false)
+{
+    int total = max_threads();
+    outer_ = static_cast<int>(
+        std::max<size_t>(std::min<size_t>(ntask, static_cast<size_t>(total)), 1));
+    inner_ = std::max(total / outer_, 1);
+    if (outer_ == 1)
+        return;
+
+    std::lock_guard<std::mutex> lock(global_mutex);
+#if defined(_OPENMP)
+    // The tasks are a parallel region; their own regions nest inside it
+    if (inner_ > 1)
+    {
+        if (levels_holders++ == 0)
+            saved_levels = omp_get_max_active_levels();
+        levels_ = true;
+        if (omp_get_max_active_levels() < omp_level() + 2)
+            omp_set_max_active_levels(omp_level() + 2);
+    }
+#endif
+
+#if defined(AMBIT_BLAS_THREADS)
+    // The thread count of OpenBLAS is global, so only outermost splits set
+    // it, and concurrent ones (of other user threads) keep the smallest
+    if (omp_level() == 0 && openblas_set_num_threads != nullptr &&
+        openblas_get_num_threads != nullptr)
+    {
+        if (blas_holders++ == 0)
+            saved_blas = openblas_get_num_threads();
+        blas_ = true;
+        if (blas_holders == 1 || inner_ < openblas_get_num_threads())
+            openblas_set_num_threads(inner_);
+    }
+#endif
+}
+
+TaskThreads::~TaskThreads()
+{
+    if (!blas_ && !levels_)
+        return;
+    std::lock_guard<std::mutex> lock(global_mutex);
+#if defined(AMBIT_BLAS_THREADS)
+    if (blas_ && --blas_holders == 0)
+        openblas_set_num_threads(saved_blas);
+#endif
+#if defined(_OPENMP)
+    if (levels_ && --levels_holders == 0)
+        omp_set_max_active_levels(saved_levels);
+#endif
+}
+
+void TaskThreads::enter() const
+{
+    if (outer_ == 1)
+        return;
+#if defined(_OPENMP)
+    omp_set_num_threads(inner_);
+#endif
+#if defined(AMBIT_BLAS_THREADS)
+    if (MKL_Set_Num_Threads_Local != nullptr)
+        MKL_Set_Num_Threads_Local(inner_);
+#endif
+}
+}
+}
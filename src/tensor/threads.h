@@ -0,0 +1,86 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+#if !defined(TENSOR_THREADS_H)
+#define TENSOR_THREADS_H
+
+#include <cstddef>
+
+#include <ambit/threads.h>
+
+namespace ambit
+{
+
+namespace threads
+{
+
+/**
+ * The split of max_threads() between ntask concurrent tasks (outer) and the
+ * threads of each task (inner), for the lifetime of the object. Typical use:
+ *  TaskThreads split(ntask);
+ *  #pragma omp parallel for num_threads(split.outer()) proc_bind(spread)
+ *  for (...)
+ *  {
+ *      split.enter();
+ *      ... // BLAS and OpenMP calls run on split.inner() threads
+ *  }
+ * While in scope the BLAS library runs on inner threads, and nested OpenMP
+ * regions are allowed when inner is above one. Those two settings are
+ * global: the first TaskThreads of any thread to change one saves it, and
+ * the last one in scope restores it.
+ **/
+class TaskThreads
+{
+  public:
+    explicit TaskThreads(size_t ntask);
+    ~TaskThreads();
+
+    TaskThreads(const TaskThreads &) = delete;
+    TaskThreads &operator=(const TaskThreads &) = delete;
+
+    /// @return The number of tasks run at once
+    int outer() const { return outer_; }
+    /// @return The threads of each task
+    int inner() const { return inner_; }
+
+    /// Gives the calling task its inner threads; call first thing in a task
+    void enter() const;
+
+  private:
+    int outer_;
+    int inner_;
+    /// Does this split hold the BLAS threads (nested levels) changed?
+    bool blas_;
+    bool levels_;
+};
+}
+}
+
+#endif
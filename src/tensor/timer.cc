@@ -36,9 +36,23 @@
 #include <ambit/timer.h>
 #include <ambit/print.h>
 
+#include "hardware_counters.h"
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cassert>
 #include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <mutex>
+#include <thread>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
 
 namespace ambit
 {
@@ -61,19 +75,136 @@ struct TimerDetail
     // Number of times the timer has been called
     size_t total_calls;
 
+    // Counters charged to this timer (not including its children)
+    double flops;
+    double bytes;
+    double allocated;
+
+    // Hardware counts of the calls, counted on this thread (including its
+    // children)
+    hardware_counters::Sample counters;
+    hardware_counters::Sample start_counters;
+    bool counting;
+
     TimerDetail *parent;
     map<string, TimerDetail> children;
+    /// Children already reached through a string literal, by its address
+    vector<pair<const char *, TimerDetail *>> interned;
 
     time_point start_time;
 
     TimerDetail()
-        : name("(no name)"), total_time(0), total_calls(0), parent(nullptr)
+        : name("(no name)"), total_time(0), total_calls(0), flops(0.0),
+          bytes(0.0), allocated(0.0), counting(false), parent(nullptr)
     {
     }
 };
 
-TimerDetail *current_timer = nullptr;
+/// A timed call recorded for write_trace, in microseconds since initialize
+struct TraceEvent
+{
+    string name;
+    long long start;
+    long long duration;
+};
+
+/**
+ * The timers of one thread in parallel code.
+ *
+ * Code run outside of parallel regions on the thread that initialized the
+ * timers builds the main tree under root. Everything else (OpenMP regions,
+ * other threads) is timed in trees of its own thread, attached to the node
+ * of the main tree that was current when the outermost timer was pushed.
+ * report() merges these trees by name under their node.
+ */
+struct ThreadTimers
+{
+    size_t index;
+    /// Roots of the trees of this thread, by the node they are attached to
+    map<const TimerDetail *, TimerDetail> roots;
+    /// The current timer, or nullptr outside of any timer of this thread
+    TimerDetail *current;
+    vector<TraceEvent> events;
+};
+
 TimerDetail *root = nullptr;
+time_point origin;
+vector<TraceEvent> main_events;
+std::atomic<TimerDetail *> current_timer(nullptr);
+std::thread::id main_thread;
+
+std::mutex threads_mutex;
+vector<std::unique_ptr<ThreadTimers>> threads;
+thread_local ThreadTimers *this_thread = nullptr;
+
+bool serial()
+{
+    if (std::this_thread::get_id() != main_thread)
+        return false;
+#if defined(_OPENMP)
+    return !omp_in_parallel();
+#else
+    return true;
+#endif
+}
+
+ThreadTimers &thread_timers()
+{
+    if (this_thread == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        threads.push_back(std::unique_ptr<ThreadTimers>(new ThreadTimers));
+        this_thread = threads.back().get();
+        this_thread->index = threads.size() - 1;
+        this_thread->current = nullptr;
+    }
+    return *this_thread;
+}
+
+/// The timer that a push on this thread nests under
+TimerDetail *current()
+{
+    if (serial())
+        return current_timer.load();
+
+    ThreadTimers &timers = thread_timers();
+    if (timers.current == nullptr)
+        timers.current = &timers.roots[current_timer.load()];
+    return timers.current;
+}
+
+void set_current(TimerDetail *timer)
+{
+    if (serial())
+    {
+        current_timer.store(timer);
+        return;
+    }
+    // Leaving the outermost timer detaches the thread from the main tree
+    if (timer->parent == nullptr)
+        timer = nullptr;
+    thread_timers().current = timer;
+}
+
+void push(TimerDetail *timer)
+{
+    set_current(timer);
+    timer->counting = settings::timer_counters;
+    if (timer->counting)
+        timer->start_counters = hardware_counters::read();
+    timer->start_time = clock::now();
+}
+
+TimerDetail *child(TimerDetail *parent, const string &name)
+{
+    TimerDetail &timer = parent->children[name];
+    if (timer.parent == nullptr)
+    {
+        timer.name = name;
+        timer.parent = parent;
+    }
+    return &timer;
+}
 }
 
 void initialize()
@@ -83,7 +214,9 @@ void initialize()
     root->parent = nullptr;
     root->total_calls = 1;
 
-    current_timer = root;
+    current_timer.store(root);
+    main_thread = std::this_thread::get_id();
+    origin = clock::now();
 
     // Determine timer overhead
     for (int i = 0; i < 1000; ++i)
@@ -95,81 +228,421 @@ void initialize()
 
 void finalize()
 {
-    assert(root == current_timer);
+    assert(root == current_timer.load());
+    {
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        for (auto &timers : threads)
+        {
+            timers->roots.clear();
+            timers->events.clear();
+        }
+    }
+    main_events.clear();
     delete root;
-    root = current_timer = nullptr;
+    root = nullptr;
+    current_timer.store(nullptr);
 }
 
 namespace
 {
 
+long long milliseconds(clock::duration time)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time)
+        .count();
+}
+
+long long microseconds(clock::duration time)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(time)
+        .count();
+}
+
+/// The timers of the same name merged over the threads
+struct MergedTimer
+{
+    string name;
+    size_t total_calls = 0;
+    double flops = 0.0;
+    double bytes = 0.0;
+    double allocated = 0.0;
+    hardware_counters::Sample counters;
+    /// Time per thread that ran the timer
+    map<size_t, clock::duration> thread_time;
+    map<string, MergedTimer> children;
+};
+
+void merge(const TimerDetail &timer, size_t thread, MergedTimer &merged)
+{
+    merged.name = timer.name;
+    merged.total_calls += timer.total_calls;
+    merged.flops += timer.flops;
+    merged.bytes += timer.bytes;
+    merged.allocated += timer.allocated;
+    merged.counters += timer.counters;
+    merged.thread_time[thread] += timer.total_time;
+    for (const auto &child : timer.children)
+        merge(child.second, thread, merged.children[child.first]);
+}
+
+/// A timer of the report, with the counters of its children included
+struct ReportNode
+{
+    string name;
+    /// Total time (summed over the threads) and the longest thread time
+    clock::duration time;
+    clock::duration wall_time;
+    size_t calls;
+    double flops;
+    double bytes;
+    double allocated;
+    /// Counted on the threads that ran the timer, so not summed over the
+    /// children like the counters above
+    hardware_counters::Sample counters;
+    /// Time per thread, for the timers of parallel code
+    vector<clock::duration> thread_time;
+    vector<ReportNode> children;
+};
+
+void add_child(ReportNode &node, const ReportNode &child)
+{
+    node.flops += child.flops;
+    node.bytes += child.bytes;
+    node.allocated += child.allocated;
+    node.children.push_back(child);
+}
+
+ReportNode build_report(const MergedTimer &timer)
+{
+    ReportNode node;
+    node.name = timer.name;
+    node.time = node.wall_time = clock::duration(0);
+    for (const auto &time : timer.thread_time)
+    {
+        node.time += time.second;
+        node.wall_time = std::max(node.wall_time, time.second);
+        node.thread_time.push_back(time.second);
+    }
+    node.calls = timer.total_calls;
+    node.flops = timer.flops;
+    node.bytes = timer.bytes;
+    node.allocated = timer.allocated;
+    node.counters = timer.counters;
+    for (const auto &child : timer.children)
+        add_child(node, build_report(child.second));
+    return node;
+}
+
+// This is a recursive function
+ReportNode build_report(const TimerDetail *timer)
+{
+    ReportNode node;
+    node.name = timer->name;
+    node.time = node.wall_time = timer->total_time;
+    node.calls = timer->total_calls;
+    node.flops = timer->flops;
+    node.bytes = timer->bytes;
+    node.allocated = timer->allocated;
+    node.counters = timer->counters;
+    for (const auto &child : timer->children)
+        add_child(node, build_report(&child.second));
+
+    // The timers of parallel code attached to this timer
+    MergedTimer parallel;
+    {
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        for (const auto &timers : threads)
+        {
+            auto it = timers->roots.find(timer);
+            if (it != timers->roots.end())
+                merge(it->second, timers->index, parallel);
+        }
+    }
+    node.flops += parallel.flops;
+    node.bytes += parallel.bytes;
+    node.allocated += parallel.allocated;
+    for (const auto &child : parallel.children)
+        add_child(node, build_report(child.second));
+    return node;
+}
+
+/// Bytes read from memory on a last-level cache miss
+const double cache_line__ = 64.0;
+
+/// Rate in units (e.g. 1.0e9 for GFLOP/s) per second over time
+double rate(double count, clock::duration time, double units)
+{
+    double seconds = std::chrono::duration<double>(time).count();
+    return seconds > 0.0 ? count / seconds / units : 0.0;
+}
+
 // This is a recursive function
-void print_timer_info(TimerDetail *timer)
-{
-    char buffer[512];
-    if (timer != root)
-    {
-        snprintf(buffer, 512, "%lld ms : %lld calls : %lld ms per call : ",
-                 std::chrono::duration_cast<std::chrono::milliseconds>(
-                     timer->total_time),
-                 timer->total_calls,
-                 std::chrono::duration_cast<std::chrono::milliseconds>(
-                     timer->total_time) /
-                     timer->total_calls);
-        print("%s%*s%s\n", buffer,
-              //              60 - ambit::current_indent() - strlen(buffer),
-              60 - strlen(buffer), "", timer->name.c_str());
+void print_timer_info(const ReportNode &node, bool is_root)
+{
+    if (!is_root)
+    {
+        char buffer[512];
+        long long ms = milliseconds(node.time);
+        snprintf(buffer, 512, "%lld ms : %zu calls : %lld ms per call : ", ms,
+                 node.calls,
+                 node.calls ? ms / static_cast<long long>(node.calls) : 0LL);
+        string name = node.name;
+
+        size_t nthreads = node.thread_time.size();
+        if (nthreads > 1)
+        {
+            clock::duration shortest = *std::min_element(
+                node.thread_time.begin(), node.thread_time.end());
+            double mean = static_cast<double>(milliseconds(node.time)) /
+                          static_cast<double>(nthreads);
+            double longest = static_cast<double>(milliseconds(node.wall_time));
+            char stats[256];
+            snprintf(stats, 256,
+                     " [%zu threads, min/mean/max %lld/%.0f/%.0f ms, "
+                     "imbalance %.2f]",
+                     nthreads, milliseconds(shortest), mean, longest,
+                     mean > 0.0 ? longest / mean : 1.0);
+            name += stats;
+        }
+        if (node.flops > 0.0 || node.bytes > 0.0)
+        {
+            char rates[256];
+            snprintf(rates, 256, " (%.2f GFLOP/s, %.2f GB/s)",
+                     rate(node.flops, node.wall_time, 1.0e9),
+                     rate(node.bytes, node.wall_time, 1.0e9));
+            name += rates;
+        }
+        const hardware_counters::Sample &counters = node.counters;
+        if (counters.cycles > 0.0)
+        {
+            // Every last-level cache miss brings a line from memory
+            char hardware[256];
+            snprintf(hardware, 256,
+                     " (IPC %.2f, %.2f LLC misses/kinstr, ~%.2f GB/s DRAM)",
+                     counters.instructions / counters.cycles,
+                     counters.instructions > 0.0
+                         ? 1.0e3 * counters.llc_misses / counters.instructions
+                         : 0.0,
+                     rate(cache_line__ * counters.llc_misses, node.wall_time,
+                          1.0e9));
+            name += hardware;
+        }
+        print("%s%*s%s\n", buffer, 60 - strlen(buffer), "", name.c_str());
     }
     else
     {
         print("\nTiming information:\n\n");
     }
-    if (!timer->children.empty())
+    if (!node.children.empty())
     {
         indent(2);
 
-        for (auto &child : timer->children)
+        for (const ReportNode &child : node.children)
         {
-            print_timer_info(&child.second);
+            print_timer_info(child, false);
         }
 
         unindent(2);
     }
 }
+
+string json_string(const string &s)
+{
+    std::ostringstream out;
+    out << '"';
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char code[8];
+            snprintf(code, 8, "\\u%04x", c);
+            out << code;
+        }
+        else
+            out << c;
+    }
+    out << '"';
+    return out.str();
+}
+
+// This is a recursive function
+void write_json(std::ostream &out, const ReportNode &node, int level)
+{
+    string pad(2 * level, ' ');
+    out << pad << "{\"name\": " << json_string(node.name)
+        << ", \"time_ms\": "
+        << std::chrono::duration<double, std::milli>(node.time).count()
+        << ", \"calls\": " << node.calls << ", \"flops\": " << node.flops
+        << ", \"bytes\": " << node.bytes
+        << ", \"allocated\": " << node.allocated
+        << ", \"gflops\": " << rate(node.flops, node.wall_time, 1.0e9)
+        << ", \"gbps\": " << rate(node.bytes, node.wall_time, 1.0e9);
+    if (node.counters.cycles > 0.0)
+        out << ", \"cycles\": " << node.counters.cycles
+            << ", \"instructions\": " << node.counters.instructions
+            << ", \"llc_misses\": " << node.counters.llc_misses
+            << ", \"dram_gbps\": "
+            << rate(cache_line__ * node.counters.llc_misses, node.wall_time,
+                    1.0e9);
+    if (!node.thread_time.empty())
+    {
+        out << ", \"thread_ms\": [";
+        for (size_t n = 0; n < node.thread_time.size(); ++n)
+            out << (n ? ", " : "")
+                << std::chrono::duration<double, std::milli>(
+                       node.thread_time[n])
+                       .count();
+        out << "]";
+    }
+    out << ", \"children\": [";
+    if (!node.children.empty())
+    {
+        out << "\n";
+        for (size_t n = 0; n < node.children.size(); ++n)
+        {
+            write_json(out, node.children[n], level + 1);
+            out << (n + 1 < node.children.size() ? ",\n" : "\n");
+        }
+        out << pad;
+    }
+    out << "]}";
+}
 }
 
 void report()
 {
     if (settings::timers)
-        print_timer_info(root);
+        print_timer_info(build_report(root), true);
+}
+
+void report_json(const string &filename)
+{
+    std::ofstream out(filename);
+    if (!out)
+        throw std::runtime_error("Unable to open " + filename);
+    write_json(out, build_report(root), 0);
+    out << "\n";
+}
+
+void write_trace(const string &filename)
+{
+    std::ofstream out(filename);
+    if (!out)
+        throw std::runtime_error("Unable to open " + filename);
+
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    auto write_events = [&](const vector<TraceEvent> &events, size_t tid) {
+        for (const TraceEvent &event : events)
+        {
+            out << (first ? "\n" : ",\n") << "{\"name\": "
+                << json_string(event.name)
+                << ", \"ph\": \"X\", \"pid\": 0, \"tid\": " << tid
+                << ", \"ts\": " << event.start
+                << ", \"dur\": " << event.duration << "}";
+            first = false;
+        }
+    };
+    // The main tree is thread 0, the trees of parallel code follow
+    write_events(main_events, 0L);
+    {
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        for (const auto &timers : threads)
+            write_events(timers->events, timers->index + 1L);
+    }
+    out << "\n]}\n";
 }
 
 void timer_push(const string &name)
 {
-    if (settings::timers)
+#if !defined(AMBIT_DISABLE_TIMERS)
+    if (enabled())
     {
-        assert(current_timer != nullptr);
+        assert(root != nullptr);
+        push(child(current(), name));
+    }
+#endif
+}
 
-        if (current_timer->children.count(name) == 0)
+void timer_push(const char *name)
+{
+#if !defined(AMBIT_DISABLE_TIMERS)
+    if (enabled())
+    {
+        assert(root != nullptr);
+        TimerDetail *parent = current();
+        // The same address may hold another string (e.g. a reused buffer),
+        // so a hit is confirmed by the contents
+        for (auto &interned : parent->interned)
         {
-            current_timer->children[name].name = name;
-            current_timer->children[name].parent = current_timer;
+            if (interned.first == name)
+            {
+                if (interned.second->name != name)
+                    interned.second = child(parent, name);
+                push(interned.second);
+                return;
+            }
         }
-
-        current_timer = &current_timer->children[name];
-        current_timer->start_time = clock::now();
+        TimerDetail *timer = child(parent, name);
+        parent->interned.push_back(std::make_pair(name, timer));
+        push(timer);
     }
+#endif
 }
 
 void timer_pop()
 {
-    if (settings::timers)
+#if !defined(AMBIT_DISABLE_TIMERS)
+    if (enabled())
     {
-        current_timer->total_time += clock::now() - current_timer->start_time;
-        current_timer->total_calls++;
-
-        current_timer = current_timer->parent;
+        TimerDetail *timer = current();
+        time_point now = clock::now();
+        timer->total_time += now - timer->start_time;
+        timer->total_calls++;
+        if (timer->counting)
+            timer->counters +=
+                hardware_counters::read() - timer->start_counters;
+        if (settings::timer_trace)
+        {
+            TraceEvent event{timer->name,
+                             microseconds(timer->start_time - origin),
+                             microseconds(now - timer->start_time)};
+            if (serial())
+                main_events.push_back(event);
+            else
+                thread_timers().events.push_back(event);
+        }
+        set_current(timer->parent);
     }
+#endif
 }
+
+void add_flops(double flops)
+{
+#if !defined(AMBIT_DISABLE_TIMERS)
+    if (enabled())
+        current()->flops += flops;
+#endif
+}
+
+void add_bytes(double bytes)
+{
+#if !defined(AMBIT_DISABLE_TIMERS)
+    if (enabled())
+        current()->bytes += bytes;
+#endif
+}
+
+void add_allocated(double bytes)
+{
+#if !defined(AMBIT_DISABLE_TIMERS)
+    if (enabled())
+        current()->allocated += bytes;
+#endif
+}
+
+bool counters_available() { return hardware_counters::available(); }
 }
 }
@@ -0,0 +1,215 @@
+/*
+ * @BEGIN LICENSE
+ *
+ * ambit: C++ library for the implementation of tensor product calculations
+ *        through a clean, concise user interface.
+ *
+ * Copyright (c) 2014-2017 Ambit developers.
+ *
+ * The copyrights for code used from other parties are included in
+ * the corresponding files.
+ *
+ * This file is part of ambit.
+ *
+ * Ambit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * Ambit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with ambit; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @END LICENSE
+ */
+
+
+/*
+ * Replays a call trace written with ambit::call_trace (or the
+ * AMBIT_CALL_TRACE environment variable) on tensors of random data, under
+ * the timers:
+ *
+ *  replay_trace <trace file> [repeats]
+ *
+ * Every call is run repeats times (default 1), and the slowest calls are
+ * listed before the timer report.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+#include <ambit/call_trace.h>
+#include <ambit/print.h>
+#include <ambit/tensor.h>
+#include <ambit/timer.h>
+
+using namespace ambit;
+
+namespace
+{
+
+/// Number of the slowest calls that are listed
+const size_t nslowest = 20;
+
+void initialize_random(Tensor &tensor)
+{
+    std::vector<double> &data = tensor.data();
+    for (double &value : data)
+        value = std::rand() / static_cast<double>(RAND_MAX);
+}
+
+string join(const vector<size_t> &dims)
+{
+    string result;
+    for (size_t n = 0; n < dims.size(); ++n)
+        result += (n ? "," : "") + std::to_string(dims[n]);
+    return result;
+}
+
+string join(const Indices &inds)
+{
+    string result;
+    for (size_t n = 0; n < inds.size(); ++n)
+        result += (n ? "," : "") + inds[n];
+    return result;
+}
+
+string describe(const call_trace::Call &call)
+{
+    static const char *names[] = {"C", "A", "B"};
+    string result = call.kind;
+    for (size_t n = 0; n < call.types.size(); ++n)
+    {
+        result += string(" ") + names[n] + "(";
+        if (call.kind == "slice")
+        {
+            for (size_t dim = 0; dim < call.ranges[n].size(); ++dim)
+                result += (dim ? "," : "") +
+                          std::to_string(call.ranges[n][dim][0]) + ":" +
+                          std::to_string(call.ranges[n][dim][1]);
+        }
+        else
+        {
+            result += join(call.indices[n]);
+        }
+        result += ")[" + join(call.dims[n]) + "]";
+    }
+    return result;
+}
+
+/// Random tensors, one per operand position, type and shape
+class TensorCache
+{
+  public:
+    Tensor get(size_t position, TensorType type, const Dimension &dims)
+    {
+        string key = std::to_string(position) + " " + std::to_string(type) +
+                     " " + join(dims);
+        auto it = tensors_.find(key);
+        if (it != tensors_.end())
+            return it->second;
+
+        static const char *names[] = {"C", "A", "B"};
+        Tensor tensor = Tensor::build(CoreTensor, names[position], dims);
+        initialize_random(tensor);
+        if (type != CoreTensor)
+            tensor = tensor.clone(type);
+        tensors_[key] = tensor;
+        return tensor;
+    }
+
+  private:
+    map<string, Tensor> tensors_;
+};
+
+void replay(const call_trace::Call &call, TensorCache &cache)
+{
+    Tensor C = cache.get(0, call.types[0], call.dims[0]);
+    Tensor A = cache.get(1, call.types[1], call.dims[1]);
+    if (call.kind == "contract")
+    {
+        Tensor B = cache.get(2, call.types[2], call.dims[2]);
+        C.contract(A, B, call.indices[0], call.indices[1], call.indices[2],
+                   call.alpha, call.beta);
+    }
+    else if (call.kind == "permute")
+    {
+        C.permute(A, call.indices[0], call.indices[1], call.alpha,
+                  call.beta);
+    }
+    else
+    {
+        C.slice(A, call.ranges[0], call.ranges[1], call.alpha, call.beta);
+    }
+}
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <trace file> [repeats]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int repeats = argc > 2 ? std::max(1, std::atoi(argv[2])) : 1;
+
+    settings::timers = true;
+    ambit::initialize(argc, argv);
+
+    int status = EXIT_SUCCESS;
+    try
+    {
+        vector<call_trace::Call> calls = call_trace::read(argv[1]);
+        ambit::print("==> Replaying %zu calls of %s, %d repeats <==\n\n",
+                     calls.size(), argv[1], repeats);
+
+        TensorCache cache;
+        /// Best time of each call, in seconds
+        vector<pair<double, size_t>> times;
+        double total = 0.0;
+
+        timer::timer_push("replay");
+        for (size_t n = 0; n < calls.size(); ++n)
+        {
+            double best = 0.0;
+            for (int repeat = 0; repeat < repeats; ++repeat)
+            {
+                auto start = std::chrono::steady_clock::now();
+                replay(calls[n], cache);
+                std::chrono::duration<double> time =
+                    std::chrono::steady_clock::now() - start;
+                best = repeat ? std::min(best, time.count()) : time.count();
+            }
+            times.push_back({best, n});
+            total += best;
+        }
+        timer::timer_pop();
+
+        std::sort(times.rbegin(), times.rend());
+        ambit::print("  %-8s %12s  %s\n", "Call", "Best (ms)", "Operation");
+        for (size_t n = 0; n < std::min(nslowest, times.size()); ++n)
+        {
+            ambit::print("  %-8zu %12.3f  %s\n", times[n].second + 1,
+                         1000.0 * times[n].first,
+                         describe(calls[times[n].second]).c_str());
+        }
+        ambit::print("\n  Total %.3f ms (best of each call)\n",
+                     1000.0 * total);
+    }
+    catch (const std::exception &e)
+    {
+        ambit::print("replay_trace: %s\n", e.what());
+        status = EXIT_FAILURE;
+    }
+
+    ambit::finalize();
+    return status;
+}
@@ -28,9 +28,17 @@
  */
 
 #include <ambit/blocked_tensor.h>
+#include <ambit/composite_tensor.h>
+#include <ambit/graph.h>
+#include <ambit/io/hdf5.h>
+#include <ambit/memory.h>
+#include <ambit/settings.h>
+#include <ambit/transform.h>
 #include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <stdexcept>
+#include <thread>
 
 #define ANSI_COLOR_RED "\x1b[31m"
 #define ANSI_COLOR_GREEN "\x1b[32m"
@@ -415,6 +423,27 @@ double test_block_norm_3()
     return diff;
 }
 
+double test_block_stats()
+{
+    BlockedTensor::reset_mo_spaces();
+    BlockedTensor::add_mo_space("a", "u,v", {2, 3, 4}, AlphaSpin);
+    BlockedTensor::add_mo_space("v", "e,f", {5, 6, 7, 8, 9}, AlphaSpin);
+    BlockedTensor T2 = BlockedTensor::build(CoreTensor, "T2", {"aavv", "avav"});
+    T2.set(0.5);
+    // Element (1,0,2,3) of the avav block is MO (3,5,4,8)
+    T2.block("avav").data()[((1 * 5 + 0) * 3 + 2) * 5 + 3] = -2.0;
+    TensorStats stats = T2.stats();
+    double diff = std::fabs(stats.norm1 - (449.0 * 0.5 + 2.0));
+    diff += std::fabs(stats.norm_inf - 2.0);
+    diff += std::fabs(stats.norm2 - std::sqrt(449.0 * 0.25 + 4.0));
+    diff += std::fabs(stats.rms - std::sqrt((449.0 * 0.25 + 4.0) / 450.0));
+    diff += std::fabs(stats.max - 0.5) + std::fabs(stats.min + 2.0);
+    if (stats.numel != 450L ||
+        stats.min_indices != std::vector<size_t>({3, 5, 4, 8}))
+        diff += 1.0;
+    return diff;
+}
+
 double test_block_zero()
 {
     BlockedTensor::reset_mo_spaces();
@@ -870,6 +899,49 @@ double test_Cij_equal_Aik_B_jk()
     return diff_oo;
 }
 
+double test_label_cache_reset()
+{
+    // Resolve C("ij") = A("ik") * B("jk") once, then redefine the spaces so
+    // that "k" labels virtual orbitals; the cached block keys must not leak
+    double diff_first = test_Cij_equal_Aik_B_jk();
+
+    BlockedTensor::reset_mo_spaces();
+    BlockedTensor::add_mo_space("o", "i,j", {0, 1, 2}, AlphaSpin);
+    BlockedTensor::add_mo_space("v", "a,b,k", {3, 4, 5, 6}, AlphaSpin);
+
+    BlockedTensor A = BlockedTensor::build(CoreTensor, "A", {"ov"});
+    BlockedTensor B = BlockedTensor::build(CoreTensor, "B", {"ov"});
+    BlockedTensor C = BlockedTensor::build(CoreTensor, "C", {"oo"});
+
+    size_t no = 3;
+    size_t nv = 4;
+
+    Tensor Aov_t = build_and_fill("Aov", {no, nv}, a2);
+    Tensor Bov_t = build_and_fill("Bov", {no, nv}, b2);
+
+    A.block("ov")("pq") = Aov_t("pq");
+    B.block("ov")("pq") = Bov_t("pq");
+
+    for (size_t i = 0; i < no; ++i)
+    {
+        for (size_t j = 0; j < no; ++j)
+        {
+            c2[i][j] = 0.0;
+            for (size_t k = 0; k < nv; ++k)
+            {
+                c2[i][j] += a2[i][k] * b2[j][k];
+            }
+        }
+    }
+
+    C("ij") = A("ik") * B("jk");
+
+    Tensor Coo = C.block("oo");
+    double diff_oo = difference(Coo, c2).second;
+
+    return std::max(diff_first, diff_oo);
+}
+
 double test_Cij_equal_Aip_B_jp()
 {
     BlockedTensor::reset_mo_spaces();
@@ -1306,6 +1378,96 @@ double test_chain_multiply()
     return difference(Doo, d2).second;
 }
 
+double test_chain_multiply_repeated()
+{
+    BlockedTensor::reset_mo_spaces();
+    BlockedTensor::add_mo_space("o", "i,j,k,l", {0, 1, 2}, AlphaSpin);
+    BlockedTensor::add_mo_space("v", "a,b,c,d", {5, 6, 7, 8, 9}, AlphaSpin);
+    BlockedTensor::add_composite_mo_space("g", "p,q,r,s", {"o", "v"});
+
+    BlockedTensor A = BlockedTensor::build(CoreTensor, "A", {"oo"});
+    BlockedTensor B = BlockedTensor::build(CoreTensor, "B", {"oo"});
+    BlockedTensor C = BlockedTensor::build(CoreTensor, "C", {"oo"});
+    BlockedTensor D = BlockedTensor::build(CoreTensor, "D", {"oo"});
+
+    size_t no = 3;
+
+    Tensor Aoo_t = build_and_fill("Aoo", {no, no}, a2);
+    Tensor Boo_t = build_and_fill("Boo", {no, no}, b2);
+    Tensor Coo_t = build_and_fill("Coo", {no, no}, c2);
+
+    A.block("oo")("pq") = Aoo_t("pq");
+    B.block("oo")("pq") = Boo_t("pq");
+    C.block("oo")("pq") = Coo_t("pq");
+
+    size_t niter = 3;
+    for (size_t i = 0; i < no; ++i)
+    {
+        for (size_t j = 0; j < no; ++j)
+        {
+            d2[i][j] = 0.0;
+            for (size_t k = 0; k < no; ++k)
+            {
+                for (size_t l = 0; l < no; ++l)
+                {
+                    d2[i][j] += niter * a2[l][j] * b2[i][k] * c2[k][l];
+                }
+            }
+        }
+    }
+
+    // Every iteration reuses the intermediate storage of the previous one,
+    // which must not leak into the result
+    for (size_t n = 0; n < niter; ++n)
+    {
+        D("ij") += B("ik") * C("kl") * A("lj");
+    }
+
+    Tensor Doo = D.block("oo");
+    return difference(Doo, d2).second;
+}
+
+double test_graph_blocked()
+{
+    BlockedTensor::reset_mo_spaces();
+    BlockedTensor::add_mo_space("o", "i,j,k,l", {0, 1, 2}, AlphaSpin);
+    BlockedTensor::add_mo_space("v", "a,b,c,d", {5, 6, 7, 8, 9}, AlphaSpin);
+    BlockedTensor::add_composite_mo_space("g", "p,q,r,s", {"o", "v"});
+
+    BlockedTensor A = BlockedTensor::build(CoreTensor, "A", {"gg"});
+    BlockedTensor B = BlockedTensor::build(CoreTensor, "B", {"gg"});
+    BlockedTensor C1 = BlockedTensor::build(CoreTensor, "C1", {"gg"});
+    BlockedTensor C2 = BlockedTensor::build(CoreTensor, "C2", {"gg"});
+    BlockedTensor D1 = BlockedTensor::build(CoreTensor, "D1", {"oo"});
+    BlockedTensor D2 = BlockedTensor::build(CoreTensor, "D2", {"oo"});
+
+    A.iterate([](const std::vector<size_t> &, const std::vector<SpinType> &,
+                 double &value) { value = std::rand() / double(RAND_MAX); });
+    B.iterate([](const std::vector<size_t> &, const std::vector<SpinType> &,
+                 double &value) { value = std::rand() / double(RAND_MAX); });
+
+    C1("pq") = A("pr") * B("rq");
+    D1("ij") = C1("ji");
+    D1("ij") += 0.5 * A("ia") * B("aj");
+    D1("ij") *= 2.0;
+
+    // The blocked statements run in order when the Graph executes
+    Graph g;
+    g.begin();
+    C2("pq") = A("pr") * B("rq");
+    D2("ij") = C2("ji");
+    D2("ij") += 0.5 * A("ia") * B("aj");
+    D2("ij") *= 2.0;
+    // (C2.norm() would execute the statements that write C2 first)
+    if (g.size() != 4L)
+        throw std::runtime_error("A recorded statement ran immediately.");
+    g.execute();
+
+    C1("pq") -= C2("pq");
+    D1("ij") -= D2("ij");
+    return std::max(C1.norm(), D1.norm());
+}
+
 double test_chain_multiply2()
 {
     BlockedTensor::reset_mo_spaces();
@@ -1438,6 +1600,91 @@ double test_Cia_plus_equal_Aia_minus_three_Bai()
     return difference(Cov, c2).second;
 }
 
+double test_Cpq_equal_Apq_minus_Bqp_plus_half_Dpq()
+{
+    BlockedTensor::reset_mo_spaces();
+    BlockedTensor::add_mo_space("o", "i,j,k", {0, 1, 2}, AlphaSpin);
+    BlockedTensor::add_mo_space("v", "a,b,c,d", {5, 6, 7, 8, 9}, AlphaSpin);
+    BlockedTensor::add_composite_mo_space("g", "p,q,r,s", {"o", "v"});
+
+    BlockedTensor A =
+        BlockedTensor::build(CoreTensor, "A", {"oo", "ov", "vo", "vv"});
+    BlockedTensor B =
+        BlockedTensor::build(CoreTensor, "B", {"oo", "ov", "vo", "vv"});
+    BlockedTensor D =
+        BlockedTensor::build(CoreTensor, "D", {"oo", "ov", "vo", "vv"});
+    BlockedTensor C =
+        BlockedTensor::build(CoreTensor, "C", {"oo", "ov", "vo", "vv"});
+
+    size_t no = 3;
+    size_t nv = 5;
+
+    Tensor Aov_t = build_and_fill("Aov", {no, nv}, a2);
+    Tensor Bvo_t = build_and_fill("Bvo", {nv, no}, b2);
+    Tensor Dov_t = build_and_fill("Dov", {no, nv}, d2);
+    Tensor Cvv_t = build_and_fill("Cvv", {nv, nv}, c2);
+
+    A.block("ov")("pq") = Aov_t("pq");
+    B.block("vo")("pq") = Bvo_t("pq");
+    D.block("ov")("pq") = Dov_t("pq");
+    C.block("vv")("pq") = Cvv_t("pq");
+
+    // Every block of C is written, each with all three terms at once
+    C("pq") = A("pq") - B("qp") + 0.5 * D("pq");
+
+    for (size_t i = 0; i < no; ++i)
+    {
+        for (size_t a = 0; a < nv; ++a)
+        {
+            c2[i][a] = a2[i][a] - b2[a][i] + 0.5 * d2[i][a];
+        }
+    }
+
+    Tensor Cov = C.block("ov");
+    Tensor Cvv = C.block("vv");
+    return std::max(difference(Cov, c2).second, Cvv.norm(0));
+}
+
+double test_Cia_equal_Aij_Bja_over_denominator()
+{
+    BlockedTensor::reset_mo_spaces();
+    BlockedTensor::add_mo_space("o", "i,j,k", {0, 1, 2}, AlphaSpin);
+    BlockedTensor::add_mo_space("v", "a,b,c,d", {5, 6, 7, 8, 9}, AlphaSpin);
+
+    BlockedTensor C = BlockedTensor::build(CoreTensor, "C", {"ov"});
+
+    size_t no = 3;
+    size_t nv = 5;
+    std::vector<double> epsilon = {-2.0, -1.5, -1.0, 0.0, 0.0,
+                                   0.5,  1.0,  1.5,  2.0, 2.5};
+
+    Tensor Aoo_t = build_and_fill("Aoo", {no, no}, a2);
+    Tensor Bov_t = build_and_fill("Bov", {no, nv}, b2);
+    Tensor Cov_t = build_and_fill("Cov", {no, nv}, c2);
+    C.block("ov")("ia") = Cov_t("ia");
+
+    C.block("ov").contract(
+        Aoo_t, Bov_t, {"i", "a"}, {"i", "j"}, {"j", "a"},
+        BlockedTensor::denominator("ov", epsilon, {1.0, -1.0}, 0.1), 1.0,
+        0.5);
+
+    for (size_t i = 0; i < no; ++i)
+    {
+        for (size_t a = 0; a < nv; ++a)
+        {
+            double sum = 0.5 * c2[i][a];
+            for (size_t j = 0; j < no; ++j)
+            {
+                sum += a2[i][j] * b2[j][a];
+            }
+            c2[i][a] = sum / (0.1 + epsilon[i] - epsilon[a + 5]);
+        }
+    }
+
+    Tensor Cov = C.block("ov");
+    return difference(Cov, c2).second;
+}
+
 double test_Dij_equal_Aij_times_Bij_plus_Cij()
 {
     BlockedTensor::reset_mo_spaces();
@@ -2316,6 +2563,507 @@ double test_batched_with_factor()
     return C2.norm(0);
 }
 
+double test_batched_auto()
+{
+    BlockedTensor::reset_mo_spaces();
+    BlockedTensor::add_mo_space("o", "i,j,k", {0, 1, 2, 10, 12}, AlphaSpin);
+    BlockedTensor::add_mo_space("v", "a,b,c,d", {5, 6, 7, 8, 9, 3, 4},
+                                AlphaSpin);
+    BlockedTensor::add_composite_mo_space("g", "p,q,r,s,t,u", {"o", "v"});
+
+    BlockedTensor A = BlockedTensor::build(CoreTensor, "A", {"gggg"});
+    BlockedTensor B = BlockedTensor::build(CoreTensor, "B", {"gg"});
+    BlockedTensor C = BlockedTensor::build(CoreTensor, "C", {"gg"});
+    BlockedTensor D = BlockedTensor::build(CoreTensor, "D", {"gggg"});
+    BlockedTensor D2 = BlockedTensor::build(CoreTensor, "D2", {"gggg"});
+
+    for (const std::string &bl : A.block_labels())
+        A.block(bl)("pqrs") =
+            build_and_fill("A" + bl, A.block(bl).dims(), a4)("pqrs");
+    for (const std::string &bl : B.block_labels())
+        B.block(bl)("pq") =
+            build_and_fill("B" + bl, B.block(bl).dims(), b2)("pq");
+    for (const std::string &bl : C.block_labels())
+        C.block(bl)("pq") =
+            build_and_fill("C" + bl, C.block(bl).dims(), c2)("pq");
+
+    D["pqrs"] = A["pqtu"] * B["rt"] * C["su"];
+
+    // Only the intermediates of a few values of one index fit at a time
+    size_t memory_limit = settings::memory_limit;
+    settings::memory_limit =
+        memory::live_bytes() + 4 * 12 * 12 * 12 * sizeof(double);
+    D2["pqrs"] = batched(A["pqtu"] * B["rt"] * C["su"]);
+    settings::memory_limit = memory_limit;
+
+    D2["pqrs"] -= D["pqrs"];
+    return D2.norm(0);
+}
+
+double test_restricted_spin()
+{
+    BlockedTensor::reset_mo_spaces();
+    BlockedTensor::add_mo_space("o", "i,j,k,l", {0, 1, 2}, AlphaSpin);
+    BlockedTensor::add_mo_space("O", "I,J,K,L", {0, 1, 2}, BetaSpin);
+    BlockedTensor::add_mo_space("v", "a,b,c,d", {3, 4, 5, 6}, AlphaSpin);
+    BlockedTensor::add_mo_space("V", "A,B,C,D", {3, 4, 5, 6}, BetaSpin);
+
+    // Spin-symmetric operands and the reference result, all blocks stored
+    BlockedTensor T = BlockedTensor::build(CoreTensor, "T", spin_cases({"oovv"}));
+    BlockedTensor V = BlockedTensor::build(CoreTensor, "V", spin_cases({"vvvv"}));
+    BlockedTensor R = BlockedTensor::build(CoreTensor, "R", spin_cases({"oovv"}));
+    T.block("oovv")("pqrs") = build_and_fill("T", T.block("oovv").dims(), a4)("pqrs");
+    T.block("OOVV")("pqrs") = T.block("oovv")("pqrs");
+    T.block("oOvV")("pqrs") = build_and_fill("T", T.block("oOvV").dims(), b4)("pqrs");
+    V.block("vvvv")("pqrs") = build_and_fill("V", V.block("vvvv").dims(), c4)("pqrs");
+    V.block("VVVV")("pqrs") = V.block("vvvv")("pqrs");
+    V.block("vVvV")("pqrs") = build_and_fill("V", V.block("vVvV").dims(), d4)("pqrs");
+
+    R["ijab"] = 0.5 * T["ijcd"] * V["cdab"];
+    R["iJaB"] = T["iJcD"] * V["cDaB"];
+    R["IJAB"] = 0.5 * T["IJCD"] * V["CDAB"];
+    R["ijab"] += T["ijab"];
+    R["IJAB"] += T["IJAB"];
+
+    // The beta-beta blocks alias the alpha-alpha ones and their statements
+    // are skipped
+    BlockedTensor::set_restricted_spin(true);
+    BlockedTensor T2 = BlockedTensor::build(CoreTensor, "T2", spin_cases({"oovv"}));
+    BlockedTensor V2 = BlockedTensor::build(CoreTensor, "V2", spin_cases({"vvvv"}));
+    BlockedTensor R2 = BlockedTensor::build(CoreTensor, "R2", spin_cases({"oovv"}));
+    BlockedTensor::set_restricted_spin(false);
+    if (T2.numblocks() != 3 || !T2.is_alias({1, 1, 3, 3}) ||
+        T2.block("OOVV") != T2.block("oovv"))
+        return 1.0;
+
+    T2["ijab"] = T["ijab"];
+    T2["iJaB"] = T["iJaB"];
+    V2["abcd"] = V["abcd"];
+    V2["aBcD"] = V["aBcD"];
+
+    R2["ijab"] = 0.5 * T2["ijcd"] * V2["cdab"];
+    R2["iJaB"] = T2["iJcD"] * V2["cDaB"];
+    R2["IJAB"] = 0.5 * T2["IJCD"] * V2["CDAB"];
+    R2["ijab"] += T2["ijab"];
+    R2["IJAB"] += T2["IJAB"];
+
+    double diff = 0.0;
+    for (const std::string &bl : R.block_labels())
+    {
+        Tensor D = R.block(bl).clone();
+        D("pqrs") -= R2.block(bl)("pqrs");
+        diff = std::max(diff, D.norm(0));
+    }
+    return diff;
+}
+
+double test_mo_space_contexts()
+{
+    BlockedTensor::reset_mo_spaces();
+    BlockedTensor::add_mo_space("o", "i,j,k", {0, 1}, AlphaSpin);
+
+    // Two calculations run side by side, each with its own "o" and "v"
+    std::vector<Tensor> At, Bt;
+    for (size_t n = 0; n < 2; ++n)
+    {
+        At.push_back(build_and_fill("A", {8 + 2 * n, 8 + 2 * n}, a2));
+        Bt.push_back(build_and_fill("B", {8 + 2 * n, 8 + 2 * n}, b2));
+    }
+    std::vector<double> diff(2, 1.0);
+    auto calculation = [&](size_t n) {
+        BlockedTensor::set_context(std::make_shared<MOSpaceContext>());
+        std::vector<size_t> occ, vir;
+        for (size_t p = 0; p < 3 + n; ++p)
+            occ.push_back(p);
+        for (size_t p = 3 + n; p < 8 + 2 * n; ++p)
+            vir.push_back(p);
+        BlockedTensor::add_mo_space("o", "i,j,k", occ, AlphaSpin);
+        BlockedTensor::add_mo_space("v", "a,b,c", vir, AlphaSpin);
+        BlockedTensor::add_composite_mo_space("g", "p,q,r", {"o", "v"});
+
+        BlockedTensor A = BlockedTensor::build(CoreTensor, "A", {"gg"});
+        BlockedTensor B = BlockedTensor::build(CoreTensor, "B", {"gg"});
+        BlockedTensor C = BlockedTensor::build(CoreTensor, "C", {"gg"});
+        Tensor Ct = Tensor::build(CoreTensor, "C", {8 + 2 * n, 8 + 2 * n});
+        auto ranges = [n](const std::string &bl, IndexRange &block,
+                          IndexRange &full) {
+            for (char c : bl)
+            {
+                full.push_back(c == 'o' ? std::vector<size_t>{0, 3 + n}
+                                        : std::vector<size_t>{3 + n, 8 + 2 * n});
+                block.push_back({0, full.back()[1] - full.back()[0]});
+            }
+        };
+        for (const std::string &bl : A.block_labels())
+        {
+            IndexRange block, full;
+            ranges(bl, block, full);
+            A.block(bl).slice(At[n], block, full);
+            B.block(bl).slice(Bt[n], block, full);
+        }
+
+        C["pq"] = A["pr"] * B["rq"];
+        Ct("pq") = At[n]("pr") * Bt[n]("rq");
+
+        double d = 0.0;
+        for (const std::string &bl : C.block_labels())
+        {
+            IndexRange block, full;
+            ranges(bl, block, full);
+            Tensor D = C.block(bl).clone();
+            Tensor R = C.block(bl).clone();
+            R.slice(Ct, block, full);
+            D("pq") -= R("pq");
+            d = std::max(d, D.norm(0));
+        }
+        diff[n] = d;
+        BlockedTensor::set_context(nullptr);
+    };
+    std::thread first(calculation, 0);
+    std::thread second(calculation, 1);
+    first.join();
+    second.join();
+
+    // The spaces of this thread were left alone
+    if (BlockedTensor::context()->mo_spaces.size() != 1 ||
+        BlockedTensor::mo_space(0).dim() != 2)
+        return 1.0;
+    return std::max(diff[0], diff[1]);
+}
+
+double test_checkpoint()
+{
+    BlockedTensor::reset_mo_spaces();
+    BlockedTensor::add_mo_space("o", "i,j,k,l", {0, 1, 2}, AlphaSpin);
+    BlockedTensor::add_mo_space("O", "I,J,K,L", {0, 1, 2}, BetaSpin);
+    BlockedTensor::add_mo_space("v", "a,b,c,d", {3, 4, 5, 6}, AlphaSpin);
+    BlockedTensor::add_mo_space("V", "A,B,C,D", {3, 4, 5, 6}, BetaSpin);
+
+    BlockedTensor::set_restricted_spin(true);
+    BlockedTensor T = BlockedTensor::build(CoreTensor, "T", spin_cases({"oovv"}));
+    BlockedTensor::set_restricted_spin(false);
+    T.block("oovv")("pqrs") = build_and_fill("T", T.block("oovv").dims(), a4)("pqrs");
+    T.block("oOvV")("pqrs") = build_and_fill("T", T.block("oOvV").dims(), b4)("pqrs");
+
+    std::map<std::string, Tensor> reference;
+    for (const std::string &bl : T.block_labels())
+        reference[bl] = T.block(bl).clone();
+
+    // Saving twice overwrites the blocks in place
+    {
+        io::hdf5::File file("checkpoint.h5", io::hdf5::kOpenModeCreateNew);
+        T.save(file);
+        T.save(file);
+    }
+    std::future<void> pending = T.save_async("checkpoint.h5", "async");
+    // The background write works on a snapshot
+    T.block("oovv").zero();
+    pending.get();
+
+    // Loading defines the MO spaces again; the CoreTensor blocks are read on
+    // first use, after the file is closed
+    BlockedTensor::reset_mo_spaces();
+    BlockedTensor L, D, A;
+    {
+        io::hdf5::File file("checkpoint.h5", io::hdf5::kOpenModeOpenExisting);
+        L = BlockedTensor::load(file);
+        D = BlockedTensor::load(file, DiskTensor);
+        A = BlockedTensor::load(file.group("async"));
+    }
+    if (L.name() != "T" || L.numblocks() != 3 ||
+        L.block("OOVV") != L.block("oovv") ||
+        D.block("OOVV") != D.block("oovv"))
+        return 1.0;
+
+    double diff = 0.0;
+    for (const auto &bl_tensor : reference)
+    {
+        for (BlockedTensor *B : {&L, &D, &A})
+        {
+            Tensor Diff = B->block(bl_tensor.first).clone(CoreTensor);
+            Diff("pqrs") -= bl_tensor.second("pqrs");
+            diff = std::max(diff, Diff.norm(0));
+        }
+    }
+    std::remove("checkpoint.h5");
+    return diff;
+}
+
+double test_composite_gram()
+{
+    BlockedTensor::reset_mo_spaces();
+    BlockedTensor::add_mo_space("o", "i,j,k", {0, 1, 2}, AlphaSpin);
+    BlockedTensor::add_mo_space("v", "a,b,c", {3, 4, 5, 6, 7}, AlphaSpin);
+    BlockedTensor::add_composite_mo_space("g", "p,q,r", {"o", "v"});
+
+    std::vector<BlockedTensor> X;
+    for (size_t n = 0; n < 3; ++n)
+    {
+        X.push_back(BlockedTensor::build(CoreTensor, "X", {"gg"}));
+        X.back().iterate([&](const std::vector<size_t> &indices,
+                             const std::vector<SpinType> &, double &value) {
+            value = std::sin(1.0 + n + 0.7 * indices[0] + 0.3 * indices[1]);
+        });
+    }
+
+    double diff = 0.0;
+    std::vector<std::vector<double>> S = composite::gram(X);
+    for (size_t i = 0; i < 3; ++i)
+    {
+        for (size_t j = 0; j < 3; ++j)
+        {
+            double ref = 0.0;
+            for (const std::string &bl : X[i].block_labels())
+                ref += X[i].block(bl)("pq") * X[j].block(bl)("pq");
+            diff = std::max(diff, std::fabs(S[i][j] - ref));
+        }
+    }
+
+    BlockedTensor C = BlockedTensor::build(CoreTensor, "C", {"gg"});
+    C.set(1.0);
+    composite::linear_combination(C, X, {2.0, -1.0, 0.5}, 0.5);
+    C["pq"] -= 2.0 * X[0]["pq"];
+    C["pq"] += X[1]["pq"];
+    C["pq"] -= 0.5 * X[2]["pq"];
+    BlockedTensor half = BlockedTensor::build(CoreTensor, "half", {"gg"});
+    half.set(0.5);
+    C["pq"] -= half["pq"];
+    return std::max(diff, C.norm(0));
+}
+
+double test_block_screening()
+{
+    BlockedTensor::reset_mo_spaces();
+    BlockedTensor::add_mo_space("o", "i,j,k,l", {0, 1, 2}, AlphaSpin);
+    BlockedTensor::add_mo_space("v", "a,b,c,d", {3, 4, 5, 6}, AlphaSpin);
+    BlockedTensor::add_composite_mo_space("g", "p,q,r,s", {"o", "v"});
+
+    BlockedTensor A = BlockedTensor::build(CoreTensor, "A", {"gg"});
+    BlockedTensor B = BlockedTensor::build(CoreTensor, "B", {"gg"});
+    for (const std::string &bl : A.block_labels())
+    {
+        A.block(bl)("pq") = build_and_fill("A", A.block(bl).dims(), a2)("pq");
+        B.block(bl)("pq") = build_and_fill("B", B.block(bl).dims(), b2)("pq");
+    }
+    // A numerically zero block, and the same tensor with it exactly zero
+    A.block("ov").scale(1.0E-13);
+    BlockedTensor Aref = BlockedTensor::build(CoreTensor, "Aref", {"gg"});
+    Aref["pq"] = A["pq"];
+    Aref.block("ov").zero();
+
+    BlockedTensor Cref = BlockedTensor::build(CoreTensor, "Cref", {"gg"});
+    BlockedTensor C1 = BlockedTensor::build(CoreTensor, "C1", {"gg"});
+    BlockedTensor C2 = BlockedTensor::build(CoreTensor, "C2", {"gg"});
+    Cref["pq"] = Aref["pr"] * B["rq"];
+
+    // The products with the small block are skipped, then the small block
+    // is not even stored
+    settings::block_screening = 1.0E-8;
+    C1["pq"] = A["pr"] * B["rq"];
+    size_t dropped = A.drop_zero_blocks(1.0E-10);
+    C2["pq"] = A["pr"] * B["rq"];
+    settings::block_screening = 0.0;
+    if (dropped != 1 || A.is_block("ov") || A.numblocks() != 3)
+        return 1.0;
+
+    double diff = 0.0;
+    for (const std::string &bl : Cref.block_labels())
+    {
+        for (BlockedTensor *C : {&C1, &C2})
+        {
+            Tensor D = C->block(bl).clone();
+            D("pq") -= Cref.block(bl)("pq");
+            diff = std::max(diff, D.norm(0));
+        }
+    }
+    return diff;
+}
+
+double test_syev_power_inverse()
+{
+    BlockedTensor::reset_mo_spaces();
+    BlockedTensor::add_mo_space("o", "i,j,k,l", {0, 1, 2}, AlphaSpin);
+    BlockedTensor::add_mo_space("O", "I,J,K,L", {0, 1, 2}, BetaSpin);
+    BlockedTensor::add_mo_space("v", "a,b,c,d", {3, 4, 5, 6}, AlphaSpin);
+    BlockedTensor::add_mo_space("V", "A,B,C,D", {3, 4, 5, 6}, BetaSpin);
+
+    BlockedTensor::set_restricted_spin(true);
+    BlockedTensor F =
+        BlockedTensor::build(CoreTensor, "F", {"oo", "vv", "OO", "VV"});
+    BlockedTensor::set_restricted_spin(false);
+    // Symmetric, positive definite blocks
+    for (const std::string &bl : {"oo", "vv"})
+    {
+        Tensor S = build_and_fill("S", F.block(bl).dims(), a2);
+        F.block(bl)("pq") = S("rp") * S("rq");
+        for (size_t p = 0; p < S.dim(0); ++p)
+            F.block(bl).data()[p * S.dim(0) + p] += 1.0;
+    }
+
+    std::map<std::string, BlockedTensor> diag = F.syev(AscendingEigenvalue);
+    BlockedTensor Finv = F.inverse();
+    BlockedTensor Fhalf = F.power(0.5);
+    // The aliased blocks share the results of their partners
+    if (diag["eigenvectors"].block("OO") != diag["eigenvectors"].block("oo") ||
+        diag["eigenvalues"].rank() != 1 || Finv.block("VV") != Finv.block("vv"))
+        return 1.0;
+
+    double diff = 0.0;
+    for (const std::string &bl : {"oo", "vv"})
+    {
+        Tensor B = F.block(bl);
+        size_t n = B.dim(0);
+        Tensor I = Tensor::build(CoreTensor, "I", {n, n});
+        for (size_t p = 0; p < n; ++p)
+            I.data()[p * n + p] = 1.0;
+
+        // V F V^T = diag(eigenvalues)
+        Tensor V = diag["eigenvectors"].block(bl);
+        Tensor D = Tensor::build(CoreTensor, "D", {n, n});
+        D("pq") = V("pr") * B("rs") * V("qs");
+        Tensor e = diag["eigenvalues"].block(bl.substr(0, 1));
+        for (size_t p = 0; p < n; ++p)
+            D.data()[p * n + p] -= e.data()[p];
+        // F^-1 F = 1 and F^1/2 F^1/2 = F
+        Tensor E = Tensor::build(CoreTensor, "E", {n, n});
+        E("pq") = Finv.block(bl)("pr") * B("rq");
+        E("pq") -= I("pq");
+        Tensor H = Tensor::build(CoreTensor, "H", {n, n});
+        H("pq") = Fhalf.block(bl)("pr") * Fhalf.block(bl)("rq");
+        H("pq") -= B("pq");
+        for (const Tensor &T : {D, E, H})
+            diff = std::max(diff, T.norm(0) / B.norm(0));
+    }
+    return diff;
+}
+
+double test_transform_ao_to_mo()
+{
+    BlockedTensor::reset_mo_spaces();
+    BlockedTensor::add_mo_space("o", "i,j,k,l", {0, 1}, AlphaSpin);
+    BlockedTensor::add_mo_space("v", "a,b,c,d", {2, 3, 4}, AlphaSpin);
+
+    size_t n = 6;
+    Tensor ao = build_and_fill("ao", {n, n, n, n}, a4);
+    Tensor C = build_and_fill("C", {n, 5}, a2);
+    Tensor aodisk = Tensor::build(DiskTensor, "ao", {n, n, n, n});
+    aodisk.copy(ao);
+    AOSlabFunction generate = [&](size_t first, size_t last, Tensor &slab) {
+        slab.slice(ao, {{0, last - first}, {0, n}, {0, n}, {0, n}},
+                   {{first, last}, {0, n}, {0, n}, {0, n}});
+    };
+
+    std::vector<std::string> blocks = {"oovv", "ovov", "vvvv", "oooo"};
+    std::vector<BlockedTensor> results = {
+        transform_ao_to_mo(ao, C, CoreTensor, "V", blocks),
+        // One row per slab
+        transform_ao_to_mo(ao, C, CoreTensor, "V", blocks, 1),
+        transform_ao_to_mo(aodisk, C, DiskTensor, "V", blocks, 1),
+        transform_ao_to_mo(generate, n, C, CoreTensor, "V", blocks, 1)};
+
+    Tensor Co = Tensor::build(CoreTensor, "Co", {n, 2});
+    Tensor Cv = Tensor::build(CoreTensor, "Cv", {n, 3});
+    Co.slice(C, {{0, n}, {0, 2}}, {{0, n}, {0, 2}});
+    Cv.slice(C, {{0, n}, {0, 3}}, {{0, n}, {2, 5}});
+    std::map<char, Tensor> Cs = {{'o', Co}, {'v', Cv}};
+
+    double diff = 0.0;
+    for (const std::string &bl : blocks)
+    {
+        Tensor ref = results[0].block(bl).clone(CoreTensor);
+        ref("ijkl") = Cs[bl[0]]("mi") * Cs[bl[1]]("nj") * Cs[bl[2]]("rk") *
+                      Cs[bl[3]]("sl") * ao("mnrs");
+        for (BlockedTensor &V : results)
+        {
+            Tensor Diff = V.block(bl).clone(CoreTensor);
+            Diff("ijkl") -= ref("ijkl");
+            // Relative, as the slabs sum the first index in another order
+            diff = std::max(diff, Diff.norm(0) / ref.norm(0));
+        }
+    }
+    return diff;
+}
+
+double test_block_distributed()
+{
+    BlockedTensor::reset_mo_spaces();
+    BlockedTensor::add_mo_space("o", "i,j,k,l", {0, 1, 2}, AlphaSpin);
+    BlockedTensor::add_mo_space("v", "a,b,c,d", {3, 4, 5, 6, 7}, AlphaSpin);
+    BlockedTensor::add_composite_mo_space("g", "p,q,r,s,t,u", {"o", "v"});
+
+    // Largest first, each to the least loaded process
+    std::vector<int> placement =
+        BlockedTensor::balance_blocks({5.0, 4.0, 3.0, 3.0, 3.0}, 2);
+    if (placement != std::vector<int>({0, 1, 1, 0, 1}))
+        return 1.0;
+
+    BlockedTensor A = BlockedTensor::build(CoreTensor, "A", {"gg"});
+    BlockedTensor B = BlockedTensor::build(CoreTensor, "B", {"gggg"});
+    BlockedTensor C = BlockedTensor::build(CoreTensor, "C", {"gggg"});
+    BlockedTensor A2 = BlockedTensor::build_distributed("A2", {"gg"});
+    BlockedTensor B2 = BlockedTensor::build_distributed("B2", {"gggg"});
+    BlockedTensor C2 = BlockedTensor::build_distributed("C2", {"gggg"});
+    for (const std::string &bl : A.block_labels())
+        A.block(bl)("pq") = build_and_fill("A" + bl, A.block(bl).dims(), a2)("pq");
+    for (const std::string &bl : B.block_labels())
+        B.block(bl)("pqrs") =
+            build_and_fill("B" + bl, B.block(bl).dims(), b4)("pqrs");
+    A2["pq"] = A["pq"];
+    B2["pqrs"] = B["pqrs"];
+
+    C["pqrs"] = A["pt"] * B["tqrs"];
+    C["pqrs"] += 0.5 * A["pt"] * A["qu"] * B["turs"];
+    C["ijab"] -= B["abij"];
+    C2["pqrs"] = A2["pt"] * B2["tqrs"];
+    C2["pqrs"] += 0.5 * A2["pt"] * A2["qu"] * B2["turs"];
+    C2["ijab"] -= B2["abij"];
+
+    double diff = std::fabs(C2.norm(2) - C.norm(2));
+    diff = std::max(diff, std::fabs(double(C2["pqrs"] * B2["pqrs"]) -
+                                    double(C["pqrs"] * B["pqrs"])));
+    C["pqrs"] -= C2["pqrs"];
+    return std::max(diff, C.norm(0));
+}
+
+double test_block_distributed_disk()
+{
+    BlockedTensor::reset_mo_spaces();
+    BlockedTensor::add_mo_space("o", "i,j,k,l", {0, 1, 2}, AlphaSpin);
+    BlockedTensor::add_mo_space("v", "a,b,c,d", {3, 4, 5, 6, 7}, AlphaSpin);
+    BlockedTensor::add_composite_mo_space("g", "p,q,r,s,t,u", {"o", "v"});
+
+    BlockedTensor A = BlockedTensor::build(CoreTensor, "A", {"gg"});
+    BlockedTensor B = BlockedTensor::build(CoreTensor, "B", {"gggg"});
+    BlockedTensor C = BlockedTensor::build(CoreTensor, "C", {"gggg"});
+    BlockedTensor A2 = BlockedTensor::build_distributed("A2", {"gg"});
+    BlockedTensor B2 =
+        BlockedTensor::build_distributed(DiskTensor, "B2", {"gggg"});
+    BlockedTensor C2 =
+        BlockedTensor::build_distributed(DiskTensor, "C2", {"gggg"});
+    for (const std::string &bl : A.block_labels())
+        A.block(bl)("pq") = build_and_fill("A" + bl, A.block(bl).dims(), a2)("pq");
+    for (const std::string &bl : B.block_labels())
+        B.block(bl)("pqrs") =
+            build_and_fill("B" + bl, B.block(bl).dims(), b4)("pqrs");
+    A2["pq"] = A["pq"];
+    B2["pqrs"] = B["pqrs"];
+    for (const auto &key_tensor : B2.blocks())
+        if (key_tensor.second.type() != DiskTensor)
+            return 1.0;
+
+    C["pqrs"] = A["pt"] * B["tqrs"];
+    C["ijab"] -= B["abij"];
+    C2["pqrs"] = A2["pt"] * B2["tqrs"];
+    C2["ijab"] -= B2["abij"];
+
+    double diff = std::fabs(C2.norm(2) - C.norm(2)) / C.norm(2);
+    double dot = C["pqrs"] * B["pqrs"];
+    diff = std::max(diff, std::fabs(double(C2["pqrs"] * B2["pqrs"]) - dot) /
+                              std::fabs(dot));
+    C["pqrs"] -= C2["pqrs"];
+    return std::max(diff, C.norm(0));
+}
+
 double test_Oia_equal_Cbu_Guv_Tivab_expert()
 {
     BlockedTensor::set_expert_mode(true);
@@ -2420,6 +3168,8 @@ int main(int argc, char *argv[])
                         "Testing blocked tensor 2-norm"),
         std::make_tuple(kPass, test_block_norm_3,
                         "Testing blocked tensor inf-norm"),
+        std::make_tuple(kPass, test_block_stats,
+                        "Testing blocked tensor stats"),
         std::make_tuple(kPass, test_block_zero, "Testing blocked tensor zero"),
         std::make_tuple(kPass, test_block_scale,
                         "Testing blocked tensor scale"),
@@ -2452,6 +3202,8 @@ int main(int argc, char *argv[])
         std::make_tuple(
             kPass, test_Cij_equal_Aik_B_jk,
             "Testing blocked tensor C(\"ij\") = A(\"ik\") * B(\"jk\")"),
+        std::make_tuple(kPass, test_label_cache_reset,
+                        "Testing label resolution after redefining spaces"),
         std::make_tuple(
             kPass, test_Cij_equal_Aip_B_jp,
             "Testing blocked tensor C(\"ij\") = A(\"ip\") * B(\"jp\") (1)"),
@@ -2483,6 +3235,10 @@ int main(int argc, char *argv[])
                         "Testing blocked tensor chain multiply (1)"),
         std::make_tuple(kPass, test_chain_multiply2,
                         "Testing blocked tensor chain multiply (2)"),
+        std::make_tuple(kPass, test_chain_multiply_repeated,
+                        "Testing blocked tensor repeated chain multiply"),
+        std::make_tuple(kPass, test_graph_blocked,
+                        "Testing blocked tensor statements in a Graph"),
         std::make_tuple(
             kPass, test_Cij_equal_Aij_plus_Bij,
             "Testing blocked tensor C(\"ij\") = A(\"ij\") + B(\"ij\")"),
@@ -2498,6 +3254,11 @@ int main(int argc, char *argv[])
         std::make_tuple(
             kPass, test_Cia_plus_equal_Aia_minus_three_Bai,
             "Testing blocked tensor C(\"ia\") += A(\"ia\") - 3 * B(\"ai\")"),
+        std::make_tuple(kPass, test_Cpq_equal_Apq_minus_Bqp_plus_half_Dpq,
+                        "Testing blocked tensor C(\"pq\") = A(\"pq\") - "
+                        "B(\"qp\") + 0.5 * D(\"pq\")"),
+        std::make_tuple(kPass, test_Cia_equal_Aij_Bja_over_denominator,
+                        "Testing blocked tensor denominator epilogue"),
         std::make_tuple(kPass, test_Dij_equal_Aij_times_Bij_plus_Cij,
                         "Testing blocked tensor distributive (1)"),
         std::make_tuple(kPass, test_Dij_plus_equal_Bij_plus_Cij_times_Aij,
@@ -2550,6 +3311,27 @@ int main(int argc, char *argv[])
         std::make_tuple(
             kPass, test_batched_with_factor,
             "C2[\"ijrs\"] = batched(\"r\", 0.5 * A[\"abrs\"] * B[\"ijab\"])"),
+        std::make_tuple(
+            kPass, test_batched_auto,
+            "D2[\"pqrs\"] = batched(A[\"pqtu\"] * B[\"rt\"] * C[\"su\"])"),
+        std::make_tuple(kPass, test_block_distributed,
+                        "Block-distributed tensors"),
+        std::make_tuple(kPass, test_block_distributed_disk,
+                        "Block-distributed tensors on disk"),
+        std::make_tuple(kPass, test_restricted_spin,
+                        "Restricted spin (aliased beta-beta blocks)"),
+        std::make_tuple(kPass, test_mo_space_contexts,
+                        "MO space contexts of concurrent threads"),
+        std::make_tuple(kPass, test_checkpoint,
+                        "Checkpoint save, background save and load"),
+        std::make_tuple(kPass, test_composite_gram,
+                        "Gram matrix and combination of blocked tensors"),
+        std::make_tuple(kPass, test_block_screening,
+                        "Norm screening of block products"),
+        std::make_tuple(kPass, test_syev_power_inverse,
+                        "Block-parallel syev, power and inverse"),
+        std::make_tuple(kPass, test_transform_ao_to_mo,
+                        "AO to MO transformation in slabs"),
         std::make_tuple(
             kPass, test_Oia_equal_Cbu_Guv_Tivab_expert,
             "O[\"ia\"] = C[\"bu\"] * G[\"uv\"] * T[\"ivab\"]"),
@@ -27,10 +27,25 @@
  * @END LICENSE
  */
 
+#include <algorithm>
+#include <ambit/call_trace.h>
+#include <ambit/composite_tensor.h>
+#include <ambit/factorized_tensor.h>
+#include <ambit/float_tensor.h>
+#include <ambit/graph.h>
+#include <ambit/memory.h>
+#include <ambit/packed_tensor.h>
+#include <ambit/static_expression.h>
 #include <ambit/tensor.h>
+#include <ambit/threads.h>
+#include <ambit/timer.h>
 #include <cmath>
 #include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
 #include <stdexcept>
+#include <thread>
 
 #define ANSI_COLOR_RED "\x1b[31m"
 #define ANSI_COLOR_GREEN "\x1b[32m"
@@ -182,6 +197,57 @@ double relative_difference(const Tensor &A1, const Tensor &A2)
         return dmax / Dmax;
 }
 
+/// C(Cinds) = alpha * A(Ainds) * B(Binds) + beta * C(Cinds), by looping over
+/// every combination of the labels
+void naive_contract(Tensor &C, const Tensor &A, const Tensor &B,
+                    const Indices &Cinds, const Indices &Ainds,
+                    const Indices &Binds, double alpha, double beta)
+{
+    Indices labels = Cinds;
+    std::map<std::string, size_t> dims;
+    for (size_t n = 0; n < Cinds.size(); ++n)
+        dims[Cinds[n]] = C.dim(n);
+    for (const auto &tensor_inds : {std::make_pair(&A, &Ainds),
+                                    std::make_pair(&B, &Binds)})
+    {
+        for (size_t n = 0; n < tensor_inds.second->size(); ++n)
+        {
+            const std::string &label = (*tensor_inds.second)[n];
+            if (dims.count(label) == 0)
+                labels.push_back(label);
+            dims[label] = tensor_inds.first->dim(n);
+        }
+    }
+
+    // Row-major offset of the element at the label values
+    auto offset = [&](const Tensor &T, const Indices &inds,
+                      const std::map<std::string, size_t> &value) {
+        size_t off = 0;
+        for (size_t n = 0; n < inds.size(); ++n)
+            off = off * T.dim(n) + value.at(inds[n]);
+        return off;
+    };
+
+    std::vector<double> &Cv = C.data();
+    const std::vector<double> &Av = A.data();
+    const std::vector<double> &Bv = B.data();
+    for (double &c : Cv)
+        c *= beta;
+    std::map<std::string, size_t> value;
+    for (const std::string &label : labels)
+        value[label] = 0;
+    while (true)
+    {
+        Cv[offset(C, Cinds, value)] += alpha * Av[offset(A, Ainds, value)] *
+                                       Bv[offset(B, Binds, value)];
+        size_t n = labels.size();
+        while (n > 0 && ++value[labels[n - 1]] == dims[labels[n - 1]])
+            value[labels[--n]] = 0;
+        if (n == 0)
+            break;
+    }
+}
+
 double try_relative_difference()
 {
     Dimension Adims = {4, 5, 6};
@@ -264,6 +330,63 @@ double try_inf_norm()
         return delta / fabs(normA1 + normA2);
 }
 
+double try_stats()
+{
+    // Several chunks of the parallel reduction. Small integers (with ties)
+    // keep the sums exact in any order, so the results match exactly.
+    size_t ni = 100, nj = 50, nk = 20;
+    Tensor A = Tensor::build(CoreTensor, "A", {ni, nj, nk});
+    std::vector<double> &Av = A.data();
+    for (size_t n = 0; n < Av.size(); ++n)
+        Av[n] = static_cast<double>((n * 7919) % 23) - 11.0;
+
+    double norm1 = 0.0, norm2 = 0.0, norm_inf = 0.0;
+    size_t max_pos = 0, min_pos = 0;
+    for (size_t n = 0; n < Av.size(); ++n)
+    {
+        norm1 += std::fabs(Av[n]);
+        norm2 += Av[n] * Av[n];
+        norm_inf = std::max(norm_inf, std::fabs(Av[n]));
+        if (Av[n] > Av[max_pos])
+            max_pos = n;
+        if (Av[n] < Av[min_pos])
+            min_pos = n;
+    }
+
+    TensorStats stats = A.stats();
+    double diff = std::fabs(stats.norm1 - norm1) / norm1;
+    diff += std::fabs(stats.norm2 - std::sqrt(norm2)) / std::sqrt(norm2);
+    diff += std::fabs(stats.norm_inf - norm_inf);
+    diff += std::fabs(stats.rms - std::sqrt(norm2 / Av.size()));
+    diff += std::fabs(stats.max - Av[max_pos]) +
+            std::fabs(stats.min - Av[min_pos]);
+    std::vector<size_t> max_indices = {max_pos / (nj * nk),
+                                       max_pos / nk % nj, max_pos % nk};
+    std::vector<size_t> min_indices = {min_pos / (nj * nk),
+                                       min_pos / nk % nj, min_pos % nk};
+    if (stats.max_indices != max_indices || stats.min_indices != min_indices ||
+        std::get<1>(A.max()) != max_indices)
+        diff += 1.0;
+    diff += std::fabs(A.norm(1) - stats.norm1);
+
+    // Random data gives the same sums bit for bit on any number of threads
+    initialize_random(A);
+    TensorStats threaded = A.stats();
+#if defined(_OPENMP)
+    int omp_threads = omp_get_max_threads();
+    omp_set_num_threads(omp_threads > 1 ? 1 : 3);
+#endif
+    TensorStats other = A.stats();
+#if defined(_OPENMP)
+    omp_set_num_threads(omp_threads);
+#endif
+    if (other.norm1 != threaded.norm1 || other.norm2 != threaded.norm2 ||
+        other.rms != threaded.rms ||
+        other.max_indices != threaded.max_indices ||
+        other.min_indices != threaded.min_indices)
+        diff += 1.0;
+    return diff;
+}
 double try_zero()
 {
     Dimension Adims = {4, 5, 6};
@@ -316,6 +439,49 @@ double try_scale()
     return relative_difference(A1, A2);
 }
 
+double try_for_each()
+{
+    // Every elementwise iterator must visit the same indices as iterate
+    Dimension Adims = {3, 4, 5, 6};
+    Tensor A1 = Tensor::build(CoreTensor, "A1", Adims);
+    Tensor A2 = Tensor::build(CoreTensor, "A2", Adims);
+    Tensor A3 = Tensor::build(CoreTensor, "A3", Adims);
+    Tensor A4 = Tensor::build(CoreTensor, "A4", Adims);
+    Tensor A5 = Tensor::build(CoreTensor, "A5", Adims);
+    initialize_random(A1, A2);
+    A3.copy(A1);
+    A4.copy(A1);
+    A5.copy(A1);
+
+    auto update = [](const std::vector<size_t> &ind, double &value) {
+        value *= 1.0 + ind[0] + 10.0 * ind[1] + 100.0 * ind[2] +
+                 1000.0 * ind[3];
+    };
+    A1.iterate(update);
+    A2.for_each(update);
+    A3.parallel_for_each(update);
+    A5.parallel_iterate(update);
+    A4.parallel_for_each_row(
+        [&](const std::vector<size_t> &ind, double *row, size_t n) {
+            std::vector<size_t> full(ind);
+            for (size_t l = 0; l < n; ++l)
+            {
+                full[3] = l;
+                update(full, row[l]);
+            }
+        });
+
+    double sum = 0.0;
+    A4.cfor_each([&](const std::vector<size_t> &, const double &value) {
+        sum += value;
+    });
+    double diff = std::fabs(sum - A1.norm(1)) / A1.norm(1);
+    diff = std::max(diff, relative_difference(A2, A1));
+    diff = std::max(diff, relative_difference(A3, A1));
+    diff = std::max(diff, relative_difference(A5, A1));
+    return std::max(diff, relative_difference(A4, A1));
+}
+
 double try_slice_rank0_same1()
 {
     Dimension Cdims = {};
@@ -1089,7 +1255,107 @@ double try_slice_rank3_diff4()
 
     return relative_difference(C1, C2);
 }
+double try_slice_large(const Dimension &Cdims, const Dimension &Adims,
+                       const IndexRange &Cinds, const IndexRange &Ainds)
+{
+    Tensor C1 = Tensor::build(CoreTensor, "C1", Cdims);
+    Tensor C2 = Tensor::build(CoreTensor, "C2", Cdims);
+    initialize_random(C1, C2);
+    Tensor A = Tensor::build(CoreTensor, "A", Adims);
+    initialize_random(A);
+
+    C1.slice(A, Cinds, Ainds, alpha, beta);
+
+    std::vector<double> &Av = A.data();
+    std::vector<double> &Cv = C2.data();
+    for (size_t i = 0; i < Cinds[0][1] - Cinds[0][0]; i++)
+        for (size_t j = 0; j < Cinds[1][1] - Cinds[1][0]; j++)
+            for (size_t k = 0; k < Cinds[2][1] - Cinds[2][0]; k++)
+            {
+                double &c = Cv[((i + Cinds[0][0]) * Cdims[1] + j +
+                                Cinds[1][0]) * Cdims[2] + k + Cinds[2][0]];
+                c = alpha * Av[((i + Ainds[0][0]) * Adims[1] + j +
+                                Ainds[1][0]) * Adims[2] + k + Ainds[2][0]] +
+                    beta * c;
+            }
+
+    return relative_difference(C1, C2);
+}
+double try_slice_long_runs()
+{
+    // Full trailing dimensions merge into runs longer than a work piece
+    return try_slice_large({6, 60, 400}, {8, 60, 400},
+                           {{1L, 5L}, {0L, 60L}, {0L, 400L}},
+                           {{2L, 6L}, {0L, 60L}, {0L, 400L}});
+}
+double try_slice_short_runs()
+{
+    // Many short stripes, split into several batches
+    return try_slice_large({40, 50, 30}, {45, 52, 40},
+                           {{0L, 40L}, {2L, 50L}, {3L, 27L}},
+                           {{5L, 45L}, {0L, 48L}, {10L, 34L}});
+}
+
+double try_cat()
+{
+    // Rows of A longer than a piece of work, and short rows of B and C
+    Tensor A = Tensor::build(CoreTensor, "A", {3, 2, 20000});
+    Tensor B = Tensor::build(CoreTensor, "B", {3, 1, 20000});
+    Tensor C = Tensor::build(CoreTensor, "C", {3, 0, 20000});
+    initialize_random(A);
+    initialize_random(B);
+
+    Tensor D1 = Tensor::cat({A, B, C, A}, 1);
+
+    Tensor D2 = Tensor::build(CoreTensor, "D2", {3, 5, 20000});
+    D2({{0, 3}, {0, 2}, {0, 20000}}) = A();
+    D2({{0, 3}, {2, 3}, {0, 20000}}) = B();
+    D2({{0, 3}, {3, 5}, {0, 20000}}) = A();
+    return relative_difference(D1, D2);
+}
+double try_slice_scatter_gather()
+{
+    Tensor C1 = Tensor::build(CoreTensor, "C1", {6, 7});
+    Tensor C2 = Tensor::build(CoreTensor, "C2", {6, 7});
+    initialize_random(C1, C2);
+
+    vector<Tensor> As = {Tensor::build(CoreTensor, "A1", {2, 3}),
+                         Tensor::build(CoreTensor, "A2", {4, 5}),
+                         Tensor::build(CoreTensor, "A3", {4, 7})};
+    for (Tensor &A : As)
+        initialize_random(A);
+    vector<IndexRange> Cinds = {
+        {{0L, 2L}, {0L, 3L}}, {{2L, 6L}, {3L, 7L}}, {{1L, 1L}, {0L, 7L}}};
+    vector<IndexRange> Ainds = {
+        {{0L, 2L}, {0L, 3L}}, {{0L, 4L}, {1L, 5L}}, {{3L, 3L}, {0L, 7L}}};
+
+    C1.scatter(As, Cinds, Ainds, alpha, beta);
+    for (size_t n = 0; n < As.size(); ++n)
+        C2.slice(As[n], Cinds[n], Ainds[n], alpha, beta);
+    double diff = relative_difference(C1, C2);
+
+    vector<Tensor> G1 = {Tensor::build(CoreTensor, "G1", {3, 2}),
+                         Tensor::build(CoreTensor, "G2", {4, 4})};
+    vector<Tensor> G2 = {Tensor::build(CoreTensor, "G1", {3, 2}),
+                         Tensor::build(CoreTensor, "G2", {4, 4})};
+    vector<IndexRange> Ginds = {{{0L, 3L}, {0L, 2L}}, {{0L, 4L}, {0L, 4L}}};
+    vector<IndexRange> Cranges = {{{3L, 6L}, {5L, 7L}},
+                                  {{1L, 5L}, {2L, 6L}}};
+    C1.gather(G1, Ginds, Cranges, alpha, 0.0);
+    for (size_t n = 0; n < G2.size(); ++n)
+        G2[n].slice(C1, Ginds[n], Cranges[n], alpha, 0.0);
+    for (size_t n = 0; n < G1.size(); ++n)
+        diff = std::max(diff, relative_difference(G1[n], G2[n]));
+    return diff;
+}
+double try_cat_dims_fail()
+{
+    Tensor A = Tensor::build(CoreTensor, "A", {4, 5});
+    Tensor B = Tensor::build(CoreTensor, "B", {4, 6});
 
+    Tensor::cat({A, B}, 0);
+    return 0.0;
+}
 double try_slice_label_fail()
 {
     Tensor C1 = Tensor::build(CoreTensor, "C1", {4, 5});
@@ -1726,6 +1992,161 @@ double try_permute_rank4_lkji()
     return relative_difference(C1, C2);
 }
 
+double try_permute_rank2_ji_tiled()
+{
+    // Spans several (partial) tiles of the transpose kernel
+    Dimension Cdims = {70, 45};
+    Tensor C1 = Tensor::build(CoreTensor, "C1", Cdims);
+    Tensor C2 = Tensor::build(CoreTensor, "C2", Cdims);
+    initialize_random(C1, C2);
+
+    Dimension Adims = {45, 70};
+    Tensor A = Tensor::build(CoreTensor, "A", Adims);
+    initialize_random(A);
+
+    if (mode == 0)
+        C1.permute(A, {"i", "j"}, {"j", "i"}, alpha, beta);
+    else if (mode == 1)
+        C1("ij") = A("ji");
+    else if (mode == 2)
+        C1("ij") += A("ji");
+    else if (mode == 3)
+        C1("ij") -= A("ji");
+    else
+        throw std::runtime_error("Bad mode.");
+
+    std::vector<double> &Av = A.data();
+    std::vector<double> &Cv = C2.data();
+    for (size_t i = 0; i < Cdims[0]; i++)
+    {
+        for (size_t j = 0; j < Cdims[1]; j++)
+        {
+            Cv[i * Cdims[1] + j] =
+                alpha * Av[j * Adims[1] + i] + beta * Cv[i * Cdims[1] + j];
+        }
+    }
+
+    return relative_difference(C1, C2);
+}
+
+double try_permute_rank4_klij_tiled()
+{
+    Dimension Cdims = {5, 40, 3, 36};
+    Tensor C1 = Tensor::build(CoreTensor, "C1", Cdims);
+    Tensor C2 = Tensor::build(CoreTensor, "C2", Cdims);
+    initialize_random(C1, C2);
+
+    Dimension Adims = {3, 36, 5, 40};
+    Tensor A = Tensor::build(CoreTensor, "A", Adims);
+    initialize_random(A);
+
+    if (mode == 0)
+        C1.permute(A, {"i", "j", "k", "l"}, {"k", "l", "i", "j"}, alpha, beta);
+    else if (mode == 1)
+        C1("ijkl") = A("klij");
+    else if (mode == 2)
+        C1("ijkl") += A("klij");
+    else if (mode == 3)
+        C1("ijkl") -= A("klij");
+    else
+        throw std::runtime_error("Bad mode.");
+
+    std::vector<double> &Av = A.data();
+    std::vector<double> &Cv = C2.data();
+    for (size_t i = 0; i < Cdims[0]; i++)
+    {
+        for (size_t j = 0; j < Cdims[1]; j++)
+        {
+            for (size_t k = 0; k < Cdims[2]; k++)
+            {
+                for (size_t l = 0; l < Cdims[3]; l++)
+                {
+                    Cv[i * Cdims[1] * Cdims[2] * Cdims[3] +
+                       j * Cdims[2] * Cdims[3] + k * Cdims[3] + l] =
+                        alpha * Av[k * Adims[1] * Adims[2] * Adims[3] +
+                                   l * Adims[2] * Adims[3] + i * Adims[3] + j] +
+                        beta * Cv[i * Cdims[1] * Cdims[2] * Cdims[3] +
+                                  j * Cdims[2] * Cdims[3] + k * Cdims[3] + l];
+                }
+            }
+        }
+    }
+
+    return relative_difference(C1, C2);
+}
+
+double try_permute_sum()
+{
+    Dimension Cdims = {5, 40, 3, 36};
+    Tensor C1 = Tensor::build(CoreTensor, "C1", Cdims);
+    Tensor C2 = Tensor::build(CoreTensor, "C2", Cdims);
+    initialize_random(C1, C2);
+
+    Tensor A = Tensor::build(CoreTensor, "A", Cdims);
+    Tensor B = Tensor::build(CoreTensor, "B", {3, 36, 5, 40});
+    Tensor D = Tensor::build(CoreTensor, "D", {5, 40, 36, 3});
+    initialize_random(A);
+    initialize_random(B);
+    initialize_random(D);
+
+    if (mode == 0)
+        C1.permute_sum({A, B, D}, {"i", "j", "k", "l"},
+                       {{"i", "j", "k", "l"},
+                        {"k", "l", "i", "j"},
+                        {"i", "j", "l", "k"}},
+                       {alpha, -alpha, 0.5 * alpha}, beta);
+    else if (mode == 1)
+        C1("ijkl") = A("ijkl") - B("klij") + 0.5 * D("ijlk");
+    else if (mode == 2)
+        C1("ijkl") += A("ijkl") - B("klij") + 0.5 * D("ijlk");
+    else if (mode == 3)
+        C1("ijkl") -= A("ijkl") - B("klij") + 0.5 * D("ijlk");
+    else
+        throw std::runtime_error("Bad mode.");
+
+    // The same terms one permute at a time
+    C2.permute(A, {"i", "j", "k", "l"}, {"i", "j", "k", "l"}, alpha, beta);
+    C2.permute(B, {"i", "j", "k", "l"}, {"k", "l", "i", "j"}, -alpha, 1.0);
+    C2.permute(D, {"i", "j", "k", "l"}, {"i", "j", "l", "k"}, 0.5 * alpha,
+               1.0);
+
+    return relative_difference(C1, C2);
+}
+
+double try_permute_antisymmetrizer()
+{
+    size_t no = 6, nv = 9;
+    Tensor X = Tensor::build(CoreTensor, "X", {no, no, nv, nv});
+    Tensor A = Tensor::build(CoreTensor, "A", {no, nv});
+    Tensor B = Tensor::build(CoreTensor, "B", {nv, no, nv, nv});
+    initialize_random(X);
+    initialize_random(A);
+    initialize_random(B);
+
+    Tensor R1 = Tensor::build(CoreTensor, "R1", {no, no, nv, nv});
+    Tensor R2 = Tensor::build(CoreTensor, "R2", {no, no, nv, nv});
+    initialize_random(R1, R2);
+
+    R1("ijab") += P("ij") * P("ab") * X("ijab");
+    R1("ijab") -= P("ij") * (A("ic") * B("cjab"));
+
+    R2("ijab") += X("ijab") - X("jiab") - X("ijba") + X("jiba");
+    Tensor AB = Tensor::build(CoreTensor, "AB", {no, no, nv, nv});
+    AB("ijab") = A("ic") * B("cjab");
+    R2("ijab") -= AB("ijab") - AB("jiab");
+
+    // Three indices give the six orderings, the odd ones negated
+    Tensor Y = Tensor::build(CoreTensor, "Y", {no, no, no});
+    Tensor S1 = Tensor::build(CoreTensor, "S1", {no, no, no});
+    Tensor S2 = Tensor::build(CoreTensor, "S2", {no, no, no});
+    initialize_random(Y);
+    S1("ijk") = P("ijk") * (0.5 * Y("ijk"));
+    S2("ijk") = 0.5 * Y("ijk") - 0.5 * Y("ikj") - 0.5 * Y("jik") +
+                0.5 * Y("jki") + 0.5 * Y("kij") - 0.5 * Y("kji");
+
+    return std::max(relative_difference(R1, R2), relative_difference(S1, S2));
+}
+
 double try_permute_label_fail()
 {
     Dimension Cdims = {3, 4};
@@ -1857,29 +2278,30 @@ double try_contract_hadamard()
 
     return relative_difference(C1, C2);
 }
-double try_contract_dot()
+double try_contract_hadamard_mid1()
 {
-    Dimension Cdims = {};
+    // P sits between the GEMM index groups of C, A and B
+    Dimension Cdims = {4, 3, 5};
     Tensor C1 = Tensor::build(CoreTensor, "C1", Cdims);
     Tensor C2 = Tensor::build(CoreTensor, "C2", Cdims);
     initialize_random(C1, C2);
 
-    Dimension Adims = {4};
+    Dimension Adims = {4, 3, 6};
     Tensor A = Tensor::build(CoreTensor, "A", Adims);
     initialize_random(A);
 
-    Dimension Bdims = {4};
+    Dimension Bdims = {6, 3, 5};
     Tensor B = Tensor::build(CoreTensor, "B", Bdims);
     initialize_random(B);
 
     if (mode == 0)
-        C1.contract(A, B, {}, {"i"}, {"i"}, alpha, beta);
+        C1.contract(A, B, {"i", "P", "j"}, {"i", "P", "k"}, {"k", "P", "j"}, alpha, beta);
     else if (mode == 1)
-        C1("") = A("i") * B("i");
+        C1("iPj") = A("iPk") * B("kPj");
     else if (mode == 2)
-        C1("") += A("i") * B("i");
+        C1("iPj") += A("iPk") * B("kPj");
     else if (mode == 3)
-        C1("") -= A("i") * B("i");
+        C1("iPj") -= A("iPk") * B("kPj");
     else
         throw std::runtime_error("Bad mode.");
 
@@ -1887,37 +2309,49 @@ double try_contract_dot()
     std::vector<double> &Bv = B.data();
     std::vector<double> &Cv = C2.data();
 
-    Cv[0] = beta * Cv[0];
-    for (size_t i = 0; i < Adims[0]; i++)
+    size_t ni = 4, nj = 5, nk = 6, np = 3;
+    for (size_t p = 0; p < np; p++)
     {
-        Cv[0] += alpha * Av[i] * Bv[i];
+        for (size_t i = 0; i < ni; i++)
+        {
+            for (size_t j = 0; j < nj; j++)
+            {
+                double sum = 0.0;
+                for (size_t k = 0; k < nk; k++)
+                {
+                    sum += Av[i * np * nk + p * nk + k] * Bv[k * np * nj + p * nj + j];
+                }
+                Cv[i * np * nj + p * nj + j] = alpha * sum + beta * Cv[i * np * nj + p * nj + j];
+            }
+        }
     }
 
     return relative_difference(C1, C2);
 }
-double try_contract_axpy1()
+double try_contract_hadamard_mid2()
 {
-    Dimension Cdims = {4};
+    // P sits between the GEMM index groups of C, A and B, all transposed
+    Dimension Cdims = {5, 3, 4};
     Tensor C1 = Tensor::build(CoreTensor, "C1", Cdims);
     Tensor C2 = Tensor::build(CoreTensor, "C2", Cdims);
     initialize_random(C1, C2);
 
-    Dimension Adims = {};
+    Dimension Adims = {6, 3, 4};
     Tensor A = Tensor::build(CoreTensor, "A", Adims);
     initialize_random(A);
 
-    Dimension Bdims = {4};
+    Dimension Bdims = {5, 3, 6};
     Tensor B = Tensor::build(CoreTensor, "B", Bdims);
     initialize_random(B);
 
     if (mode == 0)
-        C1.contract(A, B, {"i"}, {}, {"i"}, alpha, beta);
+        C1.contract(A, B, {"j", "P", "i"}, {"k", "P", "i"}, {"j", "P", "k"}, alpha, beta);
     else if (mode == 1)
-        C1("i") = A("") * B("i");
+        C1("jPi") = A("kPi") * B("jPk");
     else if (mode == 2)
-        C1("i") += A("") * B("i");
+        C1("jPi") += A("kPi") * B("jPk");
     else if (mode == 3)
-        C1("i") -= A("") * B("i");
+        C1("jPi") -= A("kPi") * B("jPk");
     else
         throw std::runtime_error("Bad mode.");
 
@@ -1925,36 +2359,49 @@ double try_contract_axpy1()
     std::vector<double> &Bv = B.data();
     std::vector<double> &Cv = C2.data();
 
-    for (size_t i = 0; i < Cdims[0]; i++)
+    size_t ni = 4, nj = 5, nk = 6, np = 3;
+    for (size_t p = 0; p < np; p++)
     {
-        Cv[i] = alpha * Av[0] * Bv[i] + beta * Cv[i];
+        for (size_t i = 0; i < ni; i++)
+        {
+            for (size_t j = 0; j < nj; j++)
+            {
+                double sum = 0.0;
+                for (size_t k = 0; k < nk; k++)
+                {
+                    sum += Av[k * np * ni + p * ni + i] * Bv[j * np * nk + p * nk + k];
+                }
+                Cv[j * np * ni + p * ni + i] = alpha * sum + beta * Cv[j * np * ni + p * ni + i];
+            }
+        }
     }
 
     return relative_difference(C1, C2);
 }
-double try_contract_axpy2()
+double try_contract_hadamard_mid3()
 {
-    Dimension Cdims = {4};
+    // P sits between the GEMM index groups of C and A only
+    Dimension Cdims = {4, 3};
     Tensor C1 = Tensor::build(CoreTensor, "C1", Cdims);
     Tensor C2 = Tensor::build(CoreTensor, "C2", Cdims);
     initialize_random(C1, C2);
 
-    Dimension Adims = {4};
+    Dimension Adims = {4, 3, 6};
     Tensor A = Tensor::build(CoreTensor, "A", Adims);
     initialize_random(A);
 
-    Dimension Bdims = {};
+    Dimension Bdims = {3, 6};
     Tensor B = Tensor::build(CoreTensor, "B", Bdims);
     initialize_random(B);
 
     if (mode == 0)
-        C1.contract(A, B, {"i"}, {"i"}, {}, alpha, beta);
+        C1.contract(A, B, {"i", "P"}, {"i", "P", "k"}, {"P", "k"}, alpha, beta);
     else if (mode == 1)
-        C1("i") = A("i") * B("");
+        C1("iP") = A("iPk") * B("Pk");
     else if (mode == 2)
-        C1("i") += A("i") * B("");
+        C1("iP") += A("iPk") * B("Pk");
     else if (mode == 3)
-        C1("i") -= A("i") * B("");
+        C1("iP") -= A("iPk") * B("Pk");
     else
         throw std::runtime_error("Bad mode.");
 
@@ -1962,72 +2409,497 @@ double try_contract_axpy2()
     std::vector<double> &Bv = B.data();
     std::vector<double> &Cv = C2.data();
 
-    for (size_t i = 0; i < Cdims[0]; i++)
+    size_t ni = 4, nj = 1, nk = 6, np = 3;
+    for (size_t p = 0; p < np; p++)
     {
-        Cv[i] = alpha * Av[i] * Bv[0] + beta * Cv[i];
+        for (size_t i = 0; i < ni; i++)
+        {
+            for (size_t j = 0; j < nj; j++)
+            {
+                double sum = 0.0;
+                for (size_t k = 0; k < nk; k++)
+                {
+                    sum += Av[i * np * nk + p * nk + k] * Bv[p * nk + k];
+                }
+                Cv[i * np + p] = alpha * sum + beta * Cv[i * np + p];
+            }
+        }
     }
 
     return relative_difference(C1, C2);
 }
-double try_contract_ger1()
+double try_contract_strided()
 {
-    Dimension Cdims = {4, 5};
+    // Misordered rank-4/5 operands whose index groups span several GETT
+    // tiles, checked against the permute-and-GEMM kernel
+    Dimension Cdims = {12, 2, 13, 5};
     Tensor C1 = Tensor::build(CoreTensor, "C1", Cdims);
     Tensor C2 = Tensor::build(CoreTensor, "C2", Cdims);
     initialize_random(C1, C2);
 
-    Dimension Adims = {4};
+    Dimension Adims = {11, 2, 13, 13, 12};
     Tensor A = Tensor::build(CoreTensor, "A", Adims);
     initialize_random(A);
 
-    Dimension Bdims = {5};
+    Dimension Bdims = {5, 13, 11, 2};
     Tensor B = Tensor::build(CoreTensor, "B", Bdims);
     initialize_random(B);
 
+    settings::contraction_kernel = settings::StridedKernel;
     if (mode == 0)
-        C1.contract(A, B, {"i", "j"}, {"i"}, {"j"}, alpha, beta);
+        C1.contract(A, B, {"a", "P", "i", "j"}, {"k", "P", "i", "l", "a"},
+                    {"j", "l", "k", "P"}, alpha, beta);
     else if (mode == 1)
-        C1("ij") = A("i") * B("j");
+        C1("aPij") = A("kPila") * B("jlkP");
     else if (mode == 2)
-        C1("ij") += A("i") * B("j");
+        C1("aPij") += A("kPila") * B("jlkP");
     else if (mode == 3)
-        C1("ij") -= A("i") * B("j");
+        C1("aPij") -= A("kPila") * B("jlkP");
     else
         throw std::runtime_error("Bad mode.");
 
-    std::vector<double> &Av = A.data();
-    std::vector<double> &Bv = B.data();
-    std::vector<double> &Cv = C2.data();
+    settings::contraction_kernel = settings::PermuteKernel;
+    C2.contract(A, B, {"a", "P", "i", "j"}, {"k", "P", "i", "l", "a"},
+                {"j", "l", "k", "P"}, alpha, beta);
+    settings::contraction_kernel = settings::AutoKernel;
 
-    for (size_t i = 0; i < Cdims[0]; i++)
+    return relative_difference(C1, C2);
+}
+double try_contract_hadamard_shapes()
+{
+    // Hadamard indices next to an empty index group, which must not be
+    // taken for the middle of a GEMM layout
+    std::vector<std::tuple<Dimension, Dimension, Dimension, Indices, Indices,
+                           Indices>>
+        shapes = {
+            std::make_tuple(Dimension{3}, Dimension{4, 3}, Dimension{4, 3},
+                            Indices{"P"}, Indices{"k", "P"},
+                            Indices{"k", "P"}),
+            std::make_tuple(Dimension{5, 3}, Dimension{3}, Dimension{5, 3},
+                            Indices{"j", "P"}, Indices{"P"},
+                            Indices{"j", "P"}),
+            std::make_tuple(Dimension{3, 5}, Dimension{4, 3},
+                            Dimension{4, 3, 5}, Indices{"P", "j"},
+                            Indices{"k", "P"}, Indices{"k", "P", "j"}),
+            std::make_tuple(Dimension{5, 3}, Dimension{4, 3},
+                            Dimension{5, 3, 4}, Indices{"j", "P"},
+                            Indices{"k", "P"}, Indices{"j", "P", "k"}),
+        };
+
+    double diff = 0.0;
+    for (const auto &shape : shapes)
     {
-        for (size_t j = 0; j < Cdims[1]; j++)
+        Tensor C1 = Tensor::build(CoreTensor, "C1", std::get<0>(shape));
+        Tensor C2 = Tensor::build(CoreTensor, "C2", std::get<0>(shape));
+        Tensor A = Tensor::build(CoreTensor, "A", std::get<1>(shape));
+        Tensor B = Tensor::build(CoreTensor, "B", std::get<2>(shape));
+        initialize_random(C1, C2);
+        initialize_random(A);
+        initialize_random(B);
+        C1.contract(A, B, std::get<3>(shape), std::get<4>(shape),
+                    std::get<5>(shape), alpha, beta);
+        naive_contract(C2, A, B, std::get<3>(shape), std::get<4>(shape),
+                       std::get<5>(shape), alpha, beta);
+        diff = std::max(diff, relative_difference(C1, C2));
+    }
+    return diff;
+}
+/// Labels of a random Hadamard contraction, each index group of random size
+/// (empty included) and every tensor in a random index order, with the
+/// dimension of each label
+void random_hadamard_labels(Indices &Cinds, Indices &Ainds, Indices &Binds,
+                            std::map<std::string, size_t> &dims)
+{
+    auto group = [&](const std::vector<std::string> &names, int least) {
+        Indices labels;
+        int count = least + std::rand() % (int(names.size()) - least + 1);
+        for (int n = 0; n < count; ++n)
         {
-            Cv[i * Cdims[1] + j] =
-                alpha * Av[i] * Bv[j] + beta * Cv[i * Cdims[1] + j];
+            labels.push_back(names[n]);
+            dims[names[n]] = 2 + std::rand() % 3;
         }
-    }
+        return labels;
+    };
+    Indices P = group({"P", "Q"}, 1);
+    Indices i = group({"i", "j"}, 0);
+    Indices j = group({"a", "b"}, 0);
+    Indices k = group({"k", "l"}, 0);
+
+    auto shuffled = [](Indices x, const Indices &y, const Indices &z) {
+        x.insert(x.end(), y.begin(), y.end());
+        x.insert(x.end(), z.begin(), z.end());
+        for (size_t n = x.size(); n > 1; --n)
+            std::swap(x[n - 1], x[std::rand() % n]);
+        return x;
+    };
+    Cinds = shuffled(P, i, j);
+    Ainds = shuffled(P, i, k);
+    Binds = shuffled(P, j, k);
+}
 
+/// Relative difference of a contraction of random tensors from the naive
+/// loop
+double naive_contract_difference(const Indices &Cinds, const Indices &Ainds,
+                                 const Indices &Binds,
+                                 const std::map<std::string, size_t> &dims)
+{
+    auto dims_of = [&](const Indices &inds) {
+        Dimension d;
+        for (const std::string &label : inds)
+            d.push_back(dims.at(label));
+        return d;
+    };
+    Tensor C1 = Tensor::build(CoreTensor, "C1", dims_of(Cinds));
+    Tensor C2 = Tensor::build(CoreTensor, "C2", dims_of(Cinds));
+    Tensor A = Tensor::build(CoreTensor, "A", dims_of(Ainds));
+    Tensor B = Tensor::build(CoreTensor, "B", dims_of(Binds));
+    initialize_random(C1, C2);
+    initialize_random(A);
+    initialize_random(B);
+    C1.contract(A, B, Cinds, Ainds, Binds, alpha, beta);
+    naive_contract(C2, A, B, Cinds, Ainds, Binds, alpha, beta);
     return relative_difference(C1, C2);
 }
-double try_contract_ger2()
+double try_contract_hadamard_random()
 {
-    Dimension Cdims = {4, 5};
+    double diff = 0.0;
+    for (int trial = 0; trial < 200; ++trial)
+    {
+        Indices Cinds, Ainds, Binds;
+        std::map<std::string, size_t> dims;
+        random_hadamard_labels(Cinds, Ainds, Binds, dims);
+        diff = std::max(diff,
+                        naive_contract_difference(Cinds, Ainds, Binds, dims));
+    }
+    return diff;
+}
+double try_contract_layout_candidates()
+{
+    // Every candidate layout of the tuning, not only the one it picks, on
+    // Hadamard shapes (which may keep P between two index groups) and on
+    // random ones
+    std::vector<std::tuple<Indices, Indices, Indices>> shapes = {
+        std::make_tuple(Indices{"b", "a", "d"}, Indices{"d", "c"},
+                        Indices{"d", "c", "a", "b"}),
+        std::make_tuple(Indices{"a", "d"}, Indices{"b", "c", "d"},
+                        Indices{"a", "d", "c", "b"}),
+        std::make_tuple(Indices{"i", "j", "a", "b"},
+                        Indices{"k", "j", "l", "i"},
+                        Indices{"b", "l", "a", "k"}),
+    };
+    std::vector<std::map<std::string, size_t>> shape_dims = {
+        {{"a", 4}, {"b", 3}, {"c", 5}, {"d", 2}},
+        {{"a", 4}, {"b", 3}, {"c", 5}, {"d", 2}},
+        {{"i", 4}, {"j", 3}, {"a", 2}, {"b", 5}, {"k", 3}, {"l", 2}},
+    };
+    for (int trial = 0; trial < 20; ++trial)
+    {
+        Indices Cinds, Ainds, Binds;
+        std::map<std::string, size_t> dims;
+        random_hadamard_labels(Cinds, Ainds, Binds, dims);
+        shapes.push_back(std::make_tuple(Cinds, Ainds, Binds));
+        shape_dims.push_back(dims);
+    }
+
+    // There are at most 64 candidates, and the candidate number wraps
+    double diff = 0.0;
+    for (int candidate = 0; candidate < 64; ++candidate)
+    {
+        settings::contraction_layout_candidate = candidate;
+        for (size_t n = 0; n < shapes.size(); ++n)
+            diff = std::max(diff, naive_contract_difference(
+                                      std::get<0>(shapes[n]),
+                                      std::get<1>(shapes[n]),
+                                      std::get<2>(shapes[n]), shape_dims[n]));
+    }
+    settings::contraction_layout_candidate = -1;
+    return diff;
+}
+double try_contract_layouts()
+{
+    // Every index group misordered, so each layout permutes something;
+    // the tuned layouts are checked against the fixed rules
+    Dimension Cdims = {7, 6, 5, 4};
     Tensor C1 = Tensor::build(CoreTensor, "C1", Cdims);
     Tensor C2 = Tensor::build(CoreTensor, "C2", Cdims);
+    Tensor C3 = Tensor::build(CoreTensor, "C3", Cdims);
     initialize_random(C1, C2);
+    C3.copy(C1);
 
-    Dimension Adims = {5};
+    Dimension Adims = {9, 6, 8, 7};
     Tensor A = Tensor::build(CoreTensor, "A", Adims);
     initialize_random(A);
 
-    Dimension Bdims = {4};
+    Dimension Bdims = {4, 8, 5, 9};
     Tensor B = Tensor::build(CoreTensor, "B", Bdims);
     initialize_random(B);
 
-    if (mode == 0)
-        C1.contract(A, B, {"i", "j"}, {"j"}, {"i"}, alpha, beta);
-    else if (mode == 1)
+    double diff = 0.0;
+    for (Tensor C : {C1, C3})
+    {
+        settings::contraction_layout = (C == C1 ? settings::EstimatedLayout
+                                                : settings::MeasuredLayout);
+        if (mode == 0)
+            C.contract(A, B, {"i", "j", "a", "b"}, {"k", "j", "l", "i"},
+                       {"b", "l", "a", "k"}, alpha, beta);
+        else if (mode == 1)
+            C("ijab") = A("kjli") * B("blak");
+        else if (mode == 2)
+            C("ijab") += A("kjli") * B("blak");
+        else if (mode == 3)
+            C("ijab") -= A("kjli") * B("blak");
+        else
+            throw std::runtime_error("Bad mode.");
+    }
+
+    settings::contraction_layout = settings::FixedLayout;
+    C2.contract(A, B, {"i", "j", "a", "b"}, {"k", "j", "l", "i"},
+                {"b", "l", "a", "k"}, alpha, beta);
+    settings::contraction_layout = settings::EstimatedLayout;
+
+    return std::max(relative_difference(C1, C2), relative_difference(C3, C2));
+}
+double try_contract_epilogue()
+{
+    // Denominators on GEMMs that write C directly, on one that writes a
+    // permuted copy of C (C("iajb")), and on Hadamard slices, plus a functor
+    std::vector<std::vector<double>> energies;
+    for (size_t n : {5, 6, 7, 8})
+    {
+        std::vector<double> energy(n);
+        for (size_t m = 0; m < n; ++m)
+            energy[m] = (energies.size() < 2 ? -1.0 : 1.0) * (1.0 + 0.1 * m);
+        energies.push_back(energy);
+    }
+    Epilogue denominator =
+        Epilogue::denominator(energies, {1.0, 1.0, -1.0, -1.0}, 0.5);
+    Epilogue square(
+        [](const std::vector<size_t> &indices, double &value) {
+            value = value * value + indices[0];
+        });
+
+    Tensor C = Tensor::build(CoreTensor, "C", {5, 6, 7, 8});
+    Tensor A = Tensor::build(CoreTensor, "A", {5, 6, 9});
+    Tensor B1 = Tensor::build(CoreTensor, "B1", {9, 7, 8});
+    Tensor B2 = Tensor::build(CoreTensor, "B2", {8, 9, 7});
+    Tensor A3 = Tensor::build(CoreTensor, "A3", {5, 9, 6, 7});
+    Tensor B3 = Tensor::build(CoreTensor, "B3", {9, 5, 8});
+    Tensor A4 = Tensor::build(CoreTensor, "A4", {5, 7, 9});
+    Tensor B4 = Tensor::build(CoreTensor, "B4", {9, 6, 8});
+    for (Tensor T : {A, B1, B2, A3, B3, A4, B4})
+        initialize_random(T);
+
+    Indices ijab = {"i", "j", "a", "b"};
+    Indices iajb = {"i", "a", "j", "b"};
+    std::vector<std::tuple<Tensor, Tensor, Indices, Indices, Indices>>
+        products = {
+            std::make_tuple(A, B1, ijab, Indices{"i", "j", "e"},
+                            Indices{"e", "a", "b"}),
+            std::make_tuple(A, B2, ijab, Indices{"i", "j", "e"},
+                            Indices{"b", "e", "a"}),
+            std::make_tuple(A3, B3, ijab, Indices{"i", "e", "j", "a"},
+                            Indices{"e", "i", "b"}),
+            std::make_tuple(A4, B4, iajb, Indices{"i", "j", "e"},
+                            Indices{"e", "a", "b"})};
+
+    double diff = 0.0;
+    for (const auto &product : products)
+    {
+        for (const Epilogue &epilogue : {denominator, square})
+        {
+            Tensor C1 = Tensor::build(CoreTensor, "C1", C.dims());
+            Tensor C2 = Tensor::build(CoreTensor, "C2", C.dims());
+            initialize_random(C1);
+            C2.copy(C1);
+
+            C1.contract(std::get<0>(product), std::get<1>(product),
+                        std::get<2>(product), std::get<3>(product),
+                        std::get<4>(product), epilogue, alpha, beta);
+
+            C2.contract(std::get<0>(product), std::get<1>(product),
+                        std::get<2>(product), std::get<3>(product),
+                        std::get<4>(product), alpha, beta);
+            C2.iterate([&](const std::vector<size_t> &indices, double &value) {
+                std::vector<size_t> idx(indices);
+                epilogue.apply(idx, 3, &value, 1);
+            });
+
+            diff = std::max(diff, relative_difference(C1, C2));
+        }
+    }
+    return diff;
+}
+double try_contract_dot()
+{
+    Dimension Cdims = {};
+    Tensor C1 = Tensor::build(CoreTensor, "C1", Cdims);
+    Tensor C2 = Tensor::build(CoreTensor, "C2", Cdims);
+    initialize_random(C1, C2);
+
+    Dimension Adims = {4};
+    Tensor A = Tensor::build(CoreTensor, "A", Adims);
+    initialize_random(A);
+
+    Dimension Bdims = {4};
+    Tensor B = Tensor::build(CoreTensor, "B", Bdims);
+    initialize_random(B);
+
+    if (mode == 0)
+        C1.contract(A, B, {}, {"i"}, {"i"}, alpha, beta);
+    else if (mode == 1)
+        C1("") = A("i") * B("i");
+    else if (mode == 2)
+        C1("") += A("i") * B("i");
+    else if (mode == 3)
+        C1("") -= A("i") * B("i");
+    else
+        throw std::runtime_error("Bad mode.");
+
+    std::vector<double> &Av = A.data();
+    std::vector<double> &Bv = B.data();
+    std::vector<double> &Cv = C2.data();
+
+    Cv[0] = beta * Cv[0];
+    for (size_t i = 0; i < Adims[0]; i++)
+    {
+        Cv[0] += alpha * Av[i] * Bv[i];
+    }
+
+    return relative_difference(C1, C2);
+}
+double try_contract_axpy1()
+{
+    Dimension Cdims = {4};
+    Tensor C1 = Tensor::build(CoreTensor, "C1", Cdims);
+    Tensor C2 = Tensor::build(CoreTensor, "C2", Cdims);
+    initialize_random(C1, C2);
+
+    Dimension Adims = {};
+    Tensor A = Tensor::build(CoreTensor, "A", Adims);
+    initialize_random(A);
+
+    Dimension Bdims = {4};
+    Tensor B = Tensor::build(CoreTensor, "B", Bdims);
+    initialize_random(B);
+
+    if (mode == 0)
+        C1.contract(A, B, {"i"}, {}, {"i"}, alpha, beta);
+    else if (mode == 1)
+        C1("i") = A("") * B("i");
+    else if (mode == 2)
+        C1("i") += A("") * B("i");
+    else if (mode == 3)
+        C1("i") -= A("") * B("i");
+    else
+        throw std::runtime_error("Bad mode.");
+
+    std::vector<double> &Av = A.data();
+    std::vector<double> &Bv = B.data();
+    std::vector<double> &Cv = C2.data();
+
+    for (size_t i = 0; i < Cdims[0]; i++)
+    {
+        Cv[i] = alpha * Av[0] * Bv[i] + beta * Cv[i];
+    }
+
+    return relative_difference(C1, C2);
+}
+double try_contract_axpy2()
+{
+    Dimension Cdims = {4};
+    Tensor C1 = Tensor::build(CoreTensor, "C1", Cdims);
+    Tensor C2 = Tensor::build(CoreTensor, "C2", Cdims);
+    initialize_random(C1, C2);
+
+    Dimension Adims = {4};
+    Tensor A = Tensor::build(CoreTensor, "A", Adims);
+    initialize_random(A);
+
+    Dimension Bdims = {};
+    Tensor B = Tensor::build(CoreTensor, "B", Bdims);
+    initialize_random(B);
+
+    if (mode == 0)
+        C1.contract(A, B, {"i"}, {"i"}, {}, alpha, beta);
+    else if (mode == 1)
+        C1("i") = A("i") * B("");
+    else if (mode == 2)
+        C1("i") += A("i") * B("");
+    else if (mode == 3)
+        C1("i") -= A("i") * B("");
+    else
+        throw std::runtime_error("Bad mode.");
+
+    std::vector<double> &Av = A.data();
+    std::vector<double> &Bv = B.data();
+    std::vector<double> &Cv = C2.data();
+
+    for (size_t i = 0; i < Cdims[0]; i++)
+    {
+        Cv[i] = alpha * Av[i] * Bv[0] + beta * Cv[i];
+    }
+
+    return relative_difference(C1, C2);
+}
+double try_contract_ger1()
+{
+    Dimension Cdims = {4, 5};
+    Tensor C1 = Tensor::build(CoreTensor, "C1", Cdims);
+    Tensor C2 = Tensor::build(CoreTensor, "C2", Cdims);
+    initialize_random(C1, C2);
+
+    Dimension Adims = {4};
+    Tensor A = Tensor::build(CoreTensor, "A", Adims);
+    initialize_random(A);
+
+    Dimension Bdims = {5};
+    Tensor B = Tensor::build(CoreTensor, "B", Bdims);
+    initialize_random(B);
+
+    if (mode == 0)
+        C1.contract(A, B, {"i", "j"}, {"i"}, {"j"}, alpha, beta);
+    else if (mode == 1)
+        C1("ij") = A("i") * B("j");
+    else if (mode == 2)
+        C1("ij") += A("i") * B("j");
+    else if (mode == 3)
+        C1("ij") -= A("i") * B("j");
+    else
+        throw std::runtime_error("Bad mode.");
+
+    std::vector<double> &Av = A.data();
+    std::vector<double> &Bv = B.data();
+    std::vector<double> &Cv = C2.data();
+
+    for (size_t i = 0; i < Cdims[0]; i++)
+    {
+        for (size_t j = 0; j < Cdims[1]; j++)
+        {
+            Cv[i * Cdims[1] + j] =
+                alpha * Av[i] * Bv[j] + beta * Cv[i * Cdims[1] + j];
+        }
+    }
+
+    return relative_difference(C1, C2);
+}
+double try_contract_ger2()
+{
+    Dimension Cdims = {4, 5};
+    Tensor C1 = Tensor::build(CoreTensor, "C1", Cdims);
+    Tensor C2 = Tensor::build(CoreTensor, "C2", Cdims);
+    initialize_random(C1, C2);
+
+    Dimension Adims = {5};
+    Tensor A = Tensor::build(CoreTensor, "A", Adims);
+    initialize_random(A);
+
+    Dimension Bdims = {4};
+    Tensor B = Tensor::build(CoreTensor, "B", Bdims);
+    initialize_random(B);
+
+    if (mode == 0)
+        C1.contract(A, B, {"i", "j"}, {"j"}, {"i"}, alpha, beta);
+    else if (mode == 1)
         C1("ij") = A("j") * B("i");
     else if (mode == 2)
         C1("ij") += A("j") * B("i");
@@ -2215,104 +3087,1516 @@ double try_contract_gemv4()
 
     return relative_difference(C1, C2);
 }
-double try_C_equal_A_B(std::string c_ind, std::string a_ind, std::string b_ind,
-                       std::vector<int> c_dim, std::vector<int> a_dim,
-                       std::vector<int> b_dim)
+double try_C_equal_A_B(std::string c_ind, std::string a_ind, std::string b_ind,
+                       std::vector<int> c_dim, std::vector<int> a_dim,
+                       std::vector<int> b_dim)
+{
+    std::vector<size_t> dims;
+    dims.push_back(3);
+    dims.push_back(4);
+    dims.push_back(5);
+
+    size_t ni = 3;
+    size_t nj = 4;
+    size_t nk = 5;
+
+    Tensor A = Tensor::build(CoreTensor, "A", {dims[a_dim[0]], dims[a_dim[1]]});
+    initialize_random(A);
+    Tensor B = Tensor::build(CoreTensor, "B", {dims[b_dim[0]], dims[b_dim[1]]});
+    initialize_random(B);
+    Tensor C1 =
+        Tensor::build(CoreTensor, "C1", {dims[c_dim[0]], dims[c_dim[1]]});
+    Tensor C2 =
+        Tensor::build(CoreTensor, "C2", {dims[c_dim[0]], dims[c_dim[1]]});
+    initialize_random(C1, C2);
+
+    std::vector<std::string> c_inds = {std::string(1, c_ind[0]),
+                                       std::string(1, c_ind[1])};
+    std::vector<std::string> a_inds = {std::string(1, a_ind[0]),
+                                       std::string(1, a_ind[1])};
+    std::vector<std::string> b_inds = {std::string(1, b_ind[0]),
+                                       std::string(1, b_ind[1])};
+
+    if (mode == 0)
+        C1.contract(A, B, c_inds, a_inds, b_inds, alpha, beta);
+    else if (mode == 1)
+        C1(c_ind) = A(a_ind) * B(b_ind);
+    else if (mode == 2)
+        C1(c_ind) += A(a_ind) * B(b_ind);
+    else if (mode == 3)
+        C1(c_ind) -= A(a_ind) * B(b_ind);
+    else
+        throw std::runtime_error("Bad mode.");
+
+    C2.scale(beta);
+    std::vector<double> &Av = A.data();
+    std::vector<double> &Bv = B.data();
+    std::vector<double> &Cv = C2.data();
+    std::vector<size_t> n(3);
+    for (n[0] = 0; n[0] < ni; ++n[0])
+    {
+        for (n[1] = 0; n[1] < nj; ++n[1])
+        {
+            for (n[2] = 0; n[2] < nk; ++n[2])
+            {
+                size_t aind1 = n[a_dim[0]];
+                size_t aind2 = n[a_dim[1]];
+                size_t bind1 = n[b_dim[0]];
+                size_t bind2 = n[b_dim[1]];
+                size_t cind1 = n[c_dim[0]];
+                size_t cind2 = n[c_dim[1]];
+                Cv[cind1 * dims[c_dim[1]] + cind2] +=
+                    alpha * Av[aind1 * dims[a_dim[1]] + aind2] *
+                    Bv[bind1 * dims[b_dim[1]] + bind2];
+            }
+        }
+    }
+
+    return relative_difference(C1, C2);
+}
+double try_contract_gemm1()
+{
+    return try_C_equal_A_B("ij", "ik", "jk", {0, 1}, {0, 2}, {1, 2});
+}
+double try_contract_gemm2()
+{
+    return try_C_equal_A_B("ij", "ik", "kj", {0, 1}, {0, 2}, {2, 1});
+}
+double try_contract_gemm3()
+{
+    return try_C_equal_A_B("ij", "ki", "jk", {0, 1}, {2, 0}, {1, 2});
+}
+double try_contract_gemm4()
+{
+    return try_C_equal_A_B("ij", "ki", "kj", {0, 1}, {2, 0}, {2, 1});
+}
+double try_contract_gemm5()
+{
+    return try_C_equal_A_B("ji", "ik", "jk", {1, 0}, {0, 2}, {1, 2});
+}
+double try_contract_gemm6()
+{
+    return try_C_equal_A_B("ji", "ik", "kj", {1, 0}, {0, 2}, {2, 1});
+}
+double try_contract_gemm7()
+{
+    return try_C_equal_A_B("ji", "ki", "jk", {1, 0}, {2, 0}, {1, 2});
+}
+double try_contract_gemm8()
+{
+    return try_C_equal_A_B("ji", "ki", "kj", {1, 0}, {2, 0}, {2, 1});
+}
+double try_contract_plan_reuse()
+{
+    // The same labels with different shapes must not share a plan
+    std::vector<std::vector<size_t>> shapes = {{3, 4, 5}, {5, 3, 4}, {3, 4, 5}};
+    double diff = 0.0;
+    for (const std::vector<size_t> &dims : shapes)
+    {
+        size_t ni = dims[0];
+        size_t nj = dims[1];
+        size_t nk = dims[2];
+
+        Tensor A = Tensor::build(CoreTensor, "A", {nk, ni});
+        initialize_random(A);
+        Tensor B = Tensor::build(CoreTensor, "B", {nj, nk});
+        initialize_random(B);
+        Tensor C1 = Tensor::build(CoreTensor, "C1", {ni, nj});
+        Tensor C2 = Tensor::build(CoreTensor, "C2", {ni, nj});
+
+        for (int repeat = 0; repeat < 2; ++repeat)
+        {
+            initialize_random(C1, C2);
+            C1.contract(A, B, {"i", "j"}, {"k", "i"}, {"j", "k"}, alpha, beta);
+
+            C2.scale(beta);
+            std::vector<double> &Av = A.data();
+            std::vector<double> &Bv = B.data();
+            std::vector<double> &Cv = C2.data();
+            for (size_t i = 0; i < ni; ++i)
+                for (size_t j = 0; j < nj; ++j)
+                    for (size_t k = 0; k < nk; ++k)
+                        Cv[i * nj + j] +=
+                            alpha * Av[k * ni + i] * Bv[j * nk + k];
+
+            diff = std::max(diff, relative_difference(C1, C2));
+        }
+    }
+    return diff;
+}
+double try_contract_batch()
+{
+    // Products of three small and two large shapes under labels that need C
+    // and A permuted (the large ones are pipelined), and the same under
+    // labels that are GEMM ready in place
+    std::vector<std::vector<size_t>> shapes = {
+        {3, 4, 5, 6},     {2, 7, 3, 4},     {40, 50, 30, 40},
+        {3, 4, 5, 6},     {5, 1, 4, 2},     {50, 40, 40, 30}};
+    std::vector<std::vector<Indices>> labels = {
+        {{"i", "j", "k"}, {"l", "k", "i"}, {"j", "l"}},
+        {{"k", "i", "j"}, {"k", "i", "l"}, {"l", "j"}}};
+    double diff = 0.0;
+    for (const std::vector<Indices> &inds : labels)
+    {
+        std::vector<Tensor> Cs, As, Bs, Rs;
+        for (const std::vector<size_t> &dims : shapes)
+        {
+            std::map<std::string, size_t> dim = {{"i", dims[0]},
+                                                 {"j", dims[1]},
+                                                 {"k", dims[2]},
+                                                 {"l", dims[3]}};
+            auto dims_of = [&](const Indices &ind) {
+                Dimension d;
+                for (const std::string &label : ind)
+                    d.push_back(dim[label]);
+                return d;
+            };
+            Cs.push_back(Tensor::build(CoreTensor, "C", dims_of(inds[0])));
+            Rs.push_back(Tensor::build(CoreTensor, "R", dims_of(inds[0])));
+            As.push_back(Tensor::build(CoreTensor, "A", dims_of(inds[1])));
+            Bs.push_back(Tensor::build(CoreTensor, "B", dims_of(inds[2])));
+            initialize_random(Cs.back(), Rs.back());
+            initialize_random(As.back());
+            initialize_random(Bs.back());
+        }
+
+        Tensor::contract_batch(Cs, As, Bs, inds[0], inds[1], inds[2], alpha,
+                               beta);
+        for (size_t n = 0; n < Rs.size(); ++n)
+        {
+            Rs[n].contract(As[n], Bs[n], inds[0], inds[1], inds[2], alpha,
+                           beta);
+            diff = std::max(diff, relative_difference(Cs[n], Rs[n]));
+        }
+    }
+    return diff;
+}
+double try_thread_split()
+{
+    // Many small products shared by four threads, so each product gets one
+    // thread, then the same under a limit of one thread
+    int nthread = threads::max_threads();
+    std::vector<Tensor> Cs, As, Bs, Rs;
+    for (size_t n = 0; n < 12; ++n)
+    {
+        Cs.push_back(Tensor::build(CoreTensor, "C", {4, 5 + n % 3}));
+        Rs.push_back(Tensor::build(CoreTensor, "R", {4, 5 + n % 3}));
+        As.push_back(Tensor::build(CoreTensor, "A", {6, 4}));
+        Bs.push_back(Tensor::build(CoreTensor, "B", {5 + n % 3, 6}));
+        initialize_random(Cs.back(), Rs.back());
+        initialize_random(As.back());
+        initialize_random(Bs.back());
+        Rs.back().contract(As.back(), Bs.back(), {"i", "j"}, {"k", "i"},
+                           {"j", "k"}, alpha, beta);
+    }
+
+#if defined(_OPENMP)
+    int omp_threads = omp_get_max_threads();
+    omp_set_num_threads(4);
+#endif
+    Tensor::contract_batch(Cs, As, Bs, {"i", "j"}, {"k", "i"}, {"j", "k"},
+                           alpha, beta);
+    double diff = 0.0;
+    for (size_t n = 0; n < Rs.size(); ++n)
+        diff = std::max(diff, relative_difference(Cs[n], Rs[n]));
+    {
+        threads::Limit limit(1);
+        threads::Limit wider(2);
+        if (threads::max_threads() != 1)
+            diff = 1.0;
+        for (size_t n = 0; n < Rs.size(); ++n)
+            Rs[n].contract(As[n], Bs[n], {"i", "j"}, {"k", "i"}, {"j", "k"},
+                           alpha, beta);
+        Tensor::contract_batch(Cs, As, Bs, {"i", "j"}, {"k", "i"}, {"j", "k"},
+                               alpha, beta);
+        for (size_t n = 0; n < Rs.size(); ++n)
+            diff = std::max(diff, relative_difference(Cs[n], Rs[n]));
+    }
+    settings::num_threads = 2;
+    if (threads::max_threads() > 2)
+        diff = 1.0;
+    settings::num_threads = 0;
+#if defined(_OPENMP)
+    omp_set_num_threads(omp_threads);
+    if (omp_get_max_threads() != omp_threads)
+        diff = 1.0;
+#endif
+    if (threads::max_threads() != nthread)
+        diff = 1.0;
+    return diff;
+}
+double try_thread_split_concurrent()
+{
+    // Splits made by concurrent user threads, ending in any order, leave the
+    // global thread settings as they found them
+    size_t nworker = 4, nproduct = 12;
+    std::vector<std::vector<Tensor>> Cs(nworker), As(nworker), Bs(nworker),
+        Rs(nworker);
+    for (size_t t = 0; t < nworker; ++t)
+    {
+        for (size_t n = 0; n < nproduct; ++n)
+        {
+            Cs[t].push_back(Tensor::build(CoreTensor, "C", {4, 5 + n % 3}));
+            Rs[t].push_back(Tensor::build(CoreTensor, "R", {4, 5 + n % 3}));
+            As[t].push_back(Tensor::build(CoreTensor, "A", {6, 4}));
+            Bs[t].push_back(Tensor::build(CoreTensor, "B", {5 + n % 3, 6}));
+            initialize_random(As[t].back());
+            initialize_random(Bs[t].back());
+            Rs[t].back().contract(As[t].back(), Bs[t].back(), {"i", "j"},
+                                  {"k", "i"}, {"j", "k"}, 1.0, 0.0);
+        }
+    }
+
+#if defined(_OPENMP)
+    int levels = omp_get_max_active_levels();
+#endif
+    std::vector<double> diff(nworker, 0.0);
+    auto work = [&](size_t t) {
+#if defined(_OPENMP)
+        omp_set_num_threads(4);
+#endif
+        for (size_t repeat = 0; repeat < 20 + 7 * t; ++repeat)
+            Tensor::contract_batch(Cs[t], As[t], Bs[t], {"i", "j"},
+                                   {"k", "i"}, {"j", "k"}, 1.0, 0.0);
+        for (size_t n = 0; n < nproduct; ++n)
+            diff[t] = std::max(diff[t], relative_difference(Cs[t][n], Rs[t][n]));
+    };
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < nworker; ++t)
+        workers.emplace_back(work, t);
+    for (std::thread &worker : workers)
+        worker.join();
+
+#if defined(_OPENMP)
+    if (omp_get_max_active_levels() != levels)
+        return 1.0;
+#endif
+    return *std::max_element(diff.begin(), diff.end());
+}
+double try_composite()
+{
+    // Six history vectors, two of them on disk, read in several chunks
+    size_t ni = 60, nj = 40, nk = 30;
+    CompositeTensor<Tensor> H("H", 5);
+    for (size_t n = 0; n < 6; ++n)
+    {
+        H(n) = Tensor::build(n < 4 ? CoreTensor : DiskTensor,
+                             "H" + std::to_string(n), {ni, nj, nk});
+        Tensor R = Tensor::build(CoreTensor, "R", {ni, nj, nk});
+        initialize_random(R);
+        H(n)("ijk") = R("ijk");
+    }
+    Tensor x = Tensor::build(CoreTensor, "x", {ni, nj, nk});
+    initialize_random(x);
+
+    double diff = 0.0;
+    vector<vector<double>> S = H.gram();
+    vector<double> d = H.dots(x);
+    for (size_t i = 0; i < 6; ++i)
+    {
+        for (size_t j = 0; j < 6; ++j)
+        {
+            double ref = H(i)("ijk") * H(j)("ijk");
+            diff = std::max(diff, std::fabs(S[i][j] - ref) / std::fabs(ref));
+        }
+        double ref = H(i)("ijk") * x("ijk");
+        diff = std::max(diff, std::fabs(d[i] - ref) / std::fabs(ref));
+    }
+
+    // C = sum_i c_i H_i + beta C, in core and on disk
+    vector<double> c = {0.5, -1.0, 0.25, 0.0, 2.0, -0.75};
+    Tensor Ccore = Tensor::build(CoreTensor, "C", {ni, nj, nk});
+    Tensor Cdisk = Tensor::build(DiskTensor, "C", {ni, nj, nk});
+    Tensor R = Tensor::build(CoreTensor, "R", {ni, nj, nk});
+    initialize_random(Ccore, R);
+    Cdisk("ijk") = Ccore("ijk");
+    R.scale(beta);
+    for (size_t i = 0; i < 6; ++i)
+        R("ijk") += c[i] * H(i)("ijk");
+    H.linear_combination(Ccore, c, beta);
+    H.linear_combination(Cdisk, c, beta);
+    Tensor Cread = Tensor::build(CoreTensor, "C", {ni, nj, nk});
+    Cread("ijk") = Cdisk("ijk");
+    diff = std::max(diff, relative_difference(Ccore, R));
+    diff = std::max(diff, relative_difference(Cread, R));
+    return diff;
+}
+double try_contract_scratch()
+{
+    // Permutes both C and A, drawing C2 and A2 from the scratch pool
+    size_t ni = 3, nj = 4, nk = 5, nl = 6;
+    Tensor A = Tensor::build(CoreTensor, "A", {nl, nk, ni});
+    initialize_random(A);
+    Tensor B = Tensor::build(CoreTensor, "B", {nj, nl});
+    initialize_random(B);
+    Tensor C1 = Tensor::build(CoreTensor, "C1", {ni, nj, nk});
+    Tensor C2 = Tensor::build(CoreTensor, "C2", {ni, nj, nk});
+
+    size_t memory_limit = settings::memory_limit;
+    double diff = 0.0;
+    for (int repeat = 0; repeat < 3; ++repeat)
+    {
+        // The first pass runs with pooling disabled
+        settings::memory_limit = (repeat == 0 ? 0L : memory_limit);
+
+        initialize_random(C1, C2);
+        C1.contract(A, B, {"i", "j", "k"}, {"l", "k", "i"}, {"j", "l"}, alpha,
+                    beta);
+
+        C2.scale(beta);
+        std::vector<double> &Av = A.data();
+        std::vector<double> &Bv = B.data();
+        std::vector<double> &Cv = C2.data();
+        for (size_t i = 0; i < ni; ++i)
+            for (size_t j = 0; j < nj; ++j)
+                for (size_t k = 0; k < nk; ++k)
+                    for (size_t l = 0; l < nl; ++l)
+                        Cv[(i * nj + j) * nk + k] +=
+                            alpha * Av[(l * nk + k) * ni + i] * Bv[j * nl + l];
+
+        diff = std::max(diff, relative_difference(C1, C2));
+    }
+    settings::memory_limit = memory_limit;
+    return diff;
+}
+double try_build_uninitialized()
+{
+    // A released buffer is handed to the next tensor of the same size. A
+    // takes the best fit of whatever earlier tests left in the pool, so its
+    // buffer is still the best fit for B.
+    const double *first;
+    {
+        Tensor A = Tensor::build_uninitialized(CoreTensor, "A", {30, 40});
+        first = A.data().data();
+    }
+    Tensor B = Tensor::build_uninitialized(CoreTensor, "B", {40, 30});
+    double diff = (B.data().data() == first ? 0.0 : 1.0);
+
+    // Among buffers of the same capacity the last released comes back first
+    const double *next;
+    {
+        Tensor X = Tensor::build_uninitialized(CoreTensor, "X", {20, 30});
+        Tensor Y = Tensor::build_uninitialized(CoreTensor, "Y", {20, 30});
+        size_t Xcapacity = X.data().capacity();
+        next = (Y.data().capacity() <= Xcapacity ? Y : X).data().data();
+        X.reset();
+    }
+    Tensor Z = Tensor::build_uninitialized(CoreTensor, "Z", {30, 20});
+    if (Z.data().data() != next)
+        diff = 1.0;
+
+    Tensor C = Tensor::build(CoreTensor, "C", {30, 40});
+    initialize_random(C);
+    B.permute(C, {"j", "i"}, {"i", "j"});
+    for (size_t i = 0; i < 30; ++i)
+        for (size_t j = 0; j < 40; ++j)
+            diff = std::max(diff, std::fabs(B.data()[j * 30 + i] -
+                                            C.data()[i * 40 + j]));
+    return diff;
+}
+/// Copy of range of A, for comparing with its view
+Tensor sliced_copy(const Tensor &A, const IndexRange &range)
+{
+    Dimension dims;
+    IndexRange whole;
+    for (const std::vector<size_t> &bounds : range)
+    {
+        dims.push_back(bounds[1] - bounds[0]);
+        whole.push_back({0L, bounds[1] - bounds[0]});
+    }
+    Tensor S = Tensor::build(CoreTensor, A.name() + " slice", dims);
+    S.slice(A, whole, range, 1.0, 0.0);
+    return S;
+}
+double try_clone_deep_copy()
+{
+    // A clone keeps its own elements, also against pointers into the data
+    // of its source taken before the clone
+    Tensor A = Tensor::build(CoreTensor, "A", {6, 7});
+    Tensor B = Tensor::build(CoreTensor, "B", {7, 5});
+    initialize_random(A);
+    initialize_random(B);
+    Tensor R = Tensor::build(CoreTensor, "R", {6, 7});
+    R.copy(A);
+
+    double *Ap = A.data().data();
+    Tensor A1 = A.clone();
+    Tensor A2 = A.clone();
+    const double A10 = A1.data()[0];
+    Ap[0] = 42.0;
+    if (A1.data()[0] != A10 || A2.data()[0] != A10)
+        throw std::runtime_error("The clone shares the data of its source");
+    if (A.data()[0] != 42.0)
+        throw std::runtime_error("The source lost its data to the clone");
+    Ap[0] = A10;
+
+    A1.scale(2.0);
+    A2("ij") += A("ik") * B("kl") * B("jl");
+    A.view({{1L, 3L}, {0L, 7L}}).zero();
+    Tensor A3 = A.clone(CoreTensor);
+
+    Tensor R2 = Tensor::build(CoreTensor, "R2", {6, 7});
+    R2("ij") = R("ik") * B("kl") * B("jl");
+    R2("ij") += R("ij");
+    double diff = relative_difference(A2, R2);
+    R2.copy(R);
+    R2.scale(2.0);
+    diff = std::max(diff, relative_difference(A1, R2));
+    R.view({{1L, 3L}, {0L, 7L}}).zero();
+    diff = std::max(diff, relative_difference(A, R));
+    return std::max(diff, relative_difference(A3, R));
+}
+double try_view_gemm()
+{
+    // Row and column sub-ranges are GEMM-compatible with ld = 12 and 9
+    IndexRange Arange = {{2L, 7L}, {3L, 11L}};
+    IndexRange Crange = {{1L, 6L}, {0L, 7L}};
+    Tensor A = Tensor::build(CoreTensor, "A", {10, 12});
+    Tensor B = Tensor::build(CoreTensor, "B", {7, 8});
+    Tensor C1 = Tensor::build(CoreTensor, "C1", {8, 9});
+    initialize_random(A);
+    initialize_random(B);
+    initialize_random(C1);
+    Tensor C2 = C1.clone();
+
+    // C(i,j) += A(i,k) B(j,k), and the same with C transposed
+    C1.view(Crange)("ij") += A(Arange)("ik") * B("jk");
+    C1.view({{0L, 7L}, {2L, 7L}})("ji") -= 0.5 * A(Arange)("ik") * B("jk");
+
+    Tensor As = sliced_copy(A, Arange);
+    Tensor Cs = sliced_copy(C2, Crange);
+    Cs("ij") += As("ik") * B("jk");
+    C2(Crange) = Cs();
+    Cs = sliced_copy(C2, {{0L, 7L}, {2L, 7L}});
+    Cs("ji") -= 0.5 * As("ik") * B("jk");
+    C2({{0L, 7L}, {2L, 7L}}) = Cs();
+    return relative_difference(C1, C2);
+}
+double try_view_strided()
+{
+    // The view does not merge into matrices, so it goes through GETT
+    IndexRange Arange = {{1L, 4L}, {0L, 5L}, {2L, 6L}};
+    Tensor A = Tensor::build(CoreTensor, "A", {5, 6, 7});
+    Tensor B = Tensor::build(CoreTensor, "B", {4, 5, 3});
+    initialize_random(A);
+    initialize_random(B);
+    Tensor C1 = Tensor::build(CoreTensor, "C1", {3, 3});
+    Tensor C2 = Tensor::build(CoreTensor, "C2", {3, 3});
+
+    C1("ij") = A.view(Arange)("iak") * B("kaj");
+    C2("ij") = sliced_copy(A, Arange)("iak") * B("kaj");
+    double diff = relative_difference(C1, C2);
+
+    // Scalar contraction and copy of a view
+    double dot = A.view(Arange)("iak") * A.view(Arange)("iak");
+    Tensor As = sliced_copy(A, Arange);
+    diff += std::fabs(dot - As.norm(2) * As.norm(2)) / dot;
+    Tensor Ac = A.view(Arange).clone(CoreTensor);
+    diff += relative_difference(Ac, As);
+    return diff;
+}
+double try_view_slab()
+{
+    // C(i,j) at k = 2 += A(i,a) at k = 2 B(a,j), written through a slab of C
+    Tensor A = Tensor::build(CoreTensor, "A", {5, 4, 6});
+    Tensor B = Tensor::build(CoreTensor, "B", {6, 7});
+    Tensor C1 = Tensor::build(CoreTensor, "C1", {5, 4, 7});
+    initialize_random(A);
+    initialize_random(B);
+    initialize_random(C1);
+    Tensor C2 = C1.clone();
+
+    C1.slab({1}, {2})("ij") += A.slab({1}, {2})("ia") * B("aj");
+    C1.slab({0, 1}, {3, 1}).zero();
+
+    Tensor As = sliced_copy(A, {{0L, 5L}, {2L, 3L}, {0L, 6L}});
+    Tensor Cs = sliced_copy(C2, {{0L, 5L}, {2L, 3L}, {0L, 7L}});
+    Cs("ikj") += As("ika") * B("aj");
+    C2({{0L, 5L}, {2L, 3L}, {0L, 7L}}) = Cs();
+    Tensor Z = Tensor::build(CoreTensor, "Z", {1, 1, 7});
+    C2({{3L, 4L}, {1L, 2L}, {0L, 7L}}) = Z();
+    return relative_difference(C1, C2);
+}
+double try_view_data_fail()
+{
+    Tensor A = Tensor::build(CoreTensor, "A", {5, 6});
+    Tensor V = A.view({{1L, 3L}, {0L, 6L}});
+    V.data();
+    return 0.0;
+}
+double try_disk_permute()
+{
+    // A tiny memory limit forces both tensors through many tiles
+    size_t ni = 7, nj = 9, nk = 11;
+    Tensor A1 = Tensor::build(CoreTensor, "A1", {nk, ni, nj});
+    Tensor C1 = Tensor::build(CoreTensor, "C1", {ni, nj, nk});
+    initialize_random(A1);
+    initialize_random(C1);
+    Tensor A2 = Tensor::build(DiskTensor, "A2", {nk, ni, nj});
+    Tensor C2 = Tensor::build(DiskTensor, "C2", {ni, nj, nk});
+    A2.copy(A1);
+    C2.copy(C1);
+
+    size_t memory_limit = settings::memory_limit;
+    settings::memory_limit = 6L * sizeof(double) * 20L;
+    C2.permute(A2, {"i", "j", "k"}, {"k", "i", "j"}, alpha, beta);
+    settings::memory_limit = memory_limit;
+
+    C1.permute(A1, {"i", "j", "k"}, {"k", "i", "j"}, alpha, beta);
+    Tensor C3 = Tensor::build(CoreTensor, "C3", {ni, nj, nk});
+    C3.copy(C2);
+    return relative_difference(C3, C1);
+}
+double try_disk_contract()
+{
+    // The contracted index is split as the A and B boxes exceed a tile
+    size_t ni = 5, nj = 6, nk = 4, nl = 13;
+    Tensor A1 = Tensor::build(CoreTensor, "A1", {nl, ni, nk});
+    Tensor B1 = Tensor::build(CoreTensor, "B1", {nj, nl});
+    Tensor C1 = Tensor::build(CoreTensor, "C1", {ni, nj, nk});
+    initialize_random(A1);
+    initialize_random(B1);
+    initialize_random(C1);
+    Tensor A2 = Tensor::build(DiskTensor, "A2", {nl, ni, nk});
+    Tensor B2 = Tensor::build(DiskTensor, "B2", {nj, nl});
+    Tensor C2 = Tensor::build(DiskTensor, "C2", {ni, nj, nk});
+    A2.copy(A1);
+    B2.copy(B1);
+    C2.copy(C1);
+
+    size_t memory_limit = settings::memory_limit;
+    settings::memory_limit = 6L * sizeof(double) * 24L;
+    C2.contract(A2, B2, {"i", "j", "k"}, {"l", "i", "k"}, {"j", "l"}, alpha,
+                beta);
+    settings::memory_limit = memory_limit;
+
+    C1.contract(A1, B1, {"i", "j", "k"}, {"l", "i", "k"}, {"j", "l"}, alpha,
+                beta);
+    Tensor C3 = Tensor::build(CoreTensor, "C3", {ni, nj, nk});
+    C3.copy(C2);
+    return relative_difference(C3, C1);
+}
+double try_disk_slice()
+{
+    // Disk -> Disk slice of a partial range followed by a disk scale
+    Tensor A1 = Tensor::build(CoreTensor, "A1", {6, 7, 8});
+    Tensor C1 = Tensor::build(CoreTensor, "C1", {5, 7, 8});
+    initialize_random(A1);
+    initialize_random(C1);
+    Tensor A2 = Tensor::build(DiskTensor, "A2", {6, 7, 8});
+    Tensor C2 = Tensor::build(DiskTensor, "C2", {5, 7, 8});
+    A2.copy(A1);
+    C2.copy(C1);
+
+    IndexRange Cinds = {{1, 4}, {0, 7}, {2, 8}};
+    IndexRange Ainds = {{2, 5}, {0, 7}, {0, 6}};
+    C1.slice(A1, Cinds, Ainds, alpha, beta);
+    C1.scale(alpha);
+    C2.slice(A2, Cinds, Ainds, alpha, beta);
+    C2.scale(alpha);
+
+    Tensor C3 = Tensor::build(CoreTensor, "C3", {5, 7, 8});
+    C3.copy(C2);
+    return relative_difference(C3, C1);
+}
+double try_disk_cat()
+{
+    // Disk and core tensors concatenated into a disk tensor
+    Tensor A1 = Tensor::build(CoreTensor, "A1", {6, 7, 8});
+    Tensor B1 = Tensor::build(CoreTensor, "B1", {6, 7, 3});
+    initialize_random(A1);
+    initialize_random(B1);
+    Tensor A2 = Tensor::build(DiskTensor, "A2", {6, 7, 8});
+    A2.copy(A1);
+
+    Tensor C1 = Tensor::cat({A1, B1}, 2);
+    Tensor C2 = Tensor::cat({A2, B1}, 2);
+
+    Tensor C3 = Tensor::build(CoreTensor, "C3", {6, 7, 11});
+    C3.copy(C2);
+    return relative_difference(C3, C1);
+}
+double try_disk_map()
+{
+    // Writes through the mapping and through slices see the same file
+    Tensor A1 = Tensor::build(CoreTensor, "A1", {4, 5, 6});
+    Tensor C1 = Tensor::build(CoreTensor, "C1", {4, 5, 6});
+    initialize_random(A1);
+    initialize_random(C1);
+    Tensor A2 = Tensor::build(DiskTensor, "A2", {4, 5, 6});
+    A2.copy(A1);
+
+    double *Ap = A2.map_data();
+    const std::vector<double> &A1v = A1.data();
+    const std::vector<double> &C1v = C1.data();
+    double diff = 0.0;
+    for (size_t ind = 0L; ind < A1.numel(); ind++)
+    {
+        diff = std::max(diff, std::fabs(Ap[ind] - A1v[ind]));
+        Ap[ind] = alpha * C1v[ind];
+    }
+    A2.unmap_data();
+
+    C1.scale(alpha);
+    Tensor C2 = Tensor::build(CoreTensor, "C2", {4, 5, 6});
+    C2.copy(A2);
+    return std::max(diff, relative_difference(C2, C1));
+}
+double try_disk_lazy_zero()
+{
+    // Only the first of three extents is written; the rest read as zeros
+    Tensor A1 = Tensor::build(CoreTensor, "A1", {300, 1000});
+    Tensor B = Tensor::build(CoreTensor, "B", {50, 1000});
+    initialize_random(B);
+    Tensor A2 = Tensor::build(DiskTensor, "A2", {300, 1000});
+
+    IndexRange Ainds = {{10, 60}, {0, 1000}};
+    IndexRange Binds = {{0, 50}, {0, 1000}};
+    A1.slice(B, Ainds, Binds, alpha, 0.0);
+    A1.scale(beta + 1.0);
+    A2.slice(B, Ainds, Binds, alpha, 0.0);
+    A2.scale(beta + 1.0);
+
+    Tensor A3 = Tensor::build(CoreTensor, "A3", {300, 1000});
+    initialize_random(A3);
+    A3.copy(A2);
+    double diff = relative_difference(A3, A1);
+
+    // Zeroing drops the data again
+    A2.zero();
+    A3.copy(A2);
+    return std::max(diff, A3.norm(0));
+}
+double try_disk_compressed()
+{
+    // Partial slices, a scale, a contraction in tiles and a mapping of a
+    // compressed tensor of three extents, mostly zeros
+    settings::disk_compression = true;
+    Tensor A2 = Tensor::build(DiskTensor, "A2", {300, 1000});
+    Tensor C2 = Tensor::build(DiskTensor, "C2", {300, 7});
+    settings::disk_compression = false;
+
+    Tensor A1 = Tensor::build(CoreTensor, "A1", {300, 1000});
+    Tensor B = Tensor::build(CoreTensor, "B", {50, 1000});
+    Tensor D = Tensor::build(CoreTensor, "D", {1000, 7});
+    initialize_random(B);
+    initialize_random(D);
+    IndexRange Ainds = {{120, 170}, {0, 1000}};
+    IndexRange Binds = {{0, 50}, {0, 1000}};
+    IndexRange Pinds = {{100, 150}, {3, 9}};
+    IndexRange Qinds = {{0, 50}, {0, 6}};
+    for (Tensor *A : {&A1, &A2})
+    {
+        A->slice(B, Ainds, Binds, alpha, 0.0);
+        A->slice(B, Pinds, Qinds, 1.0, beta);
+        A->scale(beta + 1.0);
+    }
+    Tensor A3 = Tensor::build(CoreTensor, "A3", {300, 1000});
+    A3.copy(A2);
+    double diff = relative_difference(A3, A1);
+
+    size_t memory_limit = settings::memory_limit;
+    settings::memory_limit = 6L * sizeof(double) * 20000L;
+    C2.contract(A2, D, {"i", "j"}, {"i", "k"}, {"k", "j"}, alpha, 0.0);
+    settings::memory_limit = memory_limit;
+    Tensor C1 = Tensor::build(CoreTensor, "C1", {300, 7});
+    Tensor C3 = Tensor::build(CoreTensor, "C3", {300, 7});
+    C1.contract(A1, D, {"i", "j"}, {"i", "k"}, {"k", "j"}, alpha, 0.0);
+    C3.copy(C2);
+    diff = std::max(diff, relative_difference(C3, C1));
+
+    const double *Ap = A2.map_data();
+    const std::vector<double> &A1v = A1.data();
+    for (size_t ind = 0L; ind < A1.numel(); ind++)
+        diff = std::max(diff, std::fabs(Ap[ind] - A1v[ind]));
+    A2.unmap_data();
+    return diff;
+}
+double try_disk_tile_cache()
+{
+    // A tensor of four tiles through a cache of two, so dirty tiles are
+    // written back on eviction, then read in sequence with readahead
+    size_t cache_size = settings::disk_cache_size;
+    settings::disk_cache_size = 2L * sizeof(double) * 131072L;
+    Tensor A1 = Tensor::build(CoreTensor, "A1", {500, 1000});
+    Tensor B = Tensor::build(CoreTensor, "B", {50, 1000});
+    initialize_random(B);
+    double diff = 0.0;
+    {
+        Tensor A2 = Tensor::build(DiskTensor, "A2", {500, 1000});
+        for (size_t first : {10, 400, 150, 260, 20})
+        {
+            IndexRange Ainds = {{first, first + 50}, {0, 1000}};
+            IndexRange Binds = {{0, 50}, {0, 1000}};
+            for (Tensor *A : {&A1, &A2})
+                A->slice(B, Ainds, Binds, alpha, beta);
+        }
+        for (Tensor *A : {&A1, &A2})
+            A->scale(beta + 1.0);
+
+        Tensor A3 = Tensor::build(CoreTensor, "A3", {500, 1000});
+        A3.copy(A2);
+        diff = relative_difference(A3, A1);
+        settings::disk_cache_size = 8L * sizeof(double) * 131072L;
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            A3.zero();
+            A3.copy(A2);
+            diff = std::max(diff, relative_difference(A3, A1));
+        }
+
+        // Turning the cache off writes its tiles back on the next miss
+        A2.slice(B, {{300, 350}, {0, 1000}}, {{0, 50}, {0, 1000}}, 1.0, 0.0);
+        A1.slice(B, {{300, 350}, {0, 1000}}, {{0, 50}, {0, 1000}}, 1.0, 0.0);
+        settings::disk_cache_size = 0L;
+        A3.copy(A2);
+        diff = std::max(diff, relative_difference(A3, A1));
+        const double *Ap = A2.map_data();
+        const std::vector<double> &A1v = A1.data();
+        for (size_t ind = 0L; ind < A1.numel(); ind++)
+            diff = std::max(diff, std::fabs(Ap[ind] - A1v[ind]));
+        A2.unmap_data();
+    }
+    settings::disk_cache_size = cache_size;
+    // The tiles of a freed tensor are no longer charged
+    if (memory::usage()["DiskTensor tiles"].live != 0L)
+        return 1.0;
+    return diff;
+}
+double try_disk_contract_core()
+{
+    // A core result with one disk operand goes through the same engine
+    size_t ni = 8, nj = 7, nk = 9;
+    Tensor A1 = Tensor::build(CoreTensor, "A1", {ni, nk});
+    Tensor B = Tensor::build(CoreTensor, "B", {nk, nj});
+    Tensor C1 = Tensor::build(CoreTensor, "C1", {ni, nj});
+    Tensor C2 = Tensor::build(CoreTensor, "C2", {ni, nj});
+    initialize_random(A1);
+    initialize_random(B);
+    initialize_random(C1, C2);
+    Tensor A2 = Tensor::build(DiskTensor, "A2", {ni, nk});
+    A2.copy(A1);
+
+    size_t memory_limit = settings::memory_limit;
+    settings::memory_limit = 6L * sizeof(double) * 16L;
+    C2.contract(A2, B, {"i", "j"}, {"i", "k"}, {"k", "j"}, alpha, beta);
+    settings::memory_limit = memory_limit;
+
+    C1.contract(A1, B, {"i", "j"}, {"i", "k"}, {"k", "j"}, alpha, beta);
+    return relative_difference(C2, C1);
+}
+double try_lazy_contract()
+{
+    // A generated operand is contracted tile by tile and batch by batch, and
+    // a slice of it generates only its box
+    size_t ni = 6, nj = 5, na = 7, nk = 4;
+    auto element = [](size_t i, size_t j, size_t a) {
+        return 1.0 / (1.0 + i + 0.5 * j + 0.25 * a);
+    };
+    size_t generated = 0L;
+    Tensor L = Tensor::build_lazy(
+        "L", {ni, nj, na}, [&](const IndexRange &box, double *buffer) {
+            for (size_t i = box[0][0]; i < box[0][1]; ++i)
+                for (size_t j = box[1][0]; j < box[1][1]; ++j)
+                    for (size_t a = box[2][0]; a < box[2][1]; ++a)
+                        *buffer++ = element(i, j, a);
+            generated += (box[0][1] - box[0][0]) * (box[1][1] - box[1][0]) *
+                         (box[2][1] - box[2][0]);
+        });
+    Tensor D = Tensor::build(CoreTensor, "D", {ni, nj, na});
+    D.iterate([&](const std::vector<size_t> &indices, double &value) {
+        value = element(indices[0], indices[1], indices[2]);
+    });
+
+    Tensor B = Tensor::build(CoreTensor, "B", {na, nk});
+    Tensor C1 = Tensor::build(CoreTensor, "C1", {ni, nj, nk});
+    Tensor C2 = Tensor::build(CoreTensor, "C2", {ni, nj, nk});
+    Tensor C3 = Tensor::build(CoreTensor, "C3", {ni, nj, nk});
+    initialize_random(B);
+    initialize_random(C1, C2);
+    C3.copy(C1);
+
+    size_t memory_limit = settings::memory_limit;
+    settings::memory_limit = 6L * sizeof(double) * 40L;
+    C2.contract(L, B, {"i", "j", "k"}, {"i", "j", "a"}, {"a", "k"}, alpha,
+                beta);
+    C3.scale(beta);
+    C3("ijk") += batched("i", alpha * L("ija") * B("ak"));
+    settings::memory_limit = memory_limit;
+    C1.contract(D, B, {"i", "j", "k"}, {"i", "j", "a"}, {"a", "k"}, alpha,
+                beta);
+    double diff =
+        std::max(relative_difference(C2, C1), relative_difference(C3, C1));
+
+    Tensor S1 = Tensor::build(CoreTensor, "S1", {2, nj, 3});
+    Tensor S2 = Tensor::build(CoreTensor, "S2", {2, nj, 3});
+    generated = 0L;
+    S2.slice(L, {{0, 2}, {0, nj}, {0, 3}}, {{3, 5}, {0, nj}, {2, 5}});
+    if (generated != S2.numel())
+        throw std::runtime_error("A slice of L generated " +
+                                 std::to_string(generated) + " elements");
+    S1.slice(D, {{0, 2}, {0, nj}, {0, 3}}, {{3, 5}, {0, nj}, {2, 5}});
+    diff = std::max(diff, relative_difference(S2, S1));
+    return std::max(diff, std::fabs(L.norm(2) - D.norm(2)));
+}
+PackedTensor build_random_packed(const string &name, const Dimension &dims,
+                                 const vector<PairSymmetry> &pairs)
+{
+    PackedTensor T = PackedTensor::build(CoreTensor, name, dims, pairs);
+    Tensor storage = T.packed();
+    initialize_random(storage);
+    return T;
+}
+/// Contracts the expanded tensors and checks C against the packed triangle
+/// of the full result
+double check_packed_contract(const PackedTensor &A, const PackedTensor &B,
+                             const Indices &Cinds, const Indices &Ainds,
+                             const Indices &Binds, const Dimension &Cdims,
+                             const vector<PairSymmetry> &Cpairs)
+{
+    PackedTensor C1 = build_random_packed("C1", Cdims, Cpairs);
+    Tensor C2 = C1.expand();
+    C1.contract(A, B, Cinds, Ainds, Binds, alpha, beta);
+    C2.contract(A.expand(), B.expand(), Cinds, Ainds, Binds, alpha, beta);
+
+    PackedTensor C3 = PackedTensor::build(CoreTensor, "C3", Cdims, Cpairs);
+    C3.pack(C2);
+    return relative_difference(C1.packed(), C3.packed());
+}
+double try_packed_expand()
+{
+    size_t no = 4, nv = 5;
+    PackedTensor A =
+        build_random_packed("A", {no, no, nv, nv}, {{0, -1}, {2, 1}});
+    Tensor F = A.expand();
+    std::vector<double> &Fv = F.data();
+
+    // The expanded tensor carries the declared symmetries
+    double diff = 0.0;
+    for (size_t i = 0; i < no; i++)
+        for (size_t j = 0; j < no; j++)
+            for (size_t a = 0; a < nv; a++)
+                for (size_t b = 0; b < nv; b++)
+                {
+                    double ijab = Fv[((i * no + j) * nv + a) * nv + b];
+                    double jiab = Fv[((j * no + i) * nv + a) * nv + b];
+                    double ijba = Fv[((i * no + j) * nv + b) * nv + a];
+                    diff = std::max(diff, std::fabs(ijab + jiab));
+                    diff = std::max(diff, std::fabs(ijab - ijba));
+                }
+
+    PackedTensor B = PackedTensor::build(CoreTensor, "B", {no, no, nv, nv},
+                                         {{0, -1}, {2, 1}});
+    B.pack(F);
+    return std::max(diff, relative_difference(A.packed(), B.packed()));
+}
+double try_packed_permute()
+{
+    size_t no = 4, nv = 5;
+    PackedTensor A =
+        build_random_packed("A", {no, no, nv, nv}, {{0, -1}, {2, -1}});
+    PackedTensor C1 =
+        build_random_packed("C1", {nv, nv, no, no}, {{0, -1}, {2, -1}});
+    Tensor C2 = C1.expand();
+
+    C1.permute(A, {"b", "a", "i", "j"}, {"i", "j", "a", "b"}, alpha, beta);
+    C2.permute(A.expand(), {"b", "a", "i", "j"}, {"i", "j", "a", "b"}, alpha,
+               beta);
+
+    PackedTensor C3 = PackedTensor::build(CoreTensor, "C3", {nv, nv, no, no},
+                                          {{0, -1}, {2, -1}});
+    C3.pack(C2);
+    return relative_difference(C1.packed(), C3.packed());
+}
+double try_packed_contract1()
+{
+    // C(ijab) = V(ijcd) T(cdab), summed over the c < d triangle only
+    size_t no = 4, nv = 5;
+    PackedTensor V =
+        build_random_packed("V", {no, no, nv, nv}, {{0, -1}, {2, -1}});
+    PackedTensor T =
+        build_random_packed("T", {nv, nv, nv, nv}, {{0, -1}, {2, -1}});
+    return check_packed_contract(V, T, {"i", "j", "a", "b"},
+                                 {"i", "j", "c", "d"}, {"c", "d", "a", "b"},
+                                 {no, no, nv, nv}, {{0, -1}, {2, -1}});
+}
+double try_packed_contract2()
+{
+    // Pairs labelled opposite to C, with unpaired contracted indices
+    size_t no = 4, nv = 5;
+    PackedTensor A = build_random_packed("A", {no, no, no, nv}, {{0, -1}});
+    PackedTensor B = build_random_packed("B", {no, nv, nv, nv}, {{2, -1}});
+    return check_packed_contract(A, B, {"i", "j", "a", "b"},
+                                 {"j", "i", "k", "c"}, {"k", "c", "b", "a"},
+                                 {no, no, nv, nv}, {{0, -1}, {2, -1}});
+}
+double try_packed_contract3()
+{
+    // A contracted symmetric pair, whose diagonal is counted once
+    size_t no = 4, nv = 5;
+    PackedTensor A = build_random_packed("A", {no, nv, nv}, {{1, 1}});
+    PackedTensor B = build_random_packed("B", {nv, nv, no}, {{0, 1}});
+    return check_packed_contract(A, B, {"i", "j"}, {"i", "c", "d"},
+                                 {"c", "d", "j"}, {no, no}, {});
+}
+double try_packed_contract4()
+{
+    // The pairs of C are split between A and B, so the operands are expanded
+    size_t no = 4, nv = 5;
+    PackedTensor A = build_random_packed("A", {no, nv, nv}, {});
+    PackedTensor B = build_random_packed("B", {nv, no, nv}, {});
+    return check_packed_contract(A, B, {"i", "j", "a", "b"},
+                                 {"i", "a", "c"}, {"c", "j", "b"},
+                                 {no, no, nv, nv}, {{0, -1}, {2, -1}});
+}
+Tensor build_random(const string &name, const Dimension &dims)
+{
+    Tensor T = Tensor::build(CoreTensor, name, dims);
+    initialize_random(T);
+    return T;
+}
+/// (pq|rs) = sum_Q B(Q,pq) B(Q,rs), positive semidefinite of rank nQ
+Tensor build_low_rank_eri(TensorType type, size_t n, size_t nQ)
+{
+    Tensor B = build_random("B", {nQ, n, n});
+    Tensor V = Tensor::build(type, "V", {n, n, n, n});
+    V("pqrs") = B("Qpq") * B("Qrs");
+    return V;
+}
+double try_factorized_cholesky()
+{
+    size_t n = 5, nQ = 7;
+    double diff = 0.0;
+    for (TensorType type : {CoreTensor, DiskTensor})
+    {
+        Tensor V = build_low_rank_eri(type, n, nQ);
+        FactorizedTensor F = FactorizedTensor::cholesky(V, 1.0E-12);
+        if (F.size() > nQ || F.right() != F.left())
+            return 1.0;
+        diff = std::max(diff, relative_difference(F.expand(),
+                                                  V.clone(CoreTensor)));
+    }
+    return diff;
+}
+double try_factorized_svd()
+{
+    // A rank-3 tensor T(ia,jb) = sum_Q X(Q,ia) Y(Q,jb)
+    size_t no = 4, nv = 5;
+    Tensor X = build_random("X", {3, no, nv});
+    Tensor Y = build_random("Y", {3, no, nv});
+    Tensor T = Tensor::build(CoreTensor, "T", {no, nv, no, nv});
+    T("iajb") = X("Qia") * Y("Qjb");
+
+    FactorizedTensor F = FactorizedTensor::svd(T, 2, 1.0E-10);
+    if (F.size() != 3)
+        return 1.0;
+    return relative_difference(F.expand(), T);
+}
+double try_factorized_contract()
+{
+    size_t n = 5, nQ = 7;
+    Tensor V = build_low_rank_eri(CoreTensor, n, nQ);
+    FactorizedTensor F = FactorizedTensor::cholesky(V, 1.0E-12);
+    Tensor Vfull = F.expand();
+
+    // J(pq) = (pq|rs) D(rs) and K(pq) = (pr|qs) D(rs)
+    Tensor D = build_random("D", {n, n});
+    double diff = 0.0;
+    for (const Indices &Vinds : {Indices{"p", "q", "r", "s"},
+                                 Indices{"p", "r", "q", "s"}})
+    {
+        Tensor C1 = build_random("C1", {n, n});
+        Tensor C2 = C1.clone();
+        F.contract(C1, D, {"p", "q"}, Vinds, {"r", "s"}, alpha, beta);
+        C2.contract(Vfull, D, {"p", "q"}, Vinds, {"r", "s"}, alpha, beta);
+        diff = std::max(diff, relative_difference(C1, C2));
+    }
+    return diff;
+}
+/// The part of a relative difference beyond single-precision rounding
+double beyond_float_rounding(double diff)
+{
+    return std::max(0.0, diff - 1.0E-5);
+}
+double try_float_round_trip()
+{
+    Tensor A = build_random("A", {6, 5, 4});
+    double diff = 0.0;
+    for (TensorType type : {CoreTensor, DiskTensor})
+    {
+        FloatTensor F = FloatTensor::build(type, A);
+        diff = std::max(diff, relative_difference(F.to_double(), A));
+
+        // C = alpha * A + beta * C
+        Tensor C = build_random("C", {6, 5, 4});
+        F.assign(C);
+        F.assign(A, alpha, beta);
+        Tensor R = C.clone();
+        R.scale(beta);
+        R("ijk") += alpha * A("ijk");
+        Tensor D = Tensor::build(CoreTensor, "D", {6, 5, 4});
+        D.copy(F.to_double(type));
+        diff = std::max(diff, relative_difference(D, R));
+    }
+    return beyond_float_rounding(diff);
+}
+double try_float_contract()
+{
+    size_t no = 4, nv = 7;
+    Tensor A = build_random("A", {no, nv, no, nv});
+    Tensor B = build_random("B", {nv, no, no});
+    Tensor C = build_random("C", {nv, no, no});
+    FloatTensor Af = FloatTensor::build(DiskTensor, A);
+    FloatTensor Bf = FloatTensor::build(CoreTensor, B);
+    FloatTensor Cf = FloatTensor::build(CoreTensor, C);
+
+    Cf.contract(Af, Bf, {"a", "j", "i"}, {"i", "a", "k", "c"},
+                {"c", "k", "j"}, alpha, beta);
+    C.contract(A, B, {"a", "j", "i"}, {"i", "a", "k", "c"}, {"c", "k", "j"},
+               alpha, beta);
+    return beyond_float_rounding(relative_difference(Cf.to_double(), C));
+}
+double try_float_contract_mixed()
 {
-    std::vector<size_t> dims;
-    dims.push_back(3);
-    dims.push_back(4);
-    dims.push_back(5);
-
-    size_t ni = 3;
-    size_t nj = 4;
-    size_t nk = 5;
-
-    Tensor A = Tensor::build(CoreTensor, "A", {dims[a_dim[0]], dims[a_dim[1]]});
-    initialize_random(A);
-    Tensor B = Tensor::build(CoreTensor, "B", {dims[b_dim[0]], dims[b_dim[1]]});
-    initialize_random(B);
-    Tensor C1 =
-        Tensor::build(CoreTensor, "C1", {dims[c_dim[0]], dims[c_dim[1]]});
-    Tensor C2 =
-        Tensor::build(CoreTensor, "C2", {dims[c_dim[0]], dims[c_dim[1]]});
-    initialize_random(C1, C2);
-
-    std::vector<std::string> c_inds = {std::string(1, c_ind[0]),
-                                       std::string(1, c_ind[1])};
-    std::vector<std::string> a_inds = {std::string(1, a_ind[0]),
-                                       std::string(1, a_ind[1])};
-    std::vector<std::string> b_inds = {std::string(1, b_ind[0]),
-                                       std::string(1, b_ind[1])};
-
-    if (mode == 0)
-        C1.contract(A, B, c_inds, a_inds, b_inds, alpha, beta);
-    else if (mode == 1)
-        C1(c_ind) = A(a_ind) * B(b_ind);
-    else if (mode == 2)
-        C1(c_ind) += A(a_ind) * B(b_ind);
-    else if (mode == 3)
-        C1(c_ind) -= A(a_ind) * B(b_ind);
-    else
-        throw std::runtime_error("Bad mode.");
-
-    C2.scale(beta);
-    std::vector<double> &Av = A.data();
-    std::vector<double> &Bv = B.data();
-    std::vector<double> &Cv = C2.data();
-    std::vector<size_t> n(3);
-    for (n[0] = 0; n[0] < ni; ++n[0])
+    // A contraction long enough to take several single-precision chunks
+    size_t ni = 6, nk = 700;
+    Tensor A = build_random("A", {nk, ni});
+    Tensor B = build_random("B", {ni, nk});
+    FloatTensor Af = FloatTensor::build(CoreTensor, A);
+    FloatTensor Bf = FloatTensor::build(CoreTensor, B);
+
+    // Against the double-precision product of the rounded elements
+    Tensor C1 = build_random("C1", {ni, ni});
+    Tensor C2 = C1.clone();
+    FloatTensor::contract_mixed(C1, Af, Bf, {"j", "i"}, {"k", "i"},
+                                {"j", "k"}, alpha, beta);
+    C2.contract(Af.to_double(), Bf.to_double(), {"j", "i"}, {"k", "i"},
+                {"j", "k"}, alpha, beta);
+    return beyond_float_rounding(relative_difference(C1, C2));
+}
+#if defined(HAVE_CUDA)
+double try_gpu_slice()
+{
+    Tensor A = build_random("A", {9, 7, 5});
+    Tensor G = Tensor::build(GpuTensor, "G", {9, 7, 5});
+    G.copy(A);
+
+    // A box of A scaled onto the device and back
+    IndexRange box = {{2, 8}, {1, 7}, {0, 5}};
+    Tensor C = build_random("C", {9, 7, 5});
+    Tensor R = C.clone();
+    C.slice(G, box, box, alpha, beta);
+    R.slice(A, box, box, alpha, beta);
+    return relative_difference(C, R);
+}
+double try_gpu_contract()
+{
+    size_t no = 4, nv = 7;
+    Tensor A = build_random("A", {no, nv, no, nv});
+    Tensor B = build_random("B", {nv, no, no});
+    Tensor C = build_random("C", {nv, no, no});
+    Tensor Ag = A.clone(GpuTensor);
+    Tensor Bg = B.clone(GpuTensor);
+    Tensor Cg = C.clone(GpuTensor);
+
+    Cg.contract(Ag, Bg, {"a", "j", "i"}, {"i", "a", "k", "c"},
+                {"c", "k", "j"}, alpha, beta);
+    C.contract(A, B, {"a", "j", "i"}, {"i", "a", "k", "c"}, {"c", "k", "j"},
+               alpha, beta);
+    return relative_difference(Cg.clone(CoreTensor), C);
+}
+#endif
+double try_graph_shared()
+{
+    size_t no = 4, nv = 6;
+    Tensor V = build_random("V", {no, no, nv, nv});
+    Tensor T2 = build_random("T2", {no, no, nv, nv});
+    Tensor W2 = build_random("W2", {no, no, nv, nv});
+    Tensor R1 = build_random("R1", {no, no, nv, nv});
+    Tensor R2 = build_random("R2", {no, no, nv, nv});
+    Tensor S1 = R1.clone();
+    Tensor S2 = R2.clone();
+
+    // Both products share V("mnef") * T2("ijef") up to the index names
+    S1("ijab") = V("mnef") * T2("ijef") * T2("mnab");
+    S2("ijab") += 0.5 * V("klcd") * T2("ijcd") * W2("lkba");
+
+    Graph g;
+    g.begin();
+    R1("ijab") = V("mnef") * T2("ijef") * T2("mnab");
+    R2("ijab") += 0.5 * V("klcd") * T2("ijcd") * W2("lkba");
+    g.execute();
+
+    if (g.size() != 0L || g.shared_products() != 1L)
+        throw std::runtime_error("The shared product was not reused.");
+    return std::max(relative_difference(R1, S1), relative_difference(R2, S2));
+}
+double try_graph_ordering()
+{
+    size_t ni = 5, nj = 6, nk = 7;
+    Tensor A = build_random("A", {ni, nk});
+    Tensor B = build_random("B", {nk, nj});
+    Tensor C = build_random("C", {nj, ni});
+    Tensor D1 = build_random("D1", {ni, ni});
+    Tensor D2 = build_random("D2", {ni, ni});
+    Tensor E1 = D1.clone();
+    Tensor E2 = D2.clone();
+
+    // The write to B separates the two uses of A("ik") * B("kj")
+    E1("il") = A("ik") * B("kj") * C("jl");
+    B("kj") *= 2.0;
+    E2("il") -= A("ik") * B("kj") * C("jl");
+    E1("il") += E2("li");
+
+    Tensor B0 = B.clone();
+    B0.scale(0.5);
+    B("kj") = B0("kj");
+
+    Graph g;
+    g.begin();
+    D1("il") = A("ik") * B("kj") * C("jl");
+    B("kj") *= 2.0;
+    D2("il") -= A("ik") * B("kj") * C("jl");
+    D1("il") += D2("li");
+    g.execute();
+
+    if (g.shared_products() != 0L)
+        throw std::runtime_error("A product was reused across a write.");
+    return std::max(relative_difference(D1, E1), relative_difference(D2, E2));
+}
+double try_graph_concurrent()
+{
+    size_t ni = 6, nj = 7, nk = 8, nstatements = 8;
+    Tensor B = build_random("B", {nk, nj});
+    vector<Tensor> A, C, E;
+    for (size_t n = 0; n < nstatements; ++n)
     {
-        for (n[1] = 0; n[1] < nj; ++n[1])
-        {
-            for (n[2] = 0; n[2] < nk; ++n[2])
-            {
-                size_t aind1 = n[a_dim[0]];
-                size_t aind2 = n[a_dim[1]];
-                size_t bind1 = n[b_dim[0]];
-                size_t bind2 = n[b_dim[1]];
-                size_t cind1 = n[c_dim[0]];
-                size_t cind2 = n[c_dim[1]];
-                Cv[cind1 * dims[c_dim[1]] + cind2] +=
-                    alpha * Av[aind1 * dims[a_dim[1]] + aind2] *
-                    Bv[bind1 * dims[b_dim[1]] + bind2];
-            }
-        }
+        A.push_back(build_random("A", {ni, nk}));
+        C.push_back(build_random("C", {ni, nj}));
+        E.push_back(C[n].clone());
     }
-
-    return relative_difference(C1, C2);
+    Tensor D = build_random("D", {nj, ni});
+    Tensor F = D.clone();
+
+    // Independent products, then a sum that depends on all of them
+    for (size_t n = 0; n < nstatements; ++n)
+        E[n]("ij") += A[n]("ik") * B("kj");
+    for (size_t n = 0; n < nstatements; ++n)
+        F("ji") += E[n]("ij");
+
+    Graph g;
+    g.begin();
+    for (size_t n = 0; n < nstatements; ++n)
+        C[n]("ij") += A[n]("ik") * B("kj");
+    for (size_t n = 0; n < nstatements; ++n)
+        D("ji") += C[n]("ij");
+    g.execute();
+
+    double diff = relative_difference(D, F);
+    for (size_t n = 0; n < nstatements; ++n)
+        diff = std::max(diff, relative_difference(C[n], E[n]));
+    return diff;
 }
-double try_contract_gemm1()
+double try_graph_direct_calls()
 {
-    return try_C_equal_A_B("ij", "ik", "jk", {0, 1}, {0, 2}, {1, 2});
+    // Direct calls (and static expressions) on tensors of recorded
+    // statements see them in program order
+    using namespace ambit::labels;
+    size_t ni = 5, nj = 6, nk = 7;
+    Tensor A = build_random("A", {ni, nk});
+    Tensor B = build_random("B", {nk, nj});
+    Tensor C = Tensor::build(CoreTensor, "C", {ni, nj});
+    Tensor D = Tensor::build(CoreTensor, "D", {ni, nj});
+    Tensor E = Tensor::build(CoreTensor, "E", {nj, ni});
+    Tensor F = Tensor::build(CoreTensor, "F", {ni, nj});
+    Tensor R = Tensor::build(CoreTensor, "R", {ni, nj});
+    R("ij") = A("ik") * B("kj");
+
+    Graph g;
+    g.begin();
+    C("ij") = A("ik") * B("kj");
+    D.copy(C);
+    C.scale(2.0);
+    C("ij") += A("ik") * B("kj");
+    E(_j, _i) = C(_i, _j);
+    F("ij") = A("ik") * B("kj");
+    A.scale(0.0);
+    g.execute();
+
+    double diff = relative_difference(D, R);
+    diff = std::max(diff, relative_difference(F, R));
+    R.scale(3.0);
+    diff = std::max(diff, relative_difference(C, R));
+    Tensor Et = Tensor::build(CoreTensor, "Et", {ni, nj});
+    Et("ij") = E("ji");
+    return std::max(diff, relative_difference(Et, R));
 }
-double try_contract_gemm2()
+double try_graph_scalar_fail()
 {
-    return try_C_equal_A_B("ij", "ik", "kj", {0, 1}, {0, 2}, {2, 1});
+    Tensor A = build_random("A", {4, 5});
+    Tensor B = build_random("B", {4, 5});
+    Graph g;
+    g.begin();
+    double value = A("ij") * B("ij");
+    return value;
 }
-double try_contract_gemm3()
+std::string read_file(const std::string &filename)
 {
-    return try_C_equal_A_B("ij", "ki", "jk", {0, 1}, {2, 0}, {1, 2});
+    std::ifstream in(filename);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
 }
-double try_contract_gemm4()
+double try_static_expression()
 {
-    return try_C_equal_A_B("ij", "ki", "kj", {0, 1}, {2, 0}, {2, 1});
+    using namespace ambit::labels;
+    Tensor A = build_random("A", {20, 30});
+    Tensor B = build_random("B", {30, 40});
+    Tensor D = build_random("D", {40, 20});
+    Tensor C1 = Tensor::build(CoreTensor, "C1", {20, 40});
+    Tensor C2 = Tensor::build(CoreTensor, "C2", {20, 40});
+
+    C1("ij") = A("ik") * B("kj");
+    C1("ij") += 0.5 * D("ji");
+    C1("ij") -= 2.0 * A("ik") * B("kj");
+    C1("ij") += D("ji");
+    C2(_i, _j) = A(_i, _k) * B(_k, _j);
+    C2(_i, _j) += 0.5 * D(_j, _i);
+    C2(_i, _j) -= 2.0 * A(_i, _k) * B(_k, _j) - D(_j, _i);
+    double diff = relative_difference(C1, C2);
+
+    Tensor E1 = Tensor::build(CoreTensor, "E1", {40, 20});
+    Tensor E2 = Tensor::build(CoreTensor, "E2", {40, 20});
+    E1("ji") = -1.0 * C1("ij");
+    E1("ji") += 3.0 * B("kj") * A("ik");
+    E2(_j, _i) = -C2(_i, _j) + B(_k, _j) * A(_i, _k) * 3.0;
+    return std::max(diff, relative_difference(E1, E2));
 }
-double try_contract_gemm5()
+double try_static_expression_self()
 {
-    return try_C_equal_A_B("ji", "ik", "jk", {1, 0}, {0, 2}, {1, 2});
+    using namespace ambit::labels;
+    Tensor A = build_random("A", {20, 20});
+    A(_i, _j) = 2.0 * A(_j, _i);
+    return 0.0;
 }
-double try_contract_gemm6()
+double try_timer_export()
 {
-    return try_C_equal_A_B("ji", "ik", "kj", {1, 0}, {0, 2}, {2, 1});
+#if defined(AMBIT_DISABLE_TIMERS)
+    return 0.0;
+#endif
+    Tensor A = build_random("A", {20, 30});
+    Tensor B = build_random("B", {30, 40});
+    Tensor C = Tensor::build(CoreTensor, "C", {20, 40});
+
+    settings::timers = true;
+    settings::timer_trace = true;
+    C("ij") = A("ik") * B("kj");
+    timer::report_json("test_timer_report.json");
+    timer::write_trace("test_timer_trace.json");
+    settings::timers = false;
+    settings::timer_trace = false;
+
+    std::string report = read_file("test_timer_report.json");
+    std::string trace = read_file("test_timer_trace.json");
+    std::remove("test_timer_report.json");
+    std::remove("test_timer_trace.json");
+
+    // The GEMM is charged 2 * 20 * 30 * 40 floating point operations
+    bool found = report.find("\"name\": \"BLAS\"") != std::string::npos &&
+                 report.find("\"flops\": 48000") != std::string::npos &&
+                 trace.find("\"traceEvents\"") != std::string::npos &&
+                 trace.find("\"ph\": \"X\"") != std::string::npos;
+    return found ? 0.0 : 1.0;
 }
-double try_contract_gemm7()
+double try_timer_counters()
 {
-    return try_C_equal_A_B("ji", "ki", "jk", {1, 0}, {2, 0}, {1, 2});
+#if defined(AMBIT_DISABLE_TIMERS)
+    return 0.0;
+#endif
+    Tensor A = build_random("A", {200, 300});
+    Tensor B = build_random("B", {300, 400});
+    Tensor C = Tensor::build(CoreTensor, "C", {200, 400});
+
+    settings::timers = true;
+    settings::timer_counters = true;
+    C("ij") = A("ik") * B("kj");
+    timer::report_json("test_timer_counters.json");
+    settings::timers = false;
+    settings::timer_counters = false;
+
+    std::string report = read_file("test_timer_counters.json");
+    std::remove("test_timer_counters.json");
+
+    // Without a PMU (or permission) the report has no counts
+    bool counted = report.find("\"instructions\": ") != std::string::npos;
+    return counted == timer::counters_available() ? 0.0 : 1.0;
 }
-double try_contract_gemm8()
+double try_call_trace()
 {
-    return try_C_equal_A_B("ji", "ki", "kj", {1, 0}, {2, 0}, {2, 1});
+    Tensor A = build_random("A", {20, 30});
+    Tensor B = build_random("B", {30, 40});
+    Tensor C = Tensor::build(CoreTensor, "C", {20, 40});
+    Tensor D = Tensor::build(CoreTensor, "D", {30, 20});
+
+    call_trace::start("test_call_trace.trace");
+    C("ij") = 0.5 * A("ik") * B("kj");
+    D("ki") = A("ik");
+    C({{0, 20}, {0, 30}}) = A({{0, 20}, {0, 30}});
+    call_trace::stop();
+    C("ij") = A("ik") * B("kj");
+
+    vector<call_trace::Call> calls = call_trace::read("test_call_trace.trace");
+    std::remove("test_call_trace.trace");
+
+    if (calls.size() != 3 || calls[0].kind != "contract" ||
+        calls[1].kind != "permute" || calls[2].kind != "slice")
+        return 1.0;
+    // The contraction reads back with its shapes, labels and factors
+    const call_trace::Call &call = calls[0];
+    bool same = call.alpha == 0.5 && call.beta == 0.0 &&
+                call.dims[1] == A.dims() && call.dims[2] == B.dims() &&
+                call.indices[0] == Indices({"i", "j"}) &&
+                call.indices[2] == Indices({"k", "j"}) &&
+                calls[2].ranges[0] == IndexRange({{0, 20}, {0, 30}});
+    return same ? 0.0 : 1.0;
+}
+double try_memory_accounting()
+{
+    size_t before = memory::live_bytes();
+    double diff = 0.0;
+    {
+        Tensor A = Tensor::build(CoreTensor, "Accounted", {100, 50});
+        diff += std::fabs(double(memory::live_bytes() - before) -
+                          100.0 * 50.0 * sizeof(double));
+        memory::Usage usage = memory::usage()["Accounted"];
+        diff += std::fabs(double(usage.live) - 100.0 * 50.0 * sizeof(double));
+    }
+    diff += std::fabs(double(memory::live_bytes()) - double(before));
+    diff += std::fabs(double(memory::usage()["Accounted"].peak) -
+                      100.0 * 50.0 * sizeof(double));
+    return diff;
+}
+double try_memory_limit_fail()
+{
+    size_t limit = settings::memory_limit;
+    settings::memory_limit = memory::live_bytes() + 1024L;
+    settings::enforce_memory_limit = true;
+    try
+    {
+        Tensor A = Tensor::build(CoreTensor, "Too large", {100, 100});
+    }
+    catch (...)
+    {
+        settings::memory_limit = limit;
+        settings::enforce_memory_limit = false;
+        throw;
+    }
+    settings::memory_limit = limit;
+    settings::enforce_memory_limit = false;
+    return 0.0;
+}
+double try_agnostic_placement()
+{
+    size_t limit = settings::memory_limit;
+    settings::memory_limit = memory::live_bytes() + 1000L * sizeof(double);
+    double diff = 0.0;
+    try
+    {
+        // 800 doubles fit, but a streamed tensor only gets half the room
+        diff += Tensor::choose_type({20, 40}) == CoreTensor ? 0.0 : 1.0;
+        diff += Tensor::choose_type({20, 40}, StreamedAccess) == DiskTensor
+                    ? 0.0
+                    : 1.0;
+        diff += Tensor::choose_type({40, 40}) == DiskTensor ? 0.0 : 1.0;
+
+        Tensor A = Tensor::build(AgnosticTensor, "A", {20, 40});
+        diff += A.type() == CoreTensor ? 0.0 : 1.0;
+        initialize_random(A);
+        Tensor B = A.clone(DiskTensor);
+
+        // Its own memory counts as free, so A stays put while randomly used
+        diff += A.migrate() == CoreTensor ? 0.0 : 1.0;
+        diff += A.migrate(StreamedAccess) == DiskTensor ? 0.0 : 1.0;
+        diff += A.type() == DiskTensor ? 0.0 : 1.0;
+        diff += A.name() == "A" ? 0.0 : 1.0;
+        diff += A.migrate() == CoreTensor ? 0.0 : 1.0;
+        diff += relative_difference(A, B.clone(CoreTensor));
+    }
+    catch (...)
+    {
+        settings::memory_limit = limit;
+        throw;
+    }
+    settings::memory_limit = limit;
+    return diff;
+}
+double try_page_placement()
+{
+    // 2 MB tensors, large enough to be placed
+    settings::PagePlacement placement = settings::page_placement;
+    settings::PagePlacement placements[] = {settings::SerialPlacement,
+                                            settings::ParallelFirstTouch,
+                                            settings::InterleavePlacement};
+    double diff = 0.0;
+    for (settings::PagePlacement p : placements)
+    {
+        settings::page_placement = p;
+        Tensor A = Tensor::build(CoreTensor, "Placed", {512, 512});
+        diff += A.norm(1);
+        A.set(1.0);
+        diff += std::fabs(A.norm(1) - 512.0 * 512.0);
+    }
+    settings::page_placement = placement;
+    return diff;
+}
+double try_spill_to_disk()
+{
+    // Room for two of the three 2 MB tensors
+    size_t limit = settings::memory_limit;
+    settings::memory_limit = memory::live_bytes() + 5L * 1048576L;
+    settings::spill_to_disk = true;
+    settings::enforce_memory_limit = true;
+
+    double diff = 0.0;
+    try
+    {
+        Tensor A = Tensor::build(CoreTensor, "Spill A", {512, 512});
+        Tensor B = Tensor::build(CoreTensor, "Spill B", {512, 512});
+        A.set(1.0);
+        B.set(2.0);
+        Tensor C = Tensor::build(CoreTensor, "Spill C", {512, 512});
+        C("ij") = A("ij") + B("ij");
+        diff += std::fabs(C.norm(1) - 3.0 * 512.0 * 512.0);
+        diff += std::fabs(A.norm(1) - 512.0 * 512.0);
+        diff += std::fabs(B.norm(1) - 2.0 * 512.0 * 512.0);
+    }
+    catch (...)
+    {
+        settings::memory_limit = limit;
+        settings::spill_to_disk = false;
+        settings::enforce_memory_limit = false;
+        throw;
+    }
+    settings::memory_limit = limit;
+    settings::spill_to_disk = false;
+    settings::enforce_memory_limit = false;
+    return diff;
+}
+double try_spill_compressed()
+{
+    settings::disk_compression = true;
+    double diff = 0.0;
+    try
+    {
+        diff = try_spill_to_disk();
+    }
+    catch (...)
+    {
+        settings::disk_compression = false;
+        throw;
+    }
+    settings::disk_compression = false;
+    return diff;
 }
 double try_contract_label_fail()
 {
@@ -2460,9 +4744,11 @@ int main(int argc, char *argv[])
     success &= test_function(try_1_norm, "1-Norm", kEpsilon);
     success &= test_function(try_2_norm, "2-Norm", kEpsilon);
     success &= test_function(try_inf_norm, "Inf-Norm", kEpsilon);
+    success &= test_function(try_stats, "Stats", kExact);
     success &= test_function(try_zero, "Zero", kExact);
     success &= test_function(try_copy, "Copy", kExact);
     success &= test_function(try_scale, "Scale", kExact);
+    success &= test_function(try_for_each, "For each", kEpsilon);
     printf("%s\n", std::string(82, '-').c_str());
     printf("Tests: %s\n\n", success ? "All passed" : "Some failed");
 
@@ -2515,6 +4801,12 @@ int main(int argc, char *argv[])
         test_function(try_slice_rank3_diff3, "Slice Rank-3 Diff 3", kExact);
     success &=
         test_function(try_slice_rank3_diff4, "Slice Rank-3 Diff 4", kExact);
+    success &= test_function(try_slice_long_runs, "Slice Long Runs", kEpsilon);
+    success &=
+        test_function(try_slice_short_runs, "Slice Short Runs", kEpsilon);
+    success &= test_function(try_cat, "Cat", kEpsilon);
+    success &= test_function(try_slice_scatter_gather, "Slice Scatter/Gather",
+                             kEpsilon);
     mode = 0;
     alpha = random_double();
     beta = random_double();
@@ -2559,6 +4851,9 @@ int main(int argc, char *argv[])
         test_function(try_slice_rank3_diff3, "Slice Rank-3 Diff 3", kExact);
     success &=
         test_function(try_slice_rank3_diff4, "Slice Rank-3 Diff 4", kExact);
+    success &= test_function(try_slice_long_runs, "Slice Long Runs", kEpsilon);
+    success &=
+        test_function(try_slice_short_runs, "Slice Short Runs", kEpsilon);
     mode = 1;
     alpha = 1.0;
     beta = 0.0;
@@ -2603,6 +4898,9 @@ int main(int argc, char *argv[])
         test_function(try_slice_rank3_diff3, "Slice Rank-3 Diff 3", kExact);
     success &=
         test_function(try_slice_rank3_diff4, "Slice Rank-3 Diff 4", kExact);
+    success &= test_function(try_slice_long_runs, "Slice Long Runs", kEpsilon);
+    success &=
+        test_function(try_slice_short_runs, "Slice Short Runs", kEpsilon);
     mode = 2;
     alpha = 1.0;
     beta = 1.0;
@@ -2647,6 +4945,9 @@ int main(int argc, char *argv[])
         test_function(try_slice_rank3_diff3, "Slice Rank-3 Diff 3", kExact);
     success &=
         test_function(try_slice_rank3_diff4, "Slice Rank-3 Diff 4", kExact);
+    success &= test_function(try_slice_long_runs, "Slice Long Runs", kEpsilon);
+    success &=
+        test_function(try_slice_short_runs, "Slice Short Runs", kEpsilon);
     mode = 3;
     alpha = -1.0;
     beta = 1.0;
@@ -2691,6 +4992,9 @@ int main(int argc, char *argv[])
         test_function(try_slice_rank3_diff3, "Slice Rank-3 Diff 3", kExact);
     success &=
         test_function(try_slice_rank3_diff4, "Slice Rank-3 Diff 4", kExact);
+    success &= test_function(try_slice_long_runs, "Slice Long Runs", kEpsilon);
+    success &=
+        test_function(try_slice_short_runs, "Slice Short Runs", kEpsilon);
     printf("%s\n", std::string(82, '-').c_str());
     printf("Tests: %s\n\n", success ? "All Passed" : "Some Failed");
 
@@ -2713,6 +5017,7 @@ int main(int argc, char *argv[])
         test_function(try_slice_size_fail, "Slice Size Fail", kException);
     success &=
         test_function(try_slice_bounds_fail, "Slice Bounds Fail", kException);
+    success &= test_function(try_cat_dims_fail, "Cat Dims Fail", kException);
     printf("%s\n", std::string(82, '-').c_str());
     printf("Tests: %s\n\n", success ? "All Passed" : "Some Failed");
 
@@ -2747,6 +5052,10 @@ int main(int argc, char *argv[])
         test_function(try_permute_rank4_ijkl, "Permute Rank-4 ijkl", kExact);
     success &=
         test_function(try_permute_rank4_lkji, "Permute Rank-4 lkji", kExact);
+    success &= test_function(try_permute_rank2_ji_tiled,
+                             "Permute Rank-2 ji (tiled)", kExact);
+    success &= test_function(try_permute_rank4_klij_tiled,
+                             "Permute Rank-4 klij (tiled)", kExact);
     success &=
         test_function(try_permute_rank4_ijlk, "Permute Rank-4 ijlk", kExact);
     success &=
@@ -2755,6 +5064,13 @@ int main(int argc, char *argv[])
         test_function(try_permute_rank4_ikjl, "Permute Rank-4 ikjl", kExact);
     success &=
         test_function(try_permute_rank4_lkji, "Permute Rank-4 lkji", kExact);
+    success &= test_function(try_permute_rank2_ji_tiled,
+                             "Permute Rank-2 ji (tiled)", kExact);
+    success &= test_function(try_permute_rank4_klij_tiled,
+                             "Permute Rank-4 klij (tiled)", kExact);
+    success &= test_function(try_permute_sum, "Permute Sum", kEpsilon);
+    success &= test_function(try_permute_antisymmetrizer,
+                             "Permute Antisymmetrizer", kEpsilon);
     mode = 0;
     alpha = random_double();
     beta = random_double();
@@ -2787,6 +5103,11 @@ int main(int argc, char *argv[])
         test_function(try_permute_rank4_ikjl, "Permute Rank-4 ikjl", kExact);
     success &=
         test_function(try_permute_rank4_lkji, "Permute Rank-4 lkji", kExact);
+    success &= test_function(try_permute_rank2_ji_tiled,
+                             "Permute Rank-2 ji (tiled)", kExact);
+    success &= test_function(try_permute_rank4_klij_tiled,
+                             "Permute Rank-4 klij (tiled)", kExact);
+    success &= test_function(try_permute_sum, "Permute Sum", kEpsilon);
     mode = 1;
     alpha = 1.0;
     beta = 0.0;
@@ -2819,6 +5140,11 @@ int main(int argc, char *argv[])
         test_function(try_permute_rank4_ikjl, "Permute Rank-4 ikjl", kExact);
     success &=
         test_function(try_permute_rank4_lkji, "Permute Rank-4 lkji", kExact);
+    success &= test_function(try_permute_rank2_ji_tiled,
+                             "Permute Rank-2 ji (tiled)", kExact);
+    success &= test_function(try_permute_rank4_klij_tiled,
+                             "Permute Rank-4 klij (tiled)", kExact);
+    success &= test_function(try_permute_sum, "Permute Sum", kEpsilon);
     mode = 2;
     alpha = 1.0;
     beta = 1.0;
@@ -2851,6 +5177,11 @@ int main(int argc, char *argv[])
         test_function(try_permute_rank4_ikjl, "Permute Rank-4 ikjl", kExact);
     success &=
         test_function(try_permute_rank4_lkji, "Permute Rank-4 lkji", kExact);
+    success &= test_function(try_permute_rank2_ji_tiled,
+                             "Permute Rank-2 ji (tiled)", kExact);
+    success &= test_function(try_permute_rank4_klij_tiled,
+                             "Permute Rank-4 klij (tiled)", kExact);
+    success &= test_function(try_permute_sum, "Permute Sum", kEpsilon);
     mode = 3;
     alpha = -1.0;
     beta = 1.0;
@@ -2883,6 +5214,11 @@ int main(int argc, char *argv[])
         test_function(try_permute_rank4_ikjl, "Permute Rank-4 ikjl", kExact);
     success &=
         test_function(try_permute_rank4_lkji, "Permute Rank-4 lkji", kExact);
+    success &= test_function(try_permute_rank2_ji_tiled,
+                             "Permute Rank-2 ji (tiled)", kExact);
+    success &= test_function(try_permute_rank4_klij_tiled,
+                             "Permute Rank-4 klij (tiled)", kExact);
+    success &= test_function(try_permute_sum, "Permute Sum", kEpsilon);
     printf("%s\n", std::string(82, '-').c_str());
     printf("Tests: %s\n\n", success ? "All Passed" : "Some Failed");
 
@@ -2922,6 +5258,24 @@ int main(int argc, char *argv[])
     success &= test_function(try_contract_scalar, "Contract scalar", kEpsilon);
     success &=
         test_function(try_contract_hadamard, "Contract hadamard", kEpsilon);
+    success &= test_function(try_contract_hadamard_mid1,
+                             "Contract hadamard P-middle 1", kEpsilon);
+    success &= test_function(try_contract_hadamard_mid2,
+                             "Contract hadamard P-middle 2", kEpsilon);
+    success &= test_function(try_contract_hadamard_mid3,
+                             "Contract hadamard P-middle 3", kEpsilon);
+    success &= test_function(try_contract_hadamard_shapes,
+                             "Contract hadamard shapes", kEpsilon);
+    success &= test_function(try_contract_hadamard_random,
+                             "Contract hadamard random", kEpsilon);
+    success &= test_function(try_contract_layout_candidates,
+                             "Contract layout candidates", kEpsilon);
+    success &= test_function(try_contract_strided, "Contract strided kernel",
+                             kEpsilon);
+    success &= test_function(try_contract_layouts, "Contract tuned layouts",
+                             kEpsilon);
+    success &= test_function(try_contract_epilogue, "Contract epilogue",
+                             kEpsilon);
     success &= test_function(try_contract_dot, "Contract dot", kEpsilon);
     success &= test_function(try_contract_axpy1, "Contract axpy 1", kEpsilon);
     success &= test_function(try_contract_axpy2, "Contract axpy 2", kEpsilon);
@@ -2939,6 +5293,28 @@ int main(int argc, char *argv[])
     success &= test_function(try_contract_gemm6, "Contract gemm 6", kEpsilon);
     success &= test_function(try_contract_gemm7, "Contract gemm 7", kEpsilon);
     success &= test_function(try_contract_gemm8, "Contract gemm 8", kEpsilon);
+    success &=
+        test_function(try_contract_plan_reuse, "Contract plan reuse", kEpsilon);
+    success &= test_function(try_contract_batch, "Contract batch", kEpsilon);
+    success &= test_function(try_thread_split, "Thread split of batches",
+                             kEpsilon);
+    success &= test_function(try_thread_split_concurrent,
+                             "Thread split concurrent", kEpsilon);
+    success &= test_function(try_contract_scratch, "Contract scratch", kEpsilon);
+    success &= test_function(try_build_uninitialized, "Build uninitialized",
+                             kEpsilon);
+    success &= test_function(try_clone_deep_copy, "Clone deep copy",
+                             kEpsilon);
+    success &=
+        test_function(try_static_expression, "Static expression", kEpsilon);
+    success &= test_function(try_static_expression_self,
+                             "Static expression self", kException);
+    success &= test_function(try_composite, "Composite gram and combination",
+                             kEpsilon);
+    success &= test_function(try_view_gemm, "View GEMM", kEpsilon);
+    success &= test_function(try_view_strided, "View strided", kEpsilon);
+    success &= test_function(try_view_slab, "View slab", kEpsilon);
+    success &= test_function(try_view_data_fail, "View data fail", kException);
     mode = 0;
     alpha = random_double();
     beta = random_double();
@@ -2948,6 +5324,22 @@ int main(int argc, char *argv[])
     success &= test_function(try_contract_scalar, "Contract scalar", kEpsilon);
     success &=
         test_function(try_contract_hadamard, "Contract hadamard", kEpsilon);
+    success &= test_function(try_contract_hadamard_mid1,
+                             "Contract hadamard P-middle 1", kEpsilon);
+    success &= test_function(try_contract_hadamard_mid2,
+                             "Contract hadamard P-middle 2", kEpsilon);
+    success &= test_function(try_contract_hadamard_mid3,
+                             "Contract hadamard P-middle 3", kEpsilon);
+    success &= test_function(try_contract_hadamard_shapes,
+                             "Contract hadamard shapes", kEpsilon);
+    success &= test_function(try_contract_hadamard_random,
+                             "Contract hadamard random", kEpsilon);
+    success &= test_function(try_contract_layout_candidates,
+                             "Contract layout candidates", kEpsilon);
+    success &= test_function(try_contract_strided, "Contract strided kernel",
+                             kEpsilon);
+    success &= test_function(try_contract_layouts, "Contract tuned layouts",
+                             kEpsilon);
     success &= test_function(try_contract_dot, "Contract dot", kEpsilon);
     success &= test_function(try_contract_axpy1, "Contract axpy 1", kEpsilon);
     success &= test_function(try_contract_axpy2, "Contract axpy 2", kEpsilon);
@@ -2965,6 +5357,7 @@ int main(int argc, char *argv[])
     success &= test_function(try_contract_gemm6, "Contract gemm 6", kEpsilon);
     success &= test_function(try_contract_gemm7, "Contract gemm 7", kEpsilon);
     success &= test_function(try_contract_gemm8, "Contract gemm 8", kEpsilon);
+    success &= test_function(try_contract_scratch, "Contract scratch", kEpsilon);
     mode = 1;
     alpha = 1.0;
     beta = 0.0;
@@ -2974,6 +5367,16 @@ int main(int argc, char *argv[])
     success &= test_function(try_contract_scalar, "Contract scalar", kEpsilon);
     success &=
         test_function(try_contract_hadamard, "Contract hadamard", kEpsilon);
+    success &= test_function(try_contract_hadamard_mid1,
+                             "Contract hadamard P-middle 1", kEpsilon);
+    success &= test_function(try_contract_hadamard_mid2,
+                             "Contract hadamard P-middle 2", kEpsilon);
+    success &= test_function(try_contract_hadamard_mid3,
+                             "Contract hadamard P-middle 3", kEpsilon);
+    success &= test_function(try_contract_strided, "Contract strided kernel",
+                             kEpsilon);
+    success &= test_function(try_contract_layouts, "Contract tuned layouts",
+                             kEpsilon);
     success &= test_function(try_contract_dot, "Contract dot", kEpsilon);
     success &= test_function(try_contract_axpy1, "Contract axpy 1", kEpsilon);
     success &= test_function(try_contract_axpy2, "Contract axpy 2", kEpsilon);
@@ -3000,6 +5403,16 @@ int main(int argc, char *argv[])
     success &= test_function(try_contract_scalar, "Contract scalar", kEpsilon);
     success &=
         test_function(try_contract_hadamard, "Contract hadamard", kEpsilon);
+    success &= test_function(try_contract_hadamard_mid1,
+                             "Contract hadamard P-middle 1", kEpsilon);
+    success &= test_function(try_contract_hadamard_mid2,
+                             "Contract hadamard P-middle 2", kEpsilon);
+    success &= test_function(try_contract_hadamard_mid3,
+                             "Contract hadamard P-middle 3", kEpsilon);
+    success &= test_function(try_contract_strided, "Contract strided kernel",
+                             kEpsilon);
+    success &= test_function(try_contract_layouts, "Contract tuned layouts",
+                             kEpsilon);
     success &= test_function(try_contract_dot, "Contract dot", kEpsilon);
     success &= test_function(try_contract_axpy1, "Contract axpy 1", kEpsilon);
     success &= test_function(try_contract_axpy2, "Contract axpy 2", kEpsilon);
@@ -3026,6 +5439,16 @@ int main(int argc, char *argv[])
     success &= test_function(try_contract_scalar, "Contract scalar", kEpsilon);
     success &=
         test_function(try_contract_hadamard, "Contract hadamard", kEpsilon);
+    success &= test_function(try_contract_hadamard_mid1,
+                             "Contract hadamard P-middle 1", kEpsilon);
+    success &= test_function(try_contract_hadamard_mid2,
+                             "Contract hadamard P-middle 2", kEpsilon);
+    success &= test_function(try_contract_hadamard_mid3,
+                             "Contract hadamard P-middle 3", kEpsilon);
+    success &= test_function(try_contract_strided, "Contract strided kernel",
+                             kEpsilon);
+    success &= test_function(try_contract_layouts, "Contract tuned layouts",
+                             kEpsilon);
     success &= test_function(try_contract_dot, "Contract dot", kEpsilon);
     success &= test_function(try_contract_axpy1, "Contract axpy 1", kEpsilon);
     success &= test_function(try_contract_axpy2, "Contract axpy 2", kEpsilon);
@@ -3046,6 +5469,199 @@ int main(int argc, char *argv[])
     printf("%s\n", std::string(82, '-').c_str());
     printf("Tests: %s\n\n", success ? "All Passed" : "Some Failed");
 
+    printf("==> Disk Operations <==\n\n");
+    success = true;
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("%-50s %-9s %-9s %11s\n", "Description", "Expected", "Observed",
+           "Delta");
+    mode = 0;
+    alpha = 1.0;
+    beta = 0.0;
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("Explicit: alpha = %11.3E, beta = %11.3E\n", alpha, beta);
+    printf("%s\n", std::string(82, '-').c_str());
+    success &= test_function(try_disk_permute, "Disk permute", kEpsilon);
+    success &= test_function(try_disk_contract, "Disk contract", kEpsilon);
+    success &= test_function(try_disk_contract_core, "Disk contract into core",
+                             kEpsilon);
+    success &= test_function(try_disk_slice, "Disk slice", kEpsilon);
+    success &=
+        test_function(try_disk_compressed, "Disk compressed", kEpsilon);
+    success &=
+        test_function(try_disk_tile_cache, "Disk tile cache", kEpsilon);
+    success &= test_function(try_disk_cat, "Disk cat", kEpsilon);
+    success &= test_function(try_disk_map, "Disk map", kEpsilon);
+    success &= test_function(try_disk_lazy_zero, "Disk lazy zero", kEpsilon);
+    success &= test_function(try_lazy_contract, "Lazy contract", kEpsilon);
+    mode = 0;
+    alpha = random_double();
+    beta = random_double();
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("Explicit: alpha = %11.3E, beta = %11.3E\n", alpha, beta);
+    printf("%s\n", std::string(82, '-').c_str());
+    success &= test_function(try_disk_permute, "Disk permute", kEpsilon);
+    success &= test_function(try_disk_contract, "Disk contract", kEpsilon);
+    success &= test_function(try_disk_contract_core, "Disk contract into core",
+                             kEpsilon);
+    success &= test_function(try_disk_slice, "Disk slice", kEpsilon);
+    success &=
+        test_function(try_disk_compressed, "Disk compressed", kEpsilon);
+    success &=
+        test_function(try_disk_tile_cache, "Disk tile cache", kEpsilon);
+    success &= test_function(try_disk_cat, "Disk cat", kEpsilon);
+    success &= test_function(try_disk_map, "Disk map", kEpsilon);
+    success &= test_function(try_disk_lazy_zero, "Disk lazy zero", kEpsilon);
+    success &= test_function(try_lazy_contract, "Lazy contract", kEpsilon);
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("Tests: %s\n\n", success ? "All Passed" : "Some Failed");
+
+    printf("==> Packed Operations <==\n\n");
+    success = true;
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("%-50s %-9s %-9s %11s\n", "Description", "Expected", "Observed",
+           "Delta");
+    mode = 0;
+    alpha = 1.0;
+    beta = 0.0;
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("Explicit: alpha = %11.3E, beta = %11.3E\n", alpha, beta);
+    printf("%s\n", std::string(82, '-').c_str());
+    success &= test_function(try_packed_expand, "Packed expand", kEpsilon);
+    success &= test_function(try_packed_permute, "Packed permute", kEpsilon);
+    success &=
+        test_function(try_packed_contract1, "Packed contract 1", kEpsilon);
+    success &=
+        test_function(try_packed_contract2, "Packed contract 2", kEpsilon);
+    success &=
+        test_function(try_packed_contract3, "Packed contract 3", kEpsilon);
+    success &=
+        test_function(try_packed_contract4, "Packed contract 4", kEpsilon);
+    mode = 0;
+    alpha = random_double();
+    beta = random_double();
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("Explicit: alpha = %11.3E, beta = %11.3E\n", alpha, beta);
+    printf("%s\n", std::string(82, '-').c_str());
+    success &= test_function(try_packed_expand, "Packed expand", kEpsilon);
+    success &= test_function(try_packed_permute, "Packed permute", kEpsilon);
+    success &=
+        test_function(try_packed_contract1, "Packed contract 1", kEpsilon);
+    success &=
+        test_function(try_packed_contract2, "Packed contract 2", kEpsilon);
+    success &=
+        test_function(try_packed_contract3, "Packed contract 3", kEpsilon);
+    success &=
+        test_function(try_packed_contract4, "Packed contract 4", kEpsilon);
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("Tests: %s\n\n", success ? "All Passed" : "Some Failed");
+
+    printf("==> Factorized Operations <==\n\n");
+    success = true;
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("%-50s %-9s %-9s %11s\n", "Description", "Expected", "Observed",
+           "Delta");
+    mode = 0;
+    alpha = random_double();
+    beta = random_double();
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("Explicit: alpha = %11.3E, beta = %11.3E\n", alpha, beta);
+    printf("%s\n", std::string(82, '-').c_str());
+    success &=
+        test_function(try_factorized_cholesky, "Factorized Cholesky", kEpsilon);
+    success &= test_function(try_factorized_svd, "Factorized SVD", kEpsilon);
+    success &=
+        test_function(try_factorized_contract, "Factorized contract", kEpsilon);
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("Tests: %s\n\n", success ? "All Passed" : "Some Failed");
+
+    printf("==> Float Operations <==\n\n");
+    success = true;
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("%-50s %-9s %-9s %11s\n", "Description", "Expected", "Observed",
+           "Delta");
+    mode = 0;
+    alpha = random_double();
+    beta = random_double();
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("Explicit: alpha = %11.3E, beta = %11.3E\n", alpha, beta);
+    printf("%s\n", std::string(82, '-').c_str());
+    success &= test_function(try_float_round_trip, "Float round trip", kEpsilon);
+    success &= test_function(try_float_contract, "Float contract", kEpsilon);
+    success &= test_function(try_float_contract_mixed, "Float mixed contract",
+                             kEpsilon);
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("Tests: %s\n\n", success ? "All Passed" : "Some Failed");
+
+#if defined(HAVE_CUDA)
+    printf("==> GPU Operations <==\n\n");
+    success = true;
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("%-50s %-9s %-9s %11s\n", "Description", "Expected", "Observed",
+           "Delta");
+    mode = 0;
+    alpha = random_double();
+    beta = random_double();
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("Explicit: alpha = %11.3E, beta = %11.3E\n", alpha, beta);
+    printf("%s\n", std::string(82, '-').c_str());
+    success &= test_function(try_gpu_slice, "GPU slice", kEpsilon);
+    success &= test_function(try_gpu_contract, "GPU contract", kEpsilon);
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("Tests: %s\n\n", success ? "All Passed" : "Some Failed");
+#endif
+
+    printf("==> Graph Operations <==\n\n");
+    success = true;
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("%-50s %-9s %-9s %11s\n", "Description", "Expected", "Observed",
+           "Delta");
+    mode = 0;
+    alpha = 1.0;
+    beta = 0.0;
+    printf("%s\n", std::string(82, '-').c_str());
+    success &= test_function(try_graph_shared, "Graph shared product", kEpsilon);
+    success &= test_function(try_graph_ordering, "Graph ordering", kEpsilon);
+    success &=
+        test_function(try_graph_concurrent, "Graph concurrent", kEpsilon);
+    success &= test_function(try_graph_direct_calls, "Graph direct calls",
+                             kEpsilon);
+    success &=
+        test_function(try_graph_scalar_fail, "Graph scalar fail", kException);
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("Tests: %s\n\n", success ? "All Passed" : "Some Failed");
+
+    printf("==> Timer Operations <==\n\n");
+    success = true;
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("%-50s %-9s %-9s %11s\n", "Description", "Expected", "Observed",
+           "Delta");
+    printf("%s\n", std::string(82, '-').c_str());
+    success &= test_function(try_timer_export, "Timer export", kEpsilon);
+    success &=
+        test_function(try_timer_counters, "Timer hardware counters", kEpsilon);
+    success &= test_function(try_call_trace, "Call trace", kEpsilon);
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("Tests: %s\n\n", success ? "All Passed" : "Some Failed");
+
+    printf("==> Memory Accounting <==\n\n");
+    success = true;
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("%-50s %-9s %-9s %11s\n", "Description", "Expected", "Observed",
+           "Delta");
+    printf("%s\n", std::string(82, '-').c_str());
+    success &=
+        test_function(try_memory_accounting, "Memory accounting", kEpsilon);
+    success &=
+        test_function(try_memory_limit_fail, "Memory limit fail", kException);
+    success &= test_function(try_agnostic_placement, "Agnostic placement",
+                             kEpsilon);
+    success &= test_function(try_page_placement, "Page placement", kEpsilon);
+    success &= test_function(try_spill_to_disk, "Spill to disk", kEpsilon);
+    success &=
+        test_function(try_spill_compressed, "Spill compressed", kEpsilon);
+    printf("%s\n", std::string(82, '-').c_str());
+    printf("Tests: %s\n\n", success ? "All Passed" : "Some Failed");
+
     printf("==> Contract Exceptions <==\n\n");
     success = true;
     printf("%s\n", std::string(82, '-').c_str());
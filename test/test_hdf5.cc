@@ -90,6 +90,11 @@ void test_hdf5()
     testTensor.set_name("test2");
     write(test, testTensor);
 
+    // DiskTensor's are written from their mapping
+    Tensor diskTensor = Tensor::build(DiskTensor, "Disk Tensor", {7, 7});
+    diskTensor.copy(testTensor);
+    write(test, diskTensor);
+
     // Save to the HDF5 file to test against Mathematica.
     auto result = testTensor.gesvd();
     write(test, result["U"]);
@@ -97,6 +102,69 @@ void test_hdf5()
     write(test, result["Sigma"]);
 }
 
+bool test_hdf5_read()
+{
+    using namespace ambit::io::hdf5;
+
+    Tensor testTensor = build("Chunked", {60, 70});
+    initialize_random(testTensor);
+
+    File test("chunked.h5", kOpenModeCreateNew, kDeleteModeDeleteOnClose);
+
+    Storage storage;
+    storage.chunk = {16, 70};
+    storage.compression = kCompressionGzip;
+    write(test, testTensor, storage);
+
+    // Chunks of about 1 MB are chosen for compressed datasets
+    Storage automatic;
+    automatic.compression = kCompressionGzip;
+    Tensor large = Tensor::build(CoreTensor, "Large", {300, 1000});
+    large.set(2.0);
+    write(test, large, automatic);
+
+    bool success = true;
+
+    // Whole reads, into a vector and a tensor
+    Dataset<double> set(test, "Chunked");
+    std::vector<double> values;
+    set.read(values);
+    success &= set.dims() == Dimension({60, 70}) &&
+               values == testTensor.data();
+
+    Tensor readTensor = build("Read", {60, 70});
+    set.read(readTensor);
+    readTensor("ij") -= testTensor("ij");
+    success &= readTensor.norm() == 0.0;
+
+    Dataset<double> largeSet(test, "Large");
+    Tensor largeRead = Tensor::build(DiskTensor, "Large Read", {300, 1000});
+    largeSet.read(largeRead);
+    success &= largeRead.clone(CoreTensor).norm(1) == 2.0 * 300.0 * 1000.0;
+
+    // A hyperslab into a slice, leaving the rest of the tensor alone
+    Tensor slab = build("Slab", {10, 10});
+    slab.set(1.0);
+    set.read(slab, {{2, 7}, {3, 6}}, {{40, 45}, {50, 53}});
+    Tensor expected = build("Expected", {10, 10});
+    expected.set(1.0);
+    expected({{2, 7}, {3, 6}}) = testTensor({{40, 45}, {50, 53}});
+    slab("ij") -= expected("ij");
+    success &= slab.norm() == 0.0;
+
+    // A hyperslab write
+    Tensor piece = build("Piece", {5, 7});
+    piece.set(3.0);
+    set.write(piece, {{10, 15}, {0, 7}});
+    set.read(values);
+    success &= values[10 * 70] == 3.0 && values[14 * 70 + 6] == 3.0 &&
+               values[14 * 70 + 7] == testTensor.data()[14 * 70 + 7];
+
+    ambit::print("  HDF5 chunked reads and writes: %s\n",
+                 success ? "passed" : "failed");
+    return success;
+}
+
 int main(int argc, char *argv[])
 {
     srand(time(nullptr));
@@ -117,7 +185,8 @@ int main(int argc, char *argv[])
     }
 
     test_hdf5();
+    bool success = test_hdf5_read();
 
     ambit::finalize();
-    return EXIT_SUCCESS;
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
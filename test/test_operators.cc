@@ -27,6 +27,8 @@
  * @END LICENSE
  */
 
+#include <ambit/memory.h>
+#include <ambit/settings.h>
 #include <ambit/tensor.h>
 #include <cstring>
 #include <cstdlib>
@@ -836,6 +838,33 @@ double test_syev()
     return 0.0;
 }
 
+double test_syev_subset()
+{
+    size_t ni = 9;
+
+    Tensor C = build_and_fill("C", {ni, ni}, c2);
+
+    double diff = 0.0;
+    for (EigenvalueOrder order : {AscendingEigenvalue, DescendingEigenvalue})
+    {
+        auto full = C.syev(order);
+        auto part = C.syev(order, 4);
+        const std::vector<double> &fvecs = full["eigenvectors"].data();
+        const std::vector<double> &pvecs = part["eigenvectors"].data();
+        for (size_t k = 0; k < 4; ++k)
+        {
+            diff = std::max(diff, std::fabs(full["eigenvalues"].data()[k] -
+                                            part["eigenvalues"].data()[k]));
+            // The eigenvectors agree up to their sign
+            double dot = 0.0;
+            for (size_t j = 0; j < ni; ++j)
+                dot += fvecs[k * ni + j] * pvecs[k * ni + j];
+            diff = std::max(diff, std::fabs(std::fabs(dot) - 1.0));
+        }
+    }
+    return diff;
+}
+
 double test_geev()
 {
     size_t ni = 9;
@@ -1298,6 +1327,71 @@ double test_dot_product6()
     return std::fabs(D - d);
 }
 
+double test_dot_product7()
+{
+    size_t ni = 5, nj = 6, na = 7, nb = 4;
+
+    Tensor A = build_and_fill("A", {ni, nj, na, nb}, a4);
+    Tensor B = build_and_fill("B", {na, nb, ni, nj}, b4);
+    Tensor C = build_and_fill("C", {nj, ni, nb, na}, c4);
+
+    double D = 0.5 * A("i,j,a,b") * B("a,b,i,j") * C("j,i,b,a");
+    double d = 0.0;
+
+    for (size_t i = 0; i < ni; ++i)
+    {
+        for (size_t j = 0; j < nj; ++j)
+        {
+            for (size_t a = 0; a < na; ++a)
+            {
+                for (size_t b = 0; b < nb; ++b)
+                {
+                    d += 0.5 * a4[i][j][a][b] * b4[a][b][i][j] *
+                         c4[j][i][b][a];
+                }
+            }
+        }
+    }
+
+    return std::fabs(D - d);
+}
+
+double test_dot_product8()
+{
+    size_t ni = 9, nj = 6;
+
+    Tensor A = build_and_fill("A", {ni, nj}, a2);
+    Tensor B = build_and_fill("B", {nj, ni}, b2);
+    Tensor C = build_and_fill("C", {ni, nj}, c2);
+
+    double D = A("i,j") * (2.0 * B("j,i") - C("i,j"));
+    double d = 0.0;
+
+    for (size_t i = 0; i < ni; ++i)
+    {
+        for (size_t j = 0; j < nj; ++j)
+        {
+            d += a2[i][j] * (2.0 * b2[j][i] - c2[i][j]);
+        }
+    }
+
+    return std::fabs(D - d);
+}
+
+double test_dot_product9()
+{
+    size_t ni = 9, nj = 6, na = 5;
+
+    Tensor A = build_and_fill("A", {ni, na}, a2);
+    Tensor B = build_and_fill("B", {ni, na}, b2);
+    Tensor C = build_and_fill("C", {nj, na}, c2);
+
+    // The second addend leaves i and j unpaired
+    double D = A("i,a") * (B("i,a") + C("j,a"));
+
+    return std::fabs(D);
+}
+
 double test_chain_multiply()
 {
     size_t ni = 9, nj = 6, nk = 4, nl = 5;
@@ -1328,6 +1422,40 @@ double test_chain_multiply()
     return difference(D, d2).second;
 }
 
+double test_chain_multiply_tree()
+{
+    // The cheapest order is (A * B) * (C * D), which is not a chain
+    size_t ni = 2, na = 9, nb = 2, nc = 9, nj = 2;
+
+    Tensor A = build_and_fill("A", {ni, na}, a2);
+    Tensor B = build_and_fill("B", {na, nb}, b2);
+    Tensor C = build_and_fill("C", {nb, nc}, c2);
+    Tensor D = build_and_fill("D", {nc, nj}, d2);
+    Tensor E = build_and_fill("E", {ni, nj}, e2);
+
+    E("ij") = A("ia") * C("bc") * B("ab") * D("cj");
+
+    for (size_t i = 0; i < ni; ++i)
+    {
+        for (size_t j = 0; j < nj; ++j)
+        {
+            e2[i][j] = 0.0;
+            for (size_t a = 0; a < na; ++a)
+            {
+                for (size_t b = 0; b < nb; ++b)
+                {
+                    for (size_t c = 0; c < nc; ++c)
+                    {
+                        e2[i][j] += a2[i][a] * b2[a][b] * c2[b][c] * d2[c][j];
+                    }
+                }
+            }
+        }
+    }
+
+    return difference(E, e2).second;
+}
+
 double test_chain_multiply2()
 {
     size_t ni = 5;
@@ -1668,6 +1796,121 @@ double test_chain_multiply4_batched()
     return difference(D4, d4).second;
 }
 
+/// D4("ijkl") = A4("ijmn") * B2("km") * C2("ln") under a memory limit that
+/// only leaves room for the intermediates of a few values of i at a time
+double test_chain_multiply_batched_chunks(bool automatic)
+{
+    size_t ni = 9;
+    size_t nj = 6;
+    size_t nk = 7;
+    size_t nl = 6;
+    size_t nm = 7;
+    size_t nn = 5;
+
+    std::vector<size_t> dimsA = {ni, nj, nm, nn};
+    std::vector<size_t> dimsB = {nk, nm};
+    std::vector<size_t> dimsC = {nl, nn};
+    std::vector<size_t> dimsD = {ni, nj, nk, nl};
+
+    Tensor A4 = build_and_fill("A4", dimsA, a4);
+    Tensor B2 = build_and_fill("B2", dimsB, b2);
+    Tensor C2 = build_and_fill("C2", dimsC, c2);
+    Tensor D4 = build_and_fill("D4", dimsD, d4);
+
+    // The intermediate A4 * B2 holds nj * nk * nn elements per value of i
+    size_t memory_limit = settings::memory_limit;
+    settings::memory_limit =
+        memory::live_bytes() + 4 * nj * nk * nn * sizeof(double);
+    if (automatic)
+        D4("ijkl") -= batched(A4("ijmn") * B2("km") * C2("ln"));
+    else
+        D4("ijkl") -= batched("i", A4("ijmn") * B2("km") * C2("ln"));
+    settings::memory_limit = memory_limit;
+
+    for (size_t i = 0; i < ni; ++i)
+    {
+        for (size_t j = 0; j < nj; ++j)
+        {
+            for (size_t k = 0; k < nk; ++k)
+            {
+                for (size_t l = 0; l < nl; ++l)
+                {
+                    for (size_t m = 0; m < nm; ++m)
+                    {
+                        for (size_t n = 0; n < nn; ++n)
+                        {
+                            d4[i][j][k][l] -=
+                                a4[i][j][m][n] * b2[k][m] * c2[l][n];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return difference(D4, d4).second;
+}
+
+double test_batched_chunks() { return test_chain_multiply_batched_chunks(false); }
+
+double test_batched_auto() { return test_chain_multiply_batched_chunks(true); }
+
+/// D4("ijkl") -= batched(A4("ijmn") * B2("km") * C2("ln")) with A4 and D4 on
+/// disk, so that the batches of both are staged in memory
+double test_batched_disk()
+{
+    size_t ni = 9;
+    size_t nj = 6;
+    size_t nk = 7;
+    size_t nl = 6;
+    size_t nm = 7;
+    size_t nn = 5;
+
+    std::vector<size_t> dimsA = {ni, nj, nm, nn};
+    std::vector<size_t> dimsB = {nk, nm};
+    std::vector<size_t> dimsC = {nl, nn};
+    std::vector<size_t> dimsD = {ni, nj, nk, nl};
+
+    Tensor A4 = build_and_fill("A4", dimsA, a4);
+    Tensor B2 = build_and_fill("B2", dimsB, b2);
+    Tensor C2 = build_and_fill("C2", dimsC, c2);
+    Tensor D4 = build_and_fill("D4", dimsD, d4);
+    Tensor A4disk = Tensor::build(DiskTensor, "A4 disk", dimsA);
+    Tensor D4disk = Tensor::build(DiskTensor, "D4 disk", dimsD);
+    A4disk.copy(A4);
+    D4disk.copy(D4);
+
+    size_t memory_limit = settings::memory_limit;
+    settings::memory_limit =
+        memory::live_bytes() + 8 * nj * nk * nl * sizeof(double);
+    D4disk("ijkl") -= batched("i", A4disk("ijmn") * B2("km") * C2("ln"));
+    settings::memory_limit = memory_limit;
+    D4.copy(D4disk);
+
+    for (size_t i = 0; i < ni; ++i)
+    {
+        for (size_t j = 0; j < nj; ++j)
+        {
+            for (size_t k = 0; k < nk; ++k)
+            {
+                for (size_t l = 0; l < nl; ++l)
+                {
+                    for (size_t m = 0; m < nm; ++m)
+                    {
+                        for (size_t n = 0; n < nn; ++n)
+                        {
+                            d4[i][j][k][l] -=
+                                a4[i][j][m][n] * b2[k][m] * c2[l][n];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return difference(D4, d4).second;
+}
+
 double test_batched()
 {
     size_t ni = 5;
@@ -1878,6 +2121,8 @@ int main(int argc, char *argv[])
         std::make_tuple(kPass, test_Dij_equal_negate_Aij_plus_Bij,
                         "C(\"ij\") = - (A(\"ij\") - B(\"ij\"))"),
         std::make_tuple(kPass, test_syev, "Diagonalization (not confirmed)"),
+        std::make_tuple(kPass, test_syev_subset,
+                        "Diagonalization of a subset of eigenpairs"),
         std::make_tuple(kPass, test_geev, "Diagonalization (not confirmed)"),
         std::make_tuple(kPass, test_power, "C^(-1/2) (not confirmed)"),
         std::make_tuple(kPass, test_dot_product,
@@ -1893,8 +2138,19 @@ int main(int argc, char *argv[])
         std::make_tuple(
             kPass, test_dot_product6,
             "double D = A(\"i,j\") * B(\"j,k,l,m\") * C(\"m,l,k,i\")"),
+        std::make_tuple(
+            kPass, test_dot_product7,
+            "double D = 0.5 * A(\"i,j,a,b\") * B(\"a,b,i,j\") * C(\"j,i,b,a\")"),
+        std::make_tuple(kPass, test_dot_product8,
+                        "double D = A(\"i,j\") * (2.0 * B(\"j,i\") - C(\"i,j\"))"),
+        std::make_tuple(
+            kException, test_dot_product9,
+            "double D = A(\"i,a\") * (B(\"i,a\") + C(\"j,a\")) exception expected"),
         std::make_tuple(kPass, test_chain_multiply,
                         "D(\"ij\") = B(\"ik\") * C(\"kl\") * A(\"lj\")"),
+        std::make_tuple(
+            kPass, test_chain_multiply_tree,
+            "E(\"ij\") = A(\"ia\") * C(\"bc\") * B(\"ab\") * D(\"cj\")"),
         std::make_tuple(
             kPass, test_chain_multiply2,
             "D4(\"ijkl\") = A4(\"ijmn\") * B2(\"km\") * C2(\"ln\")"),
@@ -1916,6 +2172,15 @@ int main(int argc, char *argv[])
         std::make_tuple(
             kPass, test_chain_multiply4_batched,
             "D4(\"ijkl\") -= batched(\"kl\",A4(\"ijmn\") * B2(\"km\") * C2(\"ln\"))"),
+        std::make_tuple(
+            kPass, test_batched_chunks,
+            "D4(\"ijkl\") -= batched(\"i\",A4(\"ijmn\") * B2(\"km\") * C2(\"ln\")) (chunks)"),
+        std::make_tuple(
+            kPass, test_batched_auto,
+            "D4(\"ijkl\") -= batched(A4(\"ijmn\") * B2(\"km\") * C2(\"ln\"))"),
+        std::make_tuple(
+            kPass, test_batched_disk,
+            "D4(\"ijkl\") -= batched(\"i\",A4(\"ijmn\") * B2(\"km\") * C2(\"ln\")) (disk)"),
         std::make_tuple(
             kPass, test_batched,
             "D4(\"ijkl\") += batched(\"ijkl\", A4(\"ijmn\") * B2(\"km\") * B2(\"ln\"))"),
@@ -133,6 +133,35 @@ void test_performance()
                });
     }
 
+    // T1-type contractions, which reduce to BLAS1/BLAS2 calls
+    int t1_repeats = 100 * repeats;
+
+    {
+        Tensor Giajb = build("Giajb", {no, nv, no, nv});
+        Tensor R1 = build("R1", {no, nv});
+        timing("5. R1ia = Giajb * T1jb (GEMV)", t1_repeats, [&]
+               {
+                   R1("i,a") = Giajb("i,a,j,b") * T1("j,b");
+               });
+    }
+
+    {
+        Tensor Wiajb = build("Wiajb", {no, nv, no, nv});
+        timing("6. Wiajb = T1ia * T1jb (GER)", t1_repeats, [&]
+               {
+                   Wiajb("i,a,j,b") = T1("i,a") * T1("j,b");
+               });
+    }
+
+    {
+        Tensor Fia = build("Fia", {no, nv});
+        Tensor E = build("E", {});
+        timing("7. E = T1ia * Fia (DOT)", t1_repeats, [&]
+               {
+                   E.contract(T1, Fia, {}, {"i", "a"}, {"i", "a"});
+               });
+    }
+
     //    {
     //        Tensor Wefab = build("Wefab", {nv, nv, nv, nv});
     //        Tensor Gabci = build("Gabci", {nv, nv, nv, no});
@@ -28,7 +28,9 @@
  */
 
 #include <ambit/sym_blocked_tensor.h>
+#include <ambit/io/hdf5.h>
 #include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <stdexcept>
 
@@ -340,6 +342,227 @@ double test_add_mo_space_no_mos()
     return 0.0;
 }
 
+/// Occupied MOs 0-3 and virtual MOs 4-8 spread over the irreps of C2v/D2
+void set_sym_mo_spaces()
+{
+    SymBlockedTensor::reset_mo_spaces();
+    SymBlockedTensor::add_mo_space("o", "i,j,k,l", 4,
+                                   {{0, 0}, {1, 0}, {2, 1}, {3, 3}}, AlphaSpin);
+    SymBlockedTensor::add_mo_space(
+        "v", "a,b,c,d", 4, {{4, 0}, {5, 1}, {6, 2}, {7, 3}, {8, 0}}, AlphaSpin);
+}
+
+void sym_fill_random(SymBlockedTensor &T)
+{
+    T.iterate([](const std::vector<size_t> &, const std::vector<int> &,
+                 double &value) {
+        value = double(std::rand()) / double(RAND_MAX);
+    });
+}
+
+/// The dense tensor over the "o" (MOs 0-3) and "v" (MOs 4-8) spaces
+Tensor sym_to_dense(const SymBlockedTensor &T, const std::string &spaces)
+{
+    Dimension dims;
+    std::vector<size_t> offsets;
+    for (char space : spaces)
+    {
+        dims.push_back(space == 'o' ? 4 : 5);
+        offsets.push_back(space == 'o' ? 0 : 4);
+    }
+    Tensor D = Tensor::build(CoreTensor, T.name() + " (dense)", dims);
+    std::vector<double> &data = D.data();
+    T.citerate([&](const std::vector<size_t> &mo, const std::vector<int> &,
+                   const double &value) {
+        size_t offset = 0;
+        for (size_t n = 0; n < mo.size(); ++n)
+            offset = offset * dims[n] + mo[n] - offsets[n];
+        data[offset] = value;
+    });
+    return D;
+}
+
+double sym_difference(const Tensor &A, const Tensor &B)
+{
+    const std::vector<double> &Av = A.data();
+    const std::vector<double> &Bv = B.data();
+    double diff = 0.0;
+    for (size_t n = 0; n < Av.size(); ++n)
+        diff = std::max(diff, std::fabs(Av[n] - Bv[n]));
+    return diff;
+}
+
+double test_sym_block_creation()
+{
+    set_sym_mo_spaces();
+    SymBlockedTensor T = SymBlockedTensor::build(CoreTensor, "T", {"oovv"});
+
+    // Count the irrep combinations whose direct product is totally symmetric
+    // and whose blocks hold orbitals
+    std::vector<size_t> odim = {2, 1, 0, 1};
+    std::vector<size_t> vdim = {2, 1, 1, 1};
+    size_t count = 0;
+    for (int h0 = 0; h0 < 4; ++h0)
+        for (int h1 = 0; h1 < 4; ++h1)
+            for (int h2 = 0; h2 < 4; ++h2)
+            {
+                int h3 = h0 ^ h1 ^ h2;
+                if (odim[h0] * odim[h1] * vdim[h2] * vdim[h3] > 0)
+                    count++;
+            }
+    return static_cast<double>(T.numblocks()) - static_cast<double>(count);
+}
+
+double test_sym_block_retrieve()
+{
+    set_sym_mo_spaces();
+    SymBlockedTensor T = SymBlockedTensor::build(CoreTensor, "T", {"ov"});
+    // o(1) x v(2) is not totally symmetric
+    T.block("ov", {1, 2});
+    return 0.0;
+}
+
+double test_sym_permute()
+{
+    set_sym_mo_spaces();
+    SymBlockedTensor A = SymBlockedTensor::build(CoreTensor, "A", {"oovv"});
+    SymBlockedTensor C = SymBlockedTensor::build(CoreTensor, "C", {"vovo"});
+    sym_fill_random(A);
+    sym_fill_random(C);
+    Tensor Ad = sym_to_dense(A, "oovv");
+    Tensor Cd = sym_to_dense(C, "vovo");
+
+    C("bjai") += 0.5 * A("ijab");
+    Cd("bjai") += 0.5 * Ad("ijab");
+    return sym_difference(sym_to_dense(C, "vovo"), Cd);
+}
+
+double test_sym_contraction1()
+{
+    set_sym_mo_spaces();
+    SymBlockedTensor A = SymBlockedTensor::build(CoreTensor, "A", {"oovv"});
+    SymBlockedTensor B = SymBlockedTensor::build(CoreTensor, "B", {"vvvv"});
+    SymBlockedTensor C = SymBlockedTensor::build(CoreTensor, "C", {"oovv"});
+    sym_fill_random(A);
+    sym_fill_random(B);
+    sym_fill_random(C);
+    Tensor Ad = sym_to_dense(A, "oovv");
+    Tensor Bd = sym_to_dense(B, "vvvv");
+    Tensor Cd = sym_to_dense(C, "oovv");
+
+    C("ijab") -= A("ijcd") * B("cdab");
+    Cd("ijab") -= Ad("ijcd") * Bd("cdab");
+    return sym_difference(sym_to_dense(C, "oovv"), Cd);
+}
+
+double test_sym_contraction2()
+{
+    // Contraction of two tensors of irrep 1 into a totally symmetric one
+    set_sym_mo_spaces();
+    SymBlockedTensor X = SymBlockedTensor::build(CoreTensor, "X", {"ov"}, 1);
+    SymBlockedTensor Y = SymBlockedTensor::build(CoreTensor, "Y", {"vo"}, 1);
+    SymBlockedTensor C = SymBlockedTensor::build(CoreTensor, "C", {"oo"});
+    sym_fill_random(X);
+    sym_fill_random(Y);
+    Tensor Xd = sym_to_dense(X, "ov");
+    Tensor Yd = sym_to_dense(Y, "vo");
+    Tensor Cd = Tensor::build(CoreTensor, "Cd", {4, 4});
+
+    C("ij") = X("ia") * Y("aj");
+    Cd("ij") = Xd("ia") * Yd("aj");
+    return sym_difference(sym_to_dense(C, "oo"), Cd);
+}
+
+double test_sym_dot_product()
+{
+    set_sym_mo_spaces();
+    SymBlockedTensor A = SymBlockedTensor::build(CoreTensor, "A", {"oovv"});
+    SymBlockedTensor B = SymBlockedTensor::build(CoreTensor, "B", {"oovv"});
+    sym_fill_random(A);
+    sym_fill_random(B);
+    double E = 0.25 * A("ijab") * B("ijab");
+    double Ed = 0.25 * sym_to_dense(A, "oovv")("ijab") *
+                sym_to_dense(B, "oovv")("ijab");
+    return E - Ed;
+}
+
+double test_sym_syev_power_inverse()
+{
+    set_sym_mo_spaces();
+    SymBlockedTensor F = SymBlockedTensor::build(CoreTensor, "F", {"oo", "vv"});
+    sym_fill_random(F);
+    // Make each block symmetric and positive definite
+    for (const auto &key_tensor : F.blocks())
+    {
+        Tensor B = key_tensor.second;
+        Tensor S = B.clone();
+        B("pq") = S("rp") * S("rq");
+        for (size_t p = 0; p < B.dim(0); ++p)
+            B.data()[p * B.dim(0) + p] += 1.0;
+    }
+
+    std::map<std::string, SymBlockedTensor> diag =
+        F.syev(AscendingEigenvalue);
+    SymBlockedTensor Finv = F.inverse();
+    SymBlockedTensor Fhalf = F.power(0.5);
+
+    double diff = 0.0;
+    for (const auto &key_tensor : F.blocks())
+    {
+        const SymBlockKey &key = key_tensor.first;
+        Tensor B = key_tensor.second;
+        size_t n = B.dim(0);
+        Tensor I = Tensor::build(CoreTensor, "I", {n, n});
+        for (size_t p = 0; p < n; ++p)
+            I.data()[p * n + p] = 1.0;
+
+        // V F V^T holds the eigenvalues on its diagonal
+        Tensor V = diag["eigenvectors"].block(key);
+        Tensor D = Tensor::build(CoreTensor, "D", {n, n});
+        D("pq") = V("pr") * B("rs") * V("qs");
+        D("pq") -= diag["eigenvalues"].block(key)("pq");
+        // F^-1 F = 1 and F^1/2 F^1/2 = F
+        Tensor E = Tensor::build(CoreTensor, "E", {n, n});
+        E("pq") = Finv.block(key)("pr") * B("rq");
+        E("pq") -= I("pq");
+        Tensor H = Tensor::build(CoreTensor, "H", {n, n});
+        H("pq") = Fhalf.block(key)("pr") * Fhalf.block(key)("rq");
+        H("pq") -= B("pq");
+        for (const Tensor &T : {D, E, H})
+            diff = std::max(diff, T.norm(0));
+    }
+    return diff;
+}
+
+double test_sym_checkpoint()
+{
+    set_sym_mo_spaces();
+    SymBlockedTensor A =
+        SymBlockedTensor::build(CoreTensor, "A", {"oovv"}, 1);
+    sym_fill_random(A);
+    A.save_async("sym_checkpoint.h5").get();
+
+    SymBlockedTensor L;
+    {
+        io::hdf5::File file("sym_checkpoint.h5",
+                            io::hdf5::kOpenModeOpenExisting);
+        L = SymBlockedTensor::load(file);
+    }
+    if (L.symmetry() != 1 || L.blocks().size() != A.blocks().size())
+        return 1.0;
+
+    double diff = 0.0;
+    for (const auto &key_tensor : A.blocks())
+    {
+        Tensor D = key_tensor.second.clone();
+        D("pqrs") -= L.block(key_tensor.first)("pqrs");
+        diff = std::max(diff, D.norm(0));
+    }
+    // The blocks of L were read on first use, so the file goes last
+    std::remove("sym_checkpoint.h5");
+    return diff;
+}
+
 /*
 
 
@@ -1892,6 +2115,24 @@ int main(int argc, char *argv[])
                         "Testing adding orbital space with no indices (2)"),
         std::make_tuple(kPass, test_add_mo_space_no_mos,
                         "Testing adding orbital space with no orbital list"),
+        std::make_tuple(kPass, test_sym_block_creation,
+                        "Testing symmetry-allowed block creation"),
+        std::make_tuple(kException, test_sym_block_retrieve,
+                        "Testing retrieving a symmetry-forbidden block"),
+        std::make_tuple(kPass, test_sym_permute,
+                        "Testing C(\"bjai\") += 0.5 * A(\"ijab\")"),
+        std::make_tuple(
+            kPass, test_sym_contraction1,
+            "Testing C(\"ijab\") -= A(\"ijcd\") * B(\"cdab\")"),
+        std::make_tuple(
+            kPass, test_sym_contraction2,
+            "Testing C(\"ij\") = X(\"ia\") * Y(\"aj\") (irrep 1)"),
+        std::make_tuple(kPass, test_sym_dot_product,
+                        "Testing 0.25 * A(\"ijab\") * B(\"ijab\")"),
+        std::make_tuple(kPass, test_sym_checkpoint,
+                        "Testing checkpoint save and load"),
+        std::make_tuple(kPass, test_sym_syev_power_inverse,
+                        "Testing syev, power and inverse per irrep block"),
         /*
         std::make_tuple(kPass, test_block_creation1,
                         "Testing blocked tensor creation (1)"),